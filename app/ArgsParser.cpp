@@ -2,7 +2,9 @@
 
 #include <iostream>
 #include <format>
+#include <fstream>
 #include <cstdlib>
+#include <string_view>
 
 ArgsParser::ArgsParser(const std::vector<std::string>& args) {
     auto Duplicate = [](const std::string& name) {
@@ -54,4 +56,96 @@ ArgsParser::ArgsParser(const std::vector<std::string>& args) {
             ordered.push_back(arg);
         }
     }
-}
\ No newline at end of file
+
+    if (HasValue("config"))
+        ReadConfig(values["config"]);
+}
+
+// Takes the subset of TOML flat arguments need: tables, integers, strings,
+// booleans and # comments. Arrays and inline tables aren't arguments
+void ArgsParser::ReadConfig(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << std::format("Could not open config {}", path) << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    auto Fail = [&](size_t line, const std::string& message) {
+        std::cerr << std::format("{}:{}: {}", path, line, message) << std::endl;
+        std::exit(EXIT_FAILURE);
+    };
+
+    auto Trim = [](std::string_view text) {
+        auto first = text.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos) return std::string_view();
+
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    };
+
+    std::unordered_set<std::string> seen;
+    std::string text;
+
+    for (size_t line = 1; std::getline(file, text); line++) {
+        std::string_view entry = text;
+
+        // A # inside a string isn't a comment
+        bool quoted = false;
+        for (size_t i = 0; i < entry.size(); i++) {
+            if (entry[i] == '"' && (i == 0 || entry[i - 1] != '\\')) quoted = !quoted;
+            if (entry[i] == '#' && !quoted) {
+                entry = entry.substr(0, i);
+                break;
+            }
+        }
+
+        entry = Trim(entry);
+        if (entry.empty()) continue;
+
+        if (entry.front() == '[') {
+            if (entry.back() != ']') Fail(line, "Unterminated table header");
+            continue;
+        }
+
+        auto equals = entry.find('=');
+        if (equals == std::string_view::npos) Fail(line, std::format("Expected key = value, got '{}'", entry));
+
+        std::string name(Trim(entry.substr(0, equals)));
+        auto value = Trim(entry.substr(equals + 1));
+
+        if (name.empty() || value.empty()) Fail(line, "Empty key or value");
+        if (!seen.insert(name).second) Fail(line, std::format("Key {} has already been defined", name));
+
+        // The command line overrides the file
+        if (HasValue(name) || flags.contains(name)) continue;
+
+        if (value == "true") {
+            flags.insert(name);
+        }
+        else if (value == "false") {
+            continue;
+        }
+        else if (value.front() == '"') {
+            if (value.size() < 2 || value.back() != '"') Fail(line, "Unterminated string");
+
+            std::string unescaped;
+            for (size_t i = 1; i + 1 < value.size(); i++) {
+                if (value[i] == '\\' && i + 2 < value.size()) i++;
+                unescaped += value[i];
+            }
+
+            values[name] = unescaped;
+        }
+        else if (value.front() == '[' || value.front() == '{') {
+            Fail(line, std::format("Key {} can't be an array or table", name));
+        }
+        else {
+            // TOML allows 1_000_000
+            std::string number;
+            for (auto c : value) {
+                if (c != '_') number += c;
+            }
+
+            values[name] = number;
+        }
+    }
+}
@@ -13,14 +13,24 @@ private:
     std::unordered_set<std::string> flags;
     std::vector<std::string> ordered;
 
+    void ReadConfig(const std::string& path);
+
 public:
+    // --config=<file> reads more arguments from a TOML file. Its keys are
+    // the argument names, tables only group them, and anything given on
+    // the command line wins over the file
     ArgsParser(const std::vector<std::string>& args);
 
     inline bool HasValue(const std::string& arg) const {
         return values.contains(arg);
     }
 
+    // --name=true and --name=false set a flag too, so the command line can
+    // turn off one that the config turned on
     inline bool HasFlag(const std::string& arg) const {
+        if (auto value = values.find(arg); value != values.end())
+            return value->second == "true";
+
         return flags.contains(arg);
     }
 
@@ -31,10 +41,10 @@ public:
         
         if constexpr (std::is_integral_v<T>) {
             if constexpr (std::is_unsigned_v<T>)
-                return std::stoull(values[arg]);
+                return std::stoull(values[arg], nullptr, 0);
             
             else
-                return std::stoll(values[arg]);
+                return std::stoll(values[arg], nullptr, 0);
         }
         else
             return T(values[arg]);
@@ -47,10 +57,10 @@ public:
         
         if constexpr (std::is_integral_v<T>) {
             if constexpr (std::is_unsigned_v<T>)
-                return std::stoull(values[arg]);
+                return std::stoull(values[arg], nullptr, 0);
             
             else
-                return std::stoll(values[arg]);
+                return std::stoll(values[arg], nullptr, 0);
         }
         else
             return T(values[arg]);
@@ -0,0 +1,51 @@
+#include "Console.hpp"
+
+#include <iostream>
+
+ConsoleWriter::ConsoleWriter(std::ostream& out) : out{out} {
+    thread = std::jthread([this](std::stop_token stop) { Drain(stop); });
+}
+
+ConsoleWriter::~ConsoleWriter() {
+    // Drain writes out whatever is left before it sees the stop
+    thread.request_stop();
+    thread.join();
+}
+
+void ConsoleWriter::Drain(std::stop_token stop) {
+    std::unique_lock guard(lock);
+
+    while (ready.wait(guard, stop, [&] { return !pending.empty(); })) {
+        std::swap(pending, writing);
+        busy = true;
+        guard.unlock();
+
+        out.write(writing.data(), writing.size());
+        out.flush();
+        writing.clear();
+
+        guard.lock();
+        busy = false;
+        drained.notify_all();
+    }
+}
+
+void ConsoleWriter::Write(std::string_view text) {
+    if (text.empty()) return;
+
+    std::unique_lock guard(lock);
+    drained.wait(guard, [&] { return pending.size() < MAX_PENDING; });
+
+    pending += text;
+    ready.notify_one();
+}
+
+void ConsoleWriter::Flush() {
+    std::unique_lock guard(lock);
+    drained.wait(guard, [&] { return pending.empty() && !busy; });
+}
+
+ConsoleWriter& GetConsole() {
+    static ConsoleWriter console(std::cout);
+    return console;
+}
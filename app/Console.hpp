@@ -0,0 +1,49 @@
+#ifndef APP_CONSOLE_HPP
+#define APP_CONSOLE_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Guest console output, written out on its own thread so a hart only
+// copies its text into a buffer. Writers wait only when the output falls
+// MAX_PENDING bytes behind
+class ConsoleWriter {
+private:
+    static constexpr size_t MAX_PENDING = 0x100000;
+
+    std::ostream& out;
+
+    std::mutex lock;
+    std::condition_variable_any ready;
+    std::condition_variable drained;
+
+    // Filled by writers while the thread writes out the other one
+    std::string pending;
+    std::string writing;
+    bool busy = false;
+
+    std::jthread thread;
+
+    void Drain(std::stop_token stop);
+
+public:
+    ConsoleWriter(std::ostream& out);
+    ~ConsoleWriter();
+
+    ConsoleWriter(const ConsoleWriter&) = delete;
+    ConsoleWriter& operator=(const ConsoleWriter&) = delete;
+
+    void Write(std::string_view text);
+
+    // Waits until everything written so far has reached the stream
+    void Flush();
+};
+
+// The console ecall_cout writes to
+ConsoleWriter& GetConsole();
+
+#endif
@@ -1,22 +1,45 @@
 #include "ECalls.hpp"
 
+#include <CLINT.hpp>
+#include <ConsoleDevice.hpp>
 #include <VirtualMachine.hpp>
 
-#include "Framebuffer.hpp"
-#include "VirtualMachines.hpp"
+#include "Console.hpp"
+#include "Screen.hpp"
 
+#include <array>
 #include <iostream>
 #include <string>
 #include <format>
 #include <cstdlib>
+#include <functional>
+#include <span>
+#include <algorithm>
 
 using VM = VirtualMachine;
 using Regs = std::array<VM::Reg, VM::REGISTER_COUNT>;
 using FRegs = std::array<Float, VM::REGISTER_COUNT>;
 
-void ECallCOut(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
-    std::string str = "";
+static std::function<void(Memory&, int)> exit_handler = [](Memory&, int exit_code) {
+    GetConsole().Flush();
+    std::exit(exit_code);
+};
+
+static std::function<void(Hart)> snapshot_handler;
+
+void SetExitHandler(std::function<void(Memory&, int)> handler) {
+    exit_handler = std::move(handler);
+}
+
+void SetSnapshotHandler(std::function<void(Hart)> handler) {
+    snapshot_handler = std::move(handler);
+}
+
+// Text is copied out in chunks, so a long write doesn't need a buffer
+// the size of itself
+static constexpr Address COUT_CHUNK = 0x1000;
 
+void ECallCOut(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     Address addr;
     if (is_32_bit_mode) addr = regs[VM::REG_A1].u32;
     else addr = regs[VM::REG_A1].u64;
@@ -25,24 +48,30 @@ void ECallCOut(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     if (is_32_bit_mode) size = regs[VM::REG_A2].u32;
     else size = regs[VM::REG_A2].u64;
 
-    for (Address i = 0; i < size; addr++, i++) {
-        Byte byte = memory.ReadByte(addr);
-        str += static_cast<char>(byte);
-    }
+    thread_local std::array<char, COUT_CHUNK> chunk;
 
-    std::cout << str << std::flush;
+    for (Address done = 0; done < size;) {
+        Address count = std::min(size - done, COUT_CHUNK);
+        memory.ReadBytes(addr + done, std::span(reinterpret_cast<Byte*>(chunk.data()), count));
+
+        GetConsole().Write(std::string_view(chunk.data(), count));
+        done += count;
+    }
 }
 
 void ECallCIn(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     std::string str = "";
 
+    // A prompt written just before has to show up before we wait
+    GetConsole().Flush();
+
     if (!std::getline(std::cin, str)) {
         if (is_32_bit_mode) regs[VM::REG_A0].u32 = 0;
         else regs[VM::REG_A0].u64 = 0;
         return;
     }
 
-    Address i, addr;
+    Address addr;
 
     if (is_32_bit_mode) addr = regs[VM::REG_A1].u32;
     else addr = regs[VM::REG_A1].u64;
@@ -52,21 +81,30 @@ void ECallCIn(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     if (is_32_bit_mode) size = regs[VM::REG_A2].u32;
     else size = regs[VM::REG_A2].u64;
 
-    for (i = 0, addr = addr; i < str.size() && i < size && addr < memory.GetTotalMemory(); i++, addr++) {
-        memory.WriteByte(addr, str[i]);
-    }
+    Address i = std::min<Address>(str.size(), size);
+    memory.WriteBytes(addr, std::span(reinterpret_cast<const Byte*>(str.data()), i));
 
     if (is_32_bit_mode) regs[VM::REG_A0].u32 = static_cast<uint32_t>(i);
     else regs[VM::REG_A0].u64 = i;
 }
 
-void ECallStartCPU(Hart hart, bool is_32_bit_mode, Memory&, Regs& regs, FRegs&) {
+// Harts are found through the caller's CLINT, so a host running several
+// machines only ever hands a guest its own
+static Hart GetHartCount(const Memory& memory) {
+    auto clint = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+    return clint ? clint->GetHartCount() : 0;
+}
+
+void ECallStartCPU(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     Hart target_hart;
 
     if (is_32_bit_mode) target_hart = regs[VM::REG_A1].u32;
     else target_hart = regs[VM::REG_A1].u64;
-    
-    if (target_hart > vms.size()) {
+
+    auto clint = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+    auto target = clint ? clint->GetHart(target_hart) : nullptr;
+
+    if (!target) {
         std::cerr << std::format("Unknown hart {}", target_hart) << std::endl;
         std::exit(EXIT_FAILURE);
     }
@@ -76,7 +114,7 @@ void ECallStartCPU(Hart hart, bool is_32_bit_mode, Memory&, Regs& regs, FRegs&)
     if (is_32_bit_mode) start = regs[VM::REG_A2].u32;
     else start = regs[VM::REG_A2].u64;
 
-    vms[target_hart]->Restart(start, hart);
+    target->RequestStart(start);
 }
 
 void ECallGetCPUs(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
@@ -85,13 +123,15 @@ void ECallGetCPUs(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&)
     if (is_32_bit_mode) address = regs[VM::REG_A1].u32;
     else address = regs[VM::REG_A1].u64;
 
+    Hart count = GetHartCount(memory);
+
     if (address != 0) {
-        for (Long i = 0; i < vms.size(); i++)
+        for (Long i = 0; i < count; i++)
             memory.WriteWord(address + i * sizeof(Hart), i);
     }
 
-    if (is_32_bit_mode) regs[VM::REG_A0].u32 = static_cast<Word>(vms.size());
-    else regs[VM::REG_A0].u64 = static_cast<Long>(vms.size());
+    if (is_32_bit_mode) regs[VM::REG_A0].u32 = static_cast<Word>(count);
+    else regs[VM::REG_A0].u64 = static_cast<Long>(count);
 }
 
 void ECallGetScreenAddress(Hart, bool is_32_bit_mode, Memory&, Regs& regs, FRegs&) {
@@ -115,12 +155,29 @@ void ECallGetScreenSize(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, F
     memory.WriteWord(static_cast<Address>(height_address), framebuffer_height);
 }
 
+void ECallGetScreenFormat(Hart, bool is_32_bit_mode, Memory&, Regs& regs, FRegs&) {
+    if (is_32_bit_mode) regs[VM::REG_A0].u32 = static_cast<Word>(framebuffer_format);
+    else regs[VM::REG_A0].u64 = static_cast<Word>(framebuffer_format);
+}
+
 void ECallGetMemorySize(Hart, bool is_32_bit_mode, Memory& memory, Regs& regs, FRegs&) {
     if (is_32_bit_mode) regs[VM::REG_A0].u32 = static_cast<Word>(memory.GetTotalMemory());
     else regs[VM::REG_A0].u64 = memory.GetTotalMemory();
 }
 
-void ECallExit(Hart, bool, Memory&, Regs& regs, FRegs&) {
+// a0 is set before the handler runs, so the saved state and every run
+// restored from it see 1
+void ECallSnapshot(Hart hart, bool, Memory&, Regs& regs, FRegs&) {
+    if (!snapshot_handler) {
+        regs[VM::REG_A0].u64 = 0;
+        return;
+    }
+
+    regs[VM::REG_A0].u64 = 1;
+    snapshot_handler(hart);
+}
+
+void ECallExit(Hart, bool, Memory& memory, Regs& regs, FRegs&) {
     union S32U32 {
         Word u;
         SWord s;
@@ -128,12 +185,19 @@ void ECallExit(Hart, bool, Memory&, Regs& regs, FRegs&) {
 
     S32U32 value;
     value.u = regs[VM::REG_A1].u32;
-    std::exit(value.s);
+
+    // Whatever the guest already put in the console ring goes out first
+    if (auto console = memory.FindMemoryRegionOfType<MemoryConsole>(MemoryRegion::TYPE_CONSOLE))
+        console->Flush();
+
+    exit_handler(memory, value.s);
 }
 
 void RegisterECalls() {
     VM::RegisterECall(ECALL_COUT, ECallCOut);
     VM::RegisterECall(ECALL_CIN, ECallCIn);
+    VM::RegisterECall(ECALL_GET_SCREEN_FORMAT, ECallGetScreenFormat);
+    VM::RegisterECall(ECALL_SNAPSHOT, ECallSnapshot);
     VM::RegisterECall(ECALL_START_CPU, ECallStartCPU);
     VM::RegisterECall(ECALL_GET_CPUS, ECallGetCPUs);
     VM::RegisterECall(ECALL_GET_SCREEN_ADDRESS, ECallGetScreenAddress);
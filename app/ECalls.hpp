@@ -2,15 +2,24 @@
 #define APP_ECALLS_HPP
 
 #include <cstdint>
+#include <functional>
 
 #include <Types.hpp>
 
+class Memory;
+
 // void ecall_cout(const char* buffer, Long count);
 constexpr Long ECALL_COUT = 0ULL;
 
 // Long ecall_cin(const char* buffer, Long buffer_size);
 constexpr Long ECALL_CIN = 1ULL;
 
+// Long ecall_get_screen_format(); one of the FramebufferFormat values
+constexpr Long ECALL_GET_SCREEN_FORMAT = -8ULL;
+
+// Long ecall_snapshot(); returns 1 in runs restored from the snapshot
+constexpr Long ECALL_SNAPSHOT = -7ULL;
+
 // void ecall_start_cpu(Long hart, Long pc);
 constexpr Long ECALL_START_CPU = -6ULL;
 
@@ -31,4 +40,12 @@ constexpr Long ECALL_EXIT = -1ULL;
 
 void RegisterECalls();
 
+// Called by ecall_exit with the machine that made the call. Defaults to
+// std::exit
+void SetExitHandler(std::function<void(Memory&, int)> handler);
+
+// Called by ecall_snapshot. Without a handler the call returns 0 and
+// nothing is saved
+void SetSnapshotHandler(std::function<void(Hart)> handler);
+
 #endif
\ No newline at end of file
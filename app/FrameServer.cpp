@@ -0,0 +1,156 @@
+#include "FrameServer.hpp"
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+
+namespace {
+    void PutWord(std::vector<Byte>& out, Word value) {
+        for (size_t i = 0; i < sizeof(Word); i++)
+            out.push_back(static_cast<Byte>(value >> (i * 8)));
+    }
+
+    Word GetWord(const Byte* bytes) {
+        Word value = 0;
+        for (size_t i = 0; i < sizeof(Word); i++)
+            value |= static_cast<Word>(bytes[i]) << (i * 8);
+
+        return value;
+    }
+}
+
+FrameServer::FrameServer(IOLoop& loop, Memory& memory, std::shared_ptr<MemoryInputDevice> input, Address address, Word width, Word height, Word pixel_bytes) : loop{loop}, input{std::move(input)}, width{width}, height{height}, pixel_bytes{pixel_bytes}, delta(memory, address, width, height, pixel_bytes) {}
+
+void FrameServer::Start(uint16_t port) {
+    loop.Post([this, port]() {
+        Serve(port);
+    });
+}
+
+void FrameServer::Stop() {
+    loop.Call([this]() {
+        for (auto& [key, viewer] : viewers)
+            loop.Unwatch(viewer.socket);
+
+        viewers.clear();
+
+        if (socket) loop.Unwatch(socket);
+        socket = nullptr;
+
+        if (timer != 0) loop.RemoveTimer(timer);
+        timer = 0;
+    });
+}
+
+void FrameServer::Serve(uint16_t port) {
+    socket = TCPSocket::CreateServer(port);
+
+    if (!socket->IsOpen()) {
+        std::cerr << std::format("Cannot open frame server port {}", port) << std::endl;
+        socket = nullptr;
+        return;
+    }
+
+    socket->SetBlocking(false);
+
+    loop.Watch(socket, [this]() { AcceptViewers(); });
+    timer = loop.AddTimer(FRAME_INTERVAL, [this]() { SendFrame(); });
+}
+
+void FrameServer::AcceptViewers() {
+    while (auto accepted = socket->Accept()) {
+        accepted->SetBlocking(false);
+
+        auto hello = std::make_shared<std::vector<Byte>>(std::begin(MAGIC), std::end(MAGIC));
+        PutWord(*hello, width);
+        PutWord(*hello, height);
+        PutWord(*hello, pixel_bytes);
+
+        auto key = accepted.get();
+        viewers[key] = {accepted, {}};
+
+        loop.Watch(accepted, [this, key]() {
+            auto& viewer = viewers.at(key);
+            if (ReceiveEvents(viewer)) return;
+
+            loop.Unwatch(viewer.socket);
+            viewers.erase(key);
+        });
+
+        loop.Send(accepted, std::move(hello));
+
+        // A new viewer has nothing yet, so everyone gets every tile once
+        joined = true;
+    }
+}
+
+void FrameServer::SendFrame() {
+    // Viewers the loop closed for falling behind or failing a send
+    std::erase_if(viewers, [this](auto& entry) {
+        if (entry.second.socket->IsOpen()) return false;
+
+        loop.Unwatch(entry.second.socket);
+        return true;
+    });
+
+    // Tiles keep being tracked with nobody watching, so a viewer that
+    // joins later needs only the full batch
+    auto message = std::make_shared<std::vector<Byte>>();
+    PutWord(*message, 0);
+
+    bool full = joined;
+    joined = false;
+
+    if (delta.Encode(*message, full) == 0 || viewers.empty()) return;
+
+    Word length = message->size() - sizeof(Word);
+    for (size_t i = 0; i < sizeof(Word); i++)
+        (*message)[i] = static_cast<Byte>(length >> (i * 8));
+
+    // One copy of the frame, queued on every viewer
+    IOLoop::Buffer frame = std::move(message);
+    for (auto& [key, viewer] : viewers)
+        loop.Send(viewer.socket, frame);
+}
+
+bool FrameServer::ReceiveEvents(Viewer& viewer) {
+    Byte buffer[256];
+
+    while (viewer.socket->IsOpen()) {
+        size_t size = viewer.socket->Recv(buffer, sizeof(buffer));
+        if (size == 0) break;
+
+        viewer.pending.insert(viewer.pending.end(), buffer, buffer + size);
+    }
+
+    size_t events = viewer.pending.size() / EVENT_BYTES;
+
+    for (size_t i = 0; i < events && input; i++) {
+        const Byte* event = &viewer.pending[i * EVENT_BYTES];
+        Word type = GetWord(event);
+        Word first = GetWord(event + sizeof(Word));
+        Word second = GetWord(event + 2 * sizeof(Word));
+
+        switch (type) {
+            case MemoryInputDevice::EVENT_KEY:
+                input->PushKey(first, second != 0);
+                break;
+
+            case MemoryInputDevice::EVENT_BUTTON:
+                input->PushButton(first, second != 0);
+                break;
+
+            case MemoryInputDevice::EVENT_MOTION:
+                input->PushMotion(std::min(first, width - 1), std::min(second, height - 1));
+                break;
+
+            // Unknown events are skipped, so newer viewers still work
+            default:
+                break;
+        }
+    }
+
+    viewer.pending.erase(viewer.pending.begin(), viewer.pending.begin() + events * EVENT_BYTES);
+
+    return viewer.socket->IsOpen();
+}
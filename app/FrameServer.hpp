@@ -0,0 +1,72 @@
+#ifndef APP_FRAME_SERVER_HPP
+#define APP_FRAME_SERVER_HPP
+
+#include "IOLoop.hpp"
+#include "Socket.hpp"
+
+#include <FrameDelta.hpp>
+#include <InputDevice.hpp>
+#include <Memory.hpp>
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Streams the screen to remote viewers and feeds their input back to the
+// guest. Each frame is one message of the tiles that changed, packed by
+// FrameDelta, sent to every viewer. A viewer first gets a hello of the
+// magic, then words width, height and bytes per pixel, and every message
+// after is a word of its length and a FrameDelta batch. Viewers send
+// events of three words: the MemoryInputDevice event type, then the key or
+// button and 1 for a press, or x and y for motion.
+//
+// It runs on an IOLoop, and every viewer shares the same bytes of a frame.
+// The server takes the screen's dirty bits and is the input queue's only
+// producer, so it's for headless runs where nothing else uses either
+class FrameServer {
+public:
+    static constexpr char MAGIC[8] = {'R', 'V', '6', '4', 'F', 'B', '0', '1'};
+
+private:
+    static constexpr auto FRAME_INTERVAL = std::chrono::milliseconds(33);
+    static constexpr size_t EVENT_BYTES = 3 * sizeof(Word);
+
+    struct Viewer {
+        std::shared_ptr<TCPSocket> socket;
+
+        // Bytes of an event that arrived split over reads
+        std::vector<Byte> pending;
+    };
+
+    IOLoop& loop;
+    std::shared_ptr<MemoryInputDevice> input;
+
+    const Word width, height, pixel_bytes;
+    FrameDelta delta;
+
+    std::shared_ptr<TCPSocket> socket;
+    std::unordered_map<const TCPSocket*, Viewer> viewers;
+    Long timer = 0;
+
+    // Set when a viewer joined since the last frame
+    bool joined = false;
+
+    void Serve(uint16_t port);
+
+    void AcceptViewers();
+    void SendFrame();
+
+    // False once the viewer hung up
+    bool ReceiveEvents(Viewer& viewer);
+
+public:
+    // input may be null, events are then read and dropped
+    FrameServer(IOLoop& loop, Memory& memory, std::shared_ptr<MemoryInputDevice> input, Address address, Word width, Word height, Word pixel_bytes);
+    ~FrameServer() { Stop(); }
+
+    void Start(uint16_t port);
+    void Stop();
+};
+
+#endif
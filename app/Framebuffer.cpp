@@ -4,19 +4,44 @@
 #include <string>
 #include <iostream>
 #include <cstdlib>
+#include <algorithm>
 
-MemoryFramebuffer::MemoryFramebuffer(Address base, Address size, Word width, Word height) : MemoryRegion(TYPE_FRAMEBUFFER, 0, base, size, true, true), width{width}, height{height} {
-    word_buffer.resize(size, 0);
-    for (auto& word : word_buffer)
-        word = 0;
+namespace {
+    struct UploadFormat {
+        GLint internal_format;
+        GLenum format;
+        GLenum type;
+    };
+
+    UploadFormat GetUploadFormat(FramebufferFormat format) {
+        switch (format) {
+            case FramebufferFormat::XRGB8888: return {GL_RGB8, GL_BGRA, GL_UNSIGNED_BYTE};
+            case FramebufferFormat::RGB565: return {GL_RGB8, GL_RGB, GL_UNSIGNED_SHORT_5_6_5};
+            default: return {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE};
+        }
+    }
+}
+
+MemoryFramebuffer::MemoryFramebuffer(Address base, Address size, Word width, Word height, FramebufferFormat format) : MemoryRegion(TYPE_FRAMEBUFFER, 0, base, size, true, true), buffer(size / sizeof(Long), 0), host{reinterpret_cast<Byte*>(buffer.data())}, dirty{size}, width{width}, height{height}, format{format}, row_bytes{width * GetPixelSize(format)} {
+    auto upload = GetUploadFormat(format);
 
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, upload.internal_format, width, height, 0, upload.format, upload.type, nullptr);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
+    glGenBuffers(UPLOAD_BUFFERS, upload_buffers.data());
+    for (auto buffer : upload_buffers) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, row_bytes * height, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // The texture starts undefined, so the first frame uploads everything
+    dirty.MarkAll();
+
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
 
@@ -62,8 +87,9 @@ MemoryFramebuffer::MemoryFramebuffer(Address base, Address size, Word width, Wor
     
     uniform sampler2D framebuffer;
     
+    // The texture holds guest rows top first
     void main() {
-        fColor = texture(framebuffer, vUV).rgb;
+        fColor = texture(framebuffer, vec2(vUV.x, 1.0 - vUV.y)).rgb;
     })";
 
     auto CompileShader = [](auto type, const char* code) {
@@ -107,13 +133,35 @@ MemoryFramebuffer::MemoryFramebuffer(Address base, Address size, Word width, Wor
 }
 
 MemoryFramebuffer::~MemoryFramebuffer() {
+    for (auto fence : upload_fences) {
+        if (fence) glDeleteSync(fence);
+    }
+
+    glDeleteBuffers(UPLOAD_BUFFERS, upload_buffers.data());
     glDeleteProgram(program);
     glDeleteBuffers(1, &vbo);
     glDeleteBuffers(1, &vao);
     glDeleteTextures(1, &texture);
 }
 
-void MemoryFramebuffer::DrawBuffer() const {
+std::vector<std::pair<Word, Word>> MemoryFramebuffer::TakeDirtyRows() {
+    std::vector<std::pair<Word, Word>> rows;
+
+    for (auto [start, end] : dirty.Take(0, row_bytes * height)) {
+        Word first = start / row_bytes;
+        Word last = std::min<Address>((end + row_bytes - 1) / row_bytes, height);
+
+        // Pages don't line up with rows, so neighbouring runs can share one
+        if (!rows.empty() && rows.back().second >= first)
+            rows.back().second = std::max(rows.back().second, last);
+        else if (first < last)
+            rows.push_back({first, last});
+    }
+
+    return rows;
+}
+
+void MemoryFramebuffer::DrawBuffer() {
     glUseProgram(program);
 
     glActiveTexture(GL_TEXTURE0);
@@ -122,21 +170,57 @@ void MemoryFramebuffer::DrawBuffer() const {
     static auto location = glGetUniformLocation(program, "framebuffer");
 
     glUniform1ui(location, 0);
-    
-    Lock();
 
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, word_buffer.data());    
+    // Frames where the guest drew nothing upload nothing. Stores keep
+    // landing in the buffer while it's copied, and any row they touch is
+    // dirty again for the next frame, so the copy skips the region lock
+    auto rows = TakeDirtyRows();
+    if (!rows.empty()) {
+        auto& fence = upload_fences[upload_index];
+        if (fence) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffers[upload_index]);
+
+        // The fence already covers the GPU's last read of this buffer
+        auto staging = static_cast<Byte*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, row_bytes * height, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+
+        if (staging) {
+            for (auto [first, last] : rows)
+                std::copy_n(host + first * row_bytes, (last - first) * row_bytes, staging + first * row_bytes);
 
-    Unlock();
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            // RGB565 rows are only half aligned at odd widths
+            auto upload = GetUploadFormat(format);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, GetPixelSize(format));
+
+            for (auto [first, last] : rows)
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, width, last - first, upload.format, upload.type, reinterpret_cast<void*>(first * row_bytes));
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            upload_index = (upload_index + 1) % UPLOAD_BUFFERS;
+        } else {
+            fence = nullptr;
+            dirty.MarkAll();
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
 
     glBindVertexArray(vao);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 }
 
-std::shared_ptr<MemoryFramebuffer> MemoryFramebuffer::Create(Address base, Word width, Word height) {
-    Address size = width * height * 4;
+std::shared_ptr<MemoryFramebuffer> MemoryFramebuffer::Create(Address base, Word width, Word height, FramebufferFormat format) {
+    Address size = static_cast<Address>(width) * height * GetPixelSize(format);
 
-    size = (size + sizeof(Word) - 1) & ~(sizeof(Word) - 1);
+    // Whole pages, so every page of the screen can be a host page
+    size = (size + Memory::PAGE_SIZE - 1) & ~(Memory::PAGE_SIZE - 1);
 
-    return std::shared_ptr<MemoryFramebuffer>(new MemoryFramebuffer(base & ~3, size, width, height));
+    return std::shared_ptr<MemoryFramebuffer>(new MemoryFramebuffer(base & ~(Memory::PAGE_SIZE - 1), size, width, height, format));
 }
\ No newline at end of file
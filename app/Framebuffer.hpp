@@ -2,46 +2,85 @@
 #define APP_FRAMEBUFFER_HPP
 
 #include "OpenGL.hpp"
+#include "Screen.hpp"
 
 #include <vector>
+#include <array>
+#include <cstring>
 
 #include <Types.hpp>
 #include <Memory.hpp>
 
-inline Word framebuffer_width;
-inline Word framebuffer_height;
-inline Address framebuffer_address;
-
 class MemoryFramebuffer : public MemoryRegion {
 private:
-    std::vector<Word> word_buffer;
+    // Guest rows in order, so the region hands out host pages and harts
+    // store pixels without going through it. The shader flips the image
+    std::vector<Long> buffer;
+    Byte* const host;
+
+    DirtyPages dirty;
+
     GLuint texture;
     GLuint vao;
     GLuint vbo;
     GLuint program;
 
+    // Dirty rows are staged through one of two pixel buffers while the GPU
+    // may still be reading the other, so a frame only waits on its own
+    // upload from two frames back
+    static constexpr size_t UPLOAD_BUFFERS = 2;
+
+    std::array<GLuint, UPLOAD_BUFFERS> upload_buffers;
+    std::array<GLsync, UPLOAD_BUFFERS> upload_fences{};
+    size_t upload_index = 0;
+
     mutable std::mutex lock;
 
     const Word width, height;
+    const FramebufferFormat format;
+    const Address row_bytes;
 
-    MemoryFramebuffer(Address base, Address size, Word width, Word height);
+    MemoryFramebuffer(Address base, Address size, Word width, Word height, FramebufferFormat format);
 
-    inline Address CorrectAddress(Address address) const {
-        auto x = (address >> 2) % width;
-        auto y = (address >> 2) / width;
+    // Guest rows [first, last) written since the last upload, merged
+    std::vector<std::pair<Word, Word>> TakeDirtyRows();
 
-        return (height - y - 1) * width + x;
+    template <typename T>
+    inline T Read(Address address) const {
+        return *reinterpret_cast<const T*>(host + address);
+    }
+
+    template <typename T>
+    inline void Write(Address address, T value) {
+        *reinterpret_cast<T*>(host + address) = value;
+        dirty.Mark(address);
     }
 
 public:
     ~MemoryFramebuffer();
 
-    Word ReadWord(Address address) const override {
-        return word_buffer[CorrectAddress(address)];
+    Long ReadLong(Address address) const override { return Read<Long>(address); }
+    Word ReadWord(Address address) const override { return Read<Word>(address); }
+    Half ReadHalf(Address address) const override { return Read<Half>(address); }
+    Byte ReadByte(Address address) const override { return Read<Byte>(address); }
+
+    void WriteLong(Address address, Long vlong) override { Write(address, vlong); }
+    void WriteWord(Address address, Word word) override { Write(address, word); }
+    void WriteHalf(Address address, Half half) override { Write(address, half); }
+    void WriteByte(Address address, Byte byte) override { Write(address, byte); }
+
+    bool ReadBytes(Address address, Byte* bytes, Address count) const override {
+        std::memcpy(bytes, host + address, count);
+        return true;
+    }
+
+    Byte* GetHostPage(Address address) override {
+        if (address % Memory::PAGE_SIZE) return nullptr;
+        return host + address;
     }
 
-    void WriteWord(Address address, Word word) override {
-        word_buffer[CorrectAddress(address)] = word;
+    DirtyPages* GetDirtyPages() override {
+        return &dirty;
     }
 
     void Lock() const override {
@@ -52,9 +91,9 @@ public:
         lock.unlock();
     }
 
-    void DrawBuffer() const;
+    void DrawBuffer();
 
-    static std::shared_ptr<MemoryFramebuffer> Create(Address base, Word width, Word height);
+    static std::shared_ptr<MemoryFramebuffer> Create(Address base, Word width, Word height, FramebufferFormat format = FramebufferFormat::RGBA8888);
 };
 
 #endif
\ No newline at end of file
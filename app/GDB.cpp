@@ -1,240 +1,792 @@
 #include "GDB.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <charconv>
 #include <format>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
 
-bool GDBServer::CheckPacket(const std::string& packet) const {
-    uint8_t checksum = 0;
-    bool has_checksum = false;
-    for (size_t i = 1; i < packet.size(); i++) {
-        if (packet[i] == '#') {
-            has_checksum = true;
-            break;
-        }
-        checksum += packet[i];
+namespace {
+
+constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+// Registers and memory both go out as bytes in target order
+void AppendHex(std::string& out, const Byte* bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out += HEX_DIGITS[bytes[i] >> 4];
+        out += HEX_DIGITS[bytes[i] & 0xf];
+    }
+}
+
+void AppendLong(std::string& out, Long value) {
+    Byte bytes[sizeof(Long)];
+    std::memcpy(bytes, &value, sizeof(Long));
+    AppendHex(out, bytes, sizeof(Long));
+}
+
+int HexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Numbers in packets are big endian hex, the whole text must be one
+bool ParseHex(std::string_view text, Long& value) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+    return !text.empty() && error == std::errc{} && end == text.data() + text.size();
+}
+
+// A register value in target order, as AppendLong wrote it
+bool ParseLong(std::string_view hex, Long& value) {
+    if (hex.size() != sizeof(Long) * 2) return false;
+
+    value = 0;
+    for (size_t i = 0; i < sizeof(Long); i++) {
+        int high = HexDigit(hex[i * 2]);
+        int low = HexDigit(hex[i * 2 + 1]);
+        if (high < 0 || low < 0) return false;
+
+        value |= static_cast<Long>(high << 4 | low) << (i * 8);
     }
 
-    if (!has_checksum) return false;
+    return true;
+}
 
-    uint8_t packet_checksum = std::stoul(packet.substr(packet.size() - 2));
-    return checksum == packet_checksum;
+// The text before the first of delimiters. text keeps what follows it
+std::string_view Split(std::string_view& text, std::string_view delimiters) {
+    auto index = text.find_first_of(delimiters);
+    auto head = text.substr(0, index);
+    text = index == std::string_view::npos ? std::string_view{} : text.substr(index + 1);
+    return head;
 }
 
-std::vector<std::string> GDBServer::RecvPacket() const {
-    constexpr size_t BUFFER_SIZE = 256;
-    char buffer[BUFFER_SIZE];
-    std::string str_buffer;
+// Thread IDs count from 1, since 0 means any thread and -1 all of them
+constexpr Long ANY_THREAD = 0;
+constexpr Long ALL_THREADS = -1ULL;
+
+bool ParseThread(std::string_view text, Long& thread) {
+    if (text == "-1") {
+        thread = ALL_THREADS;
+        return true;
+    }
 
-    while (true) {
-        auto size = gdb_client->Recv(buffer, BUFFER_SIZE);
-        str_buffer.resize(size);
-        for (size_t i = 0; i < size; i++)
-            str_buffer[i] = buffer[i];
-        
-        if (CheckPacket(str_buffer)) {
-            SendPacket("-");
+    return ParseHex(text, thread);
+}
+
+// Register numbers past the integer ones, as the RISC-V target numbers them
+constexpr Long REGISTER_PC = 32;
+constexpr Long REGISTER_F0 = 33;
+constexpr Long REGISTER_CSR0 = 65;
+
+}
+
+void GDBServer::Start(uint16_t port) {
+    loop.Post([this, port]() {
+        Serve(port);
+    });
+}
+
+void GDBServer::Stop() {
+    loop.Call([this]() {
+        if (gdb_client) Detach();
+
+        if (socket) loop.Unwatch(socket);
+        socket = nullptr;
+
+        if (timer != 0) loop.RemoveTimer(timer);
+        timer = 0;
+    });
+}
+
+void GDBServer::Serve(uint16_t port) {
+    tracer.SetThread(vms.size(), "gdb");
+
+    socket = TCPSocket::CreateServer(port);
+
+    if (!socket->IsOpen()) {
+        std::cerr << std::format("Cannot open GDB server port {}", port) << std::endl;
+        socket = nullptr;
+        return;
+    }
+
+    socket->SetBlocking(false);
+
+    loop.Watch(socket, [this]() { AcceptClient(); });
+    timer = loop.AddTimer(POLL_INTERVAL, [this]() { CheckHarts(); });
+}
+
+void GDBServer::AcceptClient() {
+    gdb_client = socket->Accept();
+    if (!gdb_client) return;
+
+    // Later clients wait in the backlog until this one leaves
+    loop.Unwatch(socket);
+
+    gdb_client->SetBlocking(false);
+    loop.Watch(gdb_client, [this]() {
+        if (!ReceivePackets(loop.GetStopToken())) Detach();
+    });
+
+    Attach();
+    Halt(loop.GetStopToken());
+}
+
+void GDBServer::CheckHarts() {
+    // The loop drops a client that hung up without telling anyone
+    if (gdb_client && !gdb_client->IsOpen()) {
+        Detach();
+        return;
+    }
+
+    // A continue ends with the first hart to pause, at a breakpoint or
+    // from the GUI
+    if (!gdb_client || !resumed) return;
+
+    for (Hart hart = 0; hart < vms.size(); hart++) {
+        if (!vms[hart]->IsPaused()) continue;
+
+        Halt(loop.GetStopToken());
+        SendStopReply(5, hart);
+        break;
+    }
+}
+
+void GDBServer::Attach() {
+    input_start = 0;
+    input_end = 0;
+    scan = 0;
+    no_ack = false;
+    resumed = false;
+    current_hart = 0;
+
+    // Breakpoints have to stop the hart that hits them for GDB to hear of it
+    pause_on_break.clear();
+    for (auto& vm : vms) {
+        pause_on_break.push_back(vm->PauseOnBreak());
+        vm->SetPauseOnBreak(true);
+    }
+}
+
+void GDBServer::Detach() {
+    for (size_t i = 0; i < vms.size() && i < pause_on_break.size(); i++)
+        vms[i]->SetPauseOnBreak(pause_on_break[i]);
+
+    // Left behind, they would keep their pages off the fast path for good
+    memory.ClearWatchpoints();
+
+    Resume();
+    resumed = false;
+
+    loop.Unwatch(gdb_client);
+    gdb_client = nullptr;
+
+    if (socket) loop.Watch(socket, [this]() { AcceptClient(); });
+}
+
+void GDBServer::Halt(const std::stop_token& stop) {
+    // Waking lets a hart asleep in WFI notice the pause and park
+    for (auto& vm : vms) {
+        vm->Pause();
+        vm->Wake();
+    }
+
+    for (auto& vm : vms) {
+        while (vm->IsRunning() && !vm->IsParked() && !stop.stop_requested())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    resumed = false;
+}
+
+void GDBServer::Resume() {
+    resumed = true;
+
+    for (auto& vm : vms)
+        vm->Unpause();
+}
+
+bool GDBServer::ReceivePackets(const std::stop_token& stop) {
+    // Handled bytes are dropped from the front before reading more
+    if (input_start != 0) {
+        std::memmove(input.data(), input.data() + input_start, input_end - input_start);
+        scan = scan > input_start ? scan - input_start : 0;
+        input_end -= input_start;
+        input_start = 0;
+    }
+
+    // A packet bigger than the size offered can never complete
+    if (input_end == input.size()) {
+        input_end = 0;
+        scan = 0;
+    }
+
+    auto size = gdb_client->Recv(input.data() + input_end, input.size() - input_end);
+    if (size == 0) return gdb_client->IsOpen();
+
+    input_end += size;
+
+    while (input_start < input_end) {
+        char c = input[input_start];
+
+        if (c != '$') {
+            input_start++;
+
+            // GDB sends a bare Ctrl-C to interrupt a continue
+            if (c == 0x03 && resumed) {
+                Halt(stop);
+                SendStopReply(2, current_hart);
+            }
+
+            // A rejected reply goes out again
+            else if (c == '-' && !no_ack && !framed.empty())
+                gdb_client->Send(framed.data(), framed.size());
+
+            continue;
+        }
+
+        // Carry on looking for the '#' where the last read stopped
+        if (scan <= input_start) scan = input_start + 1;
+
+        auto end = std::find(input.data() + scan, input.data() + input_end, '#') - input.data();
+        if (static_cast<size_t>(end) + 2 >= input_end) {
+            scan = end;
             break;
         }
+
+        std::string_view body(input.data() + input_start + 1, end - input_start - 1);
+
+        Byte checksum = 0;
+        for (auto byte : body)
+            checksum += byte;
+
+        Long expected = 0;
+        bool valid = ParseHex({input.data() + end + 1, 2}, expected) && expected == checksum;
+
+        input_start = end + 3;
+        scan = input_start;
+
+        if (!no_ack) gdb_client->Send(valid ? "+" : "-", 1);
+        if (!valid) continue;
+
+        // Binary data escapes the framing bytes as '}' and the byte xor 0x20
+        payload.clear();
+        for (size_t i = 0; i < body.size(); i++) {
+            if (body[i] == '}' && i + 1 < body.size())
+                payload += static_cast<char>(body[++i] ^ 0x20);
+
+            else
+                payload += body[i];
+        }
+
+        HandlePacket(payload);
+
+        if (!gdb_client) return true;
     }
 
-    SendPacket("+");
+    return gdb_client->IsOpen();
+}
+
+void GDBServer::HandlePacket(std::string_view packet) {
+    if (packet.empty()) {
+        SendUnsupported();
+        return;
+    }
+
+    tracer.Begin(Tracer::Kind::GDB, packet[0]);
+
+    auto vm = vms[current_hart];
+    auto arguments = packet.substr(1);
+
+    switch (packet[0]) {
+        case '?':
+            SendStopReply(5, current_hart);
+            break;
+
+        case 'c': {
+            Long address = 0;
+            if (ParseHex(arguments, address))
+                vm->SetPC(address);
+
+            Resume();
+            break;
+        }
+
+        case 's': {
+            Long address = 0;
+            if (ParseHex(arguments, address))
+                vm->SetPC(address);
+
+            vm->Step(1);
+            SendStopReply(5, current_hart);
+            break;
+        }
+
+        case 'g':
+            ReadRegisters();
+            break;
+
+        case 'G':
+            WriteRegisters(arguments);
+            break;
+
+        case 'p': {
+            Long number = 0;
+            if (ParseHex(arguments, number)) ReadRegister(number);
+            else SendPacket("E01");
+            break;
+        }
+
+        case 'P': {
+            auto number_text = Split(arguments, "=");
+
+            Long number = 0, value = 0;
+            bool valid = ParseHex(number_text, number) && ParseLong(arguments, value) && WriteRegister(number, value);
+
+            SendPacket(valid ? "OK" : "E01");
+            break;
+        }
+
+        case 'H': {
+            Long thread = 0;
+            if (!ParseThread(packet.substr(2), thread) || (thread != ANY_THREAD && thread != ALL_THREADS && thread > vms.size())) {
+                SendPacket("E01");
+                break;
+            }
+
+            if (thread != ANY_THREAD && thread != ALL_THREADS)
+                current_hart = static_cast<Hart>(thread - 1);
+
+            SendPacket("OK");
+            break;
+        }
+
+        case 'T': {
+            Long thread = 0;
+            bool alive = ParseThread(arguments, thread) && thread != ANY_THREAD && thread <= vms.size();
+
+            SendPacket(alive ? "OK" : "E01");
+            break;
+        }
+
+        case 'm': {
+            auto address_text = Split(arguments, ",");
+
+            Long address = 0, length = 0;
+            if (ParseHex(address_text, address) && ParseHex(arguments, length))
+                ReadMemory(address, length);
+
+            else
+                SendPacket("E01");
+
+            break;
+        }
+
+        // Hex data, which X replaces with binary at half the size
+        case 'M':
+        case 'X': {
+            auto address_text = Split(arguments, ",");
+            auto length_text = Split(arguments, ":");
 
-    std::vector<std::string> packet;
-    str_buffer = str_buffer.substr(1, str_buffer.size() - 4);
+            Long address = 0, length = 0;
+            if (!ParseHex(address_text, address) || !ParseHex(length_text, length)) {
+                SendPacket("E01");
+                break;
+            }
 
-    static std::vector delimiters = {',', ';', ':'};
-    while (true) {
-        size_t min_index = std::string::npos;
+            if (packet[0] == 'X') {
+                if (arguments.size() != length) SendPacket("E01");
+                else WriteMemory(address, arguments);
+                break;
+            }
 
-        for (auto delimiter : delimiters) {
-            size_t index = str_buffer.find(delimiter);
-            if (index < min_index)
-                min_index = index;
+            if (arguments.size() != length * 2) {
+                SendPacket("E01");
+                break;
+            }
+
+            std::string data(length, '\0');
+            for (Long i = 0; i < length; i++) {
+                int high = HexDigit(arguments[i * 2]);
+                int low = HexDigit(arguments[i * 2 + 1]);
+                data[i] = static_cast<char>(high << 4 | low);
+            }
+
+            WriteMemory(address, data);
+            break;
         }
 
-        if (min_index == std::string::npos)
+        // Software and hardware breakpoints are the same thing here, and
+        // every hart shares them. Types 2 to 4 watch writes, reads and both
+        case 'z':
+        case 'Z': {
+            auto type = Split(arguments, ",");
+            auto address_text = Split(arguments, ",");
+            auto length_text = Split(arguments, ";");
+
+            Long address = 0;
+            Long length = 0;
+            if (type.size() != 1 || type[0] < '0' || type[0] > '4' || !ParseHex(address_text, address) || !ParseHex(length_text, length)) {
+                SendUnsupported();
+                break;
+            }
+
+            if (type[0] >= '2') {
+                static constexpr Memory::WatchKind KINDS[] = {Memory::WatchKind::Write, Memory::WatchKind::Read, Memory::WatchKind::Access};
+                Memory::Watchpoint watchpoint = {address, std::max<Long>(length, 1), KINDS[type[0] - '2']};
+
+                if (packet[0] == 'Z') memory.AddWatchpoint(watchpoint);
+                else memory.RemoveWatchpoint(watchpoint);
+
+                SendPacket("OK");
+                break;
+            }
+
+            for (auto& hart : vms) {
+                if (packet[0] == 'Z') hart->SetBreakPoint(address);
+                else hart->ClearBreakPoint(address);
+            }
+
+            SendPacket("OK");
             break;
-        
-        auto first = str_buffer.substr(0, min_index);
-        str_buffer = str_buffer.substr(min_index + 1);
+        }
 
-        packet.emplace_back(std::move(first));
+        case 'D':
+            SendPacket("OK");
+            Detach();
+            break;
+
+        case 'k':
+            Detach();
+            break;
+
+        case 'q':
+        case 'Q':
+            HandleQuery(packet);
+            break;
+
+        case 'v':
+            if (packet == "vCont?")
+                SendPacket("vCont;c;C;s;S");
+
+            else if (packet.starts_with("vCont;"))
+                HandleVCont(packet.substr(5));
+
+            else
+                SendUnsupported();
+
+            break;
+
+        default:
+            SendUnsupported();
+            break;
     }
 
-    if (str_buffer.size() != 0)
-        packet.emplace_back(std::move(str_buffer));
+    tracer.End(Tracer::Kind::GDB);
+}
+
+void GDBServer::HandleQuery(std::string_view packet) {
+    auto name = packet.substr(0, packet.find(':'));
 
-    for (auto& field : packet) {
-        auto index = field.find('*');
-        if (index == std::string::npos)
-            continue;
-        
-        auto repeat = field[index + 1] - 29;
-        std::string repeated;
-        repeated.resize(repeat, field[index]);
-        
-        field = field.substr(0, index) + repeated + field.substr(index + 1);
+    if (name == "qSupported")
+        SendPacket(std::format("PacketSize={:x};QStartNoAckMode+;qXfer:memory-map:read+;vContSupported+", PACKET_SIZE));
+
+    // Acks stop after the OK, which itself still gets one
+    else if (packet == "QStartNoAckMode") {
+        SendPacket("OK");
+        no_ack = true;
     }
 
-    return packet;
+    else if (packet == "qAttached")
+        SendPacket("1");
+
+    else if (packet == "qC")
+        SendPacket(std::format("QC{:x}", current_hart + 1));
+
+    else if (packet == "qfThreadInfo") {
+        reply = "m";
+        for (Hart hart = 0; hart < vms.size(); hart++)
+            reply += std::format("{}{:x}", hart == 0 ? "" : ",", hart + 1);
+
+        SendPacket(reply);
+    }
+
+    else if (packet == "qsThreadInfo")
+        SendPacket("l");
+
+    else if (packet.starts_with("qThreadExtraInfo,")) {
+        Long thread = 0;
+        if (!ParseHex(packet.substr(17), thread) || thread == ANY_THREAD || thread > vms.size()) {
+            SendPacket("E01");
+            return;
+        }
+
+        auto text = std::format("hart {}", thread - 1);
+
+        reply.clear();
+        AppendHex(reply, reinterpret_cast<const Byte*>(text.data()), text.size());
+        SendPacket(reply);
+    }
+
+    else if (packet.starts_with("qSymbol"))
+        SendPacket("OK");
+
+    else if (packet.starts_with("qXfer:memory-map:read::")) {
+        auto arguments = packet.substr(23);
+        auto offset_text = Split(arguments, ",");
+
+        Long offset = 0, length = 0;
+        if (ParseHex(offset_text, offset) && ParseHex(arguments, length))
+            SendMemoryMap(offset, length);
+
+        else
+            SendPacket("E01");
+    }
+
+    else
+        SendUnsupported();
 }
 
-void GDBServer::SendPacket(const std::string& packet) const {
-    uint8_t checksum = 0;
-    for (auto c : packet)
-        checksum += c;
-    
-    std::string packaged = "$" + packet + '#' + std::format("{:0>x}", checksum);
+// In all-stop mode one hart stepping means the rest stay halted, any
+// continue action resumes them all
+void GDBServer::HandleVCont(std::string_view actions) {
+    bool resume = false;
+
+    for (auto rest = actions; !rest.empty();) {
+        auto action = Split(rest, ";");
+        auto target = action;
+        auto command = Split(target, ":");
 
-    gdb_client->Send(packaged.data(), packaged.size());
+        if (command.empty()) continue;
+
+        Long thread = ANY_THREAD;
+        if (!target.empty() && !ParseThread(target, thread)) {
+            SendPacket("E01");
+            return;
+        }
+
+        if (command[0] == 's' || command[0] == 'S') {
+            Hart hart = thread != ANY_THREAD && thread != ALL_THREADS && thread <= vms.size() ? static_cast<Hart>(thread - 1) : current_hart;
+
+            vms[hart]->Step(1);
+            current_hart = hart;
+
+            SendStopReply(5, hart);
+            return;
+        }
+
+        if (command[0] == 'c' || command[0] == 'C')
+            resume = true;
+    }
+
+    if (resume) Resume();
+    else SendPacket("E01");
 }
 
-void GDBServer::Run(uint16_t port) {
+void GDBServer::ReadRegisters() {
     using VM = VirtualMachine;
 
-    socket = TCPSocket::CreateServer(port);
-    
-    if (!socket->IsOpen()) {
-        std::cerr << std::format("Cannot open GDB server port {}", port) << std::endl;
-        std::exit(EXIT_FAILURE);
+    std::array<VM::Reg, VM::REGISTER_COUNT> regs;
+    std::array<Float, VM::REGISTER_COUNT> fregs;
+    Long pc;
+
+    vms[current_hart]->GetSnapshot(regs, fregs, pc);
+
+    reply.clear();
+    for (auto reg : regs)
+        AppendLong(reply, reg.u64);
+
+    AppendLong(reply, pc);
+
+    SendPacket(reply);
+}
+
+void GDBServer::WriteRegisters(std::string_view hex) {
+    constexpr size_t DIGITS = sizeof(Long) * 2;
+
+    if (hex.size() < (REGISTER_PC + 1) * DIGITS) {
+        SendPacket("E01");
+        return;
     }
 
-    gdb_client = socket->Accept();
-    uint32_t current_hart = 0;
-
-    vms[current_hart]->Pause();
-
-    while (running) {
-        auto packet = RecvPacket();
-
-        auto vm = vms[current_hart];
-
-        if (packet[0] == "D") {
-            vm->Unpause();
-            break;
-        }
-        else {
-            switch (packet[0][0]) {
-                case 'c': {
-                    if (packet[0].size() > 1) {
-                        auto s_addr = packet[0].substr(1);
-                        auto addr = std::stoull(s_addr) ;
-
-                        vm->SetPC(static_cast<uint32_t>(addr));
-                    }
-
-                    vm->Unpause();
-                    break;
-                }
-                
-                case 'g': {
-                    std::array<VM::Reg, VM::REGISTER_COUNT> regs;
-                    std::array<Float, VM::REGISTER_COUNT> fregs;
-                    Long pc;
-
-                    vm->GetSnapshot(regs, fregs, pc);
-
-                    std::string packet;
-                    for (auto reg : regs)
-                        packet += std::format("{:0>16x}", reg.u64);
-                    
-                    for (auto freg : fregs) {
-                        if (freg.is_double)
-                            packet += std::format("{:0>16x}", freg.u64);
-                        
-                        else
-                            packet += std::format("{:0>16x}", freg.u32);
-                    }
-
-                    SendPacket(packet);
-                    break;
-                }
-
-                case 'H': {
-                    uint32_t thread = std::stoull(packet[0].substr(1));
-                    if (thread >= vms.size())
-                        SendPacket("E");
-                    
-                    else {
-                        vm->Unpause();
-                        current_hart = thread;
-                        vms[current_hart]->Pause();
-                    }
-                    
-                    break;
-                }
-
-                case 'm': {
-                    auto addr = std::stoull(packet[0].substr(1));
-                    auto len = std::stoull(packet[1]);
-
-                    len = (len + 3) / 4;
-
-                    auto words = memory.PeekWords(static_cast<uint32_t>(addr), static_cast<uint32_t>(len));
-
-                    std::string packet;
-
-                    for (auto word : words) {
-                        if (!word.second) break;
-                        packet += std::format("{:0>2x}{:0>2x}{:0>2x}{:0>2x}", word.first & 0xff, (word.first >> 8) & 0xff, (word.first >> 16) & 0xff, (word.first >> 24) & 0xff);
-                    }
-
-                    SendPacket(packet);
-                    break;
-                }
-
-                case 's': {
-                    if (packet[0].size() > 1) {
-                        auto addr = std::stoull(packet[0].substr(1));
-                        vm->SetPC(addr);
-                    }
-
-                    vm->Step(1);
-
-                    break;
-                }
-
-                case 'T': {
-                    auto thread = std::stoull(packet[0].substr(1));
-
-                    if (thread >= vms.size())
-                        SendPacket("E");
-                    
-                    else
-                        SendPacket("OK");
-                    
-                    break;
-                }
-
-                case 'z': {
-                    auto type = packet[0][1];
-                    
-                    if (type != '1') {
-                        SendPacket("`'");
-                        break;
-                    }
-
-                    vm->ClearBreakPoint(static_cast<uint32_t>(std::stoull(packet[1])));
-                    SendPacket("OK");
-                    break;
-                }
-                case 'Z': {
-                    auto type = packet[0][1];
-                    
-                    if (type != '1') {
-                        SendPacket("`'");
-                        break;
-                    }
-
-                    vm->SetBreakPoint(static_cast<uint32_t>(std::stoull(packet[1])));
-                    SendPacket("OK");
-                    break;
-                }
-                default:
-                    SendUnsupported();
-                    break;
-            }
+    for (Long number = 0; number <= REGISTER_PC; number++) {
+        Long value = 0;
+        if (!ParseLong(hex.substr(number * DIGITS, DIGITS), value) || !WriteRegister(number, value)) {
+            SendPacket("E01");
+            return;
+        }
+    }
+
+    SendPacket("OK");
+}
+
+void GDBServer::ReadRegister(Long number) {
+    auto vm = vms[current_hart];
+
+    reply.clear();
+
+    if (number < REGISTER_PC)
+        AppendLong(reply, vm->GetRegister(number).Value().u64);
+
+    else if (number == REGISTER_PC)
+        AppendLong(reply, vm->GetPC());
+
+    // Singles go out NaN boxed, like the hardware holds them
+    else if (number < REGISTER_CSR0) {
+        auto freg = vm->GetFloatRegister(number - REGISTER_F0).Value();
+        AppendLong(reply, freg.is_double ? freg.u64 : 0xffffffff00000000 | freg.u32);
+    }
+
+    else {
+        std::unordered_map<Long, Long> csrs;
+        vm->GetCSRSnapshot(csrs);
+
+        auto csr = csrs.find(number - REGISTER_CSR0);
+        if (csr == csrs.end()) {
+            SendPacket("E01");
+            return;
+        }
+
+        AppendLong(reply, csr->second);
+    }
+
+    SendPacket(reply);
+}
+
+bool GDBServer::WriteRegister(Long number, Long value) {
+    auto vm = vms[current_hart];
+
+    if (number == 0) return true;
+
+    if (number < REGISTER_PC) {
+        vm->GetRegister(number).Value().u64 = value;
+        return true;
+    }
+
+    if (number == REGISTER_PC) {
+        vm->SetPC(value);
+        return true;
+    }
+
+    if (number < REGISTER_CSR0) {
+        auto& freg = vm->GetFloatRegister(number - REGISTER_F0).Value();
+
+        if (value >> 32 == 0xffffffff) {
+            freg.u32 = static_cast<Word>(value);
+            freg.is_double = false;
+        }
+
+        else
+            freg.u64 = value;
+
+        return true;
+    }
+
+    return false;
+}
+
+void GDBServer::ReadMemory(Address address, Address length) {
+    // Each byte takes two characters of the reply
+    length = std::min<Address>(length, bytes.size());
+
+    std::span<Byte> read(bytes.data(), length);
+    auto ranges = memory.PeekBytes(address, read);
+
+    // Replies stop at the first byte that isn't mapped
+    Address mapped = !ranges.empty() && ranges.front().first == address ? ranges.front().second - address : 0;
+
+    if (mapped == 0 && length != 0) {
+        SendPacket("E14");
+        return;
+    }
+
+    reply.clear();
+    AppendHex(reply, bytes.data(), mapped);
+    SendPacket(reply);
+}
+
+void GDBServer::WriteMemory(Address address, std::string_view data) {
+    try {
+        memory.WriteBytes(address, {reinterpret_cast<const Byte*>(data.data()), data.size()});
+        SendPacket("OK");
+    }
+    catch (const std::runtime_error&) {
+        SendPacket("E14");
+    }
+}
+
+// Lets GDB tell RAM from ROM and refuse addresses nothing is mapped at
+void GDBServer::SendMemoryMap(Address offset, Address length) {
+    auto regions = memory.GetMemoryRegions();
+    std::sort(regions.begin(), regions.end(), [](auto& a, auto& b) { return a->base < b->base; });
+
+    std::string map = "<?xml version=\"1.0\"?>\n"
+        "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" \"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n"
+        "<memory-map>\n";
+
+    // GDB rejects overlapping entries, so later regions lose the overlap
+    Address mapped_end = 0;
+    for (auto& region : regions) {
+        Address start = std::max(region->base, mapped_end);
+        Address end = region->base + region->size;
+        if (start >= end) continue;
+
+        map += std::format("  <memory type=\"{}\" start=\"0x{:x}\" length=\"0x{:x}\"/>\n", region->writable ? "ram" : "rom", start, end - start);
+        mapped_end = end;
+    }
+
+    map += "</memory-map>\n";
+
+    if (offset >= map.size()) {
+        SendPacket("l");
+        return;
+    }
+
+    auto chunk = std::string_view(map).substr(offset, length);
+
+    reply.clear();
+    reply += offset + chunk.size() < map.size() ? 'm' : 'l';
+    reply += chunk;
+    SendPacket(reply);
+}
+
+void GDBServer::SendStopReply(Byte signal, Hart hart) {
+    current_hart = hart;
+
+    auto hit = vms[hart]->TakeWatchHit();
+    if (!hit) {
+        SendPacket(std::format("T{:02x}thread:{:x};", signal, hart + 1));
+        return;
+    }
+
+    auto kind = hit->kind == Memory::WatchKind::Write ? "watch" : hit->kind == Memory::WatchKind::Read ? "rwatch" : "awatch";
+    SendPacket(std::format("T{:02x}{}:{:x};thread:{:x};", signal, kind, hit->address, hart + 1));
+}
+
+void GDBServer::SendPacket(std::string_view packet) {
+    framed.clear();
+    framed += '$';
+
+    // Binary replies escape the bytes that frame packets, text never has them
+    Byte checksum = 0;
+    for (char c : packet) {
+        if (c == '$' || c == '#' || c == '}' || c == '*') {
+            framed += '}';
+            checksum += '}';
+            c ^= 0x20;
         }
+
+        framed += c;
+        checksum += c;
     }
-}
\ No newline at end of file
+
+    framed += '#';
+    framed += HEX_DIGITS[checksum >> 4];
+    framed += HEX_DIGITS[checksum & 0xf];
+
+    gdb_client->Send(framed.data(), framed.size());
+}
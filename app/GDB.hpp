@@ -2,38 +2,105 @@
 #define APP_GDB_HPP
 
 #include "VirtualMachines.hpp"
+#include "IOLoop.hpp"
 #include "Socket.hpp"
 
 #include <Memory.hpp>
+#include <Tracer.hpp>
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// A GDB remote stub serving one client at a time in all-stop mode: harts
+// halt together and resume together. It runs on an IOLoop, handling
+// packets as they arrive, and a timer notices harts stopping at
+// breakpoints between them
 class GDBServer {
 private:
+    IOLoop& loop;
     Memory& memory;
-    
-    mutable std::shared_ptr<TCPSocket> socket = nullptr;
-    mutable std::shared_ptr<TCPSocket> gdb_client = nullptr;
 
-    bool CheckPacket(const std::string& packet) const;
+    std::shared_ptr<TCPSocket> socket = nullptr;
+    std::shared_ptr<TCPSocket> gdb_client = nullptr;
 
-    std::vector<std::string> RecvPacket() const;
-    void SendPacket(const std::string& packet) const;
+    // Offered in qSupported. Large packets let X load an image in a few
+    // round trips per megabyte instead of one per 256 bytes
+    static constexpr size_t PACKET_SIZE = 0x20000;
 
-    inline void SendUnsupported() const {
-        SendPacket("#00");
-    }
+    // How often the harts are checked for one stopping on its own
+    static constexpr auto POLL_INTERVAL = std::chrono::milliseconds(10);
+
+    // Received bytes in [input_start, input_end). A packet can straddle any
+    // number of reads, scan remembers how far the search for its '#' got
+    std::vector<char> input = std::vector<char>(PACKET_SIZE + 64);
+    size_t input_start = 0;
+    size_t input_end = 0;
+    size_t scan = 0;
+
+    // Reused for every packet, so the buffers grow once
+    std::string payload;
+    std::string reply;
+    std::string framed;
+    std::vector<Byte> bytes = std::vector<Byte>(PACKET_SIZE / 2);
+
+    bool no_ack = false;
+
+    // Set between a continue and the stop reply that ends it
+    bool resumed = false;
+
+    Hart current_hart = 0;
+    std::vector<bool> pause_on_break;
+
+    Long timer = 0;
+
+    // Packets are handled on the loop's thread, so it gets its own
+    // timeline next to the harts
+    Tracer tracer;
+
+    void Serve(uint16_t port);
+
+    void AcceptClient();
+    void CheckHarts();
 
-    bool running = true;
+    void Attach();
+    void Detach();
+
+    // Pauses every hart and waits until none of them is mid slice
+    void Halt(const std::stop_token& stop);
+    void Resume();
+
+    bool ReceivePackets(const std::stop_token& stop);
+    void HandlePacket(std::string_view packet);
+    void HandleQuery(std::string_view packet);
+    void HandleVCont(std::string_view actions);
+
+    void ReadRegisters();
+    void WriteRegisters(std::string_view hex);
+    void ReadRegister(Long number);
+    bool WriteRegister(Long number, Long value);
+
+    void ReadMemory(Address address, Address length);
+    void WriteMemory(Address address, std::string_view bytes);
+
+    void SendMemoryMap(Address offset, Address length);
+    void SendStopReply(Byte signal, Hart hart);
+
+    void SendPacket(std::string_view packet);
+
+    inline void SendUnsupported() {
+        SendPacket("");
+    }
 
 public:
-    GDBServer(Memory& memory) : memory{memory} {}
-    ~GDBServer() = default;
+    GDBServer(IOLoop& loop, Memory& memory) : loop{loop}, memory{memory} {}
+    ~GDBServer() { Stop(); }
+
+    void Start(uint16_t port);
+    void Stop();
 
-    void Run(uint16_t port);
-    inline void Stop() { running = false; }
+    inline const Tracer& GetTracer() const { return tracer; }
 };
 
-#endif
\ No newline at end of file
+#endif
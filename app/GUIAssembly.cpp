@@ -7,13 +7,14 @@
 #include <stdexcept>
 #include <format>
 
-void GUIAssembly::Draw() {
-    if (ImGui::Begin("Assembly")) {
-        Address pc = vm->GetPC();
+bool GUIAssembly::Refresh() {
+    if (!vm->ReadState(*state)) return false;
+
+    Address pc = state->pc;
 
-        bool needs_scroll = pc != last_pc;
-        last_pc = pc;
+    bool moved = !lines_valid || state->is_32_bit_mode != lines_32_bit || pc < window_pc || pc >= window_pc + (WINDOW << 2);
 
+    if (moved) {
         int64_t window_begin = (pc >> 2) - WINDOW / 2 + WINDOW_SLIDE;
 
         if (window_begin < 0) window_begin = 0;
@@ -31,42 +32,71 @@ void GUIAssembly::Draw() {
             throw std::runtime_error(std::format("Memory needs to be at least {} bytes in size", WINDOW << 2));
         }
 
-        Address window_pc = static_cast<Address>(window_begin) << 2;
+        window_pc = static_cast<Address>(window_begin) << 2;
+        lines_valid = false;
+    }
+
+    mapped_ranges = memory.Peek(window_pc, std::span<Word>(window));
+
+    for (Address addr = window_pc, i = 0; i < WINDOW; addr += 4, i++) {
+        bool was_mapped = mapped[i];
+        mapped[i] = Memory::IsInRanges(mapped_ranges, addr, sizeof(Word));
+
+        // Breakpoints can be set from GDB at any time, so these are redone
+        // on every refresh, but they're cheap next to the disassembly
+        break_points[i] = vm->IsBreakPoint(addr);
+
+        if (lines_valid && mapped[i] == was_mapped && (!mapped[i] || window[i] == decoded[i])) continue;
+
+        decoded[i] = window[i];
+
+        if (mapped[i])
+            RVInstruction::FromUInt32(window[i]).Disassemble(lines[i].data(), lines[i].size());
+    }
+
+    lines_valid = true;
+    lines_32_bit = state->is_32_bit_mode;
+    return true;
+}
+
+void GUIAssembly::Draw() {
+    if (ImGui::Begin("Assembly")) {
+        if (vm.get() != shown_vm) {
+            shown_vm = vm.get();
+            lines_valid = false;
+            has_state = false;
+            throttle.Expire();
+        }
+
+        if (throttle.Due())
+            has_state = Refresh() || has_state;
+
+        if (has_state) {
+            Address pc = state->pc;
 
-        auto instrs = memory.PeekWords(window_pc, WINDOW);
+            bool needs_scroll = pc != last_pc;
+            last_pc = pc;
 
-        for (Address addr = window_pc, i = 0; i < WINDOW; addr += 4, i++) {
-            if (instrs[i].second) {
-                RVInstruction instr = RVInstruction::FromUInt32(instrs[i].first);
-                std::string s_addr;
-                if (vm->Is32BitMode())
-                    s_addr = std::format("0x{:0>8x}", addr);
-                
-                else
-                    s_addr = std::format("0x{:0>16x}", addr);
+            int digits = state->is_32_bit_mode ? 8 : 16;
+
+            for (Address addr = window_pc, i = 0; i < WINDOW; addr += 4, i++) {
+                const char* text = mapped[i] ? lines[i].data() : nullptr;
 
                 if (addr == pc) {
-                    ImGui::TextColored(gui_pc_highlight_color, "-> %s %s", s_addr.c_str(), std::string(instr).c_str());
+                    if (text) ImGui::TextColored(gui_pc_highlight_color, "-> 0x%0*llx %s", digits, addr, text);
+                    else ImGui::TextColored(gui_pc_highlight_color, "-> Unmapped Memory");
+
                     if (needs_scroll) ImGui::SetScrollHereY();
-                } else if (vm->IsBreakPoint(addr)) {
-                    ImGui::TextColored(gui_break_highlight_color, "   %s %s", s_addr.c_str(), std::string(instr).c_str());
+                } else if (break_points[i]) {
+                    if (text) ImGui::TextColored(gui_break_highlight_color, "   0x%0*llx %s", digits, addr, text);
+                    else ImGui::TextColored(gui_break_highlight_color, "   Unmapped Memory");
                 } else {
-                    ImGui::Text("   %s %s", s_addr.c_str(), std::string(instr).c_str());
-                }
-            }
-            else {
-                if (addr == pc) {
-                    ImGui::TextColored(gui_pc_highlight_color, "-> Unmapped Memory");
-                    if (needs_scroll) ImGui::SetScrollHereY();
+                    if (text) ImGui::Text("   0x%0*llx %s", digits, addr, text);
+                    else ImGui::Text("   Unmapped Memory");
                 }
-                else if (vm->IsBreakPoint(addr))
-                    ImGui::TextColored(gui_break_highlight_color, "   Unmapped Memory");
-                
-                else
-                    ImGui::Text("   Unmapped Memory");
             }
         }
     }
 
     ImGui::End();
-}
\ No newline at end of file
+}
@@ -3,9 +3,12 @@
 
 #include "VirtualMachine.hpp"
 #include "Memory.hpp"
+#include "GUIThrottle.hpp"
 #include <RV64.hpp>
 
+#include <array>
 #include <memory>
+#include <vector>
 
 class GUIAssembly {
     Memory& memory;
@@ -15,6 +18,28 @@ class GUIAssembly {
     static constexpr size_t WINDOW = 128;
     static constexpr size_t WINDOW_SLIDE = 12;
 
+    // Read in bulk on every refresh into the same buffers
+    std::array<Word, WINDOW> window{};
+    std::vector<Memory::Range> mapped_ranges;
+
+    std::unique_ptr<VirtualMachine::HartState> state = std::make_unique<VirtualMachine::HartState>();
+    bool has_state = false;
+
+    // Disassembly of the window. A line is redone only when its word
+    // changes, and the whole window only when the pc leaves it
+    std::array<Word, WINDOW> decoded{};
+    std::array<RVInstruction::Disassembly, WINDOW> lines{};
+    std::array<bool, WINDOW> mapped{};
+    std::array<bool, WINDOW> break_points{};
+    Address window_pc = 0;
+    bool lines_valid = false;
+    bool lines_32_bit = false;
+
+    const VirtualMachine* shown_vm = nullptr;
+    GUIThrottle throttle;
+
+    bool Refresh();
+
 public:
     std::shared_ptr<VirtualMachine> vm;
 
@@ -24,4 +49,4 @@ public:
     void Draw();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -2,13 +2,12 @@
 
 #include <imgui.h>
 
-#include <unordered_map>
 #include <format>
 #include <array>
 #include <tuple>
 #include <string>
 
-void GUICSR::Draw() {
+void GUICSR::Refresh() {
     using CSRTuple = std::tuple<Word, std::string>;
     using VM = VirtualMachine;
     
@@ -16,6 +15,13 @@ void GUICSR::Draw() {
         CSRTuple(VM::CSR_FFLAGS, "fflags"),
         CSRTuple(VM::CSR_FRM, "frm"),
         CSRTuple(VM::CSR_FCSR, "fcsr"),
+        CSRTuple(VM::CSR_VSTART, "vstart"),
+        CSRTuple(VM::CSR_VXSAT, "vxsat"),
+        CSRTuple(VM::CSR_VXRM, "vxrm"),
+        CSRTuple(VM::CSR_VCSR, "vcsr"),
+        CSRTuple(VM::CSR_VL, "vl"),
+        CSRTuple(VM::CSR_VTYPE, "vtype"),
+        CSRTuple(VM::CSR_VLENB, "vlenb"),
         CSRTuple(VM::CSR_CYCLE, "cycle"),
         CSRTuple(VM::CSR_TIME, "time"),
         CSRTuple(VM::CSR_INSTRET, "instret"),
@@ -61,14 +67,27 @@ void GUICSR::Draw() {
         CSRTuple(VM::CSR_MINSTRETH, "minstreth"),
     };
 
-    if (ImGui::Begin("CSRs")) {
-        std::unordered_map<Long, Long> csrs;
-        vm->GetCSRSnapshot(csrs);
+    lines.clear();
+    if (!vm->ReadState(*state)) return;
+
+    const auto& csrs = state->csrs;
+
+    for (const auto& [csr, name] : csrs_names)
+        lines.push_back(std::format("{:<16}0x{:<3x} : 0x{:0>16x} ({})", name, csr, csrs[csr], csrs[csr]));
+}
 
-        for (const auto& [csr, name] : csrs_names) {
-            auto fmt = std::format("{:<16}0x{:<3x} : 0x{:0>16x} ({})", name, csr, csrs[csr], csrs[csr]);
-            ImGui::Text("%s", fmt.c_str());
+void GUICSR::Draw() {
+    if (ImGui::Begin("CSRs")) {
+        if (vm.get() != shown_vm) {
+            shown_vm = vm.get();
+            throttle.Expire();
         }
+
+        if (throttle.Due())
+            Refresh();
+
+        for (const auto& line : lines)
+            ImGui::TextUnformatted(line.c_str());
     }
 
     ImGui::End();
@@ -2,10 +2,21 @@
 #define GUI_CSR_HPP
 
 #include "VirtualMachine.hpp"
+#include "GUIThrottle.hpp"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 class GUICSR {
+    std::unique_ptr<VirtualMachine::HartState> state = std::make_unique<VirtualMachine::HartState>();
+    std::vector<std::string> lines;
+
+    const VirtualMachine* shown_vm = nullptr;
+    GUIThrottle throttle;
+
+    void Refresh();
+
 public:
     std::shared_ptr<VirtualMachine> vm;
     
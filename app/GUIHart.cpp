@@ -44,6 +44,12 @@ void GUIHart::Draw() {
         else
             ImGui::Text("IPS: %f.2B", b_ips);
 
+        if (vm->UsesJIT())
+            ImGui::Text("JIT coverage: %.1f%%", vm->GetJITCoverage() * 100.0);
+
+        if (vm->UsesBasicBlocks())
+            ImGui::Text("Indirect hits: %.1f%%", vm->GetIndirectHitRate() * 100.0);
+
         ImGui::NewLine();
 
         if (vm->Is32BitMode())
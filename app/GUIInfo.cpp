@@ -29,6 +29,13 @@ void GUIInfo::Draw() {
         } else {
             ImGui::Text("Host memory size: %.2f GiBs", hm_gbs);
         }
+
+        auto stats = memory.GetCompressionStats();
+        auto packed_kbs = stats.packed_bytes / 1024.0f;
+        auto ratio = stats.packed_bytes ? stats.pages * Memory::PAGE_SIZE / static_cast<float>(stats.packed_bytes) : 0.0f;
+
+        ImGui::Text("Compressed pages: %llu in %.2f KiBs (%.2fx)", static_cast<unsigned long long>(stats.pages), packed_kbs, ratio);
+        ImGui::Text("Pages decompressed: %llu", static_cast<unsigned long long>(stats.unpacked));
     }
 
     ImGui::End();
@@ -0,0 +1,116 @@
+#include "GUIMemoryHeatmap.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <stdexcept>
+#include <string>
+
+void GUIMemoryHeatmap::BuildCells() {
+    cells.clear();
+    hottest = 0;
+
+    auto& regions = memory.GetMemoryRegions();
+    if (region >= regions.size()) return;
+
+    auto& shown = *regions[region];
+    Address pages = (shown.size + Memory::PAGE_SIZE - 1) / Memory::PAGE_SIZE;
+
+    pages_per_cell = std::max<Address>(1, (pages + MAX_CELLS - 1) / MAX_CELLS);
+    cells.resize((pages + pages_per_cell - 1) / pages_per_cell);
+
+    for (auto& [page, counts] : stats.pages) {
+        if (page < shown.base || page >= shown.base + shown.size) continue;
+
+        auto& cell = cells[(page - shown.base) / Memory::PAGE_SIZE / pages_per_cell];
+        cell.reads += counts.reads;
+        cell.writes += counts.writes;
+        cell.atomics += counts.atomics;
+
+        hottest = std::max(hottest, cell.Total());
+    }
+}
+
+void GUIMemoryHeatmap::Draw() {
+    if (ImGui::Begin("Memory Heatmap")) {
+        bool sampling = memory.IsSampling();
+        if (ImGui::Checkbox("Sampling", &sampling)) {
+            memory.SetAccessSampling(sampling);
+            window_end = std::chrono::steady_clock::now() + WINDOW;
+        }
+
+        ImGui::SameLine();
+        if (ImGui::Button("Export CSV")) {
+            try {
+                memory.WriteAccessStats("memory_access.csv", stats);
+            }
+            catch (const std::runtime_error&) {
+                ImGui::OpenPopup("Access export failed");
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (sampling && now >= window_end) {
+            stats = memory.TakeAccessStats();
+            window_end = now + WINDOW;
+            BuildCells();
+        }
+
+        auto& regions = memory.GetMemoryRegions();
+        if (region >= regions.size()) region = 0;
+
+        auto RegionName = [&](size_t i) {
+            return std::format("Type {} at 0x{:x}", regions[i]->type, regions[i]->base);
+        };
+
+        auto preview = regions.empty() ? std::string() : RegionName(region);
+        if (ImGui::BeginCombo("Region", preview.c_str())) {
+            for (size_t i = 0; i < regions.size(); i++) {
+                if (ImGui::Selectable(RegionName(i).c_str(), i == region)) {
+                    region = i;
+                    BuildCells();
+                }
+            }
+
+            ImGui::EndCombo();
+        }
+
+        if (region < stats.regions.size()) {
+            auto& total = stats.regions[region];
+            ImGui::Text("Reads: %llu, writes: %llu, atomics: %llu over %.2fs", total.reads, total.writes, total.atomics, stats.seconds);
+        }
+
+        ImGui::Text("Each cell is %llu KiBs", pages_per_cell * Memory::PAGE_SIZE / 1024);
+
+        float cell_size = std::max(2.0f, ImGui::GetContentRegionAvail().x / COLUMNS);
+        auto origin = ImGui::GetCursorScreenPos();
+        auto draw_list = ImGui::GetWindowDrawList();
+
+        for (size_t i = 0; i < cells.size(); i++) {
+            ImVec2 min(origin.x + (i % COLUMNS) * cell_size, origin.y + (i / COLUMNS) * cell_size);
+            ImVec2 max(min.x + cell_size - 1, min.y + cell_size - 1);
+
+            // Log scaled, so a few very hot pages don't wash the rest out
+            auto total = cells[i].Total();
+            float heat = hottest ? std::log1p(static_cast<float>(total)) / std::log1p(static_cast<float>(hottest)) : 0.0f;
+
+            draw_list->AddRectFilled(min, max, ImGui::GetColorU32(ImVec4(heat, 0.2f * (1.0f - heat), 1.0f - heat, total ? 1.0f : 0.25f)));
+
+            if (ImGui::IsMouseHoveringRect(min, max)) {
+                Address start = regions[region]->base + i * pages_per_cell * Memory::PAGE_SIZE;
+                ImGui::SetTooltip("0x%llx\nReads: %llu\nWrites: %llu\nAtomics: %llu", start, cells[i].reads, cells[i].writes, cells[i].atomics);
+            }
+        }
+
+        ImGui::Dummy(ImVec2(COLUMNS * cell_size, ((cells.size() + COLUMNS - 1) / COLUMNS) * cell_size));
+
+        if (ImGui::BeginPopup("Access export failed")) {
+            ImGui::Text("Could not write the access counts");
+            ImGui::EndPopup();
+        }
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,36 @@
+#ifndef GUI_MEMORY_HEATMAP_HPP
+#define GUI_MEMORY_HEATMAP_HPP
+
+#include "Memory.hpp"
+
+#include <chrono>
+#include <vector>
+
+// How often each page of a region was accessed over the last sampling
+// window, one cell per page or per run of pages in large regions
+class GUIMemoryHeatmap {
+    static constexpr size_t COLUMNS = 64;
+    static constexpr size_t MAX_CELLS = COLUMNS * 64;
+    static constexpr auto WINDOW = std::chrono::seconds(1);
+
+    Memory& memory;
+
+    AccessStats stats;
+    std::chrono::steady_clock::time_point window_end{};
+
+    size_t region = 0;
+    Address pages_per_cell = 1;
+    std::vector<AccessCounts> cells;
+    Long hottest = 0;
+
+    // Buckets the window's pages of the shown region into cells
+    void BuildCells();
+
+public:
+    GUIMemoryHeatmap(Memory& memory) : memory{memory} {}
+    ~GUIMemoryHeatmap() = default;
+
+    void Draw();
+};
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <imgui.h>
 #include <misc/cpp/imgui_stdlib.h>
+#include <array>
 #include <cstdio>
 #include <cmath>
 #include <string>
@@ -10,6 +11,15 @@ constexpr size_t COLUMNS = 16;
 constexpr float CELL_PADDING = 1.25;
 constexpr float PADDING = 1.5;
 
+// Every cell is one of these, so drawing a row doesn't format anything
+static const auto hex_cells = [] {
+    std::array<std::array<char, 3>, 256> cells{};
+    for (size_t i = 0; i < cells.size(); i++)
+        std::snprintf(cells[i].data(), cells[i].size(), "%02zx", i);
+
+    return cells;
+}();
+
 void GUIMemoryViewer::CreateStyle() {
     if (style != nullptr) return;
 
@@ -46,19 +56,38 @@ void GUIMemoryViewer::UpdateBuffer() {
     end_address = end_address < memory.GetMaxAddress() ? end_address : memory.GetMaxAddress();
     
     if (read_address >= memory.GetMaxAddress()) {
-        data_buffer.clear();
+        data_size = 0;
+        mapped_ranges.clear();
         return;
     }
-    
-    data_buffer = memory.PeekWords(read_address, (end_address - read_address) / sizeof(Word));
+
+    data_size = end_address - read_address;
+    mapped_ranges = memory.PeekBytes(read_address, std::span<Byte>(data_buffer.data(), data_size));
 }
 
 GUIMemoryViewer::GUIMemoryViewer(Memory& memory, std::shared_ptr<VirtualMachine> vm, Address read_address) : memory{memory}, read_address{read_address}, vm{vm} {
     UpdateBuffer();
 }
 
+void GUIMemoryViewer::Refresh() {
+    UpdateBuffer();
+
+    if (vm->ReadState(*state)) {
+        pc = state->pc;
+        sp = state->regs[VirtualMachine::REG_SP].u64;
+    }
+}
+
 void GUIMemoryViewer::Draw() {
     if (ImGui::Begin("Memory Viewer")) {
+        if (vm.get() != shown_vm) {
+            shown_vm = vm.get();
+            throttle.Expire();
+        }
+
+        if (throttle.Due())
+            Refresh();
+
         bool update_window = style == nullptr;
         CreateStyle();
 
@@ -74,7 +103,7 @@ void GUIMemoryViewer::Draw() {
 
         ImGuiListClipper clipper;
 
-        size_t lines = static_cast<size_t>(ceilf(static_cast<float>(data_buffer.size()) / sizeof(Word)));
+        size_t lines = (data_size + COLUMNS - 1) / COLUMNS;
         clipper.Begin(lines, style->line_height);
 
         ImVec2 window_pos = ImGui::GetWindowPos();
@@ -113,34 +142,30 @@ void GUIMemoryViewer::Draw() {
                     float ascii_pos_x = c * style->glyph_width + style->ascii_start;
 
                     Address byte_index = index + c;
-                    if ((byte_index >> 2) >= data_buffer.size()) {
+                    if (byte_index >= data_size) {
                         ImGui::Text("..");
                         ImGui::SameLine(ascii_pos_x);
                         ImGui::Text(" ");
                     } else {
-                        if (data_buffer[byte_index >> 2].second) {
-                            Word value = data_buffer[byte_index >> 2].first;
-                            Byte byte = value >> (8 * (byte_index & 0b11));
-
-                            if (addr + c == vm->GetPC()) {
-                                ImGui::TextColored(gui_pc_highlight_color, "%02x", byte);
-                            } else if (addr + c == vm->GetSP()) {
-                                ImGui::TextColored(gui_sp_highlight_color, "%02x", byte);
+                        if (Memory::IsInRanges(mapped_ranges, addr + c, 1)) {
+                            Byte byte = data_buffer[byte_index];
+
+                            if (addr + c == pc) {
+                                ImGui::TextColored(gui_pc_highlight_color, "%s", hex_cells[byte].data());
+                            } else if (addr + c == sp) {
+                                ImGui::TextColored(gui_sp_highlight_color, "%s", hex_cells[byte].data());
                             } else {
-                                ImGui::Text("%02x", byte);
+                                ImGui::TextUnformatted(hex_cells[byte].data());
                             }
 
                             ImGui::SameLine(ascii_pos_x);
-                            if (byte >= 32 && byte < 127) {
-                                ImGui::Text("%c", byte);
-                            } else {
-                                ImGui::Text(".");
-                            }
+                            char ascii[2] = { byte >= 32 && byte < 127 ? static_cast<char>(byte) : '.', 0 };
+                            ImGui::TextUnformatted(ascii);
                         }
                         else {
-                            if (addr + c == vm->GetPC())
+                            if (addr + c == pc)
                                 ImGui::TextColored(gui_pc_highlight_color, "xx");
-                            else if (addr + c == vm->GetSP())
+                            else if (addr + c == sp)
                                 ImGui::TextColored(gui_sp_highlight_color, "xx");
                             else
                                 ImGui::Text("xx");
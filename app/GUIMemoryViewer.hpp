@@ -5,7 +5,10 @@
 #include "VirtualMachine.hpp"
 
 #include "GUIConstants.hpp"
+#include "GUIThrottle.hpp"
 
+#include <array>
+#include <memory>
 #include <string>
 #include <utility>
 
@@ -30,11 +33,25 @@ class GUIMemoryViewer {
     void CreateStyle();
     void UpdateBuffer();
 
-    std::vector<std::pair<Word, bool>> data_buffer;
+    // One page read in bulk on every refresh, reused so the GUI thread
+    // doesn't allocate per frame
+    std::array<Byte, Memory::PAGE_SIZE> data_buffer{};
+    Address data_size = 0;
+    std::vector<Memory::Range> mapped_ranges;
     Address read_address = 0;
 
     std::string text_input_buffer = "0";
 
+    // Highlighted cells, as of the last refresh
+    std::unique_ptr<VirtualMachine::HartState> state = std::make_unique<VirtualMachine::HartState>();
+    Address pc = 0;
+    Address sp = 0;
+
+    const VirtualMachine* shown_vm = nullptr;
+    GUIThrottle throttle;
+
+    void Refresh();
+
 public:
     std::shared_ptr<VirtualMachine> vm;
     
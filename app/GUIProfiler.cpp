@@ -0,0 +1,102 @@
+#include "GUIProfiler.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <format>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void GUIProfiler::Draw() {
+    if (ImGui::Begin("Profiler")) {
+        bool profiling = vm->IsProfiling();
+        if (ImGui::Checkbox("Enabled", &profiling))
+            vm->SetProfiling(profiling);
+
+        ImGui::SameLine();
+        if (ImGui::Button("Reset"))
+            vm->ResetProfile();
+
+        ImGui::SameLine();
+        if (ImGui::Button("Dump")) {
+            auto path = std::format("profile_hart{}.txt", vm->GetHartID());
+
+            try {
+                vm->WriteProfile(path, symbols.get());
+            }
+            catch (const std::runtime_error&) {
+                ImGui::OpenPopup("Profile dump failed");
+            }
+        }
+
+        auto profile = vm->GetProfile();
+
+        Long total = std::accumulate(profile.instructions.begin(), profile.instructions.end(), 0ULL);
+        ImGui::Text("Instructions: %llu", total);
+
+        ImGui::NewLine();
+
+        std::vector<std::pair<Long, size_t>> types;
+        for (size_t type = 0; type < profile.instructions.size(); type++) {
+            if (profile.instructions[type] != 0)
+                types.emplace_back(profile.instructions[type], type);
+        }
+
+        std::sort(types.rbegin(), types.rend());
+        if (types.size() > TOP_COUNT) types.resize(TOP_COUNT);
+
+        for (const auto& [count, type] : types) {
+            auto name = Profiler::GetTypeName(static_cast<RVInstruction::Type>(type));
+            auto fmt = std::format("{:<16}{:>14} {:>6.2f}%", name, count, 100.0 * count / total);
+            ImGui::Text("%s", fmt.c_str());
+        }
+
+        ImGui::NewLine();
+
+        auto TLBText = [](const char* name, Long hits, Long misses) {
+            Long lookups = hits + misses;
+            double rate = lookups == 0 ? 0.0 : 100.0 * hits / lookups;
+            ImGui::Text("%s TLB: %llu hits, %llu misses (%.2f%% hit)", name, hits, misses, rate);
+        };
+
+        TLBText("Instruction", profile.instruction_tlb_hits, profile.instruction_tlb_misses);
+        TLBText("Data", profile.data_tlb_hits, profile.data_tlb_misses);
+
+        ImGui::NewLine();
+
+        for (size_t cause = 0; cause < Profiler::TRAP_CAUSES; cause++) {
+            if (profile.exceptions[cause] != 0)
+                ImGui::Text("Exception %llu: %llu", static_cast<Long>(cause), profile.exceptions[cause]);
+
+            if (profile.interrupts[cause] != 0)
+                ImGui::Text("Interrupt %llu: %llu", static_cast<Long>(cause), profile.interrupts[cause]);
+        }
+
+        ImGui::NewLine();
+
+        std::vector<std::pair<Long, Address>> samples;
+        Long sample_count = 0;
+        for (const auto& [pc, count] : profile.pc_samples) {
+            samples.emplace_back(count, pc);
+            sample_count += count;
+        }
+
+        std::sort(samples.rbegin(), samples.rend());
+        if (samples.size() > TOP_COUNT) samples.resize(TOP_COUNT);
+
+        ImGui::Text("Hot PCs (1 sample per %llu instructions)", Profiler::SAMPLE_PERIOD);
+        for (const auto& [count, pc] : samples) {
+            auto fmt = std::format("0x{:0>16x} {:>10} {:>6.2f}% {}", pc, count, 100.0 * count / sample_count, symbols ? symbols->Format(pc) : std::string());
+            ImGui::Text("%s", fmt.c_str());
+        }
+
+        if (ImGui::BeginPopup("Profile dump failed")) {
+            ImGui::Text("Could not write the profile");
+            ImGui::EndPopup();
+        }
+    }
+
+    ImGui::End();
+}
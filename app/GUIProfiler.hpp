@@ -0,0 +1,24 @@
+#ifndef GUI_PROFILER_HPP
+#define GUI_PROFILER_HPP
+
+#include "VirtualMachine.hpp"
+#include "ELF.hpp"
+
+#include <memory>
+
+class GUIProfiler {
+    static constexpr size_t TOP_COUNT = 16;
+
+public:
+    std::shared_ptr<VirtualMachine> vm;
+
+    // Names hot PCs when the guest was loaded from an ELF image
+    std::shared_ptr<const SymbolTable> symbols;
+
+    GUIProfiler(std::shared_ptr<VirtualMachine> vm, std::shared_ptr<const SymbolTable> symbols = nullptr) : vm{vm}, symbols{std::move(symbols)} {}
+    ~GUIProfiler() = default;
+
+    void Draw();
+};
+
+#endif
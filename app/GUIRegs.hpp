@@ -2,8 +2,26 @@
 #define GUI_STATE_HPP
 
 #include "VirtualMachine.hpp"
+#include "GUIThrottle.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
 
 class GUIRegs {
+    // Filled from the hart's published state on every refresh
+    std::unique_ptr<VirtualMachine::HartState> state = std::make_unique<VirtualMachine::HartState>();
+
+    // Formatted once per refresh and drawn as is every frame
+    std::string pc_line;
+    std::string sp_line;
+    std::vector<std::string> lines;
+
+    const VirtualMachine* shown_vm = nullptr;
+    GUIThrottle throttle;
+
+    void Refresh();
+
 public:
     std::shared_ptr<VirtualMachine> vm;
     
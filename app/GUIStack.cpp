@@ -7,67 +7,71 @@
 #include <stdexcept>
 #include <format>
 
-void GUIStack::Draw() {
-    if (ImGui::Begin("Stack")) {
-        Word sp = vm->GetSP();
+void GUIStack::Refresh() {
+    lines.clear();
+    sp_line = WINDOW;
 
-        SAddress window_begin = sp >> 2;
-        SAddress window_end = window_begin + WINDOW;
-        SAddress window_end_pc = window_end << 2;
+    if (!vm->ReadState(*state)) return;
 
-        if (static_cast<Address>(window_end_pc) >= memory.GetTotalMemory()) {
-            window_end = memory.GetUsedMemory() >> 2;
-            window_end_pc = window_end << 2;
-            window_begin = window_end - WINDOW;
-        }
+    bool is_32_bit = state->is_32_bit_mode;
+    Address sp = is_32_bit ? state->regs[VirtualMachine::REG_SP].u32 : state->regs[VirtualMachine::REG_SP].u64;
+
+    SAddress window_begin = sp >> 2;
+    SAddress window_end = window_begin + WINDOW;
+    SAddress window_end_pc = window_end << 2;
+
+    if (static_cast<Address>(window_end_pc) >= memory.GetTotalMemory()) {
+        window_end = memory.GetUsedMemory() >> 2;
+        window_end_pc = window_end << 2;
+        window_begin = window_end - WINDOW;
+    }
+
+    if (window_begin < 0) {
+        throw std::runtime_error(std::format("Memory needs to be at least {} bytes in size", WINDOW << 2));
+    }
+
+    Address window_pc = static_cast<Address>(window_begin) << 2;
+    Address stride = is_32_bit ? sizeof(Word) : sizeof(Long);
+
+    if (is_32_bit)
+        mapped_ranges = memory.Peek(window_pc, std::span<Word>(reinterpret_cast<Word*>(window.data()), WINDOW));
 
-        if (window_begin < 0) {
-            throw std::runtime_error(std::format("Memory needs to be at least {} bytes in size", WINDOW << 2));
+    else
+        mapped_ranges = memory.Peek(window_pc, std::span<Long>(window));
+
+    for (Address addr = window_pc, i = 0; i < WINDOW; addr += stride, i++) {
+        const char* marker = addr == sp ? "->" : "  ";
+        if (addr == sp) sp_line = i;
+
+        if (!Memory::IsInRanges(mapped_ranges, addr, stride))
+            lines.push_back(std::format("{} Unmapped memory", marker));
+
+        else if (is_32_bit) {
+            Word value = reinterpret_cast<const Word*>(window.data())[i];
+            lines.push_back(std::format("{} 0x{:0>8x} : 0x{:0>8x} ({})", marker, addr, value, static_cast<int32_t>(value)));
         }
 
-        Address window_pc = static_cast<Address>(window_begin) << 2;
-
-        if (vm->Is32BitMode()) {
-            auto values = memory.PeekWords(window_pc, WINDOW);
-
-            for (Address addr = window_pc, i = 0; i < WINDOW; addr += 4, i++) {
-                if (values[i].second) {
-                    if (addr == sp) {
-                        ImGui::TextColored(gui_sp_highlight_color, "-> 0x%08llx : 0x%08x (%i)", addr, values[i].first, values[i].first);
-                    } else {
-                        ImGui::Text("   0x%08llx : 0x%08x (%i)", addr, values[i].first, values[i].first);
-                    }
-                }
-                else {
-                    if (addr == sp)
-                        ImGui::TextColored(gui_sp_highlight_color, "-> Unmapped memory");
-                    
-                    else
-                        ImGui::Text("   Unmapped memory");
-                }
-            }
+        else
+            lines.push_back(std::format("{} 0x{:0>16x} : 0x{:0>16x} ({})", marker, addr, window[i], window[i]));
+    }
+}
+
+void GUIStack::Draw() {
+    if (ImGui::Begin("Stack")) {
+        if (vm.get() != shown_vm) {
+            shown_vm = vm.get();
+            throttle.Expire();
         }
-        else {
-            auto values = memory.PeekLongs(window_pc, WINDOW);
-
-            for (Address addr = window_pc, i = 0; i < WINDOW; addr += 8, i++) {
-                auto str = std::format("{} 0x{:0>16x} : 0x{:0>16x} ({})",  addr == sp ? "->" : "  ", addr, values[i].first, values[i].first);
-
-                if (values[i].second) {
-                    if (addr == sp) {
-                        ImGui::TextColored(gui_sp_highlight_color, "%s", str.c_str());
-                    } else {
-                        ImGui::Text("%s", str.c_str());
-                    }
-                }
-                else {
-                    if (addr == sp)
-                        ImGui::TextColored(gui_sp_highlight_color, "-> Unmapped memory");
-                    
-                    else
-                        ImGui::Text("   Unmapped memory");
-                }
-            }
+
+        if (throttle.Due())
+            Refresh();
+
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (i == sp_line)
+                ImGui::TextColored(gui_sp_highlight_color, "%s", lines[i].c_str());
+
+            else
+                ImGui::TextUnformatted(lines[i].c_str());
         }
     }
 
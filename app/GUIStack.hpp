@@ -3,12 +3,34 @@
 
 #include "VirtualMachine.hpp"
 #include "Memory.hpp"
+#include "GUIThrottle.hpp"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
 
 class GUIStack {
     Memory& memory;
 
     static constexpr size_t WINDOW = 128;
 
+    // Read in bulk on every refresh into the same buffers, as words or
+    // longs depending on the hart's mode
+    std::array<Long, WINDOW> window{};
+    std::vector<Memory::Range> mapped_ranges;
+
+    std::unique_ptr<VirtualMachine::HartState> state = std::make_unique<VirtualMachine::HartState>();
+
+    // Formatted once per refresh, with the line sp points at highlighted
+    std::vector<std::string> lines;
+    size_t sp_line = WINDOW;
+
+    const VirtualMachine* shown_vm = nullptr;
+    GUIThrottle throttle;
+
+    void Refresh();
+
 public:
     std::shared_ptr<VirtualMachine> vm;
     GUIStack(std::shared_ptr<VirtualMachine> vm, Memory& memory) : memory{memory}, vm{vm} {}
@@ -0,0 +1,30 @@
+#ifndef GUI_THROTTLE_HPP
+#define GUI_THROTTLE_HPP
+
+#include <chrono>
+
+// How often panels rebuild what they show. Drawing happens every frame
+// from the last rebuild, so this bounds the GUI thread's work per second
+// no matter the frame rate. Set from --gui_refresh_ms
+inline std::chrono::milliseconds gui_refresh_interval(33);
+
+class GUIThrottle {
+    std::chrono::steady_clock::time_point last{};
+
+public:
+    // True at most once per gui_refresh_interval, and right after Expire
+    inline bool Due() {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last < gui_refresh_interval) return false;
+
+        last = now;
+        return true;
+    }
+
+    // Rebuild on the next frame, e.g. after the panel switched harts
+    inline void Expire() {
+        last = {};
+    }
+};
+
+#endif
@@ -0,0 +1,454 @@
+#include "IOLoop.hpp"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <winsock2.h>
+#elif defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <sys/event.h>
+#include <unistd.h>
+#define IO_LOOP_KQUEUE
+#else
+#include <poll.h>
+#endif
+
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <span>
+
+// Waits on many sockets at once. Level triggered: a socket keeps being
+// reported while it has something to read, or room to write when asked
+class IOLoop::Poller {
+public:
+    struct Event {
+        Long id;
+        bool readable;
+        bool writable;
+    };
+
+private:
+#if defined(__linux__)
+    int handle;
+
+public:
+    Poller() : handle{epoll_create1(EPOLL_CLOEXEC)} {
+        if (handle == -1) {
+            std::cerr << "Cannot create an epoll instance" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    ~Poller() {
+        close(handle);
+    }
+
+    void Add(intptr_t socket, Long id, bool write) {
+        epoll_event event{};
+        event.events = EPOLLIN | (write ? static_cast<uint32_t>(EPOLLOUT) : 0);
+        event.data.u64 = id;
+        epoll_ctl(handle, EPOLL_CTL_ADD, static_cast<int>(socket), &event);
+    }
+
+    void Modify(intptr_t socket, Long id, bool write) {
+        epoll_event event{};
+        event.events = EPOLLIN | (write ? static_cast<uint32_t>(EPOLLOUT) : 0);
+        event.data.u64 = id;
+        epoll_ctl(handle, EPOLL_CTL_MOD, static_cast<int>(socket), &event);
+    }
+
+    // A closed socket already left the set, and its handle may belong to
+    // a newer one by now
+    void Remove(intptr_t socket, Long, bool open) {
+        if (open) epoll_ctl(handle, EPOLL_CTL_DEL, static_cast<int>(socket), nullptr);
+    }
+
+    void Wait(std::chrono::milliseconds timeout, std::vector<Event>& events) {
+        epoll_event ready[64];
+        int count = epoll_wait(handle, ready, std::size(ready), static_cast<int>(timeout.count()));
+
+        for (int i = 0; i < count; i++) {
+            auto flags = ready[i].events;
+            events.push_back({static_cast<Long>(ready[i].data.u64), (flags & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0, (flags & (EPOLLOUT | EPOLLERR)) != 0});
+        }
+    }
+#elif defined(IO_LOOP_KQUEUE)
+    int handle;
+
+    void Change(intptr_t socket, Long id, int16_t filter, uint16_t flags) {
+        struct kevent change;
+        EV_SET(&change, static_cast<uintptr_t>(socket), filter, flags, 0, 0, reinterpret_cast<void*>(static_cast<intptr_t>(id)));
+        kevent(handle, &change, 1, nullptr, 0, nullptr);
+    }
+
+public:
+    Poller() : handle{kqueue()} {
+        if (handle == -1) {
+            std::cerr << "Cannot create a kqueue" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    ~Poller() {
+        close(handle);
+    }
+
+    void Add(intptr_t socket, Long id, bool write) {
+        Change(socket, id, EVFILT_READ, EV_ADD);
+        Change(socket, id, EVFILT_WRITE, EV_ADD | (write ? EV_ENABLE : EV_DISABLE));
+    }
+
+    void Modify(intptr_t socket, Long id, bool write) {
+        Change(socket, id, EVFILT_WRITE, write ? EV_ENABLE : EV_DISABLE);
+    }
+
+    // A closed socket already left the queue, and its handle may belong
+    // to a newer one by now
+    void Remove(intptr_t socket, Long id, bool open) {
+        if (!open) return;
+
+        Change(socket, id, EVFILT_READ, EV_DELETE);
+        Change(socket, id, EVFILT_WRITE, EV_DELETE);
+    }
+
+    void Wait(std::chrono::milliseconds timeout, std::vector<Event>& events) {
+        timespec time;
+        time.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+        time.tv_nsec = static_cast<long>(timeout.count() % 1000 * 1000000);
+
+        struct kevent ready[64];
+        int count = kevent(handle, nullptr, 0, ready, std::size(ready), &time);
+
+        for (int i = 0; i < count; i++) {
+            auto id = static_cast<Long>(reinterpret_cast<intptr_t>(ready[i].udata));
+            bool failed = (ready[i].flags & (EV_EOF | EV_ERROR)) != 0;
+            events.push_back({id, ready[i].filter == EVFILT_READ || failed, ready[i].filter == EVFILT_WRITE});
+        }
+    }
+#else
+    // Windows gets WSAPoll. IOCP completes reads into buffers it was given
+    // up front, which doesn't fit sockets that are read when ready
+    struct Entry {
+        intptr_t socket;
+        Long id;
+        bool write;
+    };
+
+    std::vector<Entry> entries;
+
+#if defined(_WIN32) || defined(_WIN64)
+    std::vector<WSAPOLLFD> ready;
+#else
+    std::vector<pollfd> ready;
+#endif
+
+public:
+    void Add(intptr_t socket, Long id, bool write) {
+        entries.push_back({socket, id, write});
+    }
+
+    void Modify(intptr_t, Long id, bool write) {
+        for (auto& entry : entries)
+            if (entry.id == id) entry.write = write;
+    }
+
+    void Remove(intptr_t, Long id, bool) {
+        std::erase_if(entries, [id](const Entry& entry) { return entry.id == id; });
+    }
+
+    void Wait(std::chrono::milliseconds timeout, std::vector<Event>& events) {
+        if (entries.empty()) {
+            std::this_thread::sleep_for(timeout);
+            return;
+        }
+
+        ready.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); i++) {
+            ready[i] = {};
+            ready[i].fd = static_cast<decltype(ready[i].fd)>(entries[i].socket);
+            ready[i].events = POLLRDNORM | (entries[i].write ? POLLWRNORM : 0);
+        }
+
+#if defined(_WIN32) || defined(_WIN64)
+        int count = WSAPoll(ready.data(), static_cast<ULONG>(ready.size()), static_cast<INT>(timeout.count()));
+#else
+        int count = poll(ready.data(), ready.size(), static_cast<int>(timeout.count()));
+#endif
+        if (count <= 0) return;
+
+        for (size_t i = 0; i < ready.size(); i++) {
+            auto flags = ready[i].revents;
+            if (flags == 0) continue;
+
+            events.push_back({entries[i].id, (flags & (POLLRDNORM | POLLHUP | POLLERR | POLLNVAL)) != 0, (flags & (POLLWRNORM | POLLERR)) != 0});
+        }
+    }
+#endif
+};
+
+IOLoop::IOLoop() : poller{std::make_unique<Poller>()} {}
+
+IOLoop::~IOLoop() {
+    Stop();
+}
+
+void IOLoop::Post(Handler handler) {
+    std::lock_guard guard(thread_lock);
+    if (!stopped) Queue(std::move(handler));
+}
+
+void IOLoop::Call(const Handler& handler) {
+    if (IsLoopThread()) {
+        handler();
+        return;
+    }
+
+    std::promise<void> done;
+    auto finished = done.get_future();
+
+    {
+        std::lock_guard guard(thread_lock);
+        if (stopped) {
+            handler();
+            return;
+        }
+
+        Queue([&]() {
+            handler();
+            done.set_value();
+        });
+    }
+
+    finished.wait();
+}
+
+void IOLoop::Queue(Handler handler) {
+    posted_lock.lock();
+    posted.push_back(std::move(handler));
+    posted_lock.unlock();
+
+    if (!thread.joinable()) {
+        thread = std::jthread([this](std::stop_token stop) {
+            Run(stop);
+        });
+    }
+}
+
+void IOLoop::Stop() {
+    std::lock_guard guard(thread_lock);
+    if (stopped) return;
+
+    stopped = true;
+
+    if (thread.joinable()) {
+        thread.request_stop();
+        thread.join();
+    }
+
+    for (auto& [id, entry] : watched)
+        poller->Remove(entry.handle, id, entry.socket->IsOpen());
+
+    watched.clear();
+    watch_ids.clear();
+    timers.clear();
+}
+
+bool IOLoop::IsLoopThread() const {
+    return loop_thread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+void IOLoop::Run(std::stop_token stop) {
+    loop_thread = std::this_thread::get_id();
+
+    std::vector<Poller::Event> events;
+
+    while (!stop.stop_requested()) {
+        RunPosted();
+
+        auto now = std::chrono::steady_clock::now();
+        auto timeout = MAX_WAIT;
+        for (auto& timer : timers) {
+            if (!timer.handler) continue;
+            timeout = std::min(timeout, std::max(std::chrono::milliseconds(0), std::chrono::duration_cast<std::chrono::milliseconds>(timer.next - now)));
+        }
+
+        events.clear();
+        poller->Wait(timeout, events);
+
+        for (auto& event : events) {
+            auto found = watched.find(event.id);
+            if (found == watched.end()) continue;
+
+            auto& entry = found->second;
+            if (entry.removed || !entry.socket->IsOpen()) continue;
+
+            if (event.writable) Flush(event.id, entry);
+
+            // Copied, as a handler may watch its own socket again
+            if (event.readable && !entry.removed && entry.socket->IsOpen()) {
+                auto handler = entry.on_readable;
+                handler();
+            }
+        }
+
+        RunTimers();
+
+        // Whatever a handler dropped or the peer closed goes now, after
+        // nothing refers to it anymore
+        for (auto it = watched.begin(); it != watched.end();) {
+            auto& entry = it->second;
+            bool open = entry.socket->IsOpen();
+
+            if (!entry.removed && open) {
+                it++;
+                continue;
+            }
+
+            poller->Remove(entry.handle, it->first, open);
+            watch_ids.erase(entry.socket.get());
+            it = watched.erase(it);
+        }
+
+        std::erase_if(timers, [](const Timer& timer) { return !timer.handler; });
+    }
+
+    // Callers waiting in Call get their handlers run
+    RunPosted();
+
+    loop_thread = std::thread::id();
+}
+
+void IOLoop::RunPosted() {
+    posted_lock.lock();
+    auto handlers = std::move(posted);
+    posted.clear();
+    posted_lock.unlock();
+
+    for (auto& handler : handlers)
+        handler();
+}
+
+void IOLoop::RunTimers() {
+    auto now = std::chrono::steady_clock::now();
+
+    // By index and copied, as a handler may add or remove timers
+    for (size_t i = 0; i < timers.size(); i++) {
+        if (!timers[i].handler || timers[i].next > now) continue;
+
+        timers[i].next = std::max(timers[i].next + timers[i].interval, now);
+
+        auto handler = timers[i].handler;
+        handler();
+    }
+}
+
+void IOLoop::Watch(const std::shared_ptr<TCPSocket>& socket, Handler on_readable) {
+    auto found = watch_ids.find(socket.get());
+    if (found != watch_ids.end()) {
+        auto& entry = watched.at(found->second);
+        entry.on_readable = std::move(on_readable);
+        entry.removed = false;
+        return;
+    }
+
+    auto handle = socket->GetHandle();
+    if (handle == -1) return;
+
+    Long id = next_watch++;
+    auto& entry = watched[id];
+    entry.socket = socket;
+    entry.handle = handle;
+    entry.on_readable = std::move(on_readable);
+
+    watch_ids[socket.get()] = id;
+
+    poller->Add(handle, id, false);
+}
+
+void IOLoop::Unwatch(const std::shared_ptr<TCPSocket>& socket) {
+    auto found = watch_ids.find(socket.get());
+    if (found == watch_ids.end()) return;
+
+    auto& entry = watched.at(found->second);
+    entry.removed = true;
+    entry.queued.clear();
+    entry.queued_bytes = 0;
+    entry.offset = 0;
+}
+
+void IOLoop::Send(const std::shared_ptr<TCPSocket>& socket, Buffer buffer) {
+    if (!buffer || buffer->empty()) return;
+
+    auto found = watch_ids.find(socket.get());
+    if (found == watch_ids.end()) return;
+
+    auto& entry = watched.at(found->second);
+    if (entry.removed) return;
+
+    if (entry.queued_bytes + buffer->size() > MAX_QUEUED) {
+        entry.socket->Close();
+        return;
+    }
+
+    entry.queued_bytes += buffer->size();
+    entry.queued.push_back(std::move(buffer));
+
+    // Most sends fit right away and never wait for the poller
+    Flush(found->second, entry);
+}
+
+size_t IOLoop::GetQueued(const std::shared_ptr<TCPSocket>& socket) const {
+    auto found = watch_ids.find(socket.get());
+    return found == watch_ids.end() ? 0 : watched.at(found->second).queued_bytes;
+}
+
+void IOLoop::Flush(Long id, Watched& entry) {
+    std::span<const Byte> gather[16];
+
+    while (!entry.queued.empty()) {
+        size_t count = 0;
+        for (auto& buffer : entry.queued) {
+            if (count == std::size(gather)) break;
+
+            gather[count] = std::span<const Byte>(*buffer).subspan(count == 0 ? entry.offset : 0);
+            count++;
+        }
+
+        auto sent = entry.socket->SendSome(std::span(gather, count));
+        if (sent == 0) break;
+
+        entry.queued_bytes -= sent;
+
+        while (sent != 0) {
+            auto left = entry.queued.front()->size() - entry.offset;
+            if (sent < left) {
+                entry.offset += sent;
+                break;
+            }
+
+            sent -= left;
+            entry.offset = 0;
+            entry.queued.pop_front();
+        }
+    }
+
+    // Only ask to hear of room while something waits for it
+    bool writing = !entry.queued.empty() && entry.socket->IsOpen();
+    if (writing != entry.writing) {
+        poller->Modify(entry.handle, id, writing);
+        entry.writing = writing;
+    }
+}
+
+Long IOLoop::AddTimer(std::chrono::milliseconds interval, Handler handler) {
+    Long id = next_timer++;
+    timers.push_back({id, interval, std::chrono::steady_clock::now() + interval, std::move(handler)});
+    return id;
+}
+
+void IOLoop::RemoveTimer(Long id) {
+    // Removed after the timers run, as one may be running now
+    for (auto& timer : timers)
+        if (timer.id == id) timer.handler = nullptr;
+}
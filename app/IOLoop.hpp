@@ -0,0 +1,144 @@
+#ifndef APP_IO_LOOP_HPP
+#define APP_IO_LOOP_HPP
+
+#include "Socket.hpp"
+
+#include <Types.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// One thread serving every socket of the GDB stub, the frame server and
+// whatever else talks to the network. It waits on all of them at once with
+// epoll, kqueue or WSAPoll and runs a handler when one is readable, plus
+// timers for work that isn't driven by the peer.
+//
+// Sends are queued and written when the socket has room, a batch of
+// buffers per system call. Buffers are shared, not copied, so the same
+// bytes can go to many sockets and stay alive until the last one wrote
+// them.
+//
+// Watch, Unwatch, Send and the timer calls are for the loop's own thread,
+// from handlers or from Post
+class IOLoop {
+public:
+    using Handler = std::function<void()>;
+    using Buffer = std::shared_ptr<const std::vector<Byte>>;
+
+    // A socket with more than this queued is closed for falling behind
+    static constexpr size_t MAX_QUEUED = 64 * 1024 * 1024;
+
+    class Poller;
+
+private:
+    // Posted handlers wait for at most this long, as nothing interrupts
+    // a wait early
+    static constexpr auto MAX_WAIT = std::chrono::milliseconds(10);
+
+    struct Watched {
+        std::shared_ptr<TCPSocket> socket;
+        intptr_t handle;
+        Handler on_readable;
+
+        std::deque<Buffer> queued;
+        size_t queued_bytes = 0;
+
+        // How much of the first queued buffer already went
+        size_t offset = 0;
+
+        bool writing = false;
+        bool removed = false;
+    };
+
+    struct Timer {
+        Long id;
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point next;
+        Handler handler;
+    };
+
+    std::unique_ptr<Poller> poller;
+
+    // Keyed by an id that is never reused, so a late event for a socket
+    // already gone finds nothing
+    std::unordered_map<Long, Watched> watched;
+    std::unordered_map<const TCPSocket*, Long> watch_ids;
+    Long next_watch = 1;
+
+    std::vector<Timer> timers;
+    Long next_timer = 1;
+
+    std::vector<Handler> posted;
+    std::mutex posted_lock;
+
+    std::jthread thread;
+    std::atomic<std::thread::id> loop_thread;
+    std::mutex thread_lock;
+    bool stopped = false;
+
+    void Run(std::stop_token stop);
+
+    // With thread_lock held
+    void Queue(Handler handler);
+
+    void RunPosted();
+    void RunTimers();
+
+    void Flush(Long id, Watched& entry);
+
+public:
+    IOLoop();
+    IOLoop(const IOLoop&) = delete;
+
+    // Stops like Stop
+    ~IOLoop();
+
+    IOLoop& operator=(const IOLoop&) = delete;
+
+    // Runs the handler on the loop's thread, starting it on first use
+    void Post(Handler handler);
+
+    // Like Post, but waits for the handler to finish. Runs it right away
+    // when called from the loop or after it stopped
+    void Call(const Handler& handler);
+
+    // Stops the thread. Sockets still watched are dropped with what was
+    // queued for them
+    void Stop();
+
+    // Runs on_readable while the socket has something to read or accept.
+    // Watching a socket again replaces its handler
+    void Watch(const std::shared_ptr<TCPSocket>& socket, Handler on_readable);
+
+    // Drops the socket with anything it had queued
+    void Unwatch(const std::shared_ptr<TCPSocket>& socket);
+
+    // Queues the buffer after whatever the socket has queued. The socket
+    // has to be watched
+    void Send(const std::shared_ptr<TCPSocket>& socket, Buffer buffer);
+
+    // Bytes queued that haven't gone yet
+    size_t GetQueued(const std::shared_ptr<TCPSocket>& socket) const;
+
+    // Runs the handler every interval. One that falls behind runs once and
+    // starts again from then, it doesn't catch up
+    Long AddTimer(std::chrono::milliseconds interval, Handler handler);
+    void RemoveTimer(Long id);
+
+    bool IsLoopThread() const;
+
+    // For handlers that wait on something, to give up when the loop stops
+    inline std::stop_token GetStopToken() const {
+        return thread.get_stop_token();
+    }
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef APP_MACHINE_ARGS_HPP
+#define APP_MACHINE_ARGS_HPP
+
+#include <Memory.hpp>
+#include <VirtualMachine.hpp>
+
+#include <memory>
+#include <string>
+
+#include "ArgsParser.hpp"
+
+enum class Engine {
+    Interpreter,
+    Blocks,
+    JIT
+};
+
+enum class RAMBacking {
+    // Pages allocated one at a time as the guest touches them
+    Paged,
+    // One host mapping the OS fills in on first touch
+    Mapped,
+    // A mapping backed by huge pages where the host has them
+    HugePages
+};
+
+inline Engine engine = Engine::Blocks;
+inline RAMBacking ram_backing = RAMBacking::Paged;
+
+// Reads --engine=interpreter|blocks|jit and --ram_backing=paged|mapped|huge.
+// --jit, --mapped_ram and --huge_pages still work and mean the same thing.
+// Returns false with a message for a value it doesn't know
+inline bool ParseMachineArgs(ArgsParser& args_parser, std::string& error) {
+    if (args_parser.HasFlag("jit")) engine = Engine::JIT;
+
+    if (args_parser.HasValue("engine")) {
+        auto name = args_parser.GetValue<std::string>("engine");
+        if (name == "interpreter") engine = Engine::Interpreter;
+        else if (name == "blocks") engine = Engine::Blocks;
+        else if (name == "jit") engine = Engine::JIT;
+        else {
+            error = "--engine must be interpreter, blocks or jit";
+            return false;
+        }
+    }
+
+    if (args_parser.HasFlag("mapped_ram")) ram_backing = args_parser.HasFlag("huge_pages") ? RAMBacking::HugePages : RAMBacking::Mapped;
+
+    if (args_parser.HasValue("ram_backing")) {
+        auto name = args_parser.GetValue<std::string>("ram_backing");
+        if (name == "paged") ram_backing = RAMBacking::Paged;
+        else if (name == "mapped") ram_backing = RAMBacking::Mapped;
+        else if (name == "huge") ram_backing = RAMBacking::HugePages;
+        else {
+            error = "--ram_backing must be paged, mapped or huge";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline std::shared_ptr<MemoryRegion> CreateRAM(Address base, Address size, Word host_node = NUMA::NO_NODE) {
+    if (ram_backing == RAMBacking::Paged && host_node == NUMA::NO_NODE)
+        return MemoryRAM::Create(base, size);
+
+    return MemoryMappedRAM::Create(base, size, ram_backing == RAMBacking::HugePages, host_node);
+}
+
+inline void ApplyEngine(VirtualMachine& vm) {
+    vm.SetUseJIT(engine == Engine::JIT);
+    vm.SetUseBasicBlocks(engine != Engine::Interpreter);
+}
+
+#endif
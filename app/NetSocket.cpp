@@ -0,0 +1,133 @@
+#include "NetSocket.hpp"
+
+#include <format>
+#include <iostream>
+
+void NetSocketBackend::Attach(MemoryNetDevice& device) {
+    loop.Call([this, &device]() {
+        this->device = &device;
+        Open();
+    });
+}
+
+// Frames posted by Transmit before this still go out first, as posted
+// handlers run in order
+void NetSocketBackend::Detach() {
+    loop.Call([this]() {
+        Close();
+        device = nullptr;
+    });
+}
+
+void NetSocketBackend::Open() {
+    if (listening) {
+        server = TCPSocket::CreateServer(port);
+
+        if (!server->IsOpen()) {
+            std::cerr << std::format("Cannot open network port {}", port) << std::endl;
+            server = nullptr;
+            return;
+        }
+
+        server->SetBlocking(false);
+        loop.Watch(server, [this]() { AcceptPeer(); });
+        return;
+    }
+
+    auto socket = TCPSocket::CreateClient(address == "localhost" ? "127.0.0.1" : address, port);
+    if (!socket->IsOpen()) {
+        std::cerr << std::format("Cannot connect the network to {}:{}", address, port) << std::endl;
+        return;
+    }
+
+    Watch(std::move(socket));
+}
+
+void NetSocketBackend::Close() {
+    if (peer) loop.Unwatch(peer);
+    if (server) loop.Unwatch(server);
+
+    peer = nullptr;
+    server = nullptr;
+    pending.clear();
+}
+
+void NetSocketBackend::AcceptPeer() {
+    while (auto accepted = server->Accept()) {
+        // The newest peer takes the cable
+        if (peer) loop.Unwatch(peer);
+        Watch(std::move(accepted));
+    }
+}
+
+void NetSocketBackend::Watch(std::shared_ptr<TCPSocket> socket) {
+    socket->SetBlocking(false);
+
+    peer = std::move(socket);
+    pending.clear();
+
+    loop.Watch(peer, [this]() { ReceiveFrames(); });
+}
+
+void NetSocketBackend::ReceiveFrames() {
+    Byte buffer[0x4000];
+
+    while (peer->IsOpen()) {
+        size_t size = peer->Recv(buffer, sizeof(buffer));
+        if (size == 0) break;
+
+        pending.insert(pending.end(), buffer, buffer + size);
+    }
+
+    size_t offset = 0;
+    while (pending.size() - offset >= LENGTH_BYTES) {
+        size_t length = 0;
+        for (size_t i = 0; i < LENGTH_BYTES; i++)
+            length = length << 8 | pending[offset + i];
+
+        // Nothing that long is a frame, so the stream lost its place
+        if (length > MemoryNetDevice::MAX_FRAME) {
+            peer->Close();
+            pending.clear();
+            return;
+        }
+
+        if (pending.size() - offset - LENGTH_BYTES < length) break;
+
+        if (device) device->Receive(std::span(pending.data() + offset + LENGTH_BYTES, length));
+        offset += LENGTH_BYTES + length;
+    }
+
+    pending.erase(pending.begin(), pending.begin() + offset);
+}
+
+bool NetSocketBackend::Transmit(std::span<const std::span<const Byte>> frame) {
+    size_t size = 0;
+    for (auto piece : frame)
+        size += piece.size();
+
+    auto buffer = std::make_shared<std::vector<Byte>>();
+    buffer->reserve(LENGTH_BYTES + size);
+
+    for (size_t i = 0; i < LENGTH_BYTES; i++)
+        buffer->push_back(static_cast<Byte>(size >> ((LENGTH_BYTES - 1 - i) * 8)));
+
+    for (auto piece : frame)
+        buffer->insert(buffer->end(), piece.begin(), piece.end());
+
+    // Like a cable nobody is at the other end of, frames go nowhere while
+    // there's no peer
+    loop.Post([this, buffer = IOLoop::Buffer(std::move(buffer))]() {
+        if (peer && peer->IsOpen()) loop.Send(peer, buffer);
+    });
+
+    return true;
+}
+
+std::shared_ptr<NetSocketBackend> NetSocketBackend::Listen(IOLoop& loop, uint16_t port) {
+    return std::shared_ptr<NetSocketBackend>(new NetSocketBackend(loop, "", port, true));
+}
+
+std::shared_ptr<NetSocketBackend> NetSocketBackend::Connect(IOLoop& loop, const std::string& address, uint16_t port) {
+    return std::shared_ptr<NetSocketBackend>(new NetSocketBackend(loop, address, port, false));
+}
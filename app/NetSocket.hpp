@@ -0,0 +1,56 @@
+#ifndef APP_NET_SOCKET_HPP
+#define APP_NET_SOCKET_HPP
+
+#include "IOLoop.hpp"
+#include "Socket.hpp"
+
+#include <NetDevice.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Carries a network card's frames over TCP, each after its length as a big
+// endian word, the framing QEMU's socket netdev uses. One side listens and
+// the other connects, so two guests can share a cable or a guest can join
+// a host side switch. It runs on an IOLoop, and a frame sent is copied once
+// into the buffer queued on the socket
+class NetSocketBackend : public MemoryNetDevice::Backend {
+private:
+    static constexpr size_t LENGTH_BYTES = 4;
+
+    IOLoop& loop;
+
+    const std::string address;
+    const uint16_t port;
+    const bool listening;
+
+    std::shared_ptr<TCPSocket> server;
+    std::shared_ptr<TCPSocket> peer;
+
+    // Only touched on the loop's thread
+    MemoryNetDevice* device = nullptr;
+    std::vector<Byte> pending;
+
+    void Open();
+    void Close();
+
+    void AcceptPeer();
+    void Watch(std::shared_ptr<TCPSocket> socket);
+    void ReceiveFrames();
+
+    NetSocketBackend(IOLoop& loop, const std::string& address, uint16_t port, bool listening) : loop{loop}, address{address}, port{port}, listening{listening} {}
+
+public:
+    void Attach(MemoryNetDevice& device) override;
+    void Detach() override;
+
+    bool Transmit(std::span<const std::span<const Byte>> frame) override;
+
+    // Waits for a peer on the port, and for the next once one leaves
+    static std::shared_ptr<NetSocketBackend> Listen(IOLoop& loop, uint16_t port);
+
+    static std::shared_ptr<NetSocketBackend> Connect(IOLoop& loop, const std::string& address, uint16_t port);
+};
+
+#endif
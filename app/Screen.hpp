@@ -0,0 +1,105 @@
+#ifndef APP_SCREEN_HPP
+#define APP_SCREEN_HPP
+
+#include <Types.hpp>
+#include <DeviceTree.hpp>
+#include <FrameCapture.hpp>
+
+#include <memory>
+#include <string>
+
+#include "ArgsParser.hpp"
+
+// Pixel layouts a guest can draw in. Rows always run top to bottom with no
+// padding between them
+enum class FramebufferFormat : Word {
+    // Bytes R, G, B, A, which is what guests got before formats existed
+    RGBA8888 = 0,
+    // Words 0x00RRGGBB
+    XRGB8888 = 1,
+    // Halves RRRRRGGGGGGBBBBB
+    RGB565 = 2
+};
+
+inline Word framebuffer_width;
+inline Word framebuffer_height;
+inline Address framebuffer_address;
+inline FramebufferFormat framebuffer_format = FramebufferFormat::RGBA8888;
+
+inline Word GetPixelSize(FramebufferFormat format) {
+    return format == FramebufferFormat::RGB565 ? sizeof(Half) : sizeof(Word);
+}
+
+inline Address GetFramebufferBytes() {
+    return static_cast<Address>(framebuffer_width) * framebuffer_height * GetPixelSize(framebuffer_format);
+}
+
+// The screen as a simple-framebuffer node sees it
+inline DeviceTree::Framebuffer DescribeFramebuffer() {
+    DeviceTree::Framebuffer framebuffer;
+    framebuffer.base = framebuffer_address;
+    framebuffer.width = framebuffer_width;
+    framebuffer.height = framebuffer_height;
+    framebuffer.stride = framebuffer_width * GetPixelSize(framebuffer_format);
+
+    switch (framebuffer_format) {
+        case FramebufferFormat::RGBA8888: framebuffer.format = "a8b8g8r8"; break;
+        case FramebufferFormat::XRGB8888: framebuffer.format = "x8r8g8b8"; break;
+        case FramebufferFormat::RGB565: framebuffer.format = "r5g6b5"; break;
+    }
+
+    return framebuffer;
+}
+
+// Reads --screen_width, --screen_height, --screen_format and
+// --screen_address over the defaults already set. Returns false for a
+// format it doesn't know
+inline bool ParseScreenArgs(ArgsParser& args_parser) {
+    framebuffer_address = args_parser.GetValueOr<Address>("screen_address", framebuffer_address);
+    framebuffer_width = args_parser.GetValueOr<Word>("screen_width", framebuffer_width);
+    framebuffer_height = args_parser.GetValueOr<Word>("screen_height", framebuffer_height);
+
+    if (!args_parser.HasValue("screen_format")) return true;
+
+    auto format = args_parser.GetValue<std::string>("screen_format");
+    if (format == "rgba8888") framebuffer_format = FramebufferFormat::RGBA8888;
+    else if (format == "xrgb8888") framebuffer_format = FramebufferFormat::XRGB8888;
+    else if (format == "rgb565") framebuffer_format = FramebufferFormat::RGB565;
+    else return false;
+
+    return true;
+}
+
+// --capture=<dir> writes every frame the guest draws there as a PNG, or
+// with --capture_format=raw as the guest's own bytes. --capture_pipe=<cmd>
+// feeds them as 24 bit RGB to a command instead. --capture_fps sets how
+// often the screen is looked at, 30 by default. Null when nothing asked
+// for frames, which --capture_hashes=<file> alone also does
+inline std::unique_ptr<FrameCapture> StartCapture(ArgsParser& args_parser, Memory& memory) {
+    if (!args_parser.HasValue("capture") && !args_parser.HasValue("capture_pipe") && !args_parser.HasValue("capture_hashes"))
+        return nullptr;
+
+    FrameCapture::Options options;
+    options.address = framebuffer_address;
+    options.width = framebuffer_width;
+    options.height = framebuffer_height;
+    options.format = static_cast<FrameCapture::PixelFormat>(framebuffer_format);
+    options.fps = args_parser.GetValueOr<Long>("capture_fps", 30);
+
+    if (args_parser.HasValue("capture_pipe")) {
+        options.output = FrameCapture::Output::Pipe;
+        options.destination = args_parser.GetValue<std::string>("capture_pipe");
+    }
+
+    else if (args_parser.HasValue("capture")) {
+        options.output = args_parser.GetValueOr<std::string>("capture_format", "png") == "raw" ? FrameCapture::Output::Raw : FrameCapture::Output::PNG;
+        options.destination = args_parser.GetValue<std::string>("capture");
+    }
+
+    else
+        options.output = FrameCapture::Output::None;
+
+    return std::make_unique<FrameCapture>(memory, options);
+}
+
+#endif
@@ -1,20 +1,32 @@
-#include "socket.hpp"
+#include "Socket.hpp"
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #endif
 
+#include <algorithm>
+#include <cerrno>
 #include <iostream>
 #include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #if defined(_WIN32) || defined(_WIN64)
 uint32_t users = 0;
 std::mutex users_lock;
 
-class WindowsWSAUser {
+class WSAUser {
 public:
-    WindowsWSAUser() {
+    WSAUser() {
         users_lock.lock();
         if (users == 0) {
             WSAData wsa_data;
@@ -30,7 +42,7 @@ public:
         users_lock.unlock();
     }
 
-    virtual ~WindowsWSAUser() {
+    virtual ~WSAUser() {
         users_lock.lock();
         users--;
 
@@ -42,13 +54,54 @@ public:
     };
 };
 
-class WindowsTCPSocket : public TCPSocket, public WindowsWSAUser {
+inline bool WouldBlock() {
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+inline void SetHandleBlocking(SOCKET handle, bool blocking) {
+    u_long mode = blocking ? 0 : 1;
+    ioctlsocket(handle, FIONBIO, &mode);
+}
+#else
+// Winsock names for the BSD calls, so one implementation serves both
+using SOCKET = int;
+static constexpr SOCKET INVALID_SOCKET = -1;
+static constexpr int SOCKET_ERROR = -1;
+
+inline int closesocket(SOCKET handle) {
+    return close(handle);
+}
+
+class WSAUser {};
+
+inline bool WouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+inline void SetHandleBlocking(SOCKET handle, bool blocking) {
+    int flags = fcntl(handle, F_GETFL, 0);
+    fcntl(handle, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+}
+#endif
+
+// Most buffers a gather send hands the system at once
+static constexpr size_t MAX_GATHER = 16;
+
+// A peer that hung up fails the send instead of raising SIGPIPE
+#ifdef MSG_NOSIGNAL
+static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static constexpr int SEND_FLAGS = 0;
+#endif
+
+class SystemTCPSocket : public TCPSocket, public WSAUser {
 protected:
     mutable SOCKET handle = INVALID_SOCKET;
 
     virtual int Bind(const std::string& address, uint16_t port, uint16_t family) const = 0;
 
-    void Close() const {
+public:
+    void Close() const override {
         lock.lock();
         if (handle != INVALID_SOCKET) {
             closesocket(handle);
@@ -57,10 +110,9 @@ protected:
         lock.unlock();
     }
 
-public:
-    WindowsTCPSocket() : WindowsWSAUser() {};
+    SystemTCPSocket() : WSAUser() {};
 
-    ~WindowsTCPSocket() {
+    ~SystemTCPSocket() {
         Close();
     }
 
@@ -117,9 +169,15 @@ public:
 
         while (sent != size) {
             lock.lock();
-            err = send(handle, &buffer[sent], size - sent, 0);
+            err = send(handle, &buffer[sent], size - sent, SEND_FLAGS);
             lock.unlock();
 
+            // A non-blocking socket with a full send buffer waits for room
+            if (err == SOCKET_ERROR && WouldBlock()) {
+                WaitWritable();
+                continue;
+            }
+
             if (err == SOCKET_ERROR) break;
 
             sent += err;
@@ -130,6 +188,59 @@ public:
         }
     }
 
+    size_t SendSome(std::span<const std::span<const uint8_t>> buffers) const override {
+        buffers = buffers.first(std::min(buffers.size(), MAX_GATHER));
+
+        lock.lock();
+        if (handle == INVALID_SOCKET) {
+            lock.unlock();
+            return 0;
+        }
+
+#if defined(_WIN32) || defined(_WIN64)
+        WSABUF gather[MAX_GATHER];
+        for (size_t i = 0; i < buffers.size(); i++) {
+            gather[i].buf = reinterpret_cast<char*>(const_cast<uint8_t*>(buffers[i].data()));
+            gather[i].len = static_cast<ULONG>(buffers[i].size());
+        }
+
+        DWORD sent = 0;
+        int err = WSASend(handle, gather, static_cast<DWORD>(buffers.size()), &sent, 0, nullptr, nullptr);
+        if (err == 0) err = static_cast<int>(sent);
+#else
+        iovec gather[MAX_GATHER];
+        for (size_t i = 0; i < buffers.size(); i++) {
+            gather[i].iov_base = const_cast<uint8_t*>(buffers[i].data());
+            gather[i].iov_len = buffers[i].size();
+        }
+
+        msghdr message{};
+        message.msg_iov = gather;
+        message.msg_iovlen = buffers.size();
+
+        int err = static_cast<int>(sendmsg(handle, &message, SEND_FLAGS));
+#endif
+        lock.unlock();
+
+        if (err == SOCKET_ERROR && WouldBlock())
+            return 0;
+
+        if (err == SOCKET_ERROR) {
+            Close();
+            return 0;
+        }
+
+        return err;
+    }
+
+    intptr_t GetHandle() const override {
+        lock.lock();
+        auto waited = handle;
+        lock.unlock();
+
+        return waited == INVALID_SOCKET ? -1 : static_cast<intptr_t>(waited);
+    }
+
     size_t Recv(void* buffer, size_t size) const override {
         if (!IsOpen()) {
             std::cerr << "Cannot recv data with a closed socket" << std::endl;
@@ -140,7 +251,10 @@ public:
         int err = recv(handle, reinterpret_cast<char*>(buffer), size, 0);
         lock.unlock();
 
-        if (err == SOCKET_ERROR) {
+        if (err == SOCKET_ERROR && WouldBlock())
+            return 0;
+
+        if (err == SOCKET_ERROR || err == 0) {
             Close();
             return 0;
         }
@@ -148,27 +262,65 @@ public:
         return err;
     }
 
+    void SetBlocking(bool blocking) const override {
+        lock.lock();
+        if (handle != INVALID_SOCKET) SetHandleBlocking(handle, blocking);
+        lock.unlock();
+    }
+
+    bool WaitReadable(std::chrono::milliseconds timeout) const override {
+        return Wait(timeout, false);
+    }
+
+    void WaitWritable() const {
+        Wait(std::chrono::milliseconds(100), true);
+    }
+
+    bool Wait(std::chrono::milliseconds timeout, bool for_write) const {
+        lock.lock();
+        auto waited = handle;
+        lock.unlock();
+
+        if (waited == INVALID_SOCKET) return false;
+
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(waited, &set);
+
+        timeval time;
+        time.tv_sec = static_cast<long>(timeout.count() / 1000);
+        time.tv_usec = static_cast<long>(timeout.count() % 1000 * 1000);
+
+        int ready = select(static_cast<int>(waited) + 1, for_write ? nullptr : &set, for_write ? &set : nullptr, nullptr, &time);
+        return ready > 0;
+    }
+
     virtual std::shared_ptr<TCPSocket> Accept() const override = 0;
 };
 
-class WindowsClientTCPSocket : public WindowsTCPSocket {
+class SystemClientTCPSocket : public SystemTCPSocket {
 protected:
     int Bind(const std::string& address, uint16_t port, uint16_t family) const override {
-        sockaddr_in addr;
+        sockaddr_in addr{};
         addr.sin_family = family;
         addr.sin_addr.s_addr = inet_addr(address.c_str());
-        addr.sin_port = port;
+        addr.sin_port = htons(port);
 
         return connect(handle, reinterpret_cast<sockaddr*>(&addr), sizeof(sockaddr));
     }
 
 public:
-    WindowsClientTCPSocket(const std::string& address, uint16_t port) {
+    SystemClientTCPSocket(const std::string& address, uint16_t port) {
         Setup(address, port);
     }
 
-    WindowsClientTCPSocket(SOCKET handle) {
+    SystemClientTCPSocket(SOCKET handle) {
         this->handle = handle;
+
+        // Packets are small and answered one at a time, so don't hold them
+        // back waiting for more
+        int no_delay = 1;
+        setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&no_delay), sizeof(no_delay));
     }
 
     bool IsServer() const override {
@@ -185,19 +337,22 @@ public:
     }
 };
 
-class WindowsServerTCPSocket : public WindowsTCPSocket {
+class SystemServerTCPSocket : public SystemTCPSocket {
 protected:
     int Bind(const std::string&, uint16_t port, uint16_t family) const override {
-        sockaddr_in addr;
+        int reuse = 1;
+        setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+        sockaddr_in addr{};
         addr.sin_family = family;
         addr.sin_addr.s_addr = INADDR_ANY;
-        addr.sin_port = port;
+        addr.sin_port = htons(port);
 
         return bind(handle, reinterpret_cast<sockaddr*>(&addr), sizeof(sockaddr));
     }
 
 public:
-    WindowsServerTCPSocket(uint16_t port) {
+    SystemServerTCPSocket(uint16_t port) {
         Setup("", port);
     }
 
@@ -212,25 +367,25 @@ public:
         }
 
         SOCKET client = accept(handle, nullptr, nullptr);
+        if (client == INVALID_SOCKET && WouldBlock())
+            return nullptr;
+
         if (client == INVALID_SOCKET) {
             Close();
             return nullptr;
         }
 
-        return std::shared_ptr<TCPSocket>(new WindowsClientTCPSocket(client));
+        // Clients start blocking whatever the server was set to
+        SetHandleBlocking(client, true);
+
+        return std::shared_ptr<TCPSocket>(new SystemClientTCPSocket(client));
     }
 };
 
-#endif
-
 std::shared_ptr<TCPSocket> TCPSocket::CreateServer(uint16_t port) {
-#if defined(_WIN32) || defined(_WIN64)
-    return std::shared_ptr<TCPSocket>(new WindowsServerTCPSocket(port));
-#endif
+    return std::shared_ptr<TCPSocket>(new SystemServerTCPSocket(port));
 }
 
 std::shared_ptr<TCPSocket> TCPSocket::CreateClient(const std::string& address, uint16_t port) {
-#if defined(_WIN32) || defined(_WIN64)
-    return std::shared_ptr<TCPSocket>(new WindowsClientTCPSocket(address == "localhost" ? "127.0.0.1" : address, port));
-#endif
-}
\ No newline at end of file
+    return std::shared_ptr<TCPSocket>(new SystemClientTCPSocket(address == "localhost" ? "127.0.0.1" : address, port));
+}
@@ -1,11 +1,13 @@
 #ifndef APP_SOCKET_HPP
 #define APP_SOCKET_HPP
 
+#include <chrono>
 #include <cstdint>
 #include <vector>
 #include <memory>
 #include <string>
 #include <mutex>
+#include <span>
 
 class TCPSocket {
 protected:
@@ -17,13 +19,34 @@ public:
     virtual bool IsOpen() const = 0;
     virtual bool IsServer() const = 0;
 
+    virtual void Close() const = 0;
+
     virtual void Send(const void* data, size_t size) const = 0;
+
+    // Sends what fits without waiting from the buffers in order, in one
+    // call. Returns how many bytes went, 0 when the send buffer is full or
+    // the socket closed on an error
+    virtual size_t SendSome(std::span<const std::span<const uint8_t>> buffers) const = 0;
+
+    // Returns 0 when a non-blocking socket has nothing to read yet. A peer
+    // that hung up closes the socket, which IsOpen then reports
     virtual size_t Recv(void* buffer, size_t max_size) const = 0;
 
+    // A non-blocking server returns nullptr from Accept while no client
+    // is waiting
+    virtual void SetBlocking(bool blocking) const = 0;
+
+    // Whether Recv or Accept has something before the timeout runs out
+    virtual bool WaitReadable(std::chrono::milliseconds timeout) const = 0;
+
     virtual std::shared_ptr<TCPSocket> Accept() const = 0;
 
+    // The system's handle, for waiting on many sockets at once. -1 once
+    // closed
+    virtual intptr_t GetHandle() const = 0;
+
     static std::shared_ptr<TCPSocket> CreateServer(uint16_t port);
     static std::shared_ptr<TCPSocket> CreateClient(const std::string& address, uint16_t port);
 };
 
-#endif
\ No newline at end of file
+#endif
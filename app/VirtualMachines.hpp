@@ -5,7 +5,34 @@
 
 #include <vector>
 #include <memory>
+#include <chrono>
+#include <thread>
+#include <algorithm>
 
 inline std::vector<std::shared_ptr<VirtualMachine>> vms;
 
+// Runs work with every hart held off the host CPU, for passes over guest
+// memory. If a hart doesn't park in time the work is skipped and false
+// comes back
+template <typename Work>
+inline bool WithHartsHeld(std::chrono::milliseconds timeout, Work work) {
+    for (auto& vm : vms)
+        vm->Hold();
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    bool quiet = false;
+
+    while (!quiet && std::chrono::steady_clock::now() < deadline) {
+        quiet = std::all_of(vms.begin(), vms.end(), [](auto& vm) { return vm->IsParked() || !vm->IsRunning(); });
+        if (!quiet) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    if (quiet) work();
+
+    for (auto& vm : vms)
+        vm->Release();
+
+    return quiet;
+}
+
 #endif
\ No newline at end of file
@@ -3,13 +3,22 @@
 #include "DeltaTime.hpp"
 
 #include <Memory.hpp>
+#include <DMA.hpp>
+#include <PLIC.hpp>
+#include <BlockDevice.hpp>
+#include <ConsoleDevice.hpp>
+#include <DeviceTree.hpp>
+#include <InputDevice.hpp>
+#include <ELF.hpp>
 #include <RV64.hpp>
 
 #include "GUIMemoryViewer.hpp"
+#include "GUIMemoryHeatmap.hpp"
 #include "GUIAssembly.hpp"
 #include "GUIInfo.hpp"
 #include "GUIRegs.hpp"
 #include "GUIHart.hpp"
+#include "GUIProfiler.hpp"
 #include "GUIStack.hpp"
 #include "GUICSR.hpp"
 
@@ -17,14 +26,17 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <thread>
 
 #include "GDB.hpp"
+#include "Console.hpp"
 #include "ECalls.hpp"
 #include "ArgsParser.hpp"
+#include "MachineArgs.hpp"
 #include "Framebuffer.hpp"
 #include "VirtualMachines.hpp"
 
@@ -48,6 +60,17 @@ int main(int argc, const char** argv) {
     ArgsParser args_parser(args);
 
     cores = args_parser.GetValueOr<Hart>("cores", 1);
+
+    if (!ParseScreenArgs(args_parser)) {
+        std::cerr << "--screen_format must be rgba8888, xrgb8888 or rgb565" << std::endl;
+        return -1;
+    }
+
+    std::string machine_error;
+    if (!ParseMachineArgs(args_parser, machine_error)) {
+        std::cerr << machine_error << std::endl;
+        return -1;
+    }
     
     if (!args_parser.HasValue("bios_file")) {
         std::cerr << "--bios_file is required" << std::endl;
@@ -58,33 +81,101 @@ int main(int argc, const char** argv) {
 
     if (cores == 0) cores = 1;
 
-    RVInstruction::SetupCSRNames();
-    
     RegisterECalls();
 
     Window window("RV32IMF", window_width, window_height);
     {
         constexpr Address BIOS_RAM_ADDRESS = 0x1000;
+        Address ram_size = args_parser.GetValueOr<Address>("ram_size", 16) * 1024 * 1024;
+
+        // ELF images have their read only segments mapped ahead of the RAM,
+        // so those pages are served from the file instead of copied
+        std::unique_ptr<ELFImage> elf;
+        if (ELFImage::IsELF(bios_path)) {
+            try {
+                elf = ELFImage::Open(bios_path);
+            }
+            catch (const std::runtime_error& error) {
+                std::cerr << error.what() << std::endl;
+                return -1;
+            }
+        }
 
         Memory memory;
-        {
-            auto ram = MemoryRAM::Create(BIOS_RAM_ADDRESS, 16 * 1024 * 1024);
-            memory.AddMemoryRegion(std::move(ram));
-        }
-        memory.ReadFileInto(bios_path, BIOS_RAM_ADDRESS);
+        if (elf)
+            elf->MapReadOnlySegments(memory);
+
+        memory.AddMemoryRegion(CreateRAM(BIOS_RAM_ADDRESS, ram_size));
+
+        if (args_parser.HasFlag("prefault"))
+            memory.Prefault(BIOS_RAM_ADDRESS, ram_size);
 
-        auto framebuffer = MemoryFramebuffer::Create(framebuffer_address, framebuffer_width, framebuffer_height);
+        if (elf)
+            elf->LoadSegments(memory);
+        else
+            memory.ReadFileInto(bios_path, BIOS_RAM_ADDRESS);
+
+        Address entry = elf ? elf->GetEntry() : BIOS_RAM_ADDRESS;
+
+        auto framebuffer = MemoryFramebuffer::Create(framebuffer_address, framebuffer_width, framebuffer_height, framebuffer_format);
         memory.AddMemoryRegion(framebuffer);
 
+        auto clint = MemoryCLINT::Create();
+        if (args_parser.HasFlag("instruction_time"))
+            clint->SetClockSource(MemoryCLINT::ClockSource::Instructions);
+        
+        memory.AddMemoryRegion(clint);
+
+        memory.AddMemoryRegion(MemoryPLIC::Create());
+        memory.AddMemoryRegion(MemoryDMA::Create());
+
+        auto console = MemoryConsole::Create([](std::string_view text) { GetConsole().Write(text); });
+        console->SetInputSource([](std::string& line) { return static_cast<bool>(std::getline(std::cin, line)); });
+        memory.AddMemoryRegion(console);
+
+        // Window callbacks run on this thread, the queue's only producer
+        auto input = MemoryInputDevice::Create();
+        memory.AddMemoryRegion(input);
+
+        window.SetKeyboardInputCallback([input](Key key, bool is_pressed) { input->PushKey(key, is_pressed); });
+        window.SetMouseButtonInputCallback([input](uint32_t button, bool is_pressed) { input->PushButton(button, is_pressed); });
+        window.SetMouseMovementInputCallback([input](double x, double y) {
+            input->PushMotion(static_cast<Word>(std::max(x, 0.0)), static_cast<Word>(std::max(y, 0.0)));
+        });
+
+        // The disk's I/O threads and the GDB server read and write guest RAM
+        // while harts are held
+        if (args_parser.HasValue("compress_high") && (args_parser.HasValue("disk") || args_parser.HasValue("gdb"))) {
+            std::cerr << "--compress_high doesn't work with --disk or --gdb" << std::endl;
+            return -1;
+        }
+
+        if (args_parser.HasValue("disk")) {
+            try {
+                memory.AddMemoryRegion(MemoryBlockDevice::Create(args_parser.GetValue<std::string>("disk"), args_parser.HasFlag("disk_read_only")));
+            }
+            catch (const std::runtime_error& error) {
+                std::cerr << error.what() << std::endl;
+                return -1;
+            }
+        }
+
+        // Describes everything mapped above, so it goes in last. Harts boot
+        // with it in a1
+        DeviceTree::Options device_tree;
+        device_tree.harts = cores;
+        device_tree.bootargs = args_parser.GetValueOr<std::string>("bootargs", "");
+        device_tree.framebuffer = DescribeFramebuffer();
+
+        memory.AddMemoryRegion(DeviceTree::CreateROM(memory, device_tree));
+
         std::vector<Hart> harts;
         for (Hart i = 0; i < cores; i++) {
-            vms.push_back(std::make_shared<VirtualMachine>(memory, BIOS_RAM_ADDRESS, i));
+            vms.push_back(std::make_shared<VirtualMachine>(memory, entry, i));
+            vms.back()->SetDeviceTree(DeviceTree::DEFAULT_BASE);
             harts.push_back(i);
         }
 
-        //GDBServer gdb_server(memory);
-        //gdb_server.Run(8000);
-
         IMGUI_CHECKVERSION();
         ImGui::CreateContext();
         ImGuiIO& io = ImGui::GetIO();
@@ -97,13 +188,18 @@ int main(int argc, const char** argv) {
         window.SetupImGui();
         ImGui_ImplOpenGL3_Init();
 
+        if (args_parser.HasValue("gui_refresh_ms"))
+            gui_refresh_interval = std::chrono::milliseconds(args_parser.GetValue<Long>("gui_refresh_ms"));
+
         GUIMemoryViewer mem_viewer(memory, vms[0], 0x0);
+        GUIMemoryHeatmap heatmap(memory);
         GUIAssembly assembly(vms[0], memory);
         GUIInfo info(memory, vms[0]);
         GUIHart gui_harts(vms, harts);
         GUIRegs state(vms[0]);
         GUIStack stack(vms[0], memory);
         GUICSR csr(vms[0]);
+        GUIProfiler profiler(vms[0], elf ? elf->GetSymbols() : nullptr);
 
         for (auto vm : vms) {
             vm->Pause();
@@ -114,6 +210,20 @@ int main(int argc, const char** argv) {
             if (args_parser.HasFlag("pause_on_restart"))
                 vm->SetPauseOnRestart(true);
 
+            ApplyEngine(*vm);
+
+            if (args_parser.HasFlag("precise_fp"))
+                vm->SetPreciseFloatFlags(true);
+
+            if (args_parser.HasFlag("trap_misaligned"))
+                vm->SetTrapMisaligned(true);
+
+            if (args_parser.HasFlag("profile"))
+                vm->SetProfiling(true);
+
+            if (args_parser.HasValue("trace"))
+                vm->SetTracing(true);
+
             vm->Start();
         }
 
@@ -129,16 +239,39 @@ int main(int argc, const char** argv) {
             }, i));
         }
 
+        // Network servers share the loop's thread, started by the first
+        // of them
+        IOLoop io_loop;
+
+        // GDB halts every hart when it attaches and resumes them on detach
+        GDBServer gdb_server(io_loop, memory);
+        if (args_parser.HasValue("gdb"))
+            gdb_server.Start(args_parser.GetValue<Word>("gdb"));
+
+        // --compress_high=<MiB> packs pages the guest hasn't touched for a
+        // second once it uses more than that, down to --compress_low=<MiB>
+        auto compress_high = args_parser.GetValueOr<Long>("compress_high", 0) * 1024 * 1024;
+        memory.SetCompressionThresholds(compress_high, args_parser.GetValueOr<Long>("compress_low", compress_high / 2 / 1024 / 1024) * 1024 * 1024);
+
+        auto last_compress = std::chrono::steady_clock::now();
+
+        auto capture = StartCapture(args_parser, memory);
+
         while (!window.ShouldClose()) {
             window.Update();
             delta_time.Update();
 
+            if (compress_high != 0 && std::chrono::steady_clock::now() - last_compress >= std::chrono::seconds(1)) {
+                WithHartsHeld(std::chrono::milliseconds(100), [&]() { memory.CompressColdPages(); });
+                last_compress = std::chrono::steady_clock::now();
+            }
+
             ImGui_ImplOpenGL3_NewFrame();
             ImGui_ImplGlfw_NewFrame();
             ImGui::NewFrame();
 
             for (auto& vm : vms)
-                vm->UpdateTime(delta_time());
+                vm->UpdateHistory(delta_time());
 
             auto vm = vms[gui_harts.GetSelectedHart()];
             mem_viewer.vm = vm;
@@ -147,6 +280,7 @@ int main(int argc, const char** argv) {
             state.vm = vm;
             stack.vm = vm;
             csr.vm = vm;
+            profiler.vm = vm;
 
             if (ImGui::IsKeyPressed(ImGuiKey_Space, true) && vm->IsPaused())
                 vm->Step(1);
@@ -162,14 +296,14 @@ int main(int argc, const char** argv) {
             // Do rendering
 
             mem_viewer.Draw();
+            heatmap.Draw();
             assembly.Draw();
             info.Draw();
             gui_harts.Draw();
             state.Draw();
             stack.Draw();
             csr.Draw();
-            
-            assembly.Draw();
+            profiler.Draw();
             
             framebuffer->DrawBuffer();
 
@@ -184,7 +318,28 @@ int main(int argc, const char** argv) {
             }
         }
 
+        gdb_server.Stop();
+
         for (auto& vm : vms)
             vm->Stop();
+
+        workers.clear();
+
+        if (capture) {
+            capture->Stop();
+
+            if (args_parser.HasValue("capture_hashes"))
+                capture->WriteHashes(args_parser.GetValue<std::string>("capture_hashes"));
+        }
+
+        if (args_parser.HasValue("trace")) {
+            std::vector<const Tracer*> tracers;
+            for (auto& vm : vms)
+                tracers.push_back(&vm->GetTracer());
+
+            tracers.push_back(&gdb_server.GetTracer());
+
+            Tracer::WriteChromeTrace(args_parser.GetValue<std::string>("trace"), tracers);
+        }
     }
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "Allocations.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// The other forms of new and delete fall back on these ones
+namespace {
+    std::atomic<Long> allocations = 0;
+
+    void* Allocate(std::size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        if (size == 0) size = 1;
+
+        if (auto pointer = std::malloc(size)) return pointer;
+        throw std::bad_alloc();
+    }
+
+    void* AllocateAligned(std::size_t size, std::align_val_t alignment) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+
+        auto align = static_cast<std::size_t>(alignment);
+        size = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+
+#if defined(_WIN32) || defined(_WIN64)
+        if (auto pointer = _aligned_malloc(size, align)) return pointer;
+#else
+        if (auto pointer = std::aligned_alloc(align, size)) return pointer;
+#endif
+        throw std::bad_alloc();
+    }
+}
+
+Long GetAllocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) {
+    return Allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+#if defined(_WIN32) || defined(_WIN64)
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete(pointer, alignment);
+}
@@ -0,0 +1,10 @@
+#ifndef BENCH_ALLOCATIONS_HPP
+#define BENCH_ALLOCATIONS_HPP
+
+#include <RV64.hpp>
+
+// Heap allocations made through operator new on any thread so far, counted
+// by the replacements in Allocations.cpp
+Long GetAllocationCount();
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef BENCH_ASSEMBLER_HPP
+#define BENCH_ASSEMBLER_HPP
+
+#include <RV64.hpp>
+#include <Memory.hpp>
+
+#include <vector>
+
+// Just enough of an assembler to write the guest workloads without a cross
+// compiler. Branch and jump targets are absolute addresses, so loops branch
+// back to a saved Here()
+class Assembler {
+private:
+    using RV = RVInstruction;
+
+    const Address base;
+    std::vector<Word> words;
+
+    inline void R(Word opcode, Word rd, Word funct3, Word rs1, Word rs2, Word funct7) {
+        RVInstructionWord iw;
+        iw.R = {opcode, rd, funct3, rs1, rs2, funct7};
+        words.push_back(iw.raw);
+    }
+
+    inline void R4(Word opcode, Word rd, Word funct3, Word rs1, Word rs2, Word funct2, Word rs3) {
+        RVInstructionWord iw;
+        iw.R4 = {opcode, rd, funct3, rs1, rs2, funct2, rs3};
+        words.push_back(iw.raw);
+    }
+
+    inline void I(Word opcode, Word rd, Word funct3, Word rs1, Word imm) {
+        RVInstructionWord iw;
+        iw.I = {opcode, rd, funct3, rs1, imm};
+        words.push_back(iw.raw);
+    }
+
+    inline void S(Word opcode, Word funct3, Word rs1, Word rs2, Word imm) {
+        RVInstructionWord iw;
+        iw.S = {opcode, imm, funct3, rs1, rs2, imm >> 5};
+        words.push_back(iw.raw);
+    }
+
+    inline void B(Word funct3, Word rs1, Word rs2, Address target) {
+        Word imm = static_cast<Word>(target - Here());
+
+        RVInstructionWord iw;
+        iw.B = {RV::OP_BRANCH, imm >> 11, imm >> 1, funct3, rs1, rs2, imm >> 5, imm >> 12};
+        words.push_back(iw.raw);
+    }
+
+public:
+    static constexpr Word ZERO = 0, RA = 1, SP = 2, T0 = 5, T1 = 6, T2 = 7;
+    static constexpr Word A0 = 10, A1 = 11, A2 = 12, A3 = 13, A4 = 14, A5 = 15;
+    static constexpr Word S0 = 8, S1 = 9, S2 = 18, S3 = 19;
+
+    Assembler(Address base) : base{base} {}
+
+    inline Address Here() const { return base + words.size() * sizeof(Word); }
+    inline Address GetBase() const { return base; }
+    inline const std::vector<Word>& GetWords() const { return words; }
+
+    inline void WriteTo(Memory& memory) const { memory.WriteWords(base, words); }
+
+    inline void ADDI(Word rd, Word rs1, SWord imm) { I(RV::OP_MATH_IMMEDIATE, rd, RV::FUNCT3_ADDI, rs1, imm); }
+    inline void XORI(Word rd, Word rs1, SWord imm) { I(RV::OP_MATH_IMMEDIATE, rd, RV::FUNCT3_XORI, rs1, imm); }
+    inline void ANDI(Word rd, Word rs1, SWord imm) { I(RV::OP_MATH_IMMEDIATE, rd, RV::FUNCT3_ANDI, rs1, imm); }
+    inline void SLLI(Word rd, Word rs1, Word shamt) { I(RV::OP_MATH_IMMEDIATE, rd, RV::FUNCT3_SLLI, rs1, shamt); }
+    inline void SRLI(Word rd, Word rs1, Word shamt) { I(RV::OP_MATH_IMMEDIATE, rd, RV::FUNCT3_SHIFT_RIGHT_IMMEDIATE, rs1, shamt); }
+
+    inline void ADD(Word rd, Word rs1, Word rs2) { R(RV::OP_MATH, rd, RV::FUNCT3_ADD_SUB_MUL, rs1, rs2, RV::FUNCT7_ADD); }
+    inline void SUB(Word rd, Word rs1, Word rs2) { R(RV::OP_MATH, rd, RV::FUNCT3_ADD_SUB_MUL, rs1, rs2, RV::FUNCT7_SUB); }
+    inline void XOR(Word rd, Word rs1, Word rs2) { R(RV::OP_MATH, rd, RV::FUNCT3_XOR_DIV, rs1, rs2, RV::FUNCT7_XOR); }
+    inline void OR(Word rd, Word rs1, Word rs2) { R(RV::OP_MATH, rd, RV::FUNCT3_OR_REM, rs1, rs2, RV::FUNCT7_OR); }
+    inline void MUL(Word rd, Word rs1, Word rs2) { R(RV::OP_MATH, rd, RV::FUNCT3_ADD_SUB_MUL, rs1, rs2, RV::FUNCT7_MUL); }
+    inline void DIVU(Word rd, Word rs1, Word rs2) { R(RV::OP_MATH, rd, RV::FUNCT3_SHIFT_RIGHT_DIVU, rs1, rs2, RV::FUNCT7_DIVU); }
+    inline void REMU(Word rd, Word rs1, Word rs2) { R(RV::OP_MATH, rd, RV::FUNCT3_AND_REMU, rs1, rs2, RV::FUNCT7_REMU); }
+
+    inline void LUI(Word rd, Word imm) {
+        RVInstructionWord iw;
+        iw.U = {RV::OP_LUI, rd, imm};
+        words.push_back(iw.raw);
+    }
+
+    // Loads any constant, splitting it 12 bits at a time past 32 bits
+    inline void LI(Word rd, SLong value) {
+        if (value >= -2048 && value < 2048) {
+            ADDI(rd, ZERO, value);
+            return;
+        }
+
+        if (value >= -0x80000000LL && value < 0x7ffff800LL) {
+            SLong low = (value << 52) >> 52;
+            LUI(rd, static_cast<Word>((value - low) >> 12) & 0xfffff);
+            if (low) ADDI(rd, rd, low);
+            return;
+        }
+
+        SLong low = (value << 52) >> 52;
+        LI(rd, (value - low) >> 12);
+        SLLI(rd, rd, 12);
+        if (low) ADDI(rd, rd, low);
+    }
+
+    inline void LD(Word rd, Word rs1, SWord imm) { I(RV::OP_LOAD, rd, RV::FUNCT3_LD, rs1, imm); }
+    inline void LW(Word rd, Word rs1, SWord imm) { I(RV::OP_LOAD, rd, RV::FUNCT3_LW, rs1, imm); }
+    inline void SD(Word rs2, Word rs1, SWord imm) { S(RV::OP_STORE, RV::FUNCT3_SD, rs1, rs2, imm); }
+    inline void SW(Word rs2, Word rs1, SWord imm) { S(RV::OP_STORE, RV::FUNCT3_SW, rs1, rs2, imm); }
+
+    inline void BEQ(Word rs1, Word rs2, Address target) { B(RV::FUNCT3_BEQ, rs1, rs2, target); }
+    inline void BNE(Word rs1, Word rs2, Address target) { B(RV::FUNCT3_BNE, rs1, rs2, target); }
+    inline void BLTU(Word rs1, Word rs2, Address target) { B(RV::FUNCT3_BLTU, rs1, rs2, target); }
+
+    inline void JAL(Word rd, Address target) {
+        Word imm = static_cast<Word>(target - Here());
+
+        RVInstructionWord iw;
+        iw.J = {RV::OP_JAL, rd, imm >> 12, imm >> 11, imm >> 1, imm >> 20};
+        words.push_back(iw.raw);
+    }
+
+    inline void JALR(Word rd, Word rs1, SWord imm) { I(RV::OP_JALR, rd, RV::FUNCT3_JALR, rs1, imm); }
+    inline void RET() { JALR(ZERO, RA, 0); }
+
+    inline void AMOADD_W(Word rd, Word rs1, Word rs2) { R(RV::OP_ATOMIC, rd, RV::FUNCT3_ATOMIC, rs1, rs2, RV::FUNCT7_AMOADD_W); }
+
+    inline void FENCE_I() { I(RV::OP_FENCE, 0, RV::FUNCT3_FENCE_I, 0, 0); }
+
+    inline void FLD(Word rd, Word rs1, SWord imm) { I(RV::OP_FL, rd, RV::FUNCT3_FLD, rs1, imm); }
+    inline void FSD(Word rs2, Word rs1, SWord imm) { S(RV::OP_FS, RV::FUNCT3_FSD, rs1, rs2, imm); }
+
+    inline void FMADD_D(Word rd, Word rs1, Word rs2, Word rs3) { R4(RV::OP_FMADD, rd, RV::RM_DYNAMIC, rs1, rs2, RV::FUNCT2_D, rs3); }
+    inline void FADD_D(Word rd, Word rs1, Word rs2) { R(RV::OP_FLOAT, rd, RV::RM_DYNAMIC, rs1, rs2, (RV::FUNCT5_FADD << 2) | RV::FUNCT2_D); }
+    inline void FDIV_D(Word rd, Word rs1, Word rs2) { R(RV::OP_FLOAT, rd, RV::RM_DYNAMIC, rs1, rs2, (RV::FUNCT5_FDIV << 2) | RV::FUNCT2_D); }
+
+    inline void CSRRW(Word rd, Half csr, Word rs1) { I(RV::OP_CSR, rd, RV::FUNCT3_CSRRW, rs1, csr); }
+    inline void CSRRS(Word rd, Half csr, Word rs1) { I(RV::OP_CSR, rd, RV::FUNCT3_CSRRS, rs1, csr); }
+
+    inline void ECALL() { I(RV::OP_SYSTEM, 0, RV::FUNCT3_SYSTEM, 0, RV::IMM_ECALL); }
+    inline void MRET() { I(RV::OP_SYSTEM, 0, RV::FUNCT3_SYSTEM, 0, RV::IMM_MRET); }
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "History.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+    // The text after "key": up to the next comma or brace, quotes removed.
+    // Enough for the flat objects ToJSON writes, whose strings hold neither
+    std::optional<std::string> Field(const std::string& line, const std::string& key) {
+        auto start = line.find(std::format("\"{}\":", key));
+        if (start == std::string::npos) return std::nullopt;
+
+        start += key.size() + 3;
+        auto end = line.find_first_of(",}", start);
+        if (end == std::string::npos) return std::nullopt;
+
+        auto value = line.substr(start, end - start);
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+            value = value.substr(1, value.size() - 2);
+
+        return value;
+    }
+
+    bool ValidName(const std::string& name) {
+        return name.find_first_of("\",}\\") == std::string::npos;
+    }
+}
+
+std::string BenchResult::ToJSON() const {
+    if (!ValidName(label))
+        throw std::runtime_error(std::format("Benchmark labels can't hold quotes, commas, braces or backslashes: {}", label));
+
+    return std::format(
+        "{{\"workload\":\"{}\",\"subsystem\":\"{}\",\"engine\":\"{}\",\"harts\":{},\"jit\":{},\"instructions\":{},\"repeats\":{},"
+        "\"seconds\":{:.6f},\"mips\":{:.2f},\"ns_per_instruction\":{:.3f},\"noise\":{:.4f},\"memory_used\":{},\"peak_rss\":{},"
+        "\"valid\":{},\"label\":\"{}\",\"time\":{}}}",
+        workload, subsystem, engine, harts, engine == "jit" ? "true" : "false", instructions, repeats,
+        seconds, GetMIPS(), ns_per_instruction, noise, memory_used, peak_rss,
+        valid ? "true" : "false", label, time);
+}
+
+std::optional<BenchResult> BenchResult::FromJSON(const std::string& line) {
+    BenchResult result;
+
+    auto workload = Field(line, "workload");
+    auto engine = Field(line, "engine");
+    auto ns = Field(line, "ns_per_instruction");
+    if (!workload || !engine || !ns) return std::nullopt;
+
+    try {
+        result.workload = *workload;
+        result.engine = *engine;
+        result.ns_per_instruction = std::stod(*ns);
+
+        if (auto value = Field(line, "subsystem")) result.subsystem = *value;
+        if (auto value = Field(line, "harts")) result.harts = std::stoul(*value);
+        if (auto value = Field(line, "instructions")) result.instructions = std::stoull(*value);
+        if (auto value = Field(line, "repeats")) result.repeats = std::stoull(*value);
+        if (auto value = Field(line, "seconds")) result.seconds = std::stod(*value);
+        if (auto value = Field(line, "noise")) result.noise = std::stod(*value);
+        if (auto value = Field(line, "memory_used")) result.memory_used = std::stoull(*value);
+        if (auto value = Field(line, "peak_rss")) result.peak_rss = std::stoull(*value);
+        if (auto value = Field(line, "valid")) result.valid = *value == "true";
+        if (auto value = Field(line, "label")) result.label = *value;
+        if (auto value = Field(line, "time")) result.time = std::stoull(*value);
+    }
+    catch (const std::exception&) {
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+std::vector<BenchResult> ReadHistory(const std::string& path) {
+    std::vector<BenchResult> results;
+    std::ifstream file(path);
+
+    for (std::string line; std::getline(file, line);) {
+        if (auto result = BenchResult::FromJSON(line))
+            results.push_back(std::move(*result));
+    }
+
+    return results;
+}
+
+void AppendHistory(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ofstream file(path, std::ios::app);
+
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+    }
+
+    for (const auto& result : results)
+        file << result.ToJSON() << '\n';
+}
+
+double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+
+    auto middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+double RelativeDeviation(const std::vector<double>& values) {
+    auto median = Median(values);
+    if (values.size() < 2 || median == 0) return 0;
+
+    std::vector<double> deviations;
+    for (auto value : values)
+        deviations.push_back(std::abs(value - median));
+
+    return Median(deviations) / median;
+}
+
+std::optional<BenchComparison> CompareToBaseline(const BenchResult& result, const std::vector<BenchResult>& baseline, double min_threshold) {
+    std::vector<double> times, noises;
+
+    // Newest last, as runs are appended
+    for (auto run = baseline.rbegin(); run != baseline.rend() && times.size() < BASELINE_RUNS; run++) {
+        if (!run->Matches(result) || !run->valid) continue;
+
+        times.push_back(run->ns_per_instruction);
+        noises.push_back(run->noise);
+    }
+
+    if (times.empty()) return std::nullopt;
+
+    BenchComparison comparison;
+    comparison.baseline_ns_per_instruction = Median(times);
+    comparison.baseline_runs = times.size();
+
+    auto baseline_noise = std::max(Median(noises), RelativeDeviation(times));
+    comparison.threshold = std::max(min_threshold, 3 * std::hypot(result.noise, baseline_noise));
+
+    comparison.change = result.ns_per_instruction / comparison.baseline_ns_per_instruction - 1;
+    comparison.regressed = comparison.change > comparison.threshold;
+
+    return comparison;
+}
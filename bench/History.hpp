@@ -0,0 +1,75 @@
+#ifndef BENCH_HISTORY_HPP
+#define BENCH_HISTORY_HPP
+
+#include <RV64.hpp>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+// One workload run on one engine, as printed and as kept in a history file,
+// one JSON object per line. Times are the median of the repeats
+struct BenchResult {
+    std::string workload;
+    std::string subsystem;
+    std::string engine;
+    Hart harts = 1;
+
+    Long instructions = 0;
+    Long repeats = 1;
+    double seconds = 0;
+    double ns_per_instruction = 0;
+
+    // Median absolute deviation of ns_per_instruction over its median, 0
+    // for a single run
+    double noise = 0;
+
+    Long memory_used = 0;
+    Long peak_rss = 0;
+    bool valid = true;
+
+    // Where and when it ran, for reading the history back
+    std::string label;
+    Long time = 0;
+
+    inline double GetMIPS() const { return ns_per_instruction == 0 ? 0 : 1000.0 / ns_per_instruction; }
+
+    // Same workload on the same engine and number of harts
+    inline bool Matches(const BenchResult& other) const {
+        return workload == other.workload && engine == other.engine && harts == other.harts;
+    }
+
+    std::string ToJSON() const;
+
+    // Only reads back what ToJSON writes, nullopt for anything else
+    static std::optional<BenchResult> FromJSON(const std::string& line);
+};
+
+// Missing files read as an empty history
+std::vector<BenchResult> ReadHistory(const std::string& path);
+void AppendHistory(const std::string& path, const std::vector<BenchResult>& results);
+
+struct BenchComparison {
+    double baseline_ns_per_instruction;
+    size_t baseline_runs;
+
+    // Relative, positive when slower
+    double change;
+    double threshold;
+    bool regressed;
+};
+
+// Only the latest runs of a workload count towards its baseline
+static constexpr size_t BASELINE_RUNS = 10;
+
+// Against the median of the matching baseline runs. A change only counts
+// past the larger of min_threshold and three times the noise of both
+// sides, where the baseline's is its runs' own noise or their spread,
+// whichever is larger. nullopt when nothing in the baseline matches
+std::optional<BenchComparison> CompareToBaseline(const BenchResult& result, const std::vector<BenchResult>& baseline, double min_threshold);
+
+// Median and median absolute deviation over it, of values that aren't empty
+double Median(std::vector<double> values);
+double RelativeDeviation(const std::vector<double>& values);
+
+#endif
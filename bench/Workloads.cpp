@@ -0,0 +1,455 @@
+#include "Workloads.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <random>
+
+using A = Assembler;
+
+static void Exit(Assembler& a) {
+    a.LI(A::A0, ECALL_BENCH_EXIT);
+    a.ECALL();
+}
+
+static void StoreResult(Assembler& a, Word reg) {
+    a.LI(A::A5, BENCH_RESULT);
+    a.SD(reg, A::A5, 0);
+}
+
+void BuildHarness(Memory& memory, bool paged) {
+    Assembler entry(BENCH_ENTRY);
+
+    entry.LI(A::T0, BENCH_TRAP);
+    entry.CSRRW(A::ZERO, VirtualMachine::CSR_MTVEC, A::T0);
+
+    if (paged) {
+        constexpr Long V = 1 << 0, R = 1 << 1, W = 1 << 2, X = 1 << 3, A = 1 << 6, D = 1 << 7;
+
+        // One gigapage leaf covers all of RAM, so the walk costs are the TLB's
+        memory.WriteLong(BENCH_ROOT_TABLE, V | R | W | X | A | D);
+
+        entry.LI(A::T0, (8ULL << 60) | (BENCH_ROOT_TABLE >> 12));
+        entry.CSRRW(A::ZERO, VirtualMachine::CSR_SATP, A::T0);
+        entry.LI(A::T0, BENCH_BODY);
+        entry.CSRRW(A::ZERO, VirtualMachine::CSR_MEPC, A::T0);
+        entry.LI(A::T0, 1 << 11);
+        entry.CSRRW(A::ZERO, VirtualMachine::CSR_MSTATUS, A::T0);
+        entry.MRET();
+    }
+    else
+        entry.JAL(A::ZERO, BENCH_BODY);
+
+    entry.WriteTo(memory);
+
+    // An ecall from S-mode traps here and makes the same ecall from M-mode
+    Assembler trap(BENCH_TRAP);
+    Exit(trap);
+    trap.WriteTo(memory);
+}
+
+static Long IntLoopIterations(Long scale) { return scale * 2000000; }
+
+static void BuildIntLoop(Assembler& a, Memory&, Long scale, Hart) {
+    a.LI(A::S0, IntLoopIterations(scale));
+    a.LI(A::T0, 0);
+    a.LI(A::T1, 0);
+
+    auto loop = a.Here();
+    a.ADDI(A::T0, A::T0, 1);
+    a.XOR(A::T1, A::T1, A::T0);
+    a.SLLI(A::T2, A::T1, 3);
+    a.ADD(A::T1, A::T1, A::T2);
+    a.SRLI(A::T2, A::T1, 7);
+    a.XOR(A::T1, A::T1, A::T2);
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, loop);
+
+    StoreResult(a, A::T1);
+    Exit(a);
+}
+
+static bool CheckIntLoop(Memory& memory, Long scale, Hart) {
+    Long counter = 0, value = 0;
+    for (Long i = 0; i < IntLoopIterations(scale); i++) {
+        counter++;
+        value ^= counter;
+        value += value << 3;
+        value ^= value >> 7;
+    }
+
+    return memory.ReadLong(BENCH_RESULT) == value;
+}
+
+static constexpr Address COPY_BYTES = 256 * 1024;
+static constexpr Address COPY_SOURCE = BENCH_DATA;
+static constexpr Address COPY_DESTINATION = BENCH_DATA + 0x100000;
+
+static void BuildMemcpy(Assembler& a, Memory& memory, Long scale, Hart) {
+    std::mt19937_64 random(COPY_BYTES);
+    for (Address offset = 0; offset < COPY_BYTES; offset += 8)
+        memory.WriteLong(COPY_SOURCE + offset, random());
+
+    a.LI(A::S0, scale * 32);
+
+    auto outer = a.Here();
+    a.LI(A::A1, COPY_SOURCE);
+    a.LI(A::A2, COPY_DESTINATION);
+    a.LI(A::A3, COPY_SOURCE + COPY_BYTES);
+
+    auto inner = a.Here();
+    a.LD(A::T0, A::A1, 0);
+    a.LD(A::T1, A::A1, 8);
+    a.SD(A::T0, A::A2, 0);
+    a.SD(A::T1, A::A2, 8);
+    a.ADDI(A::A1, A::A1, 16);
+    a.ADDI(A::A2, A::A2, 16);
+    a.BNE(A::A1, A::A3, inner);
+
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, outer);
+
+    Exit(a);
+}
+
+static bool CheckMemcpy(Memory& memory, Long, Hart) {
+    for (Address offset = 0; offset < COPY_BYTES; offset += 8) {
+        if (memory.ReadLong(COPY_DESTINATION + offset) != memory.ReadLong(COPY_SOURCE + offset))
+            return false;
+    }
+
+    return true;
+}
+
+static constexpr Address SET_BYTES = 1024 * 1024;
+
+static void BuildMemset(Assembler& a, Memory&, Long scale, Hart) {
+    a.LI(A::S0, scale * 8);
+
+    // Each pass writes the number of passes left, so the last one leaves 1s
+    auto outer = a.Here();
+    a.ADDI(A::T0, A::S0, 0);
+    a.LI(A::A1, BENCH_DATA);
+    a.LI(A::A3, BENCH_DATA + SET_BYTES);
+
+    auto inner = a.Here();
+    a.SD(A::T0, A::A1, 0);
+    a.SD(A::T0, A::A1, 8);
+    a.SD(A::T0, A::A1, 16);
+    a.SD(A::T0, A::A1, 24);
+    a.ADDI(A::A1, A::A1, 32);
+    a.BNE(A::A1, A::A3, inner);
+
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, outer);
+
+    Exit(a);
+}
+
+static bool CheckMemset(Memory& memory, Long, Hart) {
+    for (Address offset = 0; offset < SET_BYTES; offset += 8) {
+        if (memory.ReadLong(BENCH_DATA + offset) != 1)
+            return false;
+    }
+
+    return true;
+}
+
+static Long DhrystoneIterations(Long scale) { return scale * 500000; }
+
+// Calls, multiply/divide and a record kept in memory, the mix Dhrystone leans on
+static void BuildDhrystone(Assembler& a, Memory& memory, Long scale, Hart) {
+    Assembler function(BENCH_BODY + 0x800);
+    function.MUL(A::T0, A::A0, A::A4);
+    function.DIVU(A::A1, A::T0, A::A5);
+    function.REMU(A::A2, A::T0, A::S3);
+    function.SD(A::A1, A::S2, 0);
+    function.SD(A::A2, A::S2, 8);
+    function.LD(A::T1, A::S2, 0);
+    function.LD(A::T2, A::S2, 8);
+    function.ADD(A::A0, A::T1, A::T2);
+    function.RET();
+    function.WriteTo(memory);
+
+    a.LI(A::S0, DhrystoneIterations(scale));
+    a.LI(A::S1, 0);
+    a.LI(A::S2, BENCH_DATA);
+    a.LI(A::S3, 5);
+    a.LI(A::A4, 7);
+    a.LI(A::A5, 3);
+
+    auto loop = a.Here();
+    a.ADDI(A::A0, A::S0, 0);
+    a.JAL(A::RA, function.GetBase());
+    a.ADD(A::S1, A::S1, A::A0);
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, loop);
+
+    StoreResult(a, A::S1);
+    Exit(a);
+}
+
+static bool CheckDhrystone(Memory& memory, Long scale, Hart) {
+    Long sum = 0;
+    for (Long i = DhrystoneIterations(scale); i > 0; i--)
+        sum += i * 7 / 3 + i * 7 % 5;
+
+    return memory.ReadLong(BENCH_RESULT) == sum;
+}
+
+static constexpr Long LIST_NODES = 4096;
+static constexpr Address LIST_NODE_SIZE = 16;
+
+static Long CoremarkPasses(Long scale) { return scale * 128; }
+
+// A linked list walked in shuffled order with a rotate-xor checksum, like
+// CoreMark's list kernel. The head node is always the first one
+static void BuildCoremark(Assembler& a, Memory& memory, Long scale, Hart) {
+    std::vector<Long> order(LIST_NODES);
+    for (Long i = 0; i < LIST_NODES; i++)
+        order[i] = i;
+
+    std::mt19937_64 random(LIST_NODES);
+    std::shuffle(order.begin() + 1, order.end(), random);
+
+    for (Long i = 0; i < LIST_NODES; i++) {
+        Address node = BENCH_DATA + order[i] * LIST_NODE_SIZE;
+        Address next = i + 1 < LIST_NODES ? BENCH_DATA + order[i + 1] * LIST_NODE_SIZE : 0;
+
+        memory.WriteLong(node, next);
+        memory.WriteLong(node + 8, random());
+    }
+
+    a.LI(A::S0, CoremarkPasses(scale));
+    a.LI(A::S1, 0);
+
+    auto outer = a.Here();
+    a.LI(A::A1, BENCH_DATA);
+
+    auto inner = a.Here();
+    a.LD(A::T0, A::A1, 8);
+    a.SLLI(A::T1, A::S1, 5);
+    a.SRLI(A::T2, A::S1, 59);
+    a.OR(A::S1, A::T1, A::T2);
+    a.XOR(A::S1, A::S1, A::T0);
+    a.LD(A::A1, A::A1, 0);
+    a.BNE(A::A1, A::ZERO, inner);
+
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, outer);
+
+    StoreResult(a, A::S1);
+    Exit(a);
+}
+
+static bool CheckCoremark(Memory& memory, Long scale, Hart) {
+    Long checksum = 0;
+    for (Long pass = 0; pass < CoremarkPasses(scale); pass++) {
+        for (Address node = BENCH_DATA; node != 0; node = memory.ReadLong(node))
+            checksum = std::rotl(checksum, 5) ^ memory.ReadLong(node + 8);
+    }
+
+    return memory.ReadLong(BENCH_RESULT) == checksum;
+}
+
+static Long FloatIterations(Long scale) { return scale * 500000; }
+
+static constexpr double FLOAT_SCALE = 0.999;
+static constexpr double FLOAT_OFFSET = 0.001;
+
+static void BuildFloat(Assembler& a, Memory& memory, Long scale, Hart) {
+    memory.WriteLong(BENCH_DATA, std::bit_cast<Long>(FLOAT_SCALE));
+    memory.WriteLong(BENCH_DATA + 8, std::bit_cast<Long>(FLOAT_OFFSET));
+    memory.WriteLong(BENCH_DATA + 16, std::bit_cast<Long>(1.0));
+    memory.WriteLong(BENCH_DATA + 24, std::bit_cast<Long>(0.0));
+
+    a.LI(A::S0, FloatIterations(scale));
+    a.LI(A::A1, BENCH_DATA);
+    a.FLD(2, A::A1, 0);
+    a.FLD(6, A::A1, 8);
+    a.FLD(3, A::A1, 16);
+    a.FLD(1, A::A1, 16);
+    a.FLD(5, A::A1, 24);
+
+    auto loop = a.Here();
+    a.FMADD_D(1, 1, 2, 6);
+    a.FDIV_D(4, 3, 1);
+    a.FADD_D(5, 5, 4);
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, loop);
+
+    a.LI(A::A5, BENCH_RESULT);
+    a.FSD(5, A::A5, 0);
+    Exit(a);
+}
+
+static bool CheckFloat(Memory& memory, Long scale, Hart) {
+    double value = 1.0, sum = 0.0;
+    for (Long i = 0; i < FloatIterations(scale); i++) {
+        value = std::fma(value, FLOAT_SCALE, FLOAT_OFFSET);
+        sum += 1.0 / value;
+    }
+
+    // The guest's fmadd may round twice, so only ask for a close answer
+    auto got = std::bit_cast<double>(memory.ReadLong(BENCH_RESULT));
+    return std::abs(got - sum) <= std::abs(sum) * 1e-9;
+}
+
+static Long AtomicIterations(Long scale) { return scale * 200000; }
+
+// Every hart hammers one counter
+static void BuildAtomic(Assembler& a, Memory& memory, Long scale, Hart) {
+    memory.WriteLong(BENCH_RESULT, 0);
+
+    a.LI(A::S0, AtomicIterations(scale));
+    a.LI(A::A1, BENCH_RESULT);
+    a.LI(A::T1, 1);
+
+    auto loop = a.Here();
+    a.AMOADD_W(A::ZERO, A::A1, A::T1);
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, loop);
+
+    Exit(a);
+}
+
+static bool CheckAtomic(Memory& memory, Long scale, Hart harts) {
+    return memory.ReadWord(BENCH_RESULT) == static_cast<Word>(AtomicIterations(scale) * harts);
+}
+
+static Long DecodeIterations(Long scale) { return scale * 20000; }
+static constexpr Long DECODE_BLOCK = 64;
+
+// A fence.i every pass throws away the decoded code, so each pass decodes
+// its block again
+static void BuildDecode(Assembler& a, Memory&, Long scale, Hart) {
+    a.LI(A::S0, DecodeIterations(scale));
+    a.LI(A::T0, 0);
+
+    auto loop = a.Here();
+    for (Long i = 0; i < DECODE_BLOCK; i++)
+        a.ADDI(A::T0, A::T0, 1);
+
+    a.FENCE_I();
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, loop);
+
+    StoreResult(a, A::T0);
+    Exit(a);
+}
+
+static bool CheckDecode(Memory& memory, Long scale, Hart) {
+    return memory.ReadLong(BENCH_RESULT) == static_cast<Long>(DecodeIterations(scale) * DECODE_BLOCK);
+}
+
+static Long RoutingIterations(Long scale) { return scale * 500000; }
+
+static constexpr Address ROUTING_REGIONS = 4;
+static constexpr Address ROUTING_BASE = 0x10000000;
+static constexpr Address ROUTING_STRIDE = 0x1000000;
+static constexpr Address ROUTING_SIZE = 0x10000;
+
+// Loads that go to a different region every time, so none of them find
+// the region the last one used
+static void BuildRouting(Assembler& a, Memory& memory, Long scale, Hart) {
+    std::mt19937_64 random(ROUTING_REGIONS);
+
+    for (Address region = 0; region < ROUTING_REGIONS; region++) {
+        Address base = ROUTING_BASE + region * ROUTING_STRIDE;
+
+        memory.AddMemoryRegion(MemoryRAM::Create(base, ROUTING_SIZE));
+        memory.WriteLong(base, random());
+    }
+
+    a.LI(A::S0, RoutingIterations(scale));
+    a.LI(A::S1, 0);
+    a.LI(A::A1, ROUTING_BASE);
+    a.LI(A::A2, ROUTING_BASE + ROUTING_STRIDE);
+    a.LI(A::A3, ROUTING_BASE + 2 * ROUTING_STRIDE);
+    a.LI(A::A4, ROUTING_BASE + 3 * ROUTING_STRIDE);
+
+    auto loop = a.Here();
+    a.LD(A::T0, A::A1, 0);
+    a.ADD(A::S1, A::S1, A::T0);
+    a.LD(A::T0, A::A2, 0);
+    a.ADD(A::S1, A::S1, A::T0);
+    a.LD(A::T0, A::A3, 0);
+    a.ADD(A::S1, A::S1, A::T0);
+    a.LD(A::T0, A::A4, 0);
+    a.ADD(A::S1, A::S1, A::T0);
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, loop);
+
+    StoreResult(a, A::S1);
+    Exit(a);
+}
+
+static bool CheckRouting(Memory& memory, Long scale, Hart) {
+    Long pass = 0;
+    for (Address region = 0; region < ROUTING_REGIONS; region++)
+        pass += memory.ReadLong(ROUTING_BASE + region * ROUTING_STRIDE);
+
+    return memory.ReadLong(BENCH_RESULT) == pass * RoutingIterations(scale);
+}
+
+static Long TLBPasses(Long scale) { return scale * 2000; }
+
+// Twice as many pages as the data TLB holds, walked in order, so every
+// load misses and walks the table
+static constexpr Address TLB_PAGES = 2 * 64 * 4;
+static constexpr Address TLB_PAGE_SIZE = 0x1000;
+
+static void BuildTLB(Assembler& a, Memory& memory, Long scale, Hart) {
+    std::mt19937_64 random(TLB_PAGES);
+    for (Address page = 0; page < TLB_PAGES; page++)
+        memory.WriteLong(BENCH_DATA + page * TLB_PAGE_SIZE, random());
+
+    a.LI(A::S0, TLBPasses(scale));
+    a.LI(A::S1, 0);
+    a.LI(A::A4, TLB_PAGE_SIZE);
+
+    auto outer = a.Here();
+    a.LI(A::A1, BENCH_DATA);
+    a.LI(A::A3, BENCH_DATA + TLB_PAGES * TLB_PAGE_SIZE);
+
+    auto inner = a.Here();
+    a.LD(A::T0, A::A1, 0);
+    a.ADD(A::S1, A::S1, A::T0);
+    a.ADD(A::A1, A::A1, A::A4);
+    a.BNE(A::A1, A::A3, inner);
+
+    a.ADDI(A::S0, A::S0, -1);
+    a.BNE(A::S0, A::ZERO, outer);
+
+    StoreResult(a, A::S1);
+    Exit(a);
+}
+
+static bool CheckTLB(Memory& memory, Long scale, Hart) {
+    Long pass = 0;
+    for (Address page = 0; page < TLB_PAGES; page++)
+        pass += memory.ReadLong(BENCH_DATA + page * TLB_PAGE_SIZE);
+
+    return memory.ReadLong(BENCH_RESULT) == pass * TLBPasses(scale);
+}
+
+const std::vector<Workload>& GetWorkloads() {
+    static const std::vector<Workload> workloads = {
+        {"int_loop", "alu", 1, false, BuildIntLoop, CheckIntLoop},
+        {"int_loop_paged", "alu", 1, true, BuildIntLoop, CheckIntLoop},
+        {"memcpy", "memory", 1, false, BuildMemcpy, CheckMemcpy},
+        {"memcpy_paged", "memory", 1, true, BuildMemcpy, CheckMemcpy},
+        {"memset", "memory", 1, false, BuildMemset, CheckMemset},
+        {"dhrystone", "mixed", 1, false, BuildDhrystone, CheckDhrystone},
+        {"coremark", "mixed", 1, false, BuildCoremark, CheckCoremark},
+        {"coremark_paged", "mixed", 1, true, BuildCoremark, CheckCoremark},
+        {"fp", "fp", 1, false, BuildFloat, CheckFloat},
+        {"amo", "amo", 4, false, BuildAtomic, CheckAtomic},
+        {"amo_paged", "amo", 4, true, BuildAtomic, CheckAtomic},
+        {"decode", "decode", 1, false, BuildDecode, CheckDecode},
+        {"routing", "routing", 1, false, BuildRouting, CheckRouting},
+        {"tlb", "tlb", 1, true, BuildTLB, CheckTLB}
+    };
+
+    return workloads;
+}
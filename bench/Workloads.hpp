@@ -0,0 +1,50 @@
+#ifndef BENCH_WORKLOADS_HPP
+#define BENCH_WORKLOADS_HPP
+
+#include <Memory.hpp>
+#include <VirtualMachine.hpp>
+
+#include <string>
+#include <vector>
+
+#include "Assembler.hpp"
+
+static constexpr Address BENCH_RAM_ADDRESS = 0x1000;
+static constexpr Address BENCH_RAM_SIZE = 64 * 1024 * 1024;
+
+// Every hart starts at the entry, which drops into the body either directly
+// or through an mret with paging on. Traps land on a stub that exits
+static constexpr Address BENCH_ENTRY = 0x1000;
+static constexpr Address BENCH_TRAP = 0x1800;
+static constexpr Address BENCH_BODY = 0x2000;
+static constexpr Address BENCH_ROOT_TABLE = 0x10000;
+static constexpr Address BENCH_RESULT = 0x11000;
+static constexpr Address BENCH_DATA = 0x100000;
+
+static constexpr Long ECALL_BENCH_EXIT = -1ULL;
+
+struct Workload {
+    std::string name;
+
+    // The part of the simulator the workload leans on, so a slowdown in
+    // the history points somewhere: alu, memory, mixed, fp, amo, decode,
+    // routing or tlb
+    std::string subsystem;
+
+    Hart harts;
+    bool paged;
+
+    // Emits the body and any data it needs. Scale multiplies the work done
+    void (*build)(Assembler& code, Memory& memory, Long scale, Hart harts);
+
+    // Compares what the guest left behind against the same work done on the host
+    bool (*check)(Memory& memory, Long scale, Hart harts);
+};
+
+const std::vector<Workload>& GetWorkloads();
+
+// Writes the entry, trap stub and, for paged workloads, an identity mapped
+// Sv39 gigapage over the start of memory
+void BuildHarness(Memory& memory, bool paged);
+
+#endif
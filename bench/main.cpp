@@ -0,0 +1,372 @@
+#include <VirtualMachine.hpp>
+#include <Memory.hpp>
+#include <CLINT.hpp>
+#include <RV64.hpp>
+#include <CoSimulator.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <format>
+#include <exception>
+#include <cstdlib>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "Allocations.hpp"
+#include "ArgsParser.hpp"
+#include "History.hpp"
+#include "MachineArgs.hpp"
+#include "Workloads.hpp"
+
+static std::vector<std::unique_ptr<VirtualMachine>> harts;
+
+static Long GetPeakResidentMemory() {
+#if defined(_WIN32) || defined(_WIN64)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return static_cast<Long>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+static std::string GetEngineName(Engine engine) {
+    switch (engine) {
+        case Engine::Interpreter: return "interpreter";
+        case Engine::Blocks: return "blocks";
+        case Engine::JIT: return "jit";
+    }
+
+    return "";
+}
+
+struct Run {
+    Long instructions = 0;
+    double seconds = 0;
+    Long memory_used = 0;
+    bool valid = false;
+};
+
+struct RunOptions {
+    Long scale = 1;
+    bool precise_fp = false;
+
+    bool cosim = false;
+    CoSimulator::Options cosim_options;
+};
+
+// Loads the workload into fresh memory, with its harts started
+static void BuildMachine(Memory& memory, const Workload& workload, Hart hart_count, const RunOptions& options) {
+    memory.AddMemoryRegion(MemoryRAM::Create(BENCH_RAM_ADDRESS, BENCH_RAM_SIZE));
+    memory.AddMemoryRegion(MemoryCLINT::Create());
+
+    BuildHarness(memory, workload.paged);
+
+    Assembler code(BENCH_BODY);
+    workload.build(code, memory, options.scale, hart_count);
+    code.WriteTo(memory);
+
+    for (Hart i = 0; i < hart_count; i++) {
+        auto vm = std::make_unique<VirtualMachine>(memory, BENCH_ENTRY, i);
+        ApplyEngine(*vm);
+        vm->SetPreciseFloatFlags(options.precise_fp);
+        vm->Start();
+        harts.push_back(std::move(vm));
+    }
+}
+
+// Runs the workload once on fresh memory and checks what it left behind
+static Run RunWorkload(const Workload& workload, Hart hart_count, const RunOptions& options) {
+    Memory memory;
+    BuildMachine(memory, workload, hart_count, options);
+
+    std::atomic<bool> failed = false;
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (options.cosim) {
+        try {
+            CoSimulator cosimulator(*harts[0], memory, options.cosim_options);
+            while (cosimulator.Run(options.cosim_options.interval * 100));
+
+            if (auto& divergence = cosimulator.GetDivergence()) {
+                std::cerr << std::format("{}: diverged after {} instructions at {:#x} ({}): {}{}", workload.name,
+                    divergence->instruction, divergence->pc, std::string(RVInstruction::Decode(divergence->encoding)),
+                    divergence->difference, divergence->pinpointed ? "" : ", not pinpointed") << std::endl;
+                failed = true;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << std::format("{}: co-simulation stopped: {}", workload.name, e.what()) << std::endl;
+            failed = true;
+        }
+    }
+    else {
+        std::vector<std::jthread> workers;
+        for (auto& vm : harts) {
+            workers.emplace_back([&, vm = vm.get()]() {
+                try {
+                    vm->Run();
+                }
+                catch (const std::exception& e) {
+                    std::cerr << std::format("{}: hart {} stopped: {}", workload.name, vm->GetHartID(), e.what()) << std::endl;
+                    failed = true;
+
+                    for (auto& other : harts)
+                        other->Stop();
+                }
+            });
+        }
+    }
+
+    Run run;
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto& vm : harts)
+        run.instructions += vm->GetCycles();
+
+    run.valid = !failed && workload.check(memory, options.scale, hart_count);
+    run.memory_used = memory.GetUsedMemory();
+
+    harts.clear();
+    return run;
+}
+
+struct AllocationRun {
+    Long warmup = 0;
+    Long instructions = 0;
+    Long allocations = 0;
+
+    // Whether the workload was still going at the end of the count, as its
+    // last steps run code and touch pages for the first time
+    bool steady = false;
+    bool valid = false;
+};
+
+// Slices every hart takes in turn, on this thread, as rv64_step_all does
+static constexpr Long ALLOCATION_QUANTUM = 1000;
+
+// Runs the workload with its harts stepped in turn, and counts the heap
+// allocations made over measure instructions a hart once they're past
+// warmup. By then the code is decoded, its blocks built and the pages it
+// uses mapped, so steps from there on shouldn't allocate
+static AllocationRun CountAllocations(const Workload& workload, Hart hart_count, const RunOptions& options, Long warmup, Long measure) {
+    Memory memory;
+    BuildMachine(memory, workload, hart_count, options);
+
+    AllocationRun run;
+    bool failed = false;
+
+    auto StepAll = [&]() {
+        bool ran = false;
+
+        for (auto& vm : harts) {
+            try {
+                ran |= vm->RunQuantum(ALLOCATION_QUANTUM);
+            }
+            catch (const std::exception& e) {
+                std::cerr << std::format("{}: hart {} stopped: {}", workload.name, vm->GetHartID(), e.what()) << std::endl;
+                failed = true;
+                vm->Stop();
+            }
+        }
+
+        return ran;
+    };
+
+    auto Instructions = [&]() {
+        Long instructions = 0;
+        for (auto& vm : harts)
+            instructions += vm->GetCycles();
+
+        return instructions;
+    };
+
+    while (Instructions() < warmup * hart_count && StepAll()) {}
+    run.warmup = Instructions();
+
+    auto before = GetAllocationCount();
+    while (Instructions() < (warmup + measure) * hart_count && StepAll()) {}
+    run.allocations = GetAllocationCount() - before;
+
+    run.instructions = Instructions() - run.warmup;
+    run.steady = run.instructions != 0 && StepAll();
+
+    while (StepAll()) {}
+    run.valid = !failed && workload.check(memory, options.scale, hart_count);
+
+    harts.clear();
+    return run;
+}
+
+// Runs each workload to completion and prints one JSON object per line.
+//
+// --repeat=<n> runs each n times and reports the medians with their noise.
+// --history=<file> appends the results to a file of earlier ones, and
+// --baseline=<file> compares against the latest runs in one, failing when a
+// workload slowed down past --threshold=<percent>, 5 by default, or past
+// what the noise of both explains. --all_engines runs every workload on the
+// interpreter, blocks and the JIT in turn, each compared on its own.
+//
+// --count_allocations times nothing, and instead fails when a workload
+// allocates on the heap over --measure=<n> instructions a hart after the
+// first --warmup=<n>, both 250000 by default
+int main(int argc, const char** argv) {
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; i++) {
+        args.push_back(argv[i]);
+    }
+
+    ArgsParser args_parser(args);
+
+    std::string error;
+    if (!ParseMachineArgs(args_parser, error)) {
+        std::cerr << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto only = args_parser.GetValueOr<std::string>("workload", "");
+    auto cores = args_parser.GetValueOr<Hart>("cores", 0);
+    auto repeats = std::max<Long>(args_parser.GetValueOr<Long>("repeat", 1), 1);
+    auto label = args_parser.GetValueOr<std::string>("label", "");
+    auto threshold = args_parser.GetValueOr<Long>("threshold", 5) / 100.0;
+
+    RunOptions options;
+    options.scale = args_parser.GetValueOr<Long>("scale", 1);
+    options.precise_fp = args_parser.HasFlag("precise_fp");
+
+    // --cosim=<interval> checks the engine against the reference interpreter
+    // every interval instructions, for workloads on one hart
+    options.cosim = args_parser.HasValue("cosim");
+    options.cosim_options.interval = args_parser.GetValueOr<Long>("cosim", options.cosim_options.interval);
+
+    if (options.scale == 0) options.scale = 1;
+
+    std::vector<Engine> engines = {engine};
+    if (args_parser.HasFlag("all_engines"))
+        engines = {Engine::Interpreter, Engine::Blocks, Engine::JIT};
+
+    std::vector<BenchResult> baseline;
+    if (args_parser.HasValue("baseline"))
+        baseline = ReadHistory(args_parser.GetValue<std::string>("baseline"));
+
+    // Co-simulated copies run on clones of the memory, each with its own CLINT
+    VirtualMachine::RegisterECall(ECALL_BENCH_EXIT, [](Hart hart, bool, Memory& memory, auto&, auto&) {
+        memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT)->GetHart(hart)->Stop();
+    });
+
+    auto count_allocations = args_parser.HasFlag("count_allocations");
+    auto warmup = args_parser.GetValueOr<Long>("warmup", 250000);
+    auto measure = args_parser.GetValueOr<Long>("measure", 250000);
+
+    bool all_valid = true;
+    bool allocated = false;
+    bool regressed = false;
+    bool ran_any = false;
+
+    std::vector<BenchResult> results;
+
+    for (auto run_engine : engines)
+    for (auto& workload : GetWorkloads()) {
+        if (!only.empty() && workload.name != only) continue;
+
+        // Only workloads that share work between harts take the override
+        Hart hart_count = workload.harts;
+        if (cores != 0 && hart_count > 1)
+            hart_count = cores;
+
+        if (options.cosim && hart_count > 1) {
+            std::cerr << std::format("{}: skipped, co-simulation follows a single hart", workload.name) << std::endl;
+            continue;
+        }
+
+        engine = run_engine;
+
+        if (count_allocations) {
+            auto run = CountAllocations(workload, hart_count, options, warmup, measure);
+
+            std::cout << std::format("{{\"workload\":\"{}\",\"engine\":\"{}\",\"harts\":{},\"warmup\":{},\"instructions\":{},\"allocations\":{},\"steady\":{},\"valid\":{}}}",
+                workload.name, GetEngineName(run_engine), hart_count, run.warmup, run.instructions, run.allocations,
+                run.steady ? "true" : "false", run.valid ? "true" : "false") << std::endl;
+
+            if (!run.steady)
+                std::cerr << std::format("{}: finished before the count was over, try a larger --scale", workload.name) << std::endl;
+
+            all_valid = all_valid && run.valid;
+            allocated = allocated || (run.steady && run.allocations != 0);
+            ran_any = true;
+            continue;
+        }
+
+        BenchResult result;
+        result.workload = workload.name;
+        result.subsystem = workload.subsystem;
+        result.engine = GetEngineName(run_engine);
+        result.harts = hart_count;
+        result.repeats = repeats;
+        result.label = label;
+        result.time = static_cast<Long>(std::time(nullptr));
+
+        std::vector<double> seconds, ns_per_instruction;
+
+        for (Long i = 0; i < repeats; i++) {
+            auto run = RunWorkload(workload, hart_count, options);
+
+            result.instructions = run.instructions;
+            result.memory_used = run.memory_used;
+            result.valid = result.valid && run.valid;
+
+            seconds.push_back(run.seconds);
+            ns_per_instruction.push_back(run.seconds * 1000000000.0 / run.instructions);
+        }
+
+        result.seconds = Median(seconds);
+        result.ns_per_instruction = Median(ns_per_instruction);
+        result.noise = RelativeDeviation(ns_per_instruction);
+        result.peak_rss = GetPeakResidentMemory();
+
+        all_valid = all_valid && result.valid;
+        ran_any = true;
+
+        std::cout << result.ToJSON() << std::endl;
+
+        if (auto comparison = CompareToBaseline(result, baseline, threshold)) {
+            std::cerr << std::format("{} on {}: {:+.1f}% ns/instruction against {:.3f} from {} runs, threshold {:.1f}%{}",
+                workload.name, result.engine, comparison->change * 100, comparison->baseline_ns_per_instruction,
+                comparison->baseline_runs, comparison->threshold * 100, comparison->regressed ? ", regressed" : "") << std::endl;
+
+            regressed = regressed || comparison->regressed;
+        }
+
+        results.push_back(std::move(result));
+    }
+
+    if (!ran_any) {
+        std::cerr << std::format("No workload named {}", only) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (args_parser.HasValue("history"))
+        AppendHistory(args_parser.GetValue<std::string>("history"), results);
+
+    return all_valid && !allocated && !regressed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,49 @@
+#include "block.h"
+
+static struct block_descriptor ring[1];
+static uint32_t submitted;
+
+static void block_write_reg(uint32_t reg, uint32_t value) {
+    volatile uint32_t* regs = (volatile uint32_t*)BLOCK_BASE;
+    regs[reg / 4] = value;
+    regs[reg / 4 + 1] = 0;
+}
+
+// One descriptor at a time, polled until the device writes its status back
+static int block_run(uint32_t op, uint32_t sector, uint32_t buffer, uint32_t length) {
+    if (submitted == 0) {
+        block_write_reg(BLOCK_RING_ADDRESS, (uint32_t)ring);
+        block_write_reg(BLOCK_RING_SIZE, 1);
+    }
+
+    ring[0].op = op;
+    ring[0].status = BLOCK_STATUS_PENDING;
+    ring[0].sector = sector;
+    ring[0].buffer = buffer;
+    ring[0].length = length;
+
+    block_write_reg(BLOCK_SUBMIT, ++submitted);
+
+    while (ring[0].status == BLOCK_STATUS_PENDING) {}
+
+    block_write_reg(BLOCK_INTERRUPT, 0);
+
+    return ring[0].status == BLOCK_STATUS_OK ? 0 : -1;
+}
+
+uint32_t block_capacity(void) {
+    volatile uint32_t* regs = (volatile uint32_t*)BLOCK_BASE;
+    return regs[BLOCK_CAPACITY / 4];
+}
+
+int block_read(void* buffer, uint32_t sector, uint32_t count) {
+    return block_run(BLOCK_OP_READ, sector, (uint32_t)buffer, count * BLOCK_SECTOR_SIZE);
+}
+
+int block_write(const void* buffer, uint32_t sector, uint32_t count) {
+    return block_run(BLOCK_OP_WRITE, sector, (uint32_t)buffer, count * BLOCK_SECTOR_SIZE);
+}
+
+int block_flush(void) {
+    return block_run(BLOCK_OP_FLUSH, 0, 0, 0);
+}
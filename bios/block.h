@@ -0,0 +1,43 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+
+#define BLOCK_BASE 0x2011000
+
+#define BLOCK_RING_ADDRESS 0x00
+#define BLOCK_RING_SIZE 0x08
+#define BLOCK_SUBMIT 0x10
+#define BLOCK_COMPLETED 0x18
+#define BLOCK_CAPACITY 0x20
+#define BLOCK_INTERRUPT_HART 0x28
+#define BLOCK_INTERRUPT 0x30
+
+#define BLOCK_SECTOR_SIZE 512
+
+#define BLOCK_OP_READ 0
+#define BLOCK_OP_WRITE 1
+#define BLOCK_OP_FLUSH 2
+
+#define BLOCK_STATUS_PENDING 0
+#define BLOCK_STATUS_OK 1
+#define BLOCK_STATUS_ERROR 2
+
+struct block_descriptor {
+    uint32_t op;
+    volatile uint32_t status;
+    uint64_t sector;
+    uint64_t buffer;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+// Sectors on the disk, 0 when there isn't one
+uint32_t block_capacity(void);
+
+// Both wait for the request and return 0, or -1 when the device failed it
+int block_read(void* buffer, uint32_t sector, uint32_t count);
+int block_write(const void* buffer, uint32_t sector, uint32_t count);
+int block_flush(void);
+
+#endif
@@ -0,0 +1,73 @@
+#include "console.h"
+
+static char output_ring[4096];
+static char input_ring[256];
+
+static uint32_t output_head;
+static uint32_t input_tail;
+
+static volatile uint32_t* console_regs(void) {
+    return (volatile uint32_t*)CONSOLE_BASE;
+}
+
+static void console_write_reg(uint32_t reg, uint32_t value) {
+    volatile uint32_t* regs = console_regs();
+    regs[reg / 4] = value;
+    regs[reg / 4 + 1] = 0;
+}
+
+void console_write(const char* buffer, uint32_t size) {
+    volatile uint32_t* regs = console_regs();
+
+    if (regs[CONSOLE_OUTPUT_SIZE / 4] == 0) {
+        console_write_reg(CONSOLE_OUTPUT_RING, (uint32_t)output_ring);
+        console_write_reg(CONSOLE_OUTPUT_SIZE, sizeof(output_ring));
+    }
+
+    while (size) {
+        while (output_head - regs[CONSOLE_OUTPUT_TAIL / 4] == sizeof(output_ring)) {}
+
+        output_ring[output_head % sizeof(output_ring)] = *buffer++;
+        output_head++;
+        size--;
+
+        // Publish a full ring before waiting on it, and the rest at the end
+        if (size == 0 || output_head - regs[CONSOLE_OUTPUT_TAIL / 4] == sizeof(output_ring)) {
+            __sync_synchronize();
+            regs[CONSOLE_OUTPUT_HEAD / 4] = output_head;
+        }
+    }
+}
+
+int console_read(char* buffer, int buffer_size) {
+    volatile uint32_t* regs = console_regs();
+
+    if (regs[CONSOLE_INPUT_SIZE / 4] == 0) {
+        console_write_reg(CONSOLE_INPUT_RING, (uint32_t)input_ring);
+        console_write_reg(CONSOLE_INPUT_SIZE, sizeof(input_ring));
+    }
+
+    int count = 0;
+
+    while (1) {
+        uint32_t head = regs[CONSOLE_INPUT_HEAD / 4];
+
+        if (head == input_tail) {
+            if (regs[CONSOLE_INPUT_CLOSED / 4]) break;
+            continue;
+        }
+
+        __sync_synchronize();
+
+        char c = input_ring[input_tail % sizeof(input_ring)];
+        input_tail++;
+        regs[CONSOLE_INPUT_TAIL / 4] = input_tail;
+
+        if (c == '\n') break;
+
+        // Like the ecall, the rest of a long line is dropped
+        if (count < buffer_size) buffer[count++] = c;
+    }
+
+    return count;
+}
@@ -0,0 +1,25 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+
+#define CONSOLE_BASE 0x2012000
+
+#define CONSOLE_OUTPUT_RING 0x00
+#define CONSOLE_OUTPUT_SIZE 0x08
+#define CONSOLE_OUTPUT_HEAD 0x10
+#define CONSOLE_OUTPUT_TAIL 0x18
+#define CONSOLE_INPUT_RING 0x20
+#define CONSOLE_INPUT_SIZE 0x28
+#define CONSOLE_INPUT_HEAD 0x30
+#define CONSOLE_INPUT_TAIL 0x38
+#define CONSOLE_INPUT_CLOSED 0x40
+
+// Copies into the output ring, waiting only while it's full
+void console_write(const char* buffer, uint32_t size);
+
+// Waits for a line and returns its length without the newline, 0 once
+// input has ended
+int console_read(char* buffer, int buffer_size);
+
+#endif
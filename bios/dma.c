@@ -0,0 +1,34 @@
+#include "dma.h"
+
+static void dma_write(uint32_t reg, uint32_t value) {
+    volatile uint32_t* regs = (volatile uint32_t*)DMA_BASE;
+    regs[reg / 4] = value;
+    regs[reg / 4 + 1] = 0;
+}
+
+// Transfers finish before the store to CONTROL returns
+static int dma_run(uint32_t command) {
+    volatile uint32_t* regs = (volatile uint32_t*)DMA_BASE;
+    regs[DMA_CONTROL / 4] = command;
+
+    uint32_t status = regs[DMA_STATUS / 4];
+    regs[DMA_STATUS / 4] = DMA_STATUS_IDLE;
+
+    return status == DMA_STATUS_DONE ? 0 : -1;
+}
+
+int dma_copy(void* destination, const void* source, uint32_t length) {
+    dma_write(DMA_SOURCE, (uint32_t)source);
+    dma_write(DMA_DESTINATION, (uint32_t)destination);
+    dma_write(DMA_LENGTH, length);
+
+    return dma_run(DMA_COMMAND_COPY);
+}
+
+int dma_fill(void* destination, uint8_t value, uint32_t length) {
+    dma_write(DMA_DESTINATION, (uint32_t)destination);
+    dma_write(DMA_FILL, value);
+    dma_write(DMA_LENGTH, length);
+
+    return dma_run(DMA_COMMAND_FILL);
+}
@@ -0,0 +1,29 @@
+#ifndef DMA_H
+#define DMA_H
+
+#include <stdint.h>
+
+#define DMA_BASE 0x2010000
+
+#define DMA_SOURCE 0x00
+#define DMA_DESTINATION 0x08
+#define DMA_LENGTH 0x10
+#define DMA_FILL 0x18
+#define DMA_CONTROL 0x20
+#define DMA_STATUS 0x28
+#define DMA_INTERRUPT_HART 0x30
+
+#define DMA_COMMAND_COPY 1
+#define DMA_COMMAND_FILL 2
+#define DMA_CONTROL_INTERRUPT (1 << 8)
+
+#define DMA_STATUS_IDLE 0
+#define DMA_STATUS_DONE 1
+#define DMA_STATUS_ERROR 2
+
+// Both return 0 once the transfer is done, or -1 when part of it
+// wasn't mapped
+int dma_copy(void* destination, const void* source, uint32_t length);
+int dma_fill(void* destination, uint8_t value, uint32_t length);
+
+#endif
@@ -0,0 +1,31 @@
+#include "events.h"
+
+#include "plic.h"
+
+uint32_t events_next(uint32_t* data) {
+    volatile uint32_t* regs = (volatile uint32_t*)EVENTS_BASE;
+
+    uint32_t event = regs[EVENTS_EVENT / 4];
+    if (EVENT_TYPE(event) == EVENT_NONE) return EVENT_NONE;
+
+    if (data) *data = regs[EVENTS_DATA / 4];
+    regs[EVENTS_NEXT / 4] = 0;
+
+    return event;
+}
+
+void events_wait(void) {
+    volatile uint32_t* regs = (volatile uint32_t*)EVENTS_BASE;
+
+    static int routed;
+    if (!routed) {
+        plic_enable(PLIC_SOURCE_INPUT, 1);
+        routed = 1;
+    }
+
+    // Clearing first means an event pushed after the check still wakes us
+    regs[EVENTS_INTERRUPT / 4] = 0;
+
+    while (regs[EVENTS_COUNT / 4] == 0)
+        __asm__ volatile("wfi");
+}
@@ -0,0 +1,36 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+
+#define EVENTS_BASE 0x2013000
+
+#define EVENTS_EVENT 0x00
+#define EVENTS_DATA 0x08
+#define EVENTS_NEXT 0x10
+#define EVENTS_COUNT 0x18
+#define EVENTS_DROPPED 0x20
+#define EVENTS_INTERRUPT_HART 0x28
+#define EVENTS_INTERRUPT 0x30
+
+#define EVENT_NONE 0
+#define EVENT_KEY 1
+#define EVENT_BUTTON 2
+#define EVENT_MOTION 3
+
+#define EVENT_TYPE(event) ((event) & 0xff)
+#define EVENT_PRESSED(event) (((event) >> 8) & 1)
+#define EVENT_CODE(event) ((event) >> 16)
+
+#define EVENT_X(data) ((data) & 0xffff)
+#define EVENT_Y(data) ((data) >> 16)
+
+// Takes the oldest event, EVENT_NONE when there isn't one. data may be null
+uint32_t events_next(uint32_t* data);
+
+// Sleeps in wfi until an event is queued. Routes the input source to the
+// calling hart on the PLIC, and needs the machine external interrupt
+// enabled in mie, with mstatus.MIE left as the caller wants it
+void events_wait(void);
+
+#endif
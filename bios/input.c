@@ -1,9 +1,9 @@
 #include "input.h"
 
-#include "machine.h"
+#include "console.h"
 #include "printf.h"
 
 int read_input(char* buffer, int buffer_size) {
     flush();
-    return (int)machine_call(MACHINE_CALL_CIN, buffer, buffer_size);
+    return console_read(buffer, buffer_size);
 }
\ No newline at end of file
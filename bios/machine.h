@@ -8,6 +8,8 @@ void machine_break();
 
 #define MACHINE_CALL_COUT 0
 #define MACHINE_CALL_CIN 1
+#define MACHINE_CALL_GET_SCREEN_FORMAT (-8U)
+#define MACHINE_CALL_SNAPSHOT (-7U)
 #define MACHINE_CALL_START_CPU (-6U)
 #define MACHINE_CALL_GET_CPUS (-5U)
 #define MACHINE_CALL_GET_SCREEN_ADDRESS (-4U)
@@ -15,4 +17,9 @@ void machine_break();
 #define MACHINE_CALL_GET_MEMORY_SIZE (-2U)
 #define MACHINE_CALL_EXIT (-1U)
 
+// Values MACHINE_CALL_GET_SCREEN_FORMAT returns
+#define MACHINE_SCREEN_RGBA8888 0
+#define MACHINE_SCREEN_XRGB8888 1
+#define MACHINE_SCREEN_RGB565 2
+
 #endif
\ No newline at end of file
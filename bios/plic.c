@@ -0,0 +1,26 @@
+#include "plic.h"
+
+static volatile uint32_t* plic_reg(uint32_t offset) {
+    return (volatile uint32_t*)(PLIC_BASE + offset);
+}
+
+uint32_t plic_context(void) {
+    uint32_t hart;
+    __asm__ volatile("csrr %0, mhartid" : "=r"(hart));
+    return hart * 2;
+}
+
+void plic_enable(uint32_t source, uint32_t priority) {
+    uint32_t context = plic_context();
+
+    *plic_reg(PLIC_PRIORITY + source * 4) = priority;
+    *plic_reg(PLIC_ENABLE + context * PLIC_ENABLE_STRIDE + source / 32 * 4) |= 1U << (source % 32);
+}
+
+uint32_t plic_claim(void) {
+    return *plic_reg(PLIC_CONTEXT + plic_context() * PLIC_CONTEXT_STRIDE + PLIC_CLAIM);
+}
+
+void plic_complete(uint32_t source) {
+    *plic_reg(PLIC_CONTEXT + plic_context() * PLIC_CONTEXT_STRIDE + PLIC_CLAIM) = source;
+}
@@ -0,0 +1,32 @@
+#ifndef PLIC_H
+#define PLIC_H
+
+#include <stdint.h>
+
+#define PLIC_BASE 0xc000000
+
+#define PLIC_PRIORITY 0x0
+#define PLIC_PENDING 0x1000
+#define PLIC_ENABLE 0x2000
+#define PLIC_ENABLE_STRIDE 0x80
+#define PLIC_CONTEXT 0x200000
+#define PLIC_CONTEXT_STRIDE 0x1000
+#define PLIC_THRESHOLD 0x0
+#define PLIC_CLAIM 0x4
+
+#define PLIC_SOURCE_DMA 1
+#define PLIC_SOURCE_BLOCK 2
+#define PLIC_SOURCE_INPUT 3
+
+// The calling hart's machine context
+uint32_t plic_context(void);
+
+// Routes the source to the calling hart's machine external interrupt
+void plic_enable(uint32_t source, uint32_t priority);
+
+// The source to handle next, 0 when there's none, and the write that
+// lets it interrupt again
+uint32_t plic_claim(void);
+void plic_complete(uint32_t source);
+
+#endif
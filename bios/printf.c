@@ -1,6 +1,6 @@
 #include "printf.h"
 
-#include "machine.h"
+#include "console.h"
 
 #include <stdbool.h>
 #include <stdarg.h>
@@ -9,7 +9,7 @@
 void debug_trace(const char* str) {
     size_t size = 0;
     while (str[size]) size++;
-    machine_call(MACHINE_CALL_COUT, str, size);
+    console_write(str, size);
 }
 
 int putc(char c) {
@@ -35,7 +35,7 @@ int putc(char c) {
     }
     
     if (flush) {
-        machine_call(MACHINE_CALL_COUT, buffer, index);
+        console_write(buffer, index);
         index = 0;
     }
 
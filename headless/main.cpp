@@ -0,0 +1,705 @@
+#include <VirtualMachine.hpp>
+#include <Memory.hpp>
+#include <CLINT.hpp>
+#include <DMA.hpp>
+#include <PLIC.hpp>
+#include <BlockDevice.hpp>
+#include <NetDevice.hpp>
+#include <ConsoleDevice.hpp>
+#include <InputDevice.hpp>
+#include <BalloonDevice.hpp>
+#include <DeviceTree.hpp>
+#include <ELF.hpp>
+#include <HartScheduler.hpp>
+#include <NUMA.hpp>
+#include <LockstepScheduler.hpp>
+#include <Snapshot.hpp>
+#include <Watchdog.hpp>
+#include <RV64.hpp>
+
+#include <array>
+#include <charconv>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <cstdlib>
+#include <mutex>
+#include <algorithm>
+
+#include "Console.hpp"
+#include "ECalls.hpp"
+#include "ArgsParser.hpp"
+#include "MachineArgs.hpp"
+#include "Screen.hpp"
+#include "FrameServer.hpp"
+#include "NetSocket.hpp"
+#include "VirtualMachines.hpp"
+
+// --net=tap:<name> joins a host TAP interface. --net=listen:<port> waits
+// for a peer to carry frames over TCP and --net=connect:<host>:<port> is one
+static std::shared_ptr<MemoryNetDevice::Backend> OpenNetBackend(IOLoop& loop, const std::string& spec) {
+    auto colon = spec.find(':');
+    auto kind = spec.substr(0, colon);
+    auto rest = colon == std::string::npos ? std::string() : spec.substr(colon + 1);
+
+    auto Port = [&](std::string_view text) {
+        uint16_t port = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), port);
+        if (error != std::errc() || end != text.data() + text.size() || port == 0)
+            throw std::runtime_error(std::format("Bad port in --net={}", spec));
+
+        return port;
+    };
+
+    if (kind == "tap" && !rest.empty())
+        return MemoryNetDevice::CreateTAP(rest);
+
+    if (kind == "listen")
+        return NetSocketBackend::Listen(loop, Port(rest));
+
+    if (kind == "connect") {
+        auto last = rest.rfind(':');
+        if (last != std::string::npos && last != 0)
+            return NetSocketBackend::Connect(loop, rest.substr(0, last), Port(std::string_view(rest).substr(last + 1)));
+    }
+
+    throw std::runtime_error(std::format("--net takes tap:<name>, listen:<port> or connect:<host>:<port>, not {}", spec));
+}
+
+// Prints one line per word of [address, address + bytes), disassembled a
+// page at a time into reused buffers
+static void DumpDisassembly(Memory& memory, Address address, Address bytes) {
+    constexpr Address WORDS = Memory::PAGE_SIZE / sizeof(Word);
+
+    std::array<Word, WORDS> words;
+    std::array<RVInstruction::Disassembly, WORDS> lines;
+    std::string text;
+
+    for (Address at = address & ~3ULL; at < address + bytes; at += WORDS * sizeof(Word)) {
+        Address count = std::min<Address>(WORDS, (address + bytes - at + 3) / sizeof(Word));
+        auto ranges = memory.Peek(at, std::span<Word>(words.data(), count));
+        RVInstruction::Disassemble(std::span<const Word>(words.data(), count), std::span(lines.data(), count));
+
+        text.clear();
+        for (Address i = 0; i < count; i++) {
+            char digits[16];
+            auto end = std::to_chars(digits, digits + sizeof(digits), at + i * sizeof(Word), 16).ptr;
+
+            text.append(16 - (end - digits), '0');
+            text.append(digits, end);
+            text += ": ";
+
+            if (Memory::IsInRanges(ranges, at + i * sizeof(Word), sizeof(Word)))
+                text += lines[i].data();
+            else
+                text += "unmapped";
+
+            text += '\n';
+        }
+
+        std::cout << text;
+    }
+}
+
+// Runs a binary to completion without a window or GL context. Guest output
+// goes to stdout and run stats to stderr
+int main(int argc, const char** argv) {
+    framebuffer_width = 800;
+    framebuffer_height = 600;
+    framebuffer_address = 0xffe00000;
+
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; i++) {
+        args.push_back(argv[i]);
+    }
+
+    ArgsParser args_parser(args);
+
+    Hart cores = args_parser.GetValueOr<Hart>("cores", 1);
+    if (cores == 0) cores = 1;
+
+    if (!ParseScreenArgs(args_parser)) {
+        std::cerr << "--screen_format must be rgba8888, xrgb8888 or rgb565" << std::endl;
+        return -1;
+    }
+
+    std::string machine_error;
+    if (!ParseMachineArgs(args_parser, machine_error)) {
+        std::cerr << machine_error << std::endl;
+        return -1;
+    }
+
+    if (!args_parser.HasValue("bios_file") && !args_parser.HasValue("restore")) {
+        std::cerr << "--bios_file or --restore is required" << std::endl;
+        return -1;
+    }
+
+    auto bios_path = args_parser.GetValue<std::string>("bios_file");
+    auto timeout = args_parser.GetValueOr<Long>("timeout", 0);
+
+    // --guests runs that many copies of the machine in one process, their
+    // harts sharing one pool of threads. Every guest boots from the same RAM
+    // image, so its pages stay shared until a guest writes to them
+    size_t guest_count = std::max<size_t>(args_parser.GetValueOr<size_t>("guests", 1), 1);
+
+    if (guest_count > 1) {
+        for (auto name : {"snapshot", "restore", "disk", "net", "numa_nodes"}) {
+            if (args_parser.HasValue(name)) {
+                std::cerr << std::format("--{} only works with one guest", name) << std::endl;
+                return -1;
+            }
+        }
+
+        if (args_parser.HasFlag("lockstep") || args_parser.HasValue("lockstep")) {
+            std::cerr << "--lockstep only works with one guest" << std::endl;
+            return -1;
+        }
+
+        // Mapped RAM can't be cloned copy on write
+        if (ram_backing != RAMBacking::Paged) {
+            std::cerr << "--guests needs --ram_backing=paged" << std::endl;
+            return -1;
+        }
+    }
+
+    RegisterECalls();
+
+    std::atomic<bool> finished = false;
+    std::atomic<int> exit_code = EXIT_SUCCESS;
+
+    auto Finish = [&](int code) {
+        exit_code = code;
+        finished = true;
+
+        for (auto& vm : vms)
+            vm->Stop();
+    };
+
+    // Which guest each entry of vms belongs to
+    std::vector<Memory*> guests;
+    std::vector<size_t> hart_guests;
+    std::vector<bool> guests_exited(guest_count, false);
+    size_t running_guests = guest_count;
+    std::mutex exit_lock;
+
+    // An exit only stops the guest that made it. The run ends with the last
+    // guest, with the first failure any of them gave
+    SetExitHandler([&](Memory& guest_memory, int code) {
+        if (guest_count == 1) return Finish(code);
+
+        std::lock_guard guard(exit_lock);
+
+        auto guest = static_cast<size_t>(std::find(guests.begin(), guests.end(), &guest_memory) - guests.begin());
+        if (guest == guests.size() || guests_exited[guest]) return;
+
+        guests_exited[guest] = true;
+        std::cerr << std::format("guest={} exit_code={}", guest, code) << std::endl;
+
+        for (size_t i = 0; i < vms.size(); i++) {
+            if (hart_guests[i] == guest) vms[i]->Stop();
+        }
+
+        if (code != EXIT_SUCCESS && exit_code == EXIT_SUCCESS) exit_code = code;
+        if (--running_guests == 0) finished = true;
+    });
+
+    // --snapshot saves the machine when the guest calls ecall_snapshot and
+    // ends the run. --restore starts from such a snapshot instead of booting
+    std::atomic<bool> snapshot_requested = false;
+
+    if (args_parser.HasValue("snapshot")) {
+        SetSnapshotHandler([&](Hart) {
+            snapshot_requested = true;
+            Finish(EXIT_SUCCESS);
+        });
+    }
+
+    constexpr Address BIOS_RAM_ADDRESS = 0x1000;
+    Address ram_size = args_parser.GetValueOr<Address>("ram_size", 16) * 1024 * 1024;
+
+    // ELF images have their read only segments mapped ahead of the RAM, so
+    // those pages are served from the file instead of copied
+    std::unique_ptr<ELFImage> elf;
+    if (!args_parser.HasValue("restore") && ELFImage::IsELF(bios_path)) {
+        try {
+            elf = ELFImage::Open(bios_path);
+        }
+        catch (const std::runtime_error& error) {
+            std::cerr << error.what() << std::endl;
+            return -1;
+        }
+    }
+
+    // Network servers and the card's sockets share its thread. It outlives
+    // the memory, so the card lets go of its backend first
+    IOLoop io_loop;
+
+    Memory memory;
+    if (elf)
+        elf->MapReadOnlySegments(memory);
+
+    // --numa_nodes splits the RAM into that many guest nodes, each one bound
+    // to a host node, and gives each node an even share of the harts
+    Word numa_nodes = args_parser.GetValueOr<Word>("numa_nodes", 0);
+    Word host_nodes = NUMA::GetNodeCount();
+
+    auto HostNode = [&](Hart hart) { return static_cast<Word>(hart * numa_nodes / cores) % host_nodes; };
+
+    if (numa_nodes != 0) {
+        Address node_size = (ram_size / numa_nodes) & ~(Memory::PAGE_SIZE - 1);
+
+        for (Word node = 0; node < numa_nodes; node++) {
+            Address size = node + 1 == numa_nodes ? ram_size - node * node_size : node_size;
+
+            try {
+                auto ram = CreateRAM(BIOS_RAM_ADDRESS + node * node_size, size, node % host_nodes);
+                ram->node = node;
+                memory.AddMemoryRegion(std::move(ram));
+            }
+            catch (const std::runtime_error& error) {
+                std::cerr << error.what() << std::endl;
+                return -1;
+            }
+        }
+
+        for (Hart i = 0; i < cores; i++)
+            memory.SetHartNode(i, i * numa_nodes / cores);
+    }
+
+    else
+        memory.AddMemoryRegion(CreateRAM(BIOS_RAM_ADDRESS, ram_size));
+
+    if (args_parser.HasFlag("prefault"))
+        memory.Prefault(BIOS_RAM_ADDRESS, ram_size);
+
+    Address bios_bytes = 0;
+    if (elf)
+        elf->LoadSegments(memory);
+    else if (!args_parser.HasValue("restore"))
+        bios_bytes = memory.ReadFileInto(bios_path, BIOS_RAM_ADDRESS);
+
+    // --disassemble prints the image's code instead of running it
+    if (args_parser.HasFlag("disassemble")) {
+        if (elf) {
+            for (const auto& segment : elf->GetSegments()) {
+                if (segment.executable)
+                    DumpDisassembly(memory, segment.address, segment.file_bytes);
+            }
+        }
+        else
+            DumpDisassembly(memory, BIOS_RAM_ADDRESS, bios_bytes);
+
+        return 0;
+    }
+
+    Address entry = elf ? elf->GetEntry() : BIOS_RAM_ADDRESS;
+
+    // The other guests are cloned before any device is mapped, so each one
+    // gets devices of its own below
+    std::vector<std::unique_ptr<Memory>> clones;
+    guests.push_back(&memory);
+
+    for (size_t i = 1; i < guest_count; i++) {
+        clones.push_back(memory.Clone());
+        guests.push_back(clones.back().get());
+    }
+
+    // Names a per guest output file after path, unchanged with one guest
+    auto GuestPath = [&](const std::string& path, size_t guest) {
+        return guest_count == 1 ? path : std::format("{}.{}", path, guest);
+    };
+
+    std::vector<std::shared_ptr<MemoryConsole>> consoles;
+    std::vector<std::shared_ptr<MemoryBalloon>> balloons;
+    std::vector<std::shared_ptr<std::ofstream>> console_files;
+
+    // Remote viewers type and click into the first guest
+    std::shared_ptr<MemoryInputDevice> input;
+
+    for (size_t guest = 0; guest < guests.size(); guest++) {
+        Memory& guest_memory = *guests[guest];
+
+        // Guests that draw still get memory behind the screen, it's just never shown
+        auto framebuffer = MemoryRAM::Create(framebuffer_address, GetFramebufferBytes());
+        guest_memory.AddMemoryRegion(std::move(framebuffer));
+
+        if (guest == 0 && args_parser.HasValue("frame_server")) {
+            input = MemoryInputDevice::Create();
+            guest_memory.AddMemoryRegion(input);
+        }
+
+        auto clint = MemoryCLINT::Create();
+        if (args_parser.HasFlag("instruction_time"))
+            clint->SetClockSource(MemoryCLINT::ClockSource::Instructions);
+
+        guest_memory.AddMemoryRegion(clint);
+
+        guest_memory.AddMemoryRegion(MemoryPLIC::Create());
+        guest_memory.AddMemoryRegion(MemoryDMA::Create());
+
+        // The console ring drains to --console_file when given, stdout otherwise
+        std::shared_ptr<std::ofstream> console_file;
+        if (args_parser.HasValue("console_file")) {
+            auto path = GuestPath(args_parser.GetValue<std::string>("console_file"), guest);
+
+            console_file = std::make_shared<std::ofstream>(path, std::ios::binary);
+            if (!*console_file) {
+                std::cerr << "Could not open " << path << std::endl;
+                return -1;
+            }
+        }
+
+        auto console = MemoryConsole::Create([console_file](std::string_view text) {
+            if (console_file) console_file->write(text.data(), text.size());
+            else GetConsole().Write(text);
+        });
+
+        // Only the first guest reads stdin
+        if (guest == 0)
+            console->SetInputSource([](std::string& line) { return static_cast<bool>(std::getline(std::cin, line)); });
+
+        guest_memory.AddMemoryRegion(console);
+
+        consoles.push_back(console);
+        console_files.push_back(console_file);
+
+        // --balloon_target asks each guest to give back that many MiB
+        auto balloon = MemoryBalloon::Create();
+        guest_memory.AddMemoryRegion(balloon);
+        balloon->SetTarget(args_parser.GetValueOr<Long>("balloon_target", 0) * 1024 * 1024);
+
+        balloons.push_back(balloon);
+    }
+
+    // The disk's I/O threads and the card's backend access guest RAM a word
+    // at a time while harts are held, outside the bulk copies a pass waits for
+    if ((args_parser.HasValue("disk") || args_parser.HasValue("net")) && (args_parser.HasValue("reclaim_interval") || args_parser.HasValue("compress_high"))) {
+        std::cerr << "--reclaim_interval and --compress_high don't work with --disk or --net" << std::endl;
+        return -1;
+    }
+
+    if (args_parser.HasValue("disk")) {
+
+        try {
+            memory.AddMemoryRegion(MemoryBlockDevice::Create(args_parser.GetValue<std::string>("disk"), args_parser.HasFlag("disk_read_only")));
+        }
+        catch (const std::runtime_error& error) {
+            std::cerr << error.what() << std::endl;
+            return -1;
+        }
+    }
+
+    if (args_parser.HasValue("net")) {
+        // Mapped before the backend starts, so frames can land from the first
+        auto net = MemoryNetDevice::Create();
+        memory.AddMemoryRegion(net);
+
+        try {
+            net->SetBackend(OpenNetBackend(io_loop, args_parser.GetValue<std::string>("net")));
+        }
+        catch (const std::runtime_error& error) {
+            std::cerr << error.what() << std::endl;
+            return -1;
+        }
+    }
+
+    // Describes everything mapped above, so it goes in last. Harts boot
+    // with it in a1
+    DeviceTree::Options device_tree;
+    device_tree.harts = cores;
+    device_tree.bootargs = args_parser.GetValueOr<std::string>("bootargs", "");
+    device_tree.framebuffer = DescribeFramebuffer();
+
+    for (auto guest : guests)
+        guest->AddMemoryRegion(DeviceTree::CreateROM(*guest, device_tree));
+
+    for (size_t guest = 0; guest < guests.size(); guest++)
+    for (Hart i = 0; i < cores; i++) {
+        auto vm = std::make_shared<VirtualMachine>(*guests[guest], entry, i);
+        vm->SetDeviceTree(DeviceTree::DEFAULT_BASE);
+
+        ApplyEngine(*vm);
+
+        if (args_parser.HasFlag("precise_fp"))
+            vm->SetPreciseFloatFlags(true);
+
+        if (args_parser.HasFlag("trap_misaligned"))
+            vm->SetTrapMisaligned(true);
+
+        if (args_parser.HasValue("profile") || args_parser.HasValue("autofdo"))
+            vm->SetProfiling(true);
+
+        if (args_parser.HasValue("trace"))
+            vm->SetTracing(true);
+
+        // One trace per hart, named after the --instruction_trace path
+        if (args_parser.HasValue("instruction_trace"))
+            vm->StartInstructionTrace(std::format("{}.{}", GuestPath(args_parser.GetValue<std::string>("instruction_trace"), guest), i));
+
+        // Other harts wait for ecall_start_cpu like they do in the GUI
+        if (i != 0)
+            vm->Pause();
+
+        vm->Start();
+        vms.push_back(vm);
+        hart_guests.push_back(guest);
+    }
+
+    std::vector<VirtualMachine*> harts;
+    for (auto& vm : vms)
+        harts.push_back(vm.get());
+
+    // Harts were stopped when the snapshot was saved
+    if (args_parser.HasValue("restore")) {
+        Snapshot::Restore(args_parser.GetValue<std::string>("restore"), memory, harts);
+
+        for (auto& vm : vms)
+            vm->Start();
+    }
+
+    // --max_instructions ends the run as soon as any hart has retired that
+    // many instructions
+    if (args_parser.HasValue("max_instructions")) {
+        for (auto& vm : vms) {
+            vm->SetInstructionBudget(args_parser.GetValue<Long>("max_instructions"));
+            vm->SetBudgetHandler([&](VirtualMachine& hart, VirtualMachine::Budget) {
+                std::cerr << std::format("Hart {} ran out of instructions", hart.GetHartID()) << std::endl;
+                Finish(EXIT_FAILURE);
+            });
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // --timeout stops the harts from a thread of its own, so harts asleep or
+    // parked by a scheduler stop too
+    std::unique_ptr<Watchdog> watchdog;
+    if (timeout != 0) {
+        watchdog = std::make_unique<Watchdog>(harts, std::chrono::seconds(timeout), [&]() {
+            std::cerr << std::format("Timed out after {} seconds", timeout) << std::endl;
+            Finish(EXIT_FAILURE);
+        });
+    }
+
+    // --reclaim_interval frees the RAM pages the guests have zeroed every
+    // that many seconds. With --compress_high=<MiB> a guest using more than
+    // that also packs the pages it hasn't touched since the last pass, down
+    // to --compress_low=<MiB>. Harts are held while the pages are scanned,
+    // and the console, capture and frame server wait for it
+    auto compress_high = args_parser.GetValueOr<Long>("compress_high", 0) * 1024 * 1024;
+    auto compress_low = args_parser.GetValueOr<Long>("compress_low", compress_high / 2 / 1024 / 1024) * 1024 * 1024;
+
+    for (auto guest : guests)
+        guest->SetCompressionThresholds(compress_high, compress_low);
+
+    // Compression needs passes to tell cold pages from hot ones
+    auto reclaim_interval = std::chrono::seconds(args_parser.GetValueOr<Long>("reclaim_interval", compress_high != 0 ? 1 : 0));
+    auto last_reclaim = start;
+    Address reclaimed = 0;
+    Address compressed = 0;
+
+    // A hart that doesn't park in time just skips this pass
+    auto ReclaimPages = [&]() {
+        WithHartsHeld(std::chrono::seconds(1), [&]() {
+            for (auto guest : guests) {
+                reclaimed += guest->ReclaimZeroPages();
+
+                if (compress_high != 0)
+                    compressed += guest->CompressColdPages();
+            }
+        });
+    };
+
+    // Frames come from the first guest
+    auto capture = StartCapture(args_parser, memory);
+
+    // --frame_server=<port> streams the first guest's screen to viewers
+    std::unique_ptr<FrameServer> frame_server;
+    if (args_parser.HasValue("frame_server")) {
+        frame_server = std::make_unique<FrameServer>(io_loop, memory, input, framebuffer_address, framebuffer_width, framebuffer_height, GetPixelSize(framebuffer_format));
+        frame_server->Start(args_parser.GetValue<Word>("frame_server"));
+    }
+
+    std::vector<std::jthread> workers;
+    std::unique_ptr<HartScheduler> scheduler;
+    std::unique_ptr<LockstepScheduler> lockstep;
+
+    auto OnHartError = [&](VirtualMachine& vm, const std::exception& e) {
+        std::cerr << std::format("Hart {} stopped: {}", vm.GetHartID(), e.what()) << std::endl;
+        Finish(EXIT_FAILURE);
+    };
+
+    // --lockstep runs the harts round robin on one thread, --lockstep=epochs
+    // runs them in parallel between barriers. Both repeat for a given --seed
+    if (args_parser.HasFlag("lockstep") || args_parser.HasValue("lockstep")) {
+        LockstepScheduler::Options options;
+        if (args_parser.GetValue<std::string>("lockstep") == "epochs")
+            options.mode = LockstepScheduler::Mode::Epochs;
+
+        options.quantum = args_parser.GetValueOr<Long>("quantum", options.quantum);
+        options.seed = args_parser.GetValueOr<Long>("seed", options.seed);
+        options.threads = args_parser.GetValueOr<size_t>("threads", 0);
+
+        lockstep = std::make_unique<LockstepScheduler>(memory, harts, options, OnHartError);
+        lockstep->Start();
+    }
+
+    // --threads shares a fixed pool between the harts instead of giving
+    // each one its own thread. Several guests always share one
+    else if (args_parser.HasValue("threads") || guest_count > 1) {
+        HartScheduler::Options options;
+        options.threads = args_parser.GetValueOr<size_t>("threads", 0);
+        options.quantum = args_parser.GetValueOr<Long>("quantum", options.quantum);
+        options.pin_threads = args_parser.HasFlag("pin_threads");
+        options.park_idle = !args_parser.HasFlag("no_park");
+
+        scheduler = std::make_unique<HartScheduler>(harts, options, OnHartError);
+
+        scheduler->Start();
+    }
+
+    else {
+        for (size_t i = 0; i < vms.size(); i++) {
+            workers.emplace_back([&, i]() {
+                if (numa_nodes != 0) NUMA::PinThread(HostNode(i));
+
+                try {
+                    vms[i]->Run();
+                }
+                catch (const std::exception& e) {
+                    std::cerr << std::format("Hart {} stopped: {}", i, e.what()) << std::endl;
+                    Finish(EXIT_FAILURE);
+                }
+            });
+        }
+    }
+
+    while (!finished) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        if (reclaim_interval.count() != 0 && std::chrono::steady_clock::now() - last_reclaim >= reclaim_interval) {
+            ReclaimPages();
+            last_reclaim = std::chrono::steady_clock::now();
+        }
+    }
+
+    watchdog.reset();
+    workers.clear();
+    scheduler.reset();
+    lockstep.reset();
+    frame_server.reset();
+
+    // Guest output ends before the stats
+    for (size_t guest = 0; guest < guests.size(); guest++) {
+        consoles[guest]->Flush();
+        if (console_files[guest]) console_files[guest]->flush();
+    }
+
+    GetConsole().Flush();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Long cycles = 0;
+    for (size_t i = 0; i < vms.size(); i++) {
+        auto& vm = vms[i];
+        auto guest = guest_count == 1 ? std::string() : std::format("guest={} ", hart_guests[i]);
+
+        std::cerr << std::format("{}hart={} cycles={} jit_coverage={:.3f} indirect_hits={:.3f}", guest, vm->GetHartID(), vm->GetCycles(), vm->GetJITCoverage(), vm->GetIndirectHitRate()) << std::endl;
+        cycles += vm->GetCycles();
+    }
+
+    // Only pages a guest has made its own, the shared image isn't counted
+    Address memory_used = 0;
+    for (auto guest : guests)
+        memory_used += guest->GetUsedMemory();
+
+    std::cerr << std::format("exit_code={} seconds={:.3f} cycles={} mips={:.2f} memory_used={}",
+        exit_code.load(), seconds, cycles, cycles / seconds / 1000000.0, memory_used) << std::endl;
+
+    Long ballooned = 0;
+    for (auto& balloon : balloons)
+        ballooned += balloon->GetFreed();
+
+    if (reclaimed != 0 || ballooned != 0)
+        std::cerr << std::format("reclaimed={} ballooned={}", reclaimed, ballooned) << std::endl;
+
+    if (compress_high != 0) {
+        CompressionStats stats;
+        for (auto guest : guests) {
+            auto guest_stats = guest->GetCompressionStats();
+            stats.pages += guest_stats.pages;
+            stats.packed_bytes += guest_stats.packed_bytes;
+            stats.unpacked += guest_stats.unpacked;
+        }
+
+        std::cerr << std::format("compressed={} packed_pages={} packed_bytes={} unpacked={}", compressed, stats.pages, stats.packed_bytes, stats.unpacked) << std::endl;
+    }
+
+    if (capture) {
+        capture->Stop();
+
+        if (args_parser.HasValue("capture_hashes"))
+            capture->WriteHashes(args_parser.GetValue<std::string>("capture_hashes"));
+
+        std::cerr << std::format("frames={} dropped_frames={}", capture->GetFrames().size(), capture->GetDropped()) << std::endl;
+    }
+
+    // One dump per hart, named after the --profile path
+    if (args_parser.HasValue("profile")) {
+        auto profile_path = args_parser.GetValue<std::string>("profile");
+
+        for (size_t i = 0; i < vms.size(); i++)
+            vms[i]->WriteProfile(std::format("{}.{}", GuestPath(profile_path, hart_guests[i]), vms[i]->GetHartID()), elf ? elf->GetSymbols().get() : nullptr);
+    }
+
+    // One per guest with its harts summed, as they all run the same binary
+    if (args_parser.HasValue("autofdo")) {
+        auto autofdo_path = args_parser.GetValue<std::string>("autofdo");
+
+        for (size_t guest = 0; guest < guest_count; guest++) {
+            std::vector<Profiler::Profile> profiles;
+            for (size_t i = 0; i < vms.size(); i++) {
+                if (hart_guests[i] == guest) profiles.push_back(vms[i]->GetProfile());
+            }
+
+            Profiler::WriteAutoFDO(GuestPath(autofdo_path, guest), profiles, elf ? elf->GetSymbols().get() : nullptr);
+        }
+    }
+
+    // Each guest's RAM as a sparse raw image, to look at a crashed guest later
+    if (args_parser.HasValue("ram_dump")) {
+        FileTransferOptions options;
+        options.direct_io = args_parser.HasFlag("direct_io");
+
+        for (size_t guest = 0; guest < guest_count; guest++)
+            guests[guest]->WriteToFile(GuestPath(args_parser.GetValue<std::string>("ram_dump"), guest), BIOS_RAM_ADDRESS, ram_size, options);
+    }
+
+    for (auto& vm : vms)
+        vm->StopInstructionTrace();
+
+    // All harts share one timeline file
+    if (args_parser.HasValue("trace")) {
+        std::vector<const Tracer*> tracers;
+        for (auto& vm : vms)
+            tracers.push_back(&vm->GetTracer());
+
+        Tracer::WriteChromeTrace(args_parser.GetValue<std::string>("trace"), tracers);
+    }
+
+    if (snapshot_requested)
+        Snapshot::Save(args_parser.GetValue<std::string>("snapshot"), memory, harts);
+
+    vms.clear();
+
+    return exit_code;
+}
@@ -0,0 +1,65 @@
+#ifndef BALLOON_DEVICE_HPP
+#define BALLOON_DEVICE_HPP
+
+#include "Memory.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// Lets the guest hand RAM it isn't using back to the host. The host sets
+// a target number of bytes it would like back. The guest gives ranges up
+// by writing their start to ADDRESS and their length to INFLATE, and
+// takes bytes back by writing their length to DEFLATE before it uses
+// them again, where they read as zero. The PLIC source stays raised while
+// RELEASED is short of or past TARGET
+class MemoryBalloon : public MemoryRegion {
+public:
+    static constexpr Address DEFAULT_BASE = 0x2014000;
+    static constexpr Address SIZE = 0x1000;
+
+    static constexpr Address TARGET_OFFSET = 0x00;
+    // Bytes the guest has given up and not taken back
+    static constexpr Address RELEASED_OFFSET = 0x08;
+    static constexpr Address ADDRESS_OFFSET = 0x10;
+    static constexpr Address INFLATE_OFFSET = 0x18;
+    static constexpr Address DEFLATE_OFFSET = 0x20;
+
+private:
+    std::atomic<Long> target = 0;
+    std::atomic<Long> released = 0;
+    std::atomic<Long> address = 0;
+
+    // Host memory actually freed, which only counts pages that were there
+    std::atomic<Long> freed = 0;
+
+    // Harts inflating at once don't mix up each other's ADDRESS
+    std::mutex inflate_lock;
+
+    mutable std::mutex lock;
+
+    MemoryBalloon(Address base);
+
+    void UpdateInterrupt();
+
+public:
+    Long ReadLong(Address address) const override;
+    Word ReadWord(Address address) const override;
+
+    void WriteLong(Address address, Long vlong) override;
+    void WriteWord(Address address, Word word) override;
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    Long SizeInMemory() const override { return sizeof(MemoryBalloon); }
+
+    void SetTarget(Long bytes);
+
+    inline Long GetReleased() const { return released.load(); }
+    inline Long GetFreed() const { return freed.load(); }
+
+    static std::shared_ptr<MemoryBalloon> Create(Address base = DEFAULT_BASE);
+};
+
+#endif
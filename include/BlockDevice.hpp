@@ -0,0 +1,131 @@
+#ifndef BLOCK_DEVICE_HPP
+#define BLOCK_DEVICE_HPP
+
+#include "Memory.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Disk backed by a host file. The guest keeps a ring of descriptors in its
+// own memory and rings SUBMIT with how many it has queued so far, as a free
+// running count. Every new descriptor is picked up at once and handed to a
+// pool of I/O threads, which move data straight between the file and guest
+// pages. Each descriptor gets its status written back as it finishes and
+// COMPLETED counts them, and the interrupt is raised once the whole batch
+// has drained rather than per request
+class MemoryBlockDevice : public MemoryRegion {
+public:
+    static constexpr Address DEFAULT_BASE = 0x2011000;
+    static constexpr Address SIZE = 0x1000;
+
+    static constexpr Address SECTOR_SIZE = 512;
+
+    static constexpr Address RING_ADDRESS_OFFSET = 0x00;
+    static constexpr Address RING_SIZE_OFFSET = 0x08;
+    static constexpr Address SUBMIT_OFFSET = 0x10;
+    static constexpr Address COMPLETED_OFFSET = 0x18;
+    static constexpr Address CAPACITY_OFFSET = 0x20;
+    static constexpr Address INTERRUPT_HART_OFFSET = 0x28;
+    // Reads 1 while the interrupt is raised. Any write clears it
+    static constexpr Address INTERRUPT_OFFSET = 0x30;
+
+    // Descriptor layout in guest memory
+    static constexpr Address DESCRIPTOR_SIZE = 32;
+    static constexpr Address DESCRIPTOR_OP = 0;
+    static constexpr Address DESCRIPTOR_STATUS = 4;
+    static constexpr Address DESCRIPTOR_SECTOR = 8;
+    static constexpr Address DESCRIPTOR_BUFFER = 16;
+    static constexpr Address DESCRIPTOR_LENGTH = 24;
+
+    static constexpr Word OP_READ = 0;
+    static constexpr Word OP_WRITE = 1;
+    static constexpr Word OP_FLUSH = 2;
+
+    // The guest clears status before submitting, the device sets the rest
+    static constexpr Word STATUS_PENDING = 0;
+    static constexpr Word STATUS_OK = 1;
+    static constexpr Word STATUS_ERROR = 2;
+
+    static constexpr size_t DEFAULT_THREADS = 4;
+
+private:
+    struct Request {
+        Address descriptor;
+        Word op;
+        Long sector;
+        Address buffer;
+        Word length;
+    };
+
+    static constexpr size_t REGISTER_COUNT = INTERRUPT_OFFSET / sizeof(Long) + 1;
+
+    std::array<std::atomic<Long>, REGISTER_COUNT> registers{};
+
+    inline std::atomic<Long>& Register(Address offset) { return registers[offset / sizeof(Long)]; }
+
+    const bool read_only;
+
+    // Opened while capacity is worked out, so it comes first
+#if defined(_WIN32) || defined(_WIN64)
+    void* file = nullptr;
+#else
+    int file = -1;
+#endif
+
+    const Long capacity;
+
+    // Descriptors already handed out, as a count like SUBMIT
+    Long consumed = 0;
+    std::mutex submit_lock;
+
+    std::mutex queue_lock;
+    std::condition_variable queue_signal;
+    std::deque<Request> queue;
+    size_t in_flight = 0;
+    bool stopping = false;
+
+    std::vector<std::thread> threads;
+
+    mutable std::mutex lock;
+
+    MemoryBlockDevice(Address base, const std::string& path, bool read_only, size_t threads);
+
+    void Submit(Long count);
+    void Work();
+    bool Execute(const Request& request);
+
+    // Positional I/O on the backing file, true when every byte moved
+    bool ReadAt(Byte* bytes, Address count, Long offset);
+    bool WriteAt(const Byte* bytes, Address count, Long offset);
+    bool Flush();
+
+    void SetInterrupt(bool pending);
+
+public:
+    // Waits for requests already submitted, so the Memory must still be alive
+    ~MemoryBlockDevice();
+
+    Long ReadLong(Address address) const override;
+    Word ReadWord(Address address) const override;
+
+    void WriteLong(Address address, Long vlong) override;
+    void WriteWord(Address address, Word word) override;
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    Long SizeInMemory() const override { return sizeof(MemoryBlockDevice); }
+
+    inline Long GetCapacity() const { return capacity; }
+
+    static std::shared_ptr<MemoryBlockDevice> Create(const std::string& path, bool read_only = false, Address base = DEFAULT_BASE, size_t threads = DEFAULT_THREADS);
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef CLINT_HPP
+#define CLINT_HPP
+
+#include "Memory.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+class VirtualMachine;
+
+// CLINT style mtime/mtimecmp/msip block shared by every hart. Time comes
+// from one monotonic clock, either the host's or the count of retired
+// instructions for reproducible runs. Past mtime each hart also has a
+// start mailbox: storing an address there resets the hart and starts it
+// there at its next block boundary
+class MemoryCLINT : public MemoryRegion {
+public:
+    static constexpr Address DEFAULT_BASE = 0x2000000;
+    static constexpr Address SIZE = 0x10000;
+
+    static constexpr Address MSIP_OFFSET = 0x0;
+    static constexpr Address MTIMECMP_OFFSET = 0x4000;
+    static constexpr Address MTIME_OFFSET = 0xbff8;
+    static constexpr Address START_OFFSET = 0xc000;
+
+    static constexpr Hart MAX_HARTS = 4095;
+    static constexpr Hart MAX_START_HARTS = (SIZE - START_OFFSET) / sizeof(Long);
+
+    static constexpr Long TICKS_PER_SECOND = 10000000;
+    static constexpr Long INSTRUCTIONS_PER_TICK = 10;
+
+    static constexpr Long NO_DEADLINE = -1ULL;
+
+    enum class ClockSource {
+        WallClock,
+        Instructions
+    };
+
+private:
+    static constexpr Long NANOSECONDS_PER_TICK = 1000000000 / TICKS_PER_SECOND;
+    static_assert(1000000000 % TICKS_PER_SECOND == 0);
+
+    struct HartSlot {
+        std::atomic<VirtualMachine*> vm = nullptr;
+        std::atomic<Word> msip = 0;
+        std::atomic<Long> mtimecmp = NO_DEADLINE;
+    };
+
+    const std::unique_ptr<HartSlot[]> harts;
+
+    std::atomic<ClockSource> clock_source = ClockSource::WallClock;
+    const std::chrono::steady_clock::time_point epoch;
+    std::atomic<Long> instructions = 0;
+    std::atomic<Long> deferred_instructions = 0;
+    std::atomic<bool> defer_retire = false;
+    std::atomic<Long> time_offset = 0;
+
+    mutable std::mutex lock;
+
+    Long GetClockTime() const;
+    void UpdateHart(Hart hart) const;
+    void StartHart(Hart hart, Address address) const;
+
+    MemoryCLINT(Address base);
+
+public:
+    Long ReadLong(Address address) const override;
+    Word ReadWord(Address address) const override;
+
+    void WriteLong(Address address, Long vlong) override;
+    void WriteWord(Address address, Word word) override;
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    Long SizeInMemory() const override { return sizeof(HartSlot) * MAX_HARTS; }
+
+    // Same clock, time and per hart registers, with no harts attached
+    std::shared_ptr<MemoryRegion> Clone() override;
+
+    void SetClockSource(ClockSource clock_source);
+    inline ClockSource GetClockSource() const { return clock_source; }
+
+    inline Long GetTime() const { return GetClockTime() + time_offset.load(std::memory_order_relaxed); }
+    void SetTime(Long time);
+
+    inline Long GetTimeCmp(Hart hart) const { return harts[hart].mtimecmp.load(std::memory_order_relaxed); }
+    void SetTimeCmp(Hart hart, Long time_cmp);
+
+    inline bool IsTimerPending(Hart hart) const {
+        auto time_cmp = GetTimeCmp(hart);
+        return time_cmp != NO_DEADLINE && GetTime() >= time_cmp;
+    }
+
+    inline bool IsSoftwarePending(Hart hart) const { return harts[hart].msip.load(std::memory_order_relaxed) & 1; }
+
+    // Counted time only moves when harts report the instructions they retired
+    inline void Retire(Long count) {
+        if (clock_source != ClockSource::Instructions) return;
+
+        if (defer_retire) deferred_instructions.fetch_add(count, std::memory_order_relaxed);
+        else instructions.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Holds retired instructions back until PublishRetired, so harts running
+    // in parallel all see time stand still between epoch barriers
+    void SetDeferRetire(bool defer_retire);
+    void PublishRetired();
+
+    Long InstructionsUntilDeadline(Hart hart) const;
+    std::chrono::steady_clock::duration TimeUntilDeadline(Hart hart) const;
+
+    // Jumps counted time forward to the hart's deadline. An idle hart would
+    // otherwise wait forever for time that only instructions advance
+    void SkipToDeadline(Hart hart);
+
+    // Lets other devices raise their interrupt lines on attached harts
+    void SetInterruptPending(Hart hart, Long cause, bool pending) const;
+
+    void AttachHart(Hart hart, VirtualMachine* vm);
+    void DetachHart(Hart hart, VirtualMachine* vm);
+
+    // The harts of the machine the CLINT belongs to, which is how host code
+    // shared between several machines tells their harts apart
+    inline VirtualMachine* GetHart(Hart hart) const { return hart < MAX_HARTS ? harts[hart].vm.load() : nullptr; }
+    Hart GetHartCount() const;
+
+    static std::shared_ptr<MemoryCLINT> Create(Address base = DEFAULT_BASE);
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef CO_SIMULATOR_HPP
+#define CO_SIMULATOR_HPP
+
+#include "VirtualMachine.hpp"
+#include "Memory.hpp"
+
+#include <memory>
+#include <optional>
+#include <string>
+
+// Runs a hart on its fast engine next to a copy of it on the reference
+// interpreter, each on its own clone of guest memory. After every interval
+// both have retired the same instructions and their states are compared by
+// hash, along with the RAM pages the reference wrote. A third copy trails
+// one interval behind on the reference interpreter, so a mismatch is
+// replayed from the last state both agreed on, an instruction at a time,
+// to find the first one that differs.
+//
+// Counted time is forced on so every copy sees the same clock. The hart
+// must not run anywhere else meanwhile, the guest can only use devices
+// that clone, and ecalls run once for every copy
+class CoSimulator {
+public:
+    struct Options {
+        // Instructions between comparisons
+        Long interval = 10000;
+    };
+
+    struct Divergence {
+        // Instructions retired since the co-simulation started, before the
+        // one that diverged
+        Long instruction = 0;
+        Long pc = 0;
+
+        // Read at pc as a physical address, like the assembly view. Zero
+        // when nothing is mapped there
+        Word encoding = 0;
+
+        // Which state differed and how, fast engine first
+        std::string difference;
+
+        // False when the replay never diverged, which happens when the fast
+        // engine only goes wrong running whole blocks. The mismatch is then
+        // somewhere in the interval after instruction
+        bool pinpointed = false;
+    };
+
+private:
+    VirtualMachine& fast;
+    Memory& memory;
+    const Options options;
+    const Long start_cycles;
+
+    // Memory comes first so it outlives the hart running on it
+    std::unique_ptr<Memory> reference_memory;
+    std::unique_ptr<VirtualMachine> reference;
+
+    std::unique_ptr<Memory> checkpoint_memory;
+    std::unique_ptr<VirtualMachine> checkpoint;
+
+    // Too large for the stack
+    std::unique_ptr<VirtualMachine::HartState> fast_state;
+    std::unique_ptr<VirtualMachine::HartState> reference_state;
+
+    Long checkpoints = 0;
+    std::optional<Divergence> divergence;
+
+    std::unique_ptr<VirtualMachine> CreateCopy(Memory& memory, const VirtualMachine& from, bool fast_engine) const;
+
+    static void RunTo(VirtualMachine& vm, Long cycles);
+    static Long HashState(const VirtualMachine::HartState& state);
+    static std::string Describe(const VirtualMachine::HartState& fast, const VirtualMachine::HartState& reference);
+
+    // The first RAM page the two memories disagree on, among the pages
+    // written in other since its dirty bits were last taken
+    static std::optional<Address> FindDifferentPage(Memory& memory, Memory& other);
+
+    // What differs between a fast and a reference copy, empty when they
+    // agree. Pages the reference stored to are compared, and with
+    // fast_stores the ones the fast copy stored to as well
+    std::string Compare(VirtualMachine& fast_copy, Memory& fast_memory, VirtualMachine& reference_copy, Memory& reference_copy_memory, bool fast_stores);
+
+    Divergence Pinpoint();
+
+public:
+    CoSimulator(VirtualMachine& fast, Memory& memory, const Options& options);
+    CoSimulator(const CoSimulator&) = delete;
+
+    CoSimulator& operator=(const CoSimulator&) = delete;
+
+    // Runs every copy up to instructions further, an interval at a time.
+    // Returns false once the copies have diverged, or the hart has stopped
+    // or can't go on, like in WFI with no deadline
+    bool Run(Long instructions);
+
+    inline const std::optional<Divergence>& GetDivergence() const { return divergence; }
+    inline Long GetCheckpoints() const { return checkpoints; }
+};
+
+#endif
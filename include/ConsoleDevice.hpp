@@ -0,0 +1,105 @@
+#ifndef CONSOLE_DEVICE_HPP
+#define CONSOLE_DEVICE_HPP
+
+#include "Memory.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Paravirtual console. The guest keeps an output and an input ring in its
+// own memory and the indices live in the device as free running byte
+// counts, so printing is a copy into RAM and one store to OUTPUT_HEAD, no
+// trap. A host thread drains output to the sink as HEAD moves, and input
+// is read on a thread of its own and written into the input ring, so a
+// hart waiting for a line never blocks in the host
+class MemoryConsole : public MemoryRegion, public std::enable_shared_from_this<MemoryConsole> {
+public:
+    static constexpr Address DEFAULT_BASE = 0x2012000;
+    static constexpr Address SIZE = 0x1000;
+
+    // Counts wrap at 32 bits, so a 32 bit guest only ever touches low words
+    static constexpr Address OUTPUT_RING_OFFSET = 0x00;
+    static constexpr Address OUTPUT_SIZE_OFFSET = 0x08;
+    static constexpr Address OUTPUT_HEAD_OFFSET = 0x10;
+    static constexpr Address OUTPUT_TAIL_OFFSET = 0x18;
+    static constexpr Address INPUT_RING_OFFSET = 0x20;
+    static constexpr Address INPUT_SIZE_OFFSET = 0x28;
+    static constexpr Address INPUT_HEAD_OFFSET = 0x30;
+    static constexpr Address INPUT_TAIL_OFFSET = 0x38;
+    // Reads 1 once the input source has ended
+    static constexpr Address INPUT_CLOSED_OFFSET = 0x40;
+
+    using Output = std::function<void(std::string_view)>;
+
+    // Blocks for the next line, false at the end of input
+    using InputSource = std::function<bool(std::string&)>;
+
+private:
+    static constexpr size_t REGISTER_COUNT = INPUT_CLOSED_OFFSET / sizeof(Long) + 1;
+
+    std::array<std::atomic<Long>, REGISTER_COUNT> registers{};
+
+    inline std::atomic<Long>& Register(Address offset) { return registers[offset / sizeof(Long)]; }
+    inline const std::atomic<Long>& Register(Address offset) const { return registers[offset / sizeof(Long)]; }
+
+    Output output;
+
+    std::mutex output_lock;
+    std::condition_variable_any output_signal;
+    std::condition_variable drained;
+
+    // Input the ring had no room for yet
+    std::string backlog;
+    std::mutex input_lock;
+
+    InputSource input_source;
+    bool reading = false;
+    bool source_ended = false;
+
+    mutable std::mutex lock;
+
+    // Last, so it stops before anything it uses goes away
+    std::jthread thread;
+
+    MemoryConsole(Address base, Output output);
+
+    // Bytes published and not yet drained, 0 while there's no ring
+    Word OutputPending() const;
+
+    void Drain(std::stop_token stop);
+    void FillInput();
+    void StartReading();
+
+public:
+    Long ReadLong(Address address) const override;
+    Word ReadWord(Address address) const override;
+
+    void WriteLong(Address address, Long vlong) override;
+    void WriteWord(Address address, Word word) override;
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    Long SizeInMemory() const override { return sizeof(MemoryConsole); }
+
+    // Read from once the guest sets up its input ring, not before, so a
+    // guest still on the CIN ecall keeps stdin to itself
+    void SetInputSource(InputSource source);
+
+    // Queues text for the input ring, as much as fits goes in right away
+    void PushInput(std::string_view text);
+
+    // Waits until the sink has everything the guest has published
+    void Flush();
+
+    static std::shared_ptr<MemoryConsole> Create(Output output, Address base = DEFAULT_BASE);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef DMA_HPP
+#define DMA_HPP
+
+#include "Memory.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// Block transfer engine. The guest fills in source, destination and length,
+// then writes a command to CONTROL and the whole transfer runs host side
+// over the backing pages before the store returns. STATUS then reads DONE
+// or ERROR until the guest writes it back to IDLE, which also drops the
+// completion interrupt if one was asked for
+class MemoryDMA : public MemoryRegion {
+public:
+    static constexpr Address DEFAULT_BASE = 0x2010000;
+    static constexpr Address SIZE = 0x1000;
+
+    static constexpr Address SOURCE_OFFSET = 0x00;
+    static constexpr Address DESTINATION_OFFSET = 0x08;
+    static constexpr Address LENGTH_OFFSET = 0x10;
+    static constexpr Address FILL_OFFSET = 0x18;
+    static constexpr Address CONTROL_OFFSET = 0x20;
+    static constexpr Address STATUS_OFFSET = 0x28;
+    static constexpr Address INTERRUPT_HART_OFFSET = 0x30;
+
+    static constexpr Long COMMAND_COPY = 1;
+    static constexpr Long COMMAND_FILL = 2;
+    static constexpr Long COMMAND_MASK = 0xff;
+
+    // Raises the DMA source on the PLIC when done, or without one the
+    // machine external interrupt on INTERRUPT_HART
+    static constexpr Long CONTROL_INTERRUPT = 1ULL << 8;
+
+    static constexpr Long STATUS_IDLE = 0;
+    static constexpr Long STATUS_DONE = 1;
+    static constexpr Long STATUS_ERROR = 2;
+
+private:
+    static constexpr size_t REGISTER_COUNT = INTERRUPT_HART_OFFSET / sizeof(Long) + 1;
+
+    // Indexed by offset. The CONTROL slot is never written
+    std::array<std::atomic<Long>, REGISTER_COUNT> registers{};
+
+    inline std::atomic<Long>& Register(Address offset) { return registers[offset / sizeof(Long)]; }
+
+    // Commands from different harts run one at a time
+    std::mutex command_lock;
+
+    mutable std::mutex lock;
+
+    MemoryDMA(Address base);
+
+    void Run(Long control);
+    void Copy(Address to, Address from, Address bytes);
+    void Fill(Address to, Byte value, Address bytes);
+    void SetInterrupt(bool pending);
+
+public:
+    Long ReadLong(Address address) const override;
+    Word ReadWord(Address address) const override;
+
+    void WriteLong(Address address, Long vlong) override;
+    void WriteWord(Address address, Word word) override;
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    Long SizeInMemory() const override { return sizeof(MemoryDMA); }
+
+    // Same registers, for the machine the clone is added to
+    std::shared_ptr<MemoryRegion> Clone() override;
+
+    static std::shared_ptr<MemoryDMA> Create(Address base = DEFAULT_BASE);
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef DEVICE_TREE_HPP
+#define DEVICE_TREE_HPP
+
+#include "Memory.hpp"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Builds a flattened device tree, the blob a RISC-V kernel reads the whole
+// machine from at boot instead of probing it. Nodes and properties are
+// written in order, cells big endian like the format wants
+class DeviceTree {
+public:
+    // Out of the way of RAM and the devices, below the framebuffer
+    static constexpr Address DEFAULT_BASE = 0xf0000000;
+
+    static constexpr Word MAGIC = 0xd00dfeed;
+    static constexpr Word VERSION = 17;
+    static constexpr Word LAST_COMPATIBLE_VERSION = 16;
+
+    static constexpr Word TOKEN_BEGIN_NODE = 1;
+    static constexpr Word TOKEN_END_NODE = 2;
+    static constexpr Word TOKEN_PROP = 3;
+    static constexpr Word TOKEN_END = 9;
+
+    struct Framebuffer {
+        Address base = 0;
+        Word width = 0;
+        Word height = 0;
+        Word stride = 0;
+        // A simple-framebuffer format, like "a8b8g8r8"
+        std::string format;
+    };
+
+    struct Options {
+        Hart harts = 1;
+        Hart boot_hart = 0;
+        std::string isa = "rv64imafdcv_zicsr_zifencei";
+        std::string bootargs;
+
+        // Described as a framebuffer and not as RAM, whatever backs it
+        std::optional<Framebuffer> framebuffer;
+    };
+
+private:
+    std::vector<Byte> structure;
+    std::string strings;
+    std::unordered_map<std::string, Word> string_offsets;
+
+    Word next_phandle = 1;
+
+    void PushWord(Word word);
+    void PushBytes(const void* bytes, size_t count);
+    Word GetStringOffset(std::string_view name);
+
+public:
+    void BeginNode(std::string_view name);
+    void EndNode();
+
+    void AddProperty(std::string_view name);
+    void AddProperty(std::string_view name, std::string_view value);
+    void AddCells(std::string_view name, const std::vector<Word>& cells);
+    void AddStrings(std::string_view name, const std::vector<std::string_view>& values);
+
+    // Two cells each, for #address-cells and #size-cells of 2
+    void AddRegister(Address base, Address size);
+
+    inline Word NewPhandle() { return next_phandle++; }
+
+    // The blob with its header, once every node has been ended
+    std::vector<Byte> Finish(Hart boot_hart) const;
+
+    // RAM, the CLINT, the PLIC and the devices memory holds, plus the harts
+    static std::vector<Byte> Generate(const Memory& memory, const Options& options);
+
+    // The generated blob as a ROM to map at base
+    static std::unique_ptr<MemoryROM> CreateROM(const Memory& memory, const Options& options, Address base = DEFAULT_BASE);
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef ELF_HPP
+#define ELF_HPP
+
+#include "Memory.hpp"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Names for guest addresses, sorted so a lookup is a binary search
+class SymbolTable {
+public:
+    struct Symbol {
+        std::string name;
+        Address address;
+        Address size;
+        bool is_function;
+    };
+
+private:
+    std::vector<Symbol> symbols;
+
+public:
+    SymbolTable() = default;
+    SymbolTable(std::vector<Symbol> symbols);
+
+    // The symbol covering address, or the closest one below it when sizes
+    // are missing. nullptr when there is none
+    const Symbol* Find(Address address) const;
+
+    // "name+0x10", or an empty string when no symbol covers address
+    std::string Format(Address address) const;
+
+    inline const std::vector<Symbol>& GetSymbols() const { return symbols; }
+    inline bool IsEmpty() const { return symbols.empty(); }
+};
+
+// A whole file mapped read only into the host, shared by every region
+// that serves pages from it
+class FileMapping {
+private:
+    const Byte* host = nullptr;
+    Address size = 0;
+
+#if defined(_WIN32) || defined(_WIN64)
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+
+    FileMapping() = default;
+
+public:
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+    ~FileMapping();
+
+    inline const Byte* GetHost() const { return host; }
+    inline Address GetSize() const { return size; }
+
+    static std::shared_ptr<FileMapping> Open(const std::string& path);
+};
+
+// Read only guest memory served straight from a mapped file. Pages are
+// read through the host mapping, so nothing is copied until touched and
+// clones share the region as it is
+class MemoryFileROM : public MemoryRegion {
+private:
+    const std::shared_ptr<const FileMapping> file;
+    const Address offset;
+
+    MemoryFileROM(std::shared_ptr<const FileMapping> file, Address offset, Address base, Address size) : MemoryRegion(TYPE_BIOS_ROM, 0, base, size, true, false), file{std::move(file)}, offset{offset} {}
+
+    // Bytes past the end of the file read as zero
+    template <typename T>
+    inline T Read(Address address) const {
+        Address at = offset + address;
+        T value = 0;
+        if (at + sizeof(T) <= file->GetSize()) {
+            std::memcpy(&value, file->GetHost() + at, sizeof(T));
+            return value;
+        }
+
+        for (Address i = 0; i < sizeof(T) && at + i < file->GetSize(); i++)
+            value |= static_cast<T>(file->GetHost()[at + i]) << (i * 8);
+
+        return value;
+    }
+
+public:
+    Long ReadLong(Address address) const override { return Read<Long>(address); }
+    Word ReadWord(Address address) const override { return Read<Word>(address); }
+    Half ReadHalf(Address address) const override { return Read<Half>(address); }
+    Byte ReadByte(Address address) const override { return Read<Byte>(address); }
+
+    bool ReadBytes(Address address, Byte* bytes, Address count) const override;
+
+    // Loads only, Memory reports the page as not writable
+    Byte* GetHostPage(Address address) override;
+
+    void Lock() const override {}
+    void Unlock() const override {}
+
+    // The data lives in the host page cache, not in the emulator
+    Long SizeInMemory() const override { return 0; }
+
+    static std::unique_ptr<MemoryFileROM> Create(std::shared_ptr<const FileMapping> file, Address offset, Address base, Address size);
+};
+
+// ELF executable for the guest, ELF32 or ELF64 little endian RISC-V.
+// Segments load at their physical address. Read only segments that own
+// their pages are mapped from the file as MemoryFileROM regions and the
+// rest are copied, with BSS left to the zero pages RAM starts with
+class ELFImage {
+public:
+    struct Segment {
+        Address address;
+        Address file_offset;
+        Address file_bytes;
+        Address memory_bytes;
+        bool writable;
+        bool executable;
+        bool mapped = false;
+    };
+
+private:
+    std::shared_ptr<FileMapping> file;
+
+    Address entry = 0;
+    bool is_64 = false;
+
+    std::vector<Segment> segments;
+    std::shared_ptr<const SymbolTable> symbols;
+
+    ELFImage() = default;
+
+    template <typename Header, typename ProgramHeader, typename SectionHeader, typename Sym>
+    void Parse();
+
+    template <typename T>
+    T At(Address offset) const;
+
+    bool CanMap(const Segment& segment) const;
+
+public:
+    // Adds a region for each read only segment that can be served from the
+    // file. Regions added earlier win where they overlap, so call this
+    // before adding the RAM the image links against
+    void MapReadOnlySegments(Memory& memory);
+
+    // Copies every segment that wasn't mapped
+    void LoadSegments(Memory& memory);
+
+    inline Address GetEntry() const { return entry; }
+    inline bool Is64Bit() const { return is_64; }
+
+    inline const std::vector<Segment>& GetSegments() const { return segments; }
+
+    // Shared so the profiler and the GDB server can hold on to it
+    inline std::shared_ptr<const SymbolTable> GetSymbols() const { return symbols; }
+
+    static bool IsELF(const std::string& path);
+
+    static std::unique_ptr<ELFImage> Open(const std::string& path);
+};
+
+#endif
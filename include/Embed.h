@@ -0,0 +1,110 @@
+#ifndef EMBED_H
+#define EMBED_H
+
+/*
+ * A C interface for running the simulator inside another program. Each
+ * machine owns its memory, harts and ecall handlers, and nothing is shared
+ * between machines, so any number of them may run on different threads.
+ * A machine itself must only be used from one thread at a time.
+ *
+ * Calls returning int give 0 on success and -1 on failure, with the reason
+ * in rv64_last_error.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct rv64_machine rv64_machine;
+
+typedef struct rv64_config {
+    /* Harts start at start_pc in machine mode, numbered from 0 */
+    uint32_t harts;
+    uint64_t start_pc;
+
+    /* Mapped at creation when ram_size isn't 0 */
+    uint64_t ram_base;
+    uint64_t ram_size;
+
+    int use_basic_blocks;
+    int use_jit;
+} rv64_config;
+
+/* Why rv64_step or rv64_run returned */
+typedef enum rv64_event {
+    /* Ran every instruction it was given */
+    RV64_EVENT_DONE = 0,
+    /* Stopped by rv64_stop, usually from an ecall handler */
+    RV64_EVENT_STOPPED,
+    /* At a breakpoint or just after touching a watchpoint */
+    RV64_EVENT_BREAK,
+    /* Asleep in WFI with no timer set to wake it */
+    RV64_EVENT_IDLE,
+    /* An access or an ecall failed, see rv64_last_error */
+    RV64_EVENT_ERROR
+} rv64_event;
+
+/* Called for every machine mode ecall a hart makes with number in a0.
+   Registers are read and written with the calls below */
+typedef void (*rv64_ecall_handler)(rv64_machine* machine, uint32_t hart, void* user);
+
+/* One hart, 16 MiB of RAM at 0x1000 and basic blocks without the JIT */
+void rv64_config_init(rv64_config* config);
+
+/* NULL when the machine can't be made */
+rv64_machine* rv64_create(const rv64_config* config);
+void rv64_destroy(rv64_machine* machine);
+
+/* The last failure on this machine, valid until the next call */
+const char* rv64_last_error(const rv64_machine* machine);
+
+uint32_t rv64_hart_count(const rv64_machine* machine);
+
+/* Regions are added before anything runs */
+int rv64_add_ram(rv64_machine* machine, uint64_t base, uint64_t size);
+int rv64_add_rom(rv64_machine* machine, uint64_t base, const void* bytes, size_t size);
+
+int rv64_read_memory(rv64_machine* machine, uint64_t address, void* bytes, size_t size);
+int rv64_write_memory(rv64_machine* machine, uint64_t address, const void* bytes, size_t size);
+
+/* All 32 registers at once. x0 is never written. Float registers are raw
+   bits, with single values NaN boxed */
+int rv64_read_registers(rv64_machine* machine, uint32_t hart, uint64_t values[32]);
+int rv64_write_registers(rv64_machine* machine, uint32_t hart, const uint64_t values[32]);
+int rv64_read_float_registers(rv64_machine* machine, uint32_t hart, uint64_t values[32]);
+int rv64_write_float_registers(rv64_machine* machine, uint32_t hart, const uint64_t values[32]);
+
+uint64_t rv64_get_pc(const rv64_machine* machine, uint32_t hart);
+int rv64_set_pc(rv64_machine* machine, uint32_t hart, uint64_t pc);
+
+/* Replaces any handler for the number, and NULL removes it. Calling a
+   number without one is an error */
+int rv64_register_ecall(rv64_machine* machine, int64_t number, rv64_ecall_handler handler, void* user);
+
+int rv64_set_breakpoint(rv64_machine* machine, uint64_t address);
+int rv64_clear_breakpoint(rv64_machine* machine, uint64_t address);
+
+/* Runs a hart for exactly instructions, unless an event comes first. A
+   hart that was stopped is started again */
+rv64_event rv64_step(rv64_machine* machine, uint32_t hart, uint64_t instructions);
+
+/* rv64_step without a limit */
+rv64_event rv64_run(rv64_machine* machine, uint32_t hart);
+
+/* Steps every hart by instructions, or without a limit for 0, a slice at
+   a time in turn so they see each other's stores. Leaves each hart's event
+   in events */
+int rv64_step_all(rv64_machine* machine, uint64_t instructions, rv64_event* events);
+
+/* Ends the hart's rv64_step or rv64_run once the current instruction is
+   done. Meant for ecall handlers */
+int rv64_stop(rv64_machine* machine, uint32_t hart);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
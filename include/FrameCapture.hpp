@@ -0,0 +1,156 @@
+#ifndef FRAME_CAPTURE_HPP
+#define FRAME_CAPTURE_HPP
+
+#include "Memory.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records what a guest draws into a framebuffer in guest memory. Frames are
+// copied out of the screen as it is and only kept when their hash changed,
+// so the guest keeps storing meanwhile and a frame may be torn, never
+// stalled. Kept frames go through a lock-free queue to an encoder thread
+// that writes them out, and their hashes are kept for comparing a run
+// against golden images without looking at pixels
+class FrameCapture {
+public:
+    // Same values as the app's FramebufferFormat
+    enum class PixelFormat : Word {
+        RGBA8888 = 0,
+        XRGB8888 = 1,
+        RGB565 = 2
+    };
+
+    enum class Output : Byte {
+        // Only hashes
+        None,
+        // The guest's bytes as they are, one file per frame
+        Raw,
+        // One 24 bit PNG per frame
+        PNG,
+        // 24 bit RGB frames back to back on a command's stdin, e.g.
+        // ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH -i - out.mp4
+        Pipe
+    };
+
+    struct Options {
+        Address address = 0;
+        Word width = 0;
+        Word height = 0;
+        PixelFormat format = PixelFormat::RGBA8888;
+
+        Output output = Output::PNG;
+
+        // The directory frames are written to, or the command for Pipe
+        std::string destination;
+
+        // Frames copied per second by the sampler thread. 0 leaves it to
+        // CaptureFrame
+        double fps = 30.0;
+    };
+
+    struct Frame {
+        Long number = 0;
+        Long hash = 0;
+
+        // Since the capture started
+        double seconds = 0.0;
+    };
+
+private:
+    static constexpr size_t QUEUE_SLOTS = 8;
+
+    struct Slot {
+        Frame frame;
+        std::vector<Byte> pixels;
+    };
+
+    Memory& memory;
+    const Options options;
+    const Address frame_bytes;
+    const std::chrono::steady_clock::time_point start;
+
+    // One producer, the thread calling CaptureFrame, and one consumer, the
+    // encoder. Each index is only written by its own side
+    std::array<Slot, QUEUE_SLOTS> slots;
+    std::atomic<Long> head = 0;
+    std::atomic<Long> tail = 0;
+
+    // Bumped on every push and on stop, for the encoder to wait on
+    std::atomic<Long> signal = 0;
+
+    // Touched only by whoever captures
+    std::vector<Byte> scratch;
+    Long last_hash = 0;
+    Long captured = 0;
+
+    // Touched only by the encoder
+    std::vector<Byte> rgb;
+
+    std::atomic<Long> dropped = 0;
+
+    std::vector<Frame> frames;
+    mutable std::mutex frames_lock;
+
+    std::FILE* pipe = nullptr;
+
+    std::jthread encoder;
+    std::jthread sampler;
+
+    void Encode(std::stop_token stop);
+    void Sample(std::stop_token stop);
+
+    void Write(const Slot& slot);
+
+    // The frame as 24 bit RGB rows, into rgb
+    void ConvertToRGB(std::span<const Byte> pixels);
+
+public:
+    // Throws when the output can't be opened
+    FrameCapture(Memory& memory, const Options& options);
+    FrameCapture(const FrameCapture&) = delete;
+
+    // Stops like Stop
+    ~FrameCapture();
+
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Copies the screen and queues it when it changed since the last frame
+    // kept. Returns false when it didn't, or when the queue was full and
+    // the frame was dropped. Only one thread may capture at a time, which
+    // is the sampler's when fps isn't 0
+    bool CaptureFrame();
+
+    // Waits for the encoder to write every queued frame
+    void Flush();
+
+    // Stops sampling and writes out what's queued. Nothing is captured after
+    void Stop();
+
+    // Frames kept so far, in order
+    std::vector<Frame> GetFrames() const;
+
+    // Changed frames that weren't written, because the queue was full or
+    // the output failed
+    inline Long GetDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    // One line per kept frame with its number, time and hash
+    void WriteHashes(const std::string& path) const;
+
+    // FNV-1a a long at a time, with the bytes of a last partial long
+    static Long HashFrame(std::span<const Byte> pixels);
+
+    // A stored deflate PNG, so no compression library is needed
+    static void WritePNG(const std::string& path, std::span<const Byte> rgb, Word width, Word height);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef FRAME_DELTA_HPP
+#define FRAME_DELTA_HPP
+
+#include "Memory.hpp"
+
+#include <span>
+#include <vector>
+
+// Packs what changed on a screen in guest memory since the last frame, for
+// a remote viewer holding the previous one. Only rows on pages stored to
+// since the last frame are read, and only the tiles among them that really
+// differ are sent, so the work follows what the guest draws rather than
+// the resolution. The screen's dirty bits are taken, so nothing else may
+// consume them, like the GL window does.
+//
+// A batch is little endian: a long tile count, then per tile halves x, y,
+// width and height in pixels, a word of packed bytes and the packed pixels.
+// Pixels are packed in runs: a control byte under 128 is followed by that
+// many plus one distinct pixels, and one of 128 or more by a single pixel
+// repeated the control minus 126 times
+class FrameDelta {
+public:
+    static constexpr Word TILE = 64;
+
+private:
+    Memory& memory;
+    const Address address;
+    const Word width, height, pixel_bytes;
+    const Address row_bytes;
+
+    // What the viewer has, and the newest rows read from the guest
+    std::vector<Byte> sent;
+    std::vector<Byte> current;
+
+    // Reused for every tile
+    std::vector<Byte> tile;
+
+    bool first = true;
+
+    void PackTile(std::vector<Byte>& out, Word x, Word y, Word tile_width, Word tile_height);
+
+public:
+    FrameDelta(Memory& memory, Address address, Word width, Word height, Word pixel_bytes);
+
+    // Appends a batch of the tiles that changed since the last one, or of
+    // every tile with full, for a viewer that just connected. Returns how
+    // many tiles it holds
+    size_t Encode(std::vector<Byte>& out, bool full);
+
+    // Applies a batch to a viewer's copy of the screen. False when the
+    // batch is malformed, which may leave frame partly updated
+    static bool Apply(std::span<const Byte> batch, std::span<Byte> frame, Word width, Word height, Word pixel_bytes);
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef HART_SCHEDULER_HPP
+#define HART_SCHEDULER_HPP
+
+#include "VirtualMachine.hpp"
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+// Runs many harts on a fixed pool of host threads. Each worker keeps a
+// queue of runnable harts and runs them one quantum at a time, stealing
+// from the other queues when its own runs dry. Harts that are paused or
+// asleep in WFI can be parked off the queues until something wakes them
+class HartScheduler {
+public:
+    struct Options {
+        // Zero uses one worker per host thread
+        size_t threads = 0;
+        Long quantum = 1000;
+        bool pin_threads = false;
+        bool park_idle = true;
+    };
+
+    // Called on the worker thread when a hart throws. The hart is dropped
+    // from the schedule either way
+    using ErrorHandler = std::function<void(VirtualMachine& vm, const std::exception& e)>;
+
+private:
+    // Parked harts are also polled every so often by busy workers, so
+    // timer interrupts still land when the pool never goes idle
+    static constexpr Long PARKED_POLL_PERIOD = 64;
+    static constexpr auto IDLE_WAIT = std::chrono::milliseconds(1);
+
+    struct Worker {
+        std::mutex lock;
+        std::deque<VirtualMachine*> queue;
+    };
+
+    const std::vector<VirtualMachine*> harts;
+    const Options options;
+    const ErrorHandler on_error;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::jthread> threads;
+
+    std::mutex parked_lock;
+    std::vector<VirtualMachine*> parked;
+    std::atomic<bool> wake_pending = false;
+
+    std::mutex idle_lock;
+    std::condition_variable idle_signal;
+
+    std::atomic<size_t> finished = 0;
+    std::atomic<bool> stopping = false;
+
+    VirtualMachine* Take(size_t worker);
+    void Push(size_t worker, VirtualMachine* vm);
+    void Park(VirtualMachine* vm);
+    bool WakeParked(size_t worker);
+    void Finish();
+    void Notify();
+
+    void Work(size_t worker);
+
+    static void PinThread(size_t worker);
+
+public:
+    HartScheduler(const std::vector<VirtualMachine*>& harts, const Options& options, ErrorHandler on_error = nullptr);
+    HartScheduler(const HartScheduler&) = delete;
+    ~HartScheduler();
+
+    HartScheduler& operator=(const HartScheduler&) = delete;
+
+    void Start();
+
+    // Blocks until every hart has stopped or Stop was called
+    void Wait();
+    void Stop();
+
+    inline size_t GetThreadCount() const { return workers.size(); }
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef INPUT_DEVICE_HPP
+#define INPUT_DEVICE_HPP
+
+#include "Memory.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// Keyboard and mouse events in arrival order. The window thread pushes
+// into a single producer, single consumer ring without locking, and each
+// push raises the input source on the PLIC, or the machine external
+// interrupt on INTERRUPT_HART, so a guest can sleep in WFI until there is
+// something to read. EVENT and DATA show the oldest event, and a write to
+// NEXT drops it
+class MemoryInputDevice : public MemoryRegion {
+public:
+    static constexpr Address DEFAULT_BASE = 0x2013000;
+    static constexpr Address SIZE = 0x1000;
+
+    // Type in bits 0-7, 1 in bit 8 for a press, the key or button from
+    // bit 16. Reads 0 when the queue is empty
+    static constexpr Address EVENT_OFFSET = 0x00;
+    // X in the low half, Y in the high half, for motion
+    static constexpr Address DATA_OFFSET = 0x08;
+    static constexpr Address NEXT_OFFSET = 0x10;
+    static constexpr Address COUNT_OFFSET = 0x18;
+    // Events lost to a full queue
+    static constexpr Address DROPPED_OFFSET = 0x20;
+    static constexpr Address INTERRUPT_HART_OFFSET = 0x28;
+    // Reads 1 while the interrupt is raised. A write clears it unless
+    // events are still queued
+    static constexpr Address INTERRUPT_OFFSET = 0x30;
+
+    static constexpr Word EVENT_NONE = 0;
+    static constexpr Word EVENT_KEY = 1;
+    static constexpr Word EVENT_BUTTON = 2;
+    static constexpr Word EVENT_MOTION = 3;
+
+    static constexpr Word EVENT_PRESSED = 1 << 8;
+    static constexpr Word EVENT_CODE_SHIFT = 16;
+
+    static constexpr size_t QUEUE_SIZE = 256;
+
+private:
+    struct Event {
+        Word event;
+        Word data;
+    };
+
+    static_assert((QUEUE_SIZE & (QUEUE_SIZE - 1)) == 0);
+
+    // Free running counts. head is only written by the producer and tail
+    // by the consumer, on their own cache lines
+    std::array<Event, QUEUE_SIZE> queue{};
+    alignas(64) std::atomic<Long> head = 0;
+    alignas(64) std::atomic<Long> tail = 0;
+
+    std::atomic<Long> dropped = 0;
+    std::atomic<Long> interrupt_hart = 0;
+    std::atomic<bool> interrupt = false;
+
+    // Harts writing NEXT at once take turns, so there's one consumer
+    std::mutex consume_lock;
+
+    mutable std::mutex lock;
+
+    MemoryInputDevice(Address base);
+
+    bool Push(Word event, Word data);
+    void SetInterrupt(bool pending);
+
+public:
+    Long ReadLong(Address address) const override;
+    Word ReadWord(Address address) const override;
+
+    void WriteLong(Address address, Long vlong) override;
+    void WriteWord(Address address, Word word) override;
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    Long SizeInMemory() const override { return sizeof(MemoryInputDevice); }
+
+    // Only ever called from one thread. False when the queue was full
+    bool PushKey(Word key, bool pressed);
+    bool PushButton(Word button, bool pressed);
+    bool PushMotion(Word x, Word y);
+
+    static std::shared_ptr<MemoryInputDevice> Create(Address base = DEFAULT_BASE);
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef INSTRUCTION_CACHE_HPP
+#define INSTRUCTION_CACHE_HPP
+
+#include "Memory.hpp"
+#include "RV64.hpp"
+
+#include <array>
+#include <bitset>
+#include <memory>
+#include <set>
+
+class InstructionCache {
+public:
+    static constexpr Address PAGE_SIZE = 0x1000;
+    // Compressed instructions may start at any half
+    static constexpr size_t INSTRUCTIONS_PER_PAGE = PAGE_SIZE / sizeof(Half);
+    static constexpr size_t PAGE_COUNT = 64;
+
+private:
+    struct Page {
+        Address tag = 0;
+        Word version = 0;
+        std::bitset<INSTRUCTIONS_PER_PAGE> decoded;
+        std::array<RVInstruction, INSTRUCTIONS_PER_PAGE> instructions;
+    };
+
+    std::array<std::unique_ptr<Page>, PAGE_COUNT> pages;
+    const Memory& memory;
+
+    Long misses = 0;
+
+    // Virtual addresses. Kept here so decoding flags them once, leaving
+    // nothing to check per instruction while none are set
+    std::set<Address> break_points;
+
+    Page& LoadPage(Address page_address);
+
+public:
+    InstructionCache(const Memory& memory) : memory{memory} {}
+    InstructionCache(const InstructionCache&) = delete;
+    InstructionCache(InstructionCache&&) = default;
+
+    inline void Clear() {
+        for (auto& page : pages)
+            page.reset();
+    }
+
+    // The virtual address picks out breakpoints, which are set where the
+    // debugger sees the code. nullptr when there's no readable memory there
+    inline const RVInstruction* Fetch(Address address, Address virtual_address) {
+        Address page_address = address & ~(PAGE_SIZE - 1);
+        auto& page = pages[(page_address / PAGE_SIZE) % PAGE_COUNT];
+
+        Page* cached = page.get();
+        if (!cached || cached->tag != page_address || cached->version != memory.GetCodePageVersion(page_address))
+            cached = &LoadPage(page_address);
+
+        size_t index = (address & (PAGE_SIZE - 1)) / sizeof(Half);
+        if (!cached->decoded[index]) {
+            misses++;
+
+            auto [low, low_fault] = memory.TryReadHalf(address);
+            if (low_fault != Memory::AccessFault::None) return nullptr;
+
+            if (RVInstruction::IsCompressed(low))
+                cached->instructions[index] = RVInstruction::FromUInt16(low);
+            else {
+                auto [high, high_fault] = memory.TryReadHalf(address + sizeof(Half));
+                if (high_fault != Memory::AccessFault::None) return nullptr;
+
+                cached->instructions[index] = RVInstruction::FromUInt32(low | static_cast<Word>(high) << 16);
+            }
+
+            auto& decoded = cached->instructions[index];
+            decoded.break_point = decoded.type == RVInstruction::Type::EBREAK || (!break_points.empty() && break_points.contains(virtual_address));
+
+            cached->decoded[index] = true;
+        }
+
+        return &cached->instructions[index];
+    }
+
+    // A 32 bit instruction in the last half of a page continues on the next
+    // one, which may be mapped anywhere, so Fetch can't serve it
+    inline bool Straddles(Address address) const {
+        if ((address & (PAGE_SIZE - 1)) != PAGE_SIZE - sizeof(Half)) return false;
+
+        auto [low, mapped] = memory.PeekHalf(address);
+        return mapped && !RVInstruction::IsCompressed(low);
+    }
+
+    void Invalidate();
+
+    // A page may be mapped at more than one virtual address, so a flag is
+    // only a hint until IsBreakPoint confirms it for the pc
+    inline void SetBreakPoint(Address virtual_address) {
+        break_points.insert(virtual_address);
+        Invalidate();
+    }
+
+    inline void ClearBreakPoint(Address virtual_address) {
+        if (break_points.erase(virtual_address))
+            Invalidate();
+    }
+
+    inline bool IsBreakPoint(Address virtual_address) const {
+        return !break_points.empty() && break_points.contains(virtual_address);
+    }
+
+    inline Long GetMisses() const { return misses; }
+};
+
+#endif
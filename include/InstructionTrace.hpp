@@ -0,0 +1,147 @@
+#ifndef INSTRUCTION_TRACE_HPP
+#define INSTRUCTION_TRACE_HPP
+
+#include "RV64.hpp"
+
+#include <array>
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// One retired instruction. Writebacks carry the register value after the
+// instruction ran, memory accesses the virtual address
+struct InstructionTraceRecord {
+    Address pc = 0;
+    Word raw = 0;
+
+    Byte rd = 0;
+    bool writes_rd = false;
+    bool writes_frd = false;
+    Long rd_value = 0;
+
+    bool has_address = false;
+    Address address = 0;
+
+    // What an instruction of this type writes back and how it addresses memory
+    enum Access : Byte {
+        ACCESS_NONE = 0,
+        ACCESS_RD = 1 << 0,
+        ACCESS_FRD = 1 << 1,
+        ACCESS_OFFSET = 1 << 2,
+        ACCESS_RS1 = 1 << 3
+    };
+
+    static constexpr std::array<Byte, RVInstruction::TYPE_COUNT> accesses = [] {
+        using Type = RVInstruction::Type;
+
+        std::array<Byte, RVInstruction::TYPE_COUNT> table{};
+        table.fill(ACCESS_RD);
+
+        auto Mark = [&](Type first, Type last, Byte access) {
+            for (auto type = static_cast<size_t>(first); type <= static_cast<size_t>(last); type++)
+                table[type] = access;
+        };
+
+        auto Set = [&](std::initializer_list<Type> types, Byte access) {
+            for (auto type : types)
+                table[static_cast<size_t>(type)] = access;
+        };
+
+        Mark(Type::BEQ, Type::BGEU, ACCESS_NONE);
+        Mark(Type::LB, Type::LHU, ACCESS_RD | ACCESS_OFFSET);
+        Mark(Type::SB, Type::SW, ACCESS_OFFSET);
+        Set({Type::LWU, Type::LD}, ACCESS_RD | ACCESS_OFFSET);
+        Set({Type::SD}, ACCESS_OFFSET);
+        Mark(Type::LR_W, Type::AMOMAXU_D, ACCESS_RD | ACCESS_RS1);
+
+        Mark(Type::FMADD_S, Type::FCVT_S_LU, ACCESS_FRD);
+        Mark(Type::FMADD_D, Type::FMV_D_X, ACCESS_FRD);
+        Set({Type::FLW, Type::FLD}, ACCESS_FRD | ACCESS_OFFSET);
+        Set({Type::FSW, Type::FSD}, ACCESS_OFFSET);
+
+        // Vector results land in v registers, which the trace doesn't record
+        Mark(Type::VSETVLI, Type::VFMV_S_F, ACCESS_NONE);
+        Mark(Type::VLE8_V, Type::VSSE64_V, ACCESS_RS1);
+        Set({Type::VSETVLI, Type::VSETIVLI, Type::VSETVL, Type::VMV_X_S}, ACCESS_RD);
+        Set({Type::VFMV_F_S}, ACCESS_FRD);
+
+        // Float compares, classifies and conversions to integers write x registers
+        Set({
+            Type::FCVT_W_S, Type::FCVT_WU_S, Type::FMV_X_W, Type::FEQ_S, Type::FLT_S, Type::FLE_S, Type::FCLASS_S,
+            Type::FCVT_L_S, Type::FCVT_LU_S, Type::FEQ_D, Type::FLT_D, Type::FLE_D, Type::FCLASS_D,
+            Type::FCVT_W_D, Type::FCVT_WU_D, Type::FCVT_L_D, Type::FCVT_LU_D, Type::FMV_X_D
+        }, ACCESS_RD);
+
+        Set({
+            Type::FENCE, Type::FENCE_I, Type::ECALL, Type::EBREAK, Type::SRET, Type::MRET, Type::WFI,
+            Type::SFENCE_VMA, Type::SINVAL_VMA, Type::SINVAL_GVMA, Type::SFENCE_W_INVAL, Type::SFENCE_INVAL_IR,
+            Type::INVALID, Type::CUST_MTRAP, Type::CUST_STRAP
+        }, ACCESS_NONE);
+
+        return table;
+    }();
+};
+
+// Records are packed against the previous record: a flags byte, the pc only
+// when it doesn't follow the previous instruction, the raw instruction in
+// two or four bytes, then zigzag varint deltas of the writeback against
+// that register's last traced value and of the address against the last
+// traced address. Full buffers are handed to a writer thread, so the hart
+// only ever waits on a short queue lock
+class InstructionTraceWriter {
+public:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+private:
+    std::ofstream file;
+
+    std::vector<Byte> buffer;
+
+    std::deque<std::vector<Byte>> pending;
+    std::mutex pending_lock;
+    std::condition_variable pending_signal;
+    bool closing = false;
+
+    std::jthread writer;
+
+    Address next_pc = 0;
+    Address last_address = 0;
+    std::array<Long, 32> last_regs{};
+    std::array<Long, 32> last_fregs{};
+
+    void Flush();
+    void WriteBuffers();
+
+public:
+    InstructionTraceWriter(const std::string& path);
+    InstructionTraceWriter(const InstructionTraceWriter&) = delete;
+    ~InstructionTraceWriter();
+
+    InstructionTraceWriter& operator=(const InstructionTraceWriter&) = delete;
+
+    void Record(const InstructionTraceRecord& record);
+};
+
+class InstructionTraceReader {
+private:
+    std::vector<Byte> data;
+    size_t position = 0;
+
+    Address next_pc = 0;
+    Address last_address = 0;
+    std::array<Long, 32> last_regs{};
+    std::array<Long, 32> last_fregs{};
+
+public:
+    InstructionTraceReader(const std::string& path);
+    ~InstructionTraceReader() = default;
+
+    // False once every record has been read
+    bool Next(InstructionTraceRecord& record);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "RV64.hpp"
+
+#include <vector>
+
+class JIT {
+public:
+    using Block = void (*)(Long* regs, Long pc);
+
+    static constexpr size_t CODE_SIZE = 1024 * 1024;
+    static constexpr Long HOT_THRESHOLD = 16;
+
+private:
+    Byte* code = nullptr;
+    size_t used = 0;
+
+    std::vector<Byte> buffer;
+
+    void Emit(std::initializer_list<Byte> bytes);
+    void EmitWord(Word value);
+    void EmitLong(Long value);
+
+    void EmitLoad(Byte host_reg, Byte guest_reg);
+    void EmitStore(Byte guest_reg, Byte host_reg);
+    void EmitLoadImmediate(Byte host_reg, Long value);
+
+    bool EmitInstruction(const RVInstruction& instr, Long offset);
+
+public:
+    JIT();
+    JIT(const JIT&) = delete;
+    JIT(JIT&& jit);
+    ~JIT();
+
+    JIT& operator=(const JIT&) = delete;
+    JIT& operator=(JIT&& jit);
+
+    static bool IsHostSupported();
+    static bool CanCompile(const RVInstruction& instr);
+
+    inline bool IsAvailable() const {
+        return code != nullptr;
+    }
+
+    inline bool IsFull() const {
+        return used >= CODE_SIZE;
+    }
+
+    Block Compile(const std::vector<RVInstruction>& instructions, size_t count);
+    void Reset();
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef LOCKSTEP_SCHEDULER_HPP
+#define LOCKSTEP_SCHEDULER_HPP
+
+#include "VirtualMachine.hpp"
+#include "CLINT.hpp"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <barrier>
+#include <atomic>
+#include <random>
+#include <functional>
+#include <exception>
+
+// Runs harts in fixed instruction quanta so that a run repeats exactly.
+// Counted time is forced on, and harts asleep in WFI only move time when
+// every hart is asleep.
+//
+// RoundRobin runs every hart on one thread in an order shuffled from the
+// seed each round, so memory ordering and LR/SC outcomes repeat with the
+// seed. Epochs runs the harts in parallel and meets at a barrier after
+// every quantum. Time and interrupts still repeat, but harts that share
+// memory within an epoch race like they would in Run
+class LockstepScheduler {
+public:
+    enum class Mode {
+        RoundRobin,
+        Epochs
+    };
+
+    struct Options {
+        Mode mode = Mode::RoundRobin;
+        Long quantum = 1000;
+        Long seed = 0;
+
+        // Epochs only, zero uses one thread per host thread
+        size_t threads = 0;
+    };
+
+    using ErrorHandler = std::function<void(VirtualMachine& vm, const std::exception& e)>;
+
+private:
+    // Every hart paused means only the host can wake one up
+    static constexpr auto IDLE_WAIT = std::chrono::milliseconds(1);
+
+    struct EpochEnd {
+        LockstepScheduler* scheduler;
+        void operator()() noexcept { scheduler->EndEpoch(); }
+    };
+
+    const std::vector<VirtualMachine*> harts;
+    const Options options;
+    const ErrorHandler on_error;
+    const std::shared_ptr<MemoryCLINT> clint;
+
+    std::mt19937_64 random;
+    std::vector<VirtualMachine*> order;
+
+    size_t epoch_threads = 0;
+    std::unique_ptr<std::barrier<EpochEnd>> barrier;
+    std::vector<std::jthread> threads;
+
+    std::atomic<bool> ran = false;
+    std::atomic<bool> done = false;
+    std::atomic<bool> stopping = false;
+    std::atomic<Long> rounds = 0;
+
+    bool RunHart(VirtualMachine* vm);
+    bool EndRound(bool ran);
+    void EndEpoch();
+
+    void RunRounds();
+    void RunEpochs(size_t thread);
+
+public:
+    LockstepScheduler(Memory& memory, const std::vector<VirtualMachine*>& harts, const Options& options, ErrorHandler on_error = nullptr);
+    LockstepScheduler(const LockstepScheduler&) = delete;
+    ~LockstepScheduler();
+
+    LockstepScheduler& operator=(const LockstepScheduler&) = delete;
+
+    void Start();
+
+    // Blocks until every hart has stopped or Stop was called
+    void Wait();
+    void Stop();
+
+    inline Long GetRounds() const { return rounds; }
+};
+
+#endif
@@ -8,9 +8,103 @@
 #include <unordered_map>
 #include <type_traits>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
 #include <utility>
+#include <span>
+#include <optional>
+#include <chrono>
+#include <string>
+#include <thread>
 
 #include "Types.hpp"
+#include "NUMA.hpp"
+
+class Memory;
+
+// One bit per page of a region, set once a store to the page has landed and
+// cleared by whoever consumes it. Marking a page that's already dirty costs
+// a relaxed load, so only the first store after a clear pays for the RMW
+class DirtyPages {
+public:
+    static constexpr Address PAGE_SIZE = 0x1000;
+
+    using Range = std::pair<Address, Address>;
+
+private:
+    const size_t pages_count;
+    const std::unique_ptr<std::atomic<Long>[]> bits;
+
+    std::vector<Range> CollectRanges(Address offset, Address bytes, bool take) const;
+
+public:
+    DirtyPages(Address size);
+
+    // Lets stores through host pages set their page's bit without a lookup
+    inline std::pair<std::atomic<Long>*, Long> GetBit(Address offset) {
+        auto page = offset / PAGE_SIZE;
+        return {&bits[page / 64], 1ULL << (page % 64)};
+    }
+
+    inline static void Mark(std::atomic<Long>& word, Long bit) {
+        if (!(word.load(std::memory_order_relaxed) & bit))
+            word.fetch_or(bit, std::memory_order_release);
+    }
+
+    inline void Mark(Address offset) {
+        auto [word, bit] = GetBit(offset);
+        Mark(*word, bit);
+    }
+
+    void MarkAll();
+    void ClearAll();
+    void CopyFrom(const DirtyPages& other);
+
+    // Runs of dirty pages touching [offset, offset + bytes), as page aligned
+    // [start, end) offsets. Take clears the bits it reports, so a store
+    // racing with it shows up in the next call instead of being lost
+    std::vector<Range> Peek(Address offset, Address bytes) const;
+    std::vector<Range> Take(Address offset, Address bytes);
+};
+
+// What page compression is doing in a region, or summed over a Memory
+struct CompressionStats {
+    // Pages held packed, and the host memory they take
+    Long pages = 0;
+    Long packed_bytes = 0;
+
+    // Packed pages brought back because something used them again
+    Long unpacked = 0;
+};
+
+// Accesses a page took while access sampling was on
+struct AccessCounts {
+    Long reads = 0;
+    Long writes = 0;
+
+    // AMOs, LR and SC
+    Long atomics = 0;
+
+    inline Long Total() const { return reads + writes + atomics; }
+};
+
+// One sampling window. Pages are the touched ones in address order, and
+// regions hold the same counts summed, one per region in GetMemoryRegions
+// order
+struct AccessStats {
+    std::vector<std::pair<Address, AccessCounts>> pages;
+    std::vector<AccessCounts> regions;
+    double seconds = 0.0;
+};
+
+// How ReadFileInto and WriteToFile move the data
+struct FileTransferOptions {
+    // Threads sharing the chunks, 0 for one per host CPU
+    unsigned threads = 0;
+
+    // Bypasses the host's page cache where the file system allows it
+    bool direct_io = false;
+};
 
 class MemoryRegion {
 public:
@@ -19,13 +113,31 @@ public:
     const Address base, size;
     const bool readable, writable;
 
+    // The guest NUMA node the region belongs to, as the PMA ROM reports it
+    Word node = 0;
+
+    // Set by the Memory the region is added to, for devices that access
+    // the rest of the machine
+    Memory* memory = nullptr;
+
+    // Set by the Memory the region is added to. Bumped whenever host
+    // pointers handed out for the region may have gone stale
+    std::atomic<Word>* host_page_generation = nullptr;
+
     static constexpr Word TYPE_UNKNOWN = -1U;
     static constexpr Word TYPE_UNUSED = 0;
     static constexpr Word TYPE_PMA_ROM = 1;
-    static constexpr Word TYPE_MAPPED_CSRS = 2;
+    static constexpr Word TYPE_CLINT = 2;
     static constexpr Word TYPE_BIOS_ROM = 4;
     static constexpr Word TYPE_GENERAL_RAM = 5;
     static constexpr Word TYPE_FRAMEBUFFER = 8;
+    static constexpr Word TYPE_DMA = 9;
+    static constexpr Word TYPE_BLOCK = 10;
+    static constexpr Word TYPE_CONSOLE = 11;
+    static constexpr Word TYPE_INPUT = 12;
+    static constexpr Word TYPE_PLIC = 13;
+    static constexpr Word TYPE_BALLOON = 14;
+    static constexpr Word TYPE_NET = 15;
 
     MemoryRegion(Word type, Word flags, Address base, Address size, bool readable, bool writable) : type{type}, flags{flags}, base{base}, size{size}, readable{readable}, writable{writable} {}
     virtual ~MemoryRegion() = default;
@@ -40,6 +152,66 @@ public:
     virtual void WriteHalf(Address, Half);
     virtual void WriteByte(Address, Byte);
 
+    virtual void Prefault(Address, Address) {}
+
+    // Copies bytes out of regions backed by plain memory, without faulting
+    // anything in. Regions that return false are read an access at a time
+    virtual bool ReadBytes(Address, Byte*, Address) const { return false; }
+
+    // Host memory backing the page at a page aligned offset, or nullptr when
+    // accesses must go through the virtual calls
+    virtual Byte* GetHostPage(Address) { return nullptr; }
+
+    // Host memory of a page still shared copy-on-write with another region,
+    // or nullptr once the page is private. Must only be read
+    virtual const Byte* GetSharedHostPage(Address) { return nullptr; }
+
+    // A region for a cloned Memory that starts with the same contents.
+    // Read only regions without a clone are shared as they are
+    virtual std::shared_ptr<MemoryRegion> Clone() { return nullptr; }
+
+    // Makes the current contents what Rewind goes back to. Harts must not be
+    // running
+    virtual void Freeze() {}
+
+    // Puts the contents back to where the last Freeze or Clone left them, or
+    // to zeros, keeping the host memory behind them. Harts must not be
+    // running. False for regions that can't
+    virtual bool Rewind() { return false; }
+
+    // Snapshot support. Offsets of the pages that may hold data, in order.
+    // Regions that return none aren't saved
+    virtual std::vector<Address> GetSavedPages() const { return {}; }
+
+    // Returns every page to zero before a restore
+    virtual void DiscardPages() {}
+
+    // Gives the host back the whole pages in [offset, offset + bytes) the
+    // guest says it's done with. They read as zero, or as an image still
+    // shared with a clone, once the guest uses them again. Safe while harts
+    // run. Returns the bytes freed
+    virtual Address ReleasePages(Address, Address) { return 0; }
+
+    // Frees pages holding nothing but zeros. Harts must not be running.
+    // Returns the bytes freed
+    virtual Address ReclaimZeroPages() { return 0; }
+
+    // Packs pages nothing has looked up since the last call, until about
+    // bytes of host memory are saved. Called with 0 it only starts a new
+    // period for telling which pages are cold. Harts must not be running.
+    // Returns the bytes saved
+    virtual Address CompressColdPages(Address) { return 0; }
+
+    virtual CompressionStats GetCompressionStats() const { return {}; }
+
+    // Maps saved pages from an open snapshot file over the region. Regions
+    // that return false get the pages copied through GetHostPage instead
+    virtual bool MapFilePages(Address, Address, int, Long) { return false; }
+
+    // Pages written since their bits were last taken, or nullptr for regions
+    // that don't track stores. Those count as dirty everywhere
+    virtual DirtyPages* GetDirtyPages() { return nullptr; }
+
     virtual void Lock() const = 0;
     virtual void Unlock() const = 0;
 
@@ -67,41 +239,258 @@ public:
 
 private:
     using Page = std::array<Long, LONGS_PER_PAGE>;
-    using PagePtr = std::unique_ptr<Page>;
-    mutable std::vector<PagePtr> pages;
-    mutable size_t loaded_pages = 0;
-
-    inline void EnsurePageIsLoaded(size_t page) const {
-        if (pages[page] == nullptr) {
-            lock.lock();
-            if (pages[page]) {
-                lock.unlock();
-                return;
-            }
 
-            pages[page] = std::unique_ptr<Page>(new Page);
-            for (auto& word : *pages[page])
-                word = 0;
-            loaded_pages++;
-            lock.unlock();
-        }
+    // Pages sit in a two level table. The top level has a slot for every
+    // LEAF_PAGES pages and a leaf is only allocated once one of its pages
+    // is, so the table grows with what the guest touches rather than with
+    // the size of the region
+    static constexpr size_t LEAF_PAGES = 512;
+
+    using Leaf = std::array<std::atomic<Page*>, LEAF_PAGES>;
+    using SharedLeaf = std::array<const Page*, LEAF_PAGES>;
+
+    // Pages frozen by a clone. Every region cloned from the same parent
+    // reads them until it writes, then copies the page. An image keeps the
+    // image it was frozen on top of alive, since it points into it
+    struct SharedPages {
+        std::vector<std::unique_ptr<SharedLeaf>> leaves;
+        std::vector<std::unique_ptr<const Page>> owned;
+        std::shared_ptr<const SharedPages> base;
+    };
+
+    // Leaves and pages are installed with a compare-exchange so first
+    // touches from several harts never serialize. The mutex only backs
+    // Lock/Unlock
+    const size_t pages_count;
+    const size_t leaves_count;
+    const std::unique_ptr<std::atomic<Leaf*>[]> leaves;
+    mutable std::atomic<size_t> loaded_pages = 0;
+
+    std::shared_ptr<const SharedPages> shared;
+
+    // Pages and leaves taken out of the table while harts or device threads
+    // may still hold pointers into them. They're freed by the next reclaim or
+    // compression pass, which runs with no hart running and no copy under way
+    std::vector<std::unique_ptr<Page>> retired;
+    std::vector<std::unique_ptr<Leaf>> retired_leaves;
+    std::mutex retired_lock;
+
+    void RetirePage(Page* page);
+    void FreeRetired();
+
+    DirtyPages dirty;
+
+    // Pages that may have changed since the last Freeze or Rewind, so a
+    // Rewind only visits those. Never taken by anything else
+    DirtyPages written;
+
+    // Set whenever a page is looked up, and cleared by each compression
+    // pass. Harts cache host pointers, so the pass also makes them look
+    // their pages up again
+    mutable DirtyPages referenced;
+
+    // Cold pages packed by CompressColdPages. A page is either in the table
+    // or here, and is unpacked back into the table under the lock the first
+    // time anything needs it
+    mutable std::unordered_map<size_t, std::vector<Byte>> packed;
+    mutable std::mutex packed_lock;
+    mutable std::atomic<size_t> packed_pages = 0;
+    mutable std::atomic<Long> packed_bytes = 0;
+    mutable std::atomic<Long> unpacked = 0;
+
+    Page& LoadPage(size_t page) const;
+    Leaf& LoadLeaf(size_t leaf) const;
+    Page* UnpackPage(size_t page) const;
+    bool CopyPackedPage(size_t page, Page& into) const;
+    void UnpackAllPages();
+
+    inline Page* FindPage(size_t page) const {
+        auto leaf = leaves[page / LEAF_PAGES].load(std::memory_order_acquire);
+        return leaf ? (*leaf)[page % LEAF_PAGES].load(std::memory_order_acquire) : nullptr;
+    }
+
+    inline Page& EnsurePageIsLoaded(size_t page) const {
+        referenced.Mark(page * PAGE_SIZE);
+
+        if (auto loaded = FindPage(page)) return *loaded;
+
+        return LoadPage(page);
+    }
+
+    inline const Page* GetSharedPage(size_t page) const {
+        if (!shared) return nullptr;
+
+        auto& leaf = shared->leaves[page / LEAF_PAGES];
+        return leaf ? (*leaf)[page % LEAF_PAGES] : nullptr;
+    }
+
+    // Reads leave shared pages shared
+    inline const Page& GetReadablePage(size_t page) const {
+        referenced.Mark(page * PAGE_SIZE);
+
+        if (auto loaded = FindPage(page)) return *loaded;
+
+        if (auto shared_page = GetSharedPage(page))
+            return *shared_page;
+
+        return LoadPage(page);
     }
 
     MemoryRAM(Address base, Address size);
 
     mutable std::mutex lock;
 public:
+    ~MemoryRAM();
+
     Long ReadLong(Address address) const override;
     void WriteLong(Address address, Long vlong) override;
 
+    void Prefault(Address address, Address bytes) override;
+
+    // Pages never touched read as zero and stay unallocated
+    bool ReadBytes(Address address, Byte* bytes, Address count) const override;
+
+    Byte* GetHostPage(Address address) override {
+        if (address % PAGE_SIZE) return nullptr;
+
+        written.Mark(address);
+        return reinterpret_cast<Byte*>(EnsurePageIsLoaded(address / PAGE_SIZE).data());
+    }
+
+    const Byte* GetSharedHostPage(Address address) override {
+        if (address % PAGE_SIZE) return nullptr;
+
+        auto page = address / PAGE_SIZE;
+        if (FindPage(page)) return nullptr;
+
+        return reinterpret_cast<const Byte*>(GetSharedPage(page));
+    }
+
+    // Freezes this region's pages into an image shared with the clone, so
+    // both sides copy a page on their first write to it
+    std::shared_ptr<MemoryRegion> Clone() override;
+
+    // The same freeze without a clone. Pages then go back to the image on a
+    // Rewind, copied over the private pages written since so those stay
+    // allocated for the next run
+    void Freeze() override;
+    bool Rewind() override;
+
+    std::vector<Address> GetSavedPages() const override;
+    void DiscardPages() override;
+
+    Address ReleasePages(Address offset, Address bytes) override;
+    Address ReclaimZeroPages() override;
+
+    // Pages still shared with a clone are left alone, and so are pages that
+    // don't pack to PACKED_LIMIT bytes or less
+    static constexpr Address PACKED_LIMIT = PAGE_SIZE * 3 / 4;
+
+    Address CompressColdPages(Address bytes) override;
+    CompressionStats GetCompressionStats() const override;
+
+    DirtyPages* GetDirtyPages() override { return &dirty; }
+
     void Lock() const override { lock.lock(); }
     void Unlock() const override { lock.unlock(); }
 
-    Long SizeInMemory() const override { return loaded_pages * PAGE_SIZE; }
+    // Pages still shared with a clone aren't counted, packed pages count
+    // as their packed size
+    Long SizeInMemory() const override { return loaded_pages.load(std::memory_order_relaxed) * PAGE_SIZE + packed_bytes.load(std::memory_order_relaxed); }
 
     static std::unique_ptr<MemoryRAM> Create(Address base, Address size);
 };
 
+// Guest RAM reserved in one host mapping. The OS hands out zeroed pages on
+// first touch, so only memory the guest uses becomes resident
+class MemoryMappedRAM : public MemoryRegion {
+public:
+    static constexpr Long PAGE_SIZE = 0x1000;
+
+private:
+    Byte* host = nullptr;
+    const bool huge_pages;
+    const Word host_node;
+
+    // Ranges mapped from a snapshot file. The kernel may report them as not
+    // resident even though they hold data
+    std::vector<std::pair<Address, Address>> file_pages;
+
+#if defined(_WIN32) || defined(_WIN64)
+    // Windows can't demand-commit a reservation, so granules are committed
+    // on first touch
+    static constexpr Long COMMIT_SIZE = 0x10000;
+
+    const std::unique_ptr<std::atomic<Long>[]> committed;
+    mutable std::atomic<size_t> committed_granules = 0;
+
+    void Commit(size_t granule) const;
+
+    inline void EnsureCommitted(Address address) const {
+        auto granule = address / COMMIT_SIZE;
+        if (!(committed[granule / 64].load(std::memory_order_acquire) & (1ULL << (granule % 64))))
+            Commit(granule);
+    }
+#else
+    inline void EnsureCommitted(Address) const {}
+#endif
+
+    MemoryMappedRAM(Address base, Address size, bool huge_pages, Word host_node);
+
+    mutable std::mutex lock;
+
+    template <typename T>
+    inline T Read(Address address) const {
+        EnsureCommitted(address);
+        return *reinterpret_cast<const T*>(host + address);
+    }
+
+    template <typename T>
+    inline void Write(Address address, T value) {
+        EnsureCommitted(address);
+        *reinterpret_cast<T*>(host + address) = value;
+    }
+
+public:
+    ~MemoryMappedRAM();
+
+    Long ReadLong(Address address) const override { return Read<Long>(address); }
+    Word ReadWord(Address address) const override { return Read<Word>(address); }
+    Half ReadHalf(Address address) const override { return Read<Half>(address); }
+    Byte ReadByte(Address address) const override { return Read<Byte>(address); }
+
+    void WriteLong(Address address, Long vlong) override { Write(address, vlong); }
+    void WriteWord(Address address, Word word) override { Write(address, word); }
+    void WriteHalf(Address address, Half half) override { Write(address, half); }
+    void WriteByte(Address address, Byte byte) override { Write(address, byte); }
+
+    void Prefault(Address address, Address bytes) override;
+
+    bool ReadBytes(Address address, Byte* bytes, Address count) const override;
+
+    Byte* GetHostPage(Address address) override {
+        if (address % PAGE_SIZE) return nullptr;
+
+        EnsureCommitted(address);
+        return host + address;
+    }
+
+    std::vector<Address> GetSavedPages() const override;
+    void DiscardPages() override;
+    bool MapFilePages(Address address, Address bytes, int fd, Long file_offset) override;
+
+    Address ReleasePages(Address offset, Address bytes) override;
+    Address ReclaimZeroPages() override;
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    Long SizeInMemory() const override;
+
+    // A host_node binds every page to that host NUMA node
+    static std::unique_ptr<MemoryMappedRAM> Create(Address base, Address size, bool huge_pages = false, Word host_node = NUMA::NO_NODE);
+};
+
 class Memory {
 public:
     static constexpr Long TOTAL_MEMORY = 0x100000000;
@@ -109,26 +498,210 @@ public:
     static constexpr Long TOTAL_PAGES = TOTAL_MEMORY / PAGE_SIZE;
     static constexpr Long WORDS_PER_PAGE = PAGE_SIZE / sizeof(Word);
 
+    // Bits of the accesses a watchpoint stops on
+    enum class WatchKind : Byte {
+        Read = 1,
+        Write = 2,
+        Access = 3
+    };
+
+    // Why a Try access didn't happen
+    enum class AccessFault : Byte {
+        None,
+        Misaligned,
+        Unmapped,
+        Denied
+    };
+
+    struct Watchpoint {
+        Address address;
+        Address length;
+        WatchKind kind;
+
+        bool operator==(const Watchpoint&) const = default;
+    };
+
 private:
     std::vector<std::shared_ptr<MemoryRegion>> regions;
 
-    mutable std::unordered_map<Hart, Address> reservations;
-    mutable std::mutex lock;
+    std::atomic<Word> host_page_generation = 0;
+
+    // Used memory above compress_high starts packing cold pages, which
+    // stops once it's back down to compress_low. 0 never packs
+    Address compress_high = 0;
+    Address compress_low = 0;
+
+    // Held shared by bulk copies into and out of RAM, which device threads,
+    // capture and viewers make while harts run. Passes that free RAM pages
+    // hold it whole, so no copy is between finding a page and using it
+    mutable std::shared_mutex copies_lock;
+
+    // Guest physical. Harts get no host pointers into watched pages, so
+    // only accesses to those pages ever look at the list
+    std::vector<Watchpoint> watchpoints;
+    mutable std::mutex watchpoints_lock;
+    std::atomic<bool> watching = false;
+
+    // LR/SC reservations are per hart and cover a whole line. Each hart's
+    // slot holds its line with RESERVATION_VALID set, and the filter counts
+    // live reservations per hashed line so stores only scan the slots when
+    // some hart may hold their line. Only the owning hart touches its
+    // reserved value, which SC compares against so the store is atomic
+    static constexpr Hart MAX_RESERVATION_HARTS = 4096;
+    static constexpr Address RESERVATION_LINE = 64;
+    static constexpr Address RESERVATION_VALID = 1;
+    static constexpr size_t RESERVATION_FILTER_SLOTS = 1024;
+
+    const std::unique_ptr<std::atomic<Address>[]> reservations;
+    const std::unique_ptr<Long[]> reserved_values;
+    mutable std::array<std::atomic<Word>, RESERVATION_FILTER_SLOTS> reservation_filter{};
+    mutable std::atomic<Hart> reservation_harts = 0;
+
+    inline static Address GetReservationLine(Address address) {
+        return (address & ~(RESERVATION_LINE - 1)) | RESERVATION_VALID;
+    }
+
+    inline static size_t GetReservationSlot(Address address) {
+        return (address / RESERVATION_LINE) % RESERVATION_FILTER_SLOTS;
+    }
+
+    void Reserve(Address address, Hart hart_id) const;
+    void InvalidateReservations(Address address);
+
+    std::vector<DirtyPages::Range> CollectDirtyRanges(Address address, Address bytes, bool take);
+
+    // The region behind address and how many of the next bytes it covers.
+    // Without a region, the bytes until the next one starts
+    std::pair<const MemoryRegion*, Address> GetRun(Address address, Address bytes) const;
+
+    // The parts of [address, address + bytes) that may hold data, which is
+    // all of it but RAM pages never touched. Throws where nothing is mapped
+    std::vector<std::pair<Address, Address>> GetHeldRanges(Address address, Address bytes) const;
+
+    std::vector<std::pair<Address, Address>> CopyOut(Address address, std::span<Byte> bytes, bool peek) const;
+
+    template <typename T>
+    bool WriteConditional(Address address, T value, Hart hart_id);
+
+    enum class AtomicOp {
+        Swap,
+        Add,
+        And,
+        Or,
+        Xor,
+        Min,
+        MinU,
+        Max,
+        MaxU
+    };
+
+    // Returns the old value. Min and Max compare as signed
+    template <typename T>
+    T Atomic(Address address, T value, AtomicOp op);
+
+    static constexpr Long ROUTE_CHUNK_SIZE = 0x200000;
+    static constexpr Long PAGES_PER_ROUTE_CHUNK = ROUTE_CHUNK_SIZE / PAGE_SIZE;
+    static constexpr Address ROUTED_MEMORY = 0x10000000000;
+
+    // A chunk owned entirely by one region routes straight from the top level.
+    // Otherwise each page points at its region, or at a marker telling the
+    // lookup to scan when several regions share the page. Addresses past
+    // ROUTED_MEMORY always scan
+    struct RouteChunk {
+        MemoryRegion* region = nullptr;
+        std::unique_ptr<std::array<MemoryRegion*, PAGES_PER_ROUTE_CHUNK>> pages;
+    };
+
+    std::vector<RouteChunk> routes;
+
+    void AddRoute(MemoryRegion* region);
+
+    const MemoryRegion* FindMemoryRegion(Address address) const;
 
     MemoryRegion* GetMemoryRegion(Address address);
     const MemoryRegion* GetMemoryRegion(Address address) const;
 
+    enum class AccessKind : Byte {
+        Read,
+        Write,
+        Atomic
+    };
+
+    // Each thread counts into a shard of its own, so harts never wait on
+    // each other, and reading the counts merges the shards. Shards live as
+    // long as the Memory since threads keep pointing at theirs, and a
+    // thread coming back finds its old one
+    struct AccessShard {
+        std::thread::id owner;
+        std::mutex lock;
+        std::unordered_map<Address, AccessCounts> pages;
+    };
+
+    // Tells apart Memories a thread has counted for, even at a reused address
+    inline static std::atomic<Long> next_id = 0;
+    const Long id = next_id.fetch_add(1);
+
+    std::atomic<bool> sampling = false;
+    mutable std::mutex access_shards_lock;
+    mutable std::vector<std::unique_ptr<AccessShard>> access_shards;
+    std::chrono::steady_clock::time_point window_start;
+
+    AccessShard& GetAccessShard() const;
+    void CountAccess(Address address, AccessKind kind) const;
+
+    inline void Sample(Address address, AccessKind kind) const {
+        if (sampling.load(std::memory_order_relaxed)) [[unlikely]]
+            CountAccess(address, kind);
+    }
+
+    // The checks every access shares. region is set whenever it's found
+    AccessFault Route(Address address, Address bytes, bool is_write, const MemoryRegion*& region) const;
+
+    template <typename T>
+    std::pair<T, AccessFault> TryRead(Address address, AccessKind kind = AccessKind::Read) const;
+
+    template <typename T>
+    AccessFault TryWrite(Address address, T value);
+
     Address max_address = 0;
     Address memory_size = 0;
 
+    static constexpr size_t CODE_PAGE_SLOTS = 4096;
+
+    mutable std::array<std::atomic<Long>, CODE_PAGE_SLOTS / 64> code_pages{};
+    std::array<std::atomic<Word>, CODE_PAGE_SLOTS> code_page_versions{};
+
+    inline static size_t GetCodePageSlot(Address address) {
+        return (address / PAGE_SIZE) % CODE_PAGE_SLOTS;
+    }
+
+    // Guest NUMA node of each hart, one byte per hart
+    std::vector<Byte> hart_nodes;
+
+    // Four longs per region, type, base, size and flags with the region's
+    // node in bits 16 and up. The hart node bytes follow the regions
     class MemoryPMARom : public MemoryRegion {
     private:
         const std::vector<std::shared_ptr<MemoryRegion>>& regions;
+        const std::vector<Byte>& hart_nodes;
 
     public:
-        MemoryPMARom(std::vector<std::shared_ptr<MemoryRegion>>& regions) : MemoryRegion{TYPE_PMA_ROM, 0, 0, 0x200, true, false}, regions{regions} {}
+        static constexpr Address HART_NODES_OFFSET = 0x200;
+        static constexpr Hart MAX_HART_NODES = 0x200;
+
+        MemoryPMARom(std::vector<std::shared_ptr<MemoryRegion>>& regions, std::vector<Byte>& hart_nodes) : MemoryRegion{TYPE_PMA_ROM, 0, 0, HART_NODES_OFFSET + MAX_HART_NODES, true, false}, regions{regions}, hart_nodes{hart_nodes} {}
 
         Long ReadLong(Address address) const override {
+            if (address >= HART_NODES_OFFSET) {
+                Long nodes = 0;
+                Address first = address - HART_NODES_OFFSET;
+
+                for (Address i = 0; i < sizeof(Long) && first + i < hart_nodes.size(); i++)
+                    nodes |= static_cast<Long>(hart_nodes[first + i]) << (i * 8);
+
+                return nodes;
+            }
+
             address >>= 3;
             auto index = address >> 2;
             if (index >= regions.size()) return 0;
@@ -151,6 +724,8 @@ private:
                     if (region->readable) flags |= (1<<0);
                     if (region->writable) flags |= (1<<1);
 
+                    flags |= region->node << 16;
+
                     return flags;
                 }
             }
@@ -163,8 +738,8 @@ private:
         Long SizeInMemory() const { return sizeof(std::vector<std::shared_ptr<MemoryRegion>>&); }
     };
 public:
-    Memory() {
-        auto pma = std::make_unique<MemoryPMARom>(regions);
+    Memory() : reservations{std::make_unique<std::atomic<Address>[]>(MAX_RESERVATION_HARTS)}, reserved_values{std::make_unique<Long[]>(MAX_RESERVATION_HARTS)} {
+        auto pma = std::make_unique<MemoryPMARom>(regions, hart_nodes);
         AddMemoryRegion(std::move(pma));
     };
 
@@ -175,6 +750,8 @@ public:
     Memory& operator=(const Memory&) = delete;
     Memory& operator=(Memory&&) = delete;
 
+    // These throw on a bad address, for the host side that can't go on
+    // without the data
     Long ReadLong(Address address) const;
     Word ReadWord(Address address) const;
     Half ReadHalf(Address address) const;
@@ -182,8 +759,22 @@ public:
 
     std::pair<Long, bool> PeekLong(Address address) const;
     std::pair<Word, bool> PeekWord(Address address) const;
-    bool TryWriteLong(Address address, Long vlong);
-    bool TryWriteWord(Address address, Word word);
+    std::pair<Half, bool> PeekHalf(Address address) const;
+
+    // Guest accesses, which report a bad address instead of throwing so the
+    // hart can trap on it. Nothing is read or written on a fault
+    std::pair<Long, AccessFault> TryReadLong(Address address) const;
+    std::pair<Word, AccessFault> TryReadWord(Address address) const;
+    std::pair<Half, AccessFault> TryReadHalf(Address address) const;
+    std::pair<Byte, AccessFault> TryReadByte(Address address) const;
+
+    AccessFault TryWriteLong(Address address, Long vlong);
+    AccessFault TryWriteWord(Address address, Word word);
+    AccessFault TryWriteHalf(Address address, Half half);
+    AccessFault TryWriteByte(Address address, Byte byte);
+
+    // The fault an access of bytes would take, without making it
+    AccessFault Probe(Address address, Address bytes, bool is_write) const;
 
     void WriteLong(Address address, Long vlong);
     void WriteWord(Address address, Word word);
@@ -210,6 +801,41 @@ public:
     SWord AtomicMaxW(Address address, SWord word);
     Word AtomicMaxUW(Address address, Word word);
 
+    using Range = std::pair<Address, Address>;
+
+    // Bulk copies that look the region up once per run and memcpy whatever
+    // is backed by host memory. Read and Write throw like single accesses
+    // when part of the range isn't mapped. Peek zeroes those bytes instead
+    // and returns the mapped runs as merged [start, end) addresses
+    void ReadBytes(Address address, std::span<Byte> bytes) const;
+    void WriteBytes(Address address, std::span<const Byte> bytes);
+    std::vector<Range> PeekBytes(Address address, std::span<Byte> bytes) const;
+
+    template <typename T>
+    inline void Read(Address address, std::span<T> values) const {
+        ReadBytes(address, {reinterpret_cast<Byte*>(values.data()), values.size_bytes()});
+    }
+
+    template <typename T>
+    inline void Write(Address address, std::span<const T> values) {
+        WriteBytes(address, {reinterpret_cast<const Byte*>(values.data()), values.size_bytes()});
+    }
+
+    template <typename T>
+    inline std::vector<Range> Peek(Address address, std::span<T> values) const {
+        return PeekBytes(address, {reinterpret_cast<Byte*>(values.data()), values.size_bytes()});
+    }
+
+    // Whether [address, address + bytes) lies inside one of the runs Peek
+    // returned
+    inline static bool IsInRanges(const std::vector<Range>& ranges, Address address, Address bytes) {
+        for (auto& [start, end] : ranges) {
+            if (address >= start && address + bytes <= end) return true;
+        }
+
+        return false;
+    }
+
     void WriteLongs(Address address, const std::vector<Long>& longs);
     void WriteWords(Address address, const std::vector<Word>& words);
 
@@ -225,8 +851,149 @@ public:
     bool WriteLongConditional(Address address, Long vlong, Hart hart_id);
     bool WriteWordConditional(Address address, Word word, Hart hart_id);
 
-    Address ReadFileInto(const std::string& path, Address address);
-    void WriteToFile(const std::string& path, Address address, Address bytes);
+    // Call before writing through a host page so decoded code is dropped
+    inline void NotifyWrite(Address address) {
+        auto slot = GetCodePageSlot(address);
+        Long bit = 1ULL << (slot % 64);
+
+        if (code_pages[slot / 64].load(std::memory_order_relaxed) & bit) {
+            code_pages[slot / 64].fetch_and(~bit);
+            code_page_versions[slot].fetch_add(1);
+        }
+
+        if (reservation_filter[GetReservationSlot(address)].load() != 0)
+            InvalidateReservations(address);
+    }
+
+    // Range form for bulk writes. Drops decoded code on every page and any
+    // reservation inside the range
+    void NotifyWrite(Address address, Address bytes);
+
+    // Returns the host memory behind a whole guest page and whether it may be
+    // written, or nullptr for MMIO and pages split between regions
+    std::pair<Byte*, bool> GetHostPage(Address address);
+
+    // The dirty bit a store through a host page must set once it lands, or
+    // nullptr when the page's region doesn't track stores
+    std::pair<std::atomic<Long>*, Long> GetDirtyBit(Address address);
+
+    inline void MarkDirty(Address address) {
+        if (auto [word, bit] = GetDirtyBit(address); word)
+            DirtyPages::Mark(*word, bit);
+    }
+
+    // Guest physical runs of pages written since they were last taken,
+    // within [address, address + bytes). Regions that don't track stores
+    // are reported whole. Every consumer shares the same bits
+    std::vector<DirtyPages::Range> PeekDirtyRanges(Address address, Address bytes);
+    std::vector<DirtyPages::Range> TakeDirtyRanges(Address address, Address bytes);
+
+    // Host memory a page can be read through while it's shared copy-on-write
+    // with a clone, or nullptr when GetHostPage should be used
+    const Byte* GetSharedHostPage(Address address);
+
+    // Changes whenever host pages handed out earlier may no longer be the
+    // ones to use, after a clone or a copy-on-write
+    inline Word GetHostPageGeneration() const {
+        return host_page_generation.load(std::memory_order_acquire);
+    }
+
+    void AddWatchpoint(const Watchpoint& watchpoint);
+    bool RemoveWatchpoint(const Watchpoint& watchpoint);
+    void ClearWatchpoints();
+
+    inline bool IsWatching() const {
+        return watching.load(std::memory_order_relaxed);
+    }
+
+    // Whether any watchpoint touches the page holding address
+    bool IsWatchedPage(Address address) const;
+
+    // The first watchpoint overlapping [address, address + bytes) that stops
+    // on this kind of access
+    std::optional<Watchpoint> FindWatchpoint(Address address, Address bytes, WatchKind access) const;
+
+    // A new Memory with the same regions and contents. RAM pages are shared
+    // copy-on-write, the CLINT starts at this one's time and harts aren't
+    // carried over. Harts on this Memory must not be running
+    std::unique_ptr<Memory> Clone();
+
+    // Back to how a new Memory starts, with only the PMA ROM mapped, while
+    // keeping what was allocated for it. No hart may still be using it
+    void Reset();
+
+    // Makes what RAM holds now, such as a loaded program, the point Rewind
+    // goes back to. Pages are shared from then on and copied on their first
+    // write. Harts must not be running
+    void Freeze();
+
+    // Puts RAM back to where the last Freeze or Clone left it, or to zeros,
+    // keeping the regions and the host pages behind them, so it costs what
+    // the pages written since take. Decoded code and reservations are
+    // dropped, and harts should be Reset before they run again. Throws when
+    // a RAM region can't be rewound. Harts must not be running
+    void Rewind();
+
+    inline void MarkCodePage(Address address) const {
+        auto slot = GetCodePageSlot(address);
+        code_pages[slot / 64].fetch_or(1ULL << (slot % 64));
+    }
+
+    inline Word GetCodePageVersion(Address address) const {
+        return code_page_versions[GetCodePageSlot(address)].load(std::memory_order_relaxed);
+    }
+
+    void Prefault(Address address, Address bytes);
+
+    // Hands the RAM pages inside [address, address + bytes) back to the
+    // host, for a balloon. Decoded code on them is dropped. Returns the
+    // bytes freed
+    Address ReleasePages(Address address, Address bytes);
+
+    // Frees RAM pages that only hold zeros, so GetUsedMemory goes back down
+    // to the working set. Harts must not be running, and copies from other
+    // threads wait for it
+    Address ReclaimZeroPages();
+
+    // Sets when CompressColdPages packs pages. low is capped at high
+    inline void SetCompressionThresholds(Address high, Address low) {
+        compress_high = high;
+        compress_low = low < high ? low : high;
+    }
+
+    // Meant to run every so often. Pages that went unused since the last
+    // call count as cold, and are packed if used memory is past the high
+    // threshold. Harts must not be running, and copies from other threads
+    // wait for it. Returns the bytes saved
+    Address CompressColdPages();
+
+    CompressionStats GetCompressionStats() const;
+
+    // Counts reads, writes and atomics per page while on. Harts drop their
+    // host pages meanwhile, so all their accesses come through here and
+    // run slower. Turning it on starts a new window
+    void SetAccessSampling(bool enabled);
+
+    inline bool IsSampling() const {
+        return sampling.load(std::memory_order_relaxed);
+    }
+
+    // The counts since the window started. Take also starts the next one
+    AccessStats GetAccessStats() const;
+    AccessStats TakeAccessStats();
+
+    // One line per page, with the region it's in and its counts
+    void WriteAccessStats(const std::string& path, const AccessStats& stats) const;
+
+    // Raw images, streamed a chunk at a time on several threads, so neither
+    // side holds more than a chunk per thread. Dumps leave RAM pages that
+    // were never touched or only hold zeros as holes in a sparse file, and
+    // loads skip holes, only zeroing the pages under them that memory
+    // already holds. Harts must not be running
+    static constexpr Address FILE_CHUNK_SIZE = 0x100000;
+
+    Address ReadFileInto(const std::string& path, Address address, const FileTransferOptions& options = {});
+    void WriteToFile(const std::string& path, Address address, Address bytes, const FileTransferOptions& options = {});
 
     inline Address GetMaxAddress() const {
         return max_address;
@@ -248,15 +1015,46 @@ public:
         return used;
     }
 
+    // Only for the guest to read back from the PMA ROM, before harts run
+    inline void SetHartNode(Hart hart, Word node) {
+        if (hart >= MemoryPMARom::MAX_HART_NODES) return;
+
+        if (hart >= hart_nodes.size()) hart_nodes.resize(hart + 1);
+        hart_nodes[hart] = static_cast<Byte>(node);
+    }
+
+    inline Word GetHartNode(Hart hart) const {
+        return hart < hart_nodes.size() ? hart_nodes[hart] : 0;
+    }
+
+    inline const std::vector<std::shared_ptr<MemoryRegion>>& GetMemoryRegions() const {
+        return regions;
+    }
+
+    template <typename T>
+    std::shared_ptr<T> FindMemoryRegionOfType(Word type) const {
+        static_assert(std::is_base_of_v<MemoryRegion, T>);
+
+        for (auto& region : regions) {
+            if (region->type == type)
+                return std::static_pointer_cast<T>(region);
+        }
+
+        return nullptr;
+    }
+
     template <typename T>
     void AddMemoryRegion(std::shared_ptr<T> region) {
         static_assert(std::is_base_of_v<MemoryRegion, T>);
 
         auto mem_region = std::shared_ptr<MemoryRegion>(region);
+        mem_region->memory = this;
+        mem_region->host_page_generation = &host_page_generation;
 
         Address end = mem_region->base + mem_region->size;
         memory_size += mem_region->size;
 
+        AddRoute(mem_region.get());
         regions.emplace_back(std::move(mem_region));
 
         if (end > max_address)
@@ -268,10 +1066,13 @@ public:
         static_assert(std::is_base_of_v<MemoryRegion, T>);
 
         auto mem_region = std::shared_ptr<MemoryRegion>(region.release());
+        mem_region->memory = this;
+        mem_region->host_page_generation = &host_page_generation;
 
         Address end = mem_region->base + mem_region->size;
         memory_size += mem_region->size;
 
+        AddRoute(mem_region.get());
         regions.emplace_back(std::move(mem_region));
 
         if (end > max_address)
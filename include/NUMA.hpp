@@ -0,0 +1,28 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include "Types.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// The host's NUMA nodes, for guests that split their RAM into nodes of
+// their own. Hosts without NUMA, or without a way to ask, have one node
+// holding every CPU and binding is then a no-op
+class NUMA {
+public:
+    static constexpr Word NO_NODE = -1U;
+
+    static Word GetNodeCount();
+    static std::vector<size_t> GetNodeCPUs(Word node);
+
+    // Every page of [address, address + bytes) comes from the node from
+    // then on, whichever thread touches it first. The range must be page
+    // aligned and not yet touched
+    static bool BindMemory(void* address, size_t bytes, Word node);
+
+    // Lets the calling thread run only on the node's CPUs
+    static bool PinThread(Word node);
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef NET_DEVICE_HPP
+#define NET_DEVICE_HPP
+
+#include "Memory.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Ethernet card with its frames in guest memory. Like the block device the
+// guest keeps rings of descriptors and rings TX_SUBMIT and RX_SUBMIT with
+// free running counts: one descriptor per frame to send, and one per
+// buffer the card may receive a frame into. A doorbell sends every frame
+// queued so far, straight from guest pages, and frames coming in land
+// straight in guest pages too.
+//
+// Finished frames are counted in TX_COMPLETED and RX_COMPLETED. The
+// interrupt is raised once COALESCE_FRAMES of either finished, or
+// COALESCE_MICROS after the first that wasn't signalled yet, whichever comes
+// first. With COALESCE_MICROS at 0 every frame raises it
+class MemoryNetDevice : public MemoryRegion {
+public:
+    static constexpr Address DEFAULT_BASE = 0x2015000;
+    static constexpr Address SIZE = 0x1000;
+
+    static constexpr Address TX_RING_ADDRESS_OFFSET = 0x00;
+    static constexpr Address TX_RING_SIZE_OFFSET = 0x08;
+    static constexpr Address TX_SUBMIT_OFFSET = 0x10;
+    static constexpr Address TX_COMPLETED_OFFSET = 0x18;
+    static constexpr Address RX_RING_ADDRESS_OFFSET = 0x20;
+    static constexpr Address RX_RING_SIZE_OFFSET = 0x28;
+    static constexpr Address RX_SUBMIT_OFFSET = 0x30;
+    static constexpr Address RX_COMPLETED_OFFSET = 0x38;
+    // The low 6 bytes, first byte on the wire lowest
+    static constexpr Address MAC_OFFSET = 0x40;
+    static constexpr Address INTERRUPT_HART_OFFSET = 0x48;
+    static constexpr Address COALESCE_FRAMES_OFFSET = 0x50;
+    static constexpr Address COALESCE_MICROS_OFFSET = 0x58;
+    // Frames that came in with no buffer posted
+    static constexpr Address RX_DROPPED_OFFSET = 0x60;
+    // Reads 1 while the interrupt is raised. Any write clears it
+    static constexpr Address INTERRUPT_OFFSET = 0x68;
+
+    // Descriptor layout in guest memory. The card sets LENGTH to the size of
+    // a frame received, which may be more than the buffer when it didn't fit
+    static constexpr Address DESCRIPTOR_SIZE = 16;
+    static constexpr Address DESCRIPTOR_BUFFER = 0;
+    static constexpr Address DESCRIPTOR_LENGTH = 8;
+    static constexpr Address DESCRIPTOR_STATUS = 12;
+
+    // The guest clears status before submitting, the device sets the rest
+    static constexpr Word STATUS_PENDING = 0;
+    static constexpr Word STATUS_OK = 1;
+    static constexpr Word STATUS_ERROR = 2;
+
+    static constexpr Address MAX_FRAME = 0x10000;
+
+    static constexpr Long DEFAULT_MAC = 0x563412005452;
+
+    // Where frames go to and come from on the host
+    class Backend {
+    public:
+        virtual ~Backend() = default;
+
+        // Called when the card takes the backend and when it lets go of it.
+        // Frames may only be received in between
+        virtual void Attach(MemoryNetDevice& device) = 0;
+        virtual void Detach() = 0;
+
+        // Sends one frame given as pieces in order. Called on the hart that
+        // rang TX_SUBMIT, so it shouldn't wait
+        virtual bool Transmit(std::span<const std::span<const Byte>> frame) = 0;
+    };
+
+    // Writes one frame into the pieces of a guest buffer and returns its
+    // whole size, or 0 when there turned out to be none
+    using Filler = std::function<size_t(std::span<const std::span<Byte>> buffer)>;
+
+private:
+    static constexpr size_t REGISTER_COUNT = INTERRUPT_OFFSET / sizeof(Long) + 1;
+
+    std::array<std::atomic<Long>, REGISTER_COUNT> registers{};
+
+    inline std::atomic<Long>& Register(Address offset) { return registers[offset / sizeof(Long)]; }
+
+    std::shared_ptr<Backend> backend;
+    std::mutex backend_lock;
+
+    // Descriptors already taken, as counts like the doorbells
+    Long tx_consumed = 0;
+    std::mutex tx_lock;
+
+    Long rx_consumed = 0;
+    std::vector<Byte> rx_scratch = std::vector<Byte>(MAX_FRAME);
+    std::mutex rx_lock;
+
+    // Frames finished since the interrupt was last raised, and when the
+    // first of them did
+    Long unsignalled = 0;
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    std::mutex interrupt_lock;
+    std::condition_variable_any interrupt_signal;
+
+    std::jthread coalescer;
+
+    mutable std::mutex lock;
+
+    MemoryNetDevice(Address base, Long mac);
+
+    void Transmit(Long count);
+    void Finished(Long frames);
+    void Coalesce(std::stop_token stop);
+
+    void SetInterrupt(bool pending);
+
+public:
+    // Lets go of the backend first, so nothing comes in while it goes
+    ~MemoryNetDevice();
+
+    Long ReadLong(Address address) const override;
+    Word ReadWord(Address address) const override;
+
+    void WriteLong(Address address, Long vlong) override;
+    void WriteWord(Address address, Word word) override;
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    Long SizeInMemory() const override { return sizeof(MemoryNetDevice); }
+
+    // Replaces the backend. Without one, frames sent are dropped
+    void SetBackend(std::shared_ptr<Backend> backend);
+
+    // Hands the next buffer the guest posted to fill. Without one the frame
+    // is filled into scratch space and dropped, and false comes back
+    bool Receive(const Filler& fill);
+
+    // Receive for a frame the backend already holds
+    bool Receive(std::span<const Byte> frame);
+
+    inline Long GetMAC() const { return registers[MAC_OFFSET / sizeof(Long)].load(); }
+
+    static std::shared_ptr<MemoryNetDevice> Create(Long mac = DEFAULT_MAC, Address base = DEFAULT_BASE);
+
+    // A Linux TAP interface that already exists, like one made with ip
+    // tuntap add. Throws when it can't be opened or elsewhere than Linux
+    static std::shared_ptr<Backend> CreateTAP(const std::string& name);
+};
+
+#endif
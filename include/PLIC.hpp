@@ -0,0 +1,94 @@
+#ifndef PLIC_HPP
+#define PLIC_HPP
+
+#include "Memory.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// PLIC style interrupt controller with the usual SiFive layout. Each hart
+// has a machine context 2 * hart and a supervisor context 2 * hart + 1,
+// which drive its MEIP and SEIP lines. Device threads raise and lower
+// their source without a lock, pending sources are one atomic word, and
+// a claim takes the highest priority source over the context's threshold
+class MemoryPLIC : public MemoryRegion {
+public:
+    static constexpr Address DEFAULT_BASE = 0xc000000;
+    static constexpr Address SIZE = 0x4000000;
+
+    static constexpr Address PRIORITY_OFFSET = 0x0;
+    static constexpr Address PENDING_OFFSET = 0x1000;
+    static constexpr Address ENABLE_OFFSET = 0x2000;
+    static constexpr Address ENABLE_STRIDE = 0x80;
+    static constexpr Address CONTEXT_OFFSET = 0x200000;
+    static constexpr Address CONTEXT_STRIDE = 0x1000;
+    static constexpr Address THRESHOLD_OFFSET = 0x0;
+    static constexpr Address CLAIM_OFFSET = 0x4;
+
+    // Source 0 means no interrupt
+    static constexpr Word SOURCES = 64;
+    static constexpr Hart MAX_HARTS = 32;
+    static constexpr Word CONTEXTS = MAX_HARTS * 2;
+
+    static constexpr Word MAX_PRIORITY = 7;
+
+    // Where the built in devices are wired
+    static constexpr Word SOURCE_DMA = 1;
+    static constexpr Word SOURCE_BLOCK = 2;
+    static constexpr Word SOURCE_INPUT = 3;
+    static constexpr Word SOURCE_BALLOON = 4;
+    static constexpr Word SOURCE_NET = 5;
+
+private:
+    struct Context {
+        std::atomic<Long> enabled = 0;
+        std::atomic<Word> threshold = 0;
+    };
+
+    std::array<std::atomic<Word>, SOURCES> priorities{};
+    std::array<Context, CONTEXTS> contexts{};
+
+    // Lines devices hold up, sources waiting for a claim, and sources
+    // claimed but not completed yet, which don't pend again until then
+    std::atomic<Long> asserted = 0;
+    std::atomic<Long> pending = 0;
+    std::atomic<Long> in_service = 0;
+
+    mutable std::mutex lock;
+
+    MemoryPLIC(Address base);
+
+    // Source a claim by the context would get, 0 when there's none
+    Word Best(Word context) const;
+
+    Word Claim(Word context);
+    void Complete(Word source);
+
+    // Brings the interrupt line of every context enabling one of the
+    // sources up to date
+    void Update(Long sources) const;
+    void UpdateContext(Word context) const;
+
+public:
+    Long ReadLong(Address address) const override;
+    Word ReadWord(Address address) const override;
+
+    void WriteLong(Address address, Long vlong) override;
+    void WriteWord(Address address, Word word) override;
+
+    void Lock() const override { lock.lock(); }
+    void Unlock() const override { lock.unlock(); }
+
+    Long SizeInMemory() const override { return sizeof(MemoryPLIC); }
+
+    // A lowered line drops a pending interrupt that wasn't claimed yet
+    void SetLevel(Word source, bool level);
+
+    inline bool IsPending(Word source) const { return source < SOURCES && (pending.load() >> source) & 1; }
+
+    static std::shared_ptr<MemoryPLIC> Create(Address base = DEFAULT_BASE);
+};
+
+#endif
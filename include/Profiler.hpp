@@ -0,0 +1,138 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "RV64.hpp"
+
+#include <array>
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <utility>
+
+class SymbolTable;
+
+// Per-hart execution counts. Counters are bumped by the hart's own thread
+// without locking, and only the hot-PC samples, taken once every
+// SAMPLE_PERIOD instructions, go through the lock.
+//
+// Like LBR, the last BRANCH_STACK taken branches are kept in a ring, and
+// each sample adds them and the straight runs between them to the profile
+class Profiler {
+public:
+    static constexpr Long SAMPLE_PERIOD = 256;
+    static constexpr size_t TRAP_CAUSES = 64;
+    static constexpr size_t BRANCH_STACK = 16;
+
+    // From and to, both inclusive for runs
+    using Edge = std::pair<Address, Address>;
+
+    struct Profile {
+        std::array<Long, RVInstruction::TYPE_COUNT> instructions{};
+        std::array<Long, TRAP_CAUSES> exceptions{};
+        std::array<Long, TRAP_CAUSES> interrupts{};
+
+        Long instruction_tlb_hits = 0;
+        Long instruction_tlb_misses = 0;
+        Long data_tlb_hits = 0;
+        Long data_tlb_misses = 0;
+
+        std::unordered_map<Address, Long> pc_samples;
+
+        // Sorted, the order the AutoFDO file lists them in
+        std::map<Edge, Long> ranges;
+        std::map<Edge, Long> branches;
+    };
+
+private:
+    Profile profile;
+    SLong countdown = SAMPLE_PERIOD;
+
+    // Where the last instruction counted was and where it would have gone
+    // without branching
+    Address last_pc = 0;
+    Address next_pc = 0;
+    bool counted = false;
+
+    std::array<Edge, BRANCH_STACK> branch_stack{};
+    Long taken_branches = 0;
+
+    mutable std::mutex lock;
+
+    void Sample(Address pc);
+
+    inline void Follow(Address pc) {
+        if (pc != next_pc && counted)
+            branch_stack[taken_branches++ % BRANCH_STACK] = {last_pc, pc};
+
+        counted = true;
+    }
+
+public:
+    Profiler() = default;
+    Profiler(const Profiler&) = delete;
+    Profiler(Profiler&& profiler);
+    ~Profiler() = default;
+
+    Profiler& operator=(const Profiler&) = delete;
+    Profiler& operator=(Profiler&& profiler);
+
+    inline void CountInstruction(const RVInstruction& instruction, Address pc) {
+        Follow(pc);
+        last_pc = pc;
+        next_pc = pc + instruction.size;
+
+        profile.instructions[static_cast<size_t>(instruction.type)]++;
+        if (--countdown <= 0) Sample(pc);
+    }
+
+    // Compiled blocks run as one unit, so their sample lands on the block's
+    // pc. Blocks only branch at their end, so only their way in is followed
+    inline void CountInstructions(const std::vector<RVInstruction>& instructions, size_t count, Address pc) {
+        if (count == 0) return;
+
+        Follow(pc);
+        next_pc = pc;
+
+        for (size_t i = 0; i < count; i++) {
+            profile.instructions[static_cast<size_t>(instructions[i].type)]++;
+
+            last_pc = next_pc;
+            next_pc += instructions[i].size;
+        }
+
+        countdown -= static_cast<SLong>(count);
+        if (countdown <= 0) Sample(pc);
+    }
+
+    inline void CountTrap(Long cause, bool is_interrupt) {
+        auto& traps = is_interrupt ? profile.interrupts : profile.exceptions;
+        traps[cause % TRAP_CAUSES]++;
+    }
+
+    inline void CountTLBLookup(bool is_execute, bool hit) {
+        if (is_execute) (hit ? profile.instruction_tlb_hits : profile.instruction_tlb_misses)++;
+        else (hit ? profile.data_tlb_hits : profile.data_tlb_misses)++;
+    }
+
+    Profile GetProfile() const;
+    void Reset();
+
+    // Plain text, one "kind name count" line per non-zero counter and hot
+    // PCs sorted by sample count. Hot PCs get their symbol appended when
+    // a table is given
+    void WriteToFile(const std::string& path, const SymbolTable* symbols = nullptr) const;
+
+    // AutoFDO's text samples, the ranges, addresses and branches counts
+    // create_gcov and create_llvm_prof read with --profiler=text, summed over
+    // profiles. Addresses are the guest's, which are the ELF's own as images
+    // load where they link. With a table, only runs within one function and
+    // branches with both ends in functions are kept, dropping firmware
+    static void WriteAutoFDO(const std::string& path, std::span<const Profile> profiles, const SymbolTable* symbols = nullptr);
+
+    static std::string GetTypeName(RVInstruction::Type type);
+};
+
+#endif
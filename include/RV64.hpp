@@ -3,7 +3,9 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <array>
+#include <span>
 
 #include "Types.hpp"
 
@@ -118,6 +120,7 @@ struct RVInstruction {
         OR,
         AND,
         FENCE,
+        FENCE_I,
         ECALL,
         EBREAK,
         LWU,
@@ -235,6 +238,114 @@ struct RVInstruction {
         FCVT_D_L,
         FCVT_D_LU,
         FMV_D_X,
+        ADD_UW,
+        SH1ADD,
+        SH2ADD,
+        SH3ADD,
+        SH1ADD_UW,
+        SH2ADD_UW,
+        SH3ADD_UW,
+        SLLI_UW,
+        ANDN,
+        ORN,
+        XNOR,
+        CLZ,
+        CLZW,
+        CTZ,
+        CTZW,
+        CPOP,
+        CPOPW,
+        MAX,
+        MAXU,
+        MIN,
+        MINU,
+        SEXT_B,
+        SEXT_H,
+        ZEXT_H,
+        ROL,
+        ROLW,
+        ROR,
+        RORI,
+        RORIW,
+        RORW,
+        ORC_B,
+        REV8,
+        BCLR,
+        BCLRI,
+        BEXT,
+        BEXTI,
+        BINV,
+        BINVI,
+        BSET,
+        BSETI,
+        VSETVLI,
+        VSETIVLI,
+        VSETVL,
+        VLE8_V,
+        VLE16_V,
+        VLE32_V,
+        VLE64_V,
+        VSE8_V,
+        VSE16_V,
+        VSE32_V,
+        VSE64_V,
+        VLSE8_V,
+        VLSE16_V,
+        VLSE32_V,
+        VLSE64_V,
+        VSSE8_V,
+        VSSE16_V,
+        VSSE32_V,
+        VSSE64_V,
+        VADD_VV,
+        VADD_VX,
+        VADD_VI,
+        VSUB_VV,
+        VSUB_VX,
+        VRSUB_VX,
+        VRSUB_VI,
+        VAND_VV,
+        VAND_VX,
+        VAND_VI,
+        VOR_VV,
+        VOR_VX,
+        VOR_VI,
+        VXOR_VV,
+        VXOR_VX,
+        VXOR_VI,
+        VSLL_VV,
+        VSLL_VX,
+        VSLL_VI,
+        VSRL_VV,
+        VSRL_VX,
+        VSRL_VI,
+        VSRA_VV,
+        VSRA_VX,
+        VSRA_VI,
+        VMUL_VV,
+        VMUL_VX,
+        VMACC_VV,
+        VMACC_VX,
+        VREDSUM_VS,
+        VMV_V_V,
+        VMV_V_X,
+        VMV_V_I,
+        VMV_X_S,
+        VMV_S_X,
+        VFADD_VV,
+        VFADD_VF,
+        VFSUB_VV,
+        VFSUB_VF,
+        VFMUL_VV,
+        VFMUL_VF,
+        VFDIV_VV,
+        VFDIV_VF,
+        VFMACC_VV,
+        VFMACC_VF,
+        VFREDUSUM_VS,
+        VFMV_V_F,
+        VFMV_F_S,
+        VFMV_S_F,
         SRET,
         MRET,
         WFI,
@@ -249,6 +360,8 @@ struct RVInstruction {
         CUST_STRAP
     };
 
+    static constexpr size_t TYPE_COUNT = static_cast<size_t>(Type::CUST_STRAP) + 1;
+
     static constexpr Byte OP_LUI = 0b0110111;
     static constexpr Byte OP_AUIPC = 0b0010111;
     static constexpr Byte OP_JAL = 0b1101111;
@@ -333,6 +446,40 @@ struct RVInstruction {
     static constexpr Byte FUNCT7_AND = 0b0;
     static constexpr Byte FUNCT7_REMU = 0b0000001;
 
+    // Zba, Zbb and Zbs live in the OP, OP-32 and shift immediate spaces.
+    // The immediate forms keep their funct6 in the top of the immediate
+    static constexpr Byte FUNCT7_ADD_UW = 0b0000100;
+    static constexpr Byte FUNCT6_SLLI_UW = 0b000010;
+    static constexpr Byte RS2_ZEXT_H = 0b00000;
+
+    static constexpr Byte FUNCT7_SHADD = 0b0010000;
+    static constexpr Byte FUNCT3_SH1ADD = 0b010;
+    static constexpr Byte FUNCT3_SH2ADD = 0b100;
+    static constexpr Byte FUNCT3_SH3ADD = 0b110;
+
+    static constexpr Byte FUNCT7_NEGATED = 0b0100000;
+
+    static constexpr Byte FUNCT7_MIN_MAX = 0b0000101;
+    static constexpr Byte FUNCT3_MIN = 0b100;
+    static constexpr Byte FUNCT3_MINU = 0b101;
+    static constexpr Byte FUNCT3_MAX = 0b110;
+    static constexpr Byte FUNCT3_MAXU = 0b111;
+
+    static constexpr Byte FUNCT7_UNARY = 0b0110000;
+    static constexpr Byte RS2_CLZ = 0b00000;
+    static constexpr Byte RS2_CTZ = 0b00001;
+    static constexpr Byte RS2_CPOP = 0b00010;
+    static constexpr Byte RS2_SEXT_B = 0b00100;
+    static constexpr Byte RS2_SEXT_H = 0b00101;
+
+    static constexpr Byte FUNCT7_ROTATE = 0b0110000;
+    static constexpr Half IMM_ORC_B = 0b001010000111;
+    static constexpr Half IMM_REV8 = 0b011010111000;
+
+    static constexpr Byte FUNCT7_BCLR_BEXT = 0b0100100;
+    static constexpr Byte FUNCT7_BINV = 0b0110100;
+    static constexpr Byte FUNCT7_BSET = 0b0010100;
+
     static constexpr Byte OP_ATOMIC = 0b0101111;
     static constexpr Byte FUNCT3_ATOMIC = 0b010;
     static constexpr Byte FUNCT3_ATOMIC_W = 0b011;
@@ -430,6 +577,7 @@ struct RVInstruction {
 
     static constexpr Byte OP_FENCE = 0b0001111;
     static constexpr Byte FUNCT3_FENCE = 0b000;
+    static constexpr Byte FUNCT3_FENCE_I = 0b001;
 
     static constexpr Byte OP_SYSTEM = 0b1110011;
     static constexpr Byte FUNCT3_SYSTEM = 0b000;
@@ -466,12 +614,194 @@ struct RVInstruction {
     static constexpr Byte FUNCT7_CUST_MTRAP = 0b0000001;
     static constexpr Byte FUNCT7_CUST_STRAP = 0b0000010;
 
-    static std::array<std::string, 32> register_names;
-    static std::array<std::string, 32> fregister_names;
-    static std::array<std::string, 4096> csr_names;
-    static void SetupCSRNames();
+    // The V extension. Arithmetic picks its operand kinds by funct3 and its
+    // operation by funct6, with the mask bit below funct6. Loads and
+    // stores share the float opcodes and give the element width in funct3
+    static constexpr Byte OP_VECTOR = 0b1010111;
+    static constexpr Byte FUNCT3_OPIVV = 0b000;
+    static constexpr Byte FUNCT3_OPFVV = 0b001;
+    static constexpr Byte FUNCT3_OPMVV = 0b010;
+    static constexpr Byte FUNCT3_OPIVI = 0b011;
+    static constexpr Byte FUNCT3_OPIVX = 0b100;
+    static constexpr Byte FUNCT3_OPFVF = 0b101;
+    static constexpr Byte FUNCT3_OPMVX = 0b110;
+    static constexpr Byte FUNCT3_OPCFG = 0b111;
+
+    static constexpr Byte FUNCT7_VSETIVLI = 0b1100000;
+    static constexpr Byte FUNCT7_VSETVL = 0b1000000;
+
+    static constexpr Byte FUNCT3_VECTOR_8 = 0b000;
+    static constexpr Byte FUNCT3_VECTOR_16 = 0b101;
+    static constexpr Byte FUNCT3_VECTOR_32 = 0b110;
+    static constexpr Byte FUNCT3_VECTOR_64 = 0b111;
+
+    static constexpr Byte MOP_UNIT_STRIDE = 0b00;
+    static constexpr Byte MOP_STRIDED = 0b10;
+
+    static constexpr Byte FUNCT6_VADD = 0b000000;
+    static constexpr Byte FUNCT6_VSUB = 0b000010;
+    static constexpr Byte FUNCT6_VRSUB = 0b000011;
+    static constexpr Byte FUNCT6_VAND = 0b001001;
+    static constexpr Byte FUNCT6_VOR = 0b001010;
+    static constexpr Byte FUNCT6_VXOR = 0b001011;
+    static constexpr Byte FUNCT6_VMV = 0b010111;
+    static constexpr Byte FUNCT6_VMV_SCALAR = 0b010000;
+    static constexpr Byte FUNCT6_VSLL = 0b100101;
+    static constexpr Byte FUNCT6_VSRL = 0b101000;
+    static constexpr Byte FUNCT6_VSRA = 0b101001;
+
+    static constexpr Byte FUNCT6_VREDSUM = 0b000000;
+    static constexpr Byte FUNCT6_VMUL = 0b100101;
+    static constexpr Byte FUNCT6_VMACC = 0b101101;
+
+    static constexpr Byte FUNCT6_VFADD = 0b000000;
+    static constexpr Byte FUNCT6_VFREDUSUM = 0b000001;
+    static constexpr Byte FUNCT6_VFSUB = 0b000010;
+    static constexpr Byte FUNCT6_VFDIV = 0b100000;
+    static constexpr Byte FUNCT6_VFMUL = 0b100100;
+    static constexpr Byte FUNCT6_VFMACC = 0b101100;
+
+    // Which operand fields an encoding carries and how its immediate is
+    // split across the word
+    enum class Format : Byte {
+        None,
+        R,
+        R4,
+        RFloat,
+        I,
+        S,
+        B,
+        U,
+        J,
+        CSR,
+        V,
+        VI,
+        VSETVLI,
+        VSETIVLI
+    };
+
+    // A word is of this type when raw & mask == match
+    struct Encoding {
+        Type type;
+        Format format;
+        Word mask;
+        Word match;
+    };
+
+    static constexpr Word MASK_OPCODE = 0x0000007f;
+    static constexpr Word MASK_FUNCT3 = 0x0000707f;
+    static constexpr Word MASK_FUNCT7 = 0xfe00707f;
+    static constexpr Word MASK_FUNCT7_RS2 = 0xfff0707f;
+    static constexpr Word MASK_FUNCT6 = 0xfc00707f;
+    static constexpr Word MASK_FUNCT5 = 0xf800707f;
+    static constexpr Word MASK_FUNCT5_RS2 = 0xf9f0707f;
+    static constexpr Word MASK_FUNCT2 = 0x0600007f;
+    static constexpr Word MASK_FLOAT = 0xfe00007f;
+    static constexpr Word MASK_FLOAT_RS2 = 0xfff0007f;
+    static constexpr Word MASK_SFENCE = 0xfe007fff;
+    static constexpr Word MASK_FUNCT7_RS1 = 0xfe0ff07f;
+    static constexpr Word MASK_VECTOR_UNIT_STRIDE = 0xfdf0707f;
+    static constexpr Word MASK_VSETVLI = 0x8000707f;
+    static constexpr Word MASK_VSETIVLI = 0xc000707f;
+    static constexpr Word MASK_WORD = 0xffffffff;
+
+    static constexpr Word Fields(Byte opcode, Byte funct3 = 0, Byte funct7 = 0, Byte rs2 = 0, Byte rs1 = 0, Byte rd = 0) {
+        return (opcode & 0x7f) | Word(rd & 0x1f) << 7 | Word(funct3 & 0x7) << 12 | Word(rs1 & 0x1f) << 15 | Word(rs2 & 0x1f) << 20 | Word(funct7 & 0x7f) << 25;
+    }
+
+    // Immediates come out sign extended by arithmetic shifts of the word,
+    // except CSR numbers which are unsigned
+    static constexpr SLong ExtractImmediate(Format format, Word raw) {
+        auto sraw = static_cast<SWord>(raw);
+
+        switch (format) {
+            case Format::I:
+                return sraw >> 20;
+
+            case Format::CSR:
+                return raw >> 20;
+
+            case Format::S:
+                return SLong(sraw >> 25) * 32 | (raw >> 7 & 0x1f);
+
+            case Format::B:
+                return SLong(sraw >> 31) * 4096 | (raw << 4 & 0x800) | (raw >> 20 & 0x7e0) | (raw >> 7 & 0x1e);
+
+            case Format::U:
+                return static_cast<SWord>(raw & 0xfffff000);
+
+            case Format::J:
+                return SLong(sraw >> 31) * 1048576 | (raw & 0xff000) | (raw >> 9 & 0x800) | (raw >> 20 & 0x7fe);
+
+            case Format::VI:
+                return SLong(sraw << 12 >> 27);
+
+            case Format::VSETVLI:
+                return raw >> 20 & 0x7ff;
+
+            case Format::VSETIVLI:
+                return raw >> 20 & 0x3ff;
+
+            default:
+                return 0;
+        }
+    }
+
+    // The inverse of ExtractImmediate, bits the format can't hold are dropped
+    static constexpr Word PackImmediate(Format format, SLong immediate) {
+        auto imm = static_cast<Word>(immediate);
+
+        switch (format) {
+            case Format::I:
+            case Format::CSR:
+                return (imm & 0xfff) << 20;
+
+            case Format::S:
+                return (imm & 0x1f) << 7 | (imm >> 5 & 0x7f) << 25;
+
+            case Format::B:
+                return (imm >> 11 & 1) << 7 | (imm >> 1 & 0xf) << 8 | (imm >> 5 & 0x3f) << 25 | (imm >> 12 & 1) << 31;
+
+            case Format::U:
+                return imm & 0xfffff000;
+
+            case Format::J:
+                return (imm & 0xff000) | (imm >> 11 & 1) << 20 | (imm >> 1 & 0x3ff) << 21 | (imm >> 20 & 1) << 31;
+
+            case Format::VI:
+                return (imm & 0x1f) << 15;
+
+            case Format::VSETVLI:
+                return (imm & 0x7ff) << 20;
+
+            case Format::VSETIVLI:
+                return (imm & 0x3ff) << 20;
+
+            default:
+                return 0;
+        }
+    }
+
+    // Builds the word for type from its operands. Bits the encoding fixes
+    // win over operands that overlap them, such as the funct6 of SRAI.
+    // Vector encodings take their mask bit as rs3
+    static constexpr Word Encode(Type type, Byte rd, Byte rs1, Byte rs2, SLong immediate, Byte rs3 = 0, Byte rm = 0);
+
+    // Indexed by type. INVALID has a match no word can have
+    static const std::array<Encoding, TYPE_COUNT> encodings;
+
+    static const std::array<std::string_view, 32> register_names;
+    static const std::array<std::string_view, 32> fregister_names;
+
+    static std::string_view GetMnemonic(Type type);
+    static std::string_view GetCSRName(Half csr);
+
+    // Room for the longest line Disassemble writes, with its terminator
+    static constexpr size_t DISASSEMBLY_SIZE = 64;
+    using Disassembly = std::array<char, DISASSEMBLY_SIZE>;
 
     Type type = Type::INVALID;
+    Word raw = 0;
 
     union {
         Long immediate;
@@ -480,11 +810,381 @@ struct RVInstruction {
     Byte rd, rs1, rs2;
 
     Byte rm;
-    Byte rs3;
 
-    operator std::string();
+    // Vector encodings have no third source, their mask bit takes its place.
+    // vm is 1 when the instruction is unmasked
+    union {
+        Byte rs3;
+        Byte vm;
+    };
+
+    // Bytes to the next instruction, 2 for compressed ones
+    Byte size = 4;
+
+    // Set by the instruction cache on EBREAK and on breakpoints, so harts
+    // only look closer at flagged instructions
+    bool break_point = false;
+
+    // Writes into buffer without allocating, truncating to fit. The text
+    // is always terminated and the length returned excludes the terminator
+    size_t Disassemble(char* buffer, size_t size) const;
+
+    // Decodes and disassembles a run of words in one go, such as a page,
+    // one line per word. Stops at whichever span is shorter
+    static void Disassemble(std::span<const Word> words, std::span<Disassembly> lines);
+
+    operator std::string() const;
 
     static RVInstruction FromUInt32(Word instr);
+
+    static constexpr bool IsVector(Type type) { return type >= Type::VSETVLI && type <= Type::VFMV_S_F; }
+
+    // Anything but 0b11 in the lowest two bits starts a 16 bit instruction
+    static constexpr bool IsCompressed(Word low) { return (low & 0b11) != 0b11; }
+
+    // The 32 bit instruction a compressed one stands for, 0 when reserved
+    static Word Expand(Half instr);
+
+    // Decodes as the expanded instruction, keeping the 16 bits as raw
+    static RVInstruction FromUInt16(Half instr);
+
+    // Decodes whichever instruction starts at the low bits of word
+    static inline RVInstruction Decode(Word word) {
+        return IsCompressed(word) ? FromUInt16(static_cast<Half>(word)) : FromUInt32(word);
+    }
 };
 
+// The one description of every encoding. The decoder, the disassembler,
+// the encoders and the tests are all generated from it
+inline constexpr std::array<RVInstruction::Encoding, RVInstruction::TYPE_COUNT> RVInstruction::encodings = {{
+    {Type::LUI, Format::U, MASK_OPCODE, Fields(OP_LUI)},
+    {Type::AUIPC, Format::U, MASK_OPCODE, Fields(OP_AUIPC)},
+    {Type::JAL, Format::J, MASK_OPCODE, Fields(OP_JAL)},
+    {Type::JALR, Format::I, MASK_FUNCT3, Fields(OP_JALR, FUNCT3_JALR)},
+    {Type::BEQ, Format::B, MASK_FUNCT3, Fields(OP_BRANCH, FUNCT3_BEQ)},
+    {Type::BNE, Format::B, MASK_FUNCT3, Fields(OP_BRANCH, FUNCT3_BNE)},
+    {Type::BLT, Format::B, MASK_FUNCT3, Fields(OP_BRANCH, FUNCT3_BLT)},
+    {Type::BGE, Format::B, MASK_FUNCT3, Fields(OP_BRANCH, FUNCT3_BGE)},
+    {Type::BLTU, Format::B, MASK_FUNCT3, Fields(OP_BRANCH, FUNCT3_BLTU)},
+    {Type::BGEU, Format::B, MASK_FUNCT3, Fields(OP_BRANCH, FUNCT3_BGEU)},
+    {Type::LB, Format::I, MASK_FUNCT3, Fields(OP_LOAD, FUNCT3_LB)},
+    {Type::LH, Format::I, MASK_FUNCT3, Fields(OP_LOAD, FUNCT3_LH)},
+    {Type::LW, Format::I, MASK_FUNCT3, Fields(OP_LOAD, FUNCT3_LW)},
+    {Type::LBU, Format::I, MASK_FUNCT3, Fields(OP_LOAD, FUNCT3_LBU)},
+    {Type::LHU, Format::I, MASK_FUNCT3, Fields(OP_LOAD, FUNCT3_LHU)},
+    {Type::SB, Format::S, MASK_FUNCT3, Fields(OP_STORE, FUNCT3_SB)},
+    {Type::SH, Format::S, MASK_FUNCT3, Fields(OP_STORE, FUNCT3_SH)},
+    {Type::SW, Format::S, MASK_FUNCT3, Fields(OP_STORE, FUNCT3_SW)},
+    {Type::ADDI, Format::I, MASK_FUNCT3, Fields(OP_MATH_IMMEDIATE, FUNCT3_ADDI)},
+    {Type::SLTI, Format::I, MASK_FUNCT3, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLTI)},
+    {Type::SLTIU, Format::I, MASK_FUNCT3, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLTIU)},
+    {Type::XORI, Format::I, MASK_FUNCT3, Fields(OP_MATH_IMMEDIATE, FUNCT3_XORI)},
+    {Type::ORI, Format::I, MASK_FUNCT3, Fields(OP_MATH_IMMEDIATE, FUNCT3_ORI)},
+    {Type::ANDI, Format::I, MASK_FUNCT3, Fields(OP_MATH_IMMEDIATE, FUNCT3_ANDI)},
+    {Type::SLLI, Format::I, MASK_FUNCT6, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLLI, FUNCT7_SLLI << 1)},
+    {Type::SRLI, Format::I, MASK_FUNCT6, Fields(OP_MATH_IMMEDIATE, FUNCT3_SHIFT_RIGHT_IMMEDIATE, FUNCT7_SRLI << 1)},
+    {Type::SRAI, Format::I, MASK_FUNCT6, Fields(OP_MATH_IMMEDIATE, FUNCT3_SHIFT_RIGHT_IMMEDIATE, FUNCT7_SRAI << 1)},
+    {Type::ADD, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_ADD_SUB_MUL, FUNCT7_ADD)},
+    {Type::SUB, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_ADD_SUB_MUL, FUNCT7_SUB)},
+    {Type::SLL, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLL_MULH, FUNCT7_SLL)},
+    {Type::SLT, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLT_MULHSU, FUNCT7_SLT)},
+    {Type::SLTU, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLTU_MULHU, FUNCT7_SLTU)},
+    {Type::XOR, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_XOR_DIV, FUNCT7_XOR)},
+    {Type::SRL, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SHIFT_RIGHT_DIVU, FUNCT7_SRL)},
+    {Type::SRA, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SHIFT_RIGHT_DIVU, FUNCT7_SRA)},
+    {Type::OR, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_OR_REM, FUNCT7_OR)},
+    {Type::AND, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_AND_REMU, FUNCT7_AND)},
+    {Type::FENCE, Format::I, MASK_FUNCT3, Fields(OP_FENCE, FUNCT3_FENCE)},
+    {Type::FENCE_I, Format::I, MASK_FUNCT3, Fields(OP_FENCE, FUNCT3_FENCE_I)},
+    {Type::ECALL, Format::R, MASK_WORD, Fields(OP_SYSTEM, FUNCT3_SYSTEM, IMM_ECALL >> 5, IMM_ECALL & 0x1f)},
+    {Type::EBREAK, Format::R, MASK_WORD, Fields(OP_SYSTEM, FUNCT3_SYSTEM, IMM_EBREAK >> 5, IMM_EBREAK & 0x1f)},
+    {Type::LWU, Format::I, MASK_FUNCT3, Fields(OP_LOAD, FUNCT3_LWU)},
+    {Type::LD, Format::I, MASK_FUNCT3, Fields(OP_LOAD, FUNCT3_LD)},
+    {Type::SD, Format::S, MASK_FUNCT3, Fields(OP_STORE, FUNCT3_SD)},
+    {Type::ADDIW, Format::I, MASK_FUNCT3, Fields(OP_MATH_W_IMMEDIATE, FUNCT3_ADDI)},
+    {Type::SLLIW, Format::I, MASK_FUNCT7, Fields(OP_MATH_W_IMMEDIATE, FUNCT3_SLLI, FUNCT7_SLL)},
+    {Type::SRLIW, Format::I, MASK_FUNCT7, Fields(OP_MATH_W_IMMEDIATE, FUNCT3_SHIFT_RIGHT_IMMEDIATE, FUNCT7_SRL)},
+    {Type::SRAIW, Format::I, MASK_FUNCT7, Fields(OP_MATH_W_IMMEDIATE, FUNCT3_SHIFT_RIGHT_IMMEDIATE, FUNCT7_SRA)},
+    {Type::ADDW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_ADD_SUB_MUL, FUNCT7_ADD)},
+    {Type::SUBW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_ADD_SUB_MUL, FUNCT7_SUB)},
+    {Type::SLLW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_SLL_MULH, FUNCT7_SLL)},
+    {Type::SRLW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_SHIFT_RIGHT_DIVU, FUNCT7_SRL)},
+    {Type::SRAW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_SHIFT_RIGHT_DIVU, FUNCT7_SRA)},
+    {Type::CSRRW, Format::CSR, MASK_FUNCT3, Fields(OP_CSR, FUNCT3_CSRRW)},
+    {Type::CSRRS, Format::CSR, MASK_FUNCT3, Fields(OP_CSR, FUNCT3_CSRRS)},
+    {Type::CSRRC, Format::CSR, MASK_FUNCT3, Fields(OP_CSR, FUNCT3_CSRRC)},
+    {Type::CSRRWI, Format::CSR, MASK_FUNCT3, Fields(OP_CSR, FUNCT3_CSRRWI)},
+    {Type::CSRRSI, Format::CSR, MASK_FUNCT3, Fields(OP_CSR, FUNCT3_CSRRSI)},
+    {Type::CSRRCI, Format::CSR, MASK_FUNCT3, Fields(OP_CSR, FUNCT3_CSRRCI)},
+    {Type::MUL, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_ADD_SUB_MUL, FUNCT7_MUL)},
+    {Type::MULH, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLL_MULH, FUNCT7_MULH)},
+    {Type::MULHSU, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLT_MULHSU, FUNCT7_MULHSU)},
+    {Type::MULHU, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLTU_MULHU, FUNCT7_MULHU)},
+    {Type::DIV, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_XOR_DIV, FUNCT7_DIV)},
+    {Type::DIVU, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SHIFT_RIGHT_DIVU, FUNCT7_DIVU)},
+    {Type::REM, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_OR_REM, FUNCT7_REM)},
+    {Type::REMU, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_AND_REMU, FUNCT7_REMU)},
+    {Type::MULW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_ADD_SUB_MUL, FUNCT7_MUL)},
+    {Type::DIVW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_XOR_DIV, FUNCT7_DIV)},
+    {Type::DIVUW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_SHIFT_RIGHT_DIVU, FUNCT7_DIVU)},
+    {Type::REMW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_OR_REM, FUNCT7_REM)},
+    {Type::REMUW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_AND_REMU, FUNCT7_REMU)},
+    {Type::LR_W, Format::R, MASK_FUNCT5_RS2, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_LR_W, RS2_LR_W)},
+    {Type::SC_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_SC_W)},
+    {Type::AMOSWAP_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_AMOSWAP_W)},
+    {Type::AMOADD_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_AMOADD_W)},
+    {Type::AMOXOR_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_AMOXOR_W)},
+    {Type::AMOAND_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_AMOAND_W)},
+    {Type::AMOOR_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_AMOOR_W)},
+    {Type::AMOMIN_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_AMOMIN_W)},
+    {Type::AMOMAX_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_AMOMAX_W)},
+    {Type::AMOMINU_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_AMOMINU_W)},
+    {Type::AMOMAXU_W, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC, FUNCT7_AMOMAXU_W)},
+    {Type::LR_D, Format::R, MASK_FUNCT5_RS2, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_LR_W, RS2_LR_W)},
+    {Type::SC_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_SC_W)},
+    {Type::AMOSWAP_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_AMOSWAP_W)},
+    {Type::AMOADD_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_AMOADD_W)},
+    {Type::AMOXOR_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_AMOXOR_W)},
+    {Type::AMOAND_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_AMOAND_W)},
+    {Type::AMOOR_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_AMOOR_W)},
+    {Type::AMOMIN_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_AMOMIN_W)},
+    {Type::AMOMAX_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_AMOMAX_W)},
+    {Type::AMOMINU_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_AMOMINU_W)},
+    {Type::AMOMAXU_D, Format::R, MASK_FUNCT5, Fields(OP_ATOMIC, FUNCT3_ATOMIC_W, FUNCT7_AMOMAXU_W)},
+    {Type::FLW, Format::I, MASK_FUNCT3, Fields(OP_FL, FUNCT3_FLW)},
+    {Type::FSW, Format::S, MASK_FUNCT3, Fields(OP_FS, FUNCT3_FSW)},
+    {Type::FMADD_S, Format::R4, MASK_FUNCT2, Fields(OP_FMADD, 0, FUNCT2_S)},
+    {Type::FMSUB_S, Format::R4, MASK_FUNCT2, Fields(OP_FMSUB, 0, FUNCT2_S)},
+    {Type::FNMSUB_S, Format::R4, MASK_FUNCT2, Fields(OP_FNMSUB, 0, FUNCT2_S)},
+    {Type::FNMADD_S, Format::R4, MASK_FUNCT2, Fields(OP_FNMADD, 0, FUNCT2_S)},
+    {Type::FADD_S, Format::RFloat, MASK_FLOAT, Fields(OP_FLOAT, 0, FUNCT5_FADD << 2 | FUNCT2_S)},
+    {Type::FSUB_S, Format::RFloat, MASK_FLOAT, Fields(OP_FLOAT, 0, FUNCT5_FSUB << 2 | FUNCT2_S)},
+    {Type::FMUL_S, Format::RFloat, MASK_FLOAT, Fields(OP_FLOAT, 0, FUNCT5_FMUL << 2 | FUNCT2_S)},
+    {Type::FDIV_S, Format::RFloat, MASK_FLOAT, Fields(OP_FLOAT, 0, FUNCT5_FDIV << 2 | FUNCT2_S)},
+    {Type::FSQRT_S, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FSQRT << 2 | FUNCT2_S, RS2_FSQRT)},
+    {Type::FSGNJ_S, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FSGNJ, FUNCT5_FSGNJ << 2 | FUNCT2_S)},
+    {Type::FSGNJN_S, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FSGNJN, FUNCT5_FSGNJ << 2 | FUNCT2_S)},
+    {Type::FSGNJX_S, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FSGNJX, FUNCT5_FSGNJ << 2 | FUNCT2_S)},
+    {Type::FMIN_S, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FMIN, FUNCT5_FMIN_FMAX << 2 | FUNCT2_S)},
+    {Type::FMAX_S, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FMAX, FUNCT5_FMIN_FMAX << 2 | FUNCT2_S)},
+    {Type::FCVT_W_S, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_W << 2 | FUNCT2_S, RS2_FCVT_W)},
+    {Type::FCVT_WU_S, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_W << 2 | FUNCT2_S, RS2_FCVT_WU)},
+    {Type::FMV_X_W, Format::RFloat, MASK_FUNCT7_RS2, Fields(OP_FLOAT, FUNCT3_FMV_X_W, FUNCT5_FCLASS_FMV_X_W << 2 | FUNCT2_S, RS2_FMV_X_W)},
+    {Type::FEQ_S, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FEQ, FUNCT5_FCOMPARE << 2 | FUNCT2_S)},
+    {Type::FLT_S, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FLT, FUNCT5_FCOMPARE << 2 | FUNCT2_S)},
+    {Type::FLE_S, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FLE, FUNCT5_FCOMPARE << 2 | FUNCT2_S)},
+    {Type::FCLASS_S, Format::RFloat, MASK_FUNCT7_RS2, Fields(OP_FLOAT, FUNCT3_FCLASS, FUNCT5_FCLASS_FMV_X_W << 2 | FUNCT2_S, RS2_FCLASS)},
+    {Type::FCVT_S_W, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT << 2 | FUNCT2_S, RS2_FCVT_W)},
+    {Type::FCVT_S_WU, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT << 2 | FUNCT2_S, RS2_FCVT_WU)},
+    {Type::FMV_W_X, Format::RFloat, MASK_FUNCT7_RS2, Fields(OP_FLOAT, FUNCT3_FMV_W_X, FUNCT5_FMV_W_X << 2 | FUNCT2_S, RS2_FMV_W_X)},
+    {Type::FCVT_L_S, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_W << 2 | FUNCT2_S, RS2_FCVT_L)},
+    {Type::FCVT_LU_S, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_W << 2 | FUNCT2_S, RS2_FCVT_LU)},
+    {Type::FCVT_S_L, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT << 2 | FUNCT2_S, RS2_FCVT_L)},
+    {Type::FCVT_S_LU, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT << 2 | FUNCT2_S, RS2_FCVT_LU)},
+    {Type::FLD, Format::I, MASK_FUNCT3, Fields(OP_FL, FUNCT3_FLD)},
+    {Type::FSD, Format::S, MASK_FUNCT3, Fields(OP_FS, FUNCT3_FSD)},
+    {Type::FMADD_D, Format::R4, MASK_FUNCT2, Fields(OP_FMADD, 0, FUNCT2_D)},
+    {Type::FMSUB_D, Format::R4, MASK_FUNCT2, Fields(OP_FMSUB, 0, FUNCT2_D)},
+    {Type::FNMSUB_D, Format::R4, MASK_FUNCT2, Fields(OP_FNMSUB, 0, FUNCT2_D)},
+    {Type::FNMADD_D, Format::R4, MASK_FUNCT2, Fields(OP_FNMADD, 0, FUNCT2_D)},
+    {Type::FADD_D, Format::RFloat, MASK_FLOAT, Fields(OP_FLOAT, 0, FUNCT5_FADD << 2 | FUNCT2_D)},
+    {Type::FSUB_D, Format::RFloat, MASK_FLOAT, Fields(OP_FLOAT, 0, FUNCT5_FSUB << 2 | FUNCT2_D)},
+    {Type::FMUL_D, Format::RFloat, MASK_FLOAT, Fields(OP_FLOAT, 0, FUNCT5_FMUL << 2 | FUNCT2_D)},
+    {Type::FDIV_D, Format::RFloat, MASK_FLOAT, Fields(OP_FLOAT, 0, FUNCT5_FDIV << 2 | FUNCT2_D)},
+    {Type::FSQRT_D, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FSQRT << 2 | FUNCT2_D, RS2_FSQRT)},
+    {Type::FSGNJ_D, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FSGNJ, FUNCT5_FSGNJ << 2 | FUNCT2_D)},
+    {Type::FSGNJN_D, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FSGNJN, FUNCT5_FSGNJ << 2 | FUNCT2_D)},
+    {Type::FSGNJX_D, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FSGNJX, FUNCT5_FSGNJ << 2 | FUNCT2_D)},
+    {Type::FMIN_D, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FMIN, FUNCT5_FMIN_FMAX << 2 | FUNCT2_D)},
+    {Type::FMAX_D, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FMAX, FUNCT5_FMIN_FMAX << 2 | FUNCT2_D)},
+    {Type::FCVT_S_D, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_D << 2 | FUNCT2_S, RS2_FCVT_S_D)},
+    {Type::FCVT_D_S, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_D << 2 | FUNCT2_D, RS2_FCVT_D_S)},
+    {Type::FEQ_D, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FEQ, FUNCT5_FCOMPARE << 2 | FUNCT2_D)},
+    {Type::FLT_D, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FLT, FUNCT5_FCOMPARE << 2 | FUNCT2_D)},
+    {Type::FLE_D, Format::RFloat, MASK_FUNCT7, Fields(OP_FLOAT, FUNCT3_FLE, FUNCT5_FCOMPARE << 2 | FUNCT2_D)},
+    {Type::FCLASS_D, Format::RFloat, MASK_FUNCT7_RS2, Fields(OP_FLOAT, FUNCT3_FCLASS, FUNCT5_FCLASS_FMV_X_W << 2 | FUNCT2_D, RS2_FCLASS)},
+    {Type::FCVT_W_D, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_W << 2 | FUNCT2_D, RS2_FCVT_W)},
+    {Type::FCVT_WU_D, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_W << 2 | FUNCT2_D, RS2_FCVT_WU)},
+    {Type::FCVT_D_W, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT << 2 | FUNCT2_D, RS2_FCVT_W)},
+    {Type::FCVT_D_WU, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT << 2 | FUNCT2_D, RS2_FCVT_WU)},
+    {Type::FCVT_L_D, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_W << 2 | FUNCT2_D, RS2_FCVT_L)},
+    {Type::FCVT_LU_D, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT_W << 2 | FUNCT2_D, RS2_FCVT_LU)},
+    {Type::FMV_X_D, Format::RFloat, MASK_FUNCT7_RS2, Fields(OP_FLOAT, FUNCT3_FMV_X_W, FUNCT5_FCLASS_FMV_X_W << 2 | FUNCT2_D, RS2_FMV_X_W)},
+    {Type::FCVT_D_L, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT << 2 | FUNCT2_D, RS2_FCVT_L)},
+    {Type::FCVT_D_LU, Format::RFloat, MASK_FLOAT_RS2, Fields(OP_FLOAT, 0, FUNCT5_FCVT << 2 | FUNCT2_D, RS2_FCVT_LU)},
+    {Type::FMV_D_X, Format::RFloat, MASK_FUNCT7_RS2, Fields(OP_FLOAT, FUNCT3_FMV_W_X, FUNCT5_FMV_W_X << 2 | FUNCT2_D, RS2_FMV_W_X)},
+    {Type::ADD_UW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_ADD_SUB_MUL, FUNCT7_ADD_UW)},
+    {Type::SH1ADD, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SH1ADD, FUNCT7_SHADD)},
+    {Type::SH2ADD, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SH2ADD, FUNCT7_SHADD)},
+    {Type::SH3ADD, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SH3ADD, FUNCT7_SHADD)},
+    {Type::SH1ADD_UW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_SH1ADD, FUNCT7_SHADD)},
+    {Type::SH2ADD_UW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_SH2ADD, FUNCT7_SHADD)},
+    {Type::SH3ADD_UW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_SH3ADD, FUNCT7_SHADD)},
+    {Type::SLLI_UW, Format::I, MASK_FUNCT6, Fields(OP_MATH_W_IMMEDIATE, FUNCT3_SLLI, FUNCT6_SLLI_UW << 1)},
+    {Type::ANDN, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_AND_REMU, FUNCT7_NEGATED)},
+    {Type::ORN, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_OR_REM, FUNCT7_NEGATED)},
+    {Type::XNOR, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_XOR_DIV, FUNCT7_NEGATED)},
+    {Type::CLZ, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLLI, FUNCT7_UNARY, RS2_CLZ)},
+    {Type::CLZW, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_W_IMMEDIATE, FUNCT3_SLLI, FUNCT7_UNARY, RS2_CLZ)},
+    {Type::CTZ, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLLI, FUNCT7_UNARY, RS2_CTZ)},
+    {Type::CTZW, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_W_IMMEDIATE, FUNCT3_SLLI, FUNCT7_UNARY, RS2_CTZ)},
+    {Type::CPOP, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLLI, FUNCT7_UNARY, RS2_CPOP)},
+    {Type::CPOPW, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_W_IMMEDIATE, FUNCT3_SLLI, FUNCT7_UNARY, RS2_CPOP)},
+    {Type::MAX, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_MAX, FUNCT7_MIN_MAX)},
+    {Type::MAXU, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_MAXU, FUNCT7_MIN_MAX)},
+    {Type::MIN, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_MIN, FUNCT7_MIN_MAX)},
+    {Type::MINU, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_MINU, FUNCT7_MIN_MAX)},
+    {Type::SEXT_B, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLLI, FUNCT7_UNARY, RS2_SEXT_B)},
+    {Type::SEXT_H, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLLI, FUNCT7_UNARY, RS2_SEXT_H)},
+    {Type::ZEXT_H, Format::R, MASK_FUNCT7_RS2, Fields(OP_MATH_W, FUNCT3_XOR_DIV, FUNCT7_ADD_UW, RS2_ZEXT_H)},
+    {Type::ROL, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLL_MULH, FUNCT7_ROTATE)},
+    {Type::ROLW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_SLL_MULH, FUNCT7_ROTATE)},
+    {Type::ROR, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SHIFT_RIGHT_DIVU, FUNCT7_ROTATE)},
+    {Type::RORI, Format::I, MASK_FUNCT6, Fields(OP_MATH_IMMEDIATE, FUNCT3_SHIFT_RIGHT_IMMEDIATE, FUNCT7_ROTATE)},
+    {Type::RORIW, Format::I, MASK_FUNCT7, Fields(OP_MATH_W_IMMEDIATE, FUNCT3_SHIFT_RIGHT_IMMEDIATE, FUNCT7_ROTATE)},
+    {Type::RORW, Format::R, MASK_FUNCT7, Fields(OP_MATH_W, FUNCT3_SHIFT_RIGHT_DIVU, FUNCT7_ROTATE)},
+    {Type::ORC_B, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_IMMEDIATE, FUNCT3_SHIFT_RIGHT_IMMEDIATE, IMM_ORC_B >> 5, IMM_ORC_B & 0x1f)},
+    {Type::REV8, Format::I, MASK_FUNCT7_RS2, Fields(OP_MATH_IMMEDIATE, FUNCT3_SHIFT_RIGHT_IMMEDIATE, IMM_REV8 >> 5, IMM_REV8 & 0x1f)},
+    {Type::BCLR, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLL_MULH, FUNCT7_BCLR_BEXT)},
+    {Type::BCLRI, Format::I, MASK_FUNCT6, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLLI, FUNCT7_BCLR_BEXT)},
+    {Type::BEXT, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SHIFT_RIGHT_DIVU, FUNCT7_BCLR_BEXT)},
+    {Type::BEXTI, Format::I, MASK_FUNCT6, Fields(OP_MATH_IMMEDIATE, FUNCT3_SHIFT_RIGHT_IMMEDIATE, FUNCT7_BCLR_BEXT)},
+    {Type::BINV, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLL_MULH, FUNCT7_BINV)},
+    {Type::BINVI, Format::I, MASK_FUNCT6, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLLI, FUNCT7_BINV)},
+    {Type::BSET, Format::R, MASK_FUNCT7, Fields(OP_MATH, FUNCT3_SLL_MULH, FUNCT7_BSET)},
+    {Type::BSETI, Format::I, MASK_FUNCT6, Fields(OP_MATH_IMMEDIATE, FUNCT3_SLLI, FUNCT7_BSET)},
+    {Type::VSETVLI, Format::VSETVLI, MASK_VSETVLI, Fields(OP_VECTOR, FUNCT3_OPCFG)},
+    {Type::VSETIVLI, Format::VSETIVLI, MASK_VSETIVLI, Fields(OP_VECTOR, FUNCT3_OPCFG, FUNCT7_VSETIVLI)},
+    {Type::VSETVL, Format::R, MASK_FUNCT7, Fields(OP_VECTOR, FUNCT3_OPCFG, FUNCT7_VSETVL)},
+    {Type::VLE8_V, Format::V, MASK_VECTOR_UNIT_STRIDE, Fields(OP_FL, FUNCT3_VECTOR_8, MOP_UNIT_STRIDE << 1)},
+    {Type::VLE16_V, Format::V, MASK_VECTOR_UNIT_STRIDE, Fields(OP_FL, FUNCT3_VECTOR_16, MOP_UNIT_STRIDE << 1)},
+    {Type::VLE32_V, Format::V, MASK_VECTOR_UNIT_STRIDE, Fields(OP_FL, FUNCT3_VECTOR_32, MOP_UNIT_STRIDE << 1)},
+    {Type::VLE64_V, Format::V, MASK_VECTOR_UNIT_STRIDE, Fields(OP_FL, FUNCT3_VECTOR_64, MOP_UNIT_STRIDE << 1)},
+    {Type::VSE8_V, Format::V, MASK_VECTOR_UNIT_STRIDE, Fields(OP_FS, FUNCT3_VECTOR_8, MOP_UNIT_STRIDE << 1)},
+    {Type::VSE16_V, Format::V, MASK_VECTOR_UNIT_STRIDE, Fields(OP_FS, FUNCT3_VECTOR_16, MOP_UNIT_STRIDE << 1)},
+    {Type::VSE32_V, Format::V, MASK_VECTOR_UNIT_STRIDE, Fields(OP_FS, FUNCT3_VECTOR_32, MOP_UNIT_STRIDE << 1)},
+    {Type::VSE64_V, Format::V, MASK_VECTOR_UNIT_STRIDE, Fields(OP_FS, FUNCT3_VECTOR_64, MOP_UNIT_STRIDE << 1)},
+    {Type::VLSE8_V, Format::V, MASK_FUNCT6, Fields(OP_FL, FUNCT3_VECTOR_8, MOP_STRIDED << 1)},
+    {Type::VLSE16_V, Format::V, MASK_FUNCT6, Fields(OP_FL, FUNCT3_VECTOR_16, MOP_STRIDED << 1)},
+    {Type::VLSE32_V, Format::V, MASK_FUNCT6, Fields(OP_FL, FUNCT3_VECTOR_32, MOP_STRIDED << 1)},
+    {Type::VLSE64_V, Format::V, MASK_FUNCT6, Fields(OP_FL, FUNCT3_VECTOR_64, MOP_STRIDED << 1)},
+    {Type::VSSE8_V, Format::V, MASK_FUNCT6, Fields(OP_FS, FUNCT3_VECTOR_8, MOP_STRIDED << 1)},
+    {Type::VSSE16_V, Format::V, MASK_FUNCT6, Fields(OP_FS, FUNCT3_VECTOR_16, MOP_STRIDED << 1)},
+    {Type::VSSE32_V, Format::V, MASK_FUNCT6, Fields(OP_FS, FUNCT3_VECTOR_32, MOP_STRIDED << 1)},
+    {Type::VSSE64_V, Format::V, MASK_FUNCT6, Fields(OP_FS, FUNCT3_VECTOR_64, MOP_STRIDED << 1)},
+    {Type::VADD_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVV, FUNCT6_VADD << 1)},
+    {Type::VADD_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VADD << 1)},
+    {Type::VADD_VI, Format::VI, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVI, FUNCT6_VADD << 1)},
+    {Type::VSUB_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVV, FUNCT6_VSUB << 1)},
+    {Type::VSUB_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VSUB << 1)},
+    {Type::VRSUB_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VRSUB << 1)},
+    {Type::VRSUB_VI, Format::VI, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVI, FUNCT6_VRSUB << 1)},
+    {Type::VAND_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVV, FUNCT6_VAND << 1)},
+    {Type::VAND_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VAND << 1)},
+    {Type::VAND_VI, Format::VI, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVI, FUNCT6_VAND << 1)},
+    {Type::VOR_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVV, FUNCT6_VOR << 1)},
+    {Type::VOR_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VOR << 1)},
+    {Type::VOR_VI, Format::VI, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVI, FUNCT6_VOR << 1)},
+    {Type::VXOR_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVV, FUNCT6_VXOR << 1)},
+    {Type::VXOR_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VXOR << 1)},
+    {Type::VXOR_VI, Format::VI, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVI, FUNCT6_VXOR << 1)},
+    {Type::VSLL_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVV, FUNCT6_VSLL << 1)},
+    {Type::VSLL_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VSLL << 1)},
+    {Type::VSLL_VI, Format::VI, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVI, FUNCT6_VSLL << 1)},
+    {Type::VSRL_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVV, FUNCT6_VSRL << 1)},
+    {Type::VSRL_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VSRL << 1)},
+    {Type::VSRL_VI, Format::VI, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVI, FUNCT6_VSRL << 1)},
+    {Type::VSRA_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVV, FUNCT6_VSRA << 1)},
+    {Type::VSRA_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VSRA << 1)},
+    {Type::VSRA_VI, Format::VI, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPIVI, FUNCT6_VSRA << 1)},
+    {Type::VMUL_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPMVV, FUNCT6_VMUL << 1)},
+    {Type::VMUL_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPMVX, FUNCT6_VMUL << 1)},
+    {Type::VMACC_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPMVV, FUNCT6_VMACC << 1)},
+    {Type::VMACC_VX, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPMVX, FUNCT6_VMACC << 1)},
+    {Type::VREDSUM_VS, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPMVV, FUNCT6_VREDSUM << 1)},
+    {Type::VMV_V_V, Format::V, MASK_FUNCT7_RS2, Fields(OP_VECTOR, FUNCT3_OPIVV, FUNCT6_VMV << 1 | 1)},
+    {Type::VMV_V_X, Format::V, MASK_FUNCT7_RS2, Fields(OP_VECTOR, FUNCT3_OPIVX, FUNCT6_VMV << 1 | 1)},
+    {Type::VMV_V_I, Format::VI, MASK_FUNCT7_RS2, Fields(OP_VECTOR, FUNCT3_OPIVI, FUNCT6_VMV << 1 | 1)},
+    {Type::VMV_X_S, Format::V, MASK_FUNCT7_RS1, Fields(OP_VECTOR, FUNCT3_OPMVV, FUNCT6_VMV_SCALAR << 1 | 1)},
+    {Type::VMV_S_X, Format::V, MASK_FUNCT7_RS2, Fields(OP_VECTOR, FUNCT3_OPMVX, FUNCT6_VMV_SCALAR << 1 | 1)},
+    {Type::VFADD_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVV, FUNCT6_VFADD << 1)},
+    {Type::VFADD_VF, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVF, FUNCT6_VFADD << 1)},
+    {Type::VFSUB_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVV, FUNCT6_VFSUB << 1)},
+    {Type::VFSUB_VF, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVF, FUNCT6_VFSUB << 1)},
+    {Type::VFMUL_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVV, FUNCT6_VFMUL << 1)},
+    {Type::VFMUL_VF, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVF, FUNCT6_VFMUL << 1)},
+    {Type::VFDIV_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVV, FUNCT6_VFDIV << 1)},
+    {Type::VFDIV_VF, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVF, FUNCT6_VFDIV << 1)},
+    {Type::VFMACC_VV, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVV, FUNCT6_VFMACC << 1)},
+    {Type::VFMACC_VF, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVF, FUNCT6_VFMACC << 1)},
+    {Type::VFREDUSUM_VS, Format::V, MASK_FUNCT6, Fields(OP_VECTOR, FUNCT3_OPFVV, FUNCT6_VFREDUSUM << 1)},
+    {Type::VFMV_V_F, Format::V, MASK_FUNCT7_RS2, Fields(OP_VECTOR, FUNCT3_OPFVF, FUNCT6_VMV << 1 | 1)},
+    {Type::VFMV_F_S, Format::V, MASK_FUNCT7_RS1, Fields(OP_VECTOR, FUNCT3_OPFVV, FUNCT6_VMV_SCALAR << 1 | 1)},
+    {Type::VFMV_S_F, Format::V, MASK_FUNCT7_RS2, Fields(OP_VECTOR, FUNCT3_OPFVF, FUNCT6_VMV_SCALAR << 1 | 1)},
+    {Type::SRET, Format::R, MASK_WORD, Fields(OP_SYSTEM, FUNCT3_SYSTEM, IMM_SRET >> 5, RS2_SRET_MRET)},
+    {Type::MRET, Format::R, MASK_WORD, Fields(OP_SYSTEM, FUNCT3_SYSTEM, IMM_MRET >> 5, RS2_SRET_MRET)},
+    {Type::WFI, Format::R, MASK_WORD, Fields(OP_SYSTEM, FUNCT3_SYSTEM, IMM_WFI >> 5, RS2_WFI)},
+    {Type::SFENCE_VMA, Format::R, MASK_SFENCE, Fields(OP_SYSTEM, FUNCT3_SYSTEM, FUNCT7_SFENCE_VMA)},
+    {Type::SINVAL_VMA, Format::R, MASK_SFENCE, Fields(OP_SYSTEM, FUNCT3_SYSTEM, FUNCT7_SINVAL_VMA)},
+    {Type::SINVAL_GVMA, Format::R, MASK_SFENCE, Fields(OP_SYSTEM, FUNCT3_SYSTEM, FUNCT7_SINVAL_GVMA)},
+    {Type::SFENCE_W_INVAL, Format::R, MASK_WORD, Fields(OP_SYSTEM, FUNCT3_SYSTEM, FUNCT7_SFENCE_SINVAL, RS2_SFENCE_W_INVAL)},
+    {Type::SFENCE_INVAL_IR, Format::R, MASK_WORD, Fields(OP_SYSTEM, FUNCT3_SYSTEM, FUNCT7_SFENCE_SINVAL, RS2_SFENCE_INVAL_IR)},
+    {Type::INVALID, Format::None, 0, 1},
+    {Type::CUST_TVA, Format::R, MASK_FLOAT, Fields(OP_CUST, 0, FUNCT7_CUST_TVA)},
+    {Type::CUST_MTRAP, Format::R, MASK_FLOAT, Fields(OP_CUST, 0, FUNCT7_CUST_MTRAP)},
+    {Type::CUST_STRAP, Format::R, MASK_FLOAT, Fields(OP_CUST, 0, FUNCT7_CUST_STRAP)},
+}};
+
+constexpr Word RVInstruction::Encode(Type type, Byte rd, Byte rs1, Byte rs2, SLong immediate, Byte rs3, Byte rm) {
+    auto& encoding = encodings[static_cast<size_t>(type)];
+
+    Word fields = 0;
+    switch (encoding.format) {
+        case Format::R:
+            fields = Fields(0, 0, 0, rs2, rs1, rd);
+            break;
+
+        case Format::R4:
+            fields = Fields(0, rm, rs3 << 2, rs2, rs1, rd);
+            break;
+
+        case Format::RFloat:
+            fields = Fields(0, rm, 0, rs2, rs1, rd);
+            break;
+
+        case Format::I:
+        case Format::CSR:
+            fields = Fields(0, 0, 0, 0, rs1, rd) | PackImmediate(encoding.format, immediate);
+            break;
+
+        case Format::S:
+        case Format::B:
+            fields = Fields(0, 0, 0, rs2, rs1) | PackImmediate(encoding.format, immediate);
+            break;
+
+        case Format::U:
+        case Format::J:
+            fields = Fields(0, 0, 0, 0, 0, rd) | PackImmediate(encoding.format, immediate);
+            break;
+
+        case Format::V:
+            fields = Fields(0, 0, rs3 & 1, rs2, rs1, rd);
+            break;
+
+        case Format::VI:
+            fields = Fields(0, 0, rs3 & 1, rs2, 0, rd) | PackImmediate(encoding.format, immediate);
+            break;
+
+        case Format::VSETVLI:
+        case Format::VSETIVLI:
+            fields = Fields(0, 0, 0, 0, rs1, rd) | PackImmediate(encoding.format, immediate);
+            break;
+
+        default:
+            break;
+    }
+
+    return encoding.match | (fields & ~encoding.mask);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef SEQ_LOCK_HPP
+#define SEQ_LOCK_HPP
+
+#include "Types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+// One writer publishes a value that any number of readers copy without
+// locking. The sequence is odd while a write is in progress, and a reader
+// retries if it changed under the copy. The value is kept as relaxed
+// atomic words so a torn copy is only ever discarded, never undefined
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(Long) - 1) / sizeof(Long);
+
+    std::atomic<Long> sequence = 0;
+    std::array<std::atomic<Long>, WORDS> words{};
+
+    static inline size_t WordBytes(size_t word) {
+        return std::min(sizeof(Long), sizeof(T) - word * sizeof(Long));
+    }
+
+public:
+    // Writer only
+    void Write(const T& value) {
+        auto source = reinterpret_cast<const Byte*>(&value);
+
+        auto current = sequence.load(std::memory_order_relaxed);
+        sequence.store(current + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORDS; i++) {
+            Long word = 0;
+            std::memcpy(&word, source + i * sizeof(Long), WordBytes(i));
+            words[i].store(word, std::memory_order_relaxed);
+        }
+
+        sequence.store(current + 2, std::memory_order_release);
+    }
+
+    // False until the first write. A torn copy is overwritten by the retry
+    bool Read(T& value) const {
+        auto target = reinterpret_cast<Byte*>(&value);
+
+        while (true) {
+            auto before = sequence.load(std::memory_order_acquire);
+            if (before == 0) return false;
+
+            if (before & 1) continue;
+
+            for (size_t i = 0; i < WORDS; i++) {
+                Long word = words[i].load(std::memory_order_relaxed);
+                std::memcpy(target + i * sizeof(Long), &word, WordBytes(i));
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before) return true;
+        }
+    }
+
+    // Bumped by every write, so readers can tell whether anything changed
+    inline Long GetVersion() const { return sequence.load(std::memory_order_acquire) / 2; }
+};
+
+#endif
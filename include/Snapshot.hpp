@@ -0,0 +1,85 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "Types.hpp"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <type_traits>
+#include <stdexcept>
+
+class Memory;
+class VirtualMachine;
+
+// Appends plain values to a snapshot file
+class SnapshotWriter {
+private:
+    std::ofstream file;
+
+public:
+    SnapshotWriter(const std::string& path);
+
+    template <typename T>
+    inline void Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void WriteBytes(const Byte* bytes, Address count);
+
+    // Pads with zeroes up to a multiple of alignment
+    void Align(Address alignment);
+
+    Long Tell();
+    void Close();
+};
+
+// Reads plain values back out of a snapshot held in memory
+class SnapshotReader {
+private:
+    const Byte* data;
+    Address size;
+    Address offset = 0;
+
+public:
+    SnapshotReader(const Byte* data, Address size) : data{data}, size{size} {}
+
+    template <typename T>
+    inline void Read(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        if (offset + sizeof(T) > size)
+            throw std::runtime_error("Snapshot ends mid record");
+
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+    }
+
+    template <typename T>
+    inline T Read() {
+        T value;
+        Read(value);
+        return value;
+    }
+
+    inline Address Tell() const { return offset; }
+    inline void Seek(Address offset) { this->offset = offset; }
+};
+
+// The whole machine in one file: every hart's architectural state, the
+// CLINT, and each RAM page that holds data. Page data starts page aligned
+// in the file, so a restore can map it straight into guest RAM instead of
+// reading it. Harts must not be running while a snapshot is saved or
+// restored, and restores expect a machine built with the same regions
+class Snapshot {
+public:
+    static constexpr char MAGIC[8] = {'R', 'V', '6', '4', 'S', 'N', 'P', '1'};
+    static constexpr Word VERSION = 3;
+
+    static void Save(const std::string& path, Memory& memory, const std::vector<VirtualMachine*>& harts);
+    static void Restore(const std::string& path, Memory& memory, const std::vector<VirtualMachine*>& harts);
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include "Types.hpp"
+
+#include <array>
+#include <vector>
+#include <string>
+#include <atomic>
+
+// Timeline events for one thread, kept in a fixed ring that drops the
+// oldest events. Only the owning thread records, so publishing an event is
+// a single release store. Reading while the owner is still recording may
+// see torn events from the slots being overwritten, so flush once the
+// thread has stopped or paused
+class Tracer {
+public:
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    enum class Kind : Byte {
+        MachineTrap,
+        SupervisorTrap,
+        Privilege,
+        ECall,
+        WaitForInterrupt,
+        Pause,
+        GDB,
+        Count
+    };
+
+    static constexpr size_t KIND_COUNT = static_cast<size_t>(Kind::Count);
+
+    // Instants have no duration. Traps carry the cause and whether it was
+    // an interrupt, privilege changes the old and new level, ECALLs the
+    // handler index and GDB spans the packet's command character
+    struct Event {
+        Long start = 0;
+        Long duration = 0;
+        Long arg = 0;
+        Long detail = 0;
+        Kind kind = Kind::Count;
+        bool instant = false;
+    };
+
+private:
+    struct OpenSpan {
+        Long start = 0;
+        Long arg = 0;
+        Long detail = 0;
+        bool open = false;
+    };
+
+    std::vector<Event> events;
+    std::atomic<Long> head = 0;
+
+    std::array<OpenSpan, KIND_COUNT> spans{};
+
+    Long thread_id = 0;
+    std::string thread_name;
+
+    void Push(const Event& event);
+
+public:
+    Tracer() = default;
+    Tracer(const Tracer&) = delete;
+    Tracer(Tracer&& tracer);
+    ~Tracer() = default;
+
+    Tracer& operator=(const Tracer&) = delete;
+    Tracer& operator=(Tracer&& tracer);
+
+    inline void SetThread(Long id, const std::string& name) {
+        thread_id = id;
+        thread_name = name;
+    }
+
+    inline Long GetThreadID() const { return thread_id; }
+    inline const std::string& GetThreadName() const { return thread_name; }
+
+    // Nanoseconds since the first tracer was used, shared by every thread
+    static Long Now();
+
+    // A span of a kind that's already open keeps its original start
+    void Begin(Kind kind, Long arg = 0, Long detail = 0);
+    void End(Kind kind);
+    void Instant(Kind kind, Long arg = 0, Long detail = 0);
+
+    inline bool IsOpen(Kind kind) const { return spans[static_cast<size_t>(kind)].open; }
+
+    // Oldest first
+    std::vector<Event> GetEvents() const;
+    void Reset();
+
+    static std::string GetKindName(Kind kind);
+
+    // Chrome trace event JSON, loadable by chrome://tracing and Perfetto.
+    // Each tracer becomes one thread of a single process
+    static void WriteChromeTrace(const std::string& path, const std::vector<const Tracer*>& tracers);
+};
+
+#endif
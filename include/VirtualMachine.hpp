@@ -2,22 +2,40 @@
 #define VIRTUAL_MACHINE_HPP
 
 #include "Memory.hpp"
+#include "CLINT.hpp"
+#include "InstructionCache.hpp"
+#include "JIT.hpp"
+#include "Profiler.hpp"
+#include "Tracer.hpp"
+#include "InstructionTrace.hpp"
 #include "Float.hpp"
 #include "Expected.hpp"
+#include "SeqLock.hpp"
 
 #include <cstdint>
+#include <cmath>
 #include <array>
+#include <atomic>
 #include <vector>
 #include <set>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <memory>
 #include <string>
+#include <functional>
 #include <format>
 #include <stdexcept>
 #include <unordered_map>
+#include <optional>
+#include <utility>
 
-class VirtualMachine {
+class SnapshotWriter;
+class SnapshotReader;
+
+// Cache line aligned, so harts allocated side by side never share a line
+class alignas(64) VirtualMachine {
     friend class TLBEntry;
 
 public:
@@ -45,17 +63,26 @@ private:
     static constexpr Long ISA_64_BITS = 1ULL << 63;
 
     static constexpr Long ISA_A = 1<<0;
+    static constexpr Long ISA_B = 1<<1;
+    static constexpr Long ISA_C = 1<<2;
     static constexpr Long ISA_D = 1<<3;
     static constexpr Long ISA_F = 1<<5;
     static constexpr Long ISA_I = 1<<8;
     static constexpr Long ISA_M = 1<<12;
     static constexpr Long ISA_S = 1<<18;
     static constexpr Long ISA_U = 1<<20;
+    static constexpr Long ISA_V = 1<<21;
 
-    std::array<Reg, REGISTER_COUNT> regs;
-    std::array<Float, REGISTER_COUNT> fregs;
+public:
+    // Bits per vector register. Any power of two from 64 up works, the
+    // register file is one contiguous block so groups of registers are
+    // contiguous too
+    static constexpr size_t VLEN = 256;
+    static constexpr size_t VLENB = VLEN / 8;
+    static constexpr size_t ELEN = 64;
 
-    std::unordered_map<Long, Long> csrs;
+private:
+    static constexpr size_t CSR_COUNT = 0x1000;
 
     bool CSRPrivilegeCheck(Long csr);
     Long ReadCSR(Long csr, bool is_internal_read = false);
@@ -63,7 +90,18 @@ private:
 
     static const int default_rounding_mode;
     bool ChangeRoundingMode(Byte rm = 0xff);
-    bool CheckFloatErrors();
+
+    // Host exception flags are sticky, so they are only folded into fcsr when
+    // the guest can observe them instead of after every instruction
+    bool precise_float_flags = false;
+    void SyncFloatFlags();
+    void ClearFloatFlags();
+
+    template <typename T>
+    inline bool CheckFloatErrors(T result) {
+        if (precise_float_flags) SyncFloatFlags();
+        return std::isnan(result);
+    }
 
 public:
     static constexpr Half CSR_FFLAGS = 0x001;
@@ -77,6 +115,20 @@ public:
     static constexpr Long CSR_FCSR_NX = 0b1;
 
     static constexpr Long CSR_FCSR_FLAGS = 0b11111;
+
+    static constexpr Half CSR_VSTART = 0x008;
+    static constexpr Half CSR_VXSAT = 0x009;
+    static constexpr Half CSR_VXRM = 0x00a;
+    static constexpr Half CSR_VCSR = 0x00f;
+    static constexpr Half CSR_VL = 0xc20;
+    static constexpr Half CSR_VTYPE = 0xc21;
+    static constexpr Half CSR_VLENB = 0xc22;
+
+    // vtype leaves vill in the top bit when the last vsetvl asked for a
+    // type the hart can't hold
+    static constexpr Long VTYPE_VILL = 1ULL << 63;
+    static constexpr Long VTYPE_VTA = 1 << 6;
+    static constexpr Long VTYPE_VMA = 1 << 7;
     
     static constexpr Half CSR_CYCLE = 0xc00;
     static constexpr Half CSR_TIME = 0xc01;
@@ -144,7 +196,76 @@ public:
     static constexpr Half CSR_PERFORMANCE_EVENT_MAX = 32;
     static constexpr Half CSR_MHPMEVENT3 = 0x323;
 
-    static constexpr Long MSTATUS_WRITABLE_BITS = 0b00000000000011100111100110101010;
+    // Events selectable through mhpmevent3-31. Anything else reads back as
+    // HPM_EVENT_NONE, which never counts
+    static constexpr Long HPM_EVENT_NONE = 0;
+    static constexpr Long HPM_EVENT_LOADS = 1;
+    static constexpr Long HPM_EVENT_STORES = 2;
+    static constexpr Long HPM_EVENT_BRANCHES_TAKEN = 3;
+    static constexpr Long HPM_EVENT_TLB_MISSES = 4;
+    static constexpr Long HPM_EVENT_TRAPS = 5;
+    static constexpr Long HPM_EVENT_SC_FAILURES = 6;
+    static constexpr Long HPM_EVENT_FLOAT_OPS = 7;
+    static constexpr Long HPM_EVENT_DECODE_MISSES = 8;
+    static constexpr Long HPM_EVENT_COUNT = 9;
+
+    static constexpr Long MSTATUS_WRITABLE_BITS = 0b00000000000011100111111110101010;
+
+private:
+    enum class CSRKind : Byte {
+        Unimplemented,
+        Plain,
+        ReadOnly,
+        Zero,
+        Special
+    };
+
+    // How each CSR is accessed. Plain and read only CSRs live in csrs, zero
+    // CSRs read as 0 and ignore writes, and special CSRs are dispatched in
+    // ReadCSR and WriteCSR because they alias other state or have side effects
+    static constexpr std::array<CSRKind, CSR_COUNT> csr_kinds = [] {
+        std::array<CSRKind, CSR_COUNT> kinds{};
+
+        for (Half csr : {
+            CSR_STVEC, CSR_SSCRATCH, CSR_SEPC, CSR_SCAUSE, CSR_STVAL,
+            CSR_MEDELEG, CSR_MTVEC, CSR_MSCRATCH, CSR_MEPC, CSR_MCAUSE, CSR_MTVAL,
+            CSR_VSTART, CSR_VXSAT, CSR_VXRM
+        })
+            kinds[csr] = CSRKind::Plain;
+
+        for (Half csr : {
+            CSR_MVENDORID, CSR_MARCHID, CSR_MIMPID, CSR_MHARTID, CSR_MCONFIGPTR, CSR_MISA,
+            CSR_VL, CSR_VTYPE, CSR_VLENB
+        })
+            kinds[csr] = CSRKind::ReadOnly;
+
+        for (Half csr : {CSR_MCOUNTEREN, CSR_SCOUNTEREN})
+            kinds[csr] = CSRKind::Plain;
+
+        for (Half csr : {CSR_MENVCFG, CSR_MENVCFGH, CSR_SENVCFG})
+            kinds[csr] = CSRKind::Zero;
+
+        for (Half i = 0; i < CSR_PERFORMANCE_EVENT_MAX - 3; i++)
+            kinds[CSR_MHPMEVENT3 + i] = CSRKind::Special;
+
+        for (Half i = 0; i < CSR_PERF_COUNTER_MAX - 3; i++) {
+            kinds[CSR_MHPMCOUNTER3 + i] = CSRKind::Special;
+            kinds[CSR_HPMCOUNTER + i] = CSRKind::Special;
+            kinds[CSR_MHPMCOUNTER3H + i] = CSRKind::Zero;
+        }
+
+        for (Half csr : {
+            CSR_FFLAGS, CSR_FRM, CSR_FCSR, CSR_VCSR, CSR_CYCLE, CSR_TIME, CSR_MCYCLE,
+            CSR_INSTRET, CSR_MINSTRET, CSR_CYCLEH, CSR_TIMEH, CSR_INSTRETH, CSR_MINSTRETH,
+            CSR_SSTATUS, CSR_SIE, CSR_SIP, CSR_SATP,
+            CSR_MSTATUS, CSR_MIDELEG, CSR_MIE, CSR_MIP, CSR_MCOUNTINHIBIT
+        })
+            kinds[csr] = CSRKind::Special;
+
+        return kinds;
+    }();
+
+public:
 
     union MStatus {
         struct {
@@ -157,7 +278,7 @@ public:
             Long _unused3 : 1;
             Long MPIE : 1;
             Long SPP : 1;
-            Long _unused4 : 2;
+            Long VS : 2;
             Long MPP : 2;
             Long FS : 2;
             Long _unused5 : 2;
@@ -178,9 +299,12 @@ public:
     static constexpr Byte FS_CLEAN = 2;
     static constexpr Byte FS_DIRTY = 3;
 
+    // VS is encoded like FS
+    static constexpr Byte VS_DIRTY = FS_DIRTY;
+
     inline MStatus ReadMStatus() const {
         MStatus mstatus;
-        mstatus.raw = csrs.at(CSR_MSTATUS);
+        mstatus.raw = csrs[CSR_MSTATUS];
         return mstatus;
     }
 
@@ -188,11 +312,12 @@ public:
         csrs[CSR_MSTATUS] = mstatus.raw;
     }
 
-    inline bool Is32BitMode() const {
+    // Harts only run RV64, so every 32 bit path folds away at compile time
+    static constexpr bool Is32BitMode() {
         return false;
     }
 
-    static constexpr Long SSTATUS_WRITABLE_BITS = 0b00000000000011000110000100100010;
+    static constexpr Long SSTATUS_WRITABLE_BITS = 0b00000000000011000110011100100010;
 
     union SStatus {
         struct {
@@ -203,7 +328,7 @@ public:
             Long _unused2 : 1;
             Long _unused3 : 1;
             Long SPP : 1;
-            Long _unused4 : 2;
+            Long VS : 2;
             Long _unused5 : 2;
             Long FS : 2;
             Long _unused6 : 2;
@@ -217,7 +342,7 @@ public:
     };
     inline SStatus ReadSStatus() const {
         SStatus sstatus;
-        sstatus.raw = csrs.at(CSR_SSTATUS);
+        sstatus.raw = csrs[CSR_SSTATUS];
         return sstatus;
     }
 
@@ -230,7 +355,6 @@ public:
         Supervisor,
         User
     };
-    PrivilegeLevel privilege_level;
 
     static constexpr size_t REG_ZERO = 0;
     static constexpr size_t REG_RA = 1;
@@ -310,12 +434,8 @@ public:
             Long A : 1;
             Long D : 1;
             Long RSW : 2;
-            Long PPN_0 : 10;
-            Long PPN_1 : 12;
-        };
-        struct {
-            Long _unused : 10;
-            Long PPN : 22;
+            Long PPN : 44;
+            Long _reserved : 10;
         };
         Long raw;
 
@@ -329,9 +449,11 @@ public:
     static constexpr Long INTERRUPT_SUPERVISOR_TIMER = 0x5;
     static constexpr Long INTERRUPT_MACHINE_TIMER = 0x7;
     static constexpr Long INTERRUPT_SUPERVISOR_EXTERNAL = 0x9;
-    static constexpr Long INTERRUPT_MACHINE_EXTERNAL = 0xa;
+    static constexpr Long INTERRUPT_MACHINE_EXTERNAL = 0xb;
 
     void RaiseInterrupt(Long cause);
+    void ClearInterrupt(Long cause);
+    void SetInterruptPending(Long cause, bool pending);
 
 private:
     bool waiting_for_interrupt = false;
@@ -361,9 +483,25 @@ private:
 
     void RaiseException(Long cause);
 
-    static constexpr Long VALID_INTERRUPT_BITS = 0b0;
+    static constexpr Long VALID_INTERRUPT_BITS =
+        (1ULL << INTERRUPT_SUPERVISOR_SOFTWARE) | (1ULL << INTERRUPT_MACHINE_SOFTWARE) |
+        (1ULL << INTERRUPT_SUPERVISOR_TIMER) | (1ULL << INTERRUPT_MACHINE_TIMER) |
+        (1ULL << INTERRUPT_SUPERVISOR_EXTERNAL) | (1ULL << INTERRUPT_MACHINE_EXTERNAL);
+
+    // The machine lines are driven by the CLINT and PLIC, not csrw
+    static constexpr Long MIP_WRITABLE_BITS =
+        (1ULL << INTERRUPT_SUPERVISOR_SOFTWARE) | (1ULL << INTERRUPT_SUPERVISOR_TIMER) |
+        (1ULL << INTERRUPT_SUPERVISOR_EXTERNAL);
+
+    // Highest priority first, as the privileged spec orders them
+    static constexpr std::array<Long, 6> INTERRUPT_PRIORITY = {
+        INTERRUPT_MACHINE_EXTERNAL, INTERRUPT_MACHINE_SOFTWARE, INTERRUPT_MACHINE_TIMER,
+        INTERRUPT_SUPERVISOR_EXTERNAL, INTERRUPT_SUPERVISOR_SOFTWARE, INTERRUPT_SUPERVISOR_TIMER
+    };
 
-    Long mip = 0;
+    // Set and cleared from device threads, so a hart sees new interrupts by
+    // loading this one word
+    std::atomic<Long> mip = 0;
     Long mie = 0;
     Long mideleg = 0;
     Long sip = 0;
@@ -372,20 +510,26 @@ private:
     void RaiseMachineTrap(Long cause);
     void RaiseSupervisorTrap(Long cause);
     
-    MStatus mstatus;
-    SStatus sstatus;
-
+    // A cached leaf PTE. Superpages are cached at their level and match any
+    // 4 KiB VPN inside them. Entries from an older generation are invalid,
+    // which makes a full SFENCE.VMA a single increment
     struct TLBCacheEntry {
-        Long tag : 63;
-        Long super : 1;
-        
-        TLBEntry tlb_entry;
+        Long vpn = 0;
+        Long generation = 0;
+        TLBEntry pte = {};
+        Half asid = 0;
+        Byte level = 0;
+    };
+
+    static constexpr size_t TLB_SETS = 64;
+    static constexpr size_t TLB_WAYS = 4;
 
-        TLBCacheEntry() : tag{0}, super{0} { tlb_entry.raw = 0; }
+    // A set is exactly two cache lines
+    struct TLB {
+        alignas(64) std::array<std::array<TLBCacheEntry, TLB_WAYS>, TLB_SETS> sets;
+        std::array<Byte, TLB_SETS> victims{};
     };
 
-    static constexpr size_t TLB_CACHE_SIZE = 16;
-    
     template <typename Type>
     inline static consteval Type GetLog2(Type value) {
         static_assert(!std::is_signed_v<Type>);
@@ -401,29 +545,61 @@ private:
         return i;
     }
 
-public:
-    std::pair<TLBEntry, bool> GetTLBLookup(Address phys_addr, bool bypass_cache = false, bool is_amo = false);
+    TLB instruction_tlb;
+    TLB data_tlb;
 
-private:
-    size_t tlb_cache_round_robin = 0;
-    std::array<TLBCacheEntry, TLB_CACHE_SIZE> tlb_cache;
+    const TLBCacheEntry* GetTLBLookup(Address virt_addr, bool is_write, bool is_execute);
+    void FlushTLB(Address virt_addr, bool all_addresses, Half asid, bool all_asids);
 
     Memory& memory;
+    InstructionCache instruction_cache;
 
     union SATP {
         struct {
-            Long PPN : 22;
-            Long ASID : 9;
-            Long MODE : 1;
+            Long PPN : 44;
+            Long ASID : 16;
+            Long MODE : 4;
         };
         Long raw;
     };
 
+    static constexpr Long SATP_MODE_BARE = 0;
+    static constexpr Long SATP_MODE_SV39 = 8;
+    static constexpr Long SATP_MODE_SV48 = 9;
+
+    // Hot context, what nearly every instruction touches, kept together in
+    // as few cache lines as possible. fcsr and the other low CSRs share the
+    // first line of csrs, which follows
+    alignas(64) std::array<Reg, REGISTER_COUNT> regs;
+    std::array<Float, REGISTER_COUNT> fregs;
+
+    Long pc;
+    Long cycles;
+
+    // Cycles spent asleep in WFI, which retire nothing. instret is cycles
+    // less these
+    Long stalled_cycles = 0;
+
+    PrivilegeLevel privilege_level;
     SATP satp;
 
+    // Whether fetches, loads and stores go through the page tables. Kept in
+    // step with the privilege level and satp by UpdateTranslation
+    bool translating = false;
+    MStatus mstatus{};
+    SStatus sstatus{};
+
+    Long tlb_generation = 1;
+    Word host_page_generation = 0;
+
+    bool running = false;
+
+    alignas(64) std::array<Long, CSR_COUNT> csrs{};
+    alignas(64) std::array<Byte, REGISTER_COUNT * VLENB> vregs{};
+
 public:
     inline bool IsUsingVirtualMemory() const {
-        return (privilege_level != PrivilegeLevel::Machine) && (satp.MODE != 0);
+        return translating;
     }
 
     inline Long GetPendingMachineInterrupts() const {
@@ -447,60 +623,454 @@ public:
     }
 
 private:
-    std::pair<Address, bool> TranslateMemoryAddress(Address address, bool is_write, bool is_execute, bool is_amo = false);
+    // Without paging an address is its own translation, which is answered
+    // inline so bare metal and machine mode accesses skip the call
+    inline std::pair<Address, bool> TranslateMemoryAddress(Address address, bool is_write, bool is_execute, bool is_amo = false) {
+        if (!translating) return {address, true};
+        return TranslatePagedAddress(address, is_write, is_execute, is_amo);
+    }
 
-    Long pc;
-    Long cycles;
+    std::pair<Address, bool> TranslatePagedAddress(Address address, bool is_write, bool is_execute, bool is_amo);
+
+    inline void UpdateTranslation() {
+        translating = privilege_level != PrivilegeLevel::Machine && satp.MODE != 0;
+    }
+
+    inline void SetPrivilegeLevel(PrivilegeLevel level) {
+        privilege_level = level;
+        UpdateTranslation();
+    }
 
-    bool running = false;
     bool paused = false;
+
+    // Set while the hart sleeps on a pause or a hold, so another thread can
+    // tell the state has stopped changing
+    std::atomic<bool> parked = false;
+
+    // A pause the host takes without the guest or a debugger seeing it
+    std::atomic<bool> held = false;
+
     bool pause_on_break = false;
     bool pause_on_restart = false;
     std::string err = "";
 
-    std::set<Long> break_points;
+    // Handed to the guest in a1 on every start, 0 for none
+    Address device_tree = 0;
 
-    Long ticks;
-    std::vector<double> history_delta;
-    std::vector<Long> history_tick;
+    // The watchpoint the last access hit, which ends the slice after the
+    // instruction that made it
+    std::optional<Memory::Watchpoint> watch_hit;
 
     static constexpr size_t MAX_HISTORY = 15;
 
+    // The last MAX_HISTORY frames, with history_next the oldest once full
+    Long ticks;
+    std::array<double, MAX_HISTORY> history_delta{};
+    std::array<Long, MAX_HISTORY> history_tick{};
+    size_t history_count = 0;
+    size_t history_next = 0;
+
+    // Idle harts sleep here until an interrupt, a GUI or GDB command, or
+    // their timer deadline. The wait is capped so a missed wake-up only
+    // costs one period
+    static constexpr auto MAX_IDLE_WAIT = std::chrono::milliseconds(10);
+
+    std::mutex idle_lock;
+    std::condition_variable idle_signal;
+
+    Long busy_cycles = 0;
+    std::chrono::steady_clock::duration busy_time{};
+
+    // Lets a scheduler that parked this hart hear about wake-ups. Called on
+    // whichever thread raised the interrupt or unpaused the hart
+    std::function<void()> wake_handler;
+
+public:
+    enum class Budget {
+        Instructions,
+        Cycles
+    };
+
+    // Called on the hart's thread when a budget runs out. It may set a new
+    // budget to keep the hart going, otherwise the hart stops
+    using BudgetHandler = std::function<void(VirtualMachine& vm, Budget budget)>;
+
+private:
+    // What's left of each budget, nothing for none
+    std::optional<Long> instructions_left;
+    std::optional<Long> cycles_left;
+    BudgetHandler budget_handler;
+
+    void ChargeBudgets(Long steps, Long slice_cycles, Long slice_instructions);
+
+    // Start mailbox written by RequestStart and emptied by the hart itself.
+    // Other threads write it, so it gets a line of its own
+    alignas(64) std::atomic<bool> start_requested = false;
+    std::atomic<Long> start_address = 0;
+
+    // True when a start was waiting and the hart now sits at its address
+    bool TakeStartRequest();
+
+    void WaitForWake();
+    bool PollWake(bool skip_idle);
+    void RunSlice(Long steps);
+
     void Setup();
 
-    class CSRMappedMemory : public MemoryRegion {
-    public:
-        static constexpr Long TICKS_PER_SECOND = 32768;
-        Long time = 0;
-        Long time_cmp = -1ULL;
-
-        CSRMappedMemory() : MemoryRegion{TYPE_MAPPED_CSRS, 0,  0Xf00, 0x100, true, true} {}
-
-        Word ReadWord(Address address) const override {
-            address >>= 2;
-
-            switch (address) {
-                case 0:
-                    return static_cast<Word>(time);
-                
-                case 1:
-                    return static_cast<Word>(time >> 32);
-                
-                case 2:
-                    return static_cast<Word>(time_cmp);
-                
-                case 3:
-                    return static_cast<Word>(time_cmp >> 32);
+    bool IsStillWaitingForInterrupt();
+    void HandleInterrupts();
+    bool Execute(const RVInstruction& instr);
+
+    // The V extension, in Vector.cpp. Returns like Execute and clears
+    // inc_pc when the instruction trapped
+    bool ExecuteVector(const RVInstruction& instr, bool& inc_pc);
+
+    // Sets vl and vtype for vsetvl and friends, returning the new vl
+    Long SetVectorType(Long avl, Long vtype, bool keep_vl);
+
+    // Moves the elements of a vector load or store between the register
+    // group at vd and memory, stride bytes apart. Unmasked unit stride
+    // runs go a page at a time through host memory. False after a fault,
+    // with vstart at the element that faulted
+    template <typename T>
+    bool TransferVector(const RVInstruction& instr, Address base, SLong stride, bool is_write);
+
+    // Decoded here rather than cached when it crosses into the next page
+    RVInstruction straddling;
+
+    // The instruction at pc, whose first half is at translated_address.
+    // Null when the second half is on a page that faulted
+    const RVInstruction* FetchInstruction(Address translated_address);
+    bool StopsAtBreakPoint(const RVInstruction& instr) const;
+
+    // Pairs compilers emit back to back, which StepBlocks runs as one
+    // operation. Each still counts as its own instruction
+    enum class Fusion : Byte {
+        None,
+        LoadImmediate,     // LUI, ADDI
+        LoadImmediateWord, // LUI, ADDIW
+        AddressPC,         // AUIPC, ADDI
+        CallPC,            // AUIPC, JALR
+        ShiftPair,         // SLLI, SRLI
+        CompareBranch      // SLT or SLTU, BEQZ or BNEZ on the result
+    };
+
+    // How a block leaves, which decides where StepBlocks looks for the next
+    // one. Calls and returns are JAL and JALR linking or jumping through ra
+    // or t0, as the spec hints
+    enum class Exit : Byte {
+        Direct,
+        Call,
+        IndirectCall,
+        Return,
+        // Pops the return it goes to and pushes itself in its place
+        Coroutine,
+        Indirect
+    };
+
+    struct BasicBlock {
+        Address address = 0;
+        Word version = 0;
+        std::vector<RVInstruction> instructions;
+
+        // One per instruction, set on the first of a fused pair
+        std::vector<Fusion> fusions;
+
+        // Blocks the last two direct exits went to
+        std::array<BasicBlock*, 2> successors = {nullptr, nullptr};
+
+        Exit exit = Exit::Direct;
+
+        // Where the last return to this call block went
+        BasicBlock* return_block = nullptr;
+
+        Long executions = 0;
+        JIT::Block compiled = nullptr;
+        size_t compiled_length = 0;
+        Address compiled_size = 0;
+        bool compile_attempted = false;
+    };
+
+    static constexpr size_t MAX_BASIC_BLOCK_SIZE = 64;
+
+    std::unordered_map<Address, BasicBlock> basic_blocks;
+    bool basic_blocks_dirty = false;
+    bool use_basic_blocks = true;
+
+    // Shadow return address stack. Calls push their block and a return pops
+    // it, chaining straight to the block that return went to last time. A
+    // coroutine swap does both. Guesses are checked before use, so a wrong
+    // one only costs the lookup
+    static constexpr size_t RETURN_STACK_SIZE = 16;
+
+    std::array<BasicBlock*, RETURN_STACK_SIZE> return_stack{};
+    size_t return_top = 0;
+
+    // Other indirect jumps, cached by source block and target address
+    struct IndirectTarget {
+        BasicBlock* source = nullptr;
+        BasicBlock* target = nullptr;
+    };
+
+    static constexpr size_t INDIRECT_TARGETS = 64;
+
+    std::array<IndirectTarget, INDIRECT_TARGETS> indirect_targets{};
+
+    // Returns and indirect jumps taken between blocks, and how many of them
+    // found their block without a lookup
+    Long indirect_jumps = 0;
+    Long indirect_hits = 0;
+
+    JIT jit;
+    bool use_jit = false;
+    Long jit_instructions = 0;
+    Long block_instructions = 0;
+
+    void CompileBasicBlock(BasicBlock& block);
+
+    Profiler profiler;
+    bool profiling = false;
+
+    Tracer tracer;
+    bool tracing = false;
+
+    // Called before privilege_level changes, mode is the level being entered
+    void TraceTrapEntry(Tracer::Kind kind, Long cause, Byte mode);
+    void TraceTrapReturn(Tracer::Kind kind, Byte mode);
+
+    // Only Step traces instructions, so Run leaves basic blocks and the JIT
+    // alone while a trace is open
+    std::unique_ptr<InstructionTraceWriter> instruction_trace;
+
+    bool ExecuteTraced(const RVInstruction& instr);
+
+    // Event totals since the hart was created. The hpm counters are views
+    // of these, so counting costs one increment and the CSRs do the rest.
+    // Slot HPM_EVENT_NONE soaks up instructions that count as no event
+    std::array<Long, HPM_EVENT_COUNT> events{};
+
+    static constexpr std::array<Byte, RVInstruction::TYPE_COUNT> instruction_events = [] {
+        using Type = RVInstruction::Type;
+
+        std::array<Byte, RVInstruction::TYPE_COUNT> table{};
+
+        auto Mark = [&](Type first, Type last, Long event) {
+            for (auto type = static_cast<size_t>(first); type <= static_cast<size_t>(last); type++)
+                table[type] = event;
+        };
+
+        for (auto type : {Type::LB, Type::LH, Type::LW, Type::LBU, Type::LHU, Type::LWU, Type::LD, Type::FLW, Type::FLD})
+            table[static_cast<size_t>(type)] = HPM_EVENT_LOADS;
+
+        for (auto type : {Type::SB, Type::SH, Type::SW, Type::SD, Type::FSW, Type::FSD})
+            table[static_cast<size_t>(type)] = HPM_EVENT_STORES;
+
+        Mark(Type::FMADD_S, Type::FCVT_S_LU, HPM_EVENT_FLOAT_OPS);
+        Mark(Type::FMADD_D, Type::FMV_D_X, HPM_EVENT_FLOAT_OPS);
+
+        Mark(Type::VLE8_V, Type::VLE64_V, HPM_EVENT_LOADS);
+        Mark(Type::VSE8_V, Type::VSE64_V, HPM_EVENT_STORES);
+        Mark(Type::VLSE8_V, Type::VLSE64_V, HPM_EVENT_LOADS);
+        Mark(Type::VSSE8_V, Type::VSSE64_V, HPM_EVENT_STORES);
+        Mark(Type::VFADD_VV, Type::VFMV_S_F, HPM_EVENT_FLOAT_OPS);
+
+        return table;
+    }();
+
+    struct PerformanceCounter {
+        Long event = HPM_EVENT_NONE;
+        Long base = 0;
+        Long start = 0;
+    };
+
+    std::array<PerformanceCounter, CSR_PERF_COUNTER_MAX> performance_counters{};
+    Long count_inhibit = 0;
+
+    static constexpr Long COUNT_INHIBIT_WRITABLE_BITS = 0xfffffff8;
+
+    Long ReadEvent(Long event) const;
+    Long ReadPerformanceCounter(Half counter) const;
+    void WritePerformanceCounter(Half counter, Long value);
+    void SelectPerformanceEvent(Half counter, Long event);
+    void SetCountInhibit(Long value);
+
+    static bool EndsBasicBlock(RVInstruction::Type type);
+    BasicBlock& GetBasicBlock(Address address, Address virtual_address);
+    void InvalidateBasicBlocks();
+
+    static Exit GetExit(const RVInstruction& last);
+    static Fusion FindFusion(const RVInstruction& first, const RVInstruction& second);
+    void ExecuteFused(Fusion fusion, const RVInstruction& first, const RVInstruction& second);
+
+    // Per-hart cache of guest physical pages that are plain host memory, so
+    // aligned loads and stores skip routing and the virtual region calls.
+    // Pages shared copy-on-write with a clone are cached read only and
+    // dropped as soon as any hart copies a page. Stores set the page's dirty
+    // bit themselves, since they skip the region
+    struct HostPage {
+        Address page = -1ULL;
+        Byte* host = nullptr;
+        bool writable = false;
+        bool shared = false;
+        Word generation = 0;
+        std::atomic<Long>* dirty = nullptr;
+        Long dirty_bit = 0;
+    };
+
+    static constexpr size_t HOST_PAGE_SLOTS = 64;
+
+    std::array<HostPage, HOST_PAGE_SLOTS> host_pages;
+
+    void LoadHostPage(HostPage& entry, Address address, bool is_write);
+
+    // Called before running so pages frozen by a clone are looked up again
+    inline void SyncHostPages() {
+        auto generation = memory.GetHostPageGeneration();
+        if (generation == host_page_generation) return;
+
+        host_pages = {};
+        host_page_generation = generation;
+    }
+
+    inline Byte* GetHostPointer(Address address, bool is_write) {
+        Address page = address / Memory::PAGE_SIZE;
+        auto& entry = host_pages[page % HOST_PAGE_SLOTS];
+
+        if (entry.page != page || (entry.shared && (is_write || memory.GetHostPageGeneration() != entry.generation)))
+            LoadHostPage(entry, address, is_write);
+
+        if (!entry.host || (is_write && !entry.writable)) return nullptr;
+        return entry.host + (address % Memory::PAGE_SIZE);
+    }
+
+    // A fault on the routed path raises its trap and gives false, for
+    // Execute to return
+    bool RaiseAccessFault(Memory::AccessFault fault, bool is_write);
+
+    // Atomics go straight to Memory, so they're checked before it's asked
+    inline bool CheckAccess(Address address, Address bytes, bool is_write) {
+        auto fault = memory.Probe(address, bytes, is_write);
+        return fault == Memory::AccessFault::None || RaiseAccessFault(fault, is_write);
+    }
+
+    // Misaligned accesses within host memory are done like hardware would,
+    // in two parts when they cross into another page. Anything else traps
+    // for the guest to emulate, as does everything with trap_misaligned
+    bool trap_misaligned = false;
+    bool CopyMisaligned(Address virtual_address, Address address, Byte* bytes, Address size, bool is_write);
+
+    // The virtual address is only used to find the next page when a
+    // misaligned access crosses into it
+    template <typename T>
+    inline std::pair<T, bool> Load(Address virtual_address, Address address) {
+        if ((address & (sizeof(T) - 1)) == 0) [[likely]] {
+            if (auto host = GetHostPointer(address, false))
+                return {*reinterpret_cast<const T*>(host), true};
+        }
+
+        else {
+            T value;
+            if (!CopyMisaligned(virtual_address, address, reinterpret_cast<Byte*>(&value), sizeof(T), false)) return {0, false};
+
+            WatchAccess(address, sizeof(T), Memory::WatchKind::Read);
+            return {value, true};
+        }
+
+        std::pair<T, Memory::AccessFault> loaded;
+        if constexpr (sizeof(T) == sizeof(Byte)) loaded = memory.TryReadByte(address);
+        else if constexpr (sizeof(T) == sizeof(Half)) loaded = memory.TryReadHalf(address);
+        else if constexpr (sizeof(T) == sizeof(Word)) loaded = memory.TryReadWord(address);
+        else loaded = memory.TryReadLong(address);
+
+        if (loaded.second != Memory::AccessFault::None) [[unlikely]]
+            return {0, RaiseAccessFault(loaded.second, false)};
+
+        WatchAccess(address, sizeof(T), Memory::WatchKind::Read);
+        return {loaded.first, true};
+    }
+
+    template <typename T>
+    inline bool Store(Address virtual_address, Address address, T value) {
+        if ((address & (sizeof(T) - 1)) == 0) [[likely]] {
+            if (auto host = GetHostPointer(address, true)) {
+                memory.NotifyWrite(address);
+                *reinterpret_cast<T*>(host) = value;
+
+                auto& entry = host_pages[(address / Memory::PAGE_SIZE) % HOST_PAGE_SLOTS];
+                if (entry.dirty) DirtyPages::Mark(*entry.dirty, entry.dirty_bit);
+                return true;
             }
+        }
+
+        else {
+            if (!CopyMisaligned(virtual_address, address, reinterpret_cast<Byte*>(&value), sizeof(T), true)) return false;
 
-            return 0;
+            WatchAccess(address, sizeof(T), Memory::WatchKind::Write);
+            return true;
         }
 
-        void Lock() const override {}
-        void Unlock() const override {}
+        Memory::AccessFault fault;
+        if constexpr (sizeof(T) == sizeof(Byte)) fault = memory.TryWriteByte(address, value);
+        else if constexpr (sizeof(T) == sizeof(Half)) fault = memory.TryWriteHalf(address, value);
+        else if constexpr (sizeof(T) == sizeof(Word)) fault = memory.TryWriteWord(address, value);
+        else fault = memory.TryWriteLong(address, value);
+
+        if (fault != Memory::AccessFault::None) [[unlikely]]
+            return RaiseAccessFault(fault, true);
+
+        WatchAccess(address, sizeof(T), Memory::WatchKind::Write);
+        return true;
+    }
+
+    // Watched pages have no host pointer, so only accesses that already
+    // took the slow path get here
+    inline void WatchAccess(Address address, Address bytes, Memory::WatchKind access) {
+        if (!memory.IsWatching()) [[likely]] return;
+
+        if (auto hit = memory.FindWatchpoint(address, bytes, access))
+            watch_hit = hit;
+    }
+
+    // Cycles already reported to the CLINT, which counts them as time when
+    // its clock is instruction driven
+    std::shared_ptr<MemoryCLINT> clint;
+    Long retired_cycles = 0;
+
+    void UpdateTimer();
+    void FinishSteps();
+
+    // rdcycle, rdtime and rdinstret. They can't trap or change anything, so
+    // they skip the generic CSR dispatch and don't end basic blocks
+    static inline bool IsCounterRead(const RVInstruction& instr) {
+        return instr.type == RVInstruction::Type::CSRRS && instr.rs1 == REG_ZERO &&
+            (instr.immediate == CSR_CYCLE || instr.immediate == CSR_TIME || instr.immediate == CSR_INSTRET);
+    }
+
+    Long ReadCounter(Half csr);
+
+public:
+    // Everything the register, CSR and stack views show, as the hart last
+    // published it. CSRs hold what GetCSRSnapshot reports, zero for the
+    // unimplemented ones
+    struct HartState {
+        std::array<Reg, REGISTER_COUNT> regs;
+        std::array<Float, REGISTER_COUNT> fregs;
+        std::array<Long, CSR_COUNT> csrs;
+        Long pc;
+        Long cycles;
+        Byte privilege_level;
+        bool is_32_bit_mode;
     };
 
-    std::shared_ptr<CSRMappedMemory> csr_mapped_memory;
+private:
+    // Readers ask for a fresh state and the hart publishes one at its next
+    // step boundary, or while it sleeps, so harts nobody watches pay only
+    // a relaxed load per slice. Both sit on lines of their own, since
+    // readers write them from other threads
+    alignas(64) SeqLock<HartState> published_state;
+    alignas(64) mutable std::atomic<bool> state_requested = false;
+
+    void CollectCSRs(std::array<Long, CSR_COUNT>& values) const;
 
 public:
     VirtualMachine(Memory& memory, Long starting_pc, Hart hart_id);
@@ -509,21 +1079,65 @@ public:
     ~VirtualMachine();
     
     inline void Start() { running = true; }
-    inline void Restart(Long pc, Hart source_hart) {
-        this->pc = pc;
-
-        if (source_hart == csrs[CSR_MHARTID])
-            this->pc -= 4;
-
-        Setup();
-        paused = pause_on_restart;
+    // Safe from any thread. The hart resets and jumps to pc at its next
+    // block boundary, so a hart restarting itself from an ecall lands on
+    // pc and not after it
+    inline void RequestStart(Long pc) {
+        start_address.store(pc, std::memory_order_relaxed);
+        start_requested.store(true, std::memory_order_release);
+        Wake();
     }
     inline bool IsRunning() const { return running; }
-    inline void Stop() { running = false; }
+    inline void Stop() {
+        running = false;
+        Wake();
+    }
 
     inline void Pause() { paused = true; }
     inline bool IsPaused() const { return paused; }
-    inline void Unpause() { paused = false; }
+    inline bool IsParked() const { return parked.load(std::memory_order_acquire); }
+
+    // Keeps the hart off the host CPU like a pause, but leaves the paused
+    // state alone, so the host can work on memory. Done once IsParked
+    inline void Hold() {
+        held = true;
+        Wake();
+    }
+
+    inline void Release() {
+        held = false;
+        Wake();
+    }
+    inline void Unpause() {
+        paused = false;
+        Wake();
+    }
+
+    inline void Wake() {
+        {
+            std::lock_guard lock(idle_lock);
+            idle_signal.notify_all();
+        }
+
+        if (wake_handler) wake_handler();
+    }
+
+    // Set before the hart starts running
+    inline void SetWakeHandler(std::function<void()> handler) { wake_handler = std::move(handler); }
+
+    // Limits on what the hart runs from now on, 0 for none. Run and
+    // RunQuantum end each slice on a budget and charge it at the slice's
+    // end, so a hart runs out on the exact count at no cost per block.
+    // Cycles are what the slices count, time asleep in WFI isn't. A hart
+    // out of budget stops again on every start until it gets a new one
+    void SetInstructionBudget(Long instructions);
+    void SetCycleBudget(Long cycles);
+
+    inline std::optional<Long> GetInstructionsLeft() const { return instructions_left; }
+    inline std::optional<Long> GetCyclesLeft() const { return cycles_left; }
+
+    // Set before the hart starts running
+    inline void SetBudgetHandler(BudgetHandler handler) { budget_handler = std::move(handler); }
 
     inline void SetPauseOnBreak(bool pause_on_break) { this->pause_on_break = pause_on_break; }
     inline bool PauseOnBreak() const { return pause_on_break; }
@@ -531,17 +1145,103 @@ public:
     inline void SetPauseOnRestart(bool pause_on_restart) { this->pause_on_restart = pause_on_restart; }
     inline bool PauseOnRestart() const { return pause_on_restart; }
 
+    // Starts follow the RISC-V boot convention from then on, with the hart
+    // id in a0 and the device tree's address in a1
+    void SetDeviceTree(Address address);
+
+    // Back to how the hart came out of its constructor, at pc, keeping what
+    // was allocated for it. CSRs, counters, TLBs and decoded code all go,
+    // so it suits memory that was just rewound. The hart must not be running
+    void Reset(Address pc);
+
     bool Step(Long steps = 1000);
+    bool StepBlocks(Long steps = 1000);
     void Run();
 
+    // One turn of Run that never blocks, for schedulers that own the thread.
+    // Returns false without running anything when the hart isn't runnable.
+    // Without skip_idle a hart in WFI leaves counted time alone and waits
+    // for the other harts or the scheduler to move it
+    bool RunQuantum(Long steps, bool skip_idle = true);
+
+    // Running, not paused and not asleep in WFI. May advance the hart's
+    // timer, so only call it from the thread that would run the hart
+    bool IsRunnable(bool skip_idle = true);
+
+    // Architectural state for snapshots. Only call while the hart is stopped
+    // or paused. Restoring drops every cached translation and decoded block
+    void SaveState(SnapshotWriter& writer) const;
+    void RestoreState(SnapshotReader& reader);
+
+    // The same state taken from another hart, usually one running on the
+    // Memory this hart's Memory was cloned from
+    void CopyState(const VirtualMachine& vm);
+
+    inline void SetUseBasicBlocks(bool use_basic_blocks) { this->use_basic_blocks = use_basic_blocks; }
+    inline bool UsesBasicBlocks() const { return use_basic_blocks; }
+
+    inline void SetUseJIT(bool use_jit) { this->use_jit = use_jit && jit.IsAvailable(); }
+    inline bool UsesJIT() const { return use_jit; }
+
+    inline void SetTrapMisaligned(bool trap_misaligned) { this->trap_misaligned = trap_misaligned; }
+    inline bool TrapsMisaligned() const { return trap_misaligned; }
+
+    inline void SetPreciseFloatFlags(bool precise_float_flags) { this->precise_float_flags = precise_float_flags; }
+    inline bool UsesPreciseFloatFlags() const { return precise_float_flags; }
+
+    inline double GetJITCoverage() const {
+        if (block_instructions == 0) return 0.0;
+        return static_cast<double>(jit_instructions) / block_instructions;
+    }
+
+    inline double GetIndirectHitRate() const {
+        if (indirect_jumps == 0) return 0.0;
+        return static_cast<double>(indirect_hits) / indirect_jumps;
+    }
+
+    inline void SetProfiling(bool profiling) { this->profiling = profiling; }
+    inline bool IsProfiling() const { return profiling; }
+
+    inline Profiler::Profile GetProfile() const { return profiler.GetProfile(); }
+    inline void ResetProfile() { profiler.Reset(); }
+    inline void WriteProfile(const std::string& path, const SymbolTable* symbols = nullptr) const { profiler.WriteToFile(path, symbols); }
+
+    inline void SetTracing(bool tracing) { this->tracing = tracing; }
+    inline bool IsTracing() const { return tracing; }
+
+    inline const Tracer& GetTracer() const { return tracer; }
+    inline void ResetTrace() { tracer.Reset(); }
+
+    // Open and close while the hart is paused or stopped. Closing waits for
+    // the writer to drain
+    inline void StartInstructionTrace(const std::string& path) { instruction_trace = std::make_unique<InstructionTraceWriter>(path); }
+    inline void StopInstructionTrace() { instruction_trace.reset(); }
+    inline bool IsTracingInstructions() const { return instruction_trace != nullptr; }
+
     inline void SetPC(Long pc) { this->pc = pc; }
 
     void GetSnapshot(std::array<Reg, REGISTER_COUNT>& registers, std::array<Float, REGISTER_COUNT>& fregisters, Long& pc);
     void GetCSRSnapshot(std::unordered_map<Long, Long>& csrs) const;
 
+    // Copies the current state for readers. Only the thread stepping the
+    // hart may call it
+    void PublishState();
+
+    // The state PublishState would publish, taken directly. Only call while
+    // the hart isn't running on another thread
+    void CaptureState(HartState& state) const;
+
+    // The last published state, from any thread and without stopping the
+    // hart. Also asks for a newer one, so a reader polling every frame sees
+    // state at most one slice old. False until the hart first publishes
+    bool ReadState(HartState& state) const;
+
+    // Changes every time a state is published
+    inline Long GetStateVersion() const { return published_state.GetVersion(); }
+
     inline Expected<Reg&, std::range_error> GetRegister(size_t reg) {
         if (reg >= REGISTER_COUNT) {
-            return Unexpected<std::range_error>(std::range_error(std::format("Could not get register {}. Max is {}", reg, REGISTER_COUNT)));
+            return RegisterRangeError("register", reg);
         }
 
         return regs[reg];
@@ -549,7 +1249,7 @@ public:
 
     inline Expected<Float&, std::range_error> GetFloatRegister(size_t reg) {
         if (reg >= REGISTER_COUNT) {
-            return Unexpected<std::range_error>(std::range_error(std::format("Could not get float register {}. Max is {}", reg, REGISTER_COUNT)));
+            return RegisterRangeError("float register", reg);
         }
 
         return fregs[reg];
@@ -563,31 +1263,71 @@ public:
         return regs[REG_SP].u64;
     }
 
+    inline Hart GetHartID() const {
+        return csrs[CSR_MHARTID];
+    }
+
+    inline Long GetCycles() const {
+        return cycles;
+    }
+
     size_t GetInstructionsPerSecond();
 
     inline void SetBreakPoint(Address addr) {
-        break_points.insert(addr);
+        instruction_cache.SetBreakPoint(addr);
+        basic_blocks_dirty = true;
     }
 
     inline void ClearBreakPoint(Address addr) {
-        if (break_points.contains(addr))
-            break_points.erase(addr);
+        instruction_cache.ClearBreakPoint(addr);
+        basic_blocks_dirty = true;
     }
 
     bool IsBreakPoint(Address addr);
 
-    void UpdateTime(double delta_time);
+    // The watchpoint that stopped the last Step, cleared by taking it
+    inline std::optional<Memory::Watchpoint> TakeWatchHit() {
+        return std::exchange(watch_hit, std::nullopt);
+    }
+
+    void UpdateHistory(double delta_time);
 
     using ECallHandler = std::function<void(Hart, bool, Memory& memory, std::array<Reg, REGISTER_COUNT>& regs, std::array<Float, REGISTER_COUNT>& fregs)>;
 
 private:
+    ECallHandler ecall_handler;
+
     static void EmptyECallHandler(Hart hart, bool is_32_bit_mode, Memory& memory, std::array<Reg, REGISTER_COUNT>& regs, std::array<Float, REGISTER_COUNT>&);
 
+    // Built out of line, so GetRegister stays small enough to inline
+    static Unexpected<std::range_error> RegisterRangeError(const char* kind, size_t reg);
+
+    // Calls numbered from ECALL_TABLE_FIRST on are looked up by index, which
+    // covers the ones the BIOS makes. Any others are hashed
+    static constexpr SLong ECALL_TABLE_FIRST = -16;
+    static constexpr size_t ECALL_TABLE_SIZE = 32;
+
+    static std::array<ECallHandler, ECALL_TABLE_SIZE> ecall_table;
     static std::unordered_map<Long, ECallHandler> ecall_handlers;
 
+    inline static const ECallHandler* FindECall(Long handler_index) {
+        Long slot = handler_index - static_cast<Long>(ECALL_TABLE_FIRST);
+        if (slot < ECALL_TABLE_SIZE)
+            return ecall_table[slot] ? &ecall_table[slot] : nullptr;
+
+        auto found = ecall_handlers.find(handler_index);
+        return found != ecall_handlers.end() ? &found->second : nullptr;
+    }
+
 public:
+    // Takes every machine mode ecall on this hart instead of the handlers
+    // registered for all harts, for embedders that keep no global state
+    inline void SetECallHandler(ECallHandler handler) { ecall_handler = std::move(handler); }
+
     inline static void RegisterECall(Long handler_index, ECallHandler handler) {
-        ecall_handlers[handler_index] = handler;
+        Long slot = handler_index - static_cast<Long>(ECALL_TABLE_FIRST);
+        if (slot < ECALL_TABLE_SIZE) ecall_table[slot] = std::move(handler);
+        else ecall_handlers[handler_index] = std::move(handler);
     }
 };
 
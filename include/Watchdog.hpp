@@ -0,0 +1,50 @@
+#ifndef WATCHDOG_HPP
+#define WATCHDOG_HPP
+
+#include "VirtualMachine.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Stops a job's harts once a host wall clock deadline passes. It waits on a
+// thread of its own, so it also catches harts asleep, paused or parked by a
+// scheduler. Harts stop the way Stop always stops them, at their next block
+// boundary, and Run returns
+class Watchdog {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Called on the watchdog's thread once the harts were told to stop
+    using Handler = std::function<void()>;
+
+private:
+    const std::vector<VirtualMachine*> harts;
+    const Handler handler;
+
+    Clock::time_point deadline;
+    std::atomic<bool> fired = false;
+
+    std::mutex lock;
+    std::condition_variable_any signal;
+
+    std::jthread thread;
+
+    void Watch(std::stop_token stop);
+
+public:
+    Watchdog(std::vector<VirtualMachine*> harts, Clock::duration timeout, Handler handler = nullptr);
+    Watchdog(const Watchdog&) = delete;
+
+    // Gives the job timeout from now, for jobs that show they're making
+    // progress. Does nothing once the watchdog fired
+    void Kick(Clock::duration timeout);
+
+    inline bool HasFired() const { return fired.load(std::memory_order_acquire); }
+};
+
+#endif
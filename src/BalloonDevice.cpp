@@ -0,0 +1,78 @@
+#include "BalloonDevice.hpp"
+
+#include "PLIC.hpp"
+
+#include <algorithm>
+
+MemoryBalloon::MemoryBalloon(Address base) : MemoryRegion(TYPE_BALLOON, 0, base, SIZE, true, true) {}
+
+Long MemoryBalloon::ReadLong(Address offset) const {
+    switch (offset) {
+        case TARGET_OFFSET:
+            return target.load();
+
+        case RELEASED_OFFSET:
+            return released.load();
+
+        case ADDRESS_OFFSET:
+            return address.load();
+
+        default:
+            return 0;
+    }
+}
+
+Word MemoryBalloon::ReadWord(Address offset) const {
+    return static_cast<Word>(ReadLong(offset & ~7) >> ((offset & 4) * 8));
+}
+
+void MemoryBalloon::WriteLong(Address offset, Long vlong) {
+    switch (offset) {
+        case ADDRESS_OFFSET:
+            address = vlong;
+            break;
+
+        case INFLATE_OFFSET: {
+            std::lock_guard guard(inflate_lock);
+
+            if (memory)
+                freed += memory->ReleasePages(address, vlong);
+
+            released += vlong;
+            UpdateInterrupt();
+            break;
+        }
+
+        case DEFLATE_OFFSET: {
+            // Taking back more than was given only empties the balloon
+            auto current = released.load();
+            while (!released.compare_exchange_weak(current, current - std::min(current, vlong))) {}
+
+            UpdateInterrupt();
+            break;
+        }
+    }
+}
+
+// Words on the low halves let a 32 bit guest drive the device
+void MemoryBalloon::WriteWord(Address offset, Word word) {
+    if (offset & 4) return;
+
+    WriteLong(offset, word);
+}
+
+void MemoryBalloon::SetTarget(Long bytes) {
+    target = bytes;
+    UpdateInterrupt();
+}
+
+void MemoryBalloon::UpdateInterrupt() {
+    if (!memory) return;
+
+    if (auto plic = memory->FindMemoryRegionOfType<MemoryPLIC>(TYPE_PLIC))
+        plic->SetLevel(MemoryPLIC::SOURCE_BALLOON, released.load() != target.load());
+}
+
+std::shared_ptr<MemoryBalloon> MemoryBalloon::Create(Address base) {
+    return std::shared_ptr<MemoryBalloon>(new MemoryBalloon(base));
+}
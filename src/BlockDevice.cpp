@@ -0,0 +1,407 @@
+#include "BlockDevice.hpp"
+
+#include "CLINT.hpp"
+#include "PLIC.hpp"
+#include "VirtualMachine.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+namespace {
+    // Pieces of a request that sit in one guest page each. Pages that
+    // aren't plain host memory go through a bounce buffer
+    struct Span {
+        Address address;
+        Byte* host;
+        Address count;
+        std::unique_ptr<Byte[]> bounce;
+    };
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    // Runs preadv or pwritev over every span, picking up after short
+    // transfers, so a contiguous request is one call per IOV_MAX pages
+    template <typename Call>
+    bool Vectored(std::vector<Span>& spans, Long offset, Call call) {
+        std::vector<iovec> vectors;
+        for (auto& span : spans)
+            vectors.push_back({span.host, span.count});
+
+        for (size_t first = 0; first < vectors.size();) {
+            auto count = std::min<size_t>(vectors.size() - first, IOV_MAX);
+
+            auto moved = call(vectors.data() + first, count, offset);
+            if (moved <= 0) return false;
+
+            offset += moved;
+
+            while (first < vectors.size() && static_cast<size_t>(moved) >= vectors[first].iov_len) {
+                moved -= vectors[first].iov_len;
+                first++;
+            }
+
+            if (moved > 0) {
+                vectors[first].iov_base = static_cast<Byte*>(vectors[first].iov_base) + moved;
+                vectors[first].iov_len -= moved;
+            }
+        }
+
+        return true;
+    }
+#endif
+}
+
+MemoryBlockDevice::MemoryBlockDevice(Address base, const std::string& path, bool read_only, size_t threads) : MemoryRegion(TYPE_BLOCK, 0, base, SIZE, true, true), read_only{read_only}, capacity{[&]() -> Long {
+#if defined(_WIN32) || defined(_WIN64)
+    file = CreateFileA(path.c_str(), GENERIC_READ | (read_only ? 0 : GENERIC_WRITE), FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error(std::format("Could not open disk {}", path));
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error(std::format("Could not size disk {}", path));
+    }
+
+    return size.QuadPart / SECTOR_SIZE;
+#else
+    file = open(path.c_str(), read_only ? O_RDONLY : O_RDWR);
+    if (file < 0)
+        throw std::runtime_error(std::format("Could not open disk {}", path));
+
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        close(file);
+        throw std::runtime_error(std::format("Could not size disk {}", path));
+    }
+
+    return info.st_size / SECTOR_SIZE;
+#endif
+}()} {
+    Register(CAPACITY_OFFSET) = capacity;
+
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); i++)
+        this->threads.emplace_back([this]() { Work(); });
+}
+
+MemoryBlockDevice::~MemoryBlockDevice() {
+    {
+        std::unique_lock guard(queue_lock);
+        queue_signal.wait(guard, [&]() { return queue.empty() && in_flight == 0; });
+        stopping = true;
+    }
+
+    queue_signal.notify_all();
+
+    for (auto& thread : threads)
+        thread.join();
+
+#if defined(_WIN32) || defined(_WIN64)
+    CloseHandle(file);
+#else
+    close(file);
+#endif
+}
+
+Long MemoryBlockDevice::ReadLong(Address address) const {
+    auto index = address / sizeof(Long);
+    if (index >= REGISTER_COUNT) return 0;
+
+    return registers[index].load();
+}
+
+Word MemoryBlockDevice::ReadWord(Address address) const {
+    return static_cast<Word>(ReadLong(address & ~7) >> ((address & 4) * 8));
+}
+
+void MemoryBlockDevice::WriteLong(Address address, Long vlong) {
+    switch (address) {
+        case RING_ADDRESS_OFFSET:
+        case RING_SIZE_OFFSET:
+        case INTERRUPT_HART_OFFSET:
+            Register(address) = vlong;
+            break;
+
+        case SUBMIT_OFFSET:
+            Register(address) = vlong;
+            Submit(vlong);
+            break;
+
+        case INTERRUPT_OFFSET:
+            SetInterrupt(false);
+            break;
+    }
+}
+
+// Halves merge into the whole register, so a 32 bit guest ringing SUBMIT
+// with its low word still submits
+void MemoryBlockDevice::WriteWord(Address address, Word word) {
+    Address offset = address & ~7;
+
+    auto shift = (address & 4) * 8;
+    auto vlong = ReadLong(offset);
+    vlong &= ~(0xffffffffULL << shift);
+    vlong |= static_cast<Long>(word) << shift;
+
+    WriteLong(offset, vlong);
+}
+
+void MemoryBlockDevice::Submit(Long count) {
+    if (!memory) return;
+
+    std::lock_guard submit_guard(submit_lock);
+
+    Address ring = Register(RING_ADDRESS_OFFSET);
+    Long ring_size = Register(RING_SIZE_OFFSET);
+    if (ring_size == 0) return;
+
+    // Descriptors past a full ring would be ones the guest hasn't filled in
+    if (count - consumed > ring_size)
+        consumed = count - ring_size;
+
+    std::vector<Request> batch;
+    for (; consumed < count; consumed++) {
+        Address descriptor = ring + (consumed % ring_size) * DESCRIPTOR_SIZE;
+
+        batch.push_back({
+            descriptor,
+            memory->ReadWord(descriptor + DESCRIPTOR_OP),
+            memory->ReadLong(descriptor + DESCRIPTOR_SECTOR),
+            memory->ReadLong(descriptor + DESCRIPTOR_BUFFER),
+            memory->ReadWord(descriptor + DESCRIPTOR_LENGTH)
+        });
+    }
+
+    if (batch.empty()) return;
+
+    {
+        std::lock_guard guard(queue_lock);
+        queue.insert(queue.end(), batch.begin(), batch.end());
+        in_flight += batch.size();
+    }
+
+    queue_signal.notify_all();
+}
+
+void MemoryBlockDevice::Work() {
+    while (true) {
+        Request request;
+
+        {
+            std::unique_lock guard(queue_lock);
+            queue_signal.wait(guard, [&]() { return stopping || !queue.empty(); });
+
+            if (queue.empty()) return;
+
+            request = queue.front();
+            queue.pop_front();
+        }
+
+        // Buffers or descriptors that aren't mapped only fail their request
+        bool ok = false;
+        try {
+            ok = Execute(request);
+        }
+        catch (const std::runtime_error&) {}
+
+        try {
+            memory->WriteWord(request.descriptor + DESCRIPTOR_STATUS, ok ? STATUS_OK : STATUS_ERROR);
+        }
+        catch (const std::runtime_error&) {}
+
+        Register(COMPLETED_OFFSET).fetch_add(1);
+
+        bool drained;
+        {
+            std::lock_guard guard(queue_lock);
+            drained = --in_flight == 0 && queue.empty();
+        }
+
+        if (drained) {
+            SetInterrupt(true);
+            queue_signal.notify_all();
+        }
+    }
+}
+
+bool MemoryBlockDevice::Execute(const Request& request) {
+    if (request.op == OP_FLUSH)
+        return Flush();
+
+    if (request.op != OP_READ && request.op != OP_WRITE)
+        return false;
+
+    bool is_read = request.op == OP_READ;
+    if (!is_read && read_only)
+        return false;
+
+    Long offset = request.sector * SECTOR_SIZE;
+    if (request.sector >= static_cast<Long>(capacity) || request.length > (capacity - request.sector) * SECTOR_SIZE)
+        return false;
+
+    std::vector<Span> spans;
+    for (Address done = 0; done < request.length;) {
+        Address address = request.buffer + done;
+        Address count = std::min<Address>(request.length - done, Memory::PAGE_SIZE - address % Memory::PAGE_SIZE);
+
+        Byte* host = nullptr;
+        if (is_read) {
+            auto [page, writable] = memory->GetHostPage(address);
+            if (page && writable) host = page;
+        }
+        else {
+            // Pages still shared with a clone are written out without copying them
+            auto page = const_cast<Byte*>(memory->GetSharedHostPage(address));
+            host = page ? page : memory->GetHostPage(address).first;
+        }
+
+        Span span{address, host ? host + address % Memory::PAGE_SIZE : nullptr, count, nullptr};
+
+        if (!host) {
+            span.bounce = std::make_unique<Byte[]>(count);
+            span.host = span.bounce.get();
+
+            if (!is_read) {
+                for (Address i = 0; i < count; i++)
+                    span.host[i] = memory->ReadByte(address + i);
+            }
+        }
+
+        spans.push_back(std::move(span));
+        done += count;
+    }
+
+    if (!is_read) {
+#if defined(_WIN32) || defined(_WIN64)
+        for (auto& span : spans) {
+            if (!WriteAt(span.host, span.count, offset)) return false;
+            offset += span.count;
+        }
+
+        return true;
+#else
+        return Vectored(spans, offset, [&](const iovec* vectors, int count, Long at) { return pwritev(file, vectors, count, at); });
+#endif
+    }
+
+    memory->NotifyWrite(request.buffer, request.length);
+
+#if defined(_WIN32) || defined(_WIN64)
+    for (auto& span : spans) {
+        if (!ReadAt(span.host, span.count, offset)) return false;
+        offset += span.count;
+    }
+#else
+    if (!Vectored(spans, offset, [&](const iovec* vectors, int count, Long at) { return preadv(file, vectors, count, at); }))
+        return false;
+#endif
+
+    for (auto& span : spans) {
+        if (span.bounce) {
+            for (Address i = 0; i < span.count; i++)
+                memory->WriteByte(span.address + i, span.host[i]);
+        }
+        else
+            memory->MarkDirty(span.address);
+    }
+
+    return true;
+}
+
+bool MemoryBlockDevice::ReadAt(Byte* bytes, Address count, Long offset) {
+#if defined(_WIN32) || defined(_WIN64)
+    while (count > 0) {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD moved = 0;
+        if (!ReadFile(file, bytes, static_cast<DWORD>(std::min<Address>(count, 0x40000000)), &moved, &overlapped) || moved == 0)
+            return false;
+
+        bytes += moved;
+        count -= moved;
+        offset += moved;
+    }
+#else
+    while (count > 0) {
+        auto moved = pread(file, bytes, count, offset);
+        if (moved <= 0) return false;
+
+        bytes += moved;
+        count -= moved;
+        offset += moved;
+    }
+#endif
+
+    return true;
+}
+
+bool MemoryBlockDevice::WriteAt(const Byte* bytes, Address count, Long offset) {
+#if defined(_WIN32) || defined(_WIN64)
+    while (count > 0) {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD moved = 0;
+        if (!WriteFile(file, bytes, static_cast<DWORD>(std::min<Address>(count, 0x40000000)), &moved, &overlapped) || moved == 0)
+            return false;
+
+        bytes += moved;
+        count -= moved;
+        offset += moved;
+    }
+#else
+    while (count > 0) {
+        auto moved = pwrite(file, bytes, count, offset);
+        if (moved <= 0) return false;
+
+        bytes += moved;
+        count -= moved;
+        offset += moved;
+    }
+#endif
+
+    return true;
+}
+
+bool MemoryBlockDevice::Flush() {
+    if (read_only) return true;
+
+#if defined(_WIN32) || defined(_WIN64)
+    return FlushFileBuffers(file);
+#else
+    return fsync(file) == 0;
+#endif
+}
+
+void MemoryBlockDevice::SetInterrupt(bool pending) {
+    Register(INTERRUPT_OFFSET) = pending;
+
+    if (!memory) return;
+
+    // Routed by the PLIC when there is one
+    if (auto plic = memory->FindMemoryRegionOfType<MemoryPLIC>(TYPE_PLIC)) {
+        plic->SetLevel(MemoryPLIC::SOURCE_BLOCK, pending);
+        return;
+    }
+
+    auto clint = memory->FindMemoryRegionOfType<MemoryCLINT>(TYPE_CLINT);
+    if (clint) clint->SetInterruptPending(Register(INTERRUPT_HART_OFFSET), VirtualMachine::INTERRUPT_MACHINE_EXTERNAL, pending);
+}
+
+std::shared_ptr<MemoryBlockDevice> MemoryBlockDevice::Create(const std::string& path, bool read_only, Address base, size_t threads) {
+    return std::shared_ptr<MemoryBlockDevice>(new MemoryBlockDevice(base, path, read_only, threads));
+}
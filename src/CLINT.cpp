@@ -0,0 +1,232 @@
+#include "CLINT.hpp"
+
+#include "VirtualMachine.hpp"
+
+#include <format>
+#include <stdexcept>
+
+MemoryCLINT::MemoryCLINT(Address base) : MemoryRegion(TYPE_CLINT, 0, base, SIZE, true, true), harts{new HartSlot[MAX_HARTS]}, epoch{std::chrono::steady_clock::now()} {}
+
+Long MemoryCLINT::GetClockTime() const {
+    if (clock_source == ClockSource::Instructions)
+        return instructions.load(std::memory_order_relaxed) / INSTRUCTIONS_PER_TICK;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch);
+    return elapsed.count() / NANOSECONDS_PER_TICK;
+}
+
+void MemoryCLINT::UpdateHart(Hart hart) const {
+    auto vm = harts[hart].vm.load();
+    if (!vm) return;
+
+    vm->SetInterruptPending(VirtualMachine::INTERRUPT_MACHINE_SOFTWARE, IsSoftwarePending(hart));
+    vm->SetInterruptPending(VirtualMachine::INTERRUPT_MACHINE_TIMER, IsTimerPending(hart));
+}
+
+Long MemoryCLINT::ReadLong(Address address) const {
+    if (address < MTIMECMP_OFFSET) {
+        Hart hart = (address - MSIP_OFFSET) / 4;
+        if (hart >= MAX_HARTS) return 0;
+
+        Long msip = harts[hart].msip;
+        if (hart + 1 < MAX_HARTS) msip |= static_cast<Long>(harts[hart + 1].msip) << 32;
+
+        return msip;
+    }
+
+    if (address == MTIME_OFFSET)
+        return GetTime();
+
+    // The start mailbox is write only
+    if (address >= START_OFFSET) return 0;
+
+    Hart hart = (address - MTIMECMP_OFFSET) / 8;
+    if (hart >= MAX_HARTS) return 0;
+
+    return GetTimeCmp(hart);
+}
+
+Word MemoryCLINT::ReadWord(Address address) const {
+    if (address < MTIMECMP_OFFSET) {
+        Hart hart = (address - MSIP_OFFSET) / 4;
+        if (hart >= MAX_HARTS) return 0;
+
+        return harts[hart].msip;
+    }
+
+    return static_cast<Word>(ReadLong(address & ~7) >> ((address & 4) * 8));
+}
+
+void MemoryCLINT::WriteLong(Address address, Long vlong) {
+    if (address < MTIMECMP_OFFSET) {
+        WriteWord(address, static_cast<Word>(vlong));
+        WriteWord(address + 4, static_cast<Word>(vlong >> 32));
+        return;
+    }
+
+    if (address == MTIME_OFFSET) {
+        SetTime(vlong);
+        return;
+    }
+
+    if (address >= START_OFFSET) {
+        StartHart((address - START_OFFSET) / 8, vlong);
+        return;
+    }
+
+    Hart hart = (address - MTIMECMP_OFFSET) / 8;
+    if (hart >= MAX_HARTS) return;
+
+    SetTimeCmp(hart, vlong);
+}
+
+void MemoryCLINT::WriteWord(Address address, Word word) {
+    if (address < MTIMECMP_OFFSET) {
+        Hart hart = (address - MSIP_OFFSET) / 4;
+        if (hart >= MAX_HARTS) return;
+
+        harts[hart].msip = word & 1;
+        UpdateHart(hart);
+        return;
+    }
+
+    // A 32 bit guest only has the low word, and the high one of a 64 bit
+    // address alone would start the hart somewhere it never meant to go
+    if (address >= START_OFFSET) {
+        if ((address & 4) == 0) StartHart((address - START_OFFSET) / 8, word);
+        return;
+    }
+
+    auto vlong = ReadLong(address & ~7);
+    auto shift = (address & 4) * 8;
+    vlong &= ~(0xffffffffULL << shift);
+    vlong |= static_cast<Long>(word) << shift;
+
+    WriteLong(address & ~7, vlong);
+}
+
+void MemoryCLINT::StartHart(Hart hart, Address address) const {
+    if (hart >= MAX_START_HARTS) return;
+
+    auto vm = harts[hart].vm.load();
+    if (vm) vm->RequestStart(address);
+}
+
+void MemoryCLINT::SetClockSource(ClockSource clock_source) {
+    auto time = GetTime();
+    this->clock_source = clock_source;
+    SetTime(time);
+}
+
+void MemoryCLINT::SetDeferRetire(bool defer_retire) {
+    this->defer_retire = defer_retire;
+    if (!defer_retire) PublishRetired();
+}
+
+void MemoryCLINT::PublishRetired() {
+    instructions.fetch_add(deferred_instructions.exchange(0), std::memory_order_relaxed);
+
+    for (Hart hart = 0; hart < MAX_HARTS; hart++)
+        UpdateHart(hart);
+}
+
+void MemoryCLINT::SetTime(Long time) {
+    time_offset = time - GetClockTime();
+
+    for (Hart hart = 0; hart < MAX_HARTS; hart++)
+        UpdateHart(hart);
+}
+
+void MemoryCLINT::SetTimeCmp(Hart hart, Long time_cmp) {
+    harts[hart].mtimecmp = time_cmp;
+    UpdateHart(hart);
+}
+
+Long MemoryCLINT::InstructionsUntilDeadline(Hart hart) const {
+    if (clock_source != ClockSource::Instructions) return NO_DEADLINE;
+
+    auto time_cmp = GetTimeCmp(hart);
+    auto time = GetTime();
+
+    if (time_cmp == NO_DEADLINE || time >= time_cmp) return NO_DEADLINE;
+
+    auto ticks = time_cmp - time;
+    if (ticks >= NO_DEADLINE / INSTRUCTIONS_PER_TICK) return NO_DEADLINE;
+
+    return ticks * INSTRUCTIONS_PER_TICK - instructions.load(std::memory_order_relaxed) % INSTRUCTIONS_PER_TICK;
+}
+
+std::chrono::steady_clock::duration MemoryCLINT::TimeUntilDeadline(Hart hart) const {
+    auto time_cmp = GetTimeCmp(hart);
+    auto time = GetTime();
+
+    if (clock_source != ClockSource::WallClock || time_cmp == NO_DEADLINE)
+        return std::chrono::steady_clock::duration::max();
+
+    if (time >= time_cmp)
+        return std::chrono::steady_clock::duration::zero();
+
+    auto ticks = time_cmp - time;
+    if (ticks >= static_cast<Long>(INT64_MAX) / NANOSECONDS_PER_TICK)
+        return std::chrono::steady_clock::duration::max();
+
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ticks * NANOSECONDS_PER_TICK));
+}
+
+void MemoryCLINT::SkipToDeadline(Hart hart) {
+    if (clock_source != ClockSource::Instructions) return;
+
+    auto time_cmp = GetTimeCmp(hart);
+    auto time = GetTime();
+
+    if (time_cmp == NO_DEADLINE || time >= time_cmp) return;
+
+    time_offset.fetch_add(time_cmp - time);
+    UpdateHart(hart);
+}
+
+std::shared_ptr<MemoryRegion> MemoryCLINT::Clone() {
+    auto clone = Create(base);
+
+    for (Hart hart = 0; hart < MAX_HARTS; hart++) {
+        clone->harts[hart].msip = harts[hart].msip.load();
+        clone->harts[hart].mtimecmp = harts[hart].mtimecmp.load();
+    }
+
+    clone->SetClockSource(clock_source);
+    clone->SetTime(GetTime());
+
+    return clone;
+}
+
+void MemoryCLINT::SetInterruptPending(Hart hart, Long cause, bool pending) const {
+    if (hart >= MAX_HARTS) return;
+
+    auto vm = harts[hart].vm.load();
+    if (vm) vm->SetInterruptPending(cause, pending);
+}
+
+void MemoryCLINT::AttachHart(Hart hart, VirtualMachine* vm) {
+    if (hart >= MAX_HARTS)
+        throw std::runtime_error(std::format("Hart {} is past the {} harts a CLINT supports", hart, MAX_HARTS));
+
+    harts[hart].vm = vm;
+}
+
+void MemoryCLINT::DetachHart(Hart hart, VirtualMachine* vm) {
+    if (hart >= MAX_HARTS) return;
+
+    harts[hart].vm.compare_exchange_strong(vm, nullptr);
+}
+
+Hart MemoryCLINT::GetHartCount() const {
+    for (Hart count = MAX_HARTS; count > 0; count--) {
+        if (harts[count - 1].vm.load()) return count;
+    }
+
+    return 0;
+}
+
+std::shared_ptr<MemoryCLINT> MemoryCLINT::Create(Address base) {
+    return std::shared_ptr<MemoryCLINT>(new MemoryCLINT(base));
+}
@@ -0,0 +1,231 @@
+#include "CoSimulator.hpp"
+
+#include "CLINT.hpp"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    // time is read from the CLINT, whose counted time moves when an engine
+    // publishes what it retired. The block engine publishes per block and
+    // the interpreter per slice, so the two can be a tick apart with the
+    // same architectural state
+    bool IsCompared(size_t csr) {
+        return csr != VirtualMachine::CSR_TIME && csr != VirtualMachine::CSR_TIMEH;
+    }
+
+    // Only RAM is compared, device registers can't be read without side
+    // effects
+    std::vector<DirtyPages::Range> TakeWrittenRAM(Memory& memory) {
+        std::vector<DirtyPages::Range> ranges;
+
+        for (auto& region : memory.GetMemoryRegions()) {
+            if (region->type != MemoryRegion::TYPE_GENERAL_RAM) continue;
+
+            auto taken = memory.TakeDirtyRanges(region->base, region->size);
+            ranges.insert(ranges.end(), taken.begin(), taken.end());
+        }
+
+        return ranges;
+    }
+}
+
+CoSimulator::CoSimulator(VirtualMachine& fast, Memory& memory, const Options& options) : fast{fast}, memory{memory}, options{options}, start_cycles{fast.GetCycles()}, fast_state{std::make_unique<VirtualMachine::HartState>()}, reference_state{std::make_unique<VirtualMachine::HartState>()} {
+    auto clint = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+    if (!clint)
+        throw std::runtime_error("Co-simulation needs a CLINT to count time");
+
+    if (options.interval == 0)
+        throw std::runtime_error("Co-simulation interval must be at least one instruction");
+
+    // Clones take the clock along
+    clint->SetClockSource(MemoryCLINT::ClockSource::Instructions);
+
+    reference_memory = memory.Clone();
+    reference = CreateCopy(*reference_memory, fast, false);
+
+    checkpoint_memory = memory.Clone();
+    checkpoint = CreateCopy(*checkpoint_memory, fast, false);
+
+    // Pages written before the start match everywhere
+    TakeWrittenRAM(*reference_memory);
+    TakeWrittenRAM(*checkpoint_memory);
+}
+
+std::unique_ptr<VirtualMachine> CoSimulator::CreateCopy(Memory& copy_memory, const VirtualMachine& from, bool fast_engine) const {
+    auto copy = std::make_unique<VirtualMachine>(copy_memory, from.GetPC(), from.GetHartID());
+    copy->CopyState(from);
+
+    copy->SetUseBasicBlocks(fast_engine && fast.UsesBasicBlocks());
+    copy->SetUseJIT(fast_engine && fast.UsesJIT());
+    copy->SetTrapMisaligned(fast.TrapsMisaligned());
+    copy->SetPreciseFloatFlags(fast.UsesPreciseFloatFlags());
+
+    return copy;
+}
+
+// Counted time keeps cycles moving in WFI while there's a deadline, so only
+// a hart that's stopped, paused or asleep for good falls short
+void CoSimulator::RunTo(VirtualMachine& vm, Long cycles) {
+    while (vm.IsRunning() && vm.GetCycles() < cycles) {
+        auto before = vm.GetCycles();
+
+        vm.RunQuantum(cycles - before);
+        if (vm.GetCycles() == before) break;
+    }
+}
+
+// FNV-1a a register at a time
+Long CoSimulator::HashState(const VirtualMachine::HartState& state) {
+    Long hash = 0xcbf29ce484222325ULL;
+    auto Mix = [&hash](Long value) { hash = (hash ^ value) * 0x100000001b3ULL; };
+
+    Mix(state.pc);
+    Mix(state.privilege_level);
+
+    for (auto& reg : state.regs)
+        Mix(reg.u64);
+
+    for (auto& freg : state.fregs)
+        Mix(freg.u64);
+
+    for (size_t csr = 0; csr < state.csrs.size(); csr++) {
+        if (IsCompared(csr)) Mix(state.csrs[csr]);
+    }
+
+    return hash;
+}
+
+std::string CoSimulator::Describe(const VirtualMachine::HartState& fast, const VirtualMachine::HartState& reference) {
+    if (fast.pc != reference.pc)
+        return std::format("pc {:#x} against {:#x}", fast.pc, reference.pc);
+
+    if (fast.privilege_level != reference.privilege_level)
+        return std::format("privilege {} against {}", fast.privilege_level, reference.privilege_level);
+
+    for (size_t i = 0; i < VirtualMachine::REGISTER_COUNT; i++) {
+        if (fast.regs[i].u64 != reference.regs[i].u64)
+            return std::format("x{} {:#x} against {:#x}", i, fast.regs[i].u64, reference.regs[i].u64);
+    }
+
+    for (size_t i = 0; i < VirtualMachine::REGISTER_COUNT; i++) {
+        if (fast.fregs[i].u64 != reference.fregs[i].u64)
+            return std::format("f{} {:#x} against {:#x}", i, fast.fregs[i].u64, reference.fregs[i].u64);
+    }
+
+    for (size_t csr = 0; csr < fast.csrs.size(); csr++) {
+        if (IsCompared(csr) && fast.csrs[csr] != reference.csrs[csr])
+            return std::format("csr {:#x} {:#x} against {:#x}", csr, fast.csrs[csr], reference.csrs[csr]);
+    }
+
+    return {};
+}
+
+std::optional<Address> CoSimulator::FindDifferentPage(Memory& memory, Memory& other) {
+    std::array<Byte, Memory::PAGE_SIZE> ours;
+    std::array<Byte, Memory::PAGE_SIZE> theirs;
+
+    for (auto [start, end] : TakeWrittenRAM(other)) {
+        for (Address page = start; page < end; page += Memory::PAGE_SIZE) {
+            memory.ReadBytes(page, ours);
+            other.ReadBytes(page, theirs);
+
+            if (ours != theirs) return page;
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::string CoSimulator::Compare(VirtualMachine& fast_copy, Memory& fast_memory, VirtualMachine& reference_copy, Memory& reference_copy_memory, bool fast_stores) {
+    if (fast_copy.IsRunning() != reference_copy.IsRunning())
+        return std::format("the hart {} on the fast engine only", fast_copy.IsRunning() ? "kept running" : "stopped");
+
+    fast_copy.CaptureState(*fast_state);
+    reference_copy.CaptureState(*reference_state);
+
+    if (HashState(*fast_state) != HashState(*reference_state))
+        return Describe(*fast_state, *reference_state);
+
+    auto page = FindDifferentPage(fast_memory, reference_copy_memory);
+    if (!page && fast_stores) page = FindDifferentPage(reference_copy_memory, fast_memory);
+
+    if (page)
+        return std::format("RAM page {:#x}", *page);
+
+    return {};
+}
+
+bool CoSimulator::Run(Long instructions) {
+    if (divergence) return false;
+
+    Long end = fast.GetCycles() + instructions;
+
+    while (fast.IsRunning() && fast.GetCycles() < end) {
+        Long target = std::min(fast.GetCycles() + options.interval, end);
+
+        RunTo(fast, target);
+        RunTo(*reference, target);
+
+        // Only the reference's stores are checked here, the fast side's dirty
+        // bits belong to whoever else reads them
+        auto difference = Compare(fast, memory, *reference, *reference_memory, false);
+
+        if (!difference.empty()) {
+            divergence = Pinpoint();
+
+            // The replay never went wrong, so say what the interval ended on
+            if (!divergence->pinpointed)
+                divergence->difference = difference;
+
+            return false;
+        }
+
+        // The trailing copy moves up to the state both agreed on
+        RunTo(*checkpoint, target);
+        TakeWrittenRAM(*checkpoint_memory);
+        checkpoints++;
+
+        if (fast.GetCycles() < target) return false;
+    }
+
+    return fast.IsRunning();
+}
+
+CoSimulator::Divergence CoSimulator::Pinpoint() {
+    Divergence found;
+    found.instruction = checkpoint->GetCycles() - start_cycles;
+    found.pc = checkpoint->GetPC();
+
+    // A fast copy of the checkpoint, stepped next to it
+    auto replay_memory = checkpoint_memory->Clone();
+    auto replay = CreateCopy(*replay_memory, *checkpoint, true);
+
+    Long end = std::max(fast.GetCycles(), reference->GetCycles());
+
+    while (checkpoint->GetCycles() < end) {
+        auto at = checkpoint->GetCycles();
+        auto pc = checkpoint->GetPC();
+
+        RunTo(*replay, at + 1);
+        RunTo(*checkpoint, at + 1);
+
+        auto difference = Compare(*replay, *replay_memory, *checkpoint, *checkpoint_memory, true);
+        if (!difference.empty()) {
+            found.instruction = at - start_cycles;
+            found.pc = pc;
+            found.difference = std::move(difference);
+            found.pinpointed = true;
+            break;
+        }
+
+        if (checkpoint->GetCycles() == at) break;
+    }
+
+    checkpoint_memory->Peek(found.pc, std::span<Word>(&found.encoding, 1));
+    return found;
+}
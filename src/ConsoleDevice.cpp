@@ -0,0 +1,204 @@
+#include "ConsoleDevice.hpp"
+
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+MemoryConsole::MemoryConsole(Address base, Output output) : MemoryRegion(TYPE_CONSOLE, 0, base, SIZE, true, true), output{std::move(output)} {
+    thread = std::jthread([this](std::stop_token stop) { Drain(stop); });
+}
+
+Long MemoryConsole::ReadLong(Address address) const {
+    auto index = address / sizeof(Long);
+    if (index >= REGISTER_COUNT) return 0;
+
+    return registers[index].load();
+}
+
+Word MemoryConsole::ReadWord(Address address) const {
+    return static_cast<Word>(ReadLong(address & ~7) >> ((address & 4) * 8));
+}
+
+void MemoryConsole::WriteLong(Address address, Long vlong) {
+    switch (address) {
+        case OUTPUT_RING_OFFSET:
+        case OUTPUT_SIZE_OFFSET:
+            Register(address) = vlong;
+            break;
+
+        // Taking the lock orders the store against a drain about to wait
+        case OUTPUT_HEAD_OFFSET: {
+            {
+                std::lock_guard guard(output_lock);
+                Register(address) = vlong;
+            }
+
+            output_signal.notify_one();
+            break;
+        }
+
+        case INPUT_RING_OFFSET:
+            Register(address) = vlong;
+            break;
+
+        // The size goes in last, so only then is the ring usable
+        case INPUT_SIZE_OFFSET: {
+            Register(address) = vlong;
+
+            std::lock_guard guard(input_lock);
+            FillInput();
+            StartReading();
+            break;
+        }
+
+        case INPUT_TAIL_OFFSET: {
+            Register(address) = vlong;
+
+            std::lock_guard guard(input_lock);
+            FillInput();
+            break;
+        }
+    }
+}
+
+// Halves merge into the whole register, like the block device
+void MemoryConsole::WriteWord(Address address, Word word) {
+    Address offset = address & ~7;
+
+    auto shift = (address & 4) * 8;
+    auto vlong = ReadLong(offset);
+    vlong &= ~(0xffffffffULL << shift);
+    vlong |= static_cast<Long>(word) << shift;
+
+    WriteLong(offset, vlong);
+}
+
+Word MemoryConsole::OutputPending() const {
+    if (!memory || Register(OUTPUT_SIZE_OFFSET) == 0) return 0;
+
+    return static_cast<Word>(Register(OUTPUT_HEAD_OFFSET) - Register(OUTPUT_TAIL_OFFSET));
+}
+
+void MemoryConsole::Drain(std::stop_token stop) {
+    std::string chunk;
+
+    while (true) {
+        {
+            std::unique_lock guard(output_lock);
+            output_signal.wait(guard, stop, [&]() { return OutputPending() != 0; });
+
+            if (stop.stop_requested()) return;
+        }
+
+        Address ring = Register(OUTPUT_RING_OFFSET);
+        Address size = Register(OUTPUT_SIZE_OFFSET);
+        Long tail = Register(OUTPUT_TAIL_OFFSET);
+
+        // A guest that overran the ring only gets its newest bytes out
+        Address count = OutputPending();
+        if (count > size) {
+            tail += count - size;
+            count = size;
+        }
+
+        chunk.resize(count);
+
+        Address start = static_cast<Word>(tail) % size;
+        Address first = std::min(count, size - start);
+
+        // A ring that isn't mapped drops what it held
+        try {
+            memory->ReadBytes(ring + start, std::span(reinterpret_cast<Byte*>(chunk.data()), first));
+            memory->ReadBytes(ring, std::span(reinterpret_cast<Byte*>(chunk.data()) + first, count - first));
+
+            if (output) output(chunk);
+        }
+        catch (const std::runtime_error&) {}
+
+        {
+            std::lock_guard guard(output_lock);
+            Register(OUTPUT_TAIL_OFFSET) = tail + count;
+        }
+
+        drained.notify_all();
+    }
+}
+
+void MemoryConsole::Flush() {
+    std::unique_lock guard(output_lock);
+
+    // The drain thread only stops with the device, so it's still there
+    drained.wait(guard, [&]() { return OutputPending() == 0; });
+}
+
+// Called with input_lock held
+void MemoryConsole::FillInput() {
+    Address ring = Register(INPUT_RING_OFFSET);
+    Address size = Register(INPUT_SIZE_OFFSET);
+
+    if (memory && size != 0 && !backlog.empty()) {
+        Long head = Register(INPUT_HEAD_OFFSET);
+        Address used = static_cast<Word>(head - Register(INPUT_TAIL_OFFSET));
+
+        Address count = std::min<Address>(backlog.size(), used < size ? size - used : 0);
+        Address start = static_cast<Word>(head) % size;
+        Address first = std::min(count, size - start);
+
+        // Input for a ring that isn't mapped is lost, like output
+        try {
+            memory->WriteBytes(ring + start, std::span(reinterpret_cast<const Byte*>(backlog.data()), first));
+            memory->WriteBytes(ring, std::span(reinterpret_cast<const Byte*>(backlog.data()) + first, count - first));
+        }
+        catch (const std::runtime_error&) {}
+
+        backlog.erase(0, count);
+        Register(INPUT_HEAD_OFFSET) = head + count;
+    }
+
+    if (source_ended && backlog.empty())
+        Register(INPUT_CLOSED_OFFSET) = 1;
+}
+
+// Called with input_lock held. The reader may sit in a blocking read for
+// the rest of the run, so it's detached and only holds the device weakly
+void MemoryConsole::StartReading() {
+    if (reading || !input_source) return;
+
+    reading = true;
+
+    std::thread([weak = weak_from_this(), source = input_source]() {
+        std::string line;
+        while (source(line)) {
+            auto self = weak.lock();
+            if (!self) return;
+
+            line.push_back('\n');
+            self->PushInput(line);
+        }
+
+        if (auto self = weak.lock()) {
+            std::lock_guard guard(self->input_lock);
+            self->source_ended = true;
+            self->FillInput();
+        }
+    }).detach();
+}
+
+void MemoryConsole::SetInputSource(InputSource source) {
+    std::lock_guard guard(input_lock);
+    input_source = std::move(source);
+
+    if (Register(INPUT_SIZE_OFFSET) != 0)
+        StartReading();
+}
+
+void MemoryConsole::PushInput(std::string_view text) {
+    std::lock_guard guard(input_lock);
+    backlog.append(text);
+    FillInput();
+}
+
+std::shared_ptr<MemoryConsole> MemoryConsole::Create(Output output, Address base) {
+    return std::shared_ptr<MemoryConsole>(new MemoryConsole(base, std::move(output)));
+}
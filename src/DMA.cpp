@@ -0,0 +1,201 @@
+#include "DMA.hpp"
+
+#include "CLINT.hpp"
+#include "PLIC.hpp"
+#include "VirtualMachine.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+MemoryDMA::MemoryDMA(Address base) : MemoryRegion(TYPE_DMA, 0, base, SIZE, true, true) {}
+
+Long MemoryDMA::ReadLong(Address address) const {
+    // CONTROL only starts commands, so it reads as zero
+    auto index = address / sizeof(Long);
+    if (index >= REGISTER_COUNT || address == CONTROL_OFFSET) return 0;
+
+    return registers[index].load();
+}
+
+Word MemoryDMA::ReadWord(Address address) const {
+    return static_cast<Word>(ReadLong(address & ~7) >> ((address & 4) * 8));
+}
+
+void MemoryDMA::WriteLong(Address address, Long vlong) {
+    if (address == CONTROL_OFFSET) {
+        Run(vlong);
+        return;
+    }
+
+    if (address == STATUS_OFFSET) {
+        Register(STATUS_OFFSET) = STATUS_IDLE;
+        SetInterrupt(false);
+        return;
+    }
+
+    if (address / sizeof(Long) < REGISTER_COUNT)
+        Register(address) = vlong;
+}
+
+// 32 bit guests fill registers a half at a time. The low word of CONTROL
+// holds every command bit, so writing it is enough to start one
+void MemoryDMA::WriteWord(Address address, Word word) {
+    Address offset = address & ~7;
+    if (offset / sizeof(Long) >= REGISTER_COUNT) return;
+
+    if (offset == CONTROL_OFFSET || offset == STATUS_OFFSET) {
+        if ((address & 4) == 0) WriteLong(offset, word);
+        return;
+    }
+
+    auto shift = (address & 4) * 8;
+    auto vlong = Register(offset).load();
+    vlong &= ~(0xffffffffULL << shift);
+    vlong |= static_cast<Long>(word) << shift;
+
+    Register(offset) = vlong;
+}
+
+void MemoryDMA::Run(Long control) {
+    std::lock_guard guard(command_lock);
+
+    Long result = STATUS_DONE;
+
+    Address to = Register(DESTINATION_OFFSET);
+    Address from = Register(SOURCE_OFFSET);
+    Address bytes = Register(LENGTH_OFFSET);
+
+    try {
+        // Stores into our own registers would start a command inside this one
+        if (to < base + size && to + bytes > base)
+            throw std::runtime_error("DMA transfer into its own registers");
+
+        switch (control & COMMAND_MASK) {
+            case COMMAND_COPY:
+                Copy(to, from, bytes);
+                break;
+
+            case COMMAND_FILL:
+                Fill(to, static_cast<Byte>(Register(FILL_OFFSET).load()), bytes);
+                break;
+
+            default:
+                result = STATUS_ERROR;
+                break;
+        }
+    }
+    // A transfer stops at the first byte that isn't mapped
+    catch (const std::runtime_error&) {
+        result = STATUS_ERROR;
+    }
+
+    Register(STATUS_OFFSET) = result;
+
+    if (control & CONTROL_INTERRUPT)
+        SetInterrupt(true);
+}
+
+// Runs a page at a time, so each chunk sits inside one source and one
+// destination page. Overlapping copies to a higher address run back to
+// front, the way memmove does
+void MemoryDMA::Copy(Address to, Address from, Address bytes) {
+    if (!memory)
+        throw std::runtime_error("DMA isn't attached to a memory");
+
+    bool backwards = to > from && to < from + bytes;
+
+    for (Address done = 0; done < bytes;) {
+        Address remaining = bytes - done;
+        Address src, dst, chunk;
+
+        if (backwards) {
+            Address src_end = from + remaining;
+            Address dst_end = to + remaining;
+
+            chunk = std::min({remaining, (src_end - 1) % Memory::PAGE_SIZE + 1, (dst_end - 1) % Memory::PAGE_SIZE + 1});
+            src = src_end - chunk;
+            dst = dst_end - chunk;
+        }
+        else {
+            src = from + done;
+            dst = to + done;
+
+            chunk = std::min({remaining, Memory::PAGE_SIZE - src % Memory::PAGE_SIZE, Memory::PAGE_SIZE - dst % Memory::PAGE_SIZE});
+        }
+
+        // A source still shared with a clone is read without copying it
+        const Byte* src_host = memory->GetSharedHostPage(src);
+        if (!src_host) src_host = memory->GetHostPage(src).first;
+
+        auto [dst_host, writable] = memory->GetHostPage(dst);
+
+        if (src_host && dst_host && writable) {
+            memory->NotifyWrite(dst, chunk);
+            std::memmove(dst_host + dst % Memory::PAGE_SIZE, src_host + src % Memory::PAGE_SIZE, chunk);
+            memory->MarkDirty(dst);
+        }
+        // MMIO and pages split between regions go through the regions
+        else if (backwards) {
+            for (Address i = chunk; i-- > 0;)
+                memory->WriteByte(dst + i, memory->ReadByte(src + i));
+        }
+        else {
+            for (Address i = 0; i < chunk; i++)
+                memory->WriteByte(dst + i, memory->ReadByte(src + i));
+        }
+
+        done += chunk;
+    }
+}
+
+void MemoryDMA::Fill(Address to, Byte value, Address bytes) {
+    if (!memory)
+        throw std::runtime_error("DMA isn't attached to a memory");
+
+    for (Address done = 0; done < bytes;) {
+        Address dst = to + done;
+        Address chunk = std::min(bytes - done, Memory::PAGE_SIZE - dst % Memory::PAGE_SIZE);
+
+        auto [dst_host, writable] = memory->GetHostPage(dst);
+
+        if (dst_host && writable) {
+            memory->NotifyWrite(dst, chunk);
+            std::memset(dst_host + dst % Memory::PAGE_SIZE, value, chunk);
+            memory->MarkDirty(dst);
+        }
+        else {
+            for (Address i = 0; i < chunk; i++)
+                memory->WriteByte(dst + i, value);
+        }
+
+        done += chunk;
+    }
+}
+
+void MemoryDMA::SetInterrupt(bool pending) {
+    if (!memory) return;
+
+    // With a PLIC the line is routed there, INTERRUPT_HART only picks the
+    // hart without one
+    if (auto plic = memory->FindMemoryRegionOfType<MemoryPLIC>(TYPE_PLIC)) {
+        plic->SetLevel(MemoryPLIC::SOURCE_DMA, pending);
+        return;
+    }
+
+    auto clint = memory->FindMemoryRegionOfType<MemoryCLINT>(TYPE_CLINT);
+    if (clint) clint->SetInterruptPending(Register(INTERRUPT_HART_OFFSET), VirtualMachine::INTERRUPT_MACHINE_EXTERNAL, pending);
+}
+
+std::shared_ptr<MemoryRegion> MemoryDMA::Clone() {
+    auto clone = Create(base);
+
+    for (size_t i = 0; i < REGISTER_COUNT; i++)
+        clone->registers[i] = registers[i].load();
+
+    return clone;
+}
+
+std::shared_ptr<MemoryDMA> MemoryDMA::Create(Address base) {
+    return std::shared_ptr<MemoryDMA>(new MemoryDMA(base));
+}
@@ -0,0 +1,295 @@
+#include "DeviceTree.hpp"
+
+#include "CLINT.hpp"
+#include "PLIC.hpp"
+#include "VirtualMachine.hpp"
+
+#include <algorithm>
+#include <format>
+
+void DeviceTree::PushWord(Word word) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        structure.push_back(static_cast<Byte>(word >> shift));
+}
+
+void DeviceTree::PushBytes(const void* bytes, size_t count) {
+    auto first = static_cast<const Byte*>(bytes);
+    structure.insert(structure.end(), first, first + count);
+
+    while (structure.size() % 4)
+        structure.push_back(0);
+}
+
+Word DeviceTree::GetStringOffset(std::string_view name) {
+    auto [found, inserted] = string_offsets.try_emplace(std::string(name), static_cast<Word>(strings.size()));
+    if (inserted) {
+        strings.append(name);
+        strings.push_back('\0');
+    }
+
+    return found->second;
+}
+
+void DeviceTree::BeginNode(std::string_view name) {
+    PushWord(TOKEN_BEGIN_NODE);
+
+    std::string terminated(name);
+    PushBytes(terminated.c_str(), terminated.size() + 1);
+}
+
+void DeviceTree::EndNode() {
+    PushWord(TOKEN_END_NODE);
+}
+
+void DeviceTree::AddProperty(std::string_view name) {
+    PushWord(TOKEN_PROP);
+    PushWord(0);
+    PushWord(GetStringOffset(name));
+}
+
+void DeviceTree::AddProperty(std::string_view name, std::string_view value) {
+    AddStrings(name, {value});
+}
+
+void DeviceTree::AddCells(std::string_view name, const std::vector<Word>& cells) {
+    PushWord(TOKEN_PROP);
+    PushWord(static_cast<Word>(cells.size() * sizeof(Word)));
+    PushWord(GetStringOffset(name));
+
+    for (auto cell : cells)
+        PushWord(cell);
+}
+
+void DeviceTree::AddStrings(std::string_view name, const std::vector<std::string_view>& values) {
+    std::string value;
+    for (auto string : values) {
+        value.append(string);
+        value.push_back('\0');
+    }
+
+    PushWord(TOKEN_PROP);
+    PushWord(static_cast<Word>(value.size()));
+    PushWord(GetStringOffset(name));
+    PushBytes(value.data(), value.size());
+}
+
+void DeviceTree::AddRegister(Address base, Address size) {
+    AddCells("reg", {static_cast<Word>(base >> 32), static_cast<Word>(base), static_cast<Word>(size >> 32), static_cast<Word>(size)});
+}
+
+std::vector<Byte> DeviceTree::Finish(Hart boot_hart) const {
+    constexpr Word HEADER_SIZE = 40;
+    // Only the terminating entry, nothing is reserved
+    constexpr Word RESERVE_MAP_SIZE = 16;
+
+    Word struct_offset = HEADER_SIZE + RESERVE_MAP_SIZE;
+    Word struct_size = static_cast<Word>(structure.size()) + sizeof(Word);
+    Word strings_offset = struct_offset + struct_size;
+    Word total_size = strings_offset + static_cast<Word>(strings.size());
+
+    DeviceTree blob;
+    for (auto word : {MAGIC, total_size, struct_offset, strings_offset, HEADER_SIZE, VERSION, LAST_COMPATIBLE_VERSION, static_cast<Word>(boot_hart), static_cast<Word>(strings.size()), struct_size})
+        blob.PushWord(word);
+
+    blob.structure.resize(struct_offset, 0);
+    blob.structure.insert(blob.structure.end(), structure.begin(), structure.end());
+    blob.PushWord(TOKEN_END);
+    blob.structure.insert(blob.structure.end(), strings.begin(), strings.end());
+
+    return std::move(blob.structure);
+}
+
+std::vector<Byte> DeviceTree::Generate(const Memory& memory, const Options& options) {
+    constexpr Word IRQ_SUPERVISOR_EXTERNAL = VirtualMachine::INTERRUPT_SUPERVISOR_EXTERNAL;
+    constexpr Word IRQ_MACHINE_SOFTWARE = VirtualMachine::INTERRUPT_MACHINE_SOFTWARE;
+    constexpr Word IRQ_MACHINE_TIMER = VirtualMachine::INTERRUPT_MACHINE_TIMER;
+    constexpr Word IRQ_MACHINE_EXTERNAL = VirtualMachine::INTERRUPT_MACHINE_EXTERNAL;
+
+    const auto& regions = memory.GetMemoryRegions();
+
+    // Nodes only show up once the guest has more than one
+    bool numa = std::any_of(regions.begin(), regions.end(), [](auto& region) { return region->node != 0; });
+    for (Hart hart = 0; hart < options.harts; hart++)
+        numa = numa || memory.GetHartNode(hart) != 0;
+
+    DeviceTree tree;
+    tree.BeginNode("");
+    tree.AddCells("#address-cells", {2});
+    tree.AddCells("#size-cells", {2});
+    tree.AddProperty("compatible", "rv64adfim,machine");
+    tree.AddProperty("model", "RV64ADFIM");
+
+    tree.BeginNode("cpus");
+    tree.AddCells("#address-cells", {1});
+    tree.AddCells("#size-cells", {0});
+    tree.AddCells("timebase-frequency", {static_cast<Word>(MemoryCLINT::TICKS_PER_SECOND)});
+
+    std::vector<Word> intcs;
+    for (Hart hart = 0; hart < options.harts; hart++) {
+        intcs.push_back(tree.NewPhandle());
+
+        tree.BeginNode(std::format("cpu@{:x}", hart));
+        tree.AddProperty("device_type", "cpu");
+        tree.AddCells("reg", {static_cast<Word>(hart)});
+        tree.AddProperty("status", "okay");
+        tree.AddProperty("compatible", "riscv");
+        tree.AddProperty("riscv,isa", options.isa);
+        tree.AddProperty("mmu-type", "riscv,sv48");
+
+        if (numa) tree.AddCells("numa-node-id", {memory.GetHartNode(hart)});
+
+        tree.BeginNode("interrupt-controller");
+        tree.AddCells("#interrupt-cells", {1});
+        tree.AddProperty("interrupt-controller");
+        tree.AddProperty("compatible", "riscv,cpu-intc");
+        tree.AddCells("phandle", {intcs.back()});
+        tree.EndNode();
+
+        tree.EndNode();
+    }
+
+    tree.EndNode();
+
+    for (auto& region : regions) {
+        if (region->type != MemoryRegion::TYPE_GENERAL_RAM) continue;
+        if (options.framebuffer && options.framebuffer->base == region->base) continue;
+
+        tree.BeginNode(std::format("memory@{:x}", region->base));
+        tree.AddProperty("device_type", "memory");
+        tree.AddRegister(region->base, region->size);
+
+        if (numa) tree.AddCells("numa-node-id", {region->node});
+
+        tree.EndNode();
+    }
+
+    tree.BeginNode("chosen");
+    if (!options.bootargs.empty()) tree.AddProperty("bootargs", options.bootargs);
+    tree.EndNode();
+
+    tree.BeginNode("soc");
+    tree.AddCells("#address-cells", {2});
+    tree.AddCells("#size-cells", {2});
+    tree.AddProperty("compatible", "simple-bus");
+    tree.AddProperty("ranges");
+
+    Word plic_phandle = 0;
+    if (auto plic = memory.FindMemoryRegionOfType<MemoryPLIC>(MemoryRegion::TYPE_PLIC)) {
+        plic_phandle = tree.NewPhandle();
+
+        // Contexts past the PLIC's harts go unwired
+        std::vector<Word> contexts;
+        for (Hart hart = 0; hart < std::min<Hart>(options.harts, MemoryPLIC::MAX_HARTS); hart++) {
+            contexts.insert(contexts.end(), {intcs[hart], IRQ_MACHINE_EXTERNAL, intcs[hart], IRQ_SUPERVISOR_EXTERNAL});
+        }
+
+        tree.BeginNode(std::format("interrupt-controller@{:x}", plic->base));
+        tree.AddStrings("compatible", {"sifive,plic-1.0.0", "riscv,plic0"});
+        tree.AddRegister(plic->base, plic->size);
+        tree.AddCells("#address-cells", {0});
+        tree.AddCells("#interrupt-cells", {1});
+        tree.AddProperty("interrupt-controller");
+        tree.AddCells("interrupts-extended", contexts);
+        tree.AddCells("riscv,ndev", {MemoryPLIC::SOURCES - 1});
+        tree.AddCells("phandle", {plic_phandle});
+        tree.EndNode();
+    }
+
+    for (auto& region : regions) {
+        std::string_view name;
+        std::string_view compatible;
+        Word source = 0;
+
+        switch (region->type) {
+            case MemoryRegion::TYPE_CLINT: {
+                std::vector<Word> lines;
+                for (auto intc : intcs)
+                    lines.insert(lines.end(), {intc, IRQ_MACHINE_SOFTWARE, intc, IRQ_MACHINE_TIMER});
+
+                tree.BeginNode(std::format("clint@{:x}", region->base));
+                tree.AddStrings("compatible", {"sifive,clint0", "riscv,clint0"});
+                tree.AddRegister(region->base, region->size);
+                tree.AddCells("interrupts-extended", lines);
+                tree.EndNode();
+                continue;
+            }
+
+            case MemoryRegion::TYPE_DMA:
+                name = "dma";
+                compatible = "rv64adfim,dma";
+                source = MemoryPLIC::SOURCE_DMA;
+                break;
+
+            case MemoryRegion::TYPE_BLOCK:
+                name = "block";
+                compatible = "rv64adfim,block";
+                source = MemoryPLIC::SOURCE_BLOCK;
+                break;
+
+            case MemoryRegion::TYPE_CONSOLE:
+                name = "console";
+                compatible = "rv64adfim,console";
+                break;
+
+            case MemoryRegion::TYPE_INPUT:
+                name = "input";
+                compatible = "rv64adfim,input";
+                source = MemoryPLIC::SOURCE_INPUT;
+                break;
+
+            case MemoryRegion::TYPE_BALLOON:
+                name = "balloon";
+                compatible = "rv64adfim,balloon";
+                source = MemoryPLIC::SOURCE_BALLOON;
+                break;
+
+            case MemoryRegion::TYPE_NET:
+                name = "ethernet";
+                compatible = "rv64adfim,net";
+                source = MemoryPLIC::SOURCE_NET;
+                break;
+
+            default:
+                continue;
+        }
+
+        tree.BeginNode(std::format("{}@{:x}", name, region->base));
+        tree.AddProperty("compatible", compatible);
+        tree.AddRegister(region->base, region->size);
+
+        if (plic_phandle && source) {
+            tree.AddCells("interrupt-parent", {plic_phandle});
+            tree.AddCells("interrupts", {source});
+        }
+
+        tree.EndNode();
+    }
+
+    if (options.framebuffer) {
+        auto& framebuffer = *options.framebuffer;
+
+        tree.BeginNode(std::format("framebuffer@{:x}", framebuffer.base));
+        tree.AddProperty("compatible", "simple-framebuffer");
+        tree.AddRegister(framebuffer.base, static_cast<Address>(framebuffer.stride) * framebuffer.height);
+        tree.AddCells("width", {framebuffer.width});
+        tree.AddCells("height", {framebuffer.height});
+        tree.AddCells("stride", {framebuffer.stride});
+        tree.AddProperty("format", framebuffer.format);
+        tree.EndNode();
+    }
+
+    // soc, then the root
+    tree.EndNode();
+    tree.EndNode();
+
+    return tree.Finish(options.boot_hart);
+}
+
+std::unique_ptr<MemoryROM> DeviceTree::CreateROM(const Memory& memory, const Options& options, Address base) {
+    auto blob = Generate(memory, options);
+
+    std::vector<Long> longs((blob.size() + sizeof(Long) - 1) / sizeof(Long), 0);
+    std::copy(blob.begin(), blob.end(), reinterpret_cast<Byte*>(longs.data()));
+
+    return MemoryROM::Create(longs, base);
+}
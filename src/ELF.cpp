@@ -0,0 +1,365 @@
+#include "ELF.hpp"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr Byte ELF_MAGIC[4] = {0x7f, 'E', 'L', 'F'};
+
+    constexpr Byte CLASS_32 = 1;
+    constexpr Byte CLASS_64 = 2;
+    constexpr Byte DATA_LITTLE_ENDIAN = 1;
+
+    constexpr Half TYPE_EXECUTABLE = 2;
+    constexpr Half MACHINE_RISCV = 243;
+
+    constexpr Word PT_LOAD = 1;
+    constexpr Word PF_X = 1;
+    constexpr Word PF_W = 2;
+
+    constexpr Word SHT_SYMTAB = 2;
+
+    constexpr Byte STT_NOTYPE = 0;
+    constexpr Byte STT_OBJECT = 1;
+    constexpr Byte STT_FUNC = 2;
+
+    // Layouts straight from the spec, so the loader builds without elf.h
+    template <typename Offset>
+    struct Header {
+        Byte ident[16];
+        Half type;
+        Half machine;
+        Word version;
+        Offset entry;
+        Offset phoff;
+        Offset shoff;
+        Word flags;
+        Half ehsize;
+        Half phentsize;
+        Half phnum;
+        Half shentsize;
+        Half shnum;
+        Half shstrndx;
+    };
+
+    struct ProgramHeader32 {
+        Word type;
+        Word offset;
+        Word vaddr;
+        Word paddr;
+        Word filesz;
+        Word memsz;
+        Word flags;
+        Word align;
+    };
+
+    struct ProgramHeader64 {
+        Word type;
+        Word flags;
+        Long offset;
+        Long vaddr;
+        Long paddr;
+        Long filesz;
+        Long memsz;
+        Long align;
+    };
+
+    template <typename Offset>
+    struct SectionHeader {
+        Word name;
+        Word type;
+        Offset flags;
+        Offset addr;
+        Offset offset;
+        Offset size;
+        Word link;
+        Word info;
+        Offset addralign;
+        Offset entsize;
+    };
+
+    struct Sym32 {
+        Word name;
+        Word value;
+        Word size;
+        Byte info;
+        Byte other;
+        Half shndx;
+    };
+
+    struct Sym64 {
+        Word name;
+        Byte info;
+        Byte other;
+        Half shndx;
+        Long value;
+        Long size;
+    };
+
+    inline Address PageDown(Address address) {
+        return address & ~(Memory::PAGE_SIZE - 1);
+    }
+
+    inline Address PageUp(Address address) {
+        return (address + Memory::PAGE_SIZE - 1) & ~(Memory::PAGE_SIZE - 1);
+    }
+}
+
+SymbolTable::SymbolTable(std::vector<Symbol> symbols) : symbols{std::move(symbols)} {
+    std::sort(this->symbols.begin(), this->symbols.end(), [](const Symbol& lhs, const Symbol& rhs) {
+        return lhs.address < rhs.address;
+    });
+}
+
+const SymbolTable::Symbol* SymbolTable::Find(Address address) const {
+    auto next = std::upper_bound(symbols.begin(), symbols.end(), address, [](Address address, const Symbol& symbol) {
+        return address < symbol.address;
+    });
+
+    if (next == symbols.begin()) return nullptr;
+
+    // Several symbols may share an address, prefer one that is sized to it
+    auto symbol = std::prev(next);
+    for (auto candidate = symbol; candidate->address == symbol->address; candidate--) {
+        if (address < candidate->address + candidate->size) return &*candidate;
+        if (candidate == symbols.begin()) break;
+    }
+
+    return symbol->size == 0 ? &*symbol : nullptr;
+}
+
+std::string SymbolTable::Format(Address address) const {
+    auto symbol = Find(address);
+    if (!symbol) return {};
+
+    if (address == symbol->address) return symbol->name;
+    return std::format("{}+0x{:x}", symbol->name, address - symbol->address);
+}
+
+FileMapping::~FileMapping() {
+#if defined(_WIN32) || defined(_WIN64)
+    if (host) UnmapViewOfFile(host);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+#else
+    if (host) munmap(const_cast<Byte*>(host), size);
+#endif
+}
+
+std::shared_ptr<FileMapping> FileMapping::Open(const std::string& path) {
+    auto mapped = std::shared_ptr<FileMapping>(new FileMapping());
+
+#if defined(_WIN32) || defined(_WIN64)
+    mapped->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mapped->file == INVALID_HANDLE_VALUE) {
+        mapped->file = nullptr;
+        throw std::runtime_error(std::format("Could not open {} for reading", path));
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0)
+        throw std::runtime_error(std::format("{} is empty", path));
+
+    mapped->size = size.QuadPart;
+
+    mapped->mapping = CreateFileMappingA(mapped->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapped->mapping)
+        throw std::runtime_error(std::format("Could not map {}", path));
+
+    mapped->host = static_cast<const Byte*>(MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!mapped->host)
+        throw std::runtime_error(std::format("Could not map {}", path));
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error(std::format("Could not open {} for reading", path));
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw std::runtime_error(std::format("{} is empty", path));
+    }
+
+    // The mapping keeps the file referenced, so the descriptor can go
+    void* host = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (host == MAP_FAILED)
+        throw std::runtime_error(std::format("Could not map {}", path));
+
+    mapped->host = static_cast<const Byte*>(host);
+    mapped->size = info.st_size;
+#endif
+
+    return mapped;
+}
+
+bool MemoryFileROM::ReadBytes(Address address, Byte* bytes, Address count) const {
+    Address at = offset + address;
+    Address present = at < file->GetSize() ? std::min(count, file->GetSize() - at) : 0;
+
+    std::memcpy(bytes, file->GetHost() + at, present);
+    std::memset(bytes + present, 0, count - present);
+
+    return true;
+}
+
+Byte* MemoryFileROM::GetHostPage(Address address) {
+    // The tail of the last file page is zero filled by the host, but pages
+    // wholly past it aren't backed
+    if (offset + address >= PageUp(file->GetSize())) return nullptr;
+
+    return const_cast<Byte*>(file->GetHost()) + offset + address;
+}
+
+std::unique_ptr<MemoryFileROM> MemoryFileROM::Create(std::shared_ptr<const FileMapping> file, Address offset, Address base, Address size) {
+    return std::unique_ptr<MemoryFileROM>(new MemoryFileROM(std::move(file), offset, base, size));
+}
+
+template <typename T>
+T ELFImage::At(Address offset) const {
+    if (offset > file->GetSize() || sizeof(T) > file->GetSize() - offset)
+        throw std::runtime_error(std::format("ELF structure at {:#x} is past the end of the file", offset));
+
+    T value;
+    std::memcpy(&value, file->GetHost() + offset, sizeof(T));
+    return value;
+}
+
+template <typename FileHeader, typename ProgramHeader, typename FileSectionHeader, typename Sym>
+void ELFImage::Parse() {
+    auto header = At<FileHeader>(0);
+
+    if (header.machine != MACHINE_RISCV)
+        throw std::runtime_error(std::format("ELF machine {} is not RISC-V", header.machine));
+
+    if (header.type != TYPE_EXECUTABLE)
+        throw std::runtime_error("ELF file is not an executable");
+
+    entry = header.entry;
+
+    for (Half i = 0; i < header.phnum; i++) {
+        auto program = At<ProgramHeader>(header.phoff + static_cast<Address>(i) * header.phentsize);
+        if (program.type != PT_LOAD || program.memsz == 0) continue;
+
+        if (program.filesz > program.memsz || program.offset + program.filesz > file->GetSize())
+            throw std::runtime_error(std::format("ELF segment {} is malformed", i));
+
+        segments.push_back({
+            program.paddr,
+            program.offset,
+            program.filesz,
+            program.memsz,
+            (program.flags & PF_W) != 0,
+            (program.flags & PF_X) != 0
+        });
+    }
+
+    // Symbols are optional, a stripped image still runs
+    std::vector<SymbolTable::Symbol> found;
+
+    for (Half i = 0; i < header.shnum && header.shoff != 0; i++) {
+        auto section = At<FileSectionHeader>(header.shoff + static_cast<Address>(i) * header.shentsize);
+        if (section.type != SHT_SYMTAB || section.entsize < sizeof(Sym) || section.link >= header.shnum) continue;
+
+        auto strings = At<FileSectionHeader>(header.shoff + static_cast<Address>(section.link) * header.shentsize);
+        if (strings.offset > file->GetSize() || strings.size > file->GetSize() - strings.offset) continue;
+
+        for (Address entry = section.entsize; entry + section.entsize <= section.size; entry += section.entsize) {
+            auto sym = At<Sym>(section.offset + entry);
+
+            Byte kind = sym.info & 0xf;
+            if (sym.name == 0 || sym.shndx == 0 || (kind != STT_NOTYPE && kind != STT_OBJECT && kind != STT_FUNC)) continue;
+            if (sym.name >= strings.size) continue;
+
+            auto name = reinterpret_cast<const char*>(file->GetHost() + strings.offset + sym.name);
+            auto length = strnlen(name, strings.size - sym.name);
+
+            found.push_back({std::string(name, length), sym.value, sym.size, kind == STT_FUNC});
+        }
+    }
+
+    symbols = std::make_shared<const SymbolTable>(std::move(found));
+}
+
+bool ELFImage::CanMap(const Segment& segment) const {
+    if (segment.writable || segment.file_bytes != segment.memory_bytes) return false;
+
+    // Pages are served from the file, so it must line up with the guest
+    if (segment.address % Memory::PAGE_SIZE != segment.file_offset % Memory::PAGE_SIZE) return false;
+
+    // Other segments sharing a page would either lose their bytes to the
+    // file or write into the region
+    Address start = PageDown(segment.address), end = PageUp(segment.address + segment.memory_bytes);
+    for (auto& other : segments) {
+        if (&other == &segment) continue;
+        if (PageDown(other.address) < end && PageUp(other.address + other.memory_bytes) > start) return false;
+    }
+
+    return true;
+}
+
+void ELFImage::MapReadOnlySegments(Memory& memory) {
+    for (auto& segment : segments) {
+        if (segment.mapped || !CanMap(segment)) continue;
+
+        Address base = PageDown(segment.address);
+        Address size = PageUp(segment.address + segment.memory_bytes) - base;
+
+        memory.AddMemoryRegion(MemoryFileROM::Create(file, PageDown(segment.file_offset), base, size));
+        segment.mapped = true;
+    }
+}
+
+void ELFImage::LoadSegments(Memory& memory) {
+    for (auto& segment : segments) {
+        if (segment.mapped) continue;
+
+        // Bytes past file_bytes are already zero
+        memory.WriteBytes(segment.address, {file->GetHost() + segment.file_offset, segment.file_bytes});
+    }
+}
+
+bool ELFImage::IsELF(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+
+    char magic[sizeof(ELF_MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+
+    return file && std::equal(magic, magic + sizeof(magic), reinterpret_cast<const char*>(ELF_MAGIC));
+}
+
+std::unique_ptr<ELFImage> ELFImage::Open(const std::string& path) {
+    auto image = std::unique_ptr<ELFImage>(new ELFImage());
+    image->file = FileMapping::Open(path);
+
+    auto ident = image->At<std::array<Byte, 16>>(0);
+    if (!std::equal(ELF_MAGIC, ELF_MAGIC + sizeof(ELF_MAGIC), ident.begin()))
+        throw std::runtime_error(std::format("{} is not an ELF file", path));
+
+    if (ident[5] != DATA_LITTLE_ENDIAN)
+        throw std::runtime_error(std::format("{} is not little endian", path));
+
+    if (ident[4] == CLASS_64) {
+        image->is_64 = true;
+        image->Parse<Header<Long>, ProgramHeader64, SectionHeader<Long>, Sym64>();
+    }
+    else if (ident[4] == CLASS_32)
+        image->Parse<Header<Word>, ProgramHeader32, SectionHeader<Word>, Sym32>();
+    else
+        throw std::runtime_error(std::format("{} has an unknown ELF class", path));
+
+    return image;
+}
@@ -0,0 +1,296 @@
+#include "Embed.h"
+#include "Memory.hpp"
+#include "VirtualMachine.hpp"
+
+#include <cstring>
+#include <exception>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct rv64_machine {
+    struct ECall {
+        rv64_ecall_handler handler;
+        void* user;
+    };
+
+    // Members go in reverse, so harts are gone before their memory
+    Memory memory;
+    std::vector<std::unique_ptr<VirtualMachine>> harts;
+
+    std::unordered_map<Long, ECall> ecalls;
+    std::string error;
+
+    // Set by a hart's budget handler, so a step that ran out tells apart
+    // from one stopped by rv64_stop
+    std::vector<bool> out_of_budget;
+};
+
+namespace {
+    // Slices a step is cut into, like Run's
+    constexpr Long QUANTUM = 1000;
+
+    VirtualMachine& GetHart(const rv64_machine* machine, uint32_t hart) {
+        if (hart >= machine->harts.size())
+            throw std::out_of_range(std::format("There is no hart {}, the machine has {}", hart, machine->harts.size()));
+
+        return *machine->harts[hart];
+    }
+
+    // Turns what body throws into the machine's error
+    template <typename Body>
+    int Guard(rv64_machine* machine, Body&& body) {
+        try {
+            body();
+            return 0;
+        }
+        catch (const std::exception& e) {
+            machine->error = e.what();
+            return -1;
+        }
+    }
+
+    void BeginStep(rv64_machine* machine, uint32_t hart, Long instructions) {
+        auto& vm = GetHart(machine, hart);
+
+        machine->out_of_budget[hart] = false;
+        vm.SetInstructionBudget(instructions);
+
+        vm.Unpause();
+        vm.Start();
+    }
+
+    rv64_event FinishStep(rv64_machine* machine, uint32_t hart) {
+        auto& vm = *machine->harts[hart];
+        vm.SetInstructionBudget(0);
+
+        if (machine->out_of_budget[hart]) return RV64_EVENT_DONE;
+        if (!vm.IsRunning()) return RV64_EVENT_STOPPED;
+        if (vm.IsPaused()) return RV64_EVENT_BREAK;
+
+        return RV64_EVENT_IDLE;
+    }
+
+    rv64_event Step(rv64_machine* machine, uint32_t hart, Long instructions) {
+        try {
+            BeginStep(machine, hart, instructions);
+
+            auto& vm = *machine->harts[hart];
+            while (vm.RunQuantum(QUANTUM)) {}
+
+            return FinishStep(machine, hart);
+        }
+        catch (const std::exception& e) {
+            machine->error = e.what();
+            if (hart < machine->harts.size()) machine->harts[hart]->Stop();
+
+            return RV64_EVENT_ERROR;
+        }
+    }
+}
+
+void rv64_config_init(rv64_config* config) {
+    config->harts = 1;
+    config->start_pc = 0x1000;
+    config->ram_base = 0x1000;
+    config->ram_size = 16 * 1024 * 1024;
+    config->use_basic_blocks = 1;
+    config->use_jit = 0;
+}
+
+rv64_machine* rv64_create(const rv64_config* config) {
+    try {
+        auto machine = std::make_unique<rv64_machine>();
+
+        if (config->ram_size != 0)
+            machine->memory.AddMemoryRegion(MemoryRAM::Create(config->ram_base, config->ram_size));
+
+        machine->out_of_budget.resize(config->harts);
+
+        for (uint32_t hart = 0; hart < config->harts; hart++) {
+            auto vm = std::make_unique<VirtualMachine>(machine->memory, config->start_pc, hart);
+
+            vm->SetUseBasicBlocks(config->use_basic_blocks != 0);
+            vm->SetUseJIT(config->use_jit != 0);
+            vm->SetPauseOnBreak(true);
+
+            vm->SetECallHandler([machine = machine.get()](Hart hart, bool is_32_bit_mode, Memory&, auto& regs, auto&) {
+                Long number = regs[VirtualMachine::REG_A0].u64;
+                if (is_32_bit_mode) number = static_cast<Long>(regs[VirtualMachine::REG_A0].s32);
+
+                auto found = machine->ecalls.find(number);
+                if (found == machine->ecalls.end())
+                    throw std::runtime_error(std::format("Hart {} called unknown ECall handler: {}", hart, static_cast<SLong>(number)));
+
+                found->second.handler(machine, hart, found->second.user);
+            });
+
+            vm->SetBudgetHandler([machine = machine.get(), hart](VirtualMachine&, VirtualMachine::Budget) {
+                machine->out_of_budget[hart] = true;
+            });
+
+            vm->Start();
+            machine->harts.push_back(std::move(vm));
+        }
+
+        return machine.release();
+    }
+    catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+void rv64_destroy(rv64_machine* machine) {
+    delete machine;
+}
+
+const char* rv64_last_error(const rv64_machine* machine) {
+    return machine->error.c_str();
+}
+
+uint32_t rv64_hart_count(const rv64_machine* machine) {
+    return static_cast<uint32_t>(machine->harts.size());
+}
+
+int rv64_add_ram(rv64_machine* machine, uint64_t base, uint64_t size) {
+    return Guard(machine, [&]() {
+        machine->memory.AddMemoryRegion(MemoryRAM::Create(base, size));
+    });
+}
+
+int rv64_add_rom(rv64_machine* machine, uint64_t base, const void* bytes, size_t size) {
+    return Guard(machine, [&]() {
+        std::vector<Long> longs((size + sizeof(Long) - 1) / sizeof(Long));
+        std::memcpy(longs.data(), bytes, size);
+
+        machine->memory.AddMemoryRegion(MemoryROM::Create(longs, base));
+    });
+}
+
+int rv64_read_memory(rv64_machine* machine, uint64_t address, void* bytes, size_t size) {
+    return Guard(machine, [&]() {
+        machine->memory.ReadBytes(address, {static_cast<Byte*>(bytes), size});
+    });
+}
+
+int rv64_write_memory(rv64_machine* machine, uint64_t address, const void* bytes, size_t size) {
+    return Guard(machine, [&]() {
+        machine->memory.WriteBytes(address, {static_cast<const Byte*>(bytes), size});
+    });
+}
+
+int rv64_read_registers(rv64_machine* machine, uint32_t hart, uint64_t values[32]) {
+    return Guard(machine, [&]() {
+        auto& vm = GetHart(machine, hart);
+        for (size_t i = 0; i < VirtualMachine::REGISTER_COUNT; i++)
+            values[i] = vm.GetRegister(i).Value().u64;
+    });
+}
+
+int rv64_write_registers(rv64_machine* machine, uint32_t hart, const uint64_t values[32]) {
+    return Guard(machine, [&]() {
+        auto& vm = GetHart(machine, hart);
+        for (size_t i = 1; i < VirtualMachine::REGISTER_COUNT; i++)
+            vm.GetRegister(i).Value().u64 = values[i];
+    });
+}
+
+int rv64_read_float_registers(rv64_machine* machine, uint32_t hart, uint64_t values[32]) {
+    return Guard(machine, [&]() {
+        auto& vm = GetHart(machine, hart);
+        for (size_t i = 0; i < VirtualMachine::REGISTER_COUNT; i++)
+            values[i] = vm.GetFloatRegister(i).Value().u64;
+    });
+}
+
+int rv64_write_float_registers(rv64_machine* machine, uint32_t hart, const uint64_t values[32]) {
+    return Guard(machine, [&]() {
+        auto& vm = GetHart(machine, hart);
+        for (size_t i = 0; i < VirtualMachine::REGISTER_COUNT; i++)
+            vm.GetFloatRegister(i).Value().u64 = values[i];
+    });
+}
+
+uint64_t rv64_get_pc(const rv64_machine* machine, uint32_t hart) {
+    return hart < machine->harts.size() ? machine->harts[hart]->GetPC() : 0;
+}
+
+int rv64_set_pc(rv64_machine* machine, uint32_t hart, uint64_t pc) {
+    return Guard(machine, [&]() {
+        GetHart(machine, hart).SetPC(pc);
+    });
+}
+
+int rv64_register_ecall(rv64_machine* machine, int64_t number, rv64_ecall_handler handler, void* user) {
+    if (!handler) {
+        machine->ecalls.erase(static_cast<Long>(number));
+        return 0;
+    }
+
+    machine->ecalls[static_cast<Long>(number)] = {handler, user};
+    return 0;
+}
+
+int rv64_set_breakpoint(rv64_machine* machine, uint64_t address) {
+    for (auto& vm : machine->harts)
+        vm->SetBreakPoint(address);
+
+    return 0;
+}
+
+int rv64_clear_breakpoint(rv64_machine* machine, uint64_t address) {
+    for (auto& vm : machine->harts)
+        vm->ClearBreakPoint(address);
+
+    return 0;
+}
+
+rv64_event rv64_step(rv64_machine* machine, uint32_t hart, uint64_t instructions) {
+    if (instructions == 0) return RV64_EVENT_DONE;
+    return Step(machine, hart, instructions);
+}
+
+rv64_event rv64_run(rv64_machine* machine, uint32_t hart) {
+    return Step(machine, hart, 0);
+}
+
+int rv64_step_all(rv64_machine* machine, uint64_t instructions, rv64_event* events) {
+    auto count = machine->harts.size();
+    std::vector<bool> failed(count, false);
+
+    for (uint32_t hart = 0; hart < count; hart++)
+        BeginStep(machine, hart, instructions);
+
+    // Harts asleep may be woken by the others, so it's only over once a
+    // whole round ran nothing
+    for (bool ran = true; ran;) {
+        ran = false;
+
+        for (uint32_t hart = 0; hart < count; hart++) {
+            if (failed[hart]) continue;
+
+            try {
+                ran |= machine->harts[hart]->RunQuantum(QUANTUM);
+            }
+            catch (const std::exception& e) {
+                machine->error = e.what();
+                machine->harts[hart]->Stop();
+                failed[hart] = true;
+            }
+        }
+    }
+
+    for (uint32_t hart = 0; hart < count; hart++)
+        events[hart] = failed[hart] ? RV64_EVENT_ERROR : FinishStep(machine, hart);
+
+    return 0;
+}
+
+int rv64_stop(rv64_machine* machine, uint32_t hart) {
+    return Guard(machine, [&]() {
+        GetHart(machine, hart).Stop();
+    });
+}
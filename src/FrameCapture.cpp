@@ -0,0 +1,331 @@
+#include "FrameCapture.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace {
+    constexpr std::array<Word, 256> CRC_TABLE = [] {
+        std::array<Word, 256> table{};
+
+        for (Word i = 0; i < table.size(); i++) {
+            Word crc = i;
+            for (size_t bit = 0; bit < 8; bit++)
+                crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+
+            table[i] = crc;
+        }
+
+        return table;
+    }();
+
+    void PutBigEndian(std::vector<Byte>& out, Word value) {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<Byte>(value >> shift));
+    }
+
+    // Length, type, data and the CRC of type and data
+    void PutChunk(std::vector<Byte>& out, const char* type, std::span<const Byte> data) {
+        PutBigEndian(out, data.size());
+
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+
+        Word crc = 0xffffffff;
+        for (size_t i = start; i < out.size(); i++)
+            crc = CRC_TABLE[(crc ^ out[i]) & 0xff] ^ (crc >> 8);
+
+        PutBigEndian(out, crc ^ 0xffffffff);
+    }
+
+    Word GetPixelSize(FrameCapture::PixelFormat format) {
+        return format == FrameCapture::PixelFormat::RGB565 ? sizeof(Half) : sizeof(Word);
+    }
+}
+
+FrameCapture::FrameCapture(Memory& memory, const Options& options) : memory{memory}, options{options}, frame_bytes{static_cast<Address>(options.width) * options.height * GetPixelSize(options.format)}, start{std::chrono::steady_clock::now()}, scratch(frame_bytes) {
+    for (auto& slot : slots)
+        slot.pixels.resize(frame_bytes);
+
+    if (options.output == Output::Raw || options.output == Output::PNG) {
+        std::error_code error;
+        std::filesystem::create_directories(options.destination, error);
+
+        if (error)
+            throw std::runtime_error(std::format("Could not create {} for frames: {}", options.destination, error.message()));
+    }
+
+    if (options.output == Output::Pipe) {
+        pipe = popen(options.destination.c_str(), "w");
+
+        if (!pipe)
+            throw std::runtime_error(std::format("Could not start {} for frames", options.destination));
+    }
+
+    encoder = std::jthread([this](std::stop_token stop) { Encode(stop); });
+
+    if (options.fps > 0.0)
+        sampler = std::jthread([this](std::stop_token stop) { Sample(stop); });
+}
+
+FrameCapture::~FrameCapture() {
+    Stop();
+    if (pipe) pclose(pipe);
+}
+
+void FrameCapture::Stop() {
+    // The sampler stops pushing first, then the encoder drains the queue
+    sampler = {};
+    encoder = {};
+}
+
+Long FrameCapture::HashFrame(std::span<const Byte> pixels) {
+    Long hash = 0xcbf29ce484222325ULL;
+    auto Mix = [&hash](Long value) { hash = (hash ^ value) * 0x100000001b3ULL; };
+
+    size_t longs = pixels.size() / sizeof(Long);
+    for (size_t i = 0; i < longs; i++) {
+        Long value;
+        std::memcpy(&value, pixels.data() + i * sizeof(Long), sizeof(Long));
+        Mix(value);
+    }
+
+    for (size_t i = longs * sizeof(Long); i < pixels.size(); i++)
+        Mix(pixels[i]);
+
+    return hash;
+}
+
+bool FrameCapture::CaptureFrame() {
+    memory.PeekBytes(options.address, scratch);
+
+    auto hash = HashFrame(scratch);
+    if (captured != 0 && hash == last_hash) return false;
+
+    auto position = head.load(std::memory_order_relaxed);
+    if (position - tail.load(std::memory_order_acquire) == QUEUE_SLOTS) {
+        // Tried again next time, since last_hash still holds the old frame
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // The slot's old buffer becomes the next scratch, so nothing allocates
+    auto& slot = slots[position % QUEUE_SLOTS];
+    slot.pixels.swap(scratch);
+    slot.frame = {captured++, hash, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+    last_hash = hash;
+
+    {
+        std::lock_guard guard(frames_lock);
+        frames.push_back(slot.frame);
+    }
+
+    head.store(position + 1, std::memory_order_release);
+
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_one();
+
+    return true;
+}
+
+void FrameCapture::Sample(std::stop_token stop) {
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / options.fps));
+    auto next = std::chrono::steady_clock::now();
+
+    while (!stop.stop_requested()) {
+        CaptureFrame();
+
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void FrameCapture::Encode(std::stop_token stop) {
+    std::stop_callback wake(stop, [this]() {
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_one();
+    });
+
+    for (;;) {
+        // Taken before looking at the queue, so a push after the check
+        // changes it and the wait returns
+        auto seen = signal.load(std::memory_order_acquire);
+
+        auto position = tail.load(std::memory_order_relaxed);
+        if (position == head.load(std::memory_order_acquire)) {
+            if (stop.stop_requested()) return;
+
+            signal.wait(seen, std::memory_order_acquire);
+            continue;
+        }
+
+        try {
+            Write(slots[position % QUEUE_SLOTS]);
+        }
+        catch (const std::runtime_error&) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        tail.store(position + 1, std::memory_order_release);
+        tail.notify_all();
+    }
+}
+
+void FrameCapture::Flush() {
+    auto queued = head.load(std::memory_order_acquire);
+
+    for (auto written = tail.load(std::memory_order_acquire); written < queued; written = tail.load(std::memory_order_acquire))
+        tail.wait(written, std::memory_order_acquire);
+}
+
+void FrameCapture::Write(const Slot& slot) {
+    auto Path = [&](const char* extension) {
+        return (std::filesystem::path(options.destination) / std::format("frame_{:06}.{}", slot.frame.number, extension)).string();
+    };
+
+    switch (options.output) {
+        case Output::None:
+            break;
+
+        case Output::Raw: {
+            auto path = Path("raw");
+            std::ofstream file(path, std::ios::binary);
+
+            if (!file.is_open())
+                throw std::runtime_error(std::format("Could not open {} for writing", path));
+
+            file.write(reinterpret_cast<const char*>(slot.pixels.data()), slot.pixels.size());
+            break;
+        }
+
+        case Output::PNG:
+            ConvertToRGB(slot.pixels);
+            WritePNG(Path("png"), rgb, options.width, options.height);
+            break;
+
+        case Output::Pipe:
+            ConvertToRGB(slot.pixels);
+
+            if (std::fwrite(rgb.data(), 1, rgb.size(), pipe) != rgb.size())
+                throw std::runtime_error(std::format("Could not write a frame to {}", options.destination));
+
+            break;
+    }
+}
+
+void FrameCapture::ConvertToRGB(std::span<const Byte> pixels) {
+    size_t count = static_cast<size_t>(options.width) * options.height;
+    rgb.resize(count * 3);
+
+    for (size_t i = 0; i < count; i++) {
+        Byte* out = &rgb[i * 3];
+
+        switch (options.format) {
+            case PixelFormat::RGBA8888:
+                std::copy_n(&pixels[i * 4], 3, out);
+                break;
+
+            // Words 0x00RRGGBB, so blue comes first in memory
+            case PixelFormat::XRGB8888:
+                out[0] = pixels[i * 4 + 2];
+                out[1] = pixels[i * 4 + 1];
+                out[2] = pixels[i * 4];
+                break;
+
+            // Widened so full intensity stays 0xff
+            case PixelFormat::RGB565: {
+                Half pixel = pixels[i * 2] | (pixels[i * 2 + 1] << 8);
+                Byte r = pixel >> 11, g = (pixel >> 5) & 0x3f, b = pixel & 0x1f;
+
+                out[0] = (r << 3) | (r >> 2);
+                out[1] = (g << 2) | (g >> 4);
+                out[2] = (b << 3) | (b >> 2);
+                break;
+            }
+        }
+    }
+}
+
+void FrameCapture::WritePNG(const std::string& path, std::span<const Byte> rgb, Word width, Word height) {
+    Address row_bytes = static_cast<Address>(width) * 3;
+
+    // Every row starts with filter type 0, no filtering
+    std::vector<Byte> rows;
+    rows.reserve((row_bytes + 1) * height);
+
+    for (Word row = 0; row < height; row++) {
+        rows.push_back(0);
+        rows.insert(rows.end(), rgb.begin() + row * row_bytes, rgb.begin() + (row + 1) * row_bytes);
+    }
+
+    // A zlib stream of stored blocks, each up to 64 KiB less one
+    std::vector<Byte> stream = {0x78, 0x01};
+    constexpr size_t BLOCK = 0xffff;
+
+    size_t offset = 0;
+    do {
+        size_t length = std::min(BLOCK, rows.size() - offset);
+        bool last = offset + length == rows.size();
+
+        stream.push_back(last);
+        stream.push_back(length & 0xff);
+        stream.push_back(length >> 8);
+        stream.push_back(~length & 0xff);
+        stream.push_back((~length >> 8) & 0xff);
+        stream.insert(stream.end(), rows.begin() + offset, rows.begin() + offset + length);
+
+        offset += length;
+    } while (offset < rows.size());
+
+    Word a = 1, b = 0;
+    for (auto byte : rows) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    PutBigEndian(stream, (b << 16) | a);
+
+    std::vector<Byte> header;
+    PutBigEndian(header, width);
+    PutBigEndian(header, height);
+
+    // 8 bits per channel, RGB, then the default compression, filter and
+    // interlace methods
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+
+    std::vector<Byte> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    PutChunk(png, "IHDR", header);
+    PutChunk(png, "IDAT", stream);
+    PutChunk(png, "IEND", {});
+
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+
+    file.write(reinterpret_cast<const char*>(png.data()), png.size());
+}
+
+std::vector<FrameCapture::Frame> FrameCapture::GetFrames() const {
+    std::lock_guard guard(frames_lock);
+    return frames;
+}
+
+void FrameCapture::WriteHashes(const std::string& path) const {
+    std::ofstream file(path);
+
+    if (!file.is_open())
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+
+    for (auto& frame : GetFrames())
+        file << std::format("{} {:.3f} {:016x}\n", frame.number, frame.seconds, frame.hash);
+}
@@ -0,0 +1,166 @@
+#include "FrameDelta.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    template <typename T>
+    void Put(std::vector<Byte>& out, T value) {
+        for (size_t i = 0; i < sizeof(T); i++)
+            out.push_back(static_cast<Byte>(value >> (i * 8)));
+    }
+
+    template <typename T>
+    bool Get(std::span<const Byte> in, size_t& offset, T& value) {
+        if (offset + sizeof(T) > in.size()) return false;
+
+        value = 0;
+        for (size_t i = 0; i < sizeof(T); i++)
+            value |= static_cast<T>(in[offset + i]) << (i * 8);
+
+        offset += sizeof(T);
+        return true;
+    }
+}
+
+FrameDelta::FrameDelta(Memory& memory, Address address, Word width, Word height, Word pixel_bytes) : memory{memory}, address{address}, width{width}, height{height}, pixel_bytes{pixel_bytes}, row_bytes{static_cast<Address>(width) * pixel_bytes}, sent(row_bytes * height), current(row_bytes * height), tile(static_cast<Address>(TILE) * TILE * pixel_bytes) {}
+
+size_t FrameDelta::Encode(std::vector<Byte>& out, bool full) {
+    Word bands = (height + TILE - 1) / TILE;
+    std::vector<bool> dirty_bands(bands, full || first);
+
+    for (auto [start, end] : memory.TakeDirtyRanges(address, row_bytes * height)) {
+        Address first_row = start > address ? (start - address) / row_bytes : 0;
+        Address last_row = std::min<Address>((end - address + row_bytes - 1) / row_bytes, height);
+
+        for (Address row = first_row; row < last_row; row += TILE - row % TILE)
+            dirty_bands[row / TILE] = true;
+    }
+
+    size_t count_offset = out.size();
+    Put<Long>(out, 0);
+
+    Long tiles = 0;
+    for (Word band = 0; band < bands; band++) {
+        if (!dirty_bands[band]) continue;
+
+        Word y = band * TILE;
+        Word band_height = std::min(TILE, height - y);
+
+        memory.PeekBytes(address + y * row_bytes, std::span(current.data() + y * row_bytes, band_height * row_bytes));
+
+        for (Word x = 0; x < width; x += TILE) {
+            Word tile_width = std::min(TILE, width - x);
+            Address span = static_cast<Address>(tile_width) * pixel_bytes;
+
+            bool changed = full || first;
+            for (Word row = y; row < y + band_height; row++) {
+                Address offset = row * row_bytes + x * pixel_bytes;
+                if (std::memcmp(&current[offset], &sent[offset], span) == 0) continue;
+
+                changed = true;
+                std::memcpy(&sent[offset], &current[offset], span);
+            }
+
+            if (!changed) continue;
+
+            PackTile(out, x, y, tile_width, band_height);
+            tiles++;
+        }
+    }
+
+    first = false;
+
+    for (size_t i = 0; i < sizeof(Long); i++)
+        out[count_offset + i] = static_cast<Byte>(tiles >> (i * 8));
+
+    return tiles;
+}
+
+void FrameDelta::PackTile(std::vector<Byte>& out, Word x, Word y, Word tile_width, Word tile_height) {
+    Address span = static_cast<Address>(tile_width) * pixel_bytes;
+    for (Word row = 0; row < tile_height; row++)
+        std::memcpy(&tile[row * span], &sent[(y + row) * row_bytes + x * pixel_bytes], span);
+
+    Put<Half>(out, x);
+    Put<Half>(out, y);
+    Put<Half>(out, tile_width);
+    Put<Half>(out, tile_height);
+
+    size_t size_offset = out.size();
+    Put<Word>(out, 0);
+    size_t start = out.size();
+
+    size_t pixels = static_cast<size_t>(tile_width) * tile_height;
+    auto Same = [&](size_t a, size_t b) { return std::memcmp(&tile[a * pixel_bytes], &tile[b * pixel_bytes], pixel_bytes) == 0; };
+
+    for (size_t i = 0; i < pixels;) {
+        size_t run = 1;
+        while (i + run < pixels && run < 129 && Same(i, i + run)) run++;
+
+        if (run >= 2) {
+            out.push_back(static_cast<Byte>(run + 126));
+            out.insert(out.end(), &tile[i * pixel_bytes], &tile[(i + 1) * pixel_bytes]);
+            i += run;
+            continue;
+        }
+
+        // Distinct pixels up to the next pair, which starts a run
+        size_t literal = 1;
+        while (i + literal < pixels && literal < 128 && !(i + literal + 1 < pixels && Same(i + literal, i + literal + 1))) literal++;
+
+        out.push_back(static_cast<Byte>(literal - 1));
+        out.insert(out.end(), &tile[i * pixel_bytes], &tile[(i + literal) * pixel_bytes]);
+        i += literal;
+    }
+
+    Word packed = out.size() - start;
+    for (size_t i = 0; i < sizeof(Word); i++)
+        out[size_offset + i] = static_cast<Byte>(packed >> (i * 8));
+}
+
+bool FrameDelta::Apply(std::span<const Byte> batch, std::span<Byte> frame, Word width, Word height, Word pixel_bytes) {
+    Address row_bytes = static_cast<Address>(width) * pixel_bytes;
+    if (frame.size() < row_bytes * height) return false;
+
+    size_t offset = 0;
+    Long tiles;
+    if (!Get(batch, offset, tiles)) return false;
+
+    for (Long t = 0; t < tiles; t++) {
+        Half x, y, tile_width, tile_height;
+        Word packed;
+
+        if (!Get(batch, offset, x) || !Get(batch, offset, y) || !Get(batch, offset, tile_width) || !Get(batch, offset, tile_height) || !Get(batch, offset, packed))
+            return false;
+
+        if (static_cast<Word>(x) + tile_width > width || static_cast<Word>(y) + tile_height > height) return false;
+        if (offset + packed > batch.size()) return false;
+
+        size_t end = offset + packed;
+        size_t pixels = static_cast<size_t>(tile_width) * tile_height;
+
+        // Pixel i of the tile lands at its row and column on screen
+        auto Target = [&](size_t i) { return &frame[(y + i / tile_width) * row_bytes + (x + i % tile_width) * pixel_bytes]; };
+
+        for (size_t i = 0; i < pixels;) {
+            if (offset >= end) return false;
+            Byte control = batch[offset++];
+
+            bool repeat = control >= 128;
+            size_t count = repeat ? control - 126 : control + 1;
+            size_t bytes = repeat ? pixel_bytes : count * pixel_bytes;
+
+            if (i + count > pixels || offset + bytes > end) return false;
+
+            for (size_t n = 0; n < count; n++, i++)
+                std::memcpy(Target(i), &batch[offset + (repeat ? 0 : n * pixel_bytes)], pixel_bytes);
+
+            offset += bytes;
+        }
+
+        if (offset != end) return false;
+    }
+
+    return offset == batch.size();
+}
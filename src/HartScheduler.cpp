@@ -0,0 +1,196 @@
+#include "HartScheduler.hpp"
+
+#include <algorithm>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+HartScheduler::HartScheduler(const std::vector<VirtualMachine*>& harts, const Options& options, ErrorHandler on_error) : harts{harts}, options{options}, on_error{std::move(on_error)} {
+    size_t count = options.threads;
+    if (count == 0) count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    // More workers than harts would only ever steal from each other
+    count = std::clamp<size_t>(count, 1, std::max<size_t>(harts.size(), 1));
+
+    for (size_t i = 0; i < count; i++)
+        workers.push_back(std::make_unique<Worker>());
+
+    for (size_t i = 0; i < harts.size(); i++) {
+        harts[i]->SetWakeHandler([this]() {
+            wake_pending = true;
+            Notify();
+        });
+
+        workers[i % count]->queue.push_back(harts[i]);
+    }
+}
+
+HartScheduler::~HartScheduler() {
+    Stop();
+
+    // Nothing runs the harts now, so the handlers can't race a wake-up
+    // from a hart thread
+    for (auto vm : harts)
+        vm->SetWakeHandler(nullptr);
+}
+
+void HartScheduler::Start() {
+    for (size_t i = 0; i < workers.size(); i++)
+        threads.emplace_back([this, i]() { Work(i); });
+}
+
+void HartScheduler::Wait() {
+    threads.clear();
+}
+
+void HartScheduler::Stop() {
+    stopping = true;
+    Notify();
+
+    threads.clear();
+}
+
+void HartScheduler::Notify() {
+    std::lock_guard lock(idle_lock);
+    idle_signal.notify_all();
+}
+
+VirtualMachine* HartScheduler::Take(size_t worker) {
+    {
+        auto& own = *workers[worker];
+        std::lock_guard lock(own.lock);
+
+        if (!own.queue.empty()) {
+            auto vm = own.queue.front();
+            own.queue.pop_front();
+            return vm;
+        }
+    }
+
+    // Steal from the back, the hart its owner will get to last
+    for (size_t i = 1; i < workers.size(); i++) {
+        auto& victim = *workers[(worker + i) % workers.size()];
+        std::lock_guard lock(victim.lock);
+
+        if (!victim.queue.empty()) {
+            auto vm = victim.queue.back();
+            victim.queue.pop_back();
+            return vm;
+        }
+    }
+
+    return nullptr;
+}
+
+void HartScheduler::Push(size_t worker, VirtualMachine* vm) {
+    auto& own = *workers[worker];
+    std::lock_guard lock(own.lock);
+    own.queue.push_back(vm);
+}
+
+void HartScheduler::Park(VirtualMachine* vm) {
+    std::lock_guard lock(parked_lock);
+    parked.push_back(vm);
+}
+
+bool HartScheduler::WakeParked(size_t worker) {
+    size_t woken = 0;
+
+    {
+        std::lock_guard lock(parked_lock);
+
+        for (size_t i = 0; i < parked.size();) {
+            auto vm = parked[i];
+
+            if (!vm->IsRunning()) Finish();
+            else if (vm->IsRunnable()) {
+                Push(worker, vm);
+                woken++;
+            }
+
+            else {
+                i++;
+                continue;
+            }
+
+            parked[i] = parked.back();
+            parked.pop_back();
+        }
+    }
+
+    // Let idle workers steal what just woke up
+    if (woken > 1) Notify();
+
+    return woken != 0;
+}
+
+void HartScheduler::Finish() {
+    if (++finished == harts.size())
+        Notify();
+}
+
+void HartScheduler::Work(size_t worker) {
+    if (options.pin_threads)
+        PinThread(worker);
+
+    Long rounds = 0;
+
+    while (!stopping && finished < harts.size()) {
+        bool poll_parked = options.park_idle && ++rounds % PARKED_POLL_PERIOD == 0;
+        if (wake_pending.exchange(false) || poll_parked)
+            WakeParked(worker);
+
+        auto vm = Take(worker);
+
+        if (!vm) {
+            if (WakeParked(worker)) continue;
+
+            std::unique_lock lock(idle_lock);
+            idle_signal.wait_for(lock, IDLE_WAIT, [this]() {
+                return stopping || wake_pending || finished == harts.size();
+            });
+
+            continue;
+        }
+
+        bool ran = false;
+
+        try {
+            ran = vm->RunQuantum(options.quantum);
+        }
+        catch (const std::exception& e) {
+            if (on_error) on_error(*vm, e);
+
+            vm->Stop();
+            Finish();
+            continue;
+        }
+
+        if (!vm->IsRunning())
+            Finish();
+
+        else if (ran || !options.park_idle)
+            Push(worker, vm);
+
+        else
+            Park(vm);
+    }
+}
+
+void HartScheduler::PinThread(size_t worker) {
+    auto cpus = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    auto cpu = worker % cpus;
+
+#if defined(_WIN32) || defined(_WIN64)
+    SetThreadAffinityMask(GetCurrentThread(), 1ULL << (cpu % 64));
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
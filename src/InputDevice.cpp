@@ -0,0 +1,119 @@
+#include "InputDevice.hpp"
+
+#include "CLINT.hpp"
+#include "PLIC.hpp"
+#include "VirtualMachine.hpp"
+
+MemoryInputDevice::MemoryInputDevice(Address base) : MemoryRegion(TYPE_INPUT, 0, base, SIZE, true, true) {}
+
+Long MemoryInputDevice::ReadLong(Address address) const {
+    auto current_tail = tail.load(std::memory_order_relaxed);
+    bool empty = head.load(std::memory_order_acquire) == current_tail;
+
+    switch (address) {
+        case EVENT_OFFSET:
+            return empty ? EVENT_NONE : queue[current_tail % QUEUE_SIZE].event;
+
+        case DATA_OFFSET:
+            return empty ? 0 : queue[current_tail % QUEUE_SIZE].data;
+
+        case COUNT_OFFSET:
+            return head.load(std::memory_order_acquire) - current_tail;
+
+        case DROPPED_OFFSET:
+            return dropped.load(std::memory_order_relaxed);
+
+        case INTERRUPT_HART_OFFSET:
+            return interrupt_hart.load();
+
+        case INTERRUPT_OFFSET:
+            return interrupt.load();
+    }
+
+    return 0;
+}
+
+// Every register fits in its low word
+Word MemoryInputDevice::ReadWord(Address address) const {
+    if (address & 4) return 0;
+
+    return static_cast<Word>(ReadLong(address));
+}
+
+void MemoryInputDevice::WriteLong(Address address, Long vlong) {
+    switch (address) {
+        case NEXT_OFFSET: {
+            std::lock_guard guard(consume_lock);
+
+            auto current_tail = tail.load(std::memory_order_relaxed);
+            if (head.load(std::memory_order_acquire) != current_tail)
+                tail.store(current_tail + 1, std::memory_order_release);
+
+            break;
+        }
+
+        case INTERRUPT_HART_OFFSET:
+            interrupt_hart = vlong;
+            break;
+
+        // An event pushed after the guest's last read keeps it raised
+        case INTERRUPT_OFFSET:
+            SetInterrupt(false);
+
+            if (head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed))
+                SetInterrupt(true);
+
+            break;
+    }
+}
+
+void MemoryInputDevice::WriteWord(Address address, Word word) {
+    if (address & 4) return;
+
+    WriteLong(address, word);
+}
+
+bool MemoryInputDevice::Push(Word event, Word data) {
+    auto current_head = head.load(std::memory_order_relaxed);
+
+    if (current_head - tail.load(std::memory_order_acquire) == QUEUE_SIZE) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    queue[current_head % QUEUE_SIZE] = {event, data};
+    head.store(current_head + 1, std::memory_order_release);
+
+    SetInterrupt(true);
+    return true;
+}
+
+bool MemoryInputDevice::PushKey(Word key, bool pressed) {
+    return Push(EVENT_KEY | (pressed ? EVENT_PRESSED : 0) | key << EVENT_CODE_SHIFT, 0);
+}
+
+bool MemoryInputDevice::PushButton(Word button, bool pressed) {
+    return Push(EVENT_BUTTON | (pressed ? EVENT_PRESSED : 0) | button << EVENT_CODE_SHIFT, 0);
+}
+
+bool MemoryInputDevice::PushMotion(Word x, Word y) {
+    return Push(EVENT_MOTION, (x & 0xffff) | (y & 0xffff) << 16);
+}
+
+void MemoryInputDevice::SetInterrupt(bool pending) {
+    interrupt = pending;
+
+    if (!memory) return;
+
+    if (auto plic = memory->FindMemoryRegionOfType<MemoryPLIC>(TYPE_PLIC)) {
+        plic->SetLevel(MemoryPLIC::SOURCE_INPUT, pending);
+        return;
+    }
+
+    auto clint = memory->FindMemoryRegionOfType<MemoryCLINT>(TYPE_CLINT);
+    if (clint) clint->SetInterruptPending(interrupt_hart, VirtualMachine::INTERRUPT_MACHINE_EXTERNAL, pending);
+}
+
+std::shared_ptr<MemoryInputDevice> MemoryInputDevice::Create(Address base) {
+    return std::shared_ptr<MemoryInputDevice>(new MemoryInputDevice(base));
+}
@@ -0,0 +1,23 @@
+#include "InstructionCache.hpp"
+
+InstructionCache::Page& InstructionCache::LoadPage(Address page_address) {
+    auto& page = pages[(page_address / PAGE_SIZE) % PAGE_COUNT];
+
+    if (!page)
+        page = std::make_unique<Page>();
+
+    memory.MarkCodePage(page_address);
+
+    page->tag = page_address;
+    page->version = memory.GetCodePageVersion(page_address);
+    page->decoded.reset();
+
+    return *page;
+}
+
+void InstructionCache::Invalidate() {
+    for (auto& page : pages) {
+        if (page)
+            page->decoded.reset();
+    }
+}
@@ -0,0 +1,196 @@
+#include "InstructionTrace.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <format>
+#include <stdexcept>
+
+static constexpr char TRACE_MAGIC[] = "RV64ITR1";
+static constexpr size_t TRACE_MAGIC_SIZE = sizeof(TRACE_MAGIC) - 1;
+
+static constexpr Byte FLAG_JUMP = 1 << 0;
+static constexpr Byte FLAG_RD = 1 << 1;
+static constexpr Byte FLAG_FRD = 1 << 2;
+static constexpr Byte FLAG_ADDRESS = 1 << 3;
+
+static void PutVarint(std::vector<Byte>& buffer, Long value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<Byte>(value) | 0x80);
+        value >>= 7;
+    }
+
+    buffer.push_back(static_cast<Byte>(value));
+}
+
+// Small negative deltas stay small
+static void PutDelta(std::vector<Byte>& buffer, Long delta) {
+    auto signed_delta = static_cast<SLong>(delta);
+    PutVarint(buffer, (delta << 1) ^ static_cast<Long>(signed_delta >> 63));
+}
+
+InstructionTraceWriter::InstructionTraceWriter(const std::string& path) : file{path, std::ios::binary} {
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+    }
+
+    file.write(TRACE_MAGIC, TRACE_MAGIC_SIZE);
+
+    buffer.reserve(BUFFER_SIZE);
+    writer = std::jthread([this]() { WriteBuffers(); });
+}
+
+InstructionTraceWriter::~InstructionTraceWriter() {
+    Flush();
+
+    {
+        std::lock_guard guard(pending_lock);
+        closing = true;
+    }
+
+    pending_signal.notify_one();
+    writer.join();
+}
+
+void InstructionTraceWriter::Record(const InstructionTraceRecord& record) {
+    Byte flags = 0;
+    if (record.pc != next_pc) flags |= FLAG_JUMP;
+    if (record.writes_rd) flags |= FLAG_RD;
+    if (record.writes_frd) flags |= FLAG_FRD;
+    if (record.has_address) flags |= FLAG_ADDRESS;
+
+    buffer.push_back(flags);
+
+    if (flags & FLAG_JUMP)
+        PutDelta(buffer, record.pc - next_pc);
+
+    auto length = RVInstruction::IsCompressed(record.raw) ? sizeof(Half) : sizeof(Word);
+    for (size_t i = 0; i < length; i++)
+        buffer.push_back(static_cast<Byte>(record.raw >> (i * 8)));
+
+    if (flags & (FLAG_RD | FLAG_FRD)) {
+        auto& last = (flags & FLAG_RD) ? last_regs[record.rd % 32] : last_fregs[record.rd % 32];
+
+        buffer.push_back(record.rd);
+        PutDelta(buffer, record.rd_value - last);
+        last = record.rd_value;
+    }
+
+    if (flags & FLAG_ADDRESS) {
+        PutDelta(buffer, record.address - last_address);
+        last_address = record.address;
+    }
+
+    next_pc = record.pc + length;
+
+    if (buffer.size() >= BUFFER_SIZE)
+        Flush();
+}
+
+void InstructionTraceWriter::Flush() {
+    if (buffer.empty()) return;
+
+    std::vector<Byte> full;
+    full.reserve(BUFFER_SIZE);
+    full.swap(buffer);
+
+    {
+        std::lock_guard guard(pending_lock);
+        pending.push_back(std::move(full));
+    }
+
+    pending_signal.notify_one();
+}
+
+void InstructionTraceWriter::WriteBuffers() {
+    std::unique_lock lock(pending_lock);
+
+    while (true) {
+        pending_signal.wait(lock, [this] { return closing || !pending.empty(); });
+
+        while (!pending.empty()) {
+            auto next = std::move(pending.front());
+            pending.pop_front();
+
+            lock.unlock();
+            file.write(reinterpret_cast<const char*>(next.data()), next.size());
+            lock.lock();
+        }
+
+        if (closing) break;
+    }
+
+    file.flush();
+}
+
+InstructionTraceReader::InstructionTraceReader(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Could not open {} for reading", path));
+    }
+
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    if (data.size() < TRACE_MAGIC_SIZE || !std::equal(TRACE_MAGIC, TRACE_MAGIC + TRACE_MAGIC_SIZE, data.begin())) {
+        throw std::runtime_error(std::format("{} is not an instruction trace", path));
+    }
+
+    position = TRACE_MAGIC_SIZE;
+}
+
+bool InstructionTraceReader::Next(InstructionTraceRecord& record) {
+    if (position >= data.size()) return false;
+
+    auto GetByte = [&]() {
+        if (position >= data.size())
+            throw std::runtime_error("Instruction trace ends mid record");
+
+        return data[position++];
+    };
+
+    auto GetDelta = [&]() {
+        Long value = 0;
+
+        for (Long shift = 0; ; shift += 7) {
+            auto byte = GetByte();
+            value |= static_cast<Long>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+        }
+
+        return (value >> 1) ^ (0 - (value & 1));
+    };
+
+    auto flags = GetByte();
+
+    record = {};
+    record.pc = next_pc;
+
+    if (flags & FLAG_JUMP)
+        record.pc += GetDelta();
+
+    for (size_t i = 0; i < sizeof(Half); i++)
+        record.raw |= static_cast<Word>(GetByte()) << (i * 8);
+
+    auto length = RVInstruction::IsCompressed(record.raw) ? sizeof(Half) : sizeof(Word);
+    for (size_t i = sizeof(Half); i < length; i++)
+        record.raw |= static_cast<Word>(GetByte()) << (i * 8);
+
+    if (flags & (FLAG_RD | FLAG_FRD)) {
+        record.rd = GetByte();
+        record.writes_rd = flags & FLAG_RD;
+        record.writes_frd = flags & FLAG_FRD;
+
+        auto& last = record.writes_rd ? last_regs[record.rd % 32] : last_fregs[record.rd % 32];
+        record.rd_value = last + GetDelta();
+        last = record.rd_value;
+    }
+
+    if (flags & FLAG_ADDRESS) {
+        record.has_address = true;
+        record.address = last_address + GetDelta();
+        last_address = record.address;
+    }
+
+    next_pc = record.pc + length;
+    return true;
+}
@@ -0,0 +1,472 @@
+#include "JIT.hpp"
+
+#include <cstring>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X86_64
+#endif
+
+namespace {
+    // Host registers. The guest register file lives in r8 and the block's pc in r9;
+    // only caller-saved registers are touched so no prologue spills are needed.
+    constexpr Byte RAX = 0;
+    constexpr Byte RCX = 1;
+    constexpr Byte RDX = 2;
+
+    // The JIT only targets x86-64
+    constexpr uintptr_t HOST_PAGE = 4096;
+
+    // Code pages are writable or executable, never both. Only the pages a
+    // block lands on are flipped
+    bool Protect(Byte* start, size_t bytes, bool executable) {
+#if defined(_WIN32) || defined(_WIN64)
+        DWORD previous;
+        return VirtualProtect(start, bytes, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previous);
+#else
+        auto page = reinterpret_cast<uintptr_t>(start) & ~(HOST_PAGE - 1);
+        bytes += reinterpret_cast<uintptr_t>(start) - page;
+        return mprotect(reinterpret_cast<void*>(page), bytes, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) == 0;
+#endif
+    }
+}
+
+JIT::JIT() {
+    if (!IsHostSupported()) return;
+
+#if defined(_WIN32) || defined(_WIN64)
+    code = static_cast<Byte*>(VirtualAlloc(nullptr, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+    void* mapping = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    code = mapping == MAP_FAILED ? nullptr : static_cast<Byte*>(mapping);
+#endif
+}
+
+JIT::JIT(JIT&& jit) : code{jit.code}, used{jit.used} {
+    jit.code = nullptr;
+    jit.used = 0;
+}
+
+JIT::~JIT() {
+    if (!code) return;
+
+#if defined(_WIN32) || defined(_WIN64)
+    VirtualFree(code, 0, MEM_RELEASE);
+#else
+    munmap(code, CODE_SIZE);
+#endif
+}
+
+JIT& JIT::operator=(JIT&& jit) {
+    std::swap(code, jit.code);
+    std::swap(used, jit.used);
+    return *this;
+}
+
+bool JIT::IsHostSupported() {
+#ifdef JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool JIT::CanCompile(const RVInstruction& instr) {
+    using Type = RVInstruction::Type;
+
+    switch (instr.type) {
+        case Type::LUI:
+        case Type::AUIPC:
+        case Type::ADDI:
+        case Type::SLTI:
+        case Type::SLTIU:
+        case Type::XORI:
+        case Type::ORI:
+        case Type::ANDI:
+        case Type::SLLI:
+        case Type::SRLI:
+        case Type::ADD:
+        case Type::SUB:
+        case Type::SLL:
+        case Type::SLT:
+        case Type::SLTU:
+        case Type::XOR:
+        case Type::SRL:
+        case Type::OR:
+        case Type::AND:
+        case Type::MUL:
+        case Type::DIV:
+        case Type::DIVU:
+        case Type::REM:
+        case Type::REMU:
+            return true;
+
+        // The W forms write rd unconditionally in the interpreter, so only
+        // compile them when that cannot clobber x0
+        case Type::ADDIW:
+        case Type::SLLIW:
+        case Type::SRLIW:
+        case Type::ADDW:
+        case Type::SUBW:
+        case Type::SLLW:
+        case Type::MULW:
+        case Type::DIVW:
+        case Type::DIVUW:
+        case Type::REMW:
+        case Type::REMUW:
+            return instr.rd != 0;
+
+        // None of these can trap either, but the interpreter's shifts differ
+        // from the spec in places: SRA, SRAI, SRAW and SRAIW fill with ones
+        // on a zero shift, and SRLW shifts all 64 bits. The JIT has to match
+        // it, so they wait until it's fixed. The high multiplies are left to
+        // the interpreter
+        default:
+            return false;
+    }
+}
+
+void JIT::Emit(std::initializer_list<Byte> bytes) {
+    buffer.insert(buffer.end(), bytes);
+}
+
+void JIT::EmitWord(Word value) {
+    for (size_t i = 0; i < sizeof(Word); i++)
+        buffer.push_back(static_cast<Byte>(value >> (i * 8)));
+}
+
+void JIT::EmitLong(Long value) {
+    for (size_t i = 0; i < sizeof(Long); i++)
+        buffer.push_back(static_cast<Byte>(value >> (i * 8)));
+}
+
+void JIT::EmitLoad(Byte host_reg, Byte guest_reg) {
+    // mov host_reg, [r8 + guest_reg * 8]
+    Emit({0x49, 0x8b, static_cast<Byte>(0x80 | (host_reg << 3))});
+    EmitWord(guest_reg * sizeof(Long));
+}
+
+void JIT::EmitStore(Byte guest_reg, Byte host_reg) {
+    // mov [r8 + guest_reg * 8], host_reg
+    Emit({0x49, 0x89, static_cast<Byte>(0x80 | (host_reg << 3))});
+    EmitWord(guest_reg * sizeof(Long));
+}
+
+void JIT::EmitLoadImmediate(Byte host_reg, Long value) {
+    // mov host_reg, imm64
+    Emit({0x48, static_cast<Byte>(0xb8 + host_reg)});
+    EmitLong(value);
+}
+
+bool JIT::EmitInstruction(const RVInstruction& instr, Long offset) {
+    using Type = RVInstruction::Type;
+
+    if (instr.rd == 0) return true;
+
+    auto ImmediateOp = [&](Byte op) {
+        EmitLoad(RAX, instr.rs1);
+        EmitLoadImmediate(RCX, instr.immediate);
+        Emit({0x48, op, 0xc8});
+    };
+
+    auto RegisterOp = [&](Byte op) {
+        EmitLoad(RAX, instr.rs1);
+        EmitLoad(RCX, instr.rs2);
+        Emit({0x48, op, 0xc8});
+    };
+
+    auto SetCondition = [&](Byte condition) {
+        // cmp rax, rcx; setcc al; movzx eax, al
+        Emit({0x48, 0x39, 0xc8});
+        Emit({0x0f, condition, 0xc0});
+        Emit({0x0f, 0xb6, 0xc0});
+    };
+
+    auto SignExtendWord = [&]() {
+        // movsxd rax, eax
+        Emit({0x48, 0x63, 0xc0});
+    };
+
+    // rax / rcx into rax. A zero divisor gives -1, and with check_overflow
+    // one of -1 negates, so the most negative value wraps as RISC-V defines
+    // instead of faulting the host. Jumps skip the bytes counted after them
+    // A zero divisor gives all ones, or leaves the dividend as the
+    // remainder. Over -1 the quotient is the negated dividend and the
+    // remainder 0, which keeps idiv off the one division it faults on
+    auto Divide = [&](bool is_signed, bool check_overflow, bool remainder) {
+        Byte overflow = remainder ? 2 : 3;
+        Byte divide = remainder ? 8 : 5;
+        Byte zero = remainder ? 0 : 9;
+        Byte checks = check_overflow ? 4 + 2 + overflow + 2 : 0;
+
+        // test rcx, rcx; jz zero
+        Emit({0x48, 0x85, 0xc9});
+        Emit({0x74, static_cast<Byte>(checks + divide + (remainder ? 0 : 2))});
+
+        if (check_overflow) {
+            // cmp rcx, -1; jne divide; xor eax, eax or neg rax; jmp done
+            Emit({0x48, 0x83, 0xf9, 0xff});
+            Emit({0x75, static_cast<Byte>(overflow + 2)});
+
+            if (remainder)
+                Emit({0x31, 0xc0});
+            else
+                Emit({0x48, 0xf7, 0xd8});
+
+            Emit({0xeb, static_cast<Byte>(divide + zero)});
+        }
+
+        // cqo; idiv rcx, or xor edx, edx; div rcx
+        if (is_signed)
+            Emit({0x48, 0x99, 0x48, 0xf7, 0xf9});
+        else
+            Emit({0x31, 0xd2, 0x48, 0xf7, 0xf1});
+
+        if (remainder) {
+            // mov rax, rdx
+            Emit({0x48, 0x89, 0xd0});
+        }
+        else {
+            // jmp done; zero: mov rax, -1
+            Emit({0xeb, 7});
+            Emit({0x48, 0xc7, 0xc0, 0xff, 0xff, 0xff, 0xff});
+        }
+    };
+
+    constexpr Byte OP_ADD = 0x01;
+    constexpr Byte OP_OR = 0x09;
+    constexpr Byte OP_AND = 0x21;
+    constexpr Byte OP_SUB = 0x29;
+    constexpr Byte OP_XOR = 0x31;
+
+    constexpr Byte SETL = 0x9c;
+    constexpr Byte SETB = 0x92;
+
+    switch (instr.type) {
+        case Type::LUI:
+            EmitLoadImmediate(RAX, instr.immediate);
+            break;
+
+        case Type::AUIPC:
+            // mov rax, r9
+            Emit({0x4c, 0x89, 0xc8});
+            EmitLoadImmediate(RCX, offset + instr.immediate);
+            Emit({0x48, OP_ADD, 0xc8});
+            break;
+
+        case Type::ADDI: ImmediateOp(OP_ADD); break;
+        case Type::XORI: ImmediateOp(OP_XOR); break;
+        case Type::ORI: ImmediateOp(OP_OR); break;
+        case Type::ANDI: ImmediateOp(OP_AND); break;
+
+        case Type::SLTI:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoadImmediate(RCX, instr.immediate);
+            SetCondition(SETL);
+            break;
+
+        case Type::SLTIU:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoadImmediate(RCX, instr.immediate);
+            SetCondition(SETB);
+            break;
+
+        case Type::SLLI:
+            // shl rax, imm8
+            EmitLoad(RAX, instr.rs1);
+            Emit({0x48, 0xc1, 0xe0, static_cast<Byte>(instr.immediate & 0b111111)});
+            break;
+
+        case Type::SRLI:
+            // shr rax, imm8
+            EmitLoad(RAX, instr.rs1);
+            Emit({0x48, 0xc1, 0xe8, static_cast<Byte>(instr.immediate & 0b111111)});
+            break;
+
+        case Type::ADD: RegisterOp(OP_ADD); break;
+        case Type::SUB: RegisterOp(OP_SUB); break;
+        case Type::XOR: RegisterOp(OP_XOR); break;
+        case Type::OR: RegisterOp(OP_OR); break;
+        case Type::AND: RegisterOp(OP_AND); break;
+
+        case Type::SLT:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            SetCondition(SETL);
+            break;
+
+        case Type::SLTU:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            SetCondition(SETB);
+            break;
+
+        case Type::SLL:
+            // shl rax, cl
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Emit({0x48, 0xd3, 0xe0});
+            break;
+
+        case Type::SRL:
+            // shr rax, cl
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Emit({0x48, 0xd3, 0xe8});
+            break;
+
+        case Type::MUL:
+            // imul rax, rcx
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Emit({0x48, 0x0f, 0xaf, 0xc1});
+            break;
+
+        case Type::DIV:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Divide(true, true, false);
+            break;
+
+        case Type::DIVU:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Divide(false, false, false);
+            break;
+
+        case Type::REM:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Divide(true, true, true);
+            break;
+
+        case Type::REMU:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Divide(false, false, true);
+            break;
+
+        case Type::ADDIW:
+            ImmediateOp(OP_ADD);
+            SignExtendWord();
+            break;
+
+        case Type::SLLIW:
+            EmitLoad(RAX, instr.rs1);
+            Emit({0x48, 0xc1, 0xe0, static_cast<Byte>(instr.immediate & 0b111111)});
+            SignExtendWord();
+            break;
+
+        case Type::SRLIW:
+            // mov eax, eax; shr rax, imm8
+            EmitLoad(RAX, instr.rs1);
+            Emit({0x89, 0xc0});
+            Emit({0x48, 0xc1, 0xe8, static_cast<Byte>(instr.immediate & 0b111111)});
+            SignExtendWord();
+            break;
+
+        case Type::ADDW:
+            RegisterOp(OP_ADD);
+            SignExtendWord();
+            break;
+
+        case Type::SUBW:
+            RegisterOp(OP_SUB);
+            SignExtendWord();
+            break;
+
+        case Type::SLLW:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Emit({0x48, 0xd3, 0xe0});
+            SignExtendWord();
+            break;
+
+        case Type::MULW:
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Emit({0x48, 0x0f, 0xaf, 0xc1});
+            SignExtendWord();
+            break;
+
+        case Type::DIVW:
+        case Type::REMW:
+            // movsxd rax, eax; movsxd rcx, ecx. Divided in 64 bits, so the
+            // most negative word over -1 can't overflow
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Emit({0x48, 0x63, 0xc0});
+            Emit({0x48, 0x63, 0xc9});
+            Divide(true, false, instr.type == Type::REMW);
+            SignExtendWord();
+            break;
+
+        case Type::DIVUW:
+        case Type::REMUW:
+            // mov eax, eax; mov ecx, ecx
+            EmitLoad(RAX, instr.rs1);
+            EmitLoad(RCX, instr.rs2);
+            Emit({0x89, 0xc0});
+            Emit({0x89, 0xc9});
+            Divide(false, false, instr.type == Type::REMUW);
+            SignExtendWord();
+            break;
+
+        default:
+            return false;
+    }
+
+    EmitStore(instr.rd, RAX);
+    return true;
+}
+
+JIT::Block JIT::Compile(const std::vector<RVInstruction>& instructions, size_t count) {
+    if (!code || count == 0 || count > instructions.size()) return nullptr;
+
+    buffer.clear();
+
+#if defined(_WIN32) || defined(_WIN64)
+    // mov r8, rcx; mov r9, rdx
+    Emit({0x49, 0x89, 0xc8});
+    Emit({0x49, 0x89, 0xd1});
+#else
+    // mov r8, rdi; mov r9, rsi
+    Emit({0x49, 0x89, 0xf8});
+    Emit({0x49, 0x89, 0xf1});
+#endif
+
+    Long offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!EmitInstruction(instructions[i], offset))
+            return nullptr;
+
+        offset += instructions[i].size;
+    }
+
+    // ret
+    Emit({0xc3});
+
+    if (used + buffer.size() > CODE_SIZE) {
+        used = CODE_SIZE;
+        return nullptr;
+    }
+
+    Byte* start = code + used;
+    if (!Protect(start, buffer.size(), false)) return nullptr;
+
+    std::memcpy(start, buffer.data(), buffer.size());
+    if (!Protect(start, buffer.size(), true)) return nullptr;
+
+    used += (buffer.size() + 15) & ~15;
+
+    return reinterpret_cast<Block>(start);
+}
+
+void JIT::Reset() {
+    used = 0;
+}
@@ -0,0 +1,117 @@
+#include "LockstepScheduler.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+LockstepScheduler::LockstepScheduler(Memory& memory, const std::vector<VirtualMachine*>& harts, const Options& options, ErrorHandler on_error) : harts{harts}, options{options}, on_error{std::move(on_error)}, clint{memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT)}, random{options.seed}, order{harts} {
+    if (!clint)
+        throw std::runtime_error("Lockstep runs need a CLINT to count time");
+
+    if (options.quantum == 0)
+        throw std::runtime_error("Lockstep quantum must be at least one instruction");
+
+    clint->SetClockSource(MemoryCLINT::ClockSource::Instructions);
+}
+
+LockstepScheduler::~LockstepScheduler() {
+    Stop();
+}
+
+void LockstepScheduler::Start() {
+    if (options.mode == Mode::RoundRobin) {
+        threads.emplace_back([this]() { RunRounds(); });
+        return;
+    }
+
+    size_t count = options.threads;
+    if (count == 0) count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    count = std::clamp<size_t>(count, 1, std::max<size_t>(harts.size(), 1));
+
+    epoch_threads = count;
+    clint->SetDeferRetire(true);
+    barrier = std::make_unique<std::barrier<EpochEnd>>(count, EpochEnd{this});
+
+    for (size_t i = 0; i < count; i++)
+        threads.emplace_back([this, i]() { RunEpochs(i); });
+}
+
+void LockstepScheduler::Wait() {
+    threads.clear();
+    clint->SetDeferRetire(false);
+}
+
+void LockstepScheduler::Stop() {
+    stopping = true;
+    Wait();
+}
+
+bool LockstepScheduler::RunHart(VirtualMachine* vm) {
+    try {
+        return vm->RunQuantum(options.quantum, false);
+    }
+    catch (const std::exception& e) {
+        if (on_error) on_error(*vm, e);
+
+        vm->Stop();
+        return false;
+    }
+}
+
+// Decides whether to keep going once every hart had its turn, and moves
+// time along when nothing could run
+bool LockstepScheduler::EndRound(bool ran) {
+    rounds++;
+
+    if (stopping) return false;
+    if (std::none_of(harts.begin(), harts.end(), [](auto vm) { return vm->IsRunning(); })) return false;
+    if (ran) return true;
+
+    // Everyone asleep, so the earliest deadline is the next thing to happen
+    VirtualMachine* next = nullptr;
+    for (auto vm : harts) {
+        if (!vm->IsRunning() || vm->IsPaused()) continue;
+
+        auto time_cmp = clint->GetTimeCmp(vm->GetHartID());
+        if (time_cmp == MemoryCLINT::NO_DEADLINE) continue;
+
+        if (!next || time_cmp < clint->GetTimeCmp(next->GetHartID()))
+            next = vm;
+    }
+
+    if (next) clint->SkipToDeadline(next->GetHartID());
+    else std::this_thread::sleep_for(IDLE_WAIT);
+
+    return true;
+}
+
+void LockstepScheduler::RunRounds() {
+    do {
+        std::shuffle(order.begin(), order.end(), random);
+
+        bool ran = false;
+        for (auto vm : order)
+            ran |= RunHart(vm);
+
+        if (!EndRound(ran)) break;
+    } while (true);
+}
+
+void LockstepScheduler::EndEpoch() {
+    clint->PublishRetired();
+
+    if (!EndRound(ran.exchange(false)))
+        done = true;
+}
+
+void LockstepScheduler::RunEpochs(size_t thread) {
+    while (!done) {
+        // Harts stay on the same thread, which keeps their host caches warm
+        for (size_t i = thread; i < harts.size(); i += epoch_threads) {
+            if (RunHart(harts[i]))
+                ran = true;
+        }
+
+        barrier->arrive_and_wait();
+    }
+}
@@ -3,6 +3,24 @@
 #include <stdexcept>
 #include <format>
 #include <fstream>
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 Word MemoryRegion::ReadWord(Address address) const {
     auto vlong = ReadLong(address & ~7);
@@ -43,33 +61,604 @@ void MemoryRegion::WriteByte(Address address, Byte byte) {
     WriteLong(address & ~3, vlong);
 }
 
+DirtyPages::DirtyPages(Address size) : pages_count{(size + PAGE_SIZE - 1) / PAGE_SIZE}, bits{new std::atomic<Long>[(pages_count + 63) / 64]} {
+    for (size_t i = 0; i < (pages_count + 63) / 64; i++)
+        bits[i].store(0, std::memory_order_relaxed);
+}
+
+void DirtyPages::MarkAll() {
+    for (size_t i = 0; i * 64 < pages_count; i++) {
+        auto remaining = pages_count - i * 64;
+        bits[i].fetch_or(remaining >= 64 ? ~0ULL : (1ULL << remaining) - 1, std::memory_order_release);
+    }
+}
+
+void DirtyPages::ClearAll() {
+    for (size_t i = 0; i * 64 < pages_count; i++)
+        bits[i].store(0, std::memory_order_release);
+}
+
+void DirtyPages::CopyFrom(const DirtyPages& other) {
+    for (size_t i = 0; i * 64 < std::min(pages_count, other.pages_count); i++)
+        bits[i].store(other.bits[i].load(std::memory_order_acquire), std::memory_order_release);
+}
+
+std::vector<DirtyPages::Range> DirtyPages::CollectRanges(Address offset, Address bytes, bool take) const {
+    std::vector<Range> ranges;
+    if (bytes == 0) return ranges;
+
+    size_t first = offset / PAGE_SIZE;
+    size_t last = std::min<size_t>(pages_count, (offset + bytes + PAGE_SIZE - 1) / PAGE_SIZE);
+
+    for (size_t word = first / 64; word * 64 < last; word++) {
+        Long mask = ~0ULL;
+        if (word == first / 64) mask &= ~0ULL << (first % 64);
+        if (word == (last - 1) / 64 && last % 64) mask &= (1ULL << (last % 64)) - 1;
+
+        // Clean words are skipped without touching their cache line exclusively
+        Long set = bits[word].load(std::memory_order_acquire) & mask;
+        if (set && take)
+            set = bits[word].fetch_and(~mask, std::memory_order_acq_rel) & mask;
+
+        while (set) {
+            Address start = (word * 64 + std::countr_zero(set)) * PAGE_SIZE;
+            set &= set - 1;
+
+            if (!ranges.empty() && ranges.back().second == start)
+                ranges.back().second += PAGE_SIZE;
+            else
+                ranges.push_back({start, start + PAGE_SIZE});
+        }
+    }
+
+    return ranges;
+}
+
+std::vector<DirtyPages::Range> DirtyPages::Peek(Address offset, Address bytes) const {
+    return CollectRanges(offset, bytes, false);
+}
+
+std::vector<DirtyPages::Range> DirtyPages::Take(Address offset, Address bytes) {
+    return CollectRanges(offset, bytes, true);
+}
+
 std::unique_ptr<MemoryROM> MemoryROM::Create(const std::vector<Long>& longs, Address base) {
     return std::unique_ptr<MemoryROM>(new MemoryROM(longs, base & ~7));
 }
 
-MemoryRAM::MemoryRAM(Address base, Address size) : MemoryRegion(TYPE_GENERAL_RAM, 0, base, size, true, true) {
-    size_t pages_count = size / LONGS_PER_PAGE;
+MemoryRAM::MemoryRAM(Address base, Address size) : MemoryRegion(TYPE_GENERAL_RAM, 0, base, size, true, true), pages_count{size / PAGE_SIZE}, leaves_count{(pages_count + LEAF_PAGES - 1) / LEAF_PAGES}, leaves{new std::atomic<Leaf*>[leaves_count]}, dirty{size}, written{size}, referenced{size} {
+    for (size_t i = 0; i < leaves_count; i++)
+        leaves[i].store(nullptr, std::memory_order_relaxed);
+}
+
+MemoryRAM::~MemoryRAM() {
+    for (size_t leaf = 0; leaf < leaves_count; leaf++) {
+        auto pages = leaves[leaf].load(std::memory_order_relaxed);
+        if (!pages) continue;
 
-    for (size_t i = 0; i < pages_count; i++)
-        pages.push_back(nullptr);
+        for (auto& page : *pages)
+            delete page.load(std::memory_order_relaxed);
+
+        delete pages;
+    }
 }
 
-Long MemoryRAM::ReadLong(Address address) const {
-    size_t page = address / LONGS_PER_PAGE;
-    address %= PAGE_SIZE;
+MemoryRAM::Leaf& MemoryRAM::LoadLeaf(size_t leaf) const {
+    auto new_leaf = new Leaf;
+    for (auto& page : *new_leaf)
+        page.store(nullptr, std::memory_order_relaxed);
+
+    Leaf* expected = nullptr;
+    if (leaves[leaf].compare_exchange_strong(expected, new_leaf, std::memory_order_acq_rel, std::memory_order_acquire))
+        return *new_leaf;
+
+    delete new_leaf;
+    return *expected;
+}
+
+MemoryRAM::Page& MemoryRAM::LoadPage(size_t page) const {
+    // Packed pages are never shared, so nothing else could fill them in
+    if (packed_pages.load(std::memory_order_acquire) != 0) {
+        if (auto restored = UnpackPage(page)) return *restored;
+    }
+
+    auto leaf = leaves[page / LEAF_PAGES].load(std::memory_order_acquire);
+    auto& slot = (leaf ? *leaf : LoadLeaf(page / LEAF_PAGES))[page % LEAF_PAGES];
+
+    auto shared_page = GetSharedPage(page);
+    auto new_page = shared_page ? new Page{*shared_page} : new Page{};
+
+    Page* expected = nullptr;
+    if (slot.compare_exchange_strong(expected, new_page, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        loaded_pages.fetch_add(1, std::memory_order_relaxed);
+
+        // Harts reading the shared page must move to the copy
+        if (shared_page && host_page_generation)
+            host_page_generation->fetch_add(1);
+
+        return *new_page;
+    }
+
+    // Another hart installed the page first
+    delete new_page;
+    return *expected;
+}
 
-    EnsurePageIsLoaded(page);
+Long MemoryRAM::ReadLong(Address address) const {
+    auto& page = GetReadablePage(address / PAGE_SIZE);
 
-    return (*pages[page])[address >> 3];
+    return page[(address % PAGE_SIZE) >> 3];
 }
 
 void MemoryRAM::WriteLong(Address address, Long vlong) {
-    size_t page = address / LONGS_PER_PAGE;
-    address %= PAGE_SIZE;
+    auto& page = EnsurePageIsLoaded(address / PAGE_SIZE);
+
+    page[(address % PAGE_SIZE) >> 3] = vlong;
+    dirty.Mark(address);
+    written.Mark(address);
+}
+
+bool MemoryRAM::ReadBytes(Address address, Byte* bytes, Address count) const {
+    for (Address done = 0; done < count;) {
+        Address at = address + done;
+        Address chunk = std::min<Address>(count - done, PAGE_SIZE - at % PAGE_SIZE);
+
+        auto page = at / PAGE_SIZE;
+        const Page* source = FindPage(page);
+        if (!source) source = GetSharedPage(page);
+
+        // Packed pages are read from a copy and stay packed
+        Page scratch;
+        if (!source && packed_pages.load(std::memory_order_acquire) != 0 && CopyPackedPage(page, scratch))
+            source = &scratch;
+
+        if (source)
+            std::memcpy(bytes + done, reinterpret_cast<const Byte*>(source->data()) + at % PAGE_SIZE, chunk);
+        else
+            std::memset(bytes + done, 0, chunk);
+
+        done += chunk;
+    }
+
+    return true;
+}
+
+void MemoryRAM::Prefault(Address address, Address bytes) {
+    if (address >= size) return;
+
+    Address end = std::min(address + bytes, size);
+
+    for (size_t page = address / PAGE_SIZE; page * PAGE_SIZE < end; page++) {
+        if (!GetSharedPage(page))
+            EnsurePageIsLoaded(page);
+    }
+}
+
+std::vector<Address> MemoryRAM::GetSavedPages() const {
+    std::vector<Address> saved;
+
+    // Only leaves either side holds can have pages in them
+    for (size_t leaf = 0; leaf < leaves_count; leaf++) {
+        if (!leaves[leaf].load(std::memory_order_acquire) && !(shared && shared->leaves[leaf])) continue;
+
+        for (size_t page = leaf * LEAF_PAGES; page < std::min(pages_count, (leaf + 1) * LEAF_PAGES); page++) {
+            if (FindPage(page) || GetSharedPage(page))
+                saved.push_back(page * PAGE_SIZE);
+        }
+    }
+
+    // Packed pages can sit under leaves a reclaim has since dropped
+    if (packed_pages.load(std::memory_order_acquire) != 0) {
+        std::lock_guard guard(packed_lock);
+        for (auto& [page, bytes] : packed)
+            saved.push_back(page * PAGE_SIZE);
+
+        std::sort(saved.begin(), saved.end());
+    }
+
+    return saved;
+}
+
+void MemoryRAM::DiscardPages() {
+    for (size_t leaf = 0; leaf < leaves_count; leaf++) {
+        auto pages = leaves[leaf].exchange(nullptr, std::memory_order_acq_rel);
+        if (!pages) continue;
+
+        for (auto& page : *pages)
+            delete page.load(std::memory_order_relaxed);
+
+        delete pages;
+    }
+
+    loaded_pages = 0;
+    shared.reset();
+
+    FreeRetired();
+
+    {
+        std::lock_guard guard(packed_lock);
+        packed.clear();
+        packed_pages = 0;
+        packed_bytes = 0;
+    }
+
+    // Anything that was nonzero has changed
+    dirty.MarkAll();
+    written.ClearAll();
+}
+
+void MemoryRAM::RetirePage(Page* page) {
+    std::lock_guard guard(retired_lock);
+    retired.emplace_back(page);
+}
+
+void MemoryRAM::FreeRetired() {
+    std::lock_guard guard(retired_lock);
+    retired.clear();
+    retired_leaves.clear();
+}
+
+// An OR across the page the compiler vectorizes, it only stops at the end
+static bool IsZeroPage(const Long* longs, size_t count) {
+    Long any = 0;
+    for (size_t i = 0; i < count; i++)
+        any |= longs[i];
+
+    return any == 0;
+}
+
+Address MemoryRAM::ReleasePages(Address offset, Address bytes) {
+    if (offset >= size) return 0;
+
+    size_t page = (offset + PAGE_SIZE - 1) / PAGE_SIZE;
+    size_t end = std::min(offset + bytes, size) / PAGE_SIZE;
+    Address released = 0;
+
+    // Nothing points into packed pages, so they just go
+    if (packed_pages.load(std::memory_order_acquire) != 0) {
+        std::lock_guard guard(packed_lock);
+
+        std::erase_if(packed, [&](const auto& entry) {
+            if (entry.first < page || entry.first >= end) return false;
+
+            packed_bytes.fetch_sub(entry.second.size(), std::memory_order_relaxed);
+            packed_pages.fetch_sub(1, std::memory_order_release);
+            dirty.Mark(entry.first * PAGE_SIZE);
+            released += entry.second.size();
+            return true;
+        });
+    }
+
+    while (page < end) {
+        auto leaf = leaves[page / LEAF_PAGES].load(std::memory_order_acquire);
+        if (!leaf) {
+            page = (page / LEAF_PAGES + 1) * LEAF_PAGES;
+            continue;
+        }
+
+        // Harts may still be using the page through a host pointer, so it
+        // lives on until nothing runs
+        if (auto loaded = (*leaf)[page % LEAF_PAGES].exchange(nullptr, std::memory_order_acq_rel)) {
+            RetirePage(loaded);
+
+            loaded_pages.fetch_sub(1, std::memory_order_relaxed);
+            dirty.Mark(page * PAGE_SIZE);
+            released += PAGE_SIZE;
+        }
+
+        page++;
+    }
+
+    if (released && host_page_generation)
+        host_page_generation->fetch_add(1);
+
+    return released;
+}
+
+Address MemoryRAM::ReclaimZeroPages() {
+    Address reclaimed = 0;
+
+    for (size_t leaf = 0; leaf < leaves_count; leaf++) {
+        auto pages = leaves[leaf].load(std::memory_order_acquire);
+        if (!pages) continue;
+
+        bool empty = true;
+
+        for (size_t i = 0; i < LEAF_PAGES; i++) {
+            auto loaded = (*pages)[i].load(std::memory_order_relaxed);
+            if (!loaded) continue;
+
+            // Dropping a copy would bring back the shared page under it
+            if (GetSharedPage(leaf * LEAF_PAGES + i) || !IsZeroPage(loaded->data(), LONGS_PER_PAGE)) {
+                empty = false;
+                continue;
+            }
+
+            (*pages)[i].store(nullptr, std::memory_order_relaxed);
+            RetirePage(loaded);
+
+            loaded_pages.fetch_sub(1, std::memory_order_relaxed);
+            reclaimed += PAGE_SIZE;
+        }
+
+        if (empty) {
+            leaves[leaf].store(nullptr, std::memory_order_release);
+
+            std::lock_guard guard(retired_lock);
+            retired_leaves.emplace_back(pages);
+        }
+    }
+
+    FreeRetired();
+
+    if (reclaimed && host_page_generation)
+        host_page_generation->fetch_add(1);
+
+    return reclaimed;
+}
+
+// Pages pack a word at a time. Two bits per word say whether it's zero,
+// repeats the word before it, shares that word's upper half or is kept
+// whole. The tags come first, then the halves and words that were kept
+static constexpr size_t PACKED_TAG_BYTES = MemoryRAM::LONGS_PER_PAGE / 4;
+
+static bool PackLongs(const Long* longs, std::vector<Byte>& out) {
+    out.assign(PACKED_TAG_BYTES, 0);
+    Long previous = 0;
+
+    for (size_t i = 0; i < MemoryRAM::LONGS_PER_PAGE; i++) {
+        Long vlong = longs[i];
+        Byte tag = 0;
+
+        if (vlong == 0) tag = 0;
+        else if (vlong == previous) tag = 1;
+        else if ((vlong >> 32) == (previous >> 32)) {
+            tag = 2;
+
+            Word low = static_cast<Word>(vlong);
+            out.insert(out.end(), reinterpret_cast<const Byte*>(&low), reinterpret_cast<const Byte*>(&low) + sizeof(Word));
+        }
+        else {
+            tag = 3;
+            out.insert(out.end(), reinterpret_cast<const Byte*>(&vlong), reinterpret_cast<const Byte*>(&vlong) + sizeof(Long));
+        }
+
+        // Not worth keeping, so stop early
+        if (out.size() > MemoryRAM::PACKED_LIMIT) return false;
+
+        out[i / 4] |= tag << ((i % 4) * 2);
+        previous = vlong;
+    }
+
+    return true;
+}
+
+static void UnpackLongs(const std::vector<Byte>& in, Long* longs) {
+    size_t at = PACKED_TAG_BYTES;
+    Long previous = 0;
+
+    for (size_t i = 0; i < MemoryRAM::LONGS_PER_PAGE; i++) {
+        Long vlong = 0;
+
+        switch ((in[i / 4] >> ((i % 4) * 2)) & 0b11) {
+            case 1:
+                vlong = previous;
+                break;
+
+            case 2: {
+                Word low;
+                std::memcpy(&low, in.data() + at, sizeof(Word));
+                at += sizeof(Word);
+
+                vlong = (previous & ~0xffffffffULL) | low;
+                break;
+            }
+
+            case 3:
+                std::memcpy(&vlong, in.data() + at, sizeof(Long));
+                at += sizeof(Long);
+                break;
+        }
+
+        longs[i] = vlong;
+        previous = vlong;
+    }
+}
+
+MemoryRAM::Page* MemoryRAM::UnpackPage(size_t page) const {
+    std::lock_guard guard(packed_lock);
+
+    auto found = packed.find(page);
+    if (found == packed.end()) return nullptr;
+
+    auto new_page = new Page;
+    UnpackLongs(found->second, new_page->data());
+
+    // In the table before the count drops, so a LoadPage that sees no
+    // packed pages left also sees this one
+    auto leaf = leaves[page / LEAF_PAGES].load(std::memory_order_acquire);
+    (leaf ? *leaf : LoadLeaf(page / LEAF_PAGES))[page % LEAF_PAGES].store(new_page, std::memory_order_release);
+
+    loaded_pages.fetch_add(1, std::memory_order_relaxed);
+    unpacked.fetch_add(1, std::memory_order_relaxed);
+
+    packed_bytes.fetch_sub(found->second.size(), std::memory_order_relaxed);
+    packed.erase(found);
+    packed_pages.fetch_sub(1, std::memory_order_release);
+
+    return new_page;
+}
+
+bool MemoryRAM::CopyPackedPage(size_t page, Page& into) const {
+    std::lock_guard guard(packed_lock);
+
+    auto found = packed.find(page);
+    if (found == packed.end()) return false;
+
+    UnpackLongs(found->second, into.data());
+    return true;
+}
+
+void MemoryRAM::UnpackAllPages() {
+    std::vector<size_t> pages;
+
+    {
+        std::lock_guard guard(packed_lock);
+        for (auto& [page, bytes] : packed)
+            pages.push_back(page);
+    }
+
+    for (auto page : pages)
+        UnpackPage(page);
+}
+
+Address MemoryRAM::CompressColdPages(Address bytes) {
+    Address saved = 0;
+    std::vector<Byte> packing;
+
+    for (size_t leaf = 0; leaf < leaves_count && saved < bytes; leaf++) {
+        auto pages = leaves[leaf].load(std::memory_order_acquire);
+        if (!pages) continue;
+
+        for (size_t i = 0; i < LEAF_PAGES && saved < bytes; i++) {
+            size_t page = leaf * LEAF_PAGES + i;
+
+            auto loaded = (*pages)[i].load(std::memory_order_relaxed);
+            if (!loaded || GetSharedPage(page)) continue;
+
+            auto [word, bit] = referenced.GetBit(page * PAGE_SIZE);
+            if (word->load(std::memory_order_relaxed) & bit) continue;
+
+            // Zero pages need nothing kept
+            bool zero = IsZeroPage(loaded->data(), LONGS_PER_PAGE);
+            if (!zero && !PackLongs(loaded->data(), packing)) continue;
+
+            (*pages)[i].store(nullptr, std::memory_order_relaxed);
+            RetirePage(loaded);
+
+            loaded_pages.fetch_sub(1, std::memory_order_relaxed);
+
+            if (zero) {
+                saved += PAGE_SIZE;
+                continue;
+            }
+
+            {
+                std::lock_guard guard(packed_lock);
+                packed.emplace(page, packing);
+            }
+
+            packed_bytes.fetch_add(packing.size(), std::memory_order_relaxed);
+            packed_pages.fetch_add(1, std::memory_order_release);
+            saved += PAGE_SIZE - packing.size();
+        }
+    }
+
+    FreeRetired();
+
+    // The next period starts. Harts drop the host pointers they cached, so
+    // pages they keep using get marked again
+    referenced.ClearAll();
+
+    if (host_page_generation)
+        host_page_generation->fetch_add(1);
+
+    return saved;
+}
+
+CompressionStats MemoryRAM::GetCompressionStats() const {
+    return {
+        static_cast<Long>(packed_pages.load(std::memory_order_relaxed)),
+        packed_bytes.load(std::memory_order_relaxed),
+        unpacked.load(std::memory_order_relaxed)
+    };
+}
+
+void MemoryRAM::Freeze() {
+    // The image is made from the table, so packed pages go back into it
+    UnpackAllPages();
+
+    if (loaded_pages != 0) {
+        auto image = std::make_shared<SharedPages>();
+        image->base = shared;
+        image->leaves.resize(leaves_count);
 
-    EnsurePageIsLoaded(page);
+        // Leaves are copied, the pages they point at are shared
+        if (shared) {
+            for (size_t leaf = 0; leaf < leaves_count; leaf++) {
+                if (shared->leaves[leaf])
+                    image->leaves[leaf] = std::make_unique<SharedLeaf>(*shared->leaves[leaf]);
+            }
+        }
+
+        for (size_t leaf = 0; leaf < leaves_count; leaf++) {
+            auto pages = leaves[leaf].exchange(nullptr, std::memory_order_acq_rel);
+            if (!pages) continue;
+
+            for (size_t i = 0; i < LEAF_PAGES; i++) {
+                auto loaded = (*pages)[i].load(std::memory_order_relaxed);
+                if (!loaded) continue;
+
+                if (!image->leaves[leaf]) {
+                    image->leaves[leaf] = std::make_unique<SharedLeaf>();
+                    image->leaves[leaf]->fill(nullptr);
+                }
+
+                (*image->leaves[leaf])[i] = loaded;
+                image->owned.emplace_back(loaded);
+            }
+
+            delete pages;
+        }
+
+        loaded_pages = 0;
+        shared = std::move(image);
+    }
 
-    (*pages[page])[address >> 3] = vlong;
+    written.ClearAll();
+}
+
+bool MemoryRAM::Rewind() {
+    for (auto [start, end] : written.Take(0, size)) {
+        for (Address offset = start; offset < end; offset += PAGE_SIZE) {
+            auto page = offset / PAGE_SIZE;
+
+            auto loaded = FindPage(page);
+            if (!loaded) continue;
+
+            if (auto shared_page = GetSharedPage(page))
+                *loaded = *shared_page;
+            else
+                loaded->fill(0);
+
+            dirty.Mark(offset);
+        }
+    }
+
+    // Packed pages were all packed since the last freeze, so they just go
+    if (packed_pages.load(std::memory_order_acquire) != 0) {
+        std::lock_guard guard(packed_lock);
+
+        for (auto& [page, bytes] : packed)
+            dirty.Mark(page * PAGE_SIZE);
+
+        packed.clear();
+        packed_pages = 0;
+        packed_bytes = 0;
+    }
+
+    FreeRetired();
+    return true;
+}
+
+std::shared_ptr<MemoryRegion> MemoryRAM::Clone() {
+    Freeze();
+
+    auto clone = std::shared_ptr<MemoryRAM>(new MemoryRAM(base, size));
+    clone->shared = shared;
+    clone->dirty.CopyFrom(dirty);
+
+    return clone;
 }
 
 std::unique_ptr<MemoryRAM> MemoryRAM::Create(Address base, Address size) {
@@ -78,21 +667,383 @@ std::unique_ptr<MemoryRAM> MemoryRAM::Create(Address base, Address size) {
     return std::unique_ptr<MemoryRAM>(new MemoryRAM(base & ~3, size));
 }
 
-union U32S32 {
-    Word u;
-    SWord s;
-};
+MemoryMappedRAM::MemoryMappedRAM(Address base, Address size, bool huge_pages, Word host_node) : MemoryRegion(TYPE_GENERAL_RAM, 0, base, size, true, true), huge_pages{huge_pages}, host_node{host_node}
+#if defined(_WIN32) || defined(_WIN64)
+    , committed{new std::atomic<Long>[(size / COMMIT_SIZE + 63) / 64]{}}
+#endif
+{
+#if defined(_WIN32) || defined(_WIN64)
+    // Large pages on Windows need a privilege and must be committed up front
+    (void)huge_pages;
+
+    host = static_cast<Byte*>(VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS));
+    if (!host)
+        throw std::runtime_error(std::format("Cannot reserve {:#x} bytes of guest RAM", size));
+#else
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error(std::format("Cannot reserve {:#x} bytes of guest RAM", size));
+
+    host = static_cast<Byte*>(mapping);
+
+    // Nothing is touched yet, so no page lands before the policy does
+    if (host_node != NUMA::NO_NODE && !NUMA::BindMemory(host, size, host_node))
+        throw std::runtime_error(std::format("Cannot bind guest RAM to host node {}", host_node));
+
+#ifdef MADV_HUGEPAGE
+    if (huge_pages)
+        madvise(host, size, MADV_HUGEPAGE);
+#else
+    (void)huge_pages;
+#endif
+#endif
+}
 
-MemoryRegion* Memory::GetMemoryRegion(Address address) {
-    for (auto& region : regions) {
-        Address end = region->base + region->size;
-        if (address >= region->base && address < end)
-            return region.get();
+MemoryMappedRAM::~MemoryMappedRAM() {
+#if defined(_WIN32) || defined(_WIN64)
+    VirtualFree(host, 0, MEM_RELEASE);
+#else
+    munmap(host, size);
+#endif
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+void MemoryMappedRAM::Commit(size_t granule) const {
+    // Committing an already committed range is harmless, so racing harts
+    // only need to agree on who counts it
+    auto at = host + granule * COMMIT_SIZE;
+    auto ok = host_node == NUMA::NO_NODE
+        ? VirtualAlloc(at, COMMIT_SIZE, MEM_COMMIT, PAGE_READWRITE)
+        : VirtualAllocExNuma(GetCurrentProcess(), at, COMMIT_SIZE, MEM_COMMIT, PAGE_READWRITE, host_node);
+
+    if (!ok)
+        throw std::runtime_error(std::format("Cannot commit guest RAM at {:#x}", base + granule * COMMIT_SIZE));
+
+    Long bit = 1ULL << (granule % 64);
+    if (!(committed[granule / 64].fetch_or(bit, std::memory_order_acq_rel) & bit))
+        committed_granules.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+
+bool MemoryMappedRAM::ReadBytes(Address address, Byte* bytes, Address count) const {
+#if defined(_WIN32) || defined(_WIN64)
+    // Granules nobody has touched read as zero without being committed
+    for (Address done = 0; done < count;) {
+        Address at = address + done;
+        Address chunk = std::min<Address>(count - done, COMMIT_SIZE - at % COMMIT_SIZE);
+
+        auto granule = at / COMMIT_SIZE;
+        if (committed[granule / 64].load(std::memory_order_acquire) & (1ULL << (granule % 64)))
+            std::memcpy(bytes + done, host + at, chunk);
+        else
+            std::memset(bytes + done, 0, chunk);
+
+        done += chunk;
     }
-    return nullptr;
+#else
+    std::memcpy(bytes, host + address, count);
+#endif
+
+    return true;
 }
 
-const MemoryRegion* Memory::GetMemoryRegion(Address address) const {
+void MemoryMappedRAM::Prefault(Address address, Address bytes) {
+    if (address >= size) return;
+
+    Address start = address & ~(PAGE_SIZE - 1);
+    Address end = std::min(address + bytes, size);
+
+#if defined(_WIN32) || defined(_WIN64)
+    for (Address granule = start / COMMIT_SIZE; granule * COMMIT_SIZE < end; granule++)
+        EnsureCommitted(granule * COMMIT_SIZE);
+#elif defined(MADV_POPULATE_WRITE)
+    madvise(host + start, end - start, MADV_POPULATE_WRITE);
+#else
+    for (Address page = start; page < end; page += PAGE_SIZE)
+        reinterpret_cast<volatile Byte*>(host)[page] = host[page];
+#endif
+}
+
+Long MemoryMappedRAM::SizeInMemory() const {
+#if defined(_WIN32) || defined(_WIN64)
+    return committed_granules.load(std::memory_order_relaxed) * COMMIT_SIZE;
+#else
+    // Ask the kernel which pages are resident, a window at a time so huge
+    // reservations don't need a huge vector
+    constexpr Address WINDOW_PAGES = 0x10000;
+
+    static const Address host_page = sysconf(_SC_PAGESIZE);
+
+    std::vector<unsigned char> residency(WINDOW_PAGES);
+    Long resident = 0;
+
+    for (Address offset = 0; offset < size; offset += WINDOW_PAGES * host_page) {
+        Address length = std::min(WINDOW_PAGES * host_page, size - offset);
+        if (mincore(host + offset, length, residency.data()) != 0)
+            break;
+
+        Address pages = (length + host_page - 1) / host_page;
+        for (Address i = 0; i < pages; i++)
+            resident += residency[i] & 1;
+    }
+
+    return resident * host_page;
+#endif
+}
+
+std::vector<Address> MemoryMappedRAM::GetSavedPages() const {
+    std::vector<Address> saved;
+
+#if defined(_WIN32) || defined(_WIN64)
+    for (Address granule = 0; granule * COMMIT_SIZE < size; granule++) {
+        if (!(committed[granule / 64].load(std::memory_order_acquire) & (1ULL << (granule % 64))))
+            continue;
+
+        for (Address page = granule * COMMIT_SIZE; page < std::min((granule + 1) * COMMIT_SIZE, size); page += PAGE_SIZE)
+            saved.push_back(page);
+    }
+#else
+    constexpr Address WINDOW_PAGES = 0x10000;
+
+    static const Address host_page = sysconf(_SC_PAGESIZE);
+
+    std::vector<unsigned char> residency(WINDOW_PAGES);
+
+    for (Address offset = 0; offset < size; offset += WINDOW_PAGES * host_page) {
+        Address length = std::min(WINDOW_PAGES * host_page, size - offset);
+        if (mincore(host + offset, length, residency.data()) != 0)
+            break;
+
+        Address pages = (length + host_page - 1) / host_page;
+        for (Address i = 0; i < pages; i++) {
+            if (!(residency[i] & 1)) continue;
+
+            Address start = offset + i * host_page;
+            for (Address page = start; page < std::min(start + host_page, size); page += PAGE_SIZE)
+                saved.push_back(page);
+        }
+    }
+
+    std::lock_guard guard(lock);
+
+    if (!file_pages.empty()) {
+        for (auto [start, bytes] : file_pages) {
+            for (Address page = start; page < start + bytes; page += PAGE_SIZE)
+                saved.push_back(page);
+        }
+
+        std::sort(saved.begin(), saved.end());
+        saved.erase(std::unique(saved.begin(), saved.end()), saved.end());
+    }
+#endif
+
+    return saved;
+}
+
+void MemoryMappedRAM::DiscardPages() {
+#if defined(_WIN32) || defined(_WIN64)
+    VirtualFree(host, size, MEM_DECOMMIT);
+
+    for (Address i = 0; i < (size / COMMIT_SIZE + 63) / 64; i++)
+        committed[i] = 0;
+
+    committed_granules = 0;
+#else
+    // Mapping fresh anonymous memory over the region drops file pages too
+    void* mapping = mmap(host, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error(std::format("Cannot discard {:#x} bytes of guest RAM", size));
+
+    // The new mapping starts without a policy
+    if (host_node != NUMA::NO_NODE)
+        NUMA::BindMemory(host, size, host_node);
+
+#ifdef MADV_HUGEPAGE
+    if (huge_pages)
+        madvise(host, size, MADV_HUGEPAGE);
+#endif
+
+    std::lock_guard guard(lock);
+    file_pages.clear();
+#endif
+}
+
+Address MemoryMappedRAM::ReleasePages(Address offset, Address bytes) {
+    if (offset >= size) return 0;
+
+#if defined(_WIN32) || defined(_WIN64)
+    // Decommitting would fault harts still writing through host pointers,
+    // a reset keeps the pages committed and lets the OS drop their contents
+    Address start = (offset + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    Address end = std::min(offset + bytes, size) & ~(PAGE_SIZE - 1);
+    Address released = 0;
+
+    for (Address at = start; at < end;) {
+        auto granule = at / COMMIT_SIZE;
+        Address next = std::min((granule + 1) * COMMIT_SIZE, end);
+
+        if (committed[granule / 64].load(std::memory_order_acquire) & (1ULL << (granule % 64))) {
+            if (VirtualAlloc(host + at, next - at, MEM_RESET, PAGE_READWRITE))
+                released += next - at;
+        }
+
+        at = next;
+    }
+
+    return released;
+#else
+    static const Address host_page = sysconf(_SC_PAGESIZE);
+
+    Address start = (offset + host_page - 1) & ~(host_page - 1);
+    Address end = std::min(offset + bytes, size) & ~(host_page - 1);
+    if (start >= end) return 0;
+
+    // Anonymous pages come back zeroed, pages mapped from a snapshot come
+    // back as the file has them
+    if (madvise(host + start, end - start, MADV_DONTNEED) != 0)
+        return 0;
+
+    return end - start;
+#endif
+}
+
+Address MemoryMappedRAM::ReclaimZeroPages() {
+#if defined(_WIN32) || defined(_WIN64)
+    Address reclaimed = 0;
+
+    for (Address granule = 0; granule * COMMIT_SIZE < size; granule++) {
+        Long bit = 1ULL << (granule % 64);
+        if (!(committed[granule / 64].load(std::memory_order_acquire) & bit)) continue;
+
+        Address bytes = std::min(COMMIT_SIZE, size - granule * COMMIT_SIZE);
+        if (!IsZeroPage(reinterpret_cast<const Long*>(host + granule * COMMIT_SIZE), bytes / sizeof(Long))) continue;
+
+        if (!VirtualFree(host + granule * COMMIT_SIZE, bytes, MEM_DECOMMIT)) continue;
+
+        committed[granule / 64].fetch_and(~bit, std::memory_order_acq_rel);
+        committed_granules.fetch_sub(1, std::memory_order_relaxed);
+        reclaimed += bytes;
+    }
+
+    return reclaimed;
+#else
+    constexpr Address WINDOW_PAGES = 0x10000;
+
+    static const Address host_page = sysconf(_SC_PAGESIZE);
+
+    std::vector<unsigned char> residency(WINDOW_PAGES);
+    Address reclaimed = 0;
+
+    std::lock_guard guard(lock);
+
+    // Only resident pages are read, so the scan faults nothing in. A
+    // snapshot's pages would come back from the file, not as zeros
+    auto IsFilePage = [&](Address offset) {
+        return std::any_of(file_pages.begin(), file_pages.end(), [&](auto& range) { return offset >= range.first && offset < range.first + range.second; });
+    };
+
+    for (Address offset = 0; offset < size; offset += WINDOW_PAGES * host_page) {
+        Address length = std::min(WINDOW_PAGES * host_page, size - offset);
+        if (mincore(host + offset, length, residency.data()) != 0)
+            break;
+
+        Address pages = (length + host_page - 1) / host_page;
+        for (Address i = 0; i < pages; i++) {
+            Address page = offset + i * host_page;
+            if (!(residency[i] & 1) || IsFilePage(page)) continue;
+
+            if (!IsZeroPage(reinterpret_cast<const Long*>(host + page), host_page / sizeof(Long))) continue;
+
+            if (madvise(host + page, host_page, MADV_DONTNEED) == 0)
+                reclaimed += host_page;
+        }
+    }
+
+    return reclaimed;
+#endif
+}
+
+bool MemoryMappedRAM::MapFilePages(Address address, Address bytes, int fd, Long file_offset) {
+#if defined(_WIN32) || defined(_WIN64)
+    (void)address;
+    (void)bytes;
+    (void)fd;
+    (void)file_offset;
+
+    return false;
+#else
+    static const Address host_page = sysconf(_SC_PAGESIZE);
+
+    if (address % host_page || bytes % host_page || file_offset % host_page || address + bytes > size)
+        return false;
+
+    // Private mappings copy a page only once the guest writes it, so every
+    // restore from the same file shares the untouched pages
+    void* mapping = mmap(host + address, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, file_offset);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    std::lock_guard guard(lock);
+    file_pages.emplace_back(address, bytes);
+
+    return true;
+#endif
+}
+
+std::unique_ptr<MemoryMappedRAM> MemoryMappedRAM::Create(Address base, Address size, bool huge_pages, Word host_node) {
+    size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+    return std::unique_ptr<MemoryMappedRAM>(new MemoryMappedRAM(base & ~3, size, huge_pages, host_node));
+}
+
+namespace {
+    MemoryRegion* const MIXED_PAGE = reinterpret_cast<MemoryRegion*>(UINTPTR_MAX);
+}
+
+void Memory::AddRoute(MemoryRegion* region) {
+    if (region->size == 0 || region->base >= ROUTED_MEMORY) return;
+
+    Address end = std::min(region->base + region->size, ROUTED_MEMORY);
+
+    size_t chunks = (end + ROUTE_CHUNK_SIZE - 1) / ROUTE_CHUNK_SIZE;
+    if (routes.size() < chunks)
+        routes.resize(chunks);
+
+    // Regions added earlier win where they overlap, like the old linear scan
+    Address page = region->base / PAGE_SIZE;
+    while (page * PAGE_SIZE < end) {
+        auto& chunk = routes[page / PAGES_PER_ROUTE_CHUNK];
+        Address chunk_base = (page / PAGES_PER_ROUTE_CHUNK) * ROUTE_CHUNK_SIZE;
+        Address next_chunk = (page / PAGES_PER_ROUTE_CHUNK + 1) * PAGES_PER_ROUTE_CHUNK;
+
+        if (chunk.region) {
+            page = next_chunk;
+            continue;
+        }
+
+        if (!chunk.pages && region->base <= chunk_base && end >= chunk_base + ROUTE_CHUNK_SIZE) {
+            chunk.region = region;
+            page = next_chunk;
+            continue;
+        }
+
+        if (!chunk.pages) {
+            chunk.pages = std::make_unique<std::array<MemoryRegion*, PAGES_PER_ROUTE_CHUNK>>();
+            chunk.pages->fill(nullptr);
+        }
+
+        Address page_base = page * PAGE_SIZE;
+        bool covers_page = region->base <= page_base && end >= page_base + PAGE_SIZE;
+
+        auto& slot = (*chunk.pages)[page % PAGES_PER_ROUTE_CHUNK];
+        if (!slot)
+            slot = covers_page ? region : MIXED_PAGE;
+
+        page++;
+    }
+}
+
+const MemoryRegion* Memory::FindMemoryRegion(Address address) const {
     for (const auto& region : regions) {
         Address end = region->base + region->size;
         if (address >= region->base && address < end)
@@ -101,52 +1052,250 @@ const MemoryRegion* Memory::GetMemoryRegion(Address address) const {
     return nullptr;
 }
 
+MemoryRegion* Memory::GetMemoryRegion(Address address) {
+    return const_cast<MemoryRegion*>(std::as_const(*this).GetMemoryRegion(address));
+}
+
+const MemoryRegion* Memory::GetMemoryRegion(Address address) const {
+    size_t index = address / ROUTE_CHUNK_SIZE;
+    if (index >= routes.size()) return FindMemoryRegion(address);
+
+    const auto& chunk = routes[index];
+    if (chunk.region) return chunk.region;
+    if (!chunk.pages) return nullptr;
+
+    auto region = (*chunk.pages)[(address / PAGE_SIZE) % PAGES_PER_ROUTE_CHUNK];
+    if (region != MIXED_PAGE) return region;
+
+    return FindMemoryRegion(address);
+}
+
+namespace {
+    [[noreturn]] void ThrowAccessFault(Address address, Address bytes, Memory::AccessFault fault, bool is_write) {
+        auto access = is_write ? "write" : "read";
+
+        switch (fault) {
+            case Memory::AccessFault::Misaligned:
+                throw std::runtime_error(std::format("Unaligned {} of {} bytes at 0x{:x}", access, bytes, address));
+
+            case Memory::AccessFault::Denied:
+                throw std::runtime_error(std::format("Cannot {} address 0x{:x} as it's {}", access, address, is_write ? "unwritable" : "unreadable"));
+
+            default:
+                throw std::runtime_error(std::format("Address 0x{:x} is not mapped to any memory", address));
+        }
+    }
+}
+
+Memory::AccessFault Memory::Route(Address address, Address bytes, bool is_write, const MemoryRegion*& region) const {
+    if (address & (bytes - 1)) return AccessFault::Misaligned;
+    if (address >= max_address) return AccessFault::Unmapped;
+
+    region = GetMemoryRegion(address);
+    if (!region) return AccessFault::Unmapped;
+    if (!(is_write ? region->writable : region->readable)) return AccessFault::Denied;
+
+    return AccessFault::None;
+}
+
+Memory::AccessFault Memory::Probe(Address address, Address bytes, bool is_write) const {
+    const MemoryRegion* region = nullptr;
+    return Route(address, bytes, is_write, region);
+}
+
+template <typename T>
+std::pair<T, Memory::AccessFault> Memory::TryRead(Address address, AccessKind kind) const {
+    const MemoryRegion* region = nullptr;
+    if (auto fault = Route(address, sizeof(T), false, region); fault != AccessFault::None)
+        return {0, fault};
+
+    Sample(address, kind);
+
+    auto offset = address - region->base;
+
+    if constexpr (sizeof(T) == sizeof(Long)) return {region->ReadLong(offset), AccessFault::None};
+    else if constexpr (sizeof(T) == sizeof(Word)) return {region->ReadWord(offset), AccessFault::None};
+    else if constexpr (sizeof(T) == sizeof(Half)) return {region->ReadHalf(offset), AccessFault::None};
+    else return {region->ReadByte(offset), AccessFault::None};
+}
+
+template <typename T>
+Memory::AccessFault Memory::TryWrite(Address address, T value) {
+    const MemoryRegion* found = nullptr;
+    if (auto fault = Route(address, sizeof(T), true, found); fault != AccessFault::None)
+        return fault;
+
+    auto region = const_cast<MemoryRegion*>(found);
+    auto offset = address - region->base;
+
+    Sample(address, AccessKind::Write);
+    NotifyWrite(address);
+
+    if constexpr (sizeof(T) == sizeof(Long)) region->WriteLong(offset, value);
+    else if constexpr (sizeof(T) == sizeof(Word)) region->WriteWord(offset, value);
+    else if constexpr (sizeof(T) == sizeof(Half)) region->WriteHalf(offset, value);
+    else region->WriteByte(offset, value);
+
+    return AccessFault::None;
+}
+
+std::pair<Long, Memory::AccessFault> Memory::TryReadLong(Address address) const { return TryRead<Long>(address); }
+std::pair<Word, Memory::AccessFault> Memory::TryReadWord(Address address) const { return TryRead<Word>(address); }
+std::pair<Half, Memory::AccessFault> Memory::TryReadHalf(Address address) const { return TryRead<Half>(address); }
+std::pair<Byte, Memory::AccessFault> Memory::TryReadByte(Address address) const { return TryRead<Byte>(address); }
+
+Memory::AccessFault Memory::TryWriteLong(Address address, Long vlong) { return TryWrite(address, vlong); }
+Memory::AccessFault Memory::TryWriteWord(Address address, Word word) { return TryWrite(address, word); }
+Memory::AccessFault Memory::TryWriteHalf(Address address, Half half) { return TryWrite(address, half); }
+Memory::AccessFault Memory::TryWriteByte(Address address, Byte byte) { return TryWrite(address, byte); }
+
 Long Memory::ReadLong(Address address) const {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+    auto [vlong, fault] = TryRead<Long>(address);
+    if (fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Long), fault, false);
+
+    return vlong;
+}
+
+Word Memory::ReadWord(Address address) const {
+    auto [word, fault] = TryRead<Word>(address);
+    if (fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Word), fault, false);
 
+    return word;
+}
+
+Half Memory::ReadHalf(Address address) const {
+    auto [half, fault] = TryRead<Half>(address);
+    if (fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Half), fault, false);
+
+    return half;
+}
+
+Byte Memory::ReadByte(Address address) const {
+    auto [byte, fault] = TryRead<Byte>(address);
+    if (fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Byte), fault, false);
+
+    return byte;
+}
+
+std::pair<Long, bool> Memory::PeekLong(Address address) const {
     if (address & 7)
-        throw std::runtime_error(std::format("Unaligned read of word at {:#18}", address));
+        throw std::runtime_error(std::format("Unaligned read of long at {:#18}", address));
 
     auto region = GetMemoryRegion(address);
 
     if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
+        return {0, false};
     
     if (!region->readable)
-        throw std::runtime_error(std::format("Cannot read address {:#18} as it's unreadable", address));
-
+        return {0, false};
+    
     auto vlong = region->ReadLong(address - region->base);
 
-    return vlong;
+    return {vlong, true};
 }
 
-Word Memory::ReadWord(Address address) const {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
+std::pair<Word, bool> Memory::PeekWord(Address address) const {
     if (address & 3)
         throw std::runtime_error(std::format("Unaligned read of word at {:#18}", address));
 
     auto region = GetMemoryRegion(address);
 
     if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
+        return {0, false};
     
     if (!region->readable)
-        throw std::runtime_error(std::format("Cannot read address {:#18} as it's unreadable", address));
-
+        return {0, false};
+    
     auto word = region->ReadWord(address - region->base);
 
-    return word;
+    return {word, true};
 }
 
-Half Memory::ReadHalf(Address address) const {
+std::pair<Half, bool> Memory::PeekHalf(Address address) const {
+    if (address & 1)
+        throw std::runtime_error(std::format("Unaligned read of half at {:#18}", address));
+
+    auto region = GetMemoryRegion(address);
+
+    if (!region)
+        return {0, false};
+    
+    if (!region->readable)
+        return {0, false};
+    
+    return {region->ReadHalf(address - region->base), true};
+}
+
+void Memory::WriteLong(Address address, Long vlong) {
+    if (auto fault = TryWrite(address, vlong); fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Long), fault, true);
+}
+
+void Memory::WriteWord(Address address, Word word) {
+    if (auto fault = TryWrite(address, word); fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Word), fault, true);
+}
+
+void Memory::WriteHalf(Address address, Half half) {
+    if (auto fault = TryWrite(address, half); fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Half), fault, true);
+}
+
+void Memory::WriteByte(Address address, Byte byte) {
+    if (auto fault = TryWrite(address, byte); fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Byte), fault, true);
+}
+
+template <typename T>
+T Memory::Atomic(Address address, T value, AtomicOp op) {
+    using Signed = std::make_signed_t<T>;
+
     if (address >= max_address)
         throw std::runtime_error(std::format("Tried reading from memory past max_address"));
 
-    if (address & 1)
-        throw std::runtime_error(std::format("Unaligned read of half at {:#18}", address));
+    if (address & (sizeof(T) - 1))
+        throw std::runtime_error(std::format("Unaligned atomic of {} bytes at {:#18}", sizeof(T), address));
+
+    Sample(address, AccessKind::Atomic);
+    NotifyWrite(address);
+
+    // RAM pages are host memory, so the host does the atomic and harts only
+    // contend on the line itself
+    auto [host, writable] = GetHostPage(address);
+    if (host && writable) {
+        std::atomic_ref<T> target(*reinterpret_cast<T*>(host + address % PAGE_SIZE));
+
+        auto Update = [&](auto should_store) {
+            auto old_value = target.load();
+            while (should_store(old_value) && !target.compare_exchange_weak(old_value, value)) {}
+            return old_value;
+        };
+
+        auto Apply = [&]() -> T {
+            switch (op) {
+                case AtomicOp::Swap: return target.exchange(value);
+                case AtomicOp::Add: return target.fetch_add(value);
+                case AtomicOp::And: return target.fetch_and(value);
+                case AtomicOp::Or: return target.fetch_or(value);
+                case AtomicOp::Xor: return target.fetch_xor(value);
+                case AtomicOp::Min: return Update([&](T old_value) { return static_cast<Signed>(value) < static_cast<Signed>(old_value); });
+                case AtomicOp::MinU: return Update([&](T old_value) { return value < old_value; });
+                case AtomicOp::Max: return Update([&](T old_value) { return static_cast<Signed>(value) > static_cast<Signed>(old_value); });
+                case AtomicOp::MaxU: return Update([&](T old_value) { return value > old_value; });
+            }
+
+            return 0;
+        };
+
+        auto old_value = Apply();
+        MarkDirty(address);
+
+        return old_value;
+    }
 
     auto region = GetMemoryRegion(address);
 
@@ -154,813 +1303,1139 @@ Half Memory::ReadHalf(Address address) const {
         throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
     
     if (!region->readable)
-        throw std::runtime_error(std::format("Cannot read address {:#18} as it's unreadable", address));
+        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
+    
+    if (!region->writable)
+        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+
+    auto offset = address - region->base;
+
+    region->Lock();
+
+    T old_value;
+    if constexpr (sizeof(T) == sizeof(Long)) old_value = region->ReadLong(offset);
+    else old_value = region->ReadWord(offset);
+
+    T new_value = value;
+    switch (op) {
+        case AtomicOp::Swap: break;
+        case AtomicOp::Add: new_value = old_value + value; break;
+        case AtomicOp::And: new_value = old_value & value; break;
+        case AtomicOp::Or: new_value = old_value | value; break;
+        case AtomicOp::Xor: new_value = old_value ^ value; break;
+        case AtomicOp::Min: new_value = std::min<Signed>(old_value, value); break;
+        case AtomicOp::MinU: new_value = std::min(old_value, value); break;
+        case AtomicOp::Max: new_value = std::max<Signed>(old_value, value); break;
+        case AtomicOp::MaxU: new_value = std::max(old_value, value); break;
+    }
+
+    if constexpr (sizeof(T) == sizeof(Long)) region->WriteLong(offset, new_value);
+    else region->WriteWord(offset, new_value);
+
+    region->Unlock();
+
+    return old_value;
+}
+
+Long Memory::AtomicSwapL(Address address, Long vlong) { return Atomic(address, vlong, AtomicOp::Swap); }
+Long Memory::AtomicAddL(Address address, Long vlong) { return Atomic(address, vlong, AtomicOp::Add); }
+Long Memory::AtomicAndL(Address address, Long vlong) { return Atomic(address, vlong, AtomicOp::And); }
+Long Memory::AtomicOrL(Address address, Long vlong) { return Atomic(address, vlong, AtomicOp::Or); }
+Long Memory::AtomicXorL(Address address, Long vlong) { return Atomic(address, vlong, AtomicOp::Xor); }
+SLong Memory::AtomicMinL(Address address, SLong vlong) { return Atomic<Long>(address, vlong, AtomicOp::Min); }
+Long Memory::AtomicMinUL(Address address, Long vlong) { return Atomic(address, vlong, AtomicOp::MinU); }
+SLong Memory::AtomicMaxL(Address address, SLong vlong) { return Atomic<Long>(address, vlong, AtomicOp::Max); }
+Long Memory::AtomicMaxUL(Address address, Long vlong) { return Atomic(address, vlong, AtomicOp::MaxU); }
+
+Word Memory::AtomicSwapW(Address address, Word word) { return Atomic(address, word, AtomicOp::Swap); }
+Word Memory::AtomicAddW(Address address, Word word) { return Atomic(address, word, AtomicOp::Add); }
+Word Memory::AtomicAndW(Address address, Word word) { return Atomic(address, word, AtomicOp::And); }
+Word Memory::AtomicOrW(Address address, Word word) { return Atomic(address, word, AtomicOp::Or); }
+Word Memory::AtomicXorW(Address address, Word word) { return Atomic(address, word, AtomicOp::Xor); }
+SWord Memory::AtomicMinW(Address address, SWord word) { return Atomic<Word>(address, word, AtomicOp::Min); }
+Word Memory::AtomicMinUW(Address address, Word word) { return Atomic(address, word, AtomicOp::MinU); }
+SWord Memory::AtomicMaxW(Address address, SWord word) { return Atomic<Word>(address, word, AtomicOp::Max); }
+Word Memory::AtomicMaxUW(Address address, Word word) { return Atomic(address, word, AtomicOp::MaxU); }
+
+namespace {
+    // Widest aligned access that fits, for regions without host memory
+    void ReadAccesses(const MemoryRegion& region, Address offset, Byte* bytes, Address count) {
+        for (Address i = 0; i < count;) {
+            Address at = offset + i;
+
+            if (at % sizeof(Long) == 0 && count - i >= sizeof(Long)) {
+                Long vlong = region.ReadLong(at);
+                std::memcpy(bytes + i, &vlong, sizeof(Long));
+                i += sizeof(Long);
+            }
+            else if (at % sizeof(Word) == 0 && count - i >= sizeof(Word)) {
+                Word word = region.ReadWord(at);
+                std::memcpy(bytes + i, &word, sizeof(Word));
+                i += sizeof(Word);
+            }
+            else
+                bytes[i++] = region.ReadByte(at);
+        }
+    }
+
+    void WriteAccesses(MemoryRegion& region, Address offset, const Byte* bytes, Address count) {
+        for (Address i = 0; i < count;) {
+            Address at = offset + i;
+
+            if (at % sizeof(Long) == 0 && count - i >= sizeof(Long)) {
+                Long vlong;
+                std::memcpy(&vlong, bytes + i, sizeof(Long));
+                region.WriteLong(at, vlong);
+                i += sizeof(Long);
+            }
+            else if (at % sizeof(Word) == 0 && count - i >= sizeof(Word)) {
+                Word word;
+                std::memcpy(&word, bytes + i, sizeof(Word));
+                region.WriteWord(at, word);
+                i += sizeof(Word);
+            }
+            else
+                region.WriteByte(at, bytes[i++]);
+        }
+    }
+}
+
+std::pair<const MemoryRegion*, Address> Memory::GetRun(Address address, Address bytes) const {
+    Address end = address + bytes;
+
+    if (auto region = GetMemoryRegion(address))
+        return {region, std::min(end, region->base + region->size) - address};
+
+    // Rare, so scanning for the next region is fine
+    for (auto& region : regions) {
+        if (region->base > address && region->base < end)
+            end = region->base;
+    }
+
+    return {nullptr, end - address};
+}
+
+std::vector<std::pair<Address, Address>> Memory::CopyOut(Address address, std::span<Byte> bytes, bool peek) const {
+    std::vector<Range> ranges;
+
+    for (Address done = 0; done < bytes.size();) {
+        Address head = address + done;
+        auto [region, count] = GetRun(head, bytes.size() - done);
+        Byte* out = bytes.data() + done;
+
+        if (!region || !region->readable) {
+            if (!peek) {
+                if (!region) throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", head));
+                throw std::runtime_error(std::format("Cannot read address {:#18} as it's unreadable", head));
+            }
+
+            std::memset(out, 0, count);
+        }
+        else {
+            Address offset = head - region->base;
+
+            bool copied;
+            {
+                std::shared_lock guard(copies_lock);
+                copied = region->ReadBytes(offset, out, count);
+            }
+
+            if (!copied)
+                ReadAccesses(*region, offset, out, count);
+
+            if (!ranges.empty() && ranges.back().second == head)
+                ranges.back().second += count;
+            else
+                ranges.emplace_back(head, head + count);
+        }
+
+        done += count;
+    }
+
+    return ranges;
+}
+
+void Memory::ReadBytes(Address address, std::span<Byte> bytes) const {
+    CopyOut(address, bytes, false);
+}
+
+std::vector<Memory::Range> Memory::PeekBytes(Address address, std::span<Byte> bytes) const {
+    return CopyOut(address, bytes, true);
+}
+
+void Memory::WriteBytes(Address address, std::span<const Byte> bytes) {
+    if (bytes.empty()) return;
 
-    auto half = region->ReadHalf(address - region->base);
+    NotifyWrite(address, bytes.size());
 
-    return half;
-}
+    for (Address done = 0; done < bytes.size();) {
+        Address head = address + done;
+        auto [found, count] = GetRun(head, bytes.size() - done);
+        const Byte* in = bytes.data() + done;
 
-Byte Memory::ReadByte(Address address) const {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+        if (!found)
+            throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", head));
 
-    auto region = GetMemoryRegion(address);
+        if (!found->writable)
+            throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", head));
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot read address {:#18} as it's unreadable", address));
+        auto region = const_cast<MemoryRegion*>(found);
 
-    auto byte = region->ReadByte(address - region->base);
+        // One page at a time, so whole pages go through their host memory
+        count = std::min<Address>(count, PAGE_SIZE - head % PAGE_SIZE);
 
-    return byte;
-}
+        bool copied = false;
+        {
+            std::shared_lock guard(copies_lock);
 
-std::pair<Word, bool> Memory::PeekWord(Address address) const {
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned read of word at {:#18}", address));
+            auto [host, writable] = GetHostPage(head);
+            if (host && writable) {
+                std::memcpy(host + head % PAGE_SIZE, in, count);
+                copied = true;
+            }
+        }
 
-    auto region = GetMemoryRegion(address);
+        if (copied)
+            MarkDirty(head);
+        else
+            WriteAccesses(*region, head - region->base, in, count);
 
-    if (!region)
-        return {0, false};
-    
-    if (!region->readable)
-        return {0, false};
-    
-    auto word = region->ReadWord(address - region->base);
+        done += count;
+    }
+}
 
-    return {word, true};
+void Memory::WriteLongs(Address address, const std::vector<Long>& longs) {
+    Write(address, std::span<const Long>(longs));
 }
 
-bool Memory::TryWriteWord(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+void Memory::WriteWords(Address address, const std::vector<Word>& words) {
+    Write(address, std::span<const Word>(words));
+}
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned write of word at {:#18}", address));
+std::vector<Long> Memory::ReadLongs(Address address, Address count) const {
+    std::vector<Long> data(count);
+    Read(address, std::span<Long>(data));
 
-    auto region = GetMemoryRegion(address);
+    return data;
+}
 
-    if (!region)
-        return false;
-    
-    if (!region->writable)
-        return false;
+std::vector<Word> Memory::ReadWords(Address address, Address count) const {
+    std::vector<Word> data(count);
+    Read(address, std::span<Word>(data));
 
-    region->WriteWord(address - region->base, word);
-    return true;
+    return data;
 }
 
-void Memory::WriteLong(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+std::vector<std::pair<Long, bool>> Memory::PeekLongs(Address address, Address count) const {
+    std::vector<Long> values(count);
+    auto ranges = Peek(address, std::span<Long>(values));
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned write of word at {:#18}", address));
+    std::vector<std::pair<Long, bool>> data(count);
+    for (Address i = 0; i < count; i++)
+        data[i] = {values[i], IsInRanges(ranges, address + i * sizeof(Long), sizeof(Long))};
 
-    auto region = GetMemoryRegion(address);
+    return data;
+}
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", address));
+std::vector<std::pair<Word, bool>> Memory::PeekWords(Address address, Address count) const {
+    std::vector<Word> values(count);
+    auto ranges = Peek(address, std::span<Word>(values));
 
-    region->WriteLong(address - region->base, vlong);
+    std::vector<std::pair<Word, bool>> data(count);
+    for (Address i = 0; i < count; i++)
+        data[i] = {values[i], IsInRanges(ranges, address + i * sizeof(Word), sizeof(Word))};
+
+    return data;
 }
 
-void Memory::WriteWord(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+void Memory::Reserve(Address address, Hart hart_id) const {
+    if (hart_id >= MAX_RESERVATION_HARTS)
+        throw std::runtime_error(std::format("Hart {} is past the reservation slots", hart_id));
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned write of word at {:#18}", address));
+    auto harts = reservation_harts.load();
+    while (harts <= hart_id && !reservation_harts.compare_exchange_weak(harts, hart_id + 1)) {}
 
-    auto region = GetMemoryRegion(address);
+    // Publish before the load, so a store that misses the filter lands
+    // before the load and one that sees it clears the reservation
+    auto line = GetReservationLine(address);
+    reservation_filter[GetReservationSlot(line)]++;
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", address));
+    auto previous = reservations[hart_id].exchange(line);
+    if (previous != 0)
+        reservation_filter[GetReservationSlot(previous)]--;
+}
+
+void Memory::InvalidateReservations(Address address) {
+    auto line = GetReservationLine(address);
+    auto harts = reservation_harts.load();
 
-    region->WriteWord(address - region->base, word);
+    for (Hart hart = 0; hart < harts; hart++) {
+        auto expected = line;
+        if (reservations[hart].compare_exchange_strong(expected, 0))
+            reservation_filter[GetReservationSlot(line)]--;
+    }
 }
 
-void Memory::WriteHalf(Address address, Half half) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+void Memory::NotifyWrite(Address address, Address bytes) {
+    if (bytes == 0) return;
 
-    if (address & 1)
-        throw std::runtime_error(std::format("Unaligned write of half at {:#18}", address));
+    Address end = address + bytes;
+    for (Address page = address & ~(PAGE_SIZE - 1); page < end; page += PAGE_SIZE) {
+        auto slot = GetCodePageSlot(page);
+        Long bit = 1ULL << (slot % 64);
 
-    auto region = GetMemoryRegion(address);
+        if (code_pages[slot / 64].load(std::memory_order_relaxed) & bit) {
+            code_pages[slot / 64].fetch_and(~bit);
+            code_page_versions[slot].fetch_add(1);
+        }
+    }
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", address));
-    
-    region->WriteHalf(address - region->base, half);
+    // Scanning the harts is cheaper than checking the filter for every line
+    Address first_line = address & ~(RESERVATION_LINE - 1);
+    auto harts = reservation_harts.load();
+
+    for (Hart hart = 0; hart < harts; hart++) {
+        auto line = reservations[hart].load();
+        if (line == 0 || (line & ~RESERVATION_VALID) < first_line || (line & ~RESERVATION_VALID) >= end) continue;
+
+        if (reservations[hart].compare_exchange_strong(line, 0))
+            reservation_filter[GetReservationSlot(line)]--;
+    }
 }
 
-void Memory::WriteByte(Address address, Byte byte) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+Long Memory::ReadLongReserved(Address address, Hart hart_id) const {
+    Reserve(address, hart_id);
 
-    auto region = GetMemoryRegion(address);
+    auto [value, fault] = TryRead<Long>(address, AccessKind::Atomic);
+    if (fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Long), fault, false);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", address));
-    
-    region->WriteByte(address - region->base, byte);
+    reserved_values[hart_id] = value;
+
+    return value;
 }
 
-Long Memory::AtomicSwapL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+Word Memory::ReadWordReserved(Address address, Hart hart_id) const {
+    Reserve(address, hart_id);
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+    auto [value, fault] = TryRead<Word>(address, AccessKind::Atomic);
+    if (fault != AccessFault::None) [[unlikely]]
+        ThrowAccessFault(address, sizeof(Word), fault, false);
 
-    auto region = GetMemoryRegion(address);
+    reserved_values[hart_id] = value;
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    return value;
+}
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, vlong);
-    region->Lock();
+// A store from another hart between the reservation check and the write
+// still fails the SC, as the compare against the reserved value catches it
+template <typename T>
+bool Memory::WriteConditional(Address address, T value, Hart hart_id) {
+    if (hart_id >= MAX_RESERVATION_HARTS)
+        return false;
 
-    return old_long;
-}
+    auto previous = reservations[hart_id].exchange(0);
+    if (previous == 0) return false;
+
+    reservation_filter[GetReservationSlot(previous)]--;
+    if (previous != GetReservationLine(address)) return false;
 
-Long Memory::AtomicAddL(Address address, Long vlong) {
     if (address >= max_address)
         throw std::runtime_error(std::format("Tried reading from memory past max_address"));
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
-
-    auto region = GetMemoryRegion(address);
+    if (address & (sizeof(T) - 1))
+        throw std::runtime_error(std::format("Unaligned conditional write at {:#18}", address));
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    Sample(address, AccessKind::Atomic);
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, old_long + vlong);
-    region->Unlock();
+    auto expected = static_cast<T>(reserved_values[hart_id]);
 
-    return old_long;
-}
+    auto [host, writable] = GetHostPage(address);
+    if (host && writable) {
+        NotifyWrite(address);
 
-Long Memory::AtomicAndL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+        bool stored = std::atomic_ref<T>(*reinterpret_cast<T*>(host + address % PAGE_SIZE)).compare_exchange_strong(expected, value);
+        if (stored) MarkDirty(address);
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+        return stored;
+    }
 
     auto region = GetMemoryRegion(address);
 
     if (!region)
         throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
     
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
     if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+        throw std::runtime_error(std::format("Cannot write address {:#18} as it's unwritable", address));
+
+    NotifyWrite(address);
 
     region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, old_long & vlong);
+
+    T current;
+    if constexpr (sizeof(T) == sizeof(Long)) current = region->ReadLong(address - region->base);
+    else current = region->ReadWord(address - region->base);
+
+    bool stored = current == expected;
+    if (stored) {
+        if constexpr (sizeof(T) == sizeof(Long)) region->WriteLong(address - region->base, value);
+        else region->WriteWord(address - region->base, value);
+    }
+
     region->Unlock();
 
-    return old_long;
+    return stored;
 }
 
-Long Memory::AtomicOrL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+bool Memory::WriteLongConditional(Address address, Long value, Hart hart_id) {
+    return WriteConditional(address, value, hart_id);
+}
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+bool Memory::WriteWordConditional(Address address, Word value, Hart hart_id) {
+    return WriteConditional(address, value, hart_id);
+}
+
+std::pair<Byte*, bool> Memory::GetHostPage(Address address) {
+    address &= ~(PAGE_SIZE - 1);
 
     auto region = GetMemoryRegion(address);
+    if (!region || !region->readable) return {nullptr, false};
+    if (address + PAGE_SIZE > region->base + region->size) return {nullptr, false};
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    return {region->GetHostPage(address - region->base), region->writable};
+}
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, old_long | vlong);
-    region->Unlock();
+void Memory::AddWatchpoint(const Watchpoint& watchpoint) {
+    std::lock_guard guard(watchpoints_lock);
+    watchpoints.push_back(watchpoint);
+    watching.store(true);
 
-    return old_long;
+    // Harts drop their host pointers, so accesses to the page come here
+    host_page_generation.fetch_add(1);
 }
 
-Long Memory::AtomicXorL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+bool Memory::RemoveWatchpoint(const Watchpoint& watchpoint) {
+    std::lock_guard guard(watchpoints_lock);
 
-    auto region = GetMemoryRegion(address);
+    auto found = std::find(watchpoints.begin(), watchpoints.end(), watchpoint);
+    if (found == watchpoints.end()) return false;
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    watchpoints.erase(found);
+    watching.store(!watchpoints.empty());
+    host_page_generation.fetch_add(1);
+    return true;
+}
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    region->WriteLong(address - region->base, old_long ^ vlong);
-    region->Unlock();
+void Memory::ClearWatchpoints() {
+    std::lock_guard guard(watchpoints_lock);
+    if (watchpoints.empty()) return;
 
-    return old_long;
+    watchpoints.clear();
+    watching.store(false);
+    host_page_generation.fetch_add(1);
 }
 
-SLong Memory::AtomicMinL(Address address, SLong vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+bool Memory::IsWatchedPage(Address address) const {
+    if (!IsWatching()) return false;
 
-    auto region = GetMemoryRegion(address);
+    std::lock_guard guard(watchpoints_lock);
+    address &= ~(PAGE_SIZE - 1);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    for (auto& watchpoint : watchpoints) {
+        if (watchpoint.address < address + PAGE_SIZE && address < watchpoint.address + watchpoint.length)
+            return true;
+    }
 
-    U32S32 v;
+    return false;
+}
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    v.u = old_long;
-    if (vlong < v.s) v.s = vlong;
-    region->WriteLong(address - region->base, v.u);
-    region->Unlock();
+std::optional<Memory::Watchpoint> Memory::FindWatchpoint(Address address, Address bytes, WatchKind access) const {
+    std::lock_guard guard(watchpoints_lock);
 
-    return old_long;
-}
+    for (auto& watchpoint : watchpoints) {
+        if ((static_cast<Byte>(watchpoint.kind) & static_cast<Byte>(access)) == 0) continue;
 
-Long Memory::AtomicMinUL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+        if (watchpoint.address < address + bytes && address < watchpoint.address + watchpoint.length)
+            return watchpoint;
+    }
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+    return std::nullopt;
+}
 
+std::pair<std::atomic<Long>*, Long> Memory::GetDirtyBit(Address address) {
     auto region = GetMemoryRegion(address);
+    if (!region) return {nullptr, 0};
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
-
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    if (vlong < old_long) region->WriteLong(address - region->base, vlong);
-    region->Unlock();
+    auto dirty = region->GetDirtyPages();
+    if (!dirty) return {nullptr, 0};
 
-    return old_long;
+    return dirty->GetBit(address - region->base);
 }
 
-SLong Memory::AtomicMaxL(Address address, SLong vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+std::vector<DirtyPages::Range> Memory::CollectDirtyRanges(Address address, Address bytes, bool take) {
+    std::vector<DirtyPages::Range> ranges;
+    Address end = address + bytes;
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+    for (auto& region : regions) {
+        Address region_end = region->base + region->size;
+        if (!region->writable || end <= region->base || address >= region_end) continue;
 
-    auto region = GetMemoryRegion(address);
+        Address start = std::max(address, region->base);
+        Address stop = std::min(end, region_end);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+        auto dirty = region->GetDirtyPages();
+        if (!dirty) {
+            ranges.push_back({start, stop});
+            continue;
+        }
 
-    U32S32 v;
+        auto region_ranges = take ? dirty->Take(start - region->base, stop - start) : dirty->Peek(start - region->base, stop - start);
+        for (auto [first, last] : region_ranges)
+            ranges.push_back({region->base + first, region->base + last});
+    }
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    v.u = old_long;
-    if (vlong > v.s) v.s = vlong;
-    region->WriteLong(address - region->base, v.u);
-    region->Unlock();
+    std::sort(ranges.begin(), ranges.end());
+
+    // Neighbouring regions can continue each other's runs
+    std::vector<DirtyPages::Range> merged;
+    for (auto& range : ranges) {
+        if (!merged.empty() && merged.back().second >= range.first)
+            merged.back().second = std::max(merged.back().second, range.second);
+        else
+            merged.push_back(range);
+    }
 
-    return old_long;
+    return merged;
 }
 
-Long Memory::AtomicMaxUL(Address address, Long vlong) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+std::vector<DirtyPages::Range> Memory::PeekDirtyRanges(Address address, Address bytes) {
+    return CollectDirtyRanges(address, bytes, false);
+}
 
-    if (address & 7)
-        throw std::runtime_error(std::format("Unaligned atomic of long at {:#18}", address));
+std::vector<DirtyPages::Range> Memory::TakeDirtyRanges(Address address, Address bytes) {
+    return CollectDirtyRanges(address, bytes, true);
+}
+
+const Byte* Memory::GetSharedHostPage(Address address) {
+    address &= ~(PAGE_SIZE - 1);
 
     auto region = GetMemoryRegion(address);
+    if (!region || !region->readable) return nullptr;
+    if (address + PAGE_SIZE > region->base + region->size) return nullptr;
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    return region->GetSharedHostPage(address - region->base);
+}
+
+std::unique_ptr<Memory> Memory::Clone() {
+    auto clone = std::make_unique<Memory>();
+
+    // The clone builds its own PMA ROM over its own regions
+    for (auto& region : regions) {
+        if (region->type == MemoryRegion::TYPE_PMA_ROM) continue;
 
-    region->Lock();
-    auto old_long = region->ReadLong(address - region->base);
-    if (vlong > old_long) region->WriteLong(address - region->base, vlong);
-    region->Unlock();
+        auto cloned = region->Clone();
+        if (!cloned) {
+            if (region->writable)
+                throw std::runtime_error(std::format("Region at {:#x} can't be cloned", region->base));
 
-    return old_long;
-}
+            cloned = region;
+        }
 
-Word Memory::AtomicSwapW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+        clone->AddMemoryRegion(std::move(cloned));
+    }
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+    clone->hart_nodes = hart_nodes;
 
-    auto region = GetMemoryRegion(address);
+    // Our harts may hold host pointers into the pages that were just frozen
+    host_page_generation.fetch_add(1);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    return clone;
+}
 
-    region->Lock();
-    auto old_word = region->ReadLong(address - region->base);
-    region->WriteWord(address - region->base, word);
-    region->Lock();
+void Memory::Freeze() {
+    for (auto& region : regions)
+        region->Freeze();
 
-    return old_word;
+    // Our harts may hold host pointers into the pages that were just frozen
+    host_page_generation.fetch_add(1);
 }
 
-Word Memory::AtomicAddW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+void Memory::Rewind() {
+    for (auto& region : regions) {
+        if (region->type != MemoryRegion::TYPE_GENERAL_RAM) continue;
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+        if (!region->Rewind())
+            throw std::runtime_error(std::format("Region at {:#x} can't be rewound", region->base));
+    }
 
-    auto region = GetMemoryRegion(address);
+    // Only pages code was decoded from are flagged, so this stays cheap
+    for (size_t i = 0; i < code_pages.size(); i++) {
+        for (auto pages = code_pages[i].exchange(0); pages; pages &= pages - 1)
+            code_page_versions[i * 64 + std::countr_zero(pages)].fetch_add(1);
+    }
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    for (Hart hart = 0; hart < reservation_harts.load(); hart++)
+        reservations[hart].store(0);
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    region->WriteWord(address - region->base, old_word + word);
-    region->Unlock();
+    for (auto& count : reservation_filter)
+        count.store(0);
 
-    return old_word;
+    // Stores through host pointers cached before now wouldn't be seen by
+    // the next Rewind
+    host_page_generation.fetch_add(1);
 }
 
-Word Memory::AtomicAndW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+void Memory::Reset() {
+    std::erase_if(regions, [](auto& region) { return region->type != MemoryRegion::TYPE_PMA_ROM; });
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+    routes.clear();
+    max_address = 0;
+    memory_size = 0;
 
-    auto region = GetMemoryRegion(address);
+    for (auto& region : regions) {
+        memory_size += region->size;
+        max_address = std::max(max_address, region->base + region->size);
+        AddRoute(region.get());
+    }
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    hart_nodes.clear();
+    ClearWatchpoints();
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    region->WriteWord(address - region->base, old_word & word);
-    region->Unlock();
+    for (Hart hart = 0; hart < reservation_harts.load(); hart++)
+        reservations[hart].store(0);
 
-    return old_word;
-}
+    for (auto& count : reservation_filter)
+        count.store(0);
 
-Word Memory::AtomicOrW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+    reservation_harts = 0;
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+    for (auto& pages : code_pages)
+        pages.store(0);
 
-    auto region = GetMemoryRegion(address);
+    sampling.store(false);
+    TakeAccessStats();
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    host_page_generation.fetch_add(1);
+}
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    region->WriteWord(address - region->base, old_word | word);
-    region->Unlock();
+Address Memory::ReleasePages(Address address, Address bytes) {
+    Address end = address + bytes;
+    Address released = 0;
 
-    return old_word;
-}
+    for (auto& region : regions) {
+        if (region->type != MemoryRegion::TYPE_GENERAL_RAM) continue;
 
-Word Memory::AtomicXorW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+        Address region_end = region->base + region->size;
+        if (end <= region->base || address >= region_end) continue;
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+        Address start = std::max(address, region->base);
+        released += region->ReleasePages(start - region->base, std::min(end, region_end) - start);
+    }
 
-    auto region = GetMemoryRegion(address);
+    NotifyWrite(address, bytes);
+    return released;
+}
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+Address Memory::ReclaimZeroPages() {
+    std::unique_lock guard(copies_lock);
+    Address reclaimed = 0;
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    region->WriteWord(address - region->base, old_word ^ word);
-    region->Unlock();
+    for (auto& region : regions)
+        reclaimed += region->ReclaimZeroPages();
 
-    return old_word;
+    return reclaimed;
 }
 
-int32_t Memory::AtomicMinW(Address address, int32_t word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+Address Memory::CompressColdPages() {
+    std::unique_lock guard(copies_lock);
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+    Address used = GetUsedMemory();
+    Address wanted = compress_high != 0 && used > compress_high ? used - compress_low : 0;
+    Address saved = 0;
 
-    auto region = GetMemoryRegion(address);
+    // Every region is called, so they all start a new period
+    for (auto& region : regions)
+        saved += region->CompressColdPages(saved < wanted ? wanted - saved : 0);
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    return saved;
+}
 
-    U32S32 v;
+CompressionStats Memory::GetCompressionStats() const {
+    CompressionStats total;
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    v.u = old_word;
-    if (word < v.s) v.s = word;
-    region->WriteWord(address - region->base, v.u);
-    region->Unlock();
+    for (auto& region : regions) {
+        auto stats = region->GetCompressionStats();
+        total.pages += stats.pages;
+        total.packed_bytes += stats.packed_bytes;
+        total.unpacked += stats.unpacked;
+    }
 
-    return old_word;
+    return total;
 }
 
-Word Memory::AtomicMinUW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
-
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+Memory::AccessShard& Memory::GetAccessShard() const {
+    struct Cached {
+        Long memory = ~0ULL;
+        AccessShard* shard = nullptr;
+    };
 
-    auto region = GetMemoryRegion(address);
+    // A thread mostly counts for one Memory, so that's the one remembered
+    thread_local Cached cached;
+    if (cached.memory == id) return *cached.shard;
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    std::lock_guard guard(access_shards_lock);
+    auto thread = std::this_thread::get_id();
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    if (word < old_word) region->WriteWord(address - region->base, word);
-    region->Unlock();
+    auto found = std::find_if(access_shards.begin(), access_shards.end(), [&](auto& shard) { return shard->owner == thread; });
+    if (found == access_shards.end()) {
+        access_shards.emplace_back(std::make_unique<AccessShard>());
+        found = access_shards.end() - 1;
+        (*found)->owner = thread;
+    }
 
-    return old_word;
+    cached = {id, found->get()};
+    return **found;
 }
 
-int32_t Memory::AtomicMaxW(Address address, int32_t word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+void Memory::CountAccess(Address address, AccessKind kind) const {
+    auto& shard = GetAccessShard();
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+    std::lock_guard guard(shard.lock);
+    auto& counts = shard.pages[address & ~(PAGE_SIZE - 1)];
 
-    auto region = GetMemoryRegion(address);
+    switch (kind) {
+        case AccessKind::Read: counts.reads++; break;
+        case AccessKind::Write: counts.writes++; break;
+        case AccessKind::Atomic: counts.atomics++; break;
+    }
+}
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+void Memory::SetAccessSampling(bool enabled) {
+    if (enabled) TakeAccessStats();
+    sampling.store(enabled);
 
-    U32S32 v;
+    // Harts drop their host pages while sampling, and get them back after
+    host_page_generation.fetch_add(1);
+}
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    v.u = old_word;
-    if (word > v.s) v.s = word;
-    region->WriteWord(address - region->base, v.u);
-    region->Unlock();
+AccessStats Memory::GetAccessStats() const {
+    AccessStats stats;
+    std::unordered_map<Address, AccessCounts> pages;
 
-    return old_word;
-}
+    {
+        std::lock_guard guard(access_shards_lock);
 
-Word Memory::AtomicMaxUW(Address address, Word word) {
-    if (address >= max_address)
-        throw std::runtime_error(std::format("Tried reading from memory past max_address"));
+        for (auto& shard : access_shards) {
+            std::lock_guard shard_guard(shard->lock);
 
-    if (address & 3)
-        throw std::runtime_error(std::format("Unaligned atomic of word at {:#18}", address));
+            for (auto& [page, counts] : shard->pages) {
+                auto& total = pages[page];
+                total.reads += counts.reads;
+                total.writes += counts.writes;
+                total.atomics += counts.atomics;
+            }
+        }
 
-    auto region = GetMemoryRegion(address);
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - window_start).count();
+    }
 
-    if (!region)
-        throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", address));
-    
-    if (!region->readable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unreadable", address));
-    
-    if (!region->writable)
-        throw std::runtime_error(std::format("Cannot atomic address {:#18} as it's unwritable", address));
+    stats.pages.assign(pages.begin(), pages.end());
+    std::sort(stats.pages.begin(), stats.pages.end(), [](auto& a, auto& b) { return a.first < b.first; });
 
-    region->Lock();
-    auto old_word = region->ReadWord(address - region->base);
-    if (word > old_word) region->WriteWord(address - region->base, word);
-    region->Unlock();
+    stats.regions.resize(regions.size());
 
-    return old_word;
-}
+    for (auto& [page, counts] : stats.pages) {
+        for (size_t i = 0; i < regions.size(); i++) {
+            if (page < regions[i]->base || page >= regions[i]->base + regions[i]->size) continue;
 
-void Memory::WriteLongs(Address address, const std::vector<Long>& longs) {
-    for (Address head = address, i = 0; i < longs.size(); i++, head += 8) {
-        WriteLong(head, longs[i]);
+            stats.regions[i].reads += counts.reads;
+            stats.regions[i].writes += counts.writes;
+            stats.regions[i].atomics += counts.atomics;
+            break;
+        }
     }
+
+    return stats;
 }
 
-void Memory::WriteWords(Address address, const std::vector<Word>& words) {
-    for (Address head = address, i = 0; i < words.size(); i++, head += 4) {
-        WriteWord(head, words[i]);
+AccessStats Memory::TakeAccessStats() {
+    auto stats = GetAccessStats();
+
+    std::lock_guard guard(access_shards_lock);
+
+    // Counts landing between the merge and here go to the next window
+    for (auto& shard : access_shards) {
+        std::lock_guard shard_guard(shard->lock);
+        shard->pages.clear();
     }
+
+    window_start = std::chrono::steady_clock::now();
+    return stats;
 }
 
-std::vector<Long> Memory::ReadLongs(Address address, Address count) const {
-    std::vector<Long> data;
-    for (Address head = address, i = 0; i < count; i++, head += 8) {
-        data.push_back(ReadLong(head));
+void Memory::WriteAccessStats(const std::string& path, const AccessStats& stats) const {
+    std::ofstream file(path);
+
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
     }
 
-    return data;
-}
+    file << std::format("# {:.3f} seconds\n", stats.seconds);
+    file << "page,region_type,region_base,reads,writes,atomics\n";
 
-std::vector<Word> Memory::ReadWords(Address address, Address count) const {
-    std::vector<Word> data;
-    for (Address head = address, i = 0; i < count; i++, head += 4) {
-        data.push_back(ReadWord(head));
+    for (auto& [page, counts] : stats.pages) {
+        auto region = FindMemoryRegion(page);
+        Word type = region ? region->type : 0;
+        Address base = region ? region->base : 0;
+
+        file << std::format("0x{:x},{},0x{:x},{},{},{}\n", page, type, base, counts.reads, counts.writes, counts.atomics);
     }
+}
 
-    return data;
+void Memory::Prefault(Address address, Address bytes) {
+    Address end = address + bytes;
+
+    for (auto& region : regions) {
+        Address region_end = region->base + region->size;
+        if (end <= region->base || address >= region_end) continue;
+
+        Address start = std::max(address, region->base);
+        region->Prefault(start - region->base, std::min(end, region_end) - start);
+    }
 }
 
-std::vector<std::pair<Long, bool>> Memory::PeekLongs(Address address, Address count) const {
-    std::vector<std::pair<Long, bool>> data;
+namespace {
+    // A raw image read and written at offsets, from any number of threads
+    class ImageFile {
+    private:
+#if defined(_WIN32) || defined(_WIN64)
+        std::fstream file;
+        std::mutex lock;
+#else
+        int fd = -1;
+        int direct_fd = -1;
+#endif
+
+        const std::string path;
+
+    public:
+        ImageFile(const std::string& path, bool writing, bool direct_io) : path{path} {
+#if defined(_WIN32) || defined(_WIN64)
+            (void)direct_io;
+
+            auto mode = std::ios_base::binary | (writing ? std::ios_base::out | std::ios_base::trunc : std::ios_base::in);
+            file.open(path, mode);
+
+            if (!file.is_open())
+                throw std::runtime_error(std::format("Could not open {} for {}", path, writing ? "writing" : "reading"));
+#else
+            int flags = writing ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+
+            fd = open(path.c_str(), flags, 0644);
+            if (fd < 0)
+                throw std::runtime_error(std::format("Could not open {} for {}", path, writing ? "writing" : "reading"));
+
+            // A second descriptor for the whole aligned pages, as unaligned
+            // heads and tails can't go direct. File systems that refuse it
+            // get everything buffered
+#ifdef O_DIRECT
+            if (direct_io) direct_fd = open(path.c_str(), (writing ? O_WRONLY : O_RDONLY) | O_DIRECT);
+#else
+            (void)direct_io;
+#endif
+#endif
+        }
 
-    const MemoryRegion* region = nullptr;
-    Address end;
-    for (Address head = address, i = 0; i < count; i++, head += 8) {
-        if (!region) {
-            region = GetMemoryRegion(head);
-            if (region) {
-                end = region->base + region->size;
-                data.push_back({region->ReadLong(head - region->base), true});
-            }
-            else
-                data.push_back({0, false});
+        ImageFile(const ImageFile&) = delete;
+
+        ~ImageFile() {
+#if !defined(_WIN32) && !defined(_WIN64)
+            if (direct_fd >= 0) close(direct_fd);
+            close(fd);
+#endif
         }
-        else {
-            if (!(head >= region->base && head < end))
-                region = GetMemoryRegion(head);
-            
-            if (region) {
-                data.push_back({region->ReadLong(head - region->base), true});
-            }
-            else
-                data.push_back({0, false});
+
+        Address GetSize() {
+#if defined(_WIN32) || defined(_WIN64)
+            std::lock_guard guard(lock);
+            file.seekg(0, std::ios_base::end);
+            return file.tellg();
+#else
+            struct stat info;
+            if (fstat(fd, &info) != 0)
+                throw std::runtime_error(std::format("Could not read the size of {}", path));
+
+            return info.st_size;
+#endif
         }
-    }
 
-    return data;
-}
+        // Holes read as zeros
+        void Resize(Address size) {
+#if defined(_WIN32) || defined(_WIN64)
+            std::lock_guard guard(lock);
+            if (size == 0) return;
+
+            file.seekp(size - 1);
+            file.put(0);
+#else
+            if (ftruncate(fd, size) != 0)
+                throw std::runtime_error(std::format("Could not resize {}", path));
+#endif
+        }
 
-std::vector<std::pair<Word, bool>> Memory::PeekWords(Address address, Address count) const {
-    std::vector<std::pair<Word, bool>> data;
+        // [start, end) runs that may hold data, the whole file where holes
+        // can't be found
+        std::vector<Memory::Range> GetDataRanges(Address size) {
+            std::vector<Memory::Range> ranges;
 
-    const MemoryRegion* region = nullptr;
-    Address end;
-    for (Address head = address, i = 0; i < count; i++, head += 4) {
-        if (!region) {
-            region = GetMemoryRegion(head);
-            if (region) {
-                end = region->base + region->size;
-                data.push_back({region->ReadWord(head - region->base), true});
+#if defined(SEEK_DATA) && !defined(_WIN32) && !defined(_WIN64)
+            for (off_t offset = 0; static_cast<Address>(offset) < size;) {
+                off_t data = lseek(fd, offset, SEEK_DATA);
+                if (data < 0) break;
+
+                off_t hole = lseek(fd, data, SEEK_HOLE);
+                if (hole < 0) hole = size;
+
+                ranges.emplace_back(data, std::min<Address>(hole, size));
+                offset = hole;
             }
-            else
-                data.push_back({0, false});
+
+            // Some file systems tell nothing, which reads as no data at all
+            if (ranges.empty() && lseek(fd, 0, SEEK_DATA) < 0 && errno != ENXIO)
+                ranges.emplace_back(0, size);
+#else
+            if (size != 0) ranges.emplace_back(0, size);
+#endif
+
+            return ranges;
         }
-        else {
-            if (!(head >= region->base && head < end))
-                region = GetMemoryRegion(head);
-            
-            if (region) {
-                data.push_back({region->ReadWord(head - region->base), true});
+
+        void Read(Address offset, Byte* bytes, Address count) {
+#if defined(_WIN32) || defined(_WIN64)
+            std::lock_guard guard(lock);
+            file.seekg(offset);
+            if (!file.read(reinterpret_cast<char*>(bytes), count))
+                throw std::runtime_error(std::format("Could not read {}", path));
+#else
+            int from = Direct(offset, bytes, count) ? direct_fd : fd;
+
+            for (Address done = 0; done < count;) {
+                auto got = pread(from, bytes + done, count - done, offset + done);
+                if (got <= 0)
+                    throw std::runtime_error(std::format("Could not read {}", path));
+
+                done += got;
             }
-            else
-                data.push_back({0, false});
+#endif
         }
-    }
 
-    return data;
-}
+        void Write(Address offset, const Byte* bytes, Address count) {
+#if defined(_WIN32) || defined(_WIN64)
+            std::lock_guard guard(lock);
+            file.seekp(offset);
+            if (!file.write(reinterpret_cast<const char*>(bytes), count))
+                throw std::runtime_error(std::format("Could not write {}", path));
+#else
+            int to = Direct(offset, bytes, count) ? direct_fd : fd;
+
+            for (Address done = 0; done < count;) {
+                auto put = pwrite(to, bytes + done, count - done, offset + done);
+                if (put <= 0)
+                    throw std::runtime_error(std::format("Could not write {}", path));
+
+                done += put;
+            }
+#endif
+        }
 
-Long Memory::ReadLongReserved(Address address, Hart hart_id) const {
-    lock.lock();
-    for (auto& item : reservations) {
-        if (item.second == (address & ~0b11)) {
-            reservations.erase(item.first);
-            break;
+    private:
+        bool Direct([[maybe_unused]] Address offset, [[maybe_unused]] const Byte* bytes, [[maybe_unused]] Address count) const {
+#if defined(_WIN32) || defined(_WIN64)
+            return false;
+#else
+            constexpr Address ALIGNMENT = Memory::PAGE_SIZE;
+            return direct_fd >= 0 && offset % ALIGNMENT == 0 && count % ALIGNMENT == 0 && reinterpret_cast<uintptr_t>(bytes) % ALIGNMENT == 0;
+#endif
         }
-    }
-    
-    reservations[hart_id] = address & ~0b11;
-    lock.unlock();
+    };
+
+    // Runs work on every piece, a piece at a time on each thread, with the
+    // chunk sized buffer the thread owns. The first failure stops the rest
+    // and is thrown once every thread is done
+    template <typename Work>
+    void TransferPieces(const std::vector<Memory::Range>& pieces, unsigned threads, Work&& work) {
+        if (pieces.empty()) return;
+
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min<size_t>(threads, pieces.size());
+
+        std::atomic<size_t> next = 0;
+        std::atomic<bool> failed = false;
+        std::exception_ptr failure;
+        std::mutex failure_lock;
+
+        auto Worker = [&]() {
+            // Page aligned, so it can go straight to a direct descriptor
+            auto buffer = std::unique_ptr<Byte[], void(*)(Byte*)>(
+                static_cast<Byte*>(::operator new(Memory::FILE_CHUNK_SIZE, std::align_val_t{Memory::PAGE_SIZE})),
+                [](Byte* bytes) { ::operator delete(bytes, std::align_val_t{Memory::PAGE_SIZE}); });
+
+            for (size_t i = next++; i < pieces.size() && !failed; i = next++) {
+                try {
+                    work(pieces[i], buffer.get());
+                }
+                catch (...) {
+                    std::lock_guard guard(failure_lock);
+                    if (!failed.exchange(true)) failure = std::current_exception();
+                }
+            }
+        };
 
-    return ReadLong(address);
-}
+        {
+            std::vector<std::jthread> workers;
+            for (unsigned i = 1; i < threads; i++)
+                workers.emplace_back(Worker);
 
-Word Memory::ReadWordReserved(Address address, Hart hart_id) const {
-    lock.lock();
-    for (auto& item : reservations) {
-        if (item.second == (address & ~0b11)) {
-            reservations.erase(item.first);
-            break;
+            Worker();
         }
+
+        if (failure) std::rethrow_exception(failure);
     }
-    
-    reservations[hart_id] = address & ~0b11;
-    lock.unlock();
 
-    return ReadWord(address);
-}
+    // Cuts [start, end) runs into pieces of at most a chunk, split on chunk
+    // boundaries so direct I/O stays aligned
+    void AddPieces(std::vector<Memory::Range>& pieces, Address start, Address end) {
+        while (start < end) {
+            Address piece_end = std::min(end, (start / Memory::FILE_CHUNK_SIZE + 1) * Memory::FILE_CHUNK_SIZE);
+            pieces.emplace_back(start, piece_end);
+            start = piece_end;
+        }
+    }
 
-bool Memory::WriteLongConditional(Address address, Long value, Hart hart_id) {
-    lock.lock();
-    if (reservations.find(hart_id) == reservations.end()) {
-        lock.unlock();
-        return false;
+    bool IsZero(const Byte* bytes, Address count) {
+        if (reinterpret_cast<uintptr_t>(bytes) % sizeof(Long) == 0 && count % sizeof(Long) == 0)
+            return IsZeroPage(reinterpret_cast<const Long*>(bytes), count / sizeof(Long));
+
+        return std::all_of(bytes, bytes + count, [](Byte byte) { return byte == 0; });
     }
 
-    if (reservations[hart_id] != (address & ~0b11)) {
-        lock.unlock();
-        return false;
+    // Joins neighbouring and overlapping runs, which must come in order
+    void AddRange(std::vector<Memory::Range>& ranges, Address start, Address end) {
+        if (!ranges.empty() && ranges.back().second >= start)
+            ranges.back().second = std::max(ranges.back().second, end);
+        else
+            ranges.emplace_back(start, end);
     }
+}
 
-    reservations.erase(hart_id);
+std::vector<Memory::Range> Memory::GetHeldRanges(Address address, Address bytes) const {
+    std::vector<Range> held;
+    Address end = address + bytes;
 
-    lock.unlock();
+    for (Address head = address; head < end;) {
+        auto [region, count] = GetRun(head, end - head);
 
-    WriteLong(address, value);
-    return true;
-}
+        if (!region)
+            throw std::runtime_error(std::format("Address {:#18} is not mapped to any memory", head));
 
-bool Memory::WriteWordConditional(Address address, Word value, Hart hart_id) {
-    lock.lock();
-    if (reservations.find(hart_id) == reservations.end()) {
-        lock.unlock();
-        return false;
-    }
+        if (region->type != MemoryRegion::TYPE_GENERAL_RAM) {
+            AddRange(held, head, head + count);
+            head += count;
+            continue;
+        }
 
-    if (reservations[hart_id] != (address & ~0b11)) {
-        lock.unlock();
-        return false;
-    }
+        for (auto page : region->GetSavedPages()) {
+            Address start = std::max(region->base + page, head);
+            Address stop = std::min(region->base + page + PAGE_SIZE, head + count);
 
-    reservations.erase(hart_id);
+            if (start < stop) AddRange(held, start, stop);
+        }
 
-    lock.unlock();
+        head += count;
+    }
 
-    WriteWord(address, value);
-    return true;
+    return held;
 }
 
-Address Memory::ReadFileInto(const std::string& path, Address address) {
-    std::ifstream file(path, std::ios_base::binary | std::ios_base::ate);
+Address Memory::ReadFileInto(const std::string& path, Address address, const FileTransferOptions& options) {
+    ImageFile file(path, false, options.direct_io);
 
-    if (!file.is_open()) {
-        throw std::runtime_error(std::format("Could not open {} for reading", path));
+    Address size = file.GetSize();
+    auto data = file.GetDataRanges(size);
+
+    std::vector<Range> pieces;
+    for (auto [start, end] : data)
+        AddPieces(pieces, start, end);
+
+    TransferPieces(pieces, options.threads, [&](const Range& piece, Byte* buffer) {
+        Address count = piece.second - piece.first;
+
+        file.Read(piece.first, buffer, count);
+        WriteBytes(address + piece.first, {buffer, count});
+    });
+
+    std::vector<Range> holes;
+    Address last = 0;
+    for (auto [start, end] : data) {
+        if (last < start) holes.emplace_back(last, start);
+        last = end;
     }
 
-    Address size = file.tellg();
-    Word longs = (size + 7) / 8;
-    
-    file.seekg(0);
+    if (last < size) holes.emplace_back(last, size);
+
+    // Holes only need writing where memory holds something already
+    auto held = GetHeldRanges(address, size);
 
-    std::vector<Long> data(longs);
-    data[longs - 1] = 0;
+    pieces.clear();
+    for (size_t hole = 0, run = 0; hole < holes.size() && run < held.size();) {
+        Address start = std::max(holes[hole].first, held[run].first - address);
+        Address end = std::min(holes[hole].second, held[run].second - address);
 
-    file.read(reinterpret_cast<char*>(data.data()), size);
-    file.close();
+        if (start < end) AddPieces(pieces, start, end);
 
-    WriteLongs(address, data);
+        if (holes[hole].second < held[run].second - address) hole++;
+        else run++;
+    }
+
+    TransferPieces(pieces, options.threads, [&](const Range& piece, Byte* buffer) {
+        Address count = piece.second - piece.first;
+
+        std::memset(buffer, 0, count);
+        WriteBytes(address + piece.first, {buffer, count});
+    });
 
     return size;
 }
 
-void Memory::WriteToFile(const std::string& path, Address address, Address bytes) {
-    std::ofstream file(path, std::ios_base::binary);
+void Memory::WriteToFile(const std::string& path, Address address, Address bytes, const FileTransferOptions& options) {
+    ImageFile file(path, true, options.direct_io);
+    file.Resize(bytes);
 
-    if (!file.is_open()) {
-        throw std::runtime_error(std::format("Could not open {} for writing", path));
-    }
+    std::vector<Range> pieces;
+    for (auto [start, end] : GetHeldRanges(address, bytes))
+        AddPieces(pieces, start - address, end - address);
 
-    Address count = (bytes + 7) / 8;
-    
-    auto data = ReadLongs(address, count);
+    TransferPieces(pieces, options.threads, [&](const Range& piece, Byte* buffer) {
+        Address count = piece.second - piece.first;
+        ReadBytes(address + piece.first, {buffer, count});
+
+        // Only runs of pages holding something are written. Pages follow the
+        // guest's boundaries, so whole pages stay aligned in the file
+        std::optional<Address> run;
+        for (Address offset = 0; offset < count;) {
+            Address guest = address + piece.first + offset;
+            Address page_end = std::min(count, offset + PAGE_SIZE - guest % PAGE_SIZE);
+
+            if (IsZero(buffer + offset, page_end - offset)) {
+                if (run) file.Write(piece.first + *run, buffer + *run, offset - *run);
+                run.reset();
+            }
+            else if (!run)
+                run = offset;
+
+            offset = page_end;
+        }
 
-    file.write(reinterpret_cast<char*>(data.data()), bytes);
-    file.close();
+        if (run) file.Write(piece.first + *run, buffer + *run, count - *run);
+    });
 }
\ No newline at end of file
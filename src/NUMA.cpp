@@ -0,0 +1,135 @@
+#include "NUMA.hpp"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+static std::vector<size_t> AllCPUs() {
+    std::vector<size_t> cpus(std::max<size_t>(std::thread::hardware_concurrency(), 1));
+    for (size_t i = 0; i < cpus.size(); i++)
+        cpus[i] = i;
+
+    return cpus;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+// Reads sysfs lists like "0-15,32-47"
+static std::vector<size_t> ReadList(const std::string& path) {
+    std::ifstream file(path);
+    std::string text;
+    std::vector<size_t> list;
+
+    if (!std::getline(file, text)) return list;
+
+    size_t at = 0;
+    while (at < text.size()) {
+        size_t end = text.find(',', at);
+        if (end == std::string::npos) end = text.size();
+
+        auto range = text.substr(at, end - at);
+        auto dash = range.find('-');
+
+        try {
+            size_t first = std::stoul(range.substr(0, dash));
+            size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+
+            for (size_t i = first; i <= last; i++)
+                list.push_back(i);
+        }
+        catch (const std::exception&) {
+            return {};
+        }
+
+        at = end + 1;
+    }
+
+    return list;
+}
+#endif
+
+Word NUMA::GetNodeCount() {
+#if defined(_WIN32) || defined(_WIN64)
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest)) return 1;
+
+    return highest + 1;
+#else
+    auto nodes = ReadList("/sys/devices/system/node/online");
+    if (nodes.empty()) return 1;
+
+    return static_cast<Word>(nodes.back() + 1);
+#endif
+}
+
+std::vector<size_t> NUMA::GetNodeCPUs(Word node) {
+#if defined(_WIN32) || defined(_WIN64)
+    GROUP_AFFINITY affinity{};
+    if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity)) return AllCPUs();
+
+    std::vector<size_t> cpus;
+    for (size_t bit = 0; bit < 64; bit++) {
+        if (affinity.Mask & (1ULL << bit))
+            cpus.push_back(affinity.Group * 64 + bit);
+    }
+
+    return cpus.empty() ? AllCPUs() : cpus;
+#else
+    auto cpus = ReadList(std::format("/sys/devices/system/node/node{}/cpulist", node));
+    return cpus.empty() ? AllCPUs() : cpus;
+#endif
+}
+
+bool NUMA::BindMemory(void* address, size_t bytes, Word node) {
+#if defined(SYS_mbind)
+    constexpr int MPOL_BIND = 2;
+    constexpr size_t BITS = sizeof(unsigned long) * 8;
+
+    std::vector<unsigned long> mask(node / BITS + 1);
+    mask[node / BITS] = 1UL << (node % BITS);
+
+    // The kernel counts one bit less than it's told
+    return syscall(SYS_mbind, address, bytes, MPOL_BIND, mask.data(), mask.size() * BITS + 1, 0) == 0;
+#else
+    // Windows places pages when they're committed, see MemoryMappedRAM
+    (void)address;
+    (void)bytes;
+    (void)node;
+    return false;
+#endif
+}
+
+bool NUMA::PinThread(Word node) {
+    auto cpus = GetNodeCPUs(node);
+
+#if defined(_WIN32) || defined(_WIN64)
+    GROUP_AFFINITY affinity{};
+    affinity.Group = static_cast<WORD>(cpus.front() / 64);
+
+    for (auto cpu : cpus) {
+        if (cpu / 64 == affinity.Group)
+            affinity.Mask |= 1ULL << (cpu % 64);
+    }
+
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (auto cpu : cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
@@ -0,0 +1,447 @@
+#include "NetDevice.hpp"
+
+#include "CLINT.hpp"
+#include "PLIC.hpp"
+#include "VirtualMachine.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Pieces of a frame that sit in one guest page each. Pages that aren't
+    // plain host memory go through a bounce buffer
+    struct Span {
+        Address address;
+        Byte* host;
+        Address count;
+        std::unique_ptr<Byte[]> bounce;
+    };
+
+    std::vector<Span> GetSpans(Memory& memory, Address buffer, Address length, bool receive) {
+        std::vector<Span> spans;
+
+        for (Address done = 0; done < length;) {
+            Address address = buffer + done;
+            Address count = std::min<Address>(length - done, Memory::PAGE_SIZE - address % Memory::PAGE_SIZE);
+
+            Byte* host = nullptr;
+            if (receive) {
+                auto [page, writable] = memory.GetHostPage(address);
+                if (page && writable) host = page;
+            }
+            else {
+                // Pages still shared with a clone are sent without copying them
+                auto page = const_cast<Byte*>(memory.GetSharedHostPage(address));
+                host = page ? page : memory.GetHostPage(address).first;
+            }
+
+            Span span{address, host ? host + address % Memory::PAGE_SIZE : nullptr, count, nullptr};
+
+            if (!host) {
+                span.bounce = std::make_unique<Byte[]>(count);
+                span.host = span.bounce.get();
+
+                if (!receive) {
+                    for (Address i = 0; i < count; i++)
+                        span.host[i] = memory.ReadByte(address + i);
+                }
+            }
+
+            spans.push_back(std::move(span));
+            done += count;
+        }
+
+        return spans;
+    }
+
+#if defined(__linux__)
+    // Reads frames on its own thread and writes them from the hart's. Both
+    // go straight between the interface and guest pages
+    class TAPBackend : public MemoryNetDevice::Backend {
+    private:
+        // How long a wait for frames lasts before checking for a stop
+        static constexpr int POLL_MILLISECONDS = 100;
+
+        const int file;
+
+        // Catches whatever of a frame doesn't fit the guest's buffer
+        std::vector<Byte> overflow = std::vector<Byte>(MemoryNetDevice::MAX_FRAME);
+
+        std::jthread reader;
+
+        void Read(std::stop_token stop, MemoryNetDevice& device) {
+            pollfd ready{file, POLLIN, 0};
+
+            while (!stop.stop_requested()) {
+                if (poll(&ready, 1, POLL_MILLISECONDS) <= 0) continue;
+
+                // Every frame waiting goes in before the interrupt is looked at
+                while (!stop.stop_requested()) {
+                    bool any = false;
+
+                    device.Receive([&](std::span<const std::span<Byte>> buffer) -> size_t {
+                        std::vector<iovec> vectors;
+                        for (auto piece : buffer)
+                            vectors.push_back({piece.data(), piece.size()});
+
+                        vectors.push_back({overflow.data(), overflow.size()});
+
+                        auto size = readv(file, vectors.data(), vectors.size());
+                        any = size > 0;
+                        return any ? size : 0;
+                    });
+
+                    if (!any) break;
+                }
+            }
+        }
+
+    public:
+        TAPBackend(int file) : file{file} {}
+
+        ~TAPBackend() {
+            Detach();
+            close(file);
+        }
+
+        void Attach(MemoryNetDevice& device) override {
+            reader = std::jthread([this, &device](std::stop_token stop) { Read(stop, device); });
+        }
+
+        void Detach() override {
+            if (!reader.joinable()) return;
+
+            reader.request_stop();
+            reader.join();
+        }
+
+        bool Transmit(std::span<const std::span<const Byte>> frame) override {
+            std::vector<iovec> vectors;
+            size_t size = 0;
+
+            for (auto piece : frame) {
+                vectors.push_back({const_cast<Byte*>(piece.data()), piece.size()});
+                size += piece.size();
+            }
+
+            return writev(file, vectors.data(), vectors.size()) == static_cast<ssize_t>(size);
+        }
+    };
+#endif
+}
+
+MemoryNetDevice::MemoryNetDevice(Address base, Long mac) : MemoryRegion(TYPE_NET, 0, base, SIZE, true, true) {
+    Register(MAC_OFFSET) = mac & 0xffffffffffffULL;
+
+    coalescer = std::jthread([this](std::stop_token stop) { Coalesce(stop); });
+}
+
+MemoryNetDevice::~MemoryNetDevice() {
+    SetBackend(nullptr);
+}
+
+Long MemoryNetDevice::ReadLong(Address address) const {
+    auto index = address / sizeof(Long);
+    if (index >= REGISTER_COUNT) return 0;
+
+    return registers[index].load();
+}
+
+Word MemoryNetDevice::ReadWord(Address address) const {
+    return static_cast<Word>(ReadLong(address & ~7) >> ((address & 4) * 8));
+}
+
+void MemoryNetDevice::WriteLong(Address address, Long vlong) {
+    switch (address) {
+        case TX_RING_ADDRESS_OFFSET:
+        case TX_RING_SIZE_OFFSET:
+        case RX_RING_ADDRESS_OFFSET:
+        case RX_RING_SIZE_OFFSET:
+        case RX_SUBMIT_OFFSET:
+        case INTERRUPT_HART_OFFSET:
+            Register(address) = vlong;
+            break;
+
+        // A new bound may be due sooner than the one being waited for
+        case COALESCE_FRAMES_OFFSET:
+        case COALESCE_MICROS_OFFSET:
+            Register(address) = vlong;
+            Finished(0);
+            break;
+
+        case TX_SUBMIT_OFFSET:
+            Register(address) = vlong;
+            Transmit(vlong);
+            break;
+
+        case INTERRUPT_OFFSET:
+            SetInterrupt(false);
+            break;
+    }
+}
+
+// Halves merge into the whole register, so a 32 bit guest ringing a
+// doorbell with its low word still rings it
+void MemoryNetDevice::WriteWord(Address address, Word word) {
+    Address offset = address & ~7;
+
+    auto shift = (address & 4) * 8;
+    auto vlong = ReadLong(offset);
+    vlong &= ~(0xffffffffULL << shift);
+    vlong |= static_cast<Long>(word) << shift;
+
+    WriteLong(offset, vlong);
+}
+
+void MemoryNetDevice::SetBackend(std::shared_ptr<Backend> backend) {
+    std::lock_guard guard(backend_lock);
+
+    if (this->backend) this->backend->Detach();
+    this->backend = std::move(backend);
+    if (this->backend) this->backend->Attach(*this);
+}
+
+void MemoryNetDevice::Transmit(Long count) {
+    if (!memory) return;
+
+    std::lock_guard guard(tx_lock);
+
+    Address ring = Register(TX_RING_ADDRESS_OFFSET);
+    Long ring_size = Register(TX_RING_SIZE_OFFSET);
+    if (ring_size == 0) return;
+
+    // Descriptors past a full ring would be ones the guest hasn't filled in
+    if (count - tx_consumed > ring_size)
+        tx_consumed = count - ring_size;
+
+    Long sent = 0;
+    std::vector<std::span<const Byte>> pieces;
+
+    std::lock_guard backend_guard(backend_lock);
+
+    for (; tx_consumed < count; tx_consumed++, sent++) {
+        Address descriptor = ring + (tx_consumed % ring_size) * DESCRIPTOR_SIZE;
+
+        // Frames that aren't mapped or don't fit only fail themselves
+        bool ok = false;
+        try {
+            Address buffer = memory->ReadLong(descriptor + DESCRIPTOR_BUFFER);
+            Address length = memory->ReadWord(descriptor + DESCRIPTOR_LENGTH);
+
+            if (length != 0 && length <= MAX_FRAME) {
+                auto spans = GetSpans(*memory, buffer, length, false);
+
+                pieces.clear();
+                for (auto& span : spans)
+                    pieces.emplace_back(span.host, span.count);
+
+                // An unplugged card still sends, into nothing
+                ok = !backend || backend->Transmit(pieces);
+            }
+        }
+        catch (const std::runtime_error&) {}
+
+        try {
+            memory->WriteWord(descriptor + DESCRIPTOR_STATUS, ok ? STATUS_OK : STATUS_ERROR);
+        }
+        catch (const std::runtime_error&) {}
+    }
+
+    if (sent == 0) return;
+
+    Register(TX_COMPLETED_OFFSET).fetch_add(sent);
+    Finished(sent);
+}
+
+bool MemoryNetDevice::Receive(const Filler& fill) {
+    if (!memory) return false;
+
+    std::lock_guard guard(rx_lock);
+
+    Address ring = Register(RX_RING_ADDRESS_OFFSET);
+    Long ring_size = Register(RX_RING_SIZE_OFFSET);
+    Long posted = Register(RX_SUBMIT_OFFSET);
+
+    // Buffers past a full ring would be ones the guest hasn't filled in
+    if (ring_size != 0 && posted - rx_consumed > ring_size)
+        rx_consumed = posted - ring_size;
+
+    if (ring_size == 0 || rx_consumed == posted) {
+        std::span<Byte> scratch(rx_scratch);
+        if (fill(std::span(&scratch, 1)) == 0) return false;
+
+        Register(RX_DROPPED_OFFSET).fetch_add(1);
+        return false;
+    }
+
+    Address descriptor = ring + (rx_consumed % ring_size) * DESCRIPTOR_SIZE;
+
+    Address buffer = 0;
+    Address capacity = 0;
+    std::vector<Span> spans;
+
+    try {
+        buffer = memory->ReadLong(descriptor + DESCRIPTOR_BUFFER);
+        capacity = std::min<Address>(memory->ReadWord(descriptor + DESCRIPTOR_LENGTH), MAX_FRAME);
+        spans = GetSpans(*memory, buffer, capacity, true);
+    }
+    catch (const std::runtime_error&) {
+        spans.clear();
+        capacity = 0;
+    }
+
+    std::vector<std::span<Byte>> pieces;
+    for (auto& span : spans)
+        pieces.emplace_back(span.host, span.count);
+
+    // Code or reservations in the buffer go before the frame lands
+    if (capacity != 0) memory->NotifyWrite(buffer, capacity);
+
+    size_t size = fill(pieces);
+    if (size == 0) return false;
+
+    bool ok = capacity != 0 && size <= capacity;
+
+    try {
+        Address landed = std::min<Address>(size, capacity);
+
+        for (auto& span : spans) {
+            Address count = std::min(span.count, landed);
+            landed -= count;
+
+            if (span.bounce) {
+                for (Address i = 0; i < count; i++)
+                    memory->WriteByte(span.address + i, span.host[i]);
+            }
+            else if (count != 0)
+                memory->MarkDirty(span.address);
+        }
+
+        memory->WriteWord(descriptor + DESCRIPTOR_LENGTH, static_cast<Word>(size));
+        memory->WriteWord(descriptor + DESCRIPTOR_STATUS, ok ? STATUS_OK : STATUS_ERROR);
+    }
+    catch (const std::runtime_error&) {}
+
+    rx_consumed++;
+
+    Register(RX_COMPLETED_OFFSET).fetch_add(1);
+    Finished(1);
+
+    return true;
+}
+
+bool MemoryNetDevice::Receive(std::span<const Byte> frame) {
+    return Receive([frame](std::span<const std::span<Byte>> buffer) -> size_t {
+        size_t copied = 0;
+        for (auto piece : buffer) {
+            auto count = std::min(piece.size(), frame.size() - copied);
+            std::memcpy(piece.data(), frame.data() + copied, count);
+            copied += count;
+        }
+
+        return frame.size();
+    });
+}
+
+void MemoryNetDevice::Finished(Long frames) {
+    bool raise = false;
+
+    {
+        std::lock_guard guard(interrupt_lock);
+        unsignalled += frames;
+
+        Long bound = Register(COALESCE_FRAMES_OFFSET);
+        Long micros = Register(COALESCE_MICROS_OFFSET);
+
+        if (unsignalled == 0) return;
+
+        if (micros == 0 || (bound != 0 && unsignalled >= bound))
+            raise = true;
+
+        else if (!deadline || *deadline - std::chrono::steady_clock::now() > std::chrono::microseconds(micros)) {
+            deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(micros);
+            interrupt_signal.notify_one();
+        }
+    }
+
+    if (raise) SetInterrupt(true);
+}
+
+void MemoryNetDevice::Coalesce(std::stop_token stop) {
+    std::unique_lock guard(interrupt_lock);
+
+    while (!stop.stop_requested()) {
+        if (!deadline) {
+            interrupt_signal.wait(guard, stop, [&]() { return deadline.has_value(); });
+            continue;
+        }
+
+        auto until = *deadline;
+        if (interrupt_signal.wait_until(guard, stop, until, [&]() { return !deadline || *deadline != until; }))
+            continue;
+
+        if (stop.stop_requested()) break;
+
+        guard.unlock();
+        SetInterrupt(true);
+        guard.lock();
+    }
+}
+
+void MemoryNetDevice::SetInterrupt(bool pending) {
+    if (pending) {
+        std::lock_guard guard(interrupt_lock);
+        unsignalled = 0;
+        deadline.reset();
+    }
+
+    Register(INTERRUPT_OFFSET) = pending;
+
+    if (!memory) return;
+
+    // Routed by the PLIC when there is one
+    if (auto plic = memory->FindMemoryRegionOfType<MemoryPLIC>(TYPE_PLIC)) {
+        plic->SetLevel(MemoryPLIC::SOURCE_NET, pending);
+        return;
+    }
+
+    auto clint = memory->FindMemoryRegionOfType<MemoryCLINT>(TYPE_CLINT);
+    if (clint) clint->SetInterruptPending(Register(INTERRUPT_HART_OFFSET), VirtualMachine::INTERRUPT_MACHINE_EXTERNAL, pending);
+}
+
+std::shared_ptr<MemoryNetDevice> MemoryNetDevice::Create(Long mac, Address base) {
+    return std::shared_ptr<MemoryNetDevice>(new MemoryNetDevice(base, mac));
+}
+
+std::shared_ptr<MemoryNetDevice::Backend> MemoryNetDevice::CreateTAP(const std::string& name) {
+#if defined(__linux__)
+    int file = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (file < 0)
+        throw std::runtime_error("Could not open /dev/net/tun");
+
+    ifreq request{};
+    request.ifr_flags = IFF_TAP | IFF_NO_PI;
+    std::strncpy(request.ifr_name, name.c_str(), IFNAMSIZ - 1);
+
+    if (ioctl(file, TUNSETIFF, &request) < 0) {
+        close(file);
+        throw std::runtime_error(std::format("Could not attach to TAP interface {}", name));
+    }
+
+    return std::make_shared<TAPBackend>(file);
+#else
+    throw std::runtime_error(std::format("TAP interface {} needs Linux", name));
+#endif
+}
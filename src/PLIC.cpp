@@ -0,0 +1,193 @@
+#include "PLIC.hpp"
+
+#include "CLINT.hpp"
+#include "VirtualMachine.hpp"
+
+#include <algorithm>
+#include <bit>
+
+MemoryPLIC::MemoryPLIC(Address base) : MemoryRegion(TYPE_PLIC, 0, base, SIZE, true, true) {}
+
+// Context registers are single words, so a 64 bit access to the threshold
+// doesn't claim on the way
+Long MemoryPLIC::ReadLong(Address address) const {
+    if (address >= CONTEXT_OFFSET) return ReadWord(address);
+
+    return ReadWord(address) | static_cast<Long>(ReadWord(address + 4)) << 32;
+}
+
+Word MemoryPLIC::ReadWord(Address address) const {
+    if (address < PENDING_OFFSET) {
+        auto source = (address - PRIORITY_OFFSET) / 4;
+        return source < SOURCES ? priorities[source].load() : 0;
+    }
+
+    if (address < ENABLE_OFFSET) {
+        auto word = (address - PENDING_OFFSET) / 4;
+        return word < SOURCES / 32 ? static_cast<Word>(pending.load() >> (word * 32)) : 0;
+    }
+
+    if (address < CONTEXT_OFFSET) {
+        auto context = (address - ENABLE_OFFSET) / ENABLE_STRIDE;
+        auto word = (address - ENABLE_OFFSET) % ENABLE_STRIDE / 4;
+        if (context >= CONTEXTS || word >= SOURCES / 32) return 0;
+
+        return static_cast<Word>(contexts[context].enabled.load() >> (word * 32));
+    }
+
+    auto context = (address - CONTEXT_OFFSET) / CONTEXT_STRIDE;
+    if (context >= CONTEXTS) return 0;
+
+    switch ((address - CONTEXT_OFFSET) % CONTEXT_STRIDE) {
+        case THRESHOLD_OFFSET:
+            return contexts[context].threshold.load();
+
+        // Claiming is a side effect of the read, so the const is cast away
+        case CLAIM_OFFSET:
+            return const_cast<MemoryPLIC*>(this)->Claim(context);
+    }
+
+    return 0;
+}
+
+void MemoryPLIC::WriteLong(Address address, Long vlong) {
+    WriteWord(address, static_cast<Word>(vlong));
+    if (address >= CONTEXT_OFFSET) return;
+
+    WriteWord(address + 4, static_cast<Word>(vlong >> 32));
+}
+
+void MemoryPLIC::WriteWord(Address address, Word word) {
+    if (address < PENDING_OFFSET) {
+        auto source = (address - PRIORITY_OFFSET) / 4;
+        if (source == 0 || source >= SOURCES) return;
+
+        priorities[source] = std::min(word, MAX_PRIORITY);
+        Update(1ULL << source);
+        return;
+    }
+
+    // Pending bits are read only
+    if (address < ENABLE_OFFSET) return;
+
+    if (address < CONTEXT_OFFSET) {
+        auto context = (address - ENABLE_OFFSET) / ENABLE_STRIDE;
+        auto index = (address - ENABLE_OFFSET) % ENABLE_STRIDE / 4;
+        if (context >= CONTEXTS || index >= SOURCES / 32) return;
+
+        auto shift = index * 32;
+        Long bits = static_cast<Long>(word) << shift;
+
+        // Source 0 doesn't exist, so it's never enabled
+        if (index == 0) bits &= ~1ULL;
+
+        auto& enabled = contexts[context].enabled;
+        auto old = enabled.load();
+        while (!enabled.compare_exchange_weak(old, (old & ~(0xffffffffULL << shift)) | bits)) {}
+
+        UpdateContext(context);
+        return;
+    }
+
+    auto context = (address - CONTEXT_OFFSET) / CONTEXT_STRIDE;
+    if (context >= CONTEXTS) return;
+
+    switch ((address - CONTEXT_OFFSET) % CONTEXT_STRIDE) {
+        case THRESHOLD_OFFSET:
+            contexts[context].threshold = std::min(word, MAX_PRIORITY);
+            UpdateContext(context);
+            break;
+
+        case CLAIM_OFFSET:
+            Complete(word);
+            break;
+    }
+}
+
+Word MemoryPLIC::Best(Word context) const {
+    auto candidates = pending.load() & contexts[context].enabled.load();
+    auto threshold = contexts[context].threshold.load();
+
+    Word best = 0;
+    Word best_priority = threshold;
+
+    for (; candidates; candidates &= candidates - 1) {
+        Word source = std::countr_zero(candidates);
+        auto priority = priorities[source].load(std::memory_order_relaxed);
+
+        // Ties go to the lowest source, which comes first
+        if (priority > best_priority) {
+            best = source;
+            best_priority = priority;
+        }
+    }
+
+    return best;
+}
+
+Word MemoryPLIC::Claim(Word context) {
+    while (true) {
+        auto source = Best(context);
+        if (source == 0) return 0;
+
+        auto bit = 1ULL << source;
+
+        // Another context may have claimed it first
+        if (pending.fetch_and(~bit) & bit) {
+            in_service.fetch_or(bit);
+            Update(bit);
+            return source;
+        }
+    }
+}
+
+void MemoryPLIC::Complete(Word source) {
+    if (source == 0 || source >= SOURCES) return;
+
+    auto bit = 1ULL << source;
+    in_service.fetch_and(~bit);
+
+    // A line still held up pends again right away
+    if (asserted.load() & bit)
+        pending.fetch_or(bit);
+
+    Update(bit);
+}
+
+void MemoryPLIC::SetLevel(Word source, bool level) {
+    if (source == 0 || source >= SOURCES) return;
+
+    auto bit = 1ULL << source;
+
+    if (level) {
+        asserted.fetch_or(bit);
+        if (!(in_service.load() & bit)) pending.fetch_or(bit);
+    }
+    else {
+        asserted.fetch_and(~bit);
+        pending.fetch_and(~bit);
+    }
+
+    Update(bit);
+}
+
+void MemoryPLIC::Update(Long sources) const {
+    for (Word context = 0; context < CONTEXTS; context++) {
+        if (contexts[context].enabled.load(std::memory_order_relaxed) & sources)
+            UpdateContext(context);
+    }
+}
+
+void MemoryPLIC::UpdateContext(Word context) const {
+    if (!memory) return;
+
+    auto clint = memory->FindMemoryRegionOfType<MemoryCLINT>(TYPE_CLINT);
+    if (!clint) return;
+
+    auto cause = context & 1 ? VirtualMachine::INTERRUPT_SUPERVISOR_EXTERNAL : VirtualMachine::INTERRUPT_MACHINE_EXTERNAL;
+    clint->SetInterruptPending(context / 2, cause, Best(context) != 0);
+}
+
+std::shared_ptr<MemoryPLIC> MemoryPLIC::Create(Address base) {
+    return std::shared_ptr<MemoryPLIC>(new MemoryPLIC(base));
+}
@@ -0,0 +1,150 @@
+#include "Profiler.hpp"
+#include "ELF.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <format>
+#include <stdexcept>
+
+Profiler::Profiler(Profiler&& profiler) {
+    *this = std::move(profiler);
+}
+
+Profiler& Profiler::operator=(Profiler&& profiler) {
+    std::scoped_lock guard(lock, profiler.lock);
+
+    profile = std::move(profiler.profile);
+    countdown = profiler.countdown;
+
+    last_pc = profiler.last_pc;
+    next_pc = profiler.next_pc;
+    counted = profiler.counted;
+
+    branch_stack = profiler.branch_stack;
+    taken_branches = profiler.taken_branches;
+
+    return *this;
+}
+
+void Profiler::Sample(Address pc) {
+    countdown = SAMPLE_PERIOD;
+
+    std::lock_guard guard(lock);
+    profile.pc_samples[pc]++;
+
+    // Oldest first, each run going from one branch's target to the next
+    // branch taken
+    Long depth = std::min<Long>(taken_branches, BRANCH_STACK);
+    for (Long i = taken_branches - depth; i < taken_branches; i++) {
+        const auto& branch = branch_stack[i % BRANCH_STACK];
+        profile.branches[branch]++;
+
+        if (i + 1 == taken_branches) break;
+
+        Address begin = branch.second;
+        Address end = branch_stack[(i + 1) % BRANCH_STACK].first;
+        if (begin <= end) profile.ranges[{begin, end}]++;
+    }
+}
+
+Profiler::Profile Profiler::GetProfile() const {
+    std::lock_guard guard(lock);
+    return profile;
+}
+
+void Profiler::Reset() {
+    std::lock_guard guard(lock);
+    profile = {};
+}
+
+void Profiler::WriteToFile(const std::string& path, const SymbolTable* symbols) const {
+    std::ofstream file(path);
+
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+    }
+
+    auto snapshot = GetProfile();
+
+    for (size_t type = 0; type < RVInstruction::TYPE_COUNT; type++) {
+        if (snapshot.instructions[type] != 0)
+            file << std::format("instruction {} {}\n", GetTypeName(static_cast<RVInstruction::Type>(type)), snapshot.instructions[type]);
+    }
+
+    for (size_t cause = 0; cause < TRAP_CAUSES; cause++) {
+        if (snapshot.exceptions[cause] != 0)
+            file << std::format("exception {} {}\n", cause, snapshot.exceptions[cause]);
+
+        if (snapshot.interrupts[cause] != 0)
+            file << std::format("interrupt {} {}\n", cause, snapshot.interrupts[cause]);
+    }
+
+    file << std::format("tlb instruction_hits {}\n", snapshot.instruction_tlb_hits);
+    file << std::format("tlb instruction_misses {}\n", snapshot.instruction_tlb_misses);
+    file << std::format("tlb data_hits {}\n", snapshot.data_tlb_hits);
+    file << std::format("tlb data_misses {}\n", snapshot.data_tlb_misses);
+
+    std::vector<std::pair<Address, Long>> samples(snapshot.pc_samples.begin(), snapshot.pc_samples.end());
+    std::sort(samples.begin(), samples.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second > rhs.second;
+    });
+
+    for (const auto& [pc, count] : samples) {
+        auto name = symbols ? symbols->Format(pc) : std::string();
+
+        if (name.empty())
+            file << std::format("pc {:x} {}\n", pc, count);
+        else
+            file << std::format("pc {:x} {} {}\n", pc, count, name);
+    }
+}
+
+std::string Profiler::GetTypeName(RVInstruction::Type type) {
+    return std::string(RVInstruction::GetMnemonic(type));
+}
+
+void Profiler::WriteAutoFDO(const std::string& path, std::span<const Profile> profiles, const SymbolTable* symbols) {
+    std::ofstream file(path);
+
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+    }
+
+    auto InFunction = [&](Address address) {
+        auto symbol = symbols->Find(address);
+        return symbol && symbol->is_function ? symbol : nullptr;
+    };
+
+    std::map<Edge, Long> ranges;
+    std::map<Address, Long> addresses;
+    std::map<Edge, Long> branches;
+
+    for (const auto& profile : profiles) {
+        for (const auto& [range, count] : profile.ranges) {
+            if (symbols && (!InFunction(range.first) || InFunction(range.first) != InFunction(range.second))) continue;
+            ranges[range] += count;
+        }
+
+        for (const auto& [pc, count] : profile.pc_samples) {
+            if (symbols && !InFunction(pc)) continue;
+            addresses[pc] += count;
+        }
+
+        for (const auto& [branch, count] : profile.branches) {
+            if (symbols && (!InFunction(branch.first) || !InFunction(branch.second))) continue;
+            branches[branch] += count;
+        }
+    }
+
+    file << std::format("{}\n", ranges.size());
+    for (const auto& [range, count] : ranges)
+        file << std::format("{:x}-{:x}:{}\n", range.first, range.second, count);
+
+    file << std::format("{}\n", addresses.size());
+    for (const auto& [pc, count] : addresses)
+        file << std::format("{:x}:{}\n", pc, count);
+
+    file << std::format("{}\n", branches.size());
+    for (const auto& [branch, count] : branches)
+        file << std::format("{:x}->{:x}:{}\n", branch.first, branch.second, count);
+}
@@ -1,8 +1,14 @@
 #include "RV64.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
 #include <format>
+#include <memory>
+#include <utility>
 
-std::array<std::string, 32> RVInstruction::register_names = {
+const std::array<std::string_view, 32> RVInstruction::register_names = {
     "zero",
     "ra",
     "sp",
@@ -37,7 +43,7 @@ std::array<std::string, 32> RVInstruction::register_names = {
     "t6"
 };
 
-std::array<std::string, 32> RVInstruction::fregister_names = {
+const std::array<std::string_view, 32> RVInstruction::fregister_names = {
     "ft0",
     "ft1",
     "ft2",
@@ -72,703 +78,970 @@ std::array<std::string, 32> RVInstruction::fregister_names = {
     "ft11"
 };
 
-std::array<std::string, 4096> RVInstruction::csr_names = {};
+namespace {
 
-void RVInstruction::SetupCSRNames() {
-    for (size_t i = 0; i < csr_names.size(); i++) {
-        csr_names[i] = std::format("csr{}", i);
+// How a type's operands are written after its mnemonic
+enum class Syntax : Byte {
+    None,
+    RdUpper,
+    RdOffset,
+    RdRs1Offset,
+    Rs1Rs2Offset,
+    RdLoad,
+    Rs2Store,
+    RdRs1Imm,
+    RdRs1Shamt,
+    RdRs1Rs2,
+    RdRs1,
+    Rs1Rs2,
+    RdCsrRs1,
+    RdCsrUimm,
+    RdAddress,
+    RdRs2Address,
+    FrdLoad,
+    Frs2Store,
+    FrdFrs1Frs2Frs3,
+    FrdFrs1Frs2,
+    FrdFrs1,
+    RdFrs1,
+    RdFrs1Frs2,
+    FrdRs1,
+    VSetVli,
+    VSetIvli,
+    VdAddress,
+    VdAddressRs2,
+    VdVs2Vs1,
+    VdVs2Rs1,
+    VdVs2Imm,
+    VdVs2Uimm,
+    VdVs2Frs1,
+    VdVs1Vs2,
+    VdRs1Vs2,
+    VdFrs1Vs2,
+    VdVs1,
+    VdRs1,
+    VdImm,
+    VdFrs1,
+    RdVs2,
+    FrdVs2
+};
+
+struct InstructionSyntax {
+    std::string_view mnemonic;
+    Syntax syntax;
+};
+
+// Indexed by Type, in the same order
+constexpr std::array<InstructionSyntax, RVInstruction::TYPE_COUNT> instruction_syntax = {{
+    {"LUI", Syntax::RdUpper},
+    {"AUIPC", Syntax::RdUpper},
+    {"JAL", Syntax::RdOffset},
+    {"JALR", Syntax::RdRs1Offset},
+    {"BEQ", Syntax::Rs1Rs2Offset},
+    {"BNE", Syntax::Rs1Rs2Offset},
+    {"BLT", Syntax::Rs1Rs2Offset},
+    {"BGE", Syntax::Rs1Rs2Offset},
+    {"BLTU", Syntax::Rs1Rs2Offset},
+    {"BGEU", Syntax::Rs1Rs2Offset},
+    {"LB", Syntax::RdLoad},
+    {"LH", Syntax::RdLoad},
+    {"LW", Syntax::RdLoad},
+    {"LBU", Syntax::RdLoad},
+    {"LHU", Syntax::RdLoad},
+    {"SB", Syntax::Rs2Store},
+    {"SH", Syntax::Rs2Store},
+    {"SW", Syntax::Rs2Store},
+    {"ADDI", Syntax::RdRs1Imm},
+    {"SLTI", Syntax::RdRs1Imm},
+    {"SLTIU", Syntax::RdRs1Imm},
+    {"XORI", Syntax::RdRs1Imm},
+    {"ORI", Syntax::RdRs1Imm},
+    {"ANDI", Syntax::RdRs1Imm},
+    {"SLLI", Syntax::RdRs1Shamt},
+    {"SRLI", Syntax::RdRs1Shamt},
+    {"SRAI", Syntax::RdRs1Shamt},
+    {"ADD", Syntax::RdRs1Rs2},
+    {"SUB", Syntax::RdRs1Rs2},
+    {"SLL", Syntax::RdRs1Rs2},
+    {"SLT", Syntax::RdRs1Rs2},
+    {"SLTU", Syntax::RdRs1Rs2},
+    {"XOR", Syntax::RdRs1Rs2},
+    {"SRL", Syntax::RdRs1Rs2},
+    {"SRA", Syntax::RdRs1Rs2},
+    {"OR", Syntax::RdRs1Rs2},
+    {"AND", Syntax::RdRs1Rs2},
+    {"FENCE", Syntax::None},
+    {"FENCE.I", Syntax::None},
+    {"ECALL", Syntax::None},
+    {"EBREAK", Syntax::None},
+    {"LWU", Syntax::RdLoad},
+    {"LD", Syntax::RdLoad},
+    {"SD", Syntax::Rs2Store},
+    {"ADDIW", Syntax::RdRs1Imm},
+    {"SLLIW", Syntax::RdRs1Shamt},
+    {"SRLIW", Syntax::RdRs1Shamt},
+    {"SRAIW", Syntax::RdRs1Shamt},
+    {"ADDW", Syntax::RdRs1Rs2},
+    {"SUBW", Syntax::RdRs1Rs2},
+    {"SLLW", Syntax::RdRs1Rs2},
+    {"SRLW", Syntax::RdRs1Rs2},
+    {"SRAW", Syntax::RdRs1Rs2},
+    {"CSRRW", Syntax::RdCsrRs1},
+    {"CSRRS", Syntax::RdCsrRs1},
+    {"CSRRC", Syntax::RdCsrRs1},
+    {"CSRRWI", Syntax::RdCsrUimm},
+    {"CSRRSI", Syntax::RdCsrUimm},
+    {"CSRRCI", Syntax::RdCsrUimm},
+    {"MUL", Syntax::RdRs1Rs2},
+    {"MULH", Syntax::RdRs1Rs2},
+    {"MULHSU", Syntax::RdRs1Rs2},
+    {"MULHU", Syntax::RdRs1Rs2},
+    {"DIV", Syntax::RdRs1Rs2},
+    {"DIVU", Syntax::RdRs1Rs2},
+    {"REM", Syntax::RdRs1Rs2},
+    {"REMU", Syntax::RdRs1Rs2},
+    {"MULW", Syntax::RdRs1Rs2},
+    {"DIVW", Syntax::RdRs1Rs2},
+    {"DIVUW", Syntax::RdRs1Rs2},
+    {"REMW", Syntax::RdRs1Rs2},
+    {"REMUW", Syntax::RdRs1Rs2},
+    {"LR.W", Syntax::RdAddress},
+    {"SC.W", Syntax::RdRs2Address},
+    {"AMOSWAP.W", Syntax::RdRs2Address},
+    {"AMOADD.W", Syntax::RdRs2Address},
+    {"AMOXOR.W", Syntax::RdRs2Address},
+    {"AMOAND.W", Syntax::RdRs2Address},
+    {"AMOOR.W", Syntax::RdRs2Address},
+    {"AMOMIN.W", Syntax::RdRs2Address},
+    {"AMOMAX.W", Syntax::RdRs2Address},
+    {"AMOMINU.W", Syntax::RdRs2Address},
+    {"AMOMAXU.W", Syntax::RdRs2Address},
+    {"LR.D", Syntax::RdAddress},
+    {"SC.D", Syntax::RdRs2Address},
+    {"AMOSWAP.D", Syntax::RdRs2Address},
+    {"AMOADD.D", Syntax::RdRs2Address},
+    {"AMOXOR.D", Syntax::RdRs2Address},
+    {"AMOAND.D", Syntax::RdRs2Address},
+    {"AMOOR.D", Syntax::RdRs2Address},
+    {"AMOMIN.D", Syntax::RdRs2Address},
+    {"AMOMAX.D", Syntax::RdRs2Address},
+    {"AMOMINU.D", Syntax::RdRs2Address},
+    {"AMOMAXU.D", Syntax::RdRs2Address},
+    {"FLW", Syntax::FrdLoad},
+    {"FSW", Syntax::Frs2Store},
+    {"FMADD.S", Syntax::FrdFrs1Frs2Frs3},
+    {"FMSUB.S", Syntax::FrdFrs1Frs2Frs3},
+    {"FNMSUB.S", Syntax::FrdFrs1Frs2Frs3},
+    {"FNMADD.S", Syntax::FrdFrs1Frs2Frs3},
+    {"FADD.S", Syntax::FrdFrs1Frs2},
+    {"FSUB.S", Syntax::FrdFrs1Frs2},
+    {"FMUL.S", Syntax::FrdFrs1Frs2},
+    {"FDIV.S", Syntax::FrdFrs1Frs2},
+    {"FSQRT.S", Syntax::FrdFrs1},
+    {"FSGNJ.S", Syntax::FrdFrs1Frs2},
+    {"FSGNJN.S", Syntax::FrdFrs1Frs2},
+    {"FSGNJX.S", Syntax::FrdFrs1Frs2},
+    {"FMIN.S", Syntax::FrdFrs1Frs2},
+    {"FMAX.S", Syntax::FrdFrs1Frs2},
+    {"FCVT.W.S", Syntax::RdFrs1},
+    {"FCVT.WU.S", Syntax::RdFrs1},
+    {"FMV.X.W", Syntax::RdFrs1},
+    {"FEQ.S", Syntax::RdFrs1Frs2},
+    {"FLT.S", Syntax::RdFrs1Frs2},
+    {"FLE.S", Syntax::RdFrs1Frs2},
+    {"FCLASS.S", Syntax::RdFrs1},
+    {"FCVT.S.W", Syntax::FrdRs1},
+    {"FCVT.S.WU", Syntax::FrdRs1},
+    {"FMV.W.X", Syntax::FrdRs1},
+    {"FCVT.L.S", Syntax::RdFrs1},
+    {"FCVT.LU.S", Syntax::RdFrs1},
+    {"FCVT.S.L", Syntax::FrdRs1},
+    {"FCVT.S.LU", Syntax::FrdRs1},
+    {"FLD", Syntax::FrdLoad},
+    {"FSD", Syntax::Frs2Store},
+    {"FMADD.D", Syntax::FrdFrs1Frs2Frs3},
+    {"FMSUB.D", Syntax::FrdFrs1Frs2Frs3},
+    {"FNMSUB.D", Syntax::FrdFrs1Frs2Frs3},
+    {"FNMADD.D", Syntax::FrdFrs1Frs2Frs3},
+    {"FADD.D", Syntax::FrdFrs1Frs2},
+    {"FSUB.D", Syntax::FrdFrs1Frs2},
+    {"FMUL.D", Syntax::FrdFrs1Frs2},
+    {"FDIV.D", Syntax::FrdFrs1Frs2},
+    {"FSQRT.D", Syntax::FrdFrs1},
+    {"FSGNJ.D", Syntax::FrdFrs1Frs2},
+    {"FSGNJN.D", Syntax::FrdFrs1Frs2},
+    {"FSGNJX.D", Syntax::FrdFrs1Frs2},
+    {"FMIN.D", Syntax::FrdFrs1Frs2},
+    {"FMAX.D", Syntax::FrdFrs1Frs2},
+    {"FCVT.S.D", Syntax::FrdFrs1},
+    {"FCVT.D.S", Syntax::FrdFrs1},
+    {"FEQ.D", Syntax::RdFrs1Frs2},
+    {"FLT.D", Syntax::RdFrs1Frs2},
+    {"FLE.D", Syntax::RdFrs1Frs2},
+    {"FCLASS.D", Syntax::RdFrs1},
+    {"FCVT.W.D", Syntax::RdFrs1},
+    {"FCVT.WU.D", Syntax::RdFrs1},
+    {"FCVT.D.W", Syntax::FrdRs1},
+    {"FCVT.D.WU", Syntax::FrdRs1},
+    {"FCVT.L.D", Syntax::RdFrs1},
+    {"FCVT.LU.D", Syntax::RdFrs1},
+    {"FMV.X.D", Syntax::RdFrs1},
+    {"FCVT.D.L", Syntax::FrdRs1},
+    {"FCVT.D.LU", Syntax::FrdRs1},
+    {"FMV.D.X", Syntax::FrdRs1},
+    {"ADD.UW", Syntax::RdRs1Rs2},
+    {"SH1ADD", Syntax::RdRs1Rs2},
+    {"SH2ADD", Syntax::RdRs1Rs2},
+    {"SH3ADD", Syntax::RdRs1Rs2},
+    {"SH1ADD.UW", Syntax::RdRs1Rs2},
+    {"SH2ADD.UW", Syntax::RdRs1Rs2},
+    {"SH3ADD.UW", Syntax::RdRs1Rs2},
+    {"SLLI.UW", Syntax::RdRs1Shamt},
+    {"ANDN", Syntax::RdRs1Rs2},
+    {"ORN", Syntax::RdRs1Rs2},
+    {"XNOR", Syntax::RdRs1Rs2},
+    {"CLZ", Syntax::RdRs1},
+    {"CLZW", Syntax::RdRs1},
+    {"CTZ", Syntax::RdRs1},
+    {"CTZW", Syntax::RdRs1},
+    {"CPOP", Syntax::RdRs1},
+    {"CPOPW", Syntax::RdRs1},
+    {"MAX", Syntax::RdRs1Rs2},
+    {"MAXU", Syntax::RdRs1Rs2},
+    {"MIN", Syntax::RdRs1Rs2},
+    {"MINU", Syntax::RdRs1Rs2},
+    {"SEXT.B", Syntax::RdRs1},
+    {"SEXT.H", Syntax::RdRs1},
+    {"ZEXT.H", Syntax::RdRs1},
+    {"ROL", Syntax::RdRs1Rs2},
+    {"ROLW", Syntax::RdRs1Rs2},
+    {"ROR", Syntax::RdRs1Rs2},
+    {"RORI", Syntax::RdRs1Shamt},
+    {"RORIW", Syntax::RdRs1Shamt},
+    {"RORW", Syntax::RdRs1Rs2},
+    {"ORC.B", Syntax::RdRs1},
+    {"REV8", Syntax::RdRs1},
+    {"BCLR", Syntax::RdRs1Rs2},
+    {"BCLRI", Syntax::RdRs1Shamt},
+    {"BEXT", Syntax::RdRs1Rs2},
+    {"BEXTI", Syntax::RdRs1Shamt},
+    {"BINV", Syntax::RdRs1Rs2},
+    {"BINVI", Syntax::RdRs1Shamt},
+    {"BSET", Syntax::RdRs1Rs2},
+    {"BSETI", Syntax::RdRs1Shamt},
+    {"VSETVLI", Syntax::VSetVli},
+    {"VSETIVLI", Syntax::VSetIvli},
+    {"VSETVL", Syntax::RdRs1Rs2},
+    {"VLE8.V", Syntax::VdAddress},
+    {"VLE16.V", Syntax::VdAddress},
+    {"VLE32.V", Syntax::VdAddress},
+    {"VLE64.V", Syntax::VdAddress},
+    {"VSE8.V", Syntax::VdAddress},
+    {"VSE16.V", Syntax::VdAddress},
+    {"VSE32.V", Syntax::VdAddress},
+    {"VSE64.V", Syntax::VdAddress},
+    {"VLSE8.V", Syntax::VdAddressRs2},
+    {"VLSE16.V", Syntax::VdAddressRs2},
+    {"VLSE32.V", Syntax::VdAddressRs2},
+    {"VLSE64.V", Syntax::VdAddressRs2},
+    {"VSSE8.V", Syntax::VdAddressRs2},
+    {"VSSE16.V", Syntax::VdAddressRs2},
+    {"VSSE32.V", Syntax::VdAddressRs2},
+    {"VSSE64.V", Syntax::VdAddressRs2},
+    {"VADD.VV", Syntax::VdVs2Vs1},
+    {"VADD.VX", Syntax::VdVs2Rs1},
+    {"VADD.VI", Syntax::VdVs2Imm},
+    {"VSUB.VV", Syntax::VdVs2Vs1},
+    {"VSUB.VX", Syntax::VdVs2Rs1},
+    {"VRSUB.VX", Syntax::VdVs2Rs1},
+    {"VRSUB.VI", Syntax::VdVs2Imm},
+    {"VAND.VV", Syntax::VdVs2Vs1},
+    {"VAND.VX", Syntax::VdVs2Rs1},
+    {"VAND.VI", Syntax::VdVs2Imm},
+    {"VOR.VV", Syntax::VdVs2Vs1},
+    {"VOR.VX", Syntax::VdVs2Rs1},
+    {"VOR.VI", Syntax::VdVs2Imm},
+    {"VXOR.VV", Syntax::VdVs2Vs1},
+    {"VXOR.VX", Syntax::VdVs2Rs1},
+    {"VXOR.VI", Syntax::VdVs2Imm},
+    {"VSLL.VV", Syntax::VdVs2Vs1},
+    {"VSLL.VX", Syntax::VdVs2Rs1},
+    {"VSLL.VI", Syntax::VdVs2Uimm},
+    {"VSRL.VV", Syntax::VdVs2Vs1},
+    {"VSRL.VX", Syntax::VdVs2Rs1},
+    {"VSRL.VI", Syntax::VdVs2Uimm},
+    {"VSRA.VV", Syntax::VdVs2Vs1},
+    {"VSRA.VX", Syntax::VdVs2Rs1},
+    {"VSRA.VI", Syntax::VdVs2Uimm},
+    {"VMUL.VV", Syntax::VdVs2Vs1},
+    {"VMUL.VX", Syntax::VdVs2Rs1},
+    {"VMACC.VV", Syntax::VdVs1Vs2},
+    {"VMACC.VX", Syntax::VdRs1Vs2},
+    {"VREDSUM.VS", Syntax::VdVs2Vs1},
+    {"VMV.V.V", Syntax::VdVs1},
+    {"VMV.V.X", Syntax::VdRs1},
+    {"VMV.V.I", Syntax::VdImm},
+    {"VMV.X.S", Syntax::RdVs2},
+    {"VMV.S.X", Syntax::VdRs1},
+    {"VFADD.VV", Syntax::VdVs2Vs1},
+    {"VFADD.VF", Syntax::VdVs2Frs1},
+    {"VFSUB.VV", Syntax::VdVs2Vs1},
+    {"VFSUB.VF", Syntax::VdVs2Frs1},
+    {"VFMUL.VV", Syntax::VdVs2Vs1},
+    {"VFMUL.VF", Syntax::VdVs2Frs1},
+    {"VFDIV.VV", Syntax::VdVs2Vs1},
+    {"VFDIV.VF", Syntax::VdVs2Frs1},
+    {"VFMACC.VV", Syntax::VdVs1Vs2},
+    {"VFMACC.VF", Syntax::VdFrs1Vs2},
+    {"VFREDUSUM.VS", Syntax::VdVs2Vs1},
+    {"VFMV.V.F", Syntax::VdFrs1},
+    {"VFMV.F.S", Syntax::FrdVs2},
+    {"VFMV.S.F", Syntax::VdFrs1},
+    {"SRET", Syntax::None},
+    {"MRET", Syntax::None},
+    {"WFI", Syntax::None},
+    {"SFENCE.VMA", Syntax::Rs1Rs2},
+    {"SINVAL.VMA", Syntax::Rs1Rs2},
+    {"SINVAL.GVMA", Syntax::Rs1Rs2},
+    {"SFENCE.W.INVAL", Syntax::None},
+    {"SFENCE.INVAL.IR", Syntax::None},
+    {"INVALID", Syntax::None},
+    {"CUST.TVA", Syntax::RdRs1},
+    {"CUST.MTRAP", Syntax::Rs1Rs2},
+    {"CUST.STRAP", Syntax::Rs1Rs2},
+}};
+
+static_assert(instruction_syntax[static_cast<size_t>(RVInstruction::Type::CUST_STRAP)].mnemonic == "CUST.STRAP");
+
+// Decoding first picks a bucket by opcode and funct3, then takes the first
+// encoding in it whose mask matches. Buckets list the most specific masks
+// first, so ECALL is tried before the SYSTEM encodings that ignore rs2
+constexpr size_t BUCKET_COUNT = 1 << 10;
+
+constexpr size_t BucketOf(Word raw) {
+    return (raw & RVInstruction::MASK_OPCODE) << 3 | (raw >> 12 & 0b111);
+}
+
+constexpr bool InBucket(const RVInstruction::Encoding& encoding, size_t bucket) {
+    Word fields = RVInstruction::Fields(bucket >> 3, bucket & 0b111);
+    return (fields & encoding.mask & RVInstruction::MASK_FUNCT3) == (encoding.match & RVInstruction::MASK_FUNCT3);
+}
+
+constexpr size_t CountCandidates() {
+    size_t count = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++)
+        for (auto& encoding : RVInstruction::encodings)
+            count += InBucket(encoding, bucket);
+
+    return count;
+}
+
+constexpr size_t CANDIDATE_COUNT = CountCandidates();
+
+static_assert(RVInstruction::TYPE_COUNT <= 0x10000 && CANDIDATE_COUNT <= 0x10000);
+
+struct DecodeBucket {
+    Half first;
+    Byte count;
+};
+
+struct DecodeTables {
+    std::array<DecodeBucket, BUCKET_COUNT> buckets{};
+    std::array<Half, CANDIDATE_COUNT> candidates{};
+};
+
+constexpr DecodeTables decode_tables = [] {
+    DecodeTables tables;
+    auto specificity = [](Half type) { return std::popcount(RVInstruction::encodings[type].mask); };
+
+    size_t next = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+        size_t first = next;
+
+        for (size_t type = 0; type < RVInstruction::TYPE_COUNT; type++) {
+            if (!InBucket(RVInstruction::encodings[type], bucket)) continue;
+
+            size_t at = next++;
+            for (; at > first && specificity(tables.candidates[at - 1]) < specificity(type); at--)
+                tables.candidates[at] = tables.candidates[at - 1];
+
+            tables.candidates[at] = type;
+        }
+
+        tables.buckets[bucket] = {static_cast<Half>(first), static_cast<Byte>(next - first)};
     }
 
-    csr_names[0x001] = "fflags";
-    csr_names[0x002] = "frm";
-    csr_names[0x003] = "fcsr";
+    return tables;
+}();
+
+// Encodings that share a word must be strictly ordered by specificity,
+// otherwise which one wins would depend on table order
+constexpr bool IsUnambiguous() {
+    for (auto& bucket : decode_tables.buckets) {
+        for (size_t i = bucket.first; i < bucket.first + bucket.count; i++) {
+            for (size_t j = i + 1; j < bucket.first + bucket.count; j++) {
+                auto& a = RVInstruction::encodings[decode_tables.candidates[i]];
+                auto& b = RVInstruction::encodings[decode_tables.candidates[j]];
 
-    csr_names[0xc00] = "cycle";
-    csr_names[0xc01] = "time";
-    csr_names[0xc02] = "instret";
-    
-    for (size_t i = 3; i < 32; i++) {
-        csr_names[0xc00 + i] = std::format("hpmcounter{}", i);
+                bool overlap = ((a.match ^ b.match) & a.mask & b.mask) == 0;
+                if (overlap && ((a.mask & b.mask) != b.mask || a.mask == b.mask)) return false;
+            }
+        }
     }
 
-    csr_names[0xc80] = "cycleh";
-    csr_names[0xc81] = "timeh";
-    csr_names[0xc82] = "instreth";
+    return true;
+}
+
+static_assert(IsUnambiguous());
+
+template <size_t... I>
+constexpr bool IsInTypeOrder(std::index_sequence<I...>) {
+    return ((RVInstruction::encodings[I].type == static_cast<RVInstruction::Type>(I)) && ...);
+}
+
+static_assert(IsInTypeOrder(std::make_index_sequence<RVInstruction::TYPE_COUNT>()));
 
-    for (size_t i = 3; i < 32; i++) {
-        csr_names[0xc80 + i] = std::format("hpmcounterh{}", i);
+// Appends to a caller's buffer, dropping whatever doesn't fit and always
+// leaving room for the terminator
+class LineWriter {
+    char* const start;
+    char* at;
+    char* const end;
+
+public:
+    LineWriter(char* buffer, size_t size) : start{buffer}, at{buffer}, end{buffer + size - 1} {}
+
+    inline void Put(std::string_view text) {
+        size_t count = std::min<size_t>(text.size(), end - at);
+        std::memcpy(at, text.data(), count);
+        at += count;
+    }
+
+    inline void Put(char c) {
+        if (at < end) *at++ = c;
+    }
+
+    template <typename T>
+    inline void Number(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        Put(std::string_view(digits, result.ptr - digits));
+    }
+
+    inline void Separator() { Put(", "); }
+
+    inline void Register(Byte reg) { Put(RVInstruction::register_names[reg & 0x1f]); }
+    inline void FloatRegister(Byte reg) { Put(RVInstruction::fregister_names[reg & 0x1f]); }
+
+    inline void VectorRegister(Byte reg) {
+        Put('v');
+        Number(reg & 0x1f);
+    }
+
+    // Masked vector instructions end with the mask operand
+    inline void Mask(Byte vm) {
+        if (!vm) Put(", v0.t");
     }
 
-    csr_names[0x100] = "sstatus";
-    csr_names[0x104] = "sie";
-    csr_names[0x105] = "stvec";
-    csr_names[0x106] = "scounteren";
-    csr_names[0x10a] = "senvcfg";
-    csr_names[0x140] = "sscratch";
-    csr_names[0x141] = "sepc";
-    csr_names[0x142] = "scause";
-    csr_names[0x143] = "stval";
-    csr_names[0x144] = "sip";
-    csr_names[0x180] = "satp";
-    csr_names[0x5a8] = "scontext";
-
-    csr_names[0xf11] = "mvendorid";
-    csr_names[0xf12] = "marchid";
-    csr_names[0xf13] = "mimpid";
-    csr_names[0xf14] = "mhartid";
-    csr_names[0xf15] = "mconfigptr";
-    csr_names[0x300] = "mstatus";
-    csr_names[0x301] = "misa";
-    csr_names[0x302] = "medeleg";
-    csr_names[0x303] = "mideleg";
-    csr_names[0x304] = "mie";
-    csr_names[0x305] = "mtvec";
-    csr_names[0x306] = "mcounteren";
-    csr_names[0x310] = "mstatush";
-    csr_names[0x340] = "mscratch";
-    csr_names[0x341] = "mepc";
-    csr_names[0x342] = "mcause";
-    csr_names[0x343] = "mtval";
-    csr_names[0x344] = "mip";
-    csr_names[0x34a] = "mtinst";
-    csr_names[0x34b] = "mtval2";
-
-    for (size_t i = 0; i < 64; i++) {
-        csr_names[0x3a0 + i] = std::format("pmpcfg{}", i);
+    // e32, m1, ta, ma
+    inline void VectorType(Long vtype) {
+        Put('e');
+        Number(8 << (vtype >> 3 & 0b111));
+
+        auto lmul = vtype & 0b111;
+        Put(lmul & 0b100 ? ", mf" : ", m");
+        Number(lmul & 0b100 ? 1 << (8 - lmul) : 1 << lmul);
+
+        Put(vtype & (1 << 6) ? ", ta" : ", tu");
+        Put(vtype & (1 << 7) ? ", ma" : ", mu");
     }
 
-    csr_names[0xb00] = "mcycle";
-    csr_names[0xb02] = "minstret";
-    
-    for (size_t i = 3; i < 32; i++) {
-        csr_names[0xb00 + i] = std::format("mhpmcounter{}", i);
+    // offset(base)
+    inline void Address(SLong offset, Byte base) {
+        Number(offset);
+        Put('(');
+        Register(base);
+        Put(')');
     }
 
-    csr_names[0xb80] = "mcycleh";
-    csr_names[0xb82] = "minstreth";
-    
-    for (size_t i = 3; i < 32; i++) {
-        csr_names[0xb80 + i] = std::format("mhpmcounterh{}", i);
+    // Negative immediates also show their unsigned value
+    inline void Immediate(Long immediate) {
+        auto value = static_cast<SLong>(immediate);
+        Number(value);
+
+        if (value < 0) {
+            Put(" (");
+            Number(immediate);
+            Put(')');
+        }
     }
-    
-    csr_names[0x7a0] = "tselect";
-    csr_names[0x7a1] = "tdata1";
-    csr_names[0x7a2] = "tdata2";
-    csr_names[0x7a3] = "tdata3";
-    csr_names[0x7a8] = "mcontext";
+
+    inline size_t Finish() {
+        *at = 0;
+        return at - start;
+    }
+};
+
 }
 
-RVInstruction::operator std::string() {
-    std::string s;
+std::string_view RVInstruction::GetMnemonic(Type type) {
+    auto index = static_cast<size_t>(type);
+    return index < TYPE_COUNT ? instruction_syntax[index].mnemonic : std::string_view("UNKNOWN");
+}
 
-    union SU64 {
-        Long u;
-        SLong s;
-    };
+std::string_view RVInstruction::GetCSRName(Half csr) {
+    using Name = std::array<char, 16>;
 
-    SU64 imm;
-    imm.u = immediate;
+    // Built once on first use, every CSR has a name
+    static const auto names = [] {
+        auto names = std::make_unique<std::array<Name, 4096>>();
 
-    auto s_rs2 = register_names[rs2];
-    auto s_rs1 = register_names[rs1];
-    auto s_rd = register_names[rd];
+        auto Set = [&](size_t csr, std::string_view name) {
+            auto& entry = (*names)[csr];
+            auto count = std::min(name.size(), entry.size() - 1);
+            std::memcpy(entry.data(), name.data(), count);
+            entry[count] = 0;
+        };
 
-    auto s_frs3 = fregister_names[rs3];
-    auto s_frs2 = fregister_names[rs2];
-    auto s_frs1 = fregister_names[rs1];
-    auto s_frd = fregister_names[rd];
 
-    std::string s_imm;
-    if (imm.s < 0) s_imm = std::format("{} ({})", imm.s, imm.u);
-    else s_imm = std::format("{}", imm.u);
+        for (size_t i = 0; i < names->size(); i++)
+            Set(i, std::format("csr{}", i));
 
-    switch (type) {
-        case Type::LUI:
-            s = std::format("LUI {}, {}", s_rd, s_imm);
-            break;
-        
-        case Type::AUIPC:
-            s = std::format("AUIPC {}, {}", s_rd, s_imm);
-            break;
-        
-        case Type::JAL:
-            s = std::format("JAL {}, {}", s_rd, imm.s);
-            break;
-        
-        case Type::JALR:
-            s = std::format("JALR {}, {}, {}", s_rd, s_rs1, imm.s);
-            break;
-        
-        case Type::BEQ:
-            s = std::format("BEQ {}, {}, {}", s_rs1, s_rs2, imm.s);
-            break;
-        
-        case Type::BNE:
-            s = std::format("BNE {}, {}, {}", s_rs1, s_rs2, imm.s);
-            break;
-        
-        case Type::BLT:
-            s = std::format("BLT {}, {}, {}", s_rs1, s_rs2, imm.s);
-            break;
-        
-        case Type::BGE:
-            s = std::format("BGE {}, {}, {}", s_rs1, s_rs2, imm.s);
-            break;
-        
-        case Type::BLTU:
-            s = std::format("BLTU {}, {}, {}", s_rs1, s_rs2, imm.s);
-            break;
-        
-        case Type::BGEU:
-            s = std::format("BGEU {}, {}, {}", s_rs1, s_rs2, imm.s);
-            break;
-        
-        case Type::LB:
-            s = std::format("LB {}, {}({})", s_rd, imm.s, s_rs1);
-            break;
-        
-        case Type::LH:
-            s = std::format("LH {}, {}({})", s_rd, imm.s, s_rs1);
-            break;
-        
-        case Type::LW:
-            s = std::format("LW {}, {}({})", s_rd, imm.s, s_rs1);
-            break;
-        
-        case Type::LBU:
-            s = std::format("LBU {}, {}({})", s_rd, imm.s, s_rs1);
-            break;
-        
-        case Type::LHU:
-            s = std::format("LHU {}, {}({})", s_rd, imm.s, s_rs1);
-            break;
-        
-        case Type::SB:
-            s = std::format("SB {}, {}({})", s_rs2, imm.s, s_rs1);
-            break;
-        
-        case Type::SH:
-            s = std::format("SH {}, {}({})", s_rs2, imm.s, s_rs1);
-            break;
-        
-        case Type::SW:
-            s = std::format("SW {}, {}({})", s_rs2, imm.s, s_rs1);
-            break;
-        
-        case Type::ADDI:
-            s = std::format("ADDI {}, {}, {}", s_rd, s_rs1, s_imm);
-            break;
-        
-        case Type::SLTI:
-            s = std::format("SLTI {}, {}, {}", s_rd, s_rs1, s_imm);
-            break;
-        
-        case Type::SLTIU:
-            s = std::format("SLTIU {}, {}, {}", s_rd, s_rs1, s_imm);
-            break;
-        
-        case Type::XORI:
-            s = std::format("XORI {}, {}, {}", s_rd, s_rs1, s_imm);
-            break;
-        
-        case Type::ORI:
-            s = std::format("ORI {}, {}, {}", s_rd, s_rs1, s_imm);
-            break;
-        
-        case Type::ANDI:
-            s = std::format("ANDI {}, {}, {}", s_rd, s_rs1, s_imm);
-            break;
-        
-        case Type::SLLI:
-            s = std::format("SLLI {}, {}, {}", s_rd, s_rs1, imm.u & 0b111111);
-            break;
-        
-        case Type::SRLI:
-            s = std::format("SRLI {}, {}, {}", s_rd, s_rs1, imm.u & 0b11111);
-            break;
-        
-        case Type::SRAI:
-            s = std::format("SRAI {}, {}, {}", s_rd, s_rs1, imm.u & 0b11111);
-            break;
-        
-        case Type::ADD:
-            s = std::format("ADD {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::SUB:
-            s = std::format("SUB {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::SLL:
-            s = std::format("SLL {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::SLT:
-            s = std::format("SLT {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::SLTU:
-            s = std::format("SLTU {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::XOR:
-            s = std::format("XOR {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::SRL:
-            s = std::format("SRL {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::SRA:
-            s = std::format("SRA {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::OR:
-            s = std::format("OR {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AND:
-            s = std::format("AND {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::FENCE:
-            s = std::format("FENCE");
-            break;
-        
-        case Type::ECALL:
-            s = std::format("ECALL");
-            break;
-        
-        case Type::EBREAK:
-            s = std::format("EBREAK");
-            break;
-        
-        case Type::LWU:
-            s = std::format("LWU {}, {}({})", s_rd, imm.s, s_rs1);
-            break;
-        
-        case Type::LD:
-            s = std::format("LD {}, {}({})", s_rd, imm.s, s_rs1);
-            break;
-        
-        case Type::SD:
-            s = std::format("SD {}, {}({})", s_rs2, imm.s, s_rs1);
-            break;
+        Set(0x001, "fflags");
+        Set(0x002, "frm");
+        Set(0x003, "fcsr");
+        Set(0x008, "vstart");
+        Set(0x009, "vxsat");
+        Set(0x00a, "vxrm");
+        Set(0x00f, "vcsr");
+        Set(0xc20, "vl");
+        Set(0xc21, "vtype");
+        Set(0xc22, "vlenb");
 
-        case Type::ADDIW:
-            s = std::format("ADDI.W {}, {}, {}", s_rd, s_rs1, s_imm);
-            break;
-        
-        case Type::SUBW:
-            s = std::format("SUB.W {}, {}, {}", s_rd, s_rs1, s_imm);
-            break;
-        
-        case Type::SLLW:
-            s = std::format("SLL.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
+        Set(0xc00, "cycle");
+        Set(0xc01, "time");
+        Set(0xc02, "instret");
         
-        case Type::SRLW:
-            s = std::format("SRL.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::SRAW:
-            s = std::format("SRA.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
+        for (size_t i = 3; i < 32; i++)
+            Set(0xc00 + i, std::format("hpmcounter{}", i));
 
-        case Type::CSRRW:
-            s = std::format("CSRRW {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::CSRRS:
-            s = std::format("CSRRS {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::CSRRC:
-            s = std::format("CSRRC {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::CSRRWI:
-            s = std::format("CSRRWI {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::CSRRSI:
-            s = std::format("CSRRSI {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::CSRRCI:
-            s = std::format("CSRRCI {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::MUL:
-            s = std::format("MUL {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::MULH:
-            s = std::format("MULH {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::MULHSU:
-            s = std::format("MULHSU {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::MULHU:
-            s = std::format("MULHU {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::DIV:
-            s = std::format("DIV {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::DIVU:
-            s = std::format("DIVU {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::REM:
-            s = std::format("REM {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::REMU:
-            s = std::format("REMU {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::MULW:
-            s = std::format("MUL.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::DIVW:
-            s = std::format("DIV.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::DIVUW:
-            s = std::format("DIVU.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::REMW:
-            s = std::format("REM.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::REMUW:
-            s = std::format("REMU.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::LR_W:
-            s = std::format("LR.W {}, {}", s_rd, s_rs1);
-            break;
-        
-        case Type::SC_W:
-            s = std::format("SC.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AMOSWAP_W:
-            s = std::format("AMOSWAP.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AMOADD_W:
-            s = std::format("AMOADD.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AMOXOR_W:
-            s = std::format("AMO XOR.W{}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AMOAND_W:
-            s = std::format("AMOAND.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AMOOR_W:
-            s = std::format("AMOOR.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AMOMIN_W:
-            s = std::format("AMOMIN.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AMOMAX_W:
-            s = std::format("AMOMAX.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AMOMINU_W:
-            s = std::format("AMOMINU.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::AMOMAXU_W:
-            s = std::format("AMOMAXU.W {}, {}, {}", s_rd, s_rs1, s_rs2);
-            break;
-        
-        case Type::LR_D:
-            s = std::format("LR.D");
-            break;
-        
-        case Type::FLW:
-            s = std::format("FLW {}, {}, {}", s_frd, s_frs1, imm.s);
-            break;
-        
-        case Type::FSW:
-            s = std::format("FSW {}, {}, {}, {}", s_frd, s_frs1, s_frs2, imm.s);
-            break;
-        
-        case Type::FMADD_S:
-            s = std::format("FMADD.S {}, {}, {}, {}", s_frd, s_frs1, s_frs2, s_frs3);
-            break;
-        
-        case Type::FMSUB_S:
-            s = std::format("FMSUB.S {}, {}, {}, {}", s_frd, s_frs1, s_frs2, s_frs3);
-            break;
-        
-        case Type::FNMSUB_S:
-            s = std::format("FNMSUB.S {}, {}, {}, {}", s_frd, s_frs1, s_frs2, s_frs3);
-            break;
-        
-        case Type::FNMADD_S:
-            s = std::format("FNMADD.S {}, {}, {}, {}", s_frd, s_frs1, s_frs2, s_frs3);
-            break;
-        
-        case Type::FADD_S:
-            s = std::format("FADD.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
-        
-        case Type::FSUB_S:
-            s = std::format("FSUB.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
-        
-        case Type::FMUL_S:
-            s = std::format("FMUL.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
-        
-        case Type::FDIV_S:
-            s = std::format("FDIV.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
-        
-        case Type::FSQRT_S:
-            s = std::format("FSQRT.S {}, {}", s_frd, s_frs1);
-            break;
-        
-        case Type::FSGNJ_S:
-            s = std::format("FSGNJ.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
-        
-        case Type::FSGNJN_S:
-            s = std::format("FSGNJN.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
-        
-        case Type::FSGNJX_S:
-            s = std::format("FSGNJX.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
-        
-        case Type::FMIN_S:
-            s = std::format("FMIN.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
-        
-        case Type::FMAX_S:
-            s = std::format("FMAX.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
+        Set(0xc80, "cycleh");
+        Set(0xc81, "timeh");
+        Set(0xc82, "instreth");
 
-        case Type::FCVT_W_S:
-            s = std::format("FCVT.W.S {}, {}", s_rd, s_frs1);
-            break;
-        
-        case Type::FCVT_WU_S:
-            s = std::format("FCVT.WU.S {}, {}", s_rd, s_frs1);
-            break;
-        
-        case Type::FMV_X_W:
-            s = std::format("FMV.X.W {}, {}", s_frd, s_rs1);
-            break;
-        
-        case Type::FEQ_S:
-            s = std::format("FEQ.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
-        
-        case Type::FLT_S:
-            s = std::format("FLT.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
+        for (size_t i = 3; i < 32; i++)
+            Set(0xc80 + i, std::format("hpmcounterh{}", i));
+
+        Set(0x100, "sstatus");
+        Set(0x104, "sie");
+        Set(0x105, "stvec");
+        Set(0x106, "scounteren");
+        Set(0x10a, "senvcfg");
+        Set(0x140, "sscratch");
+        Set(0x141, "sepc");
+        Set(0x142, "scause");
+        Set(0x143, "stval");
+        Set(0x144, "sip");
+        Set(0x180, "satp");
+        Set(0x5a8, "scontext");
+
+        Set(0xf11, "mvendorid");
+        Set(0xf12, "marchid");
+        Set(0xf13, "mimpid");
+        Set(0xf14, "mhartid");
+        Set(0xf15, "mconfigptr");
+        Set(0x300, "mstatus");
+        Set(0x301, "misa");
+        Set(0x302, "medeleg");
+        Set(0x303, "mideleg");
+        Set(0x304, "mie");
+        Set(0x305, "mtvec");
+        Set(0x306, "mcounteren");
+        Set(0x310, "mstatush");
+        Set(0x340, "mscratch");
+        Set(0x341, "mepc");
+        Set(0x342, "mcause");
+        Set(0x343, "mtval");
+        Set(0x344, "mip");
+        Set(0x34a, "mtinst");
+        Set(0x34b, "mtval2");
+
+        for (size_t i = 0; i < 64; i++)
+            Set(0x3a0 + i, std::format("pmpcfg{}", i));
+
+        Set(0xb00, "mcycle");
+        Set(0xb02, "minstret");
         
-        case Type::FLE_S:
-            s = std::format("FLE.S {}, {}, {}", s_frd, s_frs1, s_frs2);
-            break;
+        for (size_t i = 3; i < 32; i++)
+            Set(0xb00 + i, std::format("mhpmcounter{}", i));
+
+        Set(0xb80, "mcycleh");
+        Set(0xb82, "minstreth");
         
-        case Type::FCLASS_S:
-            s = std::format("FCLASS.S {}, {}", s_rd, s_frs1);
-            break;
+        for (size_t i = 3; i < 32; i++)
+            Set(0xb80 + i, std::format("mhpmcounterh{}", i));
         
-        case Type::FCVT_S_W:
-            s = std::format("FCVT.S.W {}, {}", s_rd, s_frs1);
+        Set(0x7a0, "tselect");
+        Set(0x7a1, "tdata1");
+        Set(0x7a2, "tdata2");
+        Set(0x7a3, "tdata3");
+        Set(0x7a8, "mcontext");
+
+        return names;
+    }();
+
+    return (*names)[csr & 0xfff].data();
+}
+
+size_t RVInstruction::Disassemble(char* buffer, size_t size) const {
+    if (size == 0) return 0;
+
+    LineWriter out(buffer, size);
+
+    auto index = static_cast<size_t>(type);
+    if (index >= TYPE_COUNT) {
+        out.Put("Unknown instruction type ");
+        out.Number(index);
+        return out.Finish();
+    }
+
+    const auto& entry = instruction_syntax[index];
+    out.Put(entry.mnemonic);
+
+    if (entry.syntax == Syntax::None)
+        return out.Finish();
+
+    out.Put(' ');
+
+    switch (entry.syntax) {
+        case Syntax::RdUpper:
+            out.Register(rd);
+            out.Separator();
+            out.Immediate(immediate);
             break;
-        
-        case Type::FCVT_S_WU:
-            s = std::format("FCVT.S.WU {}, {}", s_rd, s_frs1);
+
+        case Syntax::RdOffset:
+            out.Register(rd);
+            out.Separator();
+            out.Number(s_immediate);
             break;
-        
-        case Type::FMV_W_X:
-            s = std::format("FMV.W.X {}, {}", s_rd, s_frs1);
+
+        case Syntax::RdRs1Offset:
+            out.Register(rd);
+            out.Separator();
+            out.Register(rs1);
+            out.Separator();
+            out.Number(s_immediate);
             break;
-        
-        case Type::FLD:
-            s = std::format("FLD {}, {}, {}", s_frd, s_frs1, imm.s);
+
+        case Syntax::Rs1Rs2Offset:
+            out.Register(rs1);
+            out.Separator();
+            out.Register(rs2);
+            out.Separator();
+            out.Number(s_immediate);
             break;
-        
-        case Type::FSD:
-            s = std::format("FSD {}, {}, {}, {}", s_frd, s_frs1, s_frs2, imm.s);
+
+        case Syntax::RdLoad:
+            out.Register(rd);
+            out.Separator();
+            out.Address(s_immediate, rs1);
             break;
-        
-        case Type::FMADD_D:
-            s = std::format("FMADD.D {}, {}, {}, {}", s_frd, s_frs1, s_frs2, s_frs3);
+
+        case Syntax::Rs2Store:
+            out.Register(rs2);
+            out.Separator();
+            out.Address(s_immediate, rs1);
             break;
-        
-        case Type::FMSUB_D:
-            s = std::format("FMSUB.D {}, {}, {}, {}", s_frd, s_frs1, s_frs2, s_frs3);
+
+        case Syntax::RdRs1Imm:
+            out.Register(rd);
+            out.Separator();
+            out.Register(rs1);
+            out.Separator();
+            out.Immediate(immediate);
             break;
-        
-        case Type::FNMSUB_D:
-            s = std::format("FNMSUB.D {}, {}, {}, {}", s_frd, s_frs1, s_frs2, s_frs3);
+
+        case Syntax::RdRs1Shamt:
+            out.Register(rd);
+            out.Separator();
+            out.Register(rs1);
+            out.Separator();
+            out.Number(immediate & 0b111111);
             break;
-        
-        case Type::FNMADD_D:
-            s = std::format("FNMADD.D {}, {}, {}, {}", s_frd, s_frs1, s_frs2, s_frs3);
+
+        case Syntax::RdRs1Rs2:
+            out.Register(rd);
+            out.Separator();
+            out.Register(rs1);
+            out.Separator();
+            out.Register(rs2);
             break;
-        
-        case Type::FADD_D:
-            s = std::format("FADD.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::RdRs1:
+            out.Register(rd);
+            out.Separator();
+            out.Register(rs1);
             break;
-        
-        case Type::FSUB_D:
-            s = std::format("FSUB.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::Rs1Rs2:
+            out.Register(rs1);
+            out.Separator();
+            out.Register(rs2);
             break;
-        
-        case Type::FMUL_D:
-            s = std::format("FMUL.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::RdCsrRs1:
+            out.Register(rd);
+            out.Separator();
+            out.Put(GetCSRName(immediate & 0xfff));
+            out.Separator();
+            out.Register(rs1);
             break;
-        
-        case Type::FDIV_D:
-            s = std::format("FDIV.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::RdCsrUimm:
+            out.Register(rd);
+            out.Separator();
+            out.Put(GetCSRName(immediate & 0xfff));
+            out.Separator();
+            out.Number(rs1);
             break;
-        
-        case Type::FSQRT_D:
-            s = std::format("FSQRT.D {}, {}", s_frd, s_frs1);
+
+        case Syntax::RdAddress:
+            out.Register(rd);
+            out.Put(", (");
+            out.Register(rs1);
+            out.Put(')');
             break;
-        
-        case Type::FSGNJ_D:
-            s = std::format("FSGNJ.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::RdRs2Address:
+            out.Register(rd);
+            out.Separator();
+            out.Register(rs2);
+            out.Put(", (");
+            out.Register(rs1);
+            out.Put(')');
             break;
-        
-        case Type::FSGNJN_D:
-            s = std::format("FSGNJN.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::FrdLoad:
+            out.FloatRegister(rd);
+            out.Separator();
+            out.Address(s_immediate, rs1);
             break;
-        
-        case Type::FSGNJX_D:
-            s = std::format("FSGNJX.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::Frs2Store:
+            out.FloatRegister(rs2);
+            out.Separator();
+            out.Address(s_immediate, rs1);
             break;
-        
-        case Type::FMIN_D:
-            s = std::format("FMIN.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::FrdFrs1Frs2Frs3:
+            out.FloatRegister(rd);
+            out.Separator();
+            out.FloatRegister(rs1);
+            out.Separator();
+            out.FloatRegister(rs2);
+            out.Separator();
+            out.FloatRegister(rs3);
             break;
-        
-        case Type::FMAX_D:
-            s = std::format("FMAX.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::FrdFrs1Frs2:
+            out.FloatRegister(rd);
+            out.Separator();
+            out.FloatRegister(rs1);
+            out.Separator();
+            out.FloatRegister(rs2);
             break;
-        
-        case Type::FCVT_S_D:
-            s = std::format("FCVT.S.D {}, {}", s_frd, s_frs1);
+
+        case Syntax::FrdFrs1:
+            out.FloatRegister(rd);
+            out.Separator();
+            out.FloatRegister(rs1);
             break;
-        
-        case Type::FCVT_D_S:
-            s = std::format("FCVT.D.S {}, {}", s_frd, s_frs1);
+
+        case Syntax::RdFrs1:
+            out.Register(rd);
+            out.Separator();
+            out.FloatRegister(rs1);
             break;
-        
-        case Type::FEQ_D:
-            s = std::format("FEQ.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::RdFrs1Frs2:
+            out.Register(rd);
+            out.Separator();
+            out.FloatRegister(rs1);
+            out.Separator();
+            out.FloatRegister(rs2);
             break;
-        
-        case Type::FLT_D:
-            s = std::format("FLT.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::FrdRs1:
+            out.FloatRegister(rd);
+            out.Separator();
+            out.Register(rs1);
             break;
-        
-        case Type::FLE_D:
-            s = std::format("FLE.D {}, {}, {}", s_frd, s_frs1, s_frs2);
+
+        case Syntax::VSetVli:
+            out.Register(rd);
+            out.Separator();
+            out.Register(rs1);
+            out.Separator();
+            out.VectorType(immediate);
             break;
-        
-        case Type::FCLASS_D:
-            s = std::format("FCLASS.D {}, {}", s_rd, s_frs1);
+
+        case Syntax::VSetIvli:
+            out.Register(rd);
+            out.Separator();
+            out.Number(rs1);
+            out.Separator();
+            out.VectorType(immediate);
             break;
-        
-        case Type::FCVT_W_D:
-            s = std::format("FCVT.W.D {}, {}", s_rd, s_frs1);
+
+        case Syntax::VdAddress:
+            out.VectorRegister(rd);
+            out.Put(", (");
+            out.Register(rs1);
+            out.Put(')');
+            out.Mask(vm);
             break;
-        
-        case Type::FCVT_WU_D:
-            s = std::format("FCVT.WU.D {}, {}", s_rd, s_frs1);
+
+        case Syntax::VdAddressRs2:
+            out.VectorRegister(rd);
+            out.Put(", (");
+            out.Register(rs1);
+            out.Put("), ");
+            out.Register(rs2);
+            out.Mask(vm);
             break;
-        
-        case Type::FCVT_D_W:
-            s = std::format("FCVT.D.W {}, {}", s_frd, s_rs1);
+
+        case Syntax::VdVs2Vs1:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.VectorRegister(rs2);
+            out.Separator();
+            out.VectorRegister(rs1);
+            out.Mask(vm);
             break;
-        
-        case Type::FCVT_D_WU:
-            s = std::format("FCVT.D.WU {}, {}", s_frd, s_rs1);
+
+        case Syntax::VdVs2Rs1:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.VectorRegister(rs2);
+            out.Separator();
+            out.Register(rs1);
+            out.Mask(vm);
             break;
-        
-        case Type::SRET:
-            s = std::format("SRET");
+
+        case Syntax::VdVs2Imm:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.VectorRegister(rs2);
+            out.Separator();
+            out.Number(s_immediate);
+            out.Mask(vm);
             break;
-        
-        case Type::MRET:
-            s = std::format("MRET");
+
+        case Syntax::VdVs2Uimm:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.VectorRegister(rs2);
+            out.Separator();
+            out.Number(rs1);
+            out.Mask(vm);
             break;
-        
-        case Type::WFI:
-            s = std::format("WFI");
+
+        case Syntax::VdVs2Frs1:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.VectorRegister(rs2);
+            out.Separator();
+            out.FloatRegister(rs1);
+            out.Mask(vm);
             break;
-        
-        case Type::SFENCE_VMA:
-            s = std::format("SFENCE.VMA {}, {}, {}", s_rd, s_rs1, s_rs2);
+
+        case Syntax::VdVs1Vs2:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.VectorRegister(rs1);
+            out.Separator();
+            out.VectorRegister(rs2);
+            out.Mask(vm);
             break;
-        
-        case Type::SINVAL_VMA:
-            s = std::format("SINVAL.VMA {}, {}, {}", s_rd, s_rs1, s_rs2);
+
+        case Syntax::VdRs1Vs2:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.Register(rs1);
+            out.Separator();
+            out.VectorRegister(rs2);
+            out.Mask(vm);
             break;
 
-        case Type::SINVAL_GVMA:
-            s = std::format("SINVAL.GVMA {}, {}, {}", s_rd, s_rs1, s_rs2);
+        case Syntax::VdFrs1Vs2:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.FloatRegister(rs1);
+            out.Separator();
+            out.VectorRegister(rs2);
+            out.Mask(vm);
             break;
-        
-        case Type::SFENCE_W_INVAL:
-            s = std::format("SFENCE.W.INVAL");
+
+        case Syntax::VdVs1:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.VectorRegister(rs1);
             break;
-        
-        case Type::SFENCE_INVAL_IR:
-            s = std::format("SFENCE.INVAL.IR");
+
+        case Syntax::VdRs1:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.Register(rs1);
             break;
-        
-        case Type::INVALID:
-            s = std::format("INVALID");
+
+        case Syntax::VdImm:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.Number(s_immediate);
             break;
-        
-        case Type::CUST_TVA:
-            s = std::format("CUST.TVA {}, {}", s_rd, s_rs1);
+
+        case Syntax::VdFrs1:
+            out.VectorRegister(rd);
+            out.Separator();
+            out.FloatRegister(rs1);
             break;
-        
-        case Type::CUST_MTRAP:
-            s = std::format("CUST.MTRAP {}, {}", s_rs1, s_rs2);
+
+        case Syntax::RdVs2:
+            out.Register(rd);
+            out.Separator();
+            out.VectorRegister(rs2);
             break;
-        
-        case Type::CUST_STRAP:
-            s = std::format("CUST.STRAP {}, {}", s_rs1, s_rs2);
+
+        case Syntax::FrdVs2:
+            out.FloatRegister(rd);
+            out.Separator();
+            out.VectorRegister(rs2);
             break;
 
         default:
-            s = std::format("Unknown instruction type {}", int(type));
             break;
     }
 
-    return s;
+    return out.Finish();
 }
 
-RVInstruction RVInstruction::FromUInt32(Word instr) {
-    RVInstructionWord iw;
-    iw.raw = instr;
+void RVInstruction::Disassemble(std::span<const Word> words, std::span<Disassembly> lines) {
+    auto count = std::min(words.size(), lines.size());
 
+    for (size_t i = 0; i < count; i++)
+        FromUInt32(words[i]).Disassemble(lines[i].data(), lines[i].size());
+}
+
+RVInstruction::operator std::string() const {
+    Disassembly line;
+    auto length = Disassemble(line.data(), line.size());
+    return std::string(line.data(), length);
+}
+
+RVInstruction RVInstruction::FromUInt32(Word instr) {
     RVInstruction rv;
-    rv.type = RVInstruction::Type::INVALID;
+    rv.raw = instr;
     rv.immediate = 0;
     rv.rd = 0;
     rv.rs1 = 0;
@@ -776,1185 +1049,247 @@ RVInstruction RVInstruction::FromUInt32(Word instr) {
     rv.rm = 0;
     rv.rs3 = 0;
 
-    int8_t sign_extend_at = -1;
+    auto& bucket = decode_tables.buckets[BucketOf(instr)];
+    auto first = decode_tables.candidates.begin() + bucket.first;
+    auto last = first + bucket.count;
 
-    switch (iw.opcode) {
-        case OP_LUI:
-            rv.type = RVInstruction::Type::LUI;
-            rv.rd = iw.U.rd;
-            rv.immediate = iw.U.imm << 12;
-            sign_extend_at = 31;
-            break;
-        
-        case OP_AUIPC:
-            rv.type = RVInstruction::Type::AUIPC;
-            rv.rd = iw.U.rd;
-            rv.immediate = iw.U.imm << 12;
-            sign_extend_at = 31;
-            break;
-        
-        case OP_JAL:
-            rv.type = RVInstruction::Type::JAL;
-            rv.rd = iw.J.rd;
-            rv.immediate = iw.J.imm0 << 1;
-            rv.immediate |= iw.J.imm1 << 11;
-            rv.immediate |= iw.J.imm2 << 12;
-            rv.immediate |= iw.J.imm3 << 20;
-            sign_extend_at = 20;
-            break;
-        
-        case OP_JALR:
-            if (iw.I.funct3 != 0) break;
+    auto candidate = std::find_if(first, last, [instr](Half type) {
+        return (instr & encodings[type].mask) == encodings[type].match;
+    });
 
-            rv.type = RVInstruction::Type::JALR;
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-            break;
-        
-        case OP_BRANCH:
-            rv.rs1 = iw.B.rs1;
-            rv.rs2 = iw.B.rs2;
-            rv.immediate = iw.B.imm0 << 1;
-            rv.immediate |= iw.B.imm1 << 5;
-            rv.immediate |= iw.B.imm2 << 11;
-            rv.immediate |= iw.B.imm3 << 12;
-            sign_extend_at = 12;
-
-            switch (iw.S.funct3) {
-                case FUNCT3_BEQ:
-                    rv.type = RVInstruction::Type::BEQ;
-                    break;
-                
-                case FUNCT3_BNE:
-                    rv.type = RVInstruction::Type::BNE;
-                    break;
-                
-                case FUNCT3_BLT:
-                    rv.type = RVInstruction::Type::BLT;
-                    break;
-                
-                case FUNCT3_BGE:
-                    rv.type = RVInstruction::Type::BGE;
-                    break;
-                
-                case FUNCT3_BLTU:
-                    rv.type = RVInstruction::Type::BLTU;
-                    break;
-                
-                case FUNCT3_BGEU:
-                    rv.type = RVInstruction::Type::BGEU;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_LOAD:
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-
-            switch (iw.I.funct3) {
-                case FUNCT3_LB:
-                    rv.type = RVInstruction::Type::LB;
-                    break;
-                
-                case FUNCT3_LH:
-                    rv.type = RVInstruction::Type::LH;
-                    break;
-                
-                case FUNCT3_LW:
-                    rv.type = RVInstruction::Type::LW;
-                    break;
-                
-                case FUNCT3_LD:
-                    rv.type = RVInstruction::Type::LD;
-                    break;
-                
-                case FUNCT3_LBU:
-                    rv.type = RVInstruction::Type::LBU;
-                    break;
-                
-                case FUNCT3_LHU:
-                    rv.type = RVInstruction::Type::LHU;
-                    break;
-                
-                case FUNCT3_LWU:
-                    rv.type = RVInstruction::Type::LWU;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_STORE:
-            rv.rs1 = iw.S.rs1;
-            rv.rs2 = iw.S.rs2;
-            rv.immediate = iw.S.imm0;
-            rv.immediate |= iw.S.imm1 << 5;
-            sign_extend_at = 11;
-
-            switch (iw.S.funct3) {
-                case FUNCT3_SB:
-                    rv.type = RVInstruction::Type::SB;
-                    break;
-                
-                case FUNCT3_SH:
-                    rv.type = RVInstruction::Type::SH;
-                    break;
-                
-                case FUNCT3_SW:
-                    rv.type = RVInstruction::Type::SW;
-                    break;
-                
-                case FUNCT3_SD:
-                    rv.type = RVInstruction::Type::SD;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_MATH_IMMEDIATE:
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-            
-            switch (iw.I.funct3) {
-                case FUNCT3_ADDI:
-                    rv.type = RVInstruction::Type::ADDI;
-                    break;
-                
-                case FUNCT3_SLTI:
-                    rv.type = RVInstruction::Type::SLTI;
-                    break;
-                
-                case FUNCT3_SLTIU:
-                    rv.type = RVInstruction::Type::SLTIU;
-                    break;
-                
-                case FUNCT3_XORI:
-                    rv.type = RVInstruction::Type::XORI;
-                    break;
-                
-                case FUNCT3_ORI:
-                    rv.type = RVInstruction::Type::ORI;
-                    break;
-                
-                case FUNCT3_ANDI:
-                    rv.type = RVInstruction::Type::ANDI;
-                    break;
-                
-                case FUNCT3_SLLI:
-                    if ((rv.immediate >> 6) != 0) break;
-                    rv.type = RVInstruction::Type::SLLI;
-                    break;
-                
-                case FUNCT3_SHIFT_RIGHT_IMMEDIATE:
-                    rv.rs2 = iw.R.rs2;
-                    switch (rv.immediate >> 6) {
-                        case FUNCT7_SRLI:
-                            rv.type = RVInstruction::Type::SRLI;
-                            break;
-                        
-                        case FUNCT7_SRAI:
-                            rv.type = RVInstruction::Type::SRAI;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_MATH_W_IMMEDIATE:
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-
-            switch (iw.I.funct3) {
-                case FUNCT3_ADDI:
-                    rv.type = RVInstruction::Type::ADDIW;
-                    break;
-                
-                case FUNCT3_SLLI:
-                    if ((rv.immediate >> 5) != 0) break;
-                    rv.type = RVInstruction::Type::SLLIW;
-                    break;
-                
-                case FUNCT3_SHIFT_RIGHT_IMMEDIATE:
-                    switch (rv.immediate >> 5) {
-                        case FUNCT7_SRLI:
-                            rv.type = RVInstruction::Type::SRLIW;
-                            break;
-                        
-                        case FUNCT7_SRAI:
-                            rv.type = RVInstruction::Type::SRAIW;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
+    if (candidate == last) return rv;
 
-        case OP_MATH:
-            rv.rd = iw.R.rd;
-            rv.rs1 = iw.R.rs1;
-            rv.rs2 = iw.R.rs2;
-            
-            switch (iw.R.funct3) {
-                case FUNCT3_ADD_SUB_MUL:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_ADD:
-                            rv.type = RVInstruction::Type::ADD;
-                            break;
-                        
-                        case FUNCT7_SUB:
-                            rv.type = RVInstruction::Type::SUB;
-                            break;
-                        
-                        case FUNCT7_MUL:
-                            rv.type = RVInstruction::Type::MUL;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SLL_MULH:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SLL:
-                            rv.type = RVInstruction::Type::SLL;
-                            break;
-                        
-                        case FUNCT7_MULH:
-                            rv.type = RVInstruction::Type::MULH;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SLT_MULHSU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SLT:
-                            rv.type = RVInstruction::Type::SLT;
-                            break;
-                        
-                        case FUNCT7_MULHSU:
-                            rv.type = RVInstruction::Type::MULHSU;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SLTU_MULHU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SLTU:
-                            rv.type = RVInstruction::Type::SLTU;
-                            break;
-                        
-                        case FUNCT7_MULHU:
-                            rv.type = RVInstruction::Type::MULHU;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_XOR_DIV:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_XOR:
-                            rv.type = RVInstruction::Type::XOR;
-                            break;
-                        
-                        case FUNCT7_DIV:
-                            rv.type = RVInstruction::Type::DIV;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SHIFT_RIGHT_DIVU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SRL:
-                            rv.type = RVInstruction::Type::SRL;
-                            break;
-                        
-                        case FUNCT7_SRA:
-                            rv.type = RVInstruction::Type::SRA;
-                            break;
-                        
-                        case FUNCT7_DIVU:
-                            rv.type = RVInstruction::Type::DIVU;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_OR_REM:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_OR:
-                            rv.type = RVInstruction::Type::OR;
-                            break;
-                        
-                        case FUNCT7_REM:
-                            rv.type = RVInstruction::Type::REM;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_AND_REMU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_AND:
-                            rv.type = RVInstruction::Type::AND;
-                            break;
-                        
-                        case FUNCT7_REMU:
-                            rv.type = RVInstruction::Type::REMU;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_MATH_W:
-            rv.rd = iw.R.rd;
-            rv.rs1 = iw.R.rs1;
-            rv.rs2 = iw.R.rs2;
+    auto& encoding = encodings[*candidate];
+    rv.type = encoding.type;
 
-            switch (iw.R.funct3) {
-                case FUNCT3_ADD_SUB_MUL:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_ADD:
-                            rv.type = RVInstruction::Type::ADDW;
-                            break;
-                        
-                        case FUNCT7_SUB:
-                            rv.type = RVInstruction::Type::SUBW;
-                            break;
-                        
-                        case FUNCT7_MUL:
-                            rv.type = RVInstruction::Type::MULW;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_SLL_MULH:
-                    if (iw.R.funct7 != FUNCT7_SLL) break;
-                    rv.type = RVInstruction::Type::SLLW;
-                    break;
-                
-                case FUNCT3_SLT_MULHSU:
-                    break;
-                
-                case FUNCT3_SLTU_MULHU:
-                    if (iw.R.funct7 != FUNCT7_SLTU) break;
-                    rv.type = RVInstruction::Type::SLTU;
-                    break;
-                
-                case FUNCT3_XOR_DIV:
-                    if (iw.R.funct7 != FUNCT7_DIV) break;
-                    rv.type = RVInstruction::Type::DIVW;
-                    break;
-                
-                case FUNCT3_SHIFT_RIGHT_DIVU:
-                    switch (iw.R.funct7) {
-                        case FUNCT7_SRL:
-                            rv.type = RVInstruction::Type::SRLW;
-                            break;
-                        
-                        case FUNCT7_SRA:
-                            rv.type = RVInstruction::Type::SRAW;
-                            break;
-                        
-                        case FUNCT7_DIVU:
-                            rv.type = RVInstruction::Type::DIVUW;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_OR_REM:
-                    if (iw.R.funct7 != FUNCT7_REM) break;
-                    rv.type = RVInstruction::Type::REMW;
-                    break;
-                
-                case FUNCT3_AND_REMU:
-                    if (iw.R.funct7 != FUNCT7_REMU) break;
-                    rv.type = RVInstruction::Type::REMUW;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
+    RVInstructionWord iw;
+    iw.raw = instr;
 
-        case OP_FENCE:
-            if (iw.I.funct3 != FUNCT3_FENCE) break;
+    switch (encoding.format) {
+        case Format::R4:
+            rv.rs3 = iw.R4.rs3;
+            [[fallthrough]];
 
-            rv.type = RVInstruction::Type::FENCE;
-            rv.rd = iw.I.rd;
-            rv.rs1 = iw.I.rs1;
+        case Format::RFloat:
+            rv.rm = iw.R.funct3;
+            [[fallthrough]];
 
-            break;
-        
-        case OP_SYSTEM:
+        case Format::R:
             rv.rd = iw.R.rd;
             rv.rs1 = iw.R.rs1;
             rv.rs2 = iw.R.rs2;
-
-            switch (iw.I.funct3) {
-                case FUNCT3_SYSTEM:
-                    if (iw.I.rd != RD_SYSTEM || iw.I.funct3 != FUNCT3_SYSTEM) break;
-
-                    switch (iw.I.imm) {
-                        case IMM_ECALL:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::ECALL;
-                            break;
-                        
-                        case IMM_EBREAK:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::EBREAK;
-                            break;
-                        
-                        case IMM_SRET:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::SRET;
-                            break;
-
-                        case IMM_MRET:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::MRET;
-                            break;
-                        
-                        case IMM_WFI:
-                            if (iw.I.rs1 != RS1_SYSTEM) break;
-                            rv.type = RVInstruction::Type::WFI;
-                            break;
-
-                        default:
-                            switch (iw.R.funct7) {
-                                case FUNCT7_SFENCE_VMA:
-                                    rv.type = RVInstruction::Type::SFENCE_VMA;
-                                    break;
-                                
-                                case FUNCT7_SINVAL_VMA:
-                                    rv.type = RVInstruction::Type::SINVAL_VMA;
-                                    break;
-                                
-                                case FUNCT7_SINVAL_GVMA:
-                                    rv.type = RVInstruction::Type::SINVAL_GVMA;
-                                    break;
-                                
-                                case FUNCT7_SFENCE_SINVAL:
-                                    if (iw.I.rs1 != RS1_SYSTEM) break;
-
-                                    switch (iw.R.rs2) {
-                                        case RS2_SFENCE_W_INVAL:
-                                            rv.type = RVInstruction::Type::SFENCE_W_INVAL;
-                                            break;
-                                        
-                                        case RS2_SFENCE_INVAL_IR:
-                                            rv.type = RVInstruction::Type::SFENCE_INVAL_IR;
-                                            break;
-                                        
-                                        default:
-                                            break;
-                                    }
-                                    break;
-                            }
-                            break;
-                    }
-                    break;
-                
-                case FUNCT3_CSRRW:
-                    rv.type = RVInstruction::Type::CSRRW;
-                    break;
-                
-                case FUNCT3_CSRRS:
-                    rv.type = RVInstruction::Type::CSRRS;
-                    break;
-                
-                case FUNCT3_CSRRC:
-                    rv.type = RVInstruction::Type::CSRRC;
-                    break;
-                
-                case FUNCT3_CSRRWI:
-                    rv.type = RVInstruction::Type::CSRRWI;
-                    break;
-                
-                case FUNCT3_CSRRSI:
-                    rv.type = RVInstruction::Type::CSRRSI;
-                    break;
-                
-                case FUNCT3_CSRRCI:
-                    rv.type = RVInstruction::Type::CSRRCI;
-                    break;
-                
-                default:
-                    break;
-            }
-
-            switch (iw.I.funct3) {
-                case FUNCT3_CSRRW:
-                case FUNCT3_CSRRS:
-                case FUNCT3_CSRRC:
-                case FUNCT3_CSRRWI:
-                case FUNCT3_CSRRSI:
-                case FUNCT3_CSRRCI:
-                    rv.rd = iw.I.rd;
-                    rv.rs1 = iw.I.rs1;
-                    rv.immediate = iw.I.imm;
-                    break;
-                
-                default:
-                    break;
-            }
             break;
 
-        case OP_ATOMIC:
-            rv.rd = iw.R.rd;
-            rv.rs1 = iw.R.rs1;
+        case Format::CSR:
             rv.rs2 = iw.R.rs2;
+            [[fallthrough]];
 
-            switch (iw.R.funct3) {
-                case FUNCT3_ATOMIC:
-                    switch (iw.R.funct7 & FUNCT7_ATOMIC_MASK) {
-                        case FUNCT7_LR_W:
-                            if (iw.R.rs2 != RS2_LR_W) break;
-
-                            rv.type = RVInstruction::Type::LR_W;
-                            break;
-                        
-                        case FUNCT7_SC_W:
-                            rv.type = RVInstruction::Type::SC_W;
-                            break;
-                        
-                        case FUNCT7_AMOSWAP_W:
-                            rv.type = RVInstruction::Type::AMOSWAP_W;
-                            break;
-                        
-                        case FUNCT7_AMOADD_W:
-                            rv.type = RVInstruction::Type::AMOADD_W;
-                            break;
-                        
-                        case FUNCT7_AMOXOR_W:
-                            rv.type = RVInstruction::Type::AMOXOR_W;
-                            break;
-                        
-                        case FUNCT7_AMOAND_W:
-                            rv.type = RVInstruction::Type::AMOAND_W;
-                            break;
-                        
-                        case FUNCT7_AMOOR_W:
-                            rv.type = RVInstruction::Type::AMOOR_W;
-                            break;
-                        
-                        case FUNCT7_AMOMIN_W:
-                            rv.type = RVInstruction::Type::AMOMIN_W;
-                            break;
-                        
-                        case FUNCT7_AMOMAX_W:
-                            rv.type = RVInstruction::Type::AMOMAX_W;
-                            break;
-                        
-                        case FUNCT7_AMOMINU_W:
-                            rv.type = RVInstruction::Type::AMOMINU_W;
-                            break;
-                        
-                        case FUNCT7_AMOMAXU_W:
-                            rv.type = RVInstruction::Type::AMOMAXU_W;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-            }
-            break;
-        
-        case OP_FL:
+        case Format::I:
             rv.rd = iw.I.rd;
             rv.rs1 = iw.I.rs1;
-            rv.immediate = iw.I.imm;
-            sign_extend_at = 11;
-
-            switch (iw.I.funct3) {
-                case FUNCT3_FLW:
-                    rv.type = RVInstruction::Type::FLW;
-                    break;
-                
-                case FUNCT3_FLD:
-                    rv.type = RVInstruction::Type::FLD;
-                    break;
-                
-                default:
-                    break;
-            }
             break;
-        
-        case OP_FS:
+
+        case Format::S:
+        case Format::B:
             rv.rs1 = iw.S.rs1;
             rv.rs2 = iw.S.rs2;
-            rv.immediate = iw.S.imm0;
-            rv.immediate |= iw.S.imm1 << 5;
-            sign_extend_at = 11;
-
-            switch (iw.S.funct3) {
-                case FUNCT3_FSW:
-                    rv.type = RVInstruction::Type::FSW;
-                    break;
-                
-                case FUNCT3_FSD:
-                    rv.type = RVInstruction::Type::FSD;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_FMADD:
-            rv.rd = iw.R4.rd;
-            rv.rm = iw.R4.funct3;
-            rv.rs1 = iw.R4.rs1;
-            rv.rs2 = iw.R4.rs2;
-            rv.rs3 = iw.R4.rs3;
-
-            switch (iw.R4.funct2) {
-                case FUNCT2_S:
-                    rv.type = RVInstruction::Type::FMADD_S;
-                    break;
-                
-                case FUNCT2_D:
-                    rv.type = RVInstruction::Type::FMADD_D;
-                    break;
-                
-                default:
-                    break;
-            }
             break;
-        
-        case OP_FMSUB:
-            rv.rd = iw.R4.rd;
-            rv.rm = iw.R4.funct3;
-            rv.rs1 = iw.R4.rs1;
-            rv.rs2 = iw.R4.rs2;
-            rv.rs3 = iw.R4.rs3;
 
-            switch (iw.R4.funct2) {
-                case FUNCT2_S:
-                    rv.type = RVInstruction::Type::FMSUB_S;
-                    break;
-                
-                case FUNCT2_D:
-                    rv.type = RVInstruction::Type::FMSUB_D;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_FNMSUB:
-            rv.rd = iw.R4.rd;
-            rv.rm = iw.R4.funct3;
-            rv.rs1 = iw.R4.rs1;
-            rv.rs2 = iw.R4.rs2;
-            rv.rs3 = iw.R4.rs3;
-
-            switch (iw.R4.funct2) {
-                case FUNCT2_S:
-                    rv.type = RVInstruction::Type::FNMSUB_S;
-                    break;
-                
-                case FUNCT2_D:
-                    rv.type = RVInstruction::Type::FNMSUB_D;
-                    break;
-                
-                default:
-                    break;
-            }
+        case Format::U:
+        case Format::J:
+            rv.rd = iw.U.rd;
             break;
-        
-        case OP_FNMADD:
-            rv.rd = iw.R4.rd;
-            rv.rm = iw.R4.funct3;
-            rv.rs1 = iw.R4.rs1;
-            rv.rs2 = iw.R4.rs2;
-            rv.rs3 = iw.R4.rs3;
 
-            switch (iw.R4.funct2) {
-                case FUNCT2_S:
-                    rv.type = RVInstruction::Type::FNMADD_S;
-                    break;
-                
-                case FUNCT2_D:
-                    rv.type = RVInstruction::Type::FNMADD_D;
-                    break;
-                
-                default:
-                    break;
-            }
-            break;
-        
-        case OP_FLOAT:
-            rv.rd = iw.R.rd;
-            rv.rm = iw.R.funct3;
-            rv.rs1 = iw.R.rs1;
+        case Format::V:
+        case Format::VI:
+            rv.vm = iw.R.funct7 & 1;
             rv.rs2 = iw.R.rs2;
-            
-            switch (iw.R.funct7 >> 2) {
-                case FUNCT5_FADD:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FADD_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FADD_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FSUB:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FSUB_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FSUB_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FMUL:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FMUL_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FMUL_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FDIV:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FDIV_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FDIV_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FSQRT:
-                    if (rv.rs2 != RS2_FSQRT) break;
-
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FSQRT_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FSQRT_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FSGNJ:
-                    switch (iw.R.funct3) {
-                        case FUNCT3_FSGNJ:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FSGNJ_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FSGNJ_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FSGNJN:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FSGNJN_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FSGNJN_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FSGNJX:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FSGNJX_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FSGNJX_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FMIN_FMAX:
-                    switch (iw.R.funct3) {
-                        case FUNCT3_FMIN:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FMIN_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FMIN_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FMAX:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FMAX_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FMAX_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FCVT_W:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            switch (iw.R.rs2) {
-                                case RS2_FCVT_W:
-                                    rv.type = RVInstruction::Type::FCVT_W_S;
-                                    break;
-                                
-                                case RS2_FCVT_WU:
-                                    rv.type = RVInstruction::Type::FCVT_WU_S;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT2_D:
-                            switch (iw.R.rs2) {
-                                case RS2_FCVT_W:
-                                    rv.type = RVInstruction::Type::FCVT_W_D;
-                                    break;
-                                
-                                case RS2_FCVT_WU:
-                                    rv.type = RVInstruction::Type::FCVT_WU_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-
-                case FUNCT5_FCLASS_FMV_X_W:
-                    if (iw.R.rs2 == RS2_FMV_X_W && iw.R.funct3 == FUNCT3_FMV_X_W) {
-                        switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                            case FUNCT2_S:
-                                rv.type = RVInstruction::Type::FMV_X_W;
-                                break;
-                            
-                            case FUNCT2_D:
-                                rv.type = RVInstruction::Type::FMV_X_D;
-                                break;
-                            
-                            default:
-                                break;
-                        }
-                        break;
-                    }
-                    else if (iw.R.rs2 == RS2_FCLASS && iw.R.funct3 == FUNCT3_FCLASS) {
-                        switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                            case FUNCT2_S:
-                                rv.type = RVInstruction::Type::FCLASS_S;
-                                break;
-                            
-                            case FUNCT2_D:
-                                rv.type = RVInstruction::Type::FCLASS_D;
-                                break;
-                            
-                            default:
-                                break;
-                        }
-                        break;
-                    }
-                    break;
-                
-                case FUNCT5_FCOMPARE:
-                    switch (iw.R.funct3) {
-                        case FUNCT3_FEQ:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FEQ_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FEQ_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FLT:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FLT_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FLT_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case FUNCT3_FLE:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FLE_S;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FLE_D;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FCVT:
-                    switch (iw.R.rs2) {
-                        case RS2_FCVT_W:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FCVT_S_W;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FCVT_D_W;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case RS2_FCVT_WU:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FCVT_S_WU;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FCVT_D_WU;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case RS2_FCVT_L:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FCVT_S_L;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FCVT_D_L;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        case RS2_FCVT_LU:
-                            switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                                case FUNCT2_S:
-                                    rv.type = RVInstruction::Type::FCVT_S_LU;
-                                    break;
-                                
-                                case FUNCT2_D:
-                                    rv.type = RVInstruction::Type::FCVT_D_LU;
-                                    break;
-                                
-                                default:
-                                    break;
-                            }
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-                
-                case FUNCT5_FMV_W_X:
-                    if (iw.R.rs2 != RS2_FMV_W_X || iw.R.funct3 != FUNCT3_FMV_W_X) break;
-                    rv.type = RVInstruction::Type::FMV_W_X;
-                    break;
-                
-                case FUNCT5_FCVT_D:
-                    switch (iw.R.funct7 & FLOAT_FUNCT2_MASK) {
-                        case FUNCT2_S:
-                            rv.type = RVInstruction::Type::FCVT_L_S;
-                            break;
-                        
-                        case FUNCT2_D:
-                            rv.type = RVInstruction::Type::FCVT_L_D;
-                            break;
-                        
-                        default:
-                            break;
-                    }
-                    break;
-            }
-            break;
-        
-        case OP_CUST:
+            [[fallthrough]];
+
+        case Format::VSETVLI:
+        case Format::VSETIVLI:
             rv.rd = iw.R.rd;
             rv.rs1 = iw.R.rs1;
-            rv.rs2 = iw.R.rs2;
-            rv.rd = iw.R.rd;
-            
-            switch (iw.R.funct7) {
-                case FUNCT7_CUST_TVA:
-                    rv.type = RVInstruction::Type::CUST_TVA;
-                    break;
-                
-                case FUNCT7_CUST_MTRAP:
-                    rv.type = RVInstruction::Type::CUST_MTRAP;
-                    break;
-                
-                case FUNCT7_CUST_STRAP:
-                    rv.type = RVInstruction::Type::CUST_STRAP;
-                    break;
-                
-                default:
-                    break;
-            }
             break;
 
         default:
             break;
     }
 
-    if (sign_extend_at > 0) {
-        Long sign = -1ULL << sign_extend_at;
-        if (rv.immediate & (1ULL << sign_extend_at)) rv.immediate |= sign;
+    rv.s_immediate = ExtractImmediate(encoding.format, instr);
+    return rv;
+}
+
+namespace {
+
+// Bits hi..lo of a compressed instruction, moved down to bit 0
+constexpr Word Bits(Half instr, int hi, int lo) {
+    return (instr >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+constexpr SLong SignExtend(Word value, int bits) {
+    return static_cast<SLong>(static_cast<Long>(value) << (64 - bits)) >> (64 - bits);
+}
+
+constexpr Byte REG_RA = 1;
+constexpr Byte REG_SP = 2;
+
+// The 3 bit register fields of the compressed forms name x8 to x15
+constexpr Byte Prime(Word field) {
+    return static_cast<Byte>(8 + field);
+}
+
+}
+
+Word RVInstruction::Expand(Half instr) {
+    using enum Type;
+
+    Byte rd = Bits(instr, 11, 7);
+    Byte rs2 = Bits(instr, 6, 2);
+    Byte rd_prime = Prime(Bits(instr, 4, 2));
+    Byte rs1_prime = Prime(Bits(instr, 9, 7));
+
+    // Immediates shared by several forms, named after the spec's tables
+    auto imm6 = SignExtend(Bits(instr, 12, 12) << 5 | Bits(instr, 6, 2), 6);
+    auto shamt = Bits(instr, 12, 12) << 5 | Bits(instr, 6, 2);
+    auto uimm_w = Bits(instr, 12, 10) << 3 | Bits(instr, 6, 6) << 2 | Bits(instr, 5, 5) << 6;
+    auto uimm_d = Bits(instr, 12, 10) << 3 | Bits(instr, 6, 5) << 6;
+    auto uimm_wsp = Bits(instr, 12, 12) << 5 | Bits(instr, 6, 4) << 2 | Bits(instr, 3, 2) << 6;
+    auto uimm_dsp = Bits(instr, 12, 12) << 5 | Bits(instr, 6, 5) << 3 | Bits(instr, 4, 2) << 6;
+    auto uimm_swsp = Bits(instr, 12, 9) << 2 | Bits(instr, 8, 7) << 6;
+    auto uimm_sdsp = Bits(instr, 12, 10) << 3 | Bits(instr, 9, 7) << 6;
+
+    auto branch = SignExtend(Bits(instr, 12, 12) << 8 | Bits(instr, 11, 10) << 3 | Bits(instr, 6, 5) << 6 | Bits(instr, 4, 3) << 1 | Bits(instr, 2, 2) << 5, 9);
+    auto jump = SignExtend(Bits(instr, 12, 12) << 11 | Bits(instr, 11, 11) << 4 | Bits(instr, 10, 9) << 8 | Bits(instr, 8, 8) << 10 | Bits(instr, 7, 7) << 6 | Bits(instr, 6, 6) << 7 | Bits(instr, 5, 3) << 1 | Bits(instr, 2, 2) << 5, 12);
+
+    switch (Bits(instr, 1, 0) << 3 | Bits(instr, 15, 13)) {
+        // Quadrant 0
+        case 0b00'000: {
+            auto nzuimm = Bits(instr, 12, 11) << 4 | Bits(instr, 10, 7) << 6 | Bits(instr, 6, 6) << 2 | Bits(instr, 5, 5) << 3;
+            if (nzuimm == 0) return 0;
+
+            return Encode(ADDI, rd_prime, REG_SP, 0, nzuimm);
+        }
+
+        case 0b00'001:
+            return Encode(FLD, rd_prime, rs1_prime, 0, uimm_d);
+
+        case 0b00'010:
+            return Encode(LW, rd_prime, rs1_prime, 0, uimm_w);
+
+        case 0b00'011:
+            return Encode(LD, rd_prime, rs1_prime, 0, uimm_d);
+
+        case 0b00'101:
+            return Encode(FSD, 0, rs1_prime, rd_prime, uimm_d);
+
+        case 0b00'110:
+            return Encode(SW, 0, rs1_prime, rd_prime, uimm_w);
+
+        case 0b00'111:
+            return Encode(SD, 0, rs1_prime, rd_prime, uimm_d);
+
+        // Quadrant 1
+        case 0b01'000:
+            return Encode(ADDI, rd, rd, 0, imm6);
+
+        case 0b01'001:
+            if (rd == 0) return 0;
+            return Encode(ADDIW, rd, rd, 0, imm6);
+
+        case 0b01'010:
+            return Encode(ADDI, rd, 0, 0, imm6);
+
+        case 0b01'011: {
+            if (rd == REG_SP) {
+                auto nzimm = SignExtend(Bits(instr, 12, 12) << 9 | Bits(instr, 6, 6) << 4 | Bits(instr, 5, 5) << 6 | Bits(instr, 4, 3) << 7 | Bits(instr, 2, 2) << 5, 10);
+                if (nzimm == 0) return 0;
+
+                return Encode(ADDI, REG_SP, REG_SP, 0, nzimm);
+            }
+
+            if (imm6 == 0) return 0;
+            return Encode(LUI, rd, 0, 0, imm6 * 4096);
+        }
+
+        case 0b01'100: {
+            Byte rs2_prime = rd_prime;
+
+            switch (Bits(instr, 11, 10)) {
+                case 0b00:
+                    return Encode(SRLI, rs1_prime, rs1_prime, 0, shamt);
+
+                case 0b01:
+                    return Encode(SRAI, rs1_prime, rs1_prime, 0, shamt);
+
+                case 0b10:
+                    return Encode(ANDI, rs1_prime, rs1_prime, 0, imm6);
+
+                default: {
+                    static constexpr std::array<Type, 8> arithmetic = {SUB, XOR, OR, AND, SUBW, ADDW, INVALID, INVALID};
+
+                    auto type = arithmetic[Bits(instr, 12, 12) << 2 | Bits(instr, 6, 5)];
+                    if (type == INVALID) return 0;
+
+                    return Encode(type, rs1_prime, rs1_prime, rs2_prime, 0);
+                }
+            }
+        }
+
+        case 0b01'101:
+            return Encode(JAL, 0, 0, 0, jump);
+
+        case 0b01'110:
+            return Encode(BEQ, 0, rs1_prime, 0, branch);
+
+        case 0b01'111:
+            return Encode(BNE, 0, rs1_prime, 0, branch);
+
+        // Quadrant 2
+        case 0b10'000:
+            return Encode(SLLI, rd, rd, 0, shamt);
+
+        case 0b10'001:
+            return Encode(FLD, rd, REG_SP, 0, uimm_dsp);
+
+        case 0b10'010:
+            if (rd == 0) return 0;
+            return Encode(LW, rd, REG_SP, 0, uimm_wsp);
+
+        case 0b10'011:
+            if (rd == 0) return 0;
+            return Encode(LD, rd, REG_SP, 0, uimm_dsp);
+
+        case 0b10'100:
+            if (Bits(instr, 12, 12) == 0) {
+                if (rs2 != 0) return Encode(ADD, rd, 0, rs2, 0);
+                if (rd == 0) return 0;
+
+                return Encode(JALR, 0, rd, 0, 0);
+            }
+
+            if (rs2 != 0) return Encode(ADD, rd, rd, rs2, 0);
+            if (rd == 0) return Encode(EBREAK, 0, 0, 0, 0);
+
+            return Encode(JALR, REG_RA, rd, 0, 0);
+
+        case 0b10'101:
+            return Encode(FSD, 0, REG_SP, rs2, uimm_sdsp);
+
+        case 0b10'110:
+            return Encode(SW, 0, REG_SP, rs2, uimm_swsp);
+
+        case 0b10'111:
+            return Encode(SD, 0, REG_SP, rs2, uimm_sdsp);
+
+        default:
+            return 0;
     }
+}
 
+RVInstruction RVInstruction::FromUInt16(Half instr) {
+    auto rv = FromUInt32(Expand(instr));
+    rv.raw = instr;
+    rv.size = 2;
     return rv;
-}
\ No newline at end of file
+}
@@ -0,0 +1,292 @@
+#include "Snapshot.hpp"
+
+#include "Memory.hpp"
+#include "CLINT.hpp"
+#include "VirtualMachine.hpp"
+
+#include <algorithm>
+#include <format>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Page data starts on this boundary so hosts with pages up to 64 KiB
+    // can map it
+    constexpr Address DATA_ALIGNMENT = 0x10000;
+
+    // Reading through the shared page keeps a snapshot of a clone from
+    // copying every page it saves
+    const Byte* GetPageToSave(MemoryRegion& region, Address page) {
+        if (auto shared = region.GetSharedHostPage(page)) return shared;
+        return region.GetHostPage(page);
+    }
+
+    bool IsZeroPage(const Byte* page) {
+        auto longs = reinterpret_cast<const Long*>(page);
+        return std::all_of(longs, longs + Memory::PAGE_SIZE / sizeof(Long), [](Long vlong) { return vlong == 0; });
+    }
+
+    struct SavedRegion {
+        MemoryRegion* region;
+        std::vector<Address> pages;
+    };
+
+    // The snapshot file viewed as bytes, mapped where the host allows it
+    class SnapshotFile {
+    public:
+        const Byte* data = nullptr;
+        Address size = 0;
+        int fd = -1;
+
+    private:
+        std::vector<Byte> contents;
+
+    public:
+        SnapshotFile(const std::string& path) {
+#if defined(_WIN32) || defined(_WIN64)
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file)
+                throw std::runtime_error(std::format("Could not open {} for reading", path));
+
+            contents.resize(file.tellg());
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(contents.data()), contents.size());
+
+            data = contents.data();
+            size = contents.size();
+#else
+            fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error(std::format("Could not open {} for reading", path));
+
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size == 0) {
+                close(fd);
+                throw std::runtime_error(std::format("{} is not a snapshot", path));
+            }
+
+            size = info.st_size;
+
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error(std::format("Could not map {}", path));
+            }
+
+            data = static_cast<const Byte*>(mapping);
+#endif
+        }
+
+        SnapshotFile(const SnapshotFile&) = delete;
+
+        ~SnapshotFile() {
+#if !defined(_WIN32) && !defined(_WIN64)
+            munmap(const_cast<Byte*>(data), size);
+            close(fd);
+#endif
+        }
+    };
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path) : file{path, std::ios::binary} {
+    if (!file)
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+}
+
+void SnapshotWriter::WriteBytes(const Byte* bytes, Address count) {
+    file.write(reinterpret_cast<const char*>(bytes), count);
+}
+
+void SnapshotWriter::Align(Address alignment) {
+    static constexpr std::array<char, 0x1000> zeroes{};
+
+    for (auto padding = (alignment - Tell() % alignment) % alignment; padding != 0;) {
+        auto count = std::min<Address>(padding, zeroes.size());
+        file.write(zeroes.data(), count);
+        padding -= count;
+    }
+}
+
+Long SnapshotWriter::Tell() {
+    return file.tellp();
+}
+
+void SnapshotWriter::Close() {
+    file.close();
+
+    if (file.fail())
+        throw std::runtime_error("Could not finish writing the snapshot");
+}
+
+void Snapshot::Save(const std::string& path, Memory& memory, const std::vector<VirtualMachine*>& harts) {
+    auto clint = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+    if (!clint)
+        throw std::runtime_error("Snapshots need a CLINT for the machine's time");
+
+    // Zero pages read back as zero anyway, so only pages with data are kept
+    std::vector<SavedRegion> regions;
+    for (auto& region : memory.GetMemoryRegions()) {
+        SavedRegion saved{region.get(), {}};
+
+        for (auto page : region->GetSavedPages()) {
+            if (!IsZeroPage(GetPageToSave(*region, page)))
+                saved.pages.push_back(page);
+        }
+
+        if (!saved.pages.empty())
+            regions.push_back(std::move(saved));
+    }
+
+    SnapshotWriter writer(path);
+
+    writer.Write(MAGIC);
+    writer.Write(VERSION);
+    writer.Write(static_cast<Word>(harts.size()));
+    writer.Write(static_cast<Word>(regions.size()));
+    writer.Write(static_cast<Word>(clint->GetClockSource()));
+    writer.Write(clint->GetTime());
+
+    for (auto vm : harts) {
+        Hart hart = vm->GetHartID();
+
+        writer.Write(hart);
+        writer.Write(clint->GetTimeCmp(hart));
+        writer.Write(clint->ReadWord(MemoryCLINT::MSIP_OFFSET + hart * sizeof(Word)));
+
+        vm->SaveState(writer);
+
+        // Lets a restore notice state saved by a build with another layout
+        writer.Write(writer.Tell());
+    }
+
+    // Region pages are stored back to back after the index
+    Long data_offset = writer.Tell();
+    for (auto& saved : regions)
+        data_offset += sizeof(Address) * 2 + sizeof(Long) * 2 + saved.pages.size() * sizeof(Address);
+
+    for (auto& saved : regions) {
+        data_offset = (data_offset + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+
+        writer.Write(saved.region->base);
+        writer.Write(saved.region->size);
+        writer.Write(static_cast<Long>(saved.pages.size()));
+        writer.Write(data_offset);
+
+        for (auto page : saved.pages)
+            writer.Write(page);
+
+        data_offset += saved.pages.size() * Memory::PAGE_SIZE;
+    }
+
+    for (auto& saved : regions) {
+        writer.Align(DATA_ALIGNMENT);
+
+        for (auto page : saved.pages)
+            writer.WriteBytes(GetPageToSave(*saved.region, page), Memory::PAGE_SIZE);
+    }
+
+    writer.Close();
+}
+
+void Snapshot::Restore(const std::string& path, Memory& memory, const std::vector<VirtualMachine*>& harts) {
+    auto clint = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+    if (!clint)
+        throw std::runtime_error("Snapshots need a CLINT for the machine's time");
+
+    SnapshotFile file(path);
+    SnapshotReader reader(file.data, file.size);
+
+    auto magic = reader.Read<std::array<char, sizeof(MAGIC)>>();
+    if (!std::equal(magic.begin(), magic.end(), MAGIC) || reader.Read<Word>() != VERSION)
+        throw std::runtime_error(std::format("{} is not a snapshot", path));
+
+    auto hart_count = reader.Read<Word>();
+    auto region_count = reader.Read<Word>();
+    auto clock_source = static_cast<MemoryCLINT::ClockSource>(reader.Read<Word>());
+    auto time = reader.Read<Long>();
+
+    if (hart_count != harts.size())
+        throw std::runtime_error(std::format("{} holds {} harts, the machine has {}", path, hart_count, harts.size()));
+
+    for (auto vm : harts) {
+        auto hart = reader.Read<Hart>();
+        if (hart != vm->GetHartID())
+            throw std::runtime_error(std::format("{} holds hart {} where the machine has hart {}", path, hart, vm->GetHartID()));
+
+        auto time_cmp = reader.Read<Long>();
+        auto msip = reader.Read<Word>();
+
+        vm->RestoreState(reader);
+
+        Long end = reader.Tell();
+        if (reader.Read<Long>() != end)
+            throw std::runtime_error(std::format("{} was saved by a build with a different hart layout", path));
+
+        clint->SetTimeCmp(hart, time_cmp);
+        clint->WriteWord(MemoryCLINT::MSIP_OFFSET + hart * sizeof(Word), msip);
+    }
+
+    clint->SetClockSource(clock_source);
+    clint->SetTime(time);
+
+    // Pages the snapshot doesn't hold were zero when it was saved
+    auto& regions = memory.GetMemoryRegions();
+    for (auto& region : regions)
+        region->DiscardPages();
+
+    for (Word i = 0; i < region_count; i++) {
+        auto base = reader.Read<Address>();
+        auto size = reader.Read<Address>();
+        auto page_count = reader.Read<Long>();
+        auto data_offset = reader.Read<Long>();
+
+        auto found = std::find_if(regions.begin(), regions.end(), [&](auto& region) {
+            return region->base == base && region->size == size;
+        });
+
+        if (found == regions.end())
+            throw std::runtime_error(std::format("{} holds a {:#x} byte region at {:#x} the machine doesn't have", path, size, base));
+
+        if (data_offset + page_count * Memory::PAGE_SIZE > file.size)
+            throw std::runtime_error(std::format("{} ends before its page data", path));
+
+        auto& region = *found;
+
+        std::vector<Address> pages(page_count);
+        for (auto& page : pages)
+            reader.Read(page);
+
+        // Runs of neighbouring pages are mapped in one go when the region can
+        for (Long first = 0; first < page_count;) {
+            Long last = first + 1;
+            while (last < page_count && pages[last] == pages[last - 1] + Memory::PAGE_SIZE)
+                last++;
+
+            Long file_offset = data_offset + first * Memory::PAGE_SIZE;
+            Address bytes = (last - first) * Memory::PAGE_SIZE;
+
+            bool mapped = file.fd >= 0 && region->MapFilePages(pages[first], bytes, file.fd, file_offset);
+
+            for (Long page = first; page < last; page++) {
+                if (!mapped) {
+                    auto host = region->GetHostPage(pages[page]);
+                    if (!host)
+                        throw std::runtime_error(std::format("Region at {:#x} can't hold restored pages", base));
+
+                    std::memcpy(host, file.data + data_offset + page * Memory::PAGE_SIZE, Memory::PAGE_SIZE);
+                }
+
+                memory.NotifyWrite(base + pages[page]);
+            }
+
+            first = last;
+        }
+    }
+}
@@ -0,0 +1,149 @@
+#include "Tracer.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <format>
+#include <stdexcept>
+
+Tracer::Tracer(Tracer&& tracer) {
+    *this = std::move(tracer);
+}
+
+Tracer& Tracer::operator=(Tracer&& tracer) {
+    events = std::move(tracer.events);
+    head = tracer.head.load();
+    spans = tracer.spans;
+    thread_id = tracer.thread_id;
+    thread_name = std::move(tracer.thread_name);
+
+    tracer.head = 0;
+
+    return *this;
+}
+
+Long Tracer::Now() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Tracer::Push(const Event& event) {
+    // Most harts are never traced, so only pay for the ring once used
+    if (events.empty())
+        events.resize(CAPACITY);
+
+    auto index = head.load(std::memory_order_relaxed);
+    events[index % CAPACITY] = event;
+    head.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::Begin(Kind kind, Long arg, Long detail) {
+    auto& span = spans[static_cast<size_t>(kind)];
+    if (span.open) return;
+
+    span = { Now(), arg, detail, true };
+}
+
+void Tracer::End(Kind kind) {
+    auto& span = spans[static_cast<size_t>(kind)];
+    if (!span.open) return;
+
+    span.open = false;
+    Push({ span.start, Now() - span.start, span.arg, span.detail, kind, false });
+}
+
+void Tracer::Instant(Kind kind, Long arg, Long detail) {
+    Push({ Now(), 0, arg, detail, kind, true });
+}
+
+std::vector<Tracer::Event> Tracer::GetEvents() const {
+    auto end = head.load(std::memory_order_acquire);
+    auto begin = end > CAPACITY ? end - CAPACITY : 0;
+
+    std::vector<Event> snapshot;
+    snapshot.reserve(end - begin);
+
+    for (auto i = begin; i < end; i++)
+        snapshot.push_back(events[i % CAPACITY]);
+
+    return snapshot;
+}
+
+void Tracer::Reset() {
+    head = 0;
+    spans = {};
+}
+
+std::string Tracer::GetKindName(Kind kind) {
+    switch (kind) {
+        case Kind::MachineTrap: return "machine_trap";
+        case Kind::SupervisorTrap: return "supervisor_trap";
+        case Kind::Privilege: return "privilege";
+        case Kind::ECall: return "ecall";
+        case Kind::WaitForInterrupt: return "wfi";
+        case Kind::Pause: return "pause";
+        case Kind::GDB: return "gdb";
+        default: return "unknown";
+    }
+}
+
+static std::string GetEventArgs(const Tracer::Event& event) {
+    using Kind = Tracer::Kind;
+
+    switch (event.kind) {
+        case Kind::MachineTrap:
+        case Kind::SupervisorTrap:
+            return std::format("{{\"cause\":{},\"interrupt\":{}}}", event.arg, event.detail ? "true" : "false");
+
+        case Kind::Privilege:
+            return std::format("{{\"from\":{},\"to\":{}}}", event.arg, event.detail);
+
+        case Kind::ECall:
+            return std::format("{{\"index\":{}}}", static_cast<SLong>(event.arg));
+
+        case Kind::GDB:
+            return std::format("{{\"packet\":\"{}\"}}", static_cast<char>(event.arg));
+
+        default:
+            return "{}";
+    }
+}
+
+void Tracer::WriteChromeTrace(const std::string& path, const std::vector<const Tracer*>& tracers) {
+    std::ofstream file(path);
+
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Could not open {} for writing", path));
+    }
+
+    file << "{\"traceEvents\":[\n";
+
+    bool first = true;
+    auto Separate = [&]() {
+        if (!first) file << ",\n";
+        first = false;
+    };
+
+    for (auto tracer : tracers) {
+        Separate();
+        file << std::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+            tracer->GetThreadID(), tracer->GetThreadName());
+
+        // Timestamps are in microseconds
+        for (const auto& event : tracer->GetEvents()) {
+            Separate();
+
+            auto name = GetKindName(event.kind);
+            auto args = GetEventArgs(event);
+
+            if (event.instant)
+                file << std::format("{{\"name\":\"{}\",\"ph\":\"i\",\"s\":\"t\",\"ts\":{:.3f},\"pid\":0,\"tid\":{},\"args\":{}}}",
+                    name, event.start / 1000.0, tracer->GetThreadID(), args);
+
+            else
+                file << std::format("{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":0,\"tid\":{},\"args\":{}}}",
+                    name, event.start / 1000.0, event.duration / 1000.0, tracer->GetThreadID(), args);
+        }
+    }
+
+    file << "\n]}\n";
+}
@@ -0,0 +1,511 @@
+#include "VirtualMachine.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace {
+
+using Type = RVInstruction::Type;
+
+// A register group is a flat array of elements, since the registers of a
+// group are adjacent in the register file
+template <typename T>
+inline T* Group(Byte* vregs, Byte reg) {
+    return reinterpret_cast<T*>(vregs + reg * VirtualMachine::VLENB);
+}
+
+inline bool IsActive(const Byte* vregs, Long element) {
+    return vregs[element / 8] >> (element % 8) & 1;
+}
+
+// Runs f with a value of the unsigned type that is sew bytes wide
+template <typename F>
+inline void BySEW(Long sew, F f) {
+    switch (sew) {
+        case 1: f(Byte{}); break;
+        case 2: f(Half{}); break;
+        case 4: f(Word{}); break;
+        default: f(Long{}); break;
+    }
+}
+
+// The kernels keep masked and unmasked loops apart so the common unmasked
+// one has no branches and the compiler vectorizes it for the host. Tail
+// and inactive elements are left undisturbed, which either policy allows
+template <typename T, typename Operand, typename Op>
+inline void Arithmetic(Byte* vregs, const RVInstruction& instr, Long start, Long vl, Operand operand, Op op) {
+    auto d = Group<T>(vregs, instr.rd);
+    auto a = Group<T>(vregs, instr.rs2);
+
+    if (instr.vm) {
+        for (Long i = start; i < vl; i++)
+            d[i] = op(a[i], operand(i));
+    }
+
+    else {
+        for (Long i = start; i < vl; i++)
+            if (IsActive(vregs, i)) d[i] = op(a[i], operand(i));
+    }
+}
+
+template <typename T, typename Operand, typename Op>
+inline void Accumulate(Byte* vregs, const RVInstruction& instr, Long start, Long vl, Operand operand, Op op) {
+    auto d = Group<T>(vregs, instr.rd);
+    auto a = Group<T>(vregs, instr.rs2);
+
+    if (instr.vm) {
+        for (Long i = start; i < vl; i++)
+            d[i] = op(d[i], a[i], operand(i));
+    }
+
+    else {
+        for (Long i = start; i < vl; i++)
+            if (IsActive(vregs, i)) d[i] = op(d[i], a[i], operand(i));
+    }
+}
+
+// vd[0] = vs1[0] + the active elements of vs2
+template <typename T>
+inline void Reduce(Byte* vregs, const RVInstruction& instr, Long vl) {
+    auto a = Group<T>(vregs, instr.rs2);
+    T sum = Group<T>(vregs, instr.rs1)[0];
+
+    for (Long i = 0; i < vl; i++)
+        if (instr.vm || IsActive(vregs, i)) sum += a[i];
+
+    Group<T>(vregs, instr.rd)[0] = sum;
+}
+
+// NaN results are the canonical NaN, whatever NaN the host made
+template <typename T>
+inline T Canonical(T value) {
+    return value != value ? std::numeric_limits<T>::quiet_NaN() : value;
+}
+
+}
+
+Long VirtualMachine::SetVectorType(Long avl, Long vtype, bool keep_vl) {
+    Long vsew = vtype >> 3 & 0b111;
+    Long vlmul = vtype & 0b111;
+
+    // LMUL in eighths, so the fractional 1/8 to 1/2 are whole too
+    Long sew = 8ULL << vsew;
+    Long lmul8 = vlmul & 0b100 ? 8 >> (8 - vlmul) : 8 << vlmul;
+
+    bool valid = vlmul != 0b100 && sew <= ELEN && (vtype >> 8) == 0 && sew * 8 <= lmul8 * ELEN;
+
+    csrs[CSR_VSTART] = 0;
+
+    if (!valid) {
+        csrs[CSR_VTYPE] = VTYPE_VILL;
+        csrs[CSR_VL] = 0;
+        return 0;
+    }
+
+    Long vlmax = VLEN * lmul8 / (8 * sew);
+
+    csrs[CSR_VTYPE] = vtype;
+    csrs[CSR_VL] = std::min(keep_vl ? csrs[CSR_VL] : avl, vlmax);
+
+    return csrs[CSR_VL];
+}
+
+template <typename T>
+bool VirtualMachine::TransferVector(const RVInstruction& instr, Address base, SLong stride, bool is_write) {
+    auto elements = Group<T>(vregs.data(), instr.rd);
+    Long vl = csrs[CSR_VL];
+
+    bool whole_pages = instr.vm && stride == sizeof(T);
+
+    for (Long i = csrs[CSR_VSTART]; i < vl;) {
+        if (!instr.vm && !IsActive(vregs.data(), i)) {
+            i++;
+            continue;
+        }
+
+        Address address = base + i * stride;
+
+        if (address & (sizeof(T) - 1)) {
+            csrs[CSR_VSTART] = i;
+            RaiseException(is_write ? EXCEPTION_STORE_AMO_ADDRESS_MISALIGNED : EXCEPTION_LOAD_ADDRESS_MISALIGNED);
+            return false;
+        }
+
+        auto [translated_address, translation_valid] = TranslateMemoryAddress(address, is_write, false);
+        if (!translation_valid) {
+            csrs[CSR_VSTART] = i;
+            return false;
+        }
+
+        // The rest of the run that sits on this page in one copy
+        if (whole_pages) {
+            if (auto host = GetHostPointer(translated_address, is_write)) {
+                Long count = std::min<Long>(vl - i, (Memory::PAGE_SIZE - address % Memory::PAGE_SIZE) / sizeof(T));
+
+                if (is_write) {
+                    memory.NotifyWrite(translated_address, count * sizeof(T));
+                    std::memcpy(host, elements + i, count * sizeof(T));
+
+                    auto& entry = host_pages[(translated_address / Memory::PAGE_SIZE) % HOST_PAGE_SLOTS];
+                    if (entry.dirty) DirtyPages::Mark(*entry.dirty, entry.dirty_bit);
+                }
+
+                else
+                    std::memcpy(elements + i, host, count * sizeof(T));
+
+                i += count;
+                continue;
+            }
+        }
+
+        bool accessed;
+        if (is_write) accessed = Store<T>(address, translated_address, elements[i]);
+        else std::tie(elements[i], accessed) = Load<T>(address, translated_address);
+
+        if (!accessed) {
+            csrs[CSR_VSTART] = i;
+            return false;
+        }
+
+        i++;
+    }
+
+    csrs[CSR_VSTART] = 0;
+    return true;
+}
+
+bool VirtualMachine::ExecuteVector(const RVInstruction& instr, bool& inc_pc) {
+    auto Illegal = [&]() {
+        RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+        inc_pc = false;
+        return true;
+    };
+
+    // With VS off every vector instruction traps, which is how kernels find
+    // out a task started using the vector unit
+    auto vs = privilege_level == PrivilegeLevel::Machine ? mstatus.VS : sstatus.VS;
+    if (vs == 0) return Illegal();
+
+    mstatus.VS = VS_DIRTY;
+    sstatus.VS = VS_DIRTY;
+
+    switch (instr.type) {
+        case Type::VSETVLI:
+        case Type::VSETIVLI:
+        case Type::VSETVL: {
+            Long avl = 0;
+            bool keep_vl = false;
+
+            if (instr.type == Type::VSETIVLI) avl = instr.rs1;
+            else if (instr.rs1 != 0) avl = regs[instr.rs1].u64;
+            else if (instr.rd != 0) avl = -1ULL;
+            else keep_vl = true;
+
+            Long vtype = instr.type == Type::VSETVL ? regs[instr.rs2].u64 : instr.immediate;
+            Long vl = SetVectorType(avl, vtype, keep_vl);
+
+            if (instr.rd != 0) regs[instr.rd].u64 = vl;
+            return true;
+        }
+
+        default:
+            break;
+    }
+
+    Long vtype = csrs[CSR_VTYPE];
+    if (vtype & VTYPE_VILL) return Illegal();
+
+    Long sew = 1ULL << (vtype >> 3 & 0b111);
+    Long vlmul = vtype & 0b111;
+    Long lmul8 = vlmul & 0b100 ? 8 >> (8 - vlmul) : 8 << vlmul;
+
+    Long vl = csrs[CSR_VL];
+    Long start = csrs[CSR_VSTART];
+
+    auto funct3 = instr.raw >> 12 & 0b111;
+    auto* v = vregs.data();
+
+    // Register groups start on a multiple of their size, and a masked
+    // instruction can't overwrite the mask
+    auto Aligned = [](Byte reg, Long eighths) {
+        Long registers = std::max<Long>(eighths / 8, 1);
+        return reg % registers == 0;
+    };
+
+    // Element width of a load or store, which sets its own group size
+    Long eew = 0;
+    switch (instr.type) {
+        case Type::VLE8_V: case Type::VSE8_V: case Type::VLSE8_V: case Type::VSSE8_V: eew = 1; break;
+        case Type::VLE16_V: case Type::VSE16_V: case Type::VLSE16_V: case Type::VSSE16_V: eew = 2; break;
+        case Type::VLE32_V: case Type::VSE32_V: case Type::VLSE32_V: case Type::VSSE32_V: eew = 4; break;
+        case Type::VLE64_V: case Type::VSE64_V: case Type::VLSE64_V: case Type::VSSE64_V: eew = 8; break;
+        default: break;
+    }
+
+    if (eew != 0) {
+        Long emul8 = lmul8 * eew / sew;
+        if (emul8 < 1 || emul8 > 64 || !Aligned(instr.rd, emul8)) return Illegal();
+
+        bool is_write = instr.type >= Type::VSE8_V && instr.type <= Type::VSE64_V;
+        is_write = is_write || (instr.type >= Type::VSSE8_V && instr.type <= Type::VSSE64_V);
+        if (!is_write && !instr.vm && instr.rd == 0) return Illegal();
+
+        bool strided = instr.type >= Type::VLSE8_V && instr.type <= Type::VSSE64_V;
+
+        Address base = regs[instr.rs1].u64;
+        SLong stride = strided ? regs[instr.rs2].s64 : static_cast<SLong>(eew);
+
+        bool done = true;
+        BySEW(eew, [&]<typename T>(T) { done = TransferVector<T>(instr, base, stride, is_write); });
+        return done;
+    }
+
+    bool reads_vs1 = funct3 == RVInstruction::FUNCT3_OPIVV || funct3 == RVInstruction::FUNCT3_OPMVV || funct3 == RVInstruction::FUNCT3_OPFVV;
+
+    // Moves to and from element 0 take single registers, and reductions
+    // only read vs2 as a group
+    bool scalar_move = instr.type == Type::VMV_X_S || instr.type == Type::VMV_S_X || instr.type == Type::VFMV_F_S || instr.type == Type::VFMV_S_F;
+    bool reduction = instr.type == Type::VREDSUM_VS || instr.type == Type::VFREDUSUM_VS;
+
+    if (reduction && !Aligned(instr.rs2, lmul8)) return Illegal();
+
+    if (!scalar_move && !reduction) {
+        if (!Aligned(instr.rd, lmul8) || !Aligned(instr.rs2, lmul8) || (reads_vs1 && !Aligned(instr.rs1, lmul8)))
+            return Illegal();
+
+        if (!instr.vm && instr.rd == 0) return Illegal();
+    }
+
+    // Applies op to each element of vs2 and the second operand, which is a
+    // vector, a scalar register or the immediate depending on funct3
+    auto Integer = [&](auto op, bool unsigned_immediate = false) {
+        BySEW(sew, [&]<typename T>(T) {
+            if (reads_vs1) {
+                auto b = Group<T>(v, instr.rs1);
+                Arithmetic<T>(v, instr, start, vl, [b](Long i) { return b[i]; }, op);
+                return;
+            }
+
+            T scalar = static_cast<T>(regs[instr.rs1].u64);
+            if (funct3 == RVInstruction::FUNCT3_OPIVI) scalar = static_cast<T>(unsigned_immediate ? instr.rs1 : instr.immediate);
+
+            Arithmetic<T>(v, instr, start, vl, [scalar](Long) { return scalar; }, op);
+        });
+    };
+
+    auto IntegerAccumulate = [&](auto op) {
+        BySEW(sew, [&]<typename T>(T) {
+            if (reads_vs1) {
+                auto b = Group<T>(v, instr.rs1);
+                Accumulate<T>(v, instr, start, vl, [b](Long i) { return b[i]; }, op);
+                return;
+            }
+
+            T scalar = static_cast<T>(regs[instr.rs1].u64);
+            Accumulate<T>(v, instr, start, vl, [scalar](Long) { return scalar; }, op);
+        });
+    };
+
+    // Single and double elements only, rounding by frm unless rounds is off
+    auto FloatElements = [&](auto f, bool rounds = true) {
+        if (sew != 4 && sew != 8) return Illegal();
+        if (rounds && !ChangeRoundingMode(RVInstruction::RM_DYNAMIC)) return Illegal();
+
+        if (sew == 4) f(float{}, fregs[instr.rs1].f);
+        else f(double{}, fregs[instr.rs1].d);
+
+        if (precise_float_flags) SyncFloatFlags();
+        return true;
+    };
+
+    auto Float = [&](auto op) {
+        return FloatElements([&]<typename T>(T, T scalar) {
+            auto canonical = [op](T a, T b) { return Canonical<T>(op(a, b)); };
+
+            if (reads_vs1) {
+                auto b = Group<T>(v, instr.rs1);
+                Arithmetic<T>(v, instr, start, vl, [b](Long i) { return b[i]; }, canonical);
+            }
+
+            else
+                Arithmetic<T>(v, instr, start, vl, [scalar](Long) { return scalar; }, canonical);
+        });
+    };
+
+    auto Shift = [](auto a, auto b) -> Long { return b & (sizeof(a) * 8 - 1); };
+
+    switch (instr.type) {
+        case Type::VADD_VV:
+        case Type::VADD_VX:
+        case Type::VADD_VI:
+            Integer([](auto a, auto b) { return a + b; });
+            break;
+
+        case Type::VSUB_VV:
+        case Type::VSUB_VX:
+            Integer([](auto a, auto b) { return a - b; });
+            break;
+
+        case Type::VRSUB_VX:
+        case Type::VRSUB_VI:
+            Integer([](auto a, auto b) { return b - a; });
+            break;
+
+        case Type::VAND_VV:
+        case Type::VAND_VX:
+        case Type::VAND_VI:
+            Integer([](auto a, auto b) { return a & b; });
+            break;
+
+        case Type::VOR_VV:
+        case Type::VOR_VX:
+        case Type::VOR_VI:
+            Integer([](auto a, auto b) { return a | b; });
+            break;
+
+        case Type::VXOR_VV:
+        case Type::VXOR_VX:
+        case Type::VXOR_VI:
+            Integer([](auto a, auto b) { return a ^ b; });
+            break;
+
+        case Type::VSLL_VV:
+        case Type::VSLL_VX:
+        case Type::VSLL_VI:
+            Integer([Shift](auto a, auto b) { return static_cast<decltype(a)>(a << Shift(a, b)); }, true);
+            break;
+
+        case Type::VSRL_VV:
+        case Type::VSRL_VX:
+        case Type::VSRL_VI:
+            Integer([Shift](auto a, auto b) { return static_cast<decltype(a)>(a >> Shift(a, b)); }, true);
+            break;
+
+        case Type::VSRA_VV:
+        case Type::VSRA_VX:
+        case Type::VSRA_VI:
+            Integer([Shift](auto a, auto b) {
+                using Signed = std::make_signed_t<decltype(a)>;
+                return static_cast<decltype(a)>(static_cast<Signed>(a) >> Shift(a, b));
+            }, true);
+            break;
+
+        // Widened first so narrow products can't overflow int
+        case Type::VMUL_VV:
+        case Type::VMUL_VX:
+            Integer([](auto a, auto b) { return static_cast<decltype(a)>(static_cast<Long>(a) * b); });
+            break;
+
+        case Type::VMACC_VV:
+        case Type::VMACC_VX:
+            IntegerAccumulate([](auto d, auto a, auto b) { return static_cast<decltype(d)>(static_cast<Long>(a) * b + d); });
+            break;
+
+        case Type::VREDSUM_VS:
+            if (start != 0) return Illegal();
+            if (vl == 0) break;
+
+            BySEW(sew, [&]<typename T>(T) { Reduce<T>(v, instr, vl); });
+            break;
+
+        case Type::VMV_V_V:
+        case Type::VMV_V_X:
+        case Type::VMV_V_I:
+            Integer([](auto, auto b) { return b; });
+            break;
+
+        case Type::VMV_X_S:
+            BySEW(sew, [&]<typename T>(T) {
+                using Signed = std::make_signed_t<T>;
+                if (instr.rd != 0) regs[instr.rd].s64 = static_cast<Signed>(Group<T>(v, instr.rs2)[0]);
+            });
+            break;
+
+        case Type::VMV_S_X:
+            if (start >= vl) break;
+
+            BySEW(sew, [&]<typename T>(T) { Group<T>(v, instr.rd)[0] = static_cast<T>(regs[instr.rs1].u64); });
+            break;
+
+        case Type::VFADD_VV:
+        case Type::VFADD_VF:
+            Float([](auto a, auto b) { return a + b; });
+            break;
+
+        case Type::VFSUB_VV:
+        case Type::VFSUB_VF:
+            Float([](auto a, auto b) { return a - b; });
+            break;
+
+        case Type::VFMUL_VV:
+        case Type::VFMUL_VF:
+            Float([](auto a, auto b) { return a * b; });
+            break;
+
+        case Type::VFDIV_VV:
+        case Type::VFDIV_VF:
+            Float([](auto a, auto b) { return a / b; });
+            break;
+
+        // Fused like the scalar FMADD
+        case Type::VFMACC_VV:
+        case Type::VFMACC_VF:
+            FloatElements([&]<typename T>(T, T scalar) {
+                auto op = [](T d, T a, T b) { return Canonical<T>(std::fma(a, b, d)); };
+
+                if (reads_vs1) {
+                    auto b = Group<T>(v, instr.rs1);
+                    Accumulate<T>(v, instr, start, vl, [b](Long i) { return b[i]; }, op);
+                }
+
+                else
+                    Accumulate<T>(v, instr, start, vl, [scalar](Long) { return scalar; }, op);
+            });
+            break;
+
+        case Type::VFREDUSUM_VS:
+            if (start != 0) return Illegal();
+
+            FloatElements([&]<typename T>(T, T) {
+                if (vl == 0) return;
+
+                Reduce<T>(v, instr, vl);
+                Group<T>(v, instr.rd)[0] = Canonical(Group<T>(v, instr.rd)[0]);
+            });
+            break;
+
+        case Type::VFMV_V_F:
+            Float([](auto, auto b) { return b; });
+            break;
+
+        case Type::VFMV_F_S:
+            FloatElements([&]<typename T>(T, T) {
+                mstatus.FS = FS_DIRTY;
+                sstatus.FS = FS_DIRTY;
+
+                if constexpr (sizeof(T) == sizeof(float)) {
+                    fregs[instr.rd].f = Group<T>(v, instr.rs2)[0];
+                    fregs[instr.rd].is_double = false;
+                }
+
+                else
+                    fregs[instr.rd].d = Group<T>(v, instr.rs2)[0];
+            }, false);
+            break;
+
+        case Type::VFMV_S_F:
+            FloatElements([&]<typename T>(T, T scalar) {
+                if (start < vl) Group<T>(v, instr.rd)[0] = scalar;
+            }, false);
+            break;
+
+        default:
+            return Illegal();
+    }
+
+    if (inc_pc) csrs[CSR_VSTART] = 0;
+    return true;
+}
@@ -1,24 +1,41 @@
 #include "VirtualMachine.hpp"
+#include "Snapshot.hpp"
 
 #include "RV64.hpp"
 
 #include <format>
+#include <cstring>
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 #include <cmath>
 #include <chrono>
+#include <bit>
 #include <fenv.h>
 
-#if defined(_WIN32) || defined(_WIN64)
-#include <windows.h>
-#else
-#include <sched.h>
-#endif
-
 const int VirtualMachine::default_rounding_mode = fegetround();
 
+// The rounding mode belongs to the host thread, not to the hart
+static thread_local int host_rounding_mode = fegetround();
+
+static inline void SetHostRoundingMode(int mode) {
+    if (mode == host_rounding_mode) return;
+
+    fesetround(mode);
+    host_rounding_mode = mode;
+}
+
+// Messages are only built here, out of the functions that run every step
+[[noreturn]] static void ThrowTrapMode(const char* level, Long mode) {
+    throw std::runtime_error(std::format("Unhandled {} trap mode {}", level, mode));
+}
+
+[[noreturn]] static void ThrowNotImplemented(const RVInstruction& instr) {
+    throw std::runtime_error(std::format("Instruction not implemented {}", std::string(instr)));
+}
+
 bool VirtualMachine::CSRPrivilegeCheck(Long csr) {
-    if (csr < 4 || (csr >= 0xc00 && csr < 0xcf0))
+    if (csr < 0x10 || (csr >= 0xc00 && csr < 0xcf0))
         return true;
     
     if ((csr >= 0x100 && csr < 0x144) || csr == 0x180)
@@ -32,30 +49,73 @@ Long VirtualMachine::ReadCSR(Long csr, bool is_internal_read) {
         RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
         return 0;
     }
-    
-    if (csr >= CSR_MHPMEVENT3 && csr < (CSR_MHPMEVENT3 + CSR_PERFORMANCE_EVENT_MAX - 3))
-        return 0;
-    
-    if (csr >= CSR_MHPMCOUNTER3 && csr < (CSR_MHPMCOUNTER3 + CSR_PERF_COUNTER_MAX - 3))
-        return 0;
-    
-    if (csr >= CSR_MHPMCOUNTER3H && csr < (CSR_MHPMCOUNTER3H + CSR_PERF_COUNTER_MAX - 3))
-        return 0;
+
+    auto kind = csr < CSR_COUNT ? csr_kinds[csr] : CSRKind::Unimplemented;
+
+    switch (kind) {
+        case CSRKind::Unimplemented:
+            RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+            return 0;
+        
+        case CSRKind::Zero:
+            return 0;
+        
+        case CSRKind::Plain:
+        case CSRKind::ReadOnly:
+            return csrs[csr];
+        
+        case CSRKind::Special:
+            break;
+    }
+
+    if (csr >= CSR_MHPMCOUNTER3 && csr < CSR_MHPMCOUNTER3 + CSR_PERF_COUNTER_MAX - 3)
+        return ReadPerformanceCounter(csr - CSR_MHPMCOUNTER3 + 3);
+
+    if (csr >= CSR_HPMCOUNTER && csr < CSR_HPMCOUNTER + CSR_PERF_COUNTER_MAX - 3)
+        return ReadPerformanceCounter(csr - CSR_HPMCOUNTER + 3);
+
+    if (csr >= CSR_MHPMEVENT3 && csr < CSR_MHPMEVENT3 + CSR_PERFORMANCE_EVENT_MAX - 3)
+        return performance_counters[csr - CSR_MHPMEVENT3 + 3].event;
 
     switch (csr) {
+        case CSR_FFLAGS:
+            SyncFloatFlags();
+            return csrs[CSR_FCSR] & CSR_FCSR_FLAGS;
+        
+        case CSR_FCSR:
+            SyncFloatFlags();
+            return csrs[CSR_FCSR];
+        
+        case CSR_FRM:
+            return (csrs[CSR_FCSR] >> 5) & 0b111;
+
+        case CSR_VCSR:
+            return (csrs[CSR_VXRM] & 0b11) << 1 | (csrs[CSR_VXSAT] & 1);
+        
         case CSR_MCYCLE:
         case CSR_CYCLE:
-            return static_cast<Long>(cycles);
-        
         case CSR_TIME:
-            return static_cast<Long>(csr_mapped_memory->time);
+        case CSR_INSTRET:
+            return ReadCounter(csr);
+
+        case CSR_MINSTRET:
+            return ReadCounter(CSR_INSTRET);
+
+        // The upper halves RV32 reads the counters through
+        case CSR_CYCLEH:
+        case CSR_TIMEH:
+        case CSR_INSTRETH:
+            return ReadCounter(csr - CSR_CYCLEH + CSR_CYCLE) >> 32;
+
+        case CSR_MINSTRETH:
+            return ReadCounter(CSR_INSTRET) >> 32;
 
         case CSR_MSTATUS:
-            mstatus.SD = mstatus.FS == FS_DIRTY;
+            mstatus.SD = mstatus.FS == FS_DIRTY || mstatus.VS == VS_DIRTY;
             return mstatus.raw;
 
         case CSR_SSTATUS:
-            sstatus.SD = sstatus.FS == FS_DIRTY;
+            sstatus.SD = sstatus.FS == FS_DIRTY || sstatus.VS == VS_DIRTY;
             return sstatus.raw;
         
         case CSR_MIP:
@@ -72,28 +132,12 @@ Long VirtualMachine::ReadCSR(Long csr, bool is_internal_read) {
         
         case CSR_SIE:
             return sie;
-
-        case CSR_MCOUNTEREN:
-        case CSR_MCOUNTINHIBIT:
-            return 0;
-        
-        case CSR_MENVCFG:
-        case CSR_MENVCFGH:
-            return 0;
-        
-        case CSR_SENVCFG:
-            return 0;
         
         case CSR_SATP:
             return satp.raw;
-
-        default:
-            if (!csrs.contains(csr)) {
-                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                return 0;
-            }
-
-            return csrs[csr];
+        
+        case CSR_MCOUNTINHIBIT:
+            return count_inhibit;
     }
 
     return csrs[csr];
@@ -104,22 +148,79 @@ void VirtualMachine::WriteCSR(Long csr, Long value) {
         RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
         return;
     }
+
+    auto kind = csr < CSR_COUNT ? csr_kinds[csr] : CSRKind::Unimplemented;
+
+    switch (kind) {
+        case CSRKind::Unimplemented:
+            RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+            return;
+        
+        case CSRKind::Zero:
+        case CSRKind::ReadOnly:
+            return; // Non writable
+        
+        case CSRKind::Plain:
+            csrs[csr] = value;
+            return;
+        
+        case CSRKind::Special:
+            break;
+    }
+
+    if (csr >= CSR_MHPMCOUNTER3 && csr < CSR_MHPMCOUNTER3 + CSR_PERF_COUNTER_MAX - 3) {
+        WritePerformanceCounter(csr - CSR_MHPMCOUNTER3 + 3, value);
+        return;
+    }
+
+    if (csr >= CSR_HPMCOUNTER && csr < CSR_HPMCOUNTER + CSR_PERF_COUNTER_MAX - 3)
+        return; // Non writable
+
+    if (csr >= CSR_MHPMEVENT3 && csr < CSR_MHPMEVENT3 + CSR_PERFORMANCE_EVENT_MAX - 3) {
+        SelectPerformanceEvent(csr - CSR_MHPMEVENT3 + 3, value);
+        return;
+    }
     
     switch (csr) {
-        case CSR_MVENDORID:
-        case CSR_MARCHID:
-        case CSR_MIMPID:
-        case CSR_MHARTID:
-        case CSR_MISA:
+        case CSR_FFLAGS:
+            ClearFloatFlags();
+            csrs[CSR_FCSR] = (csrs[CSR_FCSR] & ~CSR_FCSR_FLAGS) | (value & CSR_FCSR_FLAGS);
+            break;
+        
+        case CSR_FRM:
+            csrs[CSR_FCSR] = (csrs[CSR_FCSR] & CSR_FCSR_FLAGS) | ((value & 0b111) << 5);
+            break;
+        
+        case CSR_FCSR:
+            ClearFloatFlags();
+            csrs[CSR_FCSR] = value & 0xff;
+            break;
+
+        case CSR_VCSR:
+            csrs[CSR_VXRM] = (value >> 1) & 0b11;
+            csrs[CSR_VXSAT] = value & 1;
+            break;
+        
+        case CSR_MCYCLE:
+            UpdateTimer();
+
+            // Keeps instret where it was
+            stalled_cycles += value - cycles;
+            cycles = value;
+            retired_cycles = value;
+            break;
+
         case CSR_MINSTRET:
-        case CSR_MINSTRETH:
+            stalled_cycles = cycles - value;
+            break;
+        
         case CSR_CYCLE:
         case CSR_TIME:
-        case CSR_MCOUNTEREN:
-        case CSR_MCOUNTINHIBIT:
-        case CSR_MENVCFG:
-        case CSR_MENVCFGH:
-        case CSR_SENVCFG:
+        case CSR_INSTRET:
+        case CSR_CYCLEH:
+        case CSR_TIMEH:
+        case CSR_INSTRETH:
+        case CSR_MINSTRETH:
             return; // Non writable
         
         case CSR_MSTATUS: {
@@ -141,9 +242,11 @@ void VirtualMachine::WriteCSR(Long csr, Long value) {
             break;
         }
 
-        case CSR_MIP:
-            mip = value & VALID_INTERRUPT_BITS;
+        case CSR_MIP: {
+            auto current = mip.load();
+            while (!mip.compare_exchange_weak(current, (current & ~MIP_WRITABLE_BITS) | (value & MIP_WRITABLE_BITS))) {}
             break;
+        }
         
         case CSR_MIE:
             mie = value & VALID_INTERRUPT_BITS;
@@ -161,37 +264,95 @@ void VirtualMachine::WriteCSR(Long csr, Long value) {
             sie = value & VALID_INTERRUPT_BITS;
             break;
 
-        case CSR_SATP:
-            satp.raw = value;
-            break;
+        case CSR_SATP: {
+            // Writes selecting an unsupported mode have no effect
+            SATP new_satp;
+            new_satp.raw = value;
 
-        default:
-            if (!csrs.contains(csr)) {
-                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                return;
+            if (new_satp.MODE == SATP_MODE_BARE || new_satp.MODE == SATP_MODE_SV39 || new_satp.MODE == SATP_MODE_SV48) {
+                satp = new_satp;
+                UpdateTranslation();
             }
+            
+            break;
+        }
 
-            csrs[csr] = value;
+        case CSR_MCOUNTINHIBIT:
+            SetCountInhibit(value);
             break;
     }
 }
 
+Long VirtualMachine::ReadEvent(Long event) const {
+    switch (event) {
+        case HPM_EVENT_NONE:
+            return 0;
+        
+        case HPM_EVENT_DECODE_MISSES:
+            return instruction_cache.GetMisses();
+        
+        default:
+            return events[event];
+    }
+}
+
+Long VirtualMachine::ReadPerformanceCounter(Half counter) const {
+    const auto& performance_counter = performance_counters[counter];
+
+    if (count_inhibit & (1ULL << counter))
+        return performance_counter.base;
+
+    return performance_counter.base + ReadEvent(performance_counter.event) - performance_counter.start;
+}
+
+void VirtualMachine::WritePerformanceCounter(Half counter, Long value) {
+    auto& performance_counter = performance_counters[counter];
+
+    performance_counter.base = value;
+    performance_counter.start = ReadEvent(performance_counter.event);
+}
+
+void VirtualMachine::SelectPerformanceEvent(Half counter, Long event) {
+    if (event >= HPM_EVENT_COUNT)
+        event = HPM_EVENT_NONE;
+
+    // Switching events keeps the count so far
+    auto value = ReadPerformanceCounter(counter);
+    performance_counters[counter].event = event;
+    WritePerformanceCounter(counter, value);
+}
+
+void VirtualMachine::SetCountInhibit(Long value) {
+    value &= COUNT_INHIBIT_WRITABLE_BITS;
+
+    for (Half counter = 3; counter < CSR_PERF_COUNTER_MAX; counter++) {
+        auto bit = 1ULL << counter;
+        if (((count_inhibit ^ value) & bit) == 0) continue;
+
+        // Rebase on the value at the switch, so an inhibited counter holds
+        // it and a resumed one counts on from it
+        auto current = ReadPerformanceCounter(counter);
+        count_inhibit ^= bit;
+        WritePerformanceCounter(counter, current);
+    }
+}
+
 bool VirtualMachine::ChangeRoundingMode(Byte rm) {
     switch (rm) {
         case RVInstruction::RM_ROUND_TO_NEAREST_TIES_EVEN:
-            fesetround(FE_TONEAREST);
+            SetHostRoundingMode(FE_TONEAREST);
             break;
         
         case RVInstruction::RM_ROUND_TO_ZERO:
-            fesetround(FE_TOWARDZERO);
+            SetHostRoundingMode(FE_TOWARDZERO);
             break;
         
         case RVInstruction::RM_ROUND_DOWN:
-            fesetround(FE_DOWNWARD);
+            SetHostRoundingMode(FE_DOWNWARD);
             break;
         
         case RVInstruction::RM_ROUND_UP:
-            fesetround(FE_UPWARD);
+            SetHostRoundingMode(FE_UPWARD);
             break;
         
         case RVInstruction::RM_ROUND_TO_NEAREST_TIES_MAX_MAGNITUDE:
@@ -203,18 +364,16 @@ bool VirtualMachine::ChangeRoundingMode(Byte rm) {
             return ChangeRoundingMode((csrs[CSR_FCSR] >> 5) & 0b111);
         
         default:
-            fesetround(default_rounding_mode);
+            SetHostRoundingMode(default_rounding_mode);
             break;
     }
 
     return true;
 }
 
-bool VirtualMachine::CheckFloatErrors() {
-    fexcept_t except;
-    fegetexceptflag(&except, FE_ALL_EXCEPT);
-
-    csrs[CSR_FCSR] &= ~CSR_FCSR_FLAGS;
+void VirtualMachine::SyncFloatFlags() {
+    int except = fetestexcept(FE_ALL_EXCEPT);
+    if (!except) return;
 
     if (except & FE_DIVBYZERO) csrs[CSR_FCSR] |= CSR_FCSR_DZ;
     if (except & FE_INEXACT) csrs[CSR_FCSR] |= CSR_FCSR_NX;
@@ -222,17 +381,51 @@ bool VirtualMachine::CheckFloatErrors() {
     if (except & FE_OVERFLOW) csrs[CSR_FCSR] |= CSR_FCSR_OF;
     if (except & FE_UNDERFLOW) csrs[CSR_FCSR] |= CSR_FCSR_UF;
 
-    if (except & (FE_DIVBYZERO | FE_INVALID)) return true;
-    return false;
+    feclearexcept(FE_ALL_EXCEPT);
+}
+
+void VirtualMachine::ClearFloatFlags() {
+    feclearexcept(FE_ALL_EXCEPT);
 }
 
 void VirtualMachine::RaiseInterrupt(Long cause) {
-    auto cause_bit = 1ULL << cause;
+    mip.fetch_or(1ULL << cause);
+
+    Wake();
+}
+
+void VirtualMachine::ClearInterrupt(Long cause) {
+    mip.fetch_and(~(1ULL << cause));
+}
 
-    static std::mutex lock;
-    lock.lock();
-    csrs[CSR_MIP] |= cause_bit;
-    lock.unlock();
+void VirtualMachine::SetInterruptPending(Long cause, bool pending) {
+    if (((mip >> cause) & 1) == pending) return;
+
+    if (pending) RaiseInterrupt(cause);
+    else ClearInterrupt(cause);
+}
+
+void VirtualMachine::UpdateTimer() {
+    auto hart = csrs[CSR_MHARTID];
+
+    clint->Retire(cycles - retired_cycles);
+    retired_cycles = cycles;
+
+    SetInterruptPending(INTERRUPT_MACHINE_TIMER, clint->IsTimerPending(hart));
+}
+
+Long VirtualMachine::ReadCounter(Half csr) {
+    switch (csr) {
+        case CSR_TIME:
+            UpdateTimer();
+            return clint->GetTime();
+
+        case CSR_INSTRET:
+            return cycles - stalled_cycles;
+
+        default:
+            return cycles;
+    }
 }
 
 void VirtualMachine::RaiseException(Long cause) {
@@ -249,6 +442,10 @@ void VirtualMachine::RaiseException(Long cause) {
 }
 
 void VirtualMachine::RaiseMachineTrap(Long cause) {
+    events[HPM_EVENT_TRAPS]++;
+
+    if (profiling) profiler.CountTrap(cause & ~TRAP_INTERRUPT_BIT, cause & TRAP_INTERRUPT_BIT);
+
     auto handler_address = csrs[CSR_MTVEC];
 
     auto mode = handler_address & 0b11;
@@ -263,7 +460,7 @@ void VirtualMachine::RaiseMachineTrap(Long cause) {
             break;
         
         default:
-            throw std::runtime_error(std::format("Unhandled machine trap mode {}", mode));
+            ThrowTrapMode("machine", mode);
     }
 
     csrs[CSR_MCAUSE] = cause;
@@ -288,11 +485,17 @@ void VirtualMachine::RaiseMachineTrap(Long cause) {
             break;
     }
 
+    if (tracing) TraceTrapEntry(Tracer::Kind::MachineTrap, cause, MACHINE_MODE);
+
     pc = handler_address;
-    privilege_level = PrivilegeLevel::Machine;
+    SetPrivilegeLevel(PrivilegeLevel::Machine);
 }
 
 void VirtualMachine::RaiseSupervisorTrap(Long cause) {
+    events[HPM_EVENT_TRAPS]++;
+
+    if (profiling) profiler.CountTrap(cause & ~TRAP_INTERRUPT_BIT, cause & TRAP_INTERRUPT_BIT);
+
     auto [handler_address, valid] = TranslateMemoryAddress(csrs[CSR_STVEC], false, false);
 
     if (!valid) return;
@@ -309,7 +512,7 @@ void VirtualMachine::RaiseSupervisorTrap(Long cause) {
             break;
         
         default:
-            throw std::runtime_error(std::format("Unhandled supervisor trap mode {}", mode));
+            ThrowTrapMode("supervisor", mode);
     }
 
     csrs[CSR_SCAUSE] = cause;
@@ -328,172 +531,190 @@ void VirtualMachine::RaiseSupervisorTrap(Long cause) {
             break;
         
         default:
-            throw std::runtime_error(std::format("Unhandled supervisor trap"));
+            throw std::runtime_error("Unhandled supervisor trap");
     }
 
+    if (tracing) TraceTrapEntry(Tracer::Kind::SupervisorTrap, cause, SUPERVISOR_MODE);
+
     pc = handler_address;
-    privilege_level = PrivilegeLevel::Supervisor;
+    SetPrivilegeLevel(PrivilegeLevel::Supervisor);
+}
+
+void VirtualMachine::TraceTrapEntry(Tracer::Kind kind, Long cause, Byte mode) {
+    Byte previous_mode = USER_MODE;
+    if (privilege_level == PrivilegeLevel::Machine) previous_mode = MACHINE_MODE;
+    else if (privilege_level == PrivilegeLevel::Supervisor) previous_mode = SUPERVISOR_MODE;
+
+    tracer.Begin(kind, cause & ~TRAP_INTERRUPT_BIT, (cause & TRAP_INTERRUPT_BIT) != 0);
+    tracer.Instant(Tracer::Kind::Privilege, previous_mode, mode);
 }
 
-std::pair<VirtualMachine::TLBEntry, bool> VirtualMachine::GetTLBLookup(Address virt_addr, bool bypass_cache, bool is_amo) {
-    // TODO Fix this!
-    constexpr auto KB_OFFSET_BITS = GetLog2(0x1000U);
-    constexpr auto MB_OFFSET_BITS = GetLog2(0x200000U);
+void VirtualMachine::TraceTrapReturn(Tracer::Kind kind, Byte mode) {
+    Byte previous_mode = privilege_level == PrivilegeLevel::Machine ? MACHINE_MODE : SUPERVISOR_MODE;
 
-    auto kb_tag = (virt_addr & ~((1ULL << KB_OFFSET_BITS) - 1)) >> 1;
-    auto mb_tag = (virt_addr & ~((1ULL << MB_OFFSET_BITS) - 1)) >> 1;
+    tracer.End(kind);
+    tracer.Instant(Tracer::Kind::Privilege, previous_mode, mode);
+}
 
-    if (!bypass_cache) {
-        for (size_t i = 0; i < tlb_cache.size(); i++) {
-            if (!tlb_cache[i].tlb_entry.V) continue;
+const VirtualMachine::TLBCacheEntry* VirtualMachine::GetTLBLookup(Address virt_addr, bool is_write, bool is_execute) {
+    constexpr Long PAGE_SIZE = 0x1000;
+    constexpr Long PTE_SIZE = sizeof(Long);
+    constexpr Long VPN_BITS = 9;
 
-            if (tlb_cache[i].super && (mb_tag == tlb_cache[i].tag))
-                return {tlb_cache[i].tlb_entry, true};
-            
-            if (!tlb_cache[i].super && (kb_tag == tlb_cache[i].tag))
-                return {tlb_cache[i].tlb_entry, false};
+    Long vpn = virt_addr / PAGE_SIZE;
+    Half asid = satp.ASID;
+
+    auto& tlb = is_execute ? instruction_tlb : data_tlb;
+    auto set_index = vpn % TLB_SETS;
+    auto& set = tlb.sets[set_index];
+
+    for (auto& entry : set) {
+        if (entry.generation != tlb_generation) continue;
+        if (!entry.pte.G && entry.asid != asid) continue;
+
+        auto shift = entry.level * VPN_BITS;
+        if ((entry.vpn >> shift) == (vpn >> shift)) {
+            if (profiling) profiler.CountTLBLookup(is_execute, true);
+            return &entry;
         }
     }
 
-    union VirtualAddress {
-        struct {
-            Word offset : 12;
-            Word vpn_0 : 10;
-            Word vpn_1 : 10;
-        };
-        Word raw;
-    };
+    events[HPM_EVENT_TLB_MISSES]++;
+    if (profiling) profiler.CountTLBLookup(is_execute, false);
 
-    VirtualAddress vaddr;
-    vaddr.raw = virt_addr;
+    Long page_fault = EXCEPTION_INSTRUCTION_LOAD_PAGE_FAULT;
+    Long access_fault = EXCEPTION_LOAD_ACCESS_FAULT;
 
-    Word root_table_address = satp.PPN << 12;
+    if (is_execute) {
+        page_fault = EXCEPTION_INSTRUCTION_PAGE_FAULT;
+        access_fault = EXCEPTION_INSTRUCTION_ADDRESS_FAULT;
+    }
+    else if (is_write) {
+        page_fault = EXCEPTION_STORE_AMO_PAGE_FAULT;
+        access_fault = EXCEPTION_STORE_AMO_ACCESS_FAULT;
+    }
 
-    auto ReadTLBEntry = [&](Address address) {
-        TLBEntry ppn;
-        ppn.V = 0;
-        auto ppn_read = memory.PeekWord(address);
-        if (!ppn_read.second) {
-            RaiseException(is_amo ? EXCEPTION_STORE_AMO_ACCESS_FAULT : EXCEPTION_LOAD_ACCESS_FAULT);
-            return ppn;
-        }
-        
-        ppn.raw = ppn_read.first;
-        if (!ppn.V || (!ppn.R && ppn.W)) {
-            RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-            return ppn;
+    Long levels = satp.MODE == SATP_MODE_SV48 ? 4 : 3;
+
+    // Bits above the virtual address width must all match its top bit
+    auto high = static_cast<SLong>(virt_addr) >> (12 + levels * VPN_BITS - 1);
+    if (high != 0 && high != -1) {
+        RaiseException(page_fault);
+        return nullptr;
+    }
+
+    Address table = satp.PPN * PAGE_SIZE;
+
+    for (Long level = levels; level-- > 0;) {
+        auto index = (vpn >> (level * VPN_BITS)) & ((1ULL << VPN_BITS) - 1);
+
+        auto [raw, mapped] = memory.PeekLong(table + index * PTE_SIZE);
+        if (!mapped) {
+            RaiseException(access_fault);
+            return nullptr;
         }
 
-        if (!ppn.X && !ppn.W && ppn.R) {
-            RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-            ppn.V = 0;
-            return ppn;
+        TLBEntry pte;
+        pte.raw = raw;
+
+        if (!pte.V || (!pte.R && pte.W)) {
+            RaiseException(page_fault);
+            return nullptr;
         }
 
-        if (ppn.X && ppn.W && !ppn.R) {
-            RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-            ppn.V = 0;
-            return ppn;
+        if (!pte.IsLeaf()) {
+            table = pte.PPN * PAGE_SIZE;
+            continue;
         }
-        
-        return ppn;
-    };
 
-    auto& cache = tlb_cache[tlb_cache_round_robin];
-    tlb_cache_round_robin++;
-    if (tlb_cache_round_robin >= TLB_CACHE_SIZE) tlb_cache_round_robin = 0;
+        // Superpages must be aligned to their size
+        if (pte.PPN & ((1ULL << (level * VPN_BITS)) - 1)) {
+            RaiseException(page_fault);
+            return nullptr;
+        }
 
-    cache = TLBCacheEntry();
+        auto& entry = set[tlb.victims[set_index]];
+        tlb.victims[set_index] = (tlb.victims[set_index] + 1) % TLB_WAYS;
 
-    auto tlb = ReadTLBEntry(root_table_address + vaddr.vpn_1 * 4);
+        entry.vpn = vpn;
+        entry.generation = tlb_generation;
+        entry.pte = pte;
+        entry.asid = asid;
+        entry.level = level;
 
-    if (!tlb.V) return {tlb, false};
+        return &entry;
+    }
 
-    if (!tlb.R && !tlb.X) {
-        constexpr Word PAGE_SIZE = 0x1000;
-        tlb = ReadTLBEntry(tlb.PPN * PAGE_SIZE + vaddr.vpn_0 * 4);
+    RaiseException(page_fault);
+    return nullptr;
+}
 
-        cache.tag = kb_tag;
-        cache.tlb_entry = tlb;
+void VirtualMachine::FlushTLB(Address virt_addr, bool all_addresses, Half asid, bool all_asids) {
+    if (all_addresses && all_asids) {
+        tlb_generation++;
+        return;
     }
-    else {
-        if (tlb.PPN_0 != 0) {
-            RaiseMachineTrap(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-            tlb.V = 0;
-            return {tlb, false};
+
+    Long vpn = virt_addr / 0x1000;
+
+    for (auto tlb : {&instruction_tlb, &data_tlb}) {
+        for (auto& set : tlb->sets) {
+            for (auto& entry : set) {
+                if (entry.generation != tlb_generation) continue;
+
+                auto shift = entry.level * 9;
+                if (!all_addresses && (entry.vpn >> shift) != (vpn >> shift)) continue;
+
+                // SFENCE.VMA with an ASID leaves global mappings alone
+                if (!all_asids && (entry.pte.G || entry.asid != asid)) continue;
+
+                entry.generation = 0;
+            }
         }
-        
-        cache.tag = mb_tag;
-        cache.super = 1;
-        cache.tlb_entry = tlb;
     }
-
-    return {tlb, cache.super != 0};
 }
 
-std::pair<Address, bool> VirtualMachine::TranslateMemoryAddress(Address address, bool is_write, bool is_execute, bool is_amo) {
-    if (!IsUsingVirtualMemory()) return {address, true};
-    
-    auto [tlb, super] = GetTLBLookup(address);
+std::pair<Address, bool> VirtualMachine::TranslatePagedAddress(Address address, bool is_write, bool is_execute, bool is_amo) {
+    is_write = is_write || is_amo;
 
-    if (!tlb.V) return {0, false};
+    auto entry = GetTLBLookup(address, is_write, is_execute);
+    if (!entry) return {0, false};
 
-    if (is_execute && !tlb.X) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
-    }
+    const auto& pte = entry->pte;
 
-    if (is_write && !tlb.W) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
-    }
+    Long page_fault = EXCEPTION_INSTRUCTION_LOAD_PAGE_FAULT;
+    if (is_execute) page_fault = EXCEPTION_INSTRUCTION_PAGE_FAULT;
+    else if (is_write) page_fault = EXCEPTION_STORE_AMO_PAGE_FAULT;
 
-    if (!is_write && !tlb.R) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
-    }
+    bool allowed;
+    if (is_execute)
+        allowed = pte.X;
+    
+    else if (is_write)
+        allowed = pte.W && (!is_amo || pte.R);
+    
+    else
+        allowed = pte.R || (pte.X && sstatus.MXR);
 
-    if (is_amo && (!tlb.R || !tlb.W)) {
-        RaiseException(EXCEPTION_STORE_AMO_PAGE_FAULT);
-    }
+    if (privilege_level == PrivilegeLevel::User && !pte.U)
+        allowed = false;
 
-    if (privilege_level == PrivilegeLevel::User && !tlb.U) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
-    }
+    if (privilege_level == PrivilegeLevel::Supervisor && pte.U && (is_execute || !sstatus.SUM))
+        allowed = false;
 
-    if (privilege_level == PrivilegeLevel::Supervisor && tlb.U && !sstatus.SUM) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
-        return {0, false};
-    }
+    // A and D are managed by software, so a clear bit faults
+    if (!pte.A || (is_write && !pte.D))
+        allowed = false;
 
-    if (!tlb.A || (tlb.D && is_write)) {
-        RaiseException(EXCEPTION_INSTRUCTION_PAGE_FAULT);
+    if (!allowed) {
+        RaiseException(page_fault);
         return {0, false};
     }
 
-    union VirtualAddress {
-        struct {
-            Word offset : 12;
-            Word vpn_0 : 10;
-            Word vpn_1 : 10;
-        };
-        Word raw;
-    };
-
-    VirtualAddress vaddr;
-    vaddr.raw = address;
+    Long offset_bits = 12 + entry->level * 9;
+    Long offset_mask = (1ULL << offset_bits) - 1;
 
-    Word phys_address;
-    if (super) {
-        phys_address = tlb.PPN_1 << 22;
-        phys_address |= vaddr.vpn_0 << 12;
-        phys_address |= vaddr.offset;
-    }
-    else {
-        phys_address = tlb.PPN << 12;
-        phys_address |= vaddr.offset;
-    }
+    Address phys_address = ((static_cast<Address>(pte.PPN) << 12) & ~offset_mask) | (address & offset_mask);
 
     return {phys_address, true};
 }
@@ -507,9 +728,16 @@ void VirtualMachine::Setup() {
         f.d = 0.0;
     }
 
+    if (device_tree != 0) {
+        regs[10].u64 = csrs[CSR_MHARTID];
+        regs[11].u64 = device_tree;
+    }
+
+    vregs = {};
+
     // User
 
-    csrs[CSR_FRM] = 0;
+    csrs[CSR_FCSR] = 0;
     csrs[CSR_CYCLE] = 0;
     csrs[CSR_TIME] = 0;
     csrs[CSR_INSTRET] = 0;
@@ -517,6 +745,13 @@ void VirtualMachine::Setup() {
     csrs[CSR_TIMEH] = 0;
     csrs[CSR_INSTRETH] = 0;
 
+    csrs[CSR_VSTART] = 0;
+    csrs[CSR_VXSAT] = 0;
+    csrs[CSR_VXRM] = 0;
+    csrs[CSR_VL] = 0;
+    csrs[CSR_VTYPE] = VTYPE_VILL;
+    csrs[CSR_VLENB] = VLENB;
+
     // Supervisor
 
     csrs[CSR_SSTATUS] = 0;
@@ -531,6 +766,7 @@ void VirtualMachine::Setup() {
     csrs[CSR_SEPC] = 0;
     
     satp.raw = 0;
+    tlb_generation++;
 
     // Machine
 
@@ -543,12 +779,85 @@ void VirtualMachine::Setup() {
     // TODO Implement this!
     csrs[CSR_MCONFIGPTR] = 0;
 
-    privilege_level = PrivilegeLevel::Machine;
+    SetPrivilegeLevel(PrivilegeLevel::Machine);
 
     cycles = 0;
+    stalled_cycles = 0;
+    retired_cycles = 0;
+
+    csrs[CSR_MCOUNTEREN] = 0;
+    csrs[CSR_SCOUNTEREN] = 0;
+    performance_counters = {};
+    count_inhibit = 0;
+}
+
+void VirtualMachine::SetDeviceTree(Address address) {
+    device_tree = address;
+
+    regs[10].u64 = csrs[CSR_MHARTID];
+    regs[11].u64 = address;
+}
+
+void VirtualMachine::Reset(Address pc) {
+    // What the constructor set stays, the rest of the file is cleared in
+    // one pass rather than CSR by CSR
+    constexpr std::array<Half, 5> identity = {CSR_MVENDORID, CSR_MARCHID, CSR_MIMPID, CSR_MHARTID, CSR_MISA};
+
+    std::array<Long, identity.size()> kept;
+    for (size_t i = 0; i < identity.size(); i++)
+        kept[i] = csrs[identity[i]];
+
+    csrs.fill(0);
+
+    for (size_t i = 0; i < identity.size(); i++)
+        csrs[identity[i]] = kept[i];
+
+    mip = 0;
+    mie = 0;
+    mideleg = 0;
+    sip = 0;
+    sie = 0;
+    mstatus = {};
+    sstatus = {};
+
+    this->pc = pc;
+    Setup();
+
+    waiting_for_interrupt = false;
+    watch_hit.reset();
+    err.clear();
+
+    ticks = 0;
+    history_count = 0;
+    history_next = 0;
+    events = {};
+    indirect_jumps = 0;
+    indirect_hits = 0;
+    jit_instructions = 0;
+    block_instructions = 0;
+
+    // The caches keep their storage and only forget what they held
+    instruction_cache.Invalidate();
+
+    InvalidateBasicBlocks();
+    jit.Reset();
+
+    host_pages = {};
+    host_page_generation = memory.GetHostPageGeneration();
+}
+
+bool VirtualMachine::TakeStartRequest() {
+    if (!start_requested.exchange(false, std::memory_order_acquire)) return false;
+
+    pc = start_address.load(std::memory_order_relaxed);
+    Setup();
+
+    waiting_for_interrupt = false;
+    paused = pause_on_restart;
+    return true;
 }
 
-VirtualMachine::VirtualMachine(Memory& memory, Address starting_pc, Address hart_id) : memory{memory}, pc{starting_pc} {
+VirtualMachine::VirtualMachine(Memory& memory, Address starting_pc, Address hart_id) : memory{memory}, instruction_cache{memory}, pc{starting_pc} {
     csrs[CSR_MVENDORID] = 0;
 
     csrs[CSR_MARCHID] = ('E' << 24) | ('N' << 16) | ('I' << 8) | ('H');
@@ -556,69 +865,160 @@ VirtualMachine::VirtualMachine(Memory& memory, Address starting_pc, Address hart
 
     csrs[CSR_MHARTID] = hart_id;
 
-    csrs[CSR_MISA] = ISA_64_BITS | ISA_A | ISA_D | ISA_F | ISA_I | ISA_M;
+    csrs[CSR_MISA] = ISA_64_BITS | ISA_A | ISA_B | ISA_C | ISA_D | ISA_F | ISA_I | ISA_M | ISA_V;
+
+    clint = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+    if (!clint) {
+        clint = MemoryCLINT::Create();
+        memory.AddMemoryRegion(clint);
+    }
 
-    csr_mapped_memory = std::make_shared<CSRMappedMemory>();
-    memory.AddMemoryRegion(csr_mapped_memory);
+    clint->AttachHart(hart_id, this);
 
-    auto now = std::chrono::system_clock::now();
-    auto epoch = now.time_since_epoch();
-    auto dur_ms = std::chrono::duration_cast<std::chrono::microseconds>(epoch);
-    
-    double ms = dur_ms.count() / 1000000.0;
-    csr_mapped_memory->time = ms * CSRMappedMemory::TICKS_PER_SECOND;
+    tracer.SetThread(hart_id, std::format("hart {}", hart_id));
     
     Setup();
 }
 
-VirtualMachine::VirtualMachine(VirtualMachine&& vm) : memory{vm.memory}, pc{vm.pc} {
+VirtualMachine::VirtualMachine(VirtualMachine&& vm) : memory{vm.memory}, instruction_cache{std::move(vm.instruction_cache)}, pc{vm.pc} {
     regs = std::move(vm.regs);
     fregs = std::move(vm.fregs);
+    vregs = std::move(vm.vregs);
     csrs = std::move(vm.csrs);
-    tlb_cache = std::move(vm.tlb_cache);
+    instruction_tlb = std::move(vm.instruction_tlb);
+    data_tlb = std::move(vm.data_tlb);
+    tlb_generation = std::move(vm.tlb_generation);
     running = std::move(vm.running);
     paused = std::move(vm.paused);
     pause_on_break = std::move(vm.pause_on_break);
     pause_on_restart = std::move(vm.pause_on_restart);
+    device_tree = vm.device_tree;
     err = std::move(vm.err);
-    break_points = std::move(vm.break_points);
     ticks = std::move(vm.ticks);
-    history_delta = std::move(vm.history_delta);
-    history_tick = std::move(vm.history_tick);
-    csr_mapped_memory = std::move(vm.csr_mapped_memory);
+    use_basic_blocks = std::move(vm.use_basic_blocks);
+    jit = std::move(vm.jit);
+    use_jit = std::move(vm.use_jit);
+    trap_misaligned = vm.trap_misaligned;
+    profiler = std::move(vm.profiler);
+    profiling = std::move(vm.profiling);
+    tracer = std::move(vm.tracer);
+    tracing = std::move(vm.tracing);
+    instruction_trace = std::move(vm.instruction_trace);
+    wake_handler = std::move(vm.wake_handler);
+    instructions_left = vm.instructions_left;
+    cycles_left = vm.cycles_left;
+    budget_handler = std::move(vm.budget_handler);
+    ecall_handler = std::move(vm.ecall_handler);
+    start_address = vm.start_address.load();
+    start_requested = vm.start_requested.load();
+    events = std::move(vm.events);
+    performance_counters = std::move(vm.performance_counters);
+    count_inhibit = std::move(vm.count_inhibit);
+    jit_instructions = std::move(vm.jit_instructions);
+    block_instructions = std::move(vm.block_instructions);
+    host_pages = std::move(vm.host_pages);
+    host_page_generation = std::move(vm.host_page_generation);
+    history_delta = vm.history_delta;
+    history_tick = vm.history_tick;
+    history_count = vm.history_count;
+    history_next = vm.history_next;
+    clint = std::move(vm.clint);
     cycles = std::move(vm.cycles);
+    stalled_cycles = std::move(vm.stalled_cycles);
     privilege_level = std::move(vm.privilege_level);
+    satp = vm.satp;
+    UpdateTranslation();
+
+    clint->AttachHart(csrs[CSR_MHARTID], this);
 }
 
 VirtualMachine::~VirtualMachine() {
     running = false;
+
+    if (clint)
+        clint->DetachHart(csrs[CSR_MHARTID], this);
 }
 
-bool VirtualMachine::Step(Long steps) {
-    auto SignExtendUnsigned = [](Long value, Long bit) {
-        Long sign = -1ULL << bit;
-        if (value & (1ULL << bit)) return value | sign;
-        return value;
-    };
+bool VirtualMachine::IsStillWaitingForInterrupt() {
+    if (waiting_for_interrupt) {
+        if (mip != 0 || sip != 0 || (mie & ~mideleg) == 0)
+            waiting_for_interrupt = false;
 
-    auto SignExtendSigned = [](SLong value, Long bit) {
-        union S64U64 {
-            Long u;
-            SLong s;
-        };
-        
-        S64U64 v;
-        v.s = value;
-        Long sign = -1ULL << bit;
-        if (v.u & (1ULL << bit)) v.u |= sign;
-        return v.s;
-    };
+        if ((mie & mideleg) != 0 && (sie & mideleg) == 0)
+            waiting_for_interrupt = false;
 
-    auto AsSigned32 = [](Word value) {
-        union S32U32 {
-            Word u;
-            SWord s;
-        };
+        else
+            return true;
+    }
+
+    return false;
+}
+
+void VirtualMachine::HandleInterrupts() {
+    auto pending_interrupts = mip.load(std::memory_order_relaxed);
+
+    // Nearly every instruction ends here
+    if (((pending_interrupts & mie) | (sip & sie)) == 0) [[likely]]
+        return;
+
+    if (mstatus.MIE) {
+        pending_interrupts &= mie;
+
+        auto delegated = pending_interrupts & mideleg;
+        sip |= delegated;
+
+        pending_interrupts &= ~delegated;
+
+        if (pending_interrupts) {
+            for (auto cause : INTERRUPT_PRIORITY) {
+                if (pending_interrupts & (1ULL << cause)) {
+                    RaiseMachineTrap(cause | TRAP_INTERRUPT_BIT);
+                    return;
+                }
+            }
+        }
+
+        if (mstatus.SIE && sstatus.SIE) {
+            pending_interrupts = sip;
+            pending_interrupts &= sie;
+
+            if (pending_interrupts) {
+                for (auto cause : INTERRUPT_PRIORITY) {
+                    if (pending_interrupts & (1ULL << cause)) {
+                        RaiseSupervisorTrap(cause | TRAP_INTERRUPT_BIT);
+                        return;
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool VirtualMachine::Execute(const RVInstruction& instr) {
+    auto SignExtendUnsigned = [](Long value, Long bit) {
+        Long sign = -1ULL << bit;
+        if (value & (1ULL << bit)) return value | sign;
+        return value;
+    };
+
+    auto SignExtendSigned = [](SLong value, Long bit) {
+        union S64U64 {
+            Long u;
+            SLong s;
+        };
+        
+        S64U64 v;
+        v.s = value;
+        Long sign = -1ULL << bit;
+        if (v.u & (1ULL << bit)) v.u |= sign;
+        return v.s;
+    };
+
+    auto AsSigned32 = [](Word value) {
+        union S32U32 {
+            Word u;
+            SWord s;
+        };
 
         S32U32 v;
         v.u = value;
@@ -743,54 +1143,39 @@ bool VirtualMachine::Step(Long steps) {
         if (inexact) csrs[CSR_FCSR] |= CSR_FCSR_NX;
     };
 
+    // Full products as {high, low}, built from 32 bit halves
     auto UnsignedMul128 = [](Long lhs, Long rhs) {
-        Long u1 = (lhs & 0xffffffff);
-        Long v1 = (rhs & 0xffffffff);
-        Long t = (u1 & v1);
-        Long w3 = (t & 0xffffffff);
-        Long k = (w3 >> 32);
-
-        lhs >>= 32;
-        t = (lhs * v1) + k;
-        k = (t & 0xffffffff);
-        Long w1 = (t >> 32);
-
-        rhs >>= 32;
-        t = (u1 * rhs) + k;
-        k = (t >> 32);
-
-        return std::pair<Long, Long>((lhs * rhs) + w1 + k, (t << 32) + w3);
-    };
+        Long lhs_low = lhs & 0xffffffff;
+        Long rhs_low = rhs & 0xffffffff;
+        Long lhs_high = lhs >> 32;
+        Long rhs_high = rhs >> 32;
 
-    auto SignedMul128 = [&](SLong lhs, SLong rhs) {
-        bool lhs_neg = lhs < 0;
-        bool rhs_neg = rhs < 0;
+        Long low = lhs_low * rhs_low;
+        Long middle = lhs_high * rhs_low + (low >> 32);
+        Long carry = lhs_low * rhs_high + (middle & 0xffffffff);
 
-        if (lhs_neg) lhs = -lhs;
-        if (rhs_neg) rhs = -rhs;
+        return std::pair<Long, Long>(lhs_high * rhs_high + (middle >> 32) + (carry >> 32), (carry << 32) | (low & 0xffffffff));
+    };
 
+    // A negative operand reads as 2^64 more unsigned, which only adds the
+    // other operand to the high half
+    auto SignedMul128 = [&](SLong lhs, SLong rhs) {
         auto result = UnsignedMul128(lhs, rhs);
 
-        if (lhs_neg != rhs_neg)
-            return std::pair<Long, Long>(-result.first, -result.second);
-        
+        if (lhs < 0) result.first -= rhs;
+        if (rhs < 0) result.first -= lhs;
+
         return result;
     };
 
     auto SignedUnsignedMul128 = [&](SLong lhs, Long rhs) {
-        bool lhs_neg = lhs < 0;
-
-        if (lhs_neg) lhs = -lhs;
-
         auto result = UnsignedMul128(lhs, rhs);
 
-        if (lhs_neg)
-            return std::pair<Long, Long>(-result.first, -result.second);
-        
+        if (lhs < 0) result.first -= rhs;
+
         return result;
     };
 
-    ticks += steps;
 
     using Type = RVInstruction::Type;
 
@@ -799,2680 +1184,3913 @@ bool VirtualMachine::Step(Long steps) {
     constexpr Long RV_F64_NAN = 0x7ff0000000000000;
     constexpr Long RV_F64_QNAN = 0xfff0000000000000;
     
-    for (Word i = 0; i < steps && running; i++) {
-        cycles++;
-
-        if (waiting_for_interrupt) {
-            if (mip != 0 || sip != 0 || (mie & ~mideleg) == 0)
-                waiting_for_interrupt = false;
-
-            if ((mie & mideleg) != 0 && (sie & mideleg) == 0)
-                waiting_for_interrupt = false;
-
-            else
-                continue;
-        }
-
-        if (mstatus.MIE) {
-            auto pending_interrupts = mip;
-            pending_interrupts &= mie;
+    bool inc_pc = true;
 
-            auto delegated = pending_interrupts & mideleg;
-            sip |= delegated;
+    auto RS1 = [&]() {
+        if (Is32BitMode())
+            return static_cast<Long>(regs[instr.rs1].u32);
+        
+        return regs[instr.rs1].u64;
+    };
 
-            pending_interrupts &= ~delegated;
+    auto RS2 = [&]() {
+        if (Is32BitMode())
+            return static_cast<Long>(regs[instr.rs2].u32);
+        
+        return regs[instr.rs2].u64;
+    };
 
-            bool handled = false;
+    auto SignedRS1 = [&]() {
+        if (Is32BitMode())
+            return static_cast<SLong>(regs[instr.rs1].s32);
+        
+        return regs[instr.rs1].s64;
+    };
 
-            if (pending_interrupts) {
-                for (Word cause = 31; cause > 32; cause--) {
-                    if (pending_interrupts & (1ULL << cause)) {
-                        RaiseMachineTrap(cause | TRAP_INTERRUPT_BIT);
-                        handled = true;
-                        break;
-                    }
-                }
-            }
+    auto SignedRS2 = [&]() {
+        if (Is32BitMode())
+            return static_cast<SLong>(regs[instr.rs2].s32);
+        
+        return regs[instr.rs2].s64;
+    };
 
-            if (!handled && mstatus.SIE && sstatus.SIE) {
-                pending_interrupts = sip;
-                pending_interrupts &= sie;
+    auto SetRD = [&](Long value) {
+        if (instr.rd == 0) return;
 
-                if (pending_interrupts) {
-                    for (Word cause = 31; cause > 32; cause--) {
-                        if (pending_interrupts & (1ULL << cause)) {
-                            RaiseSupervisorTrap(cause | TRAP_INTERRUPT_BIT);
-                            break;
-                        }
-                    }
-                }
-            }
-        }
+        if (Is32BitMode())
+            regs[instr.rd].u32 = static_cast<Word>(value);
         
-        if (pc & 0b11) {
-            RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT);
-            continue;
-        }
+        else
+            regs[instr.rd].u64 = value;
+    };
 
-        auto [translated_address, translation_valid] = TranslateMemoryAddress(pc, false, true);
-        if (!translation_valid) continue;
+    auto SetSignedRD = [&](SLong value) {
+        if (instr.rd == 0) return;
         
-        auto instr = RVInstruction::FromUInt32(memory.ReadWord(translated_address));
-
-        bool inc_pc = true;
-
-        auto RS1 = [&]() {
-            if (Is32BitMode())
-                return static_cast<Long>(regs[instr.rs1].u32);
-            
-            return regs[instr.rs1].u64;
-        };
+        if (Is32BitMode())
+            regs[instr.rd].s32 = static_cast<SWord>(value);
+        
+        else
+            regs[instr.rd].s64 = value;
+    };
 
-        auto RS2 = [&]() {
-            if (Is32BitMode())
-                return static_cast<Long>(regs[instr.rs2].u32);
-            
-            return regs[instr.rs2].u64;
-        };
+    // The .UW and W forms of the bit manipulation set only exist on RV64
+    auto RequireRV64 = [&]() {
+        if (!Is32BitMode()) return true;
 
-        auto SignedRS1 = [&]() {
-            if (Is32BitMode())
-                return static_cast<SLong>(regs[instr.rs1].s32);
-            
-            return regs[instr.rs1].s64;
-        };
+        RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+        inc_pc = false;
+        return false;
+    };
 
-        auto SignedRS2 = [&]() {
-            if (Is32BitMode())
-                return static_cast<SLong>(regs[instr.rs2].s32);
-            
-            return regs[instr.rs2].s64;
-        };
+    // Rotates, bit indices and counts work on XLEN bits
+    auto XLen = [&]() -> Long {
+        return Is32BitMode() ? 32 : 64;
+    };
 
-        auto SetRD = [&](Long value) {
-            if (instr.rd == 0) return;
+    if (profiling) profiler.CountInstruction(instr, pc);
 
-            if (Is32BitMode())
-                regs[instr.rd].u32 = static_cast<Word>(value);
+    switch (instr.type) {
+        case Type::LUI:
+            SetRD(instr.immediate);
+            break;
+        
+        case Type::AUIPC:
+            SetRD(pc + instr.immediate);
+            break;
+        
+        case Type::JAL: {
+            Long next_pc = pc + instr.size;
+            pc += instr.immediate;
+            SetRD(next_pc);
+            break;
+        }
+        
+        case Type::JALR: {
+            Long next_pc = pc + instr.size;
+            pc = (RS1() + instr.immediate) & 0xfffffffffffffffe;
+            SetRD(next_pc);
+            break;
+        }
+        
+        case Type::BEQ: {
+            if (RS1() == RS2()) {
+                pc += instr.immediate;
+                events[HPM_EVENT_BRANCHES_TAKEN]++;
+            }
             
             else
-                regs[instr.rd].u64 = value;
-        };
-
-        auto SetSignedRD = [&](SLong value) {
-            if (instr.rd == 0) return;
+                pc += instr.size;
             
-            if (Is32BitMode())
-                regs[instr.rd].s32 = static_cast<SWord>(value);
+            break;
+        }
+        
+        case Type::BNE: {
+            if (RS1() != RS2()) {
+                pc += instr.immediate;
+                events[HPM_EVENT_BRANCHES_TAKEN]++;
+            }
             
             else
-                regs[instr.rd].s64 = value;
-        };
-
-        switch (instr.type) {
-            case Type::LUI:
-                SetRD(instr.immediate);
-                break;
-            
-            case Type::AUIPC:
-                SetRD(pc + instr.immediate);
-                break;
+                pc += instr.size;
             
-            case Type::JAL: {
-                Long next_pc = pc + 4;
+            break;
+        }
+        
+        case Type::BLT: {
+            if (SignedRS1() < SignedRS2()) {
                 pc += instr.immediate;
-                SetRD(next_pc);
-                break;
-            }
-            
-            case Type::JALR: {
-                Long next_pc = pc + 4;
-                pc = (RS1() + instr.immediate) & 0xfffffffffffffffe;
-                SetRD(next_pc);
-                break;
+                events[HPM_EVENT_BRANCHES_TAKEN]++;
             }
             
-            case Type::BEQ: {
-                if (RS1() == RS2())
-                    pc += instr.immediate;
-                
-                else
-                    pc += 4;
-                
-                break;
-            }
+            else
+                pc += instr.size;
             
-            case Type::BNE: {
-                if (RS1() != RS2())
-                    pc += instr.immediate;
-                
-                else
-                    pc += 4;
-                
-                break;
+            break;
+        }
+        
+        case Type::BGE: {
+            if (SignedRS1() >= SignedRS2()) {
+                pc += instr.immediate;
+                events[HPM_EVENT_BRANCHES_TAKEN]++;
             }
             
-            case Type::BLT: {
-                if (SignedRS1() < SignedRS2())
-                    pc += instr.immediate;
-                
-                else
-                    pc += 4;
-                
-                break;
-            }
+            else
+                pc += instr.size;
             
-            case Type::BGE: {
-                if (SignedRS1() >= SignedRS2())
-                    pc += instr.immediate;
-                
-                else
-                    pc += 4;
-                
-                break;
+            break;
+        }
+        
+        case Type::BLTU: {
+            if (RS1() < RS2()) {
+                pc += instr.immediate;
+                events[HPM_EVENT_BRANCHES_TAKEN]++;
             }
             
-            case Type::BLTU: {
-                if (RS1() < RS2())
-                    pc += instr.immediate;
-                
-                else
-                    pc += 4;
-                
-                break;
-            }
+            else
+                pc += instr.size;
             
-            case Type::BGEU: {
-                if (RS1() >= RS2())
-                    pc += instr.immediate;
-                
-                else
-                    pc += 4;
-                
-                break;
+            break;
+        }
+        
+        case Type::BGEU: {
+            if (RS1() >= RS2()) {
+                pc += instr.immediate;
+                events[HPM_EVENT_BRANCHES_TAKEN]++;
             }
             
-            case Type::LB: {
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
-
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                if (!translation_valid) continue;
-                SetRD(SignExtendUnsigned(memory.ReadByte(translated_address), 7));
-                break;
-            }
+            else
+                pc += instr.size;
             
-            case Type::LH: {
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
+            break;
+        }
+        
+        case Type::LB: {
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
+
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            if (!translation_valid) return false;
+            auto [value, loaded] = Load<Byte>(addr, translated_address);
+            if (!loaded) return false;
+            SetRD(SignExtendUnsigned(value, 7));
+            break;
+        }
+        
+        case Type::LH: {
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
+
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            if (!translation_valid) return false;
+            auto [value, loaded] = Load<Half>(addr, translated_address);
+            if (!loaded) return false;
+            SetRD(SignExtendUnsigned(value, 15));
+            break;
+        }
+        
+        case Type::LW: {
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
+            
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            if (!translation_valid) return false;
+            auto [value, loaded] = Load<Word>(addr, translated_address);
+            if (!loaded) return false;
+            SetRD(SignExtendUnsigned(value, 31));
+            break;
+        }
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                if (!translation_valid) continue;
-                SetRD(SignExtendUnsigned(memory.ReadHalf(translated_address), 15));
-                break;
-            }
-            
-            case Type::LW: {
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
-                
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                if (!translation_valid) continue;
-                SetRD(SignExtendUnsigned(memory.ReadWord(translated_address), 31));
-                break;
-            }
+        case Type::LBU: {
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
 
-            case Type::LBU: {
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            if (!translation_valid) return false;
+            auto [value, loaded] = Load<Byte>(addr, translated_address);
+            if (!loaded) return false;
+            SetRD(static_cast<Long>(value));
+            break;
+        }
+        
+        case Type::LHU: {
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
+
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            if (!translation_valid) return false;
+            auto [value, loaded] = Load<Half>(addr, translated_address);
+            if (!loaded) return false;
+            SetRD(static_cast<Long>(value));
+            break;
+        }
+        
+        case Type::SB: {
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            if (Is32BitMode()) addr &= 0xfffffffff;
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                if (!translation_valid) continue;
-                SetRD(static_cast<Long>(memory.ReadByte(translated_address)));
-                break;
-            }
-            
-            case Type::LHU: {
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
+            if (!translation_valid) return false;
+            if (!Store<Byte>(addr, translated_address, static_cast<uint8_t>(RS2()))) return false;
+            break;
+        }
+        
+        case Type::SH: {
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                if (!translation_valid) continue;
-                SetRD(static_cast<Long>(memory.ReadHalf(translated_address)));
-                break;
-            }
-            
-            case Type::SB: {
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                if (Is32BitMode()) addr &= 0xfffffffff;
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
+            if (!translation_valid) return false;
+            if (!Store<Half>(addr, translated_address, static_cast<uint16_t>(RS2()))) return false;
+            break;
+        }
+        
+        case Type::SW: {
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-                if (!translation_valid) continue;
-                memory.WriteByte(translated_address, static_cast<uint8_t>(RS2()));
-                break;
-            }
-            
-            case Type::SH: {
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
+            if (!translation_valid) return false;
+            if (!Store<Word>(addr, translated_address, RS2())) return false;
+            break;
+        }
+        
+        case Type::ADDI:
+            SetRD(RS1() + instr.immediate);
+            break;
+        
+        case Type::SLTI:
+            SetRD(SignedRS1() < instr.s_immediate ? 1 : 0);
+            break;
+        
+        case Type::SLTIU:
+            SetRD(RS1() < instr.immediate ? 1 : 0);
+            break;
+        
+        case Type::XORI:
+            SetRD(RS1() ^ instr.immediate);
+            break;
+        
+        case Type::ORI:
+            SetRD(RS1() | instr.immediate);
+            break;
+        
+        case Type::ANDI:
+            SetRD(RS1() & instr.immediate);
+            break;
+        
+        case Type::SLLI: {
+            auto amount = instr.immediate & 0b111111;
+            SetRD(RS1() << amount);
+            break;
+        }
+        
+        case Type::SRLI: {
+            auto amount = instr.immediate & 0b111111;
+            SetRD(RS1() >> amount);
+            break;
+        }
+        
+        case Type::SRAI: {
+            auto amount = instr.immediate & 0b111111;
+            auto value = RS1() >> amount;
+            Long sign = -1ULL << amount;
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-                if (!translation_valid) continue;
-                memory.WriteHalf(translated_address, static_cast<uint16_t>(RS2()));
-                break;
-            }
-            
-            case Type::SW: {
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
+            if (Is32BitMode() && (RS1() & (1ULL << 31)))
+                value |= sign;
+            else if (!Is32BitMode() && (RS1() & (1ULL << 63)))
+                value |= sign;
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-                if (!translation_valid) continue;
-                memory.WriteWord(translated_address, RS2());
-                break;
-            }
-            
-            case Type::ADDI:
-                SetRD(RS1() + instr.immediate);
-                break;
-            
-            case Type::SLTI:
-                SetRD(SignedRS1() < instr.s_immediate ? 1 : 0);
-                break;
-            
-            case Type::SLTIU:
-                SetRD(RS1() < instr.immediate ? 1 : 0);
-                break;
+            SetRD(value);
+            break;
+        }
+        
+        case Type::ADD:
+            SetRD(RS1() + RS2());
+            break;
+        
+        case Type::SUB:
+            SetRD(RS1() - RS2());
+            break;
+        
+        case Type::SLL: {
+            auto amount = RS2() & 0x3f;
+            SetRD(RS1() << amount);
+            break;
+        }
+        
+        case Type::SLT:
+            SetRD(SignedRS1() < SignedRS2() ? 1 : 0);
+            break;
+        
+        case Type::SLTU:
+            SetRD(RS1() < RS2() ? 1 : 0);
+            break;
+        
+        case Type::XOR:
+            SetRD(RS1() ^ RS2());
+            break;
+        
+        case Type::SRL: {
+            auto amount = RS2() & 0x3f;
+            SetRD(RS1() >> amount);
+            break;
+        }
+        
+        case Type::SRA: {
+            auto amount = RS2() & 0x3f;
+            auto value = RS1() >> amount;
+            Long sign = -1ULL << amount;
+
+            if (Is32BitMode() && (RS1() & (1ULL << 31)))
+                value |= sign;
+            else if (!Is32BitMode() && (RS1() & (1ULL << 63)))
+                value |= sign;
+
+            SetRD(value);
+            break;
+        }
+        
+        case Type::OR:
+            SetRD(RS1() | RS2());
+            break;
+        
+        case Type::AND:
+            SetRD(RS1() & RS2());
+            break;
+        
+        case Type::FENCE:
+            break;
+        
+        case Type::FENCE_I:
+            instruction_cache.Invalidate();
+            basic_blocks_dirty = true;
+            break;
+        
+        case Type::ECALL:
+            switch (privilege_level) {
+                case PrivilegeLevel::Machine: {
+                    Long value = regs[REG_A0].u64;
+                    if (Is32BitMode()) value &= 0xffffffff;
+
+                    if (tracing) tracer.Begin(Tracer::Kind::ECall, value);
+
+                    if (ecall_handler)
+                        ecall_handler(csrs[CSR_MHARTID], Is32BitMode(), memory, regs, fregs);
+
+                    else if (auto handler = FindECall(value))
+                        (*handler)(csrs[CSR_MHARTID], Is32BitMode(), memory, regs, fregs);
+                    
+                    else
+                        EmptyECallHandler(csrs[CSR_MHARTID], Is32BitMode(), memory, regs, fregs);
+
+                    if (tracing) tracer.End(Tracer::Kind::ECall);
+
+                    // A hart that started itself continues at the new pc
+                    if (start_requested.load(std::memory_order_relaxed) && TakeStartRequest())
+                        inc_pc = false;
+
+                    break;
+                }
+                
+                case PrivilegeLevel::Supervisor:
+                    RaiseException(EXCEPTION_ENVIRONMENT_CALL_FROM_S_MODE);
+                    inc_pc = false;
+                    break;
+                
+                case PrivilegeLevel::User:
+                    RaiseException(EXCEPTION_ENVIRONMENT_CALL_FROM_U_MODE);
+                    inc_pc = false;
+                    break;
+            }
+            break;
+        
+        case Type::EBREAK:
+            if (privilege_level == PrivilegeLevel::User) {
+                RaiseException(EXCEPTION_BREAKPOINT);
+                inc_pc = false;
+            }
+            
+            break;
+
+        case Type::LWU: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            if (!translation_valid) return false;
+            auto [value, loaded] = Load<Word>(addr, translated_address);
+            if (!loaded) return false;
+            SetRD(value);
+            break;
+        }
+
+        case Type::LD: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            if (!translation_valid) return false;
+            auto [value, loaded] = Load<Long>(addr, translated_address);
+            if (!loaded) return false;
+            SetRD(value);
+            break;
+        }
+
+        case Type::SD: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            Long addr = regs[instr.rs1].u64 + instr.immediate;
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
+            if (!translation_valid) return false;
+            if (!Store<Long>(addr, translated_address, regs[instr.rs2].u64)) return false;
+            break;
+        };
+
+        case Type::ADDIW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            Long val = regs[instr.rs1].u64 + instr.immediate;
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+            regs[instr.rd].u64 = val;
+            break;
+        }
+
+        case Type::SLLIW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            auto shift = instr.immediate & 0b111111;
+            Long val = regs[instr.rs1].u64 << shift;
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+            regs[instr.rd].u64 = val;
+            break;
+        }
+
+        case Type::SRLIW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            auto shift = instr.immediate & 0b111111;
+            Long val = regs[instr.rs1].u64;
+            val &= 0xffffffff;
+            val >>= shift;
+            val = SignExtendUnsigned(val, 31);
+            regs[instr.rd].u64 = val;
+            break;
+        }
+
+        case Type::SRAIW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            auto shift = instr.immediate & 0b111111;
+            Long val = regs[instr.rs1].u64 >> shift;
+            if (regs[instr.rs1].u64 & (1ULL << 63))
+                val |= -1ULL << (64 - shift);
+
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+            regs[instr.rd].u64 = val;
+            break;
+        }
+
+        case Type::ADDW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            Long val = regs[instr.rs1].u64 + regs[instr.rs2].u64;
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+            regs[instr.rd].u64 = val;
+            break;
+        }
+
+        case Type::SUBW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            Long val = regs[instr.rs1].u64 - regs[instr.rs2].u64;
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+            regs[instr.rd].u64 = val;
+            break;
+        }
+
+        case Type::SLLW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            auto shift = regs[instr.rs2].u64 & 0b111111;
+            Long val = regs[instr.rs1].u64 << shift;
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+            regs[instr.rd].u64 = val;
+            break;
+        }
+
+        case Type::SRLW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            auto shift = regs[instr.rs2].u64 & 0b111111;
+            Long val = regs[instr.rs1].u64 >> shift;
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+            regs[instr.rd].u64 = val;
+            break;
+        }
+
+        case Type::SRAW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            auto shift = regs[instr.rs2].u64 & 0b111111;
+            Long val = regs[instr.rs1].u64 >> shift;
+            if (regs[instr.rs1].u64 & (1ULL << 63))
+                val |= -1ULL << (64 - shift);
+            
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+            regs[instr.rd].u64 = val;
+            break;
+        }
+
+        case Type::ADD_UW:
+            if (!RequireRV64()) break;
+            SetRD((RS1() & 0xffffffff) + RS2());
+            break;
+
+        case Type::SH1ADD:
+            SetRD((RS1() << 1) + RS2());
+            break;
+
+        case Type::SH2ADD:
+            SetRD((RS1() << 2) + RS2());
+            break;
+
+        case Type::SH3ADD:
+            SetRD((RS1() << 3) + RS2());
+            break;
+
+        case Type::SH1ADD_UW:
+            if (!RequireRV64()) break;
+            SetRD(((RS1() & 0xffffffff) << 1) + RS2());
+            break;
+
+        case Type::SH2ADD_UW:
+            if (!RequireRV64()) break;
+            SetRD(((RS1() & 0xffffffff) << 2) + RS2());
+            break;
+
+        case Type::SH3ADD_UW:
+            if (!RequireRV64()) break;
+            SetRD(((RS1() & 0xffffffff) << 3) + RS2());
+            break;
+
+        case Type::SLLI_UW:
+            if (!RequireRV64()) break;
+            SetRD((RS1() & 0xffffffff) << (instr.immediate & 0b111111));
+            break;
+
+        case Type::ANDN:
+            SetRD(RS1() & ~RS2());
+            break;
+
+        case Type::ORN:
+            SetRD(RS1() | ~RS2());
+            break;
+
+        case Type::XNOR:
+            SetRD(~(RS1() ^ RS2()));
+            break;
+
+        case Type::CLZ:
+            SetRD(Is32BitMode() ? std::countl_zero(static_cast<Word>(RS1())) : std::countl_zero(RS1()));
+            break;
+
+        case Type::CLZW:
+            if (!RequireRV64()) break;
+            SetRD(std::countl_zero(static_cast<Word>(RS1())));
+            break;
+
+        case Type::CTZ:
+            SetRD(Is32BitMode() ? std::countr_zero(static_cast<Word>(RS1())) : std::countr_zero(RS1()));
+            break;
+
+        case Type::CTZW:
+            if (!RequireRV64()) break;
+            SetRD(std::countr_zero(static_cast<Word>(RS1())));
+            break;
+
+        case Type::CPOP:
+            SetRD(std::popcount(RS1()));
+            break;
+
+        case Type::CPOPW:
+            if (!RequireRV64()) break;
+            SetRD(std::popcount(static_cast<Word>(RS1())));
+            break;
+
+        case Type::MAX:
+            SetSignedRD(std::max(SignedRS1(), SignedRS2()));
+            break;
+
+        case Type::MAXU:
+            SetRD(std::max(RS1(), RS2()));
+            break;
+
+        case Type::MIN:
+            SetSignedRD(std::min(SignedRS1(), SignedRS2()));
+            break;
+
+        case Type::MINU:
+            SetRD(std::min(RS1(), RS2()));
+            break;
+
+        case Type::SEXT_B:
+            SetSignedRD(static_cast<SByte>(RS1()));
+            break;
+
+        case Type::SEXT_H:
+            SetSignedRD(static_cast<SHalf>(RS1()));
+            break;
+
+        case Type::ZEXT_H:
+            if (!RequireRV64()) break;
+            SetRD(RS1() & 0xffff);
+            break;
+
+        case Type::ROL:
+            SetRD(Is32BitMode() ? std::rotl(static_cast<Word>(RS1()), RS2() & 31) : std::rotl(RS1(), RS2() & 63));
+            break;
+
+        case Type::ROLW:
+            if (!RequireRV64()) break;
+            SetSignedRD(static_cast<SWord>(std::rotl(static_cast<Word>(RS1()), RS2() & 31)));
+            break;
+
+        case Type::ROR:
+            SetRD(Is32BitMode() ? std::rotr(static_cast<Word>(RS1()), RS2() & 31) : std::rotr(RS1(), RS2() & 63));
+            break;
+
+        case Type::RORI:
+            SetRD(Is32BitMode() ? std::rotr(static_cast<Word>(RS1()), instr.immediate & 31) : std::rotr(RS1(), instr.immediate & 63));
+            break;
+
+        case Type::RORIW:
+            if (!RequireRV64()) break;
+            SetSignedRD(static_cast<SWord>(std::rotr(static_cast<Word>(RS1()), instr.immediate & 31)));
+            break;
+
+        case Type::RORW:
+            if (!RequireRV64()) break;
+            SetSignedRD(static_cast<SWord>(std::rotr(static_cast<Word>(RS1()), RS2() & 31)));
+            break;
+
+        case Type::ORC_B: {
+            Long value = RS1();
+            Long result = 0;
+
+            for (Long byte = 0; byte < 64; byte += 8) {
+                if (value & (0xffULL << byte))
+                    result |= 0xffULL << byte;
+            }
+
+            SetRD(result);
+            break;
+        }
+
+        case Type::REV8:
+            if (!RequireRV64()) break;
+            SetRD(__builtin_bswap64(RS1()));
+            break;
+
+        case Type::BCLR:
+            SetRD(RS1() & ~(1ULL << (RS2() & (XLen() - 1))));
+            break;
+
+        case Type::BCLRI:
+            SetRD(RS1() & ~(1ULL << (instr.immediate & (XLen() - 1))));
+            break;
+
+        case Type::BEXT:
+            SetRD((RS1() >> (RS2() & (XLen() - 1))) & 1);
+            break;
+
+        case Type::BEXTI:
+            SetRD((RS1() >> (instr.immediate & (XLen() - 1))) & 1);
+            break;
+
+        case Type::BINV:
+            SetRD(RS1() ^ (1ULL << (RS2() & (XLen() - 1))));
+            break;
+
+        case Type::BINVI:
+            SetRD(RS1() ^ (1ULL << (instr.immediate & (XLen() - 1))));
+            break;
+
+        case Type::BSET:
+            SetRD(RS1() | (1ULL << (RS2() & (XLen() - 1))));
+            break;
+
+        case Type::BSETI:
+            SetRD(RS1() | (1ULL << (instr.immediate & (XLen() - 1))));
+            break;
+
+        case Type::CSRRW: {
+            auto value = RS1();
+
+            if (instr.rd != REG_ZERO)
+                SetRD(ReadCSR(instr.immediate));
+            
+            WriteCSR(instr.immediate, value);
+            break;
+        }
+        
+        case Type::CSRRS: {
+            if (IsCounterRead(instr)) {
+                if (instr.rd != REG_ZERO)
+                    SetRD(ReadCounter(instr.immediate));
+
+                break;
+            }
+
+            auto value = RS1();
+
+            if (instr.rd != REG_ZERO)
+                SetRD(ReadCSR(instr.immediate));
+            
+            if (instr.rs1 != REG_ZERO)
+                WriteCSR(instr.immediate, ReadCSR(instr.immediate, true) | value);
+            
+            break;
+        }
+        
+        case Type::CSRRC: {
+            auto value = RS1();
+            if (instr.rd != REG_ZERO)
+                SetRD(ReadCSR(instr.immediate));
+            
+            if (instr.rs1 != REG_ZERO)
+                WriteCSR(instr.immediate, ReadCSR(instr.immediate, true) & ~value);
+            
+            break;
+        }
+        
+        case Type::CSRRWI: {
+            auto value = instr.rs1;
+            if (instr.rd != REG_ZERO)
+                SetRD(ReadCSR(instr.immediate));
+            
+            WriteCSR(instr.immediate, value);
+            break;
+        }
+        
+        case Type::CSRRSI: {
+            auto value = instr.rs1;
+            if (instr.rd != REG_ZERO)
+                SetRD(ReadCSR(instr.immediate));
+            
+            WriteCSR(instr.immediate, ReadCSR(instr.immediate, true) | value);
+            break;
+        }
+        
+        case Type::CSRRCI: {
+            auto value = instr.rs1;
+            if (instr.rd != REG_ZERO)
+                SetRD(ReadCSR(instr.immediate));
+            
+            WriteCSR(instr.immediate, ReadCSR(instr.immediate, true) & ~value);
+            break;
+        }
+        
+        case Type::MUL: {
+            auto lhs = SignedRS1();
+            auto rhs = SignedRS2();
+            SetSignedRD(lhs * rhs);
+            break;
+        }
+        
+        case Type::MULH: {
+            auto lhs = SignedRS1();
+            auto rhs = SignedRS2();
+
+            if (Is32BitMode()) 
+                SetSignedRD((lhs * rhs) >> 32);
+
+            else {
+                auto result = SignedMul128(lhs, rhs);
+                SetSignedRD(result.first);
+            }
+            break;
+        }
+        
+        case Type::MULHSU: {
+            auto lhs = SignedRS1();
+            auto rhs = RS2();
+
+            if (Is32BitMode())
+                SetSignedRD((lhs * rhs) >> 32);
+
+            else {
+                auto result = SignedUnsignedMul128(lhs, rhs);
+                SetSignedRD(result.first);
+            }
+            break;
+        }
+        
+        case Type::MULHU: {
+            auto lhs = RS1();
+            auto rhs = RS2();
+
+            if (Is32BitMode())
+                SetRD((lhs * rhs) >> 32);
+            
+            else
+                SetRD(UnsignedMul128(lhs, rhs).first);
+            
+            break;
+        }
+
+        case Type::DIV: {
+            auto lhs = SignedRS1();
+            auto rhs = SignedRS2();
+
+            if (rhs == 0)
+                SetRD(-1ULL);
+
+            // The most negative value over -1 overflows back to itself
+            else if (rhs == -1)
+                SetRD(0 - RS1());
+            
+            else
+                SetSignedRD(lhs / rhs);
+            
+            break;
+
+        }
+        
+        case Type::DIVU: {
+            auto lhs = RS1();
+            auto rhs = RS2();
+
+            if (rhs == 0)
+                SetRD(-1ULL);
+            
+            else
+                SetRD(lhs / rhs);
+
+            break;
+        }
+        
+        case Type::REM: {
+            auto lhs = SignedRS1();
+            auto rhs = SignedRS2();
+
+            if (rhs == 0)
+                SetSignedRD(lhs);
+
+            else if (rhs == -1)
+                SetRD(0);
+            
+            else
+                SetSignedRD(lhs % rhs);
+
+            break;
+        }
+        
+        case Type::REMU: {
+            auto lhs = RS1();
+            auto rhs = RS2();
+
+            if (rhs == 0)
+                SetRD(lhs);
+            
+            else
+                SetRD(lhs % rhs);
+
+            break;
+        }
+
+        case Type::MULW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            SLong lhs = regs[instr.rs1].s32;
+            SLong rhs = regs[instr.rs2].s32;
+
+            auto val = lhs * rhs;
+            val &= 0xffffffff;
+            val = SignExtendSigned(val, 31);
+
+            regs[instr.rd].s64 = val;
+            break;
+        }
+
+        case Type::DIVW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            SLong lhs = regs[instr.rs1].s32;
+            SLong rhs = regs[instr.rs2].s32;
+
+            SLong val;
+            if (rhs == 0)
+                val = -1LL;
+            
+            else
+                val = lhs / rhs;
+            
+            val &= 0xffffffff;
+            val = SignExtendSigned(val, 31);
+
+            regs[instr.rd].s64 = val;
+            break;
+        }
+
+        case Type::DIVUW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            Long lhs = regs[instr.rs1].u32;
+            Long rhs = regs[instr.rs2].u32;
+
+            Long val;
+            if (rhs == 0)
+                val = -1ULL;
+            
+            else
+                val = lhs / rhs;
+            
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+
+            regs[instr.rd].s64 = val;
+            break;
+        }
+
+        case Type::REMW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            SLong lhs = regs[instr.rs1].s32;
+            SLong rhs = regs[instr.rs2].s32;
+
+            SLong val;
+            if (rhs == 0)
+                val = lhs;
+            
+            else
+                val = lhs % rhs;
+            
+            val &= 0xffffffff;
+            val = SignExtendSigned(val, 31);
+
+            regs[instr.rd].s64 = val;
+            break;
+        }
+
+        case Type::REMUW: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            Long lhs = regs[instr.rs1].u32;
+            Long rhs = regs[instr.rs2].u32;
+
+            Long val;
+            if (rhs == 0)
+                val = lhs;
+            
+            else
+                val = lhs % rhs;
+            
+            val &= 0xffffffff;
+            val = SignExtendUnsigned(val, 31);
+
+            regs[instr.rd].u64 = val;
+            break;
+        }
+        
+        case Type::LR_W: {
+            if (instr.rs2 != 0) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Word), false)) return false;
+
+            SetRD(memory.ReadWordReserved(translated_address, csrs[CSR_MHARTID]));
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Read);
+            break;
+        }
+        
+        case Type::SC_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), true, false);
+            if (!translation_valid) return false;
+            
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            if (memory.WriteWordConditional(translated_address, RS2(), csrs[CSR_MHARTID])) {
+                SetRD(0);
+                WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Write);
+            }
+            
+            else {
+                SetRD(1);
+                events[HPM_EVENT_SC_FAILURES]++;
+            }
+            
+            break;
+        }
+        
+        case Type::AMOSWAP_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            SetRD(memory.AtomicSwapW(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Access);
+            break;
+        }
+        
+        case Type::AMOADD_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            SetRD(memory.AtomicAddW(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Access);
+            break;
+        }
+        
+        case Type::AMOXOR_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            SetRD(memory.AtomicXorW(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Access);
+            break;
+        }
+        
+        case Type::AMOAND_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            SetRD(memory.AtomicAndW(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Access);
+            break;
+        }
+        
+        case Type::AMOOR_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+            
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            SetRD(memory.AtomicOrW(translated_address, RS2()));
+            
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Access);
+            break;
+        }
+        
+        case Type::AMOMIN_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            SetRD(memory.AtomicMinW(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Access);
+            break;
+        }
+        
+        case Type::AMOMAX_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            SetRD(memory.AtomicMaxW(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Access);
+            break;
+        }
+        
+        case Type::AMOMINU_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            SetRD(memory.AtomicMinUW(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Access);
+            break;
+        }
+        
+        case Type::AMOMAXU_W: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Word), true)) return false;
+
+            SetRD(memory.AtomicMaxUW(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Word), Memory::WatchKind::Access);
+            break;
+        }
+
+        case Type::LR_D: {
+            if (instr.rs2 != 0) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), false)) return false;
+
+            SetRD(memory.ReadLongReserved(translated_address, csrs[CSR_MHARTID]));
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Read);
+            break;
+        }
+
+        case Type::SC_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), true, false);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            if (memory.WriteLongConditional(translated_address, RS2(), csrs[CSR_MHARTID])) {
+                SetRD(0);
+                WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Write);
+            }
+            
+            else {
+                SetRD(1);
+                events[HPM_EVENT_SC_FAILURES]++;
+            }
+            
+            break;
+        }
+
+        case Type::AMOSWAP_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            SetRD(memory.AtomicSwapL(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Access);
+            break;
+        }
+
+        case Type::AMOADD_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            SetRD(memory.AtomicAddL(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Access);
+            break;
+        }
+
+        case Type::AMOXOR_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            SetRD(memory.AtomicXorL(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Access);
+            break;
+        }
+
+        case Type::AMOAND_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            SetRD(memory.AtomicAndL(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Access);
+            break;
+        }
+
+        case Type::AMOOR_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            SetRD(memory.AtomicOrL(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Access);
+            break;
+        }
+
+        case Type::AMOMIN_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            SetRD(memory.AtomicMinL(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Access);
+            break;
+        }
+
+        case Type::AMOMAX_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            SetRD(memory.AtomicMaxL(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Access);
+            break;
+        }
+
+        case Type::AMOMINU_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            SetRD(memory.AtomicMinUL(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Access);
+            break;
+        }
+
+        case Type::AMOMAXU_D: {
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
+            if (!translation_valid) return false;
+
+            if (!CheckAccess(translated_address, sizeof(Long), true)) return false;
+
+            SetRD(memory.AtomicMaxUL(translated_address, RS2()));
+
+            WatchAccess(translated_address, sizeof(Long), Memory::WatchKind::Access);
+            break;
+        }
+        
+        case Type::FLW: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            auto addr = RS1() + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
+
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            if (!translation_valid) return false;
+
+            auto [value, loaded] = Load<Word>(addr, translated_address);
+            if (!loaded) return false;
+
+            fregs[instr.rd] = ToFloat(value);
+            break;
+        }
+        
+        case Type::FSW: {
+            auto addr = RS1() + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
+
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
+            if (!translation_valid) return false;
+            if (!Store<Word>(addr, translated_address, ToUInt32(fregs[instr.rs2]))) return false;
+            break;
+        }
+        
+        case Type::FMADD_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            bool lhs_is_inf;
+            bool rhs_is_zero;
+            ClassF32(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
+            ClassF32(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+
+            if (lhs_is_inf && rhs_is_zero) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            float result = fregs[instr.rs1].f * fregs[instr.rs2].f + fregs[instr.rs3].f;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F32_NAN;
+            
+            else
+                fregs[instr.rd].f = result;
+
+            break;
+        }
+        
+        case Type::FMSUB_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            bool lhs_is_inf;
+            bool rhs_is_zero;
+            ClassF32(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
+            ClassF32(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+
+            if (lhs_is_inf && rhs_is_zero) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            float result = fregs[instr.rs1].f * fregs[instr.rs2].f - fregs[instr.rs3].f;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F32_NAN;
+            
+            else
+                fregs[instr.rd].f = result;
+
+            break;
+        }
+        
+        case Type::FNMSUB_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            bool lhs_is_inf;
+            bool rhs_is_zero;
+            ClassF32(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
+            ClassF32(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+
+            if (lhs_is_inf && rhs_is_zero) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            float result = -(fregs[instr.rs1].f * fregs[instr.rs2].f) + fregs[instr.rs3].f;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F32_NAN;
+            
+            else
+                fregs[instr.rd].f = result;
+
+            break;
+        }
+        
+        case Type::FNMADD_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            bool lhs_is_inf;
+            bool rhs_is_zero;
+            ClassF32(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
+            ClassF32(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+
+            if (lhs_is_inf && rhs_is_zero) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+
+            float result = -(fregs[instr.rs1].f * fregs[instr.rs2].f) - fregs[instr.rs3].f;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F32_NAN;
+            
+            else
+                fregs[instr.rd].f = result;
+
+            break;
+        }
+        
+        case Type::FADD_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            float result = fregs[instr.rs1].f + fregs[instr.rs2].f;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F32_NAN;
+
+            else
+                fregs[instr.rd].f = result;
+            
+            break;
+        }
+        
+        case Type::FSUB_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            float result = fregs[instr.rs1].f - fregs[instr.rs2].f;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F32_NAN;
+
+            else
+                fregs[instr.rd].f = result;
             
-            case Type::XORI:
-                SetRD(RS1() ^ instr.immediate);
+            break;
+        }
+        
+        case Type::FMUL_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
+            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            float result = fregs[instr.rs1].f * fregs[instr.rs2].f;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F32_NAN;
+
+            else
+                fregs[instr.rd].f = result;
             
-            case Type::ORI:
-                SetRD(RS1() | instr.immediate);
+            break;
+        }
+        
+        case Type::FDIV_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
+            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            float result = fregs[instr.rs1].f / fregs[instr.rs2].f;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F32_NAN;
+
+            else
+                fregs[instr.rd].f = result;
             
-            case Type::ANDI:
-                SetRD(RS1() & instr.immediate);
+            break;
+        }
+        
+        case Type::FSQRT_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
+            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            bool is_inf, is_nan, is_qnan, is_neg;
+            ClassF32(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, &is_neg);
+
+            if (is_inf || is_nan || is_qnan || is_neg)
+                fregs[instr.rd].u64 = RV_F32_NAN;
             
-            case Type::SLLI: {
-                auto amount = instr.immediate & 0b111111;
-                SetRD(RS1() << amount);
+            else
+                fregs[instr.rd].f = sqrtf(fregs[instr.rs1].f);
+            
+            break;
+        }
+        
+        case Type::FSGNJ_S: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            Float result = fregs[instr.rs1];
+            Float rhs = fregs[instr.rs2];
+
+            result.u32 &= ~(1<<31);
+            result.u32 |= rhs.u32 & (1<<31);
+            fregs[instr.rd] = result;
+            break;
+        }
+        
+        case Type::FSGNJN_S: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            Float result = fregs[instr.rs1];
+            Float rhs = fregs[instr.rs2];
+
+            result.u32 &= ~(1<<31);
+            result.u32 |= (~rhs.u32) & (1<<31);
+            fregs[instr.rd] = result;
+            break;
+        }
+        
+        case Type::FSGNJX_S: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            Float result = fregs[instr.rs1];
+            Float rhs = fregs[instr.rs2];
+
+            result.u32 ^= rhs.u32 & (1<<31);
+            fregs[instr.rd] = result;
+            break;
+        }
+        
+        case Type::FMIN_S: {
+            bool lhs_neg;
+            bool rhs_neg;
+            bool lhs_snan, lhs_qnan;
+            bool rhs_snan, rhs_qnan;
+            ClassF32(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, &lhs_neg);
+            ClassF32(fregs[instr.rs2], nullptr, &rhs_snan, &rhs_qnan, nullptr, nullptr, &rhs_neg);
+            bool lhs_nan = lhs_snan || lhs_qnan;
+            bool rhs_nan = rhs_snan || rhs_qnan;
+
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            if (lhs_nan && rhs_nan) {
+                SetFloatFlags(true, false, false, false, false);
+                fregs[instr.rd].u64 = RV_F32_NAN;
                 break;
             }
-            
-            case Type::SRLI: {
-                auto amount = instr.immediate & 0b111111;
-                SetRD(RS1() >> amount);
-                break;
+
+            bool lhs_less = false;
+            if (lhs_nan) {
+                lhs_less = false;
+                SetFloatFlags(true, false, false, false, false);
+            }
+            else if (rhs_nan) {
+                lhs_less = true;
+                SetFloatFlags(true, false, false, false, false);
             }
+            else if (lhs_neg && !rhs_neg) lhs_less = true;
+            else if (!lhs_neg && rhs_neg) lhs_less = false;
+            else if (fregs[instr.rs1].f < fregs[instr.rs2].f) lhs_less = true;
+
+            if (lhs_less)
+                fregs[instr.rd] = fregs[instr.rs1];
+            
+            else
+                fregs[instr.rd] = fregs[instr.rs2];
             
-            case Type::SRAI: {
-                auto amount = instr.immediate & 0b111111;
-                auto value = RS1() >> amount;
-                Long sign = -1ULL << amount;
+            break;
+        }
+        
+        case Type::FMAX_S: {
+            bool lhs_neg;
+            bool rhs_neg;
+            bool lhs_snan, lhs_qnan;
+            bool rhs_snan, rhs_qnan;
+            ClassF32(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, &lhs_neg);
+            ClassF32(fregs[instr.rs2], nullptr, &rhs_snan, &rhs_qnan, nullptr, nullptr, &rhs_neg);
+            bool lhs_nan = lhs_snan || lhs_qnan;
+            bool rhs_nan = rhs_snan || rhs_qnan;
 
-                if (Is32BitMode() && (RS1() & (1ULL << 31)))
-                    value |= sign;
-                else if (!Is32BitMode() && (RS1() & (1ULL << 63)))
-                    value |= sign;
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                SetRD(value);
+            if (lhs_nan && rhs_nan) {
+                SetFloatFlags(true, false, false, false, false);
+                fregs[instr.rd].u64 = RV_F32_NAN;
                 break;
             }
+
+            bool lhs_less = false;
+            if (lhs_nan) {
+                lhs_less = false;
+                SetFloatFlags(true, false, false, false, false);
+            }
+            else if (rhs_nan) {
+                lhs_less = true;
+                SetFloatFlags(true, false, false, false, false);
+            }
+            else if (lhs_neg && !rhs_neg) lhs_less = true;
+            else if (!lhs_neg && rhs_neg) lhs_less = false;
+            else if (fregs[instr.rs1].f < fregs[instr.rs2].f) lhs_less = true;
+
+            if (!lhs_less)
+                fregs[instr.rd] = fregs[instr.rs1];
             
-            case Type::ADD:
-                SetRD(RS1() + RS2());
-                break;
+            else
+                fregs[instr.rd] = fregs[instr.rs2];
             
-            case Type::SUB:
-                SetRD(RS1() - RS2());
+            break;
+        }
+        
+        case Type::FCVT_W_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
+            }
+
+            bool is_inf, is_nan, is_qnan;
+            ClassF32(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
             
-            case Type::SLL: {
-                auto amount = RS2() & 0x3f;
-                SetRD(RS1() << amount);
+            Word result;
+
+            if (is_inf) {
+                if (fregs[instr.rs1].f < 0) result = -1U;
+                else result = 0x7fffffff;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else if (is_nan || is_qnan) {
+                result = 0x7fffffff;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else {
+                SWord val = fregs[instr.rs1].f;
+                if (val != fregs[instr.rs1].f)
+                    SetFloatFlags(false, false, false, false, true);
+
+                result = AsUnsigned32(static_cast<SWord>(val));
+            }
+
+            regs[instr.rd].u64 = SignExtendUnsigned(result, 31);
+            break;
+        }
+        
+        case Type::FCVT_WU_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::SLT:
-                SetRD(SignedRS1() < SignedRS2() ? 1 : 0);
+
+            bool is_inf, is_nan, is_qnan;
+            ClassF32(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
+
+            Word result;
+
+            if (is_inf) {
+                if (fregs[instr.rs1].f < 0) result = 0;
+                else result = -1U;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else if (is_nan || is_qnan) {
+                result = -1U;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else {
+                Word val = fregs[instr.rs1].f;
+                if (val != fregs[instr.rs1].f)
+                    SetFloatFlags(false, false, false, false, true);
+                
+                result = val;
+            }
+
+            regs[instr.rd].u64 = SignExtendUnsigned(result, 31);
+            break;
+        }
+        
+        case Type::FMV_X_W:
+            regs[instr.rd].u32 = ToUInt32(fregs[instr.rs1]);
+            regs[instr.rd].u64 = SignExtendUnsigned(regs[instr.rd].u64, 31);
+            break;
+        
+        case Type::FEQ_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
+            }
+
+            auto lhs = fregs[instr.rs1];
+            auto rhs = fregs[instr.rs2];
+
+            bool lhs_nan, lhs_qnan;
+            bool rhs_nan, rhs_qnan;
+            ClassF32(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
+            ClassF32(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
+
+            if (lhs_nan || rhs_nan)
+                SetFloatFlags(true, false, false, false, false);
             
-            case Type::SLTU:
-                SetRD(RS1() < RS2() ? 1 : 0);
-                break;
+            if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan)
+                regs[instr.rd].u64 = 0;
             
-            case Type::XOR:
-                SetRD(RS1() ^ RS2());
-                break;
+            else
+                regs[instr.rd].u64 = lhs.f == rhs.f ? 1 : 0;
             
-            case Type::SRL: {
-                auto amount = RS2() & 0x3f;
-                SetRD(RS1() >> amount);
+            break;
+        }
+        
+        case Type::FLT_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::SRA: {
-                auto amount = RS2() & 0x3f;
-                auto value = RS1() >> amount;
-                Long sign = -1ULL << amount;
 
-                if (Is32BitMode() && (RS1() & (1ULL << 31)))
-                    value |= sign;
-                else if (!Is32BitMode() && (RS1() & (1ULL << 63)))
-                    value |= sign;
+            auto lhs = fregs[instr.rs1];
+            auto rhs = fregs[instr.rs2];
 
-                SetRD(value);
-                break;
+            bool lhs_nan, lhs_qnan;
+            bool rhs_nan, rhs_qnan;
+            ClassF32(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
+            ClassF32(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
+            
+            if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan) {
+                SetFloatFlags(true, false, false, false, false);
+                regs[instr.rd].u64 = 0;
             }
+            else
+                regs[instr.rd].u64 = lhs.f < rhs.f ? 1 : 0;
             
-            case Type::OR:
-                SetRD(RS1() | RS2());
+            break;
+        }
+        
+        case Type::FLE_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
+            }
+
+            auto lhs = fregs[instr.rs1];
+            auto rhs = fregs[instr.rs2];
+
+            bool lhs_nan, lhs_qnan;
+            bool rhs_nan, rhs_qnan;
+            ClassF32(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
+            ClassF32(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
             
-            case Type::AND:
-                SetRD(RS1() & RS2());
-                break;
+            if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan) {
+                SetFloatFlags(true, false, false, false, false);
+                regs[instr.rd].u64 = 0;
+            }
+            else
+                regs[instr.rd].u64 = lhs.f <= rhs.f ? 1 : 0;
             
-            case Type::FENCE:
+            break;
+        }
+        
+        case Type::FCLASS_S: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
+            }
+
+            bool is_inf, is_nan, is_qnan, is_subnormal, is_zero, is_neg;
+            ClassF32(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, &is_subnormal, &is_zero, &is_neg);
             
-            case Type::ECALL:
-                switch (privilege_level) {
-                    case PrivilegeLevel::Machine: {
-                        Long value = regs[REG_A0].u64;
-                        if (Is32BitMode()) value &= 0xffffffff;
+            Word result = 0;
+            if (is_inf && is_neg) result |= 1 << 0;
+            if (!is_subnormal && is_neg) result |= 1 << 1;
+            if (is_subnormal && is_neg) result |= 1 << 2;
+            if (is_zero && is_neg) result |= 1 << 3;
+            if (is_zero && !is_neg) result |= 1 << 4;
+            if (is_subnormal && !is_neg) result |= 1 << 5;
+            if (!is_subnormal && !is_nan) result |= 1 << 6;
+            if (is_inf && !is_neg) result |= 1 << 7;
+            if (is_nan) result |= 1 << 8;
+            if (is_qnan) result |= 1 << 9;
 
-                        if (!ecall_handlers.contains(value))
-                            EmptyECallHandler(csrs[CSR_MHARTID], Is32BitMode(), memory, regs, fregs);
-                        
-                        else
-                            ecall_handlers[value](csrs[CSR_MHARTID], Is32BitMode(), memory, regs, fregs);
-                        break;
-                    }
-                    
-                    case PrivilegeLevel::Supervisor:
-                        RaiseException(EXCEPTION_ENVIRONMENT_CALL_FROM_S_MODE);
-                        inc_pc = false;
-                        break;
-                    
-                    case PrivilegeLevel::User:
-                        RaiseException(EXCEPTION_ENVIRONMENT_CALL_FROM_U_MODE);
-                        inc_pc = false;
-                        break;
-                }
-                break;
+            regs[instr.rd].u32 = result;
+            regs[instr.rd].is_u64 = 0;
+            break;
+        }
+        
+        case Type::FCVT_S_W: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            auto val = AsSigned32(regs[instr.rs1].u32);
+
+            fregs[instr.rd].f = val;
+            if (fregs[instr.rd].f != val)
+                SetFloatFlags(true, false, false, false, false);
             
-            case Type::EBREAK:
-                if (privilege_level == PrivilegeLevel::User) {
-                    RaiseException(EXCEPTION_BREAKPOINT);
-                    inc_pc = false;
-                }
-                
-                break;
+            break;
+        }
+        
+        case Type::FCVT_S_WU:
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-            case Type::LWU: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            fregs[instr.rd].f = regs[instr.rs1].u32;
+            if (fregs[instr.rd].f != regs[instr.rs1].u32)
+                SetFloatFlags(true, false, false, false, false);
+            
+            break;
+        
+        case Type::FMV_W_X:
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                if (!translation_valid) continue;
-                SetRD(memory.ReadWord(translated_address));
+            fregs[instr.rd].u64 = 0;
+            fregs[instr.rd].u32 = regs[instr.rs1].u32;
+            break;
+        
+        case Type::FCVT_L_S: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::LD: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                if (!translation_valid) continue;
-                SetRD(memory.ReadLong(translated_address));
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::SD: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-
-                Long addr = regs[instr.rs1].u64 + instr.immediate;
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-                if (!translation_valid) continue;
-                memory.WriteLong(translated_address, regs[instr.rs2].u64);
-                break;
-            };
+            bool is_inf, is_nan, is_qnan;
+            ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
 
-            case Type::ADDIW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            Long result;
 
-                Long val = regs[instr.rs1].u64 + instr.immediate;
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
-                regs[instr.rd].u64 = val;
-                break;
+            if (is_inf) {
+                if (fregs[instr.rs1].f < 0) result = -1ULL;
+                else result = 0x7fffffffffffffff;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else if (is_nan || is_qnan) {
+                result = 0x7fffffffffffffff;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else {
+                SLong val = fregs[instr.rs1].f;
+                if (val != fregs[instr.rs1].f)
+                    SetFloatFlags(false, false, false, false, true);
+                
+                result = AsUnsigned64(val);
             }
 
-            case Type::SLLIW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            regs[instr.rd].u64 = result;
+            break;
+        }
 
-                auto shift = instr.immediate & 0b111111;
-                Long val = regs[instr.rs1].u64 << shift;
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
-                regs[instr.rd].u64 = val;
+        case Type::FCVT_LU_S: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::SRLIW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-
-                auto shift = instr.immediate & 0b111111;
-                Long val = regs[instr.rs1].u64;
-                val &= 0xffffffff;
-                val >>= shift;
-                val = SignExtendUnsigned(val, 31);
-                regs[instr.rd].u64 = val;
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::SRAIW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-
-                auto shift = instr.immediate & 0b111111;
-                Long val = regs[instr.rs1].u64 >> shift;
-                if (regs[instr.rs1].u64 & (1ULL << 63))
-                    val |= -1ULL << (64 - shift);
+            bool is_inf, is_nan, is_qnan;
+            ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
+            
+            Long result;
 
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
-                regs[instr.rd].u64 = val;
-                break;
+            if (is_inf) {
+                if (fregs[instr.rs1].f < 0) result = 0;
+                else result = -1ULL;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else if (is_nan || is_qnan) {
+                result = -1ULL;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else {
+                Long val = fregs[instr.rs1].f;
+                if (val != fregs[instr.rs1].f)
+                    SetFloatFlags(false, false, false, false, true);
+                
+                result = val;
             }
 
-            case Type::ADDW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            regs[instr.rd].u64 = result;
+            break;
+        }
 
-                Long val = regs[instr.rs1].u64 + regs[instr.rs2].u64;
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
-                regs[instr.rd].u64 = val;
+        case Type::FCVT_S_L: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::SUBW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                Long val = regs[instr.rs1].u64 - regs[instr.rs2].u64;
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
-                regs[instr.rd].u64 = val;
-                break;
-            }
+            SLong val = AsSigned64(regs[instr.rs1].u64);
 
-            case Type::SLLW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            fregs[instr.rd].f = val;
+            if (fregs[instr.rd].f != val)
+                SetFloatFlags(true, false, false, false, false);
+            
+            break;
+        }
 
-                auto shift = regs[instr.rs2].u64 & 0b111111;
-                Long val = regs[instr.rs1].u64 << shift;
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
-                regs[instr.rd].u64 = val;
+        case Type::FCVT_S_LU: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::SRLW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                auto shift = regs[instr.rs2].u64 & 0b111111;
-                Long val = regs[instr.rs1].u64 >> shift;
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
-                regs[instr.rd].u64 = val;
-                break;
-            }
+            Long val = regs[instr.rs1].u64;
 
-            case Type::SRAW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            fregs[instr.rd].f = val;
+            if (fregs[instr.rd].f != val)
+                SetFloatFlags(true, false, false, false, false);
+            
+            break;
+        }
+        
+        case Type::FLD: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                auto shift = regs[instr.rs2].u64 & 0b111111;
-                Long val = regs[instr.rs1].u64 >> shift;
-                if (regs[instr.rs1].u64 & (1ULL << 63))
-                    val |= -1ULL << (64 - shift);
-                
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
-                regs[instr.rd].u64 = val;
-                break;
-            }
+            auto addr = RS1() + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
 
-            case Type::CSRRW: {
-                auto value = RS1();
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            if (!translation_valid) return false;
 
-                if (instr.rd != REG_ZERO)
-                    SetRD(ReadCSR(instr.immediate));
-                
-                WriteCSR(instr.immediate, value);
-                break;
-            }
-            
-            case Type::CSRRS: {
-                auto value = RS1();
+            auto [value, loaded] = Load<Long>(addr, translated_address);
+            if (!loaded) return false;
 
-                if (instr.rd != REG_ZERO)
-                    SetRD(ReadCSR(instr.immediate));
-                
-                if (instr.rs1 != REG_ZERO)
-                    WriteCSR(instr.immediate, ReadCSR(instr.immediate, true) | value);
-                
-                break;
-            }
+            fregs[instr.rd] = ToDouble(value);
+            break;
+        }
+        
+        case Type::FSD: {
+            auto addr = RS1() + instr.immediate;
+            if (Is32BitMode()) addr &= 0xffffffff;
+
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
+            if (!translation_valid) return false;
             
-            case Type::CSRRC: {
-                auto value = RS1();
-                if (instr.rd != REG_ZERO)
-                    SetRD(ReadCSR(instr.immediate));
-                
-                if (instr.rs1 != REG_ZERO)
-                    WriteCSR(instr.immediate, ReadCSR(instr.immediate, true) & ~value);
-                
+            auto val = ToUInt64(fregs[instr.rs2]);
+            if (!Store<Long>(addr, translated_address, val)) return false;
+            break;
+        }
+        
+        case Type::FMADD_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::CSRRWI: {
-                auto value = instr.rs1;
-                if (instr.rd != REG_ZERO)
-                    SetRD(ReadCSR(instr.immediate));
-                
-                WriteCSR(instr.immediate, value);
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            bool lhs_is_inf;
+            bool rhs_is_zero;
+            ClassF64(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
+            ClassF64(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+
+            if (lhs_is_inf && rhs_is_zero) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
+
+            double result = fregs[instr.rs1].d * fregs[instr.rs2].d + fregs[instr.rs3].d;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F64_NAN;
             
-            case Type::CSRRSI: {
-                auto value = instr.rs1;
-                if (instr.rd != REG_ZERO)
-                    SetRD(ReadCSR(instr.immediate));
-                
-                WriteCSR(instr.immediate, ReadCSR(instr.immediate, true) | value);
+            else
+                fregs[instr.rd].d = result;
+
+            break;
+        }
+        
+        case Type::FMSUB_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::CSRRCI: {
-                auto value = instr.rs1;
-                if (instr.rd != REG_ZERO)
-                    SetRD(ReadCSR(instr.immediate));
-                
-                WriteCSR(instr.immediate, ReadCSR(instr.immediate, true) & ~value);
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            bool lhs_is_inf;
+            bool rhs_is_zero;
+            ClassF64(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
+            ClassF64(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+
+            if (lhs_is_inf && rhs_is_zero) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
+
+            double result = fregs[instr.rs1].d * fregs[instr.rs2].d - fregs[instr.rs3].d;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F64_NAN;
             
-            case Type::MUL: {
-                auto lhs = SignedRS1();
-                auto rhs = SignedRS2();
-                SetSignedRD(lhs * rhs);
+            else
+                fregs[instr.rd].d = result;
+
+            break;
+        }
+        
+        case Type::FNMSUB_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::MULH: {
-                auto lhs = SignedRS1();
-                auto rhs = SignedRS2();
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                if (Is32BitMode()) 
-                    SetSignedRD((lhs * rhs) >> 32);
+            bool lhs_is_inf;
+            bool rhs_is_zero;
+            ClassF64(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
+            ClassF64(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
 
-                else {
-                    auto result = SignedMul128(lhs, rhs);
-                    SetSignedRD(result.first);
-                }
+            if (lhs_is_inf && rhs_is_zero) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::MULHSU: {
-                auto lhs = SignedRS1();
-                auto rhs = RS2();
 
-                if (Is32BitMode())
-                    SetSignedRD((lhs * rhs) >> 32);
+            double result = -(fregs[instr.rs1].d * fregs[instr.rs2].d) + fregs[instr.rs3].d;
 
-                else {
-                    auto result = SignedUnsignedMul128(lhs, rhs);
-                    SetSignedRD(result.first);
-                }
-                break;
-            }
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F64_NAN;
             
-            case Type::MULHU: {
-                auto lhs = RS1();
-                auto rhs = RS2();
+            else
+                fregs[instr.rd].d = result;
 
-                if (Is32BitMode())
-                    SetRD((lhs * rhs) >> 32);
-                
-                else
-                    SetRD(lhs * rhs);
-                
+            break;
+        }
+        
+        case Type::FNMADD_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-            case Type::DIV: {
-                auto lhs = SignedRS1();
-                auto rhs = SignedRS2();
+            bool lhs_is_inf;
+            bool rhs_is_zero;
+            ClassF64(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
+            ClassF64(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
 
-                if (rhs == 0)
-                    SetRD(-1ULL);
-                
-                else
-                    SetSignedRD(lhs / rhs);
-                
+            if (lhs_is_inf && rhs_is_zero) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
-
             }
-            
-            case Type::DIVU: {
-                auto lhs = RS1();
-                auto rhs = RS2();
 
-                if (rhs == 0)
-                    SetRD(-1ULL);
-                
-                else
-                    SetRD(lhs / rhs);
+            double result = -(fregs[instr.rs1].d * fregs[instr.rs2].d) - fregs[instr.rs3].d;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F64_NAN;
+            
+            else
+                fregs[instr.rd].d = result;
 
+            break;
+        }
+        
+        case Type::FADD_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::REM: {
-                auto lhs = SignedRS1();
-                auto rhs = SignedRS2();
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                if (rhs == 0)
-                    SetRD(0);
-                
-                else
-                    SetSignedRD(lhs % rhs);
+            double result = fregs[instr.rs1].d + fregs[instr.rs2].d;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F64_NAN;
 
+            else
+                fregs[instr.rd].d = result;
+            
+            break;
+        }
+        
+        case Type::FSUB_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::REMU: {
-                auto lhs = RS1();
-                auto rhs = RS2();
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                if (rhs == 0)
-                    SetRD(0);
-                
-                else
-                    SetRD(lhs % rhs);
+            double result = fregs[instr.rs1].d - fregs[instr.rs2].d;
+
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F64_NAN;
 
+            else
+                fregs[instr.rd].d = result;
+            
+            break;
+        }
+        
+        case Type::FMUL_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-            case Type::MULW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-
-                SLong lhs = regs[instr.rs1].s32;
-                SLong rhs = regs[instr.rs2].s32;
+            double result = fregs[instr.rs1].d * fregs[instr.rs2].d;
 
-                auto val = lhs * rhs;
-                val &= 0xffffffff;
-                val = SignExtendSigned(val, 31);
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F64_NAN;
 
-                regs[instr.rd].s64 = val;
+            else
+                fregs[instr.rd].d = result;
+            
+            break;
+        }
+        
+        case Type::FDIV_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-            case Type::DIVW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-
-                SLong lhs = regs[instr.rs1].s32;
-                SLong rhs = regs[instr.rs2].s32;
+            double result = fregs[instr.rs1].d / fregs[instr.rs2].d;
 
-                SLong val;
-                if (rhs == 0)
-                    val = -1LL;
-                
-                else
-                    val = lhs / rhs;
-                
-                val &= 0xffffffff;
-                val = SignExtendSigned(val, 31);
+            if (CheckFloatErrors(result))
+                fregs[instr.rd].u64 = RV_F64_NAN;
 
-                regs[instr.rd].s64 = val;
+            else
+                fregs[instr.rd].d = result;
+            
+            break;
+        }
+        
+        case Type::FSQRT_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-            case Type::DIVUW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            bool is_inf, is_nan, is_qnan, is_neg;
+            ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, &is_neg);
 
-                Long lhs = regs[instr.rs1].u32;
-                Long rhs = regs[instr.rs2].u32;
+            if (is_inf || is_nan || is_qnan || is_neg)
+                fregs[instr.rd].u64 = RV_F64_NAN;
+            
+            else
+                fregs[instr.rd].d = sqrt(fregs[instr.rs1].d);
+            
+            break;
+        }
+        
+        case Type::FSGNJ_D: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                Long val;
-                if (rhs == 0)
-                    val = -1ULL;
-                
-                else
-                    val = lhs / rhs;
-                
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
+            Float result = fregs[instr.rs1];
+            Float rhs = fregs[instr.rs2];
 
-                regs[instr.rd].s64 = val;
-                break;
-            }
+            result.u64 &= ~(1ULL<<63);
+            result.u64 |= rhs.u64 & (1ULL<<63);
+            fregs[instr.rd] = result;
+            break;
+        }
+        
+        case Type::FSGNJN_D: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-            case Type::REMW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            Float result = fregs[instr.rs1];
+            Float rhs = fregs[instr.rs2];
+
+            result.u64 &= ~(1ULL<<63);
+            result.u64 |= (~rhs.u64) & (1ULL<<63);
+            fregs[instr.rd] = result;
+            break;
+        }
+        
+        case Type::FSGNJX_D: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                SLong lhs = regs[instr.rs1].s32;
-                SLong rhs = regs[instr.rs2].s32;
+            Float result = fregs[instr.rs1];
+            Float rhs = fregs[instr.rs2];
 
-                SLong val;
-                if (rhs == 0)
-                    val = -1LL;
-                
-                else
-                    val = lhs % rhs;
-                
-                val &= 0xffffffff;
-                val = SignExtendSigned(val, 31);
+            result.u64 ^= rhs.u64 & (1ULL<<63);
+            fregs[instr.rd] = result;
+            break;
+        }
+        
+        case Type::FMIN_D: {
+            bool lhs_neg;
+            bool rhs_neg;
+            bool lhs_snan, lhs_qnan;
+            bool rhs_snan, rhs_qnan;
+            ClassF64(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, &lhs_neg);
+            ClassF64(fregs[instr.rs2], nullptr, &rhs_snan, &rhs_qnan, nullptr, nullptr, &rhs_neg);
+            bool lhs_nan = lhs_snan || lhs_qnan;
+            bool rhs_nan = rhs_snan || rhs_qnan;
+
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                regs[instr.rd].s64 = val;
+            if (lhs_nan && rhs_nan) {
+                SetFloatFlags(true, false, false, false, false);
+                fregs[instr.rd].u64 = RV_F64_NAN;
                 break;
             }
 
-            case Type::REMUW: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            bool lhs_less = false;
+            if (lhs_nan) {
+                lhs_less = false;
+                SetFloatFlags(true, false, false, false, false);
+            }
+            else if (rhs_nan) {
+                lhs_less = true;
+                SetFloatFlags(true, false, false, false, false);
+            }
+            else if (lhs_neg && !rhs_neg) lhs_less = true;
+            else if (!lhs_neg && rhs_neg) lhs_less = false;
+            else if (fregs[instr.rs1].d < fregs[instr.rs2].d) lhs_less = true;
 
-                Long lhs = regs[instr.rs1].u32;
-                Long rhs = regs[instr.rs2].u32;
+            if (lhs_less)
+                fregs[instr.rd] = fregs[instr.rs1];
+            
+            else
+                fregs[instr.rd] = fregs[instr.rs2];
+            
+            break;
+        }
+        
+        case Type::FMAX_D: {
+            bool lhs_neg;
+            bool rhs_neg;
+            bool lhs_snan, lhs_qnan;
+            bool rhs_snan, rhs_qnan;
+            ClassF64(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, &lhs_neg);
+            ClassF64(fregs[instr.rs2], nullptr, &rhs_snan, &rhs_qnan, nullptr, nullptr, &rhs_neg);
+            bool lhs_nan = lhs_snan || lhs_qnan;
+            bool rhs_nan = rhs_snan || rhs_qnan;
 
-                Long val;
-                if (rhs == 0)
-                    val = -1ULL;
-                
-                else
-                    val = lhs % rhs;
-                
-                val &= 0xffffffff;
-                val = SignExtendUnsigned(val, 31);
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-                regs[instr.rd].u64 = val;
+            if (lhs_nan && rhs_nan) {
+                SetFloatFlags(true, false, false, false, false);
+                fregs[instr.rd].u64 = RV_F64_NAN;
                 break;
             }
-            
-            case Type::LR_W: {
-                if (instr.rs2 != 0) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false);
-                if (!translation_valid) continue;
 
-                SetRD(memory.ReadWordReserved(translated_address, csrs[CSR_MHARTID]));
-                break;
+            bool lhs_less = false;
+            if (lhs_nan) {
+                lhs_less = false;
+                SetFloatFlags(true, false, false, false, false);
             }
+            else if (rhs_nan) {
+                lhs_less = true;
+                SetFloatFlags(true, false, false, false, false);
+            }
+            else if (lhs_neg && !rhs_neg) lhs_less = true;
+            else if (!lhs_neg && rhs_neg) lhs_less = false;
+            else if (fregs[instr.rs1].d < fregs[instr.rs2].d) lhs_less = true;
+
+            if (!lhs_less)
+                fregs[instr.rd] = fregs[instr.rs1];
             
-            case Type::SC_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), true, false);
-                if (!translation_valid) continue;
-                
-                if (memory.WriteWordConditional(translated_address, RS2(), csrs[CSR_MHARTID]))
-                    SetRD(0);
-                
-                else
-                    SetRD(1);
-                
+            else
+                fregs[instr.rd] = fregs[instr.rs2];
+            
+            break;
+        }
+        
+        case Type::FCVT_S_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
             
-            case Type::AMOSWAP_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
+            bool lhs_snan, lhs_qnan;
+            ClassF64(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, nullptr);
 
-                SetRD(memory.AtomicSwapW(translated_address, RS2()));
-                break;
+            if (lhs_snan) fregs[instr.rd].u64 = RV_F32_NAN;
+            else if (lhs_qnan) fregs[instr.rd].u64 = RV_F32_QNAN;
+            else {
+                auto val = fregs[instr.rs1].d;
+                fregs[instr.rd].u64 = 0;
+                fregs[instr.rd].f = val;
             }
-            
-            case Type::AMOADD_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
 
-                SetRD(memory.AtomicAddW(translated_address, RS2()));
+            break;
+        }
+        
+        case Type::FCVT_D_S: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            bool lhs_snan, lhs_qnan;
+            ClassF32(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, nullptr);
+
+            if (lhs_snan) fregs[instr.rd].u64 = RV_F64_NAN;
+            else if (lhs_qnan) fregs[instr.rd].u64 = RV_F64_QNAN;
+            else fregs[instr.rd].d = fregs[instr.rs1].f;
+
+            break;
+        }
+        
+        case Type::FEQ_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::AMOXOR_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
 
-                SetRD(memory.AtomicXorW(translated_address, RS2()));
+            auto lhs = fregs[instr.rs1];
+            auto rhs = fregs[instr.rs2];
+
+            bool lhs_nan, lhs_qnan;
+            bool rhs_nan, rhs_qnan;
+            ClassF64(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
+            ClassF64(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
+
+            if (lhs_nan || rhs_nan)
+                SetFloatFlags(true, false, false, false, false);
+            
+            if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan)
+                regs[instr.rd].u64 = 0;
+            
+            else
+                regs[instr.rd].u64 = lhs.d == rhs.d ? 1 : 0;
+            
+            break;
+        }
+        
+        case Type::FLT_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::AMOAND_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
 
-                SetRD(memory.AtomicAndW(translated_address, RS2()));
-                break;
+            auto lhs = fregs[instr.rs1];
+            auto rhs = fregs[instr.rs2];
+
+            bool lhs_nan, lhs_qnan;
+            bool rhs_nan, rhs_qnan;
+            ClassF64(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
+            ClassF64(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
+            
+            if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan) {
+                SetFloatFlags(true, false, false, false, false);
+                regs[instr.rd].u64 = 0;
             }
+            else
+                regs[instr.rd].u64 = lhs.d < rhs.d ? 1 : 0;
             
-            case Type::AMOOR_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
-                
-                SetRD(memory.AtomicOrW(translated_address, RS2()));
+            break;
+        }
+        
+        case Type::FLE_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::AMOMIN_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
 
-                SetRD(memory.AtomicMinW(translated_address, RS2()));
-                break;
+            auto lhs = fregs[instr.rs1];
+            auto rhs = fregs[instr.rs2];
+
+            bool lhs_nan, lhs_qnan;
+            bool rhs_nan, rhs_qnan;
+            ClassF64(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
+            ClassF64(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
+            
+            if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan) {
+                SetFloatFlags(true, false, false, false, false);
+                regs[instr.rd].u64 = 0;
             }
+            else
+                regs[instr.rd].u64 = lhs.d <= rhs.d ? 1 : 0;
             
-            case Type::AMOMAX_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
-
-                SetRD(memory.AtomicMaxW(translated_address, RS2()));
+            break;
+        }
+        
+        case Type::FCLASS_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
+
+            bool is_inf, is_nan, is_qnan, is_subnormal, is_zero, is_neg;
+            ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, &is_subnormal, &is_zero, &is_neg);
             
-            case Type::AMOMINU_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
+            Word result = 0;
+            if (is_inf && is_neg) result |= 1 << 0;
+            if (!is_subnormal && is_neg) result |= 1 << 1;
+            if (is_subnormal && is_neg) result |= 1 << 2;
+            if (is_zero && is_neg) result |= 1 << 3;
+            if (is_zero && !is_neg) result |= 1 << 4;
+            if (is_subnormal && !is_neg) result |= 1 << 5;
+            if (!is_subnormal && !is_nan) result |= 1 << 6;
+            if (is_inf && !is_neg) result |= 1 << 7;
+            if (is_nan) result |= 1 << 8;
+            if (is_qnan) result |= 1 << 9;
 
-                SetRD(memory.AtomicMinUW(translated_address, RS2()));
+            regs[instr.rd].u32 = result;
+            regs[instr.rd].is_u64 = 0;
+            break;
+        }
+        
+        case Type::FCVT_W_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
+
+            bool is_inf, is_nan, is_qnan;
+            ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
             
-            case Type::AMOMAXU_W: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
+            Word result;
 
-                SetRD(memory.AtomicMaxUW(translated_address, RS2()));
-                break;
+            if (is_inf) {
+                if (fregs[instr.rs1].d < 0) result = -1U;
+                else result = 0x7fffffff;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else if (is_nan || is_qnan) {
+                result = 0x7fffffff;
+                SetFloatFlags(false, false, false, false, true);
             }
+            else {
+                SWord val = fregs[instr.rs1].d;
+                if (val != fregs[instr.rs1].d)
+                    SetFloatFlags(false, false, false, false, true);
 
-            case Type::LR_D: {
-                if (instr.rs2 != 0) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false);
-                if (!translation_valid) continue;
+                result = AsUnsigned32(static_cast<SWord>(val));
+            }
 
-                SetRD(memory.ReadLongReserved(translated_address, csrs[CSR_MHARTID]));
+            regs[instr.rd].u32 = result;
+            regs[instr.rd].is_u64 = 0;
+            break;
+        }
+        
+        case Type::FCVT_WU_D: {
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::SC_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), true, false);
-                if (!translation_valid) continue;
+            bool is_inf, is_nan, is_qnan;
+            ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
 
-                if (memory.WriteLongConditional(translated_address, RS2(), csrs[CSR_MHARTID]))
-                    SetRD(0);
-                
-                else
-                    SetRD(1);
+            Word result;
+
+            if (is_inf) {
+                if (fregs[instr.rs1].d < 0) result = 0;
+                else result = -1U;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else if (is_nan || is_qnan) {
+                result = -1U;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else {
+                Word val = fregs[instr.rs1].d;
+                if (val != fregs[instr.rs1].d)
+                    SetFloatFlags(false, false, false, false, true);
                 
-                break;
+                result = val;
             }
 
-            case Type::AMOSWAP_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
+            regs[instr.rd].u32 = result;
+            regs[instr.rd].is_u64 = 0;
+            break;
+        }
+        
+        case Type::FCVT_D_W: {
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+
+            auto val = AsSigned32(regs[instr.rs1].u32);
+
+            fregs[instr.rd].d = val;
+            if (fregs[instr.rd].d != val)
+                SetFloatFlags(true, false, false, false, false);
+            
+            break;
+        }
+        
+        case Type::FCVT_D_WU:
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+            
+            fregs[instr.rd].d = regs[instr.rs1].u32;
+            if (fregs[instr.rd].d != regs[instr.rs1].u32)
+                SetFloatFlags(true, false, false, false, false);
+            
+            break;
+        
+        case Type::FCVT_L_D: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
 
-                SetRD(memory.AtomicSwapL(translated_address, RS2()));
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::AMOADD_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
+            bool is_inf, is_nan, is_qnan;
+            ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
+
+            Long result;
+
+            if (is_inf) {
+                if (fregs[instr.rs1].d < 0) result = -1ULL;
+                else result = 0x7fffffffffffffff;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else if (is_nan || is_qnan) {
+                result = 0x7fffffffffffffff;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else {
+                SLong val = fregs[instr.rs1].d;
+                if (val != fregs[instr.rs1].d)
+                    SetFloatFlags(false, false, false, false, true);
+                
+                result = AsUnsigned64(val);
+            }
+
+            regs[instr.rd].u64 = result;
+            break;
+        }
 
-                SetRD(memory.AtomicAddL(translated_address, RS2()));
+        case Type::FCVT_LU_D: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
+                break;
+            }
+            
+            if (!ChangeRoundingMode(instr.rm)) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::AMOXOR_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
+            bool is_inf, is_nan, is_qnan;
+            ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
+
+            Long result;
+
+            if (is_inf) {
+                if (fregs[instr.rs1].d < 0) result = 0;
+                else result = -1ULL;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else if (is_nan || is_qnan) {
+                result = -1ULL;
+                SetFloatFlags(false, false, false, false, true);
+            }
+            else {
+                Long val = fregs[instr.rs1].d;
+                if (val != fregs[instr.rs1].d)
+                    SetFloatFlags(false, false, false, false, true);
+                
+                result = val;
+            }
+
+            regs[instr.rd].u64 = result;
+            break;
+        }
 
-                SetRD(memory.AtomicXorL(translated_address, RS2()));
+        case Type::FMV_X_D:
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::AMOAND_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
-
-                SetRD(memory.AtomicAndL(translated_address, RS2()));
+            regs[instr.rd].u64 = ToUInt64(fregs[instr.rs1]);
+            break;
+        
+        case Type::FCVT_D_L: {
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::AMOOR_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
-
-                SetRD(memory.AtomicOrL(translated_address, RS2()));
-                break;
-            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-            case Type::AMOMIN_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
+            auto val = AsSigned64(regs[instr.rs1].u64);
 
-                SetRD(memory.AtomicMinL(translated_address, RS2()));
+            fregs[instr.rd].d = val;
+            if (fregs[instr.rd].d != val)
+                SetFloatFlags(true, false, false, false, false);
+            
+            break;
+        }
+        
+        case Type::FCVT_D_LU:
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::AMOMAX_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
-
-                SetRD(memory.AtomicMaxL(translated_address, RS2()));
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
+            
+            fregs[instr.rd].d = regs[instr.rs1].u64;
+            if (fregs[instr.rd].d != regs[instr.rs1].u64)
+                SetFloatFlags(true, false, false, false, false);
+            
+            break;
+        
+        case Type::FMV_D_X:
+            if (Is32BitMode()) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
 
-            case Type::AMOMINU_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
-
-                SetRD(memory.AtomicMinUL(translated_address, RS2()));
-                break;
-            }
+            mstatus.FS = FS_DIRTY;
+            sstatus.FS = FS_DIRTY;
 
-            case Type::AMOMAXU_D: {
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(RS1(), false, false, true);
-                if (!translation_valid) continue;
+            fregs[instr.rd].u64 = regs[instr.rs1].u64;
+            break;
 
-                SetRD(memory.AtomicMaxUL(translated_address, RS2()));
-                break;
+        case Type::SRET:
+            if (privilege_level == PrivilegeLevel::User) {
+                throw std::runtime_error("Cannot use SRET in user mode");
             }
-            
-            case Type::FLW: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
 
-                auto addr = RS1() + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
+            if (tracing) TraceTrapReturn(Tracer::Kind::SupervisorTrap, sstatus.SPP ? SUPERVISOR_MODE : USER_MODE);
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                if (!translation_valid) continue;
+            pc = csrs[CSR_SEPC];
+            sstatus.SIE = sstatus.SPIE;
 
-                fregs[instr.rd] = ToFloat(translated_address);
-                break;
-            }
+            if (sstatus.SPP)
+                SetPrivilegeLevel(PrivilegeLevel::Supervisor);
             
-            case Type::FSW: {
-                auto addr = RS1() + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
-
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-                if (!translation_valid) continue;
-                memory.WriteWord(translated_address, ToUInt32(fregs[instr.rs2]));
+            else
+                SetPrivilegeLevel(PrivilegeLevel::User);
+            
+            return false;
+        
+        case Type::MRET:
+            if (privilege_level == PrivilegeLevel::Supervisor) {
+                RaiseInterrupt(INTERRUPT_SUPERVISOR_SOFTWARE);
                 break;
             }
-            
-            case Type::FMADD_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
 
-                bool lhs_is_inf;
-                bool rhs_is_zero;
-                ClassF32(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
-                ClassF32(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+            if (privilege_level == PrivilegeLevel::User) {
+                throw std::runtime_error("Cannot use MRET in user mode");
+            }
 
-                if (lhs_is_inf && rhs_is_zero) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            if (tracing) TraceTrapReturn(Tracer::Kind::MachineTrap, mstatus.MPP);
 
-                float result = fregs[instr.rs1].f * fregs[instr.rs2].f + fregs[instr.rs3].f;
+            pc = csrs[CSR_MEPC];
+            mstatus.MIE = mstatus.MPIE;
+            sstatus.SIE = mstatus.SPIE;
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F32_NAN;
+            switch (mstatus.MPP) {
+                case MACHINE_MODE:
+                    SetPrivilegeLevel(PrivilegeLevel::Machine);
+                    break;
                 
-                else
-                    fregs[instr.rd].f = result;
-
-                break;
-            }
-            
-            case Type::FMSUB_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
+                case SUPERVISOR_MODE:
+                    SetPrivilegeLevel(PrivilegeLevel::Supervisor);
                     break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
-
-                bool lhs_is_inf;
-                bool rhs_is_zero;
-                ClassF32(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
-                ClassF32(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
-
-                if (lhs_is_inf && rhs_is_zero) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
+                
+                case USER_MODE:
+                    SetPrivilegeLevel(PrivilegeLevel::User);
                     break;
-                }
-
-                float result = fregs[instr.rs1].f * fregs[instr.rs2].f - fregs[instr.rs3].f;
-
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F32_NAN;
                 
-                else
-                    fregs[instr.rd].f = result;
-
+                default:
+                    throw std::runtime_error("Cannot MRET to hypervisor");
+            }
+            return false;
+        
+        case Type::WFI:
+            waiting_for_interrupt = true;
+            break;
+        
+        case Type::SFENCE_VMA:
+            if (privilege_level == PrivilegeLevel::User) {
+                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+                inc_pc = false;
                 break;
             }
-            
-            case Type::FNMSUB_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
 
-                bool lhs_is_inf;
-                bool rhs_is_zero;
-                ClassF32(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
-                ClassF32(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
-
-                if (lhs_is_inf && rhs_is_zero) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            FlushTLB(regs[instr.rs1].u64, instr.rs1 == 0, regs[instr.rs2].u64, instr.rs2 == 0);
+            break;
+        
+        case Type::SINVAL_VMA:
+        case Type::SINVAL_GVMA:
+        case Type::SFENCE_W_INVAL:
+        case Type::SFENCE_INVAL_IR:
+            ThrowNotImplemented(instr);
+        
+        case Type::CUST_TVA: {
+            auto addr = RS1();
+            if (Is32BitMode()) addr &= 0xffffffff;
 
-                float result = -(fregs[instr.rs1].f * fregs[instr.rs2].f) + fregs[instr.rs3].f;
+            auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
+            regs[instr.rd].u64 = translated_address;
+            break;
+        }
+        
+        case Type::CUST_MTRAP:
+            pc += instr.size;
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F32_NAN;
+            switch (regs[instr.rs2].u64 & 0b11) {
+                case MACHINE_MODE:
+                    SetPrivilegeLevel(PrivilegeLevel::Machine);
+                    break;
                 
-                else
-                    fregs[instr.rd].f = result;
-
-                break;
-            }
-            
-            case Type::FNMADD_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
+                case SUPERVISOR_MODE:
+                    SetPrivilegeLevel(PrivilegeLevel::Supervisor);
                     break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
-
-                bool lhs_is_inf;
-                bool rhs_is_zero;
-                ClassF32(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
-                ClassF32(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
-
-                if (lhs_is_inf && rhs_is_zero) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
+                
+                default:
+                    SetPrivilegeLevel(PrivilegeLevel::User);
                     break;
-                }
+            }
+
+            if (Is32BitMode())
+                RaiseMachineTrap(regs[instr.rs1].u32);
 
-                float result = -(fregs[instr.rs1].f * fregs[instr.rs2].f) - fregs[instr.rs3].f;
+            else
+                RaiseMachineTrap(regs[instr.rs1].u64);
+            
+            return false;
+        
+        case Type::CUST_STRAP:
+            pc += instr.size;
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F32_NAN;
+            switch (regs[instr.rs2].u64 & 0b11) {
+                case MACHINE_MODE:
+                    SetPrivilegeLevel(PrivilegeLevel::Machine);
+                    break;
                 
-                else
-                    fregs[instr.rd].f = result;
-
-                break;
+                case SUPERVISOR_MODE:
+                    SetPrivilegeLevel(PrivilegeLevel::Supervisor);
+                    break;
+                
+                default:
+                    SetPrivilegeLevel(PrivilegeLevel::User);
+                    break;
             }
             
-            case Type::FADD_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
-
-                float result = fregs[instr.rs1].f + fregs[instr.rs2].f;
-
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F32_NAN;
+            if (Is32BitMode())
+                RaiseSupervisorTrap(regs[instr.rs1].u32);
+            
+            else
+                RaiseSupervisorTrap(regs[instr.rs1].u64);
+            
+            return false;
 
-                else
-                    fregs[instr.rd].f = result;
-                
+        case Type::INVALID:
+        default:
+            if (RVInstruction::IsVector(instr.type)) {
+                if (!ExecuteVector(instr, inc_pc)) return false;
                 break;
             }
-            
-            case Type::FSUB_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
 
-                float result = fregs[instr.rs1].f - fregs[instr.rs2].f;
+            RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
+            inc_pc = false;
+            break;
+    }
+
+    switch (instr.type) {
+        case Type::BEQ:
+        case Type::BGE:
+        case Type::BGEU:
+        case Type::BLT:
+        case Type::BLTU:
+        case Type::BNE:
+        case Type::JAL:
+        case Type::JALR:
+            break;
+        
+        default:
+            if (inc_pc)
+                pc += instr.size;
+    }
+
+    if (inc_pc)
+        events[instruction_events[static_cast<size_t>(instr.type)]]++;
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F32_NAN;
+    return true;
+}
 
-                else
-                    fregs[instr.rd].f = result;
-                
-                break;
-            }
-            
-            case Type::FMUL_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+// Faulting loads and stores and failed fetches leave no record. Execute
+// reports xRET as not retired because it moves pc itself, but it did retire
+bool VirtualMachine::ExecuteTraced(const RVInstruction& instr) {
+    using Record = InstructionTraceRecord;
 
-                float result = fregs[instr.rs1].f * fregs[instr.rs2].f;
+    auto access = Record::accesses[static_cast<size_t>(instr.type)];
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F32_NAN;
+    Record record;
+    record.pc = pc;
+    record.raw = instr.raw;
+    record.rd = instr.rd;
 
-                else
-                    fregs[instr.rd].f = result;
-                
-                break;
-            }
-            
-            case Type::FDIV_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+    if (access & (Record::ACCESS_OFFSET | Record::ACCESS_RS1)) {
+        record.has_address = true;
+        record.address = regs[instr.rs1].u64;
 
-                float result = fregs[instr.rs1].f / fregs[instr.rs2].f;
+        if (access & Record::ACCESS_OFFSET)
+            record.address += instr.immediate;
+    }
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F32_NAN;
+    bool retired = Execute(instr);
+    bool returned = instr.type == RVInstruction::Type::MRET || instr.type == RVInstruction::Type::SRET;
 
-                else
-                    fregs[instr.rd].f = result;
-                
-                break;
-            }
-            
-            case Type::FSQRT_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+    if (!retired && !returned) return false;
 
-                bool is_inf, is_nan, is_qnan, is_neg;
-                ClassF32(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, &is_neg);
+    if ((access & Record::ACCESS_RD) && instr.rd != 0) {
+        record.writes_rd = true;
+        record.rd_value = regs[instr.rd].u64;
+    }
 
-                if (is_inf || is_nan || is_qnan || is_neg)
-                    fregs[instr.rd].u64 = RV_F32_NAN;
-                
-                else
-                    fregs[instr.rd].f = sqrtf(fregs[instr.rs1].f);
-                
-                break;
-            }
-            
-            case Type::FSGNJ_S: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+    else if (access & Record::ACCESS_FRD) {
+        record.writes_frd = true;
+        record.rd_value = fregs[instr.rd].u64;
+    }
 
-                Float result = fregs[instr.rs1];
-                Float rhs = fregs[instr.rs2];
+    instruction_trace->Record(record);
+    return retired;
+}
 
-                result.u32 &= ~(1<<31);
-                result.u32 |= rhs.u32 & (1<<31);
-                fregs[instr.rd] = result;
-                break;
-            }
-            
-            case Type::FSGNJN_S: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+void VirtualMachine::FinishSteps() {
+    SyncFloatFlags();
+    UpdateTimer();
 
-                Float result = fregs[instr.rs1];
-                Float rhs = fregs[instr.rs2];
+    if (state_requested.load(std::memory_order_relaxed))
+        PublishState();
+}
 
-                result.u32 &= ~(1<<31);
-                result.u32 |= (~rhs.u32) & (1<<31);
-                fregs[instr.rd] = result;
-                break;
-            }
-            
-            case Type::FSGNJX_S: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+bool VirtualMachine::Step(Long steps) {
+    if (start_requested.load(std::memory_order_relaxed) && TakeStartRequest() && paused)
+        return false;
 
-                Float result = fregs[instr.rs1];
-                Float rhs = fregs[instr.rs2];
+    SyncHostPages();
 
-                result.u32 ^= rhs.u32 & (1<<31);
-                fregs[instr.rd] = result;
-                break;
-            }
-            
-            case Type::FMIN_S: {
-                bool lhs_neg;
-                bool rhs_neg;
-                bool lhs_snan, lhs_qnan;
-                bool rhs_snan, rhs_qnan;
-                ClassF32(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, &lhs_neg);
-                ClassF32(fregs[instr.rs2], nullptr, &rhs_snan, &rhs_qnan, nullptr, nullptr, &rhs_neg);
-                bool lhs_nan = lhs_snan || lhs_qnan;
-                bool rhs_nan = rhs_snan || rhs_qnan;
+    steps = std::min(steps, clint->InstructionsUntilDeadline(csrs[CSR_MHARTID]));
+    ticks += steps;
 
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+    ClearFloatFlags();
+    watch_hit.reset();
 
-                if (lhs_nan && rhs_nan) {
-                    SetFloatFlags(true, false, false, false, false);
-                    fregs[instr.rd].u64 = RV_F32_NAN;
-                    break;
-                }
+    for (Word i = 0; i < steps && running; i++) {
+        cycles++;
 
-                bool lhs_less = false;
-                if (lhs_nan) {
-                    lhs_less = false;
-                    SetFloatFlags(true, false, false, false, false);
-                }
-                else if (rhs_nan) {
-                    lhs_less = true;
-                    SetFloatFlags(true, false, false, false, false);
-                }
-                else if (lhs_neg && !rhs_neg) lhs_less = true;
-                else if (!lhs_neg && rhs_neg) lhs_less = false;
-                else if (fregs[instr.rs1].f < fregs[instr.rs2].f) lhs_less = true;
+        if (IsStillWaitingForInterrupt()) {
+            cycles += steps - i - 1;
+            stalled_cycles += steps - i;
+            break;
+        }
 
-                if (lhs_less)
-                    fregs[instr.rd] = fregs[instr.rs1];
-                
-                else
-                    fregs[instr.rd] = fregs[instr.rs2];
-                
-                break;
-            }
-            
-            case Type::FMAX_S: {
-                bool lhs_neg;
-                bool rhs_neg;
-                bool lhs_snan, lhs_qnan;
-                bool rhs_snan, rhs_qnan;
-                ClassF32(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, &lhs_neg);
-                ClassF32(fregs[instr.rs2], nullptr, &rhs_snan, &rhs_qnan, nullptr, nullptr, &rhs_neg);
-                bool lhs_nan = lhs_snan || lhs_qnan;
-                bool rhs_nan = rhs_snan || rhs_qnan;
+        HandleInterrupts();
 
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        if (pc & 0b1) {
+            RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT);
+            continue;
+        }
 
-                if (lhs_nan && rhs_nan) {
-                    SetFloatFlags(true, false, false, false, false);
-                    fregs[instr.rd].u64 = RV_F32_NAN;
-                    break;
-                }
+        auto [translated_address, translation_valid] = TranslateMemoryAddress(pc, false, true);
+        if (!translation_valid) continue;
+        
+        auto instr = FetchInstruction(translated_address);
+        if (!instr) continue;
+
+        // The first instruction always runs, it's the one a stop resumes on
+        if (instr->break_point && i != 0 && StopsAtBreakPoint(*instr)) [[unlikely]] {
+            cycles--;
+            FinishSteps();
+            return true;
+        }
 
-                bool lhs_less = false;
-                if (lhs_nan) {
-                    lhs_less = false;
-                    SetFloatFlags(true, false, false, false, false);
-                }
-                else if (rhs_nan) {
-                    lhs_less = true;
-                    SetFloatFlags(true, false, false, false, false);
-                }
-                else if (lhs_neg && !rhs_neg) lhs_less = true;
-                else if (!lhs_neg && rhs_neg) lhs_less = false;
-                else if (fregs[instr.rs1].f < fregs[instr.rs2].f) lhs_less = true;
+        if (!(instruction_trace ? ExecuteTraced(*instr) : Execute(*instr))) continue;
 
-                if (!lhs_less)
-                    fregs[instr.rd] = fregs[instr.rs1];
-                
-                else
-                    fregs[instr.rd] = fregs[instr.rs2];
-                
-                break;
-            }
-            
-            case Type::FCVT_W_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+        if (watch_hit) [[unlikely]] {
+            FinishSteps();
+            return true;
+        }
+    }
 
-                bool is_inf, is_nan, is_qnan;
-                ClassF32(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
-                
-                Word result;
+    FinishSteps();
 
-                if (is_inf) {
-                    if (fregs[instr.rs1].f < 0) result = -1U;
-                    else result = 0x7fffffff;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else if (is_nan || is_qnan) {
-                    result = 0x7fffffff;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else {
-                    SWord val = fregs[instr.rs1].f;
-                    if (val != fregs[instr.rs1].f)
-                        SetFloatFlags(false, false, false, false, true);
+    // The next call runs its first instruction unchecked
+    return running && IsBreakPoint(pc);
+}
 
-                    result = AsUnsigned32(static_cast<SWord>(val));
-                }
+const RVInstruction* VirtualMachine::FetchInstruction(Address translated_address) {
+    if (!instruction_cache.Straddles(translated_address)) {
+        auto instr = instruction_cache.Fetch(translated_address, pc);
+        if (!instr) RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT);
 
-                regs[instr.rd].u64 = SignExtendUnsigned(result, 31);
-                break;
-            }
-            
-            case Type::FCVT_WU_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+        return instr;
+    }
 
-                bool is_inf, is_nan, is_qnan;
-                ClassF32(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
+    auto [upper_address, upper_valid] = TranslateMemoryAddress(pc + sizeof(Half), false, true);
+    if (!upper_valid) return nullptr;
 
-                Word result;
+    auto [low, low_fault] = memory.TryReadHalf(translated_address);
+    auto [high, high_fault] = memory.TryReadHalf(upper_address);
+    if (low_fault != Memory::AccessFault::None || high_fault != Memory::AccessFault::None) {
+        RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT);
+        return nullptr;
+    }
 
-                if (is_inf) {
-                    if (fregs[instr.rs1].f < 0) result = 0;
-                    else result = -1U;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else if (is_nan || is_qnan) {
-                    result = -1U;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else {
-                    Word val = fregs[instr.rs1].f;
-                    if (val != fregs[instr.rs1].f)
-                        SetFloatFlags(false, false, false, false, true);
-                    
-                    result = val;
-                }
+    straddling = RVInstruction::FromUInt32(low | static_cast<Word>(high) << 16);
+    straddling.break_point = straddling.type == RVInstruction::Type::EBREAK || instruction_cache.IsBreakPoint(pc);
+    return &straddling;
+}
 
-                regs[instr.rd].u64 = SignExtendUnsigned(result, 31);
-                break;
-            }
-            
-            case Type::FMV_X_W:
-                regs[instr.rd].u32 = ToUInt32(fregs[instr.rs1]);
-                regs[instr.rd].u64 = SignExtendUnsigned(regs[instr.rd].u64, 31);
-                break;
-            
-            case Type::FEQ_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+bool VirtualMachine::StopsAtBreakPoint(const RVInstruction& instr) const {
+    if (instr.type == RVInstruction::Type::EBREAK)
+        return privilege_level != PrivilegeLevel::User;
 
-                auto lhs = fregs[instr.rs1];
-                auto rhs = fregs[instr.rs2];
+    return instruction_cache.IsBreakPoint(pc);
+}
 
-                bool lhs_nan, lhs_qnan;
-                bool rhs_nan, rhs_qnan;
-                ClassF32(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
-                ClassF32(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
+bool VirtualMachine::EndsBasicBlock(RVInstruction::Type type) {
+    using Type = RVInstruction::Type;
 
-                if (lhs_nan || rhs_nan)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan)
-                    regs[instr.rd].u64 = 0;
-                
-                else
-                    regs[instr.rd].u64 = lhs.f == rhs.f ? 1 : 0;
-                
-                break;
-            }
-            
-            case Type::FLT_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    switch (type) {
+        case Type::JAL:
+        case Type::JALR:
+        case Type::BEQ:
+        case Type::BNE:
+        case Type::BLT:
+        case Type::BGE:
+        case Type::BLTU:
+        case Type::BGEU:
+        case Type::ECALL:
+        case Type::EBREAK:
+        case Type::FENCE_I:
+        case Type::CSRRW:
+        case Type::CSRRS:
+        case Type::CSRRC:
+        case Type::CSRRWI:
+        case Type::CSRRSI:
+        case Type::CSRRCI:
+        case Type::SRET:
+        case Type::MRET:
+        case Type::WFI:
+        case Type::SFENCE_VMA:
+        case Type::SINVAL_VMA:
+        case Type::SINVAL_GVMA:
+        case Type::SFENCE_W_INVAL:
+        case Type::SFENCE_INVAL_IR:
+        case Type::INVALID:
+        case Type::CUST_TVA:
+        case Type::CUST_MTRAP:
+        case Type::CUST_STRAP:
+            return true;
+        
+        default:
+            return false;
+    }
+}
 
-                auto lhs = fregs[instr.rs1];
-                auto rhs = fregs[instr.rs2];
+// Entries keep their storage for the blocks decoded into them next. Their
+// links go, so nothing chains into a block that's been emptied
+void VirtualMachine::InvalidateBasicBlocks() {
+    for (auto& [address, block] : basic_blocks) {
+        block.instructions.clear();
+        block.fusions.clear();
+        block.successors = {nullptr, nullptr};
+        block.return_block = nullptr;
+        block.compiled = nullptr;
+    }
 
-                bool lhs_nan, lhs_qnan;
-                bool rhs_nan, rhs_qnan;
-                ClassF32(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
-                ClassF32(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
-                
-                if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan) {
-                    SetFloatFlags(true, false, false, false, false);
-                    regs[instr.rd].u64 = 0;
-                }
-                else
-                    regs[instr.rd].u64 = lhs.f < rhs.f ? 1 : 0;
-                
-                break;
-            }
-            
-            case Type::FLE_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    basic_blocks_dirty = false;
+    return_stack = {};
+    return_top = 0;
+    indirect_targets = {};
+}
 
-                auto lhs = fregs[instr.rs1];
-                auto rhs = fregs[instr.rs2];
+VirtualMachine::BasicBlock& VirtualMachine::GetBasicBlock(Address address, Address virtual_address) {
+    auto& block = basic_blocks[address];
+    auto version = memory.GetCodePageVersion(address);
+
+    if (!block.instructions.empty() && block.version == version)
+        return block;
+
+    block.address = address;
+    block.version = version;
+    block.instructions.clear();
+    block.fusions.clear();
+    block.successors = {nullptr, nullptr};
+    block.executions = 0;
+    block.compiled = nullptr;
+    block.compiled_length = 0;
+    block.compiled_size = 0;
+    block.compile_attempted = false;
+
+    Address head = address;
+    Address virtual_head = virtual_address;
+
+    do {
+        if (!block.instructions.empty() && !memory.PeekHalf(head).second)
+            break;
 
-                bool lhs_nan, lhs_qnan;
-                bool rhs_nan, rhs_qnan;
-                ClassF32(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
-                ClassF32(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
-                
-                if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan) {
-                    SetFloatFlags(true, false, false, false, false);
-                    regs[instr.rd].u64 = 0;
-                }
-                else
-                    regs[instr.rd].u64 = lhs.f <= rhs.f ? 1 : 0;
-                
-                break;
-            }
-            
-            case Type::FCLASS_S: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+        auto fetched = instruction_cache.Fetch(head, virtual_head);
+        if (!fetched) break;
 
-                bool is_inf, is_nan, is_qnan, is_subnormal, is_zero, is_neg;
-                ClassF32(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, &is_subnormal, &is_zero, &is_neg);
-                
-                Word result = 0;
-                if (is_inf && is_neg) result |= 1 << 0;
-                if (!is_subnormal && is_neg) result |= 1 << 1;
-                if (is_subnormal && is_neg) result |= 1 << 2;
-                if (is_zero && is_neg) result |= 1 << 3;
-                if (is_zero && !is_neg) result |= 1 << 4;
-                if (is_subnormal && !is_neg) result |= 1 << 5;
-                if (!is_subnormal && !is_nan) result |= 1 << 6;
-                if (is_inf && !is_neg) result |= 1 << 7;
-                if (is_nan) result |= 1 << 8;
-                if (is_qnan) result |= 1 << 9;
+        const auto& instr = *fetched;
 
-                regs[instr.rd].u32 = result;
-                regs[instr.rd].is_u64 = 0;
-                break;
-            }
-            
-            case Type::FCVT_S_W: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        // Flagged instructions only ever head a block, where StepBlocks
+        // checks them
+        if (instr.break_point && !block.instructions.empty())
+            break;
 
-                auto val = AsSigned32(regs[instr.rs1].u32);
+        block.instructions.push_back(instr);
 
-                fregs[instr.rd].f = val;
-                if (fregs[instr.rd].f != val)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                break;
-            }
-            
-            case Type::FCVT_S_WU:
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        if (EndsBasicBlock(instr.type) && !IsCounterRead(instr))
+            break;
 
-                fregs[instr.rd].f = regs[instr.rs1].u32;
-                if (fregs[instr.rd].f != regs[instr.rs1].u32)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                break;
-            
-            case Type::FMV_W_X:
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        head += instr.size;
+        virtual_head += instr.size;
+    } while ((head % InstructionCache::PAGE_SIZE) != 0 && !instruction_cache.Straddles(head) && block.instructions.size() < MAX_BASIC_BLOCK_SIZE);
 
-                fregs[instr.rd].u64 = 0;
-                fregs[instr.rd].u32 = regs[instr.rs1].u32;
-                break;
-            
-            case Type::FCVT_L_S: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    block.exit = block.instructions.empty() ? Exit::Direct : GetExit(block.instructions.back());
+    block.return_block = nullptr;
 
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    block.fusions.assign(block.instructions.size(), Fusion::None);
 
-                bool is_inf, is_nan, is_qnan;
-                ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
+    for (size_t i = 0; i + 1 < block.instructions.size(); i++) {
+        block.fusions[i] = FindFusion(block.instructions[i], block.instructions[i + 1]);
+        if (block.fusions[i] != Fusion::None) i++;
+    }
 
-                Long result;
+    return block;
+}
 
-                if (is_inf) {
-                    if (fregs[instr.rs1].f < 0) result = -1ULL;
-                    else result = 0x7fffffffffffffff;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else if (is_nan || is_qnan) {
-                    result = 0x7fffffffffffffff;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else {
-                    SLong val = fregs[instr.rs1].f;
-                    if (val != fregs[instr.rs1].f)
-                        SetFloatFlags(false, false, false, false, true);
-                    
-                    result = AsUnsigned64(val);
-                }
+VirtualMachine::Exit VirtualMachine::GetExit(const RVInstruction& last) {
+    using Type = RVInstruction::Type;
 
-                regs[instr.rd].u64 = result;
-                break;
-            }
+    auto IsLink = [](Byte reg) { return reg == REG_RA || reg == REG_T0; };
 
-            case Type::FCVT_LU_S: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    if (last.type == Type::JAL)
+        return IsLink(last.rd) ? Exit::Call : Exit::Direct;
 
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    if (last.type != Type::JALR)
+        return Exit::Direct;
 
-                bool is_inf, is_nan, is_qnan;
-                ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
-                
-                Long result;
+    // The spec's hints: a link rd pushes and a link rs1 pops. Both link
+    // registers pop and then push, unless they're the same one, which
+    // only pushes
+    bool push = IsLink(last.rd);
+    bool pop = IsLink(last.rs1) && (!push || last.rd != last.rs1);
 
-                if (is_inf) {
-                    if (fregs[instr.rs1].f < 0) result = 0;
-                    else result = -1ULL;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else if (is_nan || is_qnan) {
-                    result = -1ULL;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else {
-                    Long val = fregs[instr.rs1].f;
-                    if (val != fregs[instr.rs1].f)
-                        SetFloatFlags(false, false, false, false, true);
-                    
-                    result = val;
-                }
+    if (push && pop) return Exit::Coroutine;
+    if (push) return Exit::IndirectCall;
 
-                regs[instr.rd].u64 = result;
-                break;
-            }
+    return pop ? Exit::Return : Exit::Indirect;
+}
 
-            case Type::FCVT_S_L: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+VirtualMachine::Fusion VirtualMachine::FindFusion(const RVInstruction& first, const RVInstruction& second) {
+    using Type = RVInstruction::Type;
 
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+    // The second reads what the first wrote. The interpreter's W forms
+    // write x0 too, so ALU pairs ending in x0 are left alone
+    if (first.rd == REG_ZERO || second.rs1 != first.rd) return Fusion::None;
 
-                SLong val = AsSigned64(regs[instr.rs1].u64);
+    switch (first.type) {
+        case Type::LUI:
+            if (second.rd == REG_ZERO) break;
+            if (second.type == Type::ADDI) return Fusion::LoadImmediate;
+            if (second.type == Type::ADDIW) return Fusion::LoadImmediateWord;
+            break;
 
-                fregs[instr.rd].f = val;
-                if (fregs[instr.rd].f != val)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                break;
-            }
+        case Type::AUIPC:
+            if (second.type == Type::ADDI && second.rd != REG_ZERO) return Fusion::AddressPC;
+            if (second.type == Type::JALR) return Fusion::CallPC;
+            break;
 
-            case Type::FCVT_S_LU: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+        case Type::SLLI:
+            if (second.type == Type::SRLI && second.rd != REG_ZERO) return Fusion::ShiftPair;
+            break;
 
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        case Type::SLT:
+        case Type::SLTU:
+            if ((second.type == Type::BEQ || second.type == Type::BNE) && second.rs2 == REG_ZERO) return Fusion::CompareBranch;
+            break;
 
-                Long val = regs[instr.rs1].u64;
+        default:
+            break;
+    }
 
-                fregs[instr.rd].f = val;
-                if (fregs[instr.rd].f != val)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                break;
-            }
-            
-            case Type::FLD: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+    return Fusion::None;
+}
 
-                auto addr = RS1() + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
+// Same results as executing the two in turn, neither of them can trap
+void VirtualMachine::ExecuteFused(Fusion fusion, const RVInstruction& first, const RVInstruction& second) {
+    Address next_pc = pc + first.size + second.size;
+    Long value = 0;
+
+    switch (fusion) {
+        case Fusion::LoadImmediate:
+            value = first.immediate;
+            regs[first.rd].u64 = value;
+            regs[second.rd].u64 = value + second.immediate;
+            pc = next_pc;
+            break;
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                if (!translation_valid) continue;
+        case Fusion::LoadImmediateWord:
+            value = first.immediate;
+            regs[first.rd].u64 = value;
+            regs[second.rd].s64 = static_cast<SWord>(value + second.immediate);
+            pc = next_pc;
+            break;
 
-                Long val = memory.ReadWord(translated_address);
-                val |= static_cast<Long>(memory.ReadWord(translated_address + 4)) << 32;
-                fregs[instr.rd] = ToDouble(val);
-                break;
-            }
-            
-            case Type::FSD: {
-                auto addr = RS1() + instr.immediate;
-                if (Is32BitMode()) addr &= 0xffffffff;
+        case Fusion::AddressPC:
+            value = pc + first.immediate;
+            regs[first.rd].u64 = value;
+            regs[second.rd].u64 = value + second.immediate;
+            pc = next_pc;
+            break;
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, true, false);
-                if (!translation_valid) continue;
-                
-                auto val = ToUInt64(fregs[instr.rs2]);
-                memory.WriteWord(translated_address, static_cast<Word>(val));
-                memory.WriteWord(translated_address + 4, static_cast<Word>(val >> 32));
-                break;
-            }
-            
-            case Type::FMADD_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        case Fusion::CallPC:
+            value = pc + first.immediate;
+            regs[first.rd].u64 = value;
+            pc = (value + second.immediate) & 0xfffffffffffffffe;
 
-                bool lhs_is_inf;
-                bool rhs_is_zero;
-                ClassF64(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
-                ClassF64(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+            if (second.rd != REG_ZERO)
+                regs[second.rd].u64 = next_pc;
 
-                if (lhs_is_inf && rhs_is_zero) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            break;
 
-                double result = fregs[instr.rs1].d * fregs[instr.rs2].d + fregs[instr.rs3].d;
+        case Fusion::ShiftPair:
+            value = regs[first.rs1].u64 << (first.immediate & 0b111111);
+            regs[first.rd].u64 = value;
+            regs[second.rd].u64 = value >> (second.immediate & 0b111111);
+            pc = next_pc;
+            break;
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F64_NAN;
-                
-                else
-                    fregs[instr.rd].d = result;
+        case Fusion::CompareBranch: {
+            if (first.type == RVInstruction::Type::SLT)
+                value = regs[first.rs1].s64 < regs[first.rs2].s64 ? 1 : 0;
 
-                break;
+            else
+                value = regs[first.rs1].u64 < regs[first.rs2].u64 ? 1 : 0;
+
+            regs[first.rd].u64 = value;
+
+            if ((value != 0) == (second.type == RVInstruction::Type::BNE)) {
+                pc += first.size + second.immediate;
+                events[HPM_EVENT_BRANCHES_TAKEN]++;
             }
-            
-            case Type::FMSUB_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
 
-                bool lhs_is_inf;
-                bool rhs_is_zero;
-                ClassF64(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
-                ClassF64(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+            else
+                pc = next_pc;
 
-                if (lhs_is_inf && rhs_is_zero) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            break;
+        }
 
-                double result = fregs[instr.rs1].d * fregs[instr.rs2].d - fregs[instr.rs3].d;
+        case Fusion::None:
+            break;
+    }
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F64_NAN;
-                
-                else
-                    fregs[instr.rd].d = result;
+    events[instruction_events[static_cast<size_t>(first.type)]]++;
+    events[instruction_events[static_cast<size_t>(second.type)]]++;
+}
 
-                break;
-            }
-            
-            case Type::FNMSUB_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+void VirtualMachine::CompileBasicBlock(BasicBlock& block) {
+    block.compile_attempted = true;
 
-                bool lhs_is_inf;
-                bool rhs_is_zero;
-                ClassF64(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
-                ClassF64(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+    size_t length = 0;
+    while (length < block.instructions.size() && JIT::CanCompile(block.instructions[length]))
+        length++;
 
-                if (lhs_is_inf && rhs_is_zero) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    if (length == 0) return;
 
-                double result = -(fregs[instr.rs1].d * fregs[instr.rs2].d) + fregs[instr.rs3].d;
+    block.compiled = jit.Compile(block.instructions, length);
+    if (block.compiled) {
+        block.compiled_length = length;
+        block.compiled_size = 0;
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F64_NAN;
-                
-                else
-                    fregs[instr.rd].d = result;
+        for (size_t i = 0; i < length; i++)
+            block.compiled_size += block.instructions[i].size;
 
-                break;
-            }
-            
-            case Type::FNMADD_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        return;
+    }
 
-                bool lhs_is_inf;
-                bool rhs_is_zero;
-                ClassF64(fregs[instr.rs1], &lhs_is_inf, nullptr, nullptr, nullptr, nullptr, nullptr);
-                ClassF64(fregs[instr.rs2], nullptr, nullptr, nullptr, nullptr, &rhs_is_zero, nullptr);
+    if (jit.IsFull()) {
+        jit.Reset();
+        basic_blocks_dirty = true;
+    }
+}
 
-                if (lhs_is_inf && rhs_is_zero) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+bool VirtualMachine::StepBlocks(Long steps) {
+    SyncHostPages();
 
-                double result = -(fregs[instr.rs1].d * fregs[instr.rs2].d) - fregs[instr.rs3].d;
+    steps = std::min(steps, clint->InstructionsUntilDeadline(csrs[CSR_MHARTID]));
+    ticks += steps;
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F64_NAN;
-                
-                else
-                    fregs[instr.rd].d = result;
+    ClearFloatFlags();
+    watch_hit.reset();
 
-                break;
-            }
-            
-            case Type::FADD_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+    BasicBlock* previous = nullptr;
+    Long executed = 0;
 
-                double result = fregs[instr.rs1].d + fregs[instr.rs2].d;
+    while (executed < steps && running) {
+        if (basic_blocks_dirty) {
+            InvalidateBasicBlocks();
+            previous = nullptr;
+        }
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F64_NAN;
+        if (start_requested.load(std::memory_order_relaxed)) [[unlikely]] {
+            previous = nullptr;
+            if (TakeStartRequest() && paused) break;
+        }
 
-                else
-                    fregs[instr.rd].d = result;
-                
-                break;
-            }
-            
-            case Type::FSUB_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        if (IsStillWaitingForInterrupt()) {
+            cycles += steps - executed;
+            stalled_cycles += steps - executed;
+            break;
+        }
+
+        HandleInterrupts();
 
-                double result = fregs[instr.rs1].d - fregs[instr.rs2].d;
+        if (pc & 0b1) {
+            cycles++;
+            executed++;
+            previous = nullptr;
+            RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT);
+            continue;
+        }
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F64_NAN;
+        auto [translated_address, translation_valid] = TranslateMemoryAddress(pc, false, true);
+        if (!translation_valid) {
+            cycles++;
+            executed++;
+            previous = nullptr;
+            continue;
+        }
 
-                else
-                    fregs[instr.rd].d = result;
-                
-                break;
+        // Blocks are built from the cache, which can't hold this one
+        if (instruction_cache.Straddles(translated_address)) {
+            auto instr = FetchInstruction(translated_address);
+            if (instr && instr->break_point && executed != 0 && StopsAtBreakPoint(*instr)) [[unlikely]] {
+                FinishSteps();
+                return true;
             }
-            
-            case Type::FMUL_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
 
-                double result = fregs[instr.rs1].d * fregs[instr.rs2].d;
+            cycles++;
+            executed++;
+            previous = nullptr;
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F64_NAN;
+            if (instr) Execute(*instr);
 
-                else
-                    fregs[instr.rd].d = result;
-                
-                break;
+            if (watch_hit) [[unlikely]] {
+                FinishSteps();
+                return true;
             }
-            
-            case Type::FDIV_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
 
-                double result = fregs[instr.rs1].d / fregs[instr.rs2].d;
+            continue;
+        }
 
-                if (CheckFloatErrors())
-                    fregs[instr.rd].u64 = RV_F64_NAN;
+        auto IsCurrent = [&](BasicBlock* candidate) {
+            return candidate && candidate->address == translated_address && candidate->version == memory.GetCodePageVersion(translated_address);
+        };
+
+        BasicBlock* block = nullptr;
+        BasicBlock* caller = nullptr;
+        IndirectTarget* indirect = nullptr;
+
+        if (previous) {
+            switch (previous->exit) {
+                case Exit::Direct:
+                case Exit::Call:
+                    for (auto successor : previous->successors) {
+                        if (IsCurrent(successor)) {
+                            block = successor;
+                            break;
+                        }
+                    }
 
-                else
-                    fregs[instr.rd].d = result;
-                
-                break;
-            }
-            
-            case Type::FSQRT_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
                     break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
 
-                bool is_inf, is_nan, is_qnan, is_neg;
-                ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, &is_neg);
+                case Exit::Return:
+                case Exit::Coroutine:
+                    return_top = (return_top + RETURN_STACK_SIZE - 1) % RETURN_STACK_SIZE;
+                    caller = std::exchange(return_stack[return_top], nullptr);
 
-                if (is_inf || is_nan || is_qnan || is_neg)
-                    fregs[instr.rd].u64 = RV_F64_NAN;
-                
-                else
-                    fregs[instr.rd].d = sqrt(fregs[instr.rs1].d);
-                
-                break;
-            }
-            
-            case Type::FSGNJ_D: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+                    if (previous->exit == Exit::Coroutine) {
+                        return_stack[return_top] = previous;
+                        return_top = (return_top + 1) % RETURN_STACK_SIZE;
+                    }
 
-                Float result = fregs[instr.rs1];
-                Float rhs = fregs[instr.rs2];
+                    indirect_jumps++;
+                    if (caller && IsCurrent(caller->return_block)) {
+                        block = caller->return_block;
+                        indirect_hits++;
+                    }
 
-                result.u64 &= ~(1ULL<<63);
-                result.u64 |= rhs.u64 & (1ULL<<63);
-                fregs[instr.rd] = result;
-                break;
-            }
-            
-            case Type::FSGNJN_D: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+                    break;
 
-                Float result = fregs[instr.rs1];
-                Float rhs = fregs[instr.rs2];
+                case Exit::IndirectCall:
+                case Exit::Indirect:
+                    indirect = &indirect_targets[((previous->address >> 1) ^ (translated_address >> 1)) % INDIRECT_TARGETS];
 
-                result.u64 &= ~(1ULL<<63);
-                result.u64 |= (~rhs.u64) & (1ULL<<63);
-                fregs[instr.rd] = result;
-                break;
+                    indirect_jumps++;
+                    if (indirect->source == previous && IsCurrent(indirect->target)) {
+                        block = indirect->target;
+                        indirect_hits++;
+                    }
+
+                    break;
             }
-            
-            case Type::FSGNJX_D: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        }
 
-                Float result = fregs[instr.rs1];
-                Float rhs = fregs[instr.rs2];
+        if (!block) {
+            block = &GetBasicBlock(translated_address, pc);
 
-                result.u64 ^= rhs.u64 & (1ULL<<63);
-                fregs[instr.rd] = result;
-                break;
-            }
-            
-            case Type::FMIN_D: {
-                bool lhs_neg;
-                bool rhs_neg;
-                bool lhs_snan, lhs_qnan;
-                bool rhs_snan, rhs_qnan;
-                ClassF64(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, &lhs_neg);
-                ClassF64(fregs[instr.rs2], nullptr, &rhs_snan, &rhs_qnan, nullptr, nullptr, &rhs_neg);
-                bool lhs_nan = lhs_snan || lhs_qnan;
-                bool rhs_nan = rhs_snan || rhs_qnan;
+            if (caller)
+                caller->return_block = block;
 
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+            else if (indirect)
+                *indirect = {previous, block};
 
-                if (lhs_nan && rhs_nan) {
-                    SetFloatFlags(true, false, false, false, false);
-                    fregs[instr.rd].u64 = RV_F64_NAN;
-                    break;
-                }
+            else if (previous && previous->exit != Exit::Return && previous->exit != Exit::Coroutine)
+                previous->successors[previous->successors[0] ? 1 : 0] = block;
+        }
 
-                bool lhs_less = false;
-                if (lhs_nan) {
-                    lhs_less = false;
-                    SetFloatFlags(true, false, false, false, false);
-                }
-                else if (rhs_nan) {
-                    lhs_less = true;
-                    SetFloatFlags(true, false, false, false, false);
-                }
-                else if (lhs_neg && !rhs_neg) lhs_less = true;
-                else if (!lhs_neg && rhs_neg) lhs_less = false;
-                else if (fregs[instr.rs1].d < fregs[instr.rs2].d) lhs_less = true;
+        // Nothing to fetch at the head
+        if (block->instructions.empty()) {
+            cycles++;
+            executed++;
+            previous = nullptr;
+            RaiseException(EXCEPTION_INSTRUCTION_ADDRESS_FAULT);
+            continue;
+        }
 
-                if (lhs_less)
-                    fregs[instr.rd] = fregs[instr.rs1];
-                
-                else
-                    fregs[instr.rd] = fregs[instr.rs2];
-                
-                break;
-            }
-            
-            case Type::FMAX_D: {
-                bool lhs_neg;
-                bool rhs_neg;
-                bool lhs_snan, lhs_qnan;
-                bool rhs_snan, rhs_qnan;
-                ClassF64(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, &lhs_neg);
-                ClassF64(fregs[instr.rs2], nullptr, &rhs_snan, &rhs_qnan, nullptr, nullptr, &rhs_neg);
-                bool lhs_nan = lhs_snan || lhs_qnan;
-                bool rhs_nan = rhs_snan || rhs_qnan;
+        if (block->instructions[0].break_point && executed != 0 && StopsAtBreakPoint(block->instructions[0])) [[unlikely]] {
+            FinishSteps();
+            return true;
+        }
 
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        size_t start = 0;
 
-                if (lhs_nan && rhs_nan) {
-                    SetFloatFlags(true, false, false, false, false);
-                    fregs[instr.rd].u64 = RV_F64_NAN;
-                    break;
-                }
+        if (use_jit) {
+            block->executions++;
 
-                bool lhs_less = false;
-                if (lhs_nan) {
-                    lhs_less = false;
-                    SetFloatFlags(true, false, false, false, false);
-                }
-                else if (rhs_nan) {
-                    lhs_less = true;
-                    SetFloatFlags(true, false, false, false, false);
-                }
-                else if (lhs_neg && !rhs_neg) lhs_less = true;
-                else if (!lhs_neg && rhs_neg) lhs_less = false;
-                else if (fregs[instr.rs1].d < fregs[instr.rs2].d) lhs_less = true;
+            if (!block->compile_attempted && block->executions >= JIT::HOT_THRESHOLD)
+                CompileBasicBlock(*block);
 
-                if (!lhs_less)
-                    fregs[instr.rd] = fregs[instr.rs1];
-                
-                else
-                    fregs[instr.rd] = fregs[instr.rs2];
-                
-                break;
-            }
-            
-            case Type::FCVT_S_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
-                
-                bool lhs_snan, lhs_qnan;
-                ClassF64(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, nullptr);
-
-                if (lhs_snan) fregs[instr.rd].u64 = RV_F32_NAN;
-                else if (lhs_qnan) fregs[instr.rd].u64 = RV_F32_QNAN;
-                else {
-                    auto val = fregs[instr.rs1].d;
-                    fregs[instr.rd].u64 = 0;
-                    fregs[instr.rd].f = val;
-                }
+            if (block->compiled && executed + block->compiled_length <= steps) {
+                block->compiled(reinterpret_cast<Long*>(regs.data()), pc);
+
+                if (profiling) profiler.CountInstructions(block->instructions, block->compiled_length, pc);
 
-                break;
+                start = block->compiled_length;
+                pc += block->compiled_size;
+                cycles += start;
+                executed += start;
+                jit_instructions += start;
+                block_instructions += start;
             }
-            
-            case Type::FCVT_D_S: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        }
 
-                bool lhs_snan, lhs_qnan;
-                ClassF32(fregs[instr.rs1], nullptr, &lhs_snan, &lhs_qnan, nullptr, nullptr, nullptr);
+        Address next_pc = pc;
+        bool retired = true;
 
-                if (lhs_snan) fregs[instr.rd].u64 = RV_F64_NAN;
-                else if (lhs_qnan) fregs[instr.rd].u64 = RV_F64_QNAN;
-                else fregs[instr.rd].d = fregs[instr.rs1].f;
+        // The profiler counts instructions one at a time in Execute
+        bool fuse = !profiling;
 
-                break;
-            }
-            
-            case Type::FEQ_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+        // Whether the block ran to its end, in which case a call pushes it
+        bool completed = start == block->instructions.size();
 
-                auto lhs = fregs[instr.rs1];
-                auto rhs = fregs[instr.rs2];
+        for (size_t i = start; i < block->instructions.size() && executed < steps; i++) {
+            cycles++;
+            executed++;
+            block_instructions++;
+            next_pc += block->instructions[i].size;
 
-                bool lhs_nan, lhs_qnan;
-                bool rhs_nan, rhs_qnan;
-                ClassF64(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
-                ClassF64(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
+            // A pair only runs fused when both halves fit in the slice
+            auto fusion = block->fusions[i];
+            if (fusion != Fusion::None && fuse && executed < steps) {
+                cycles++;
+                executed++;
+                block_instructions++;
+                next_pc += block->instructions[i + 1].size;
 
-                if (lhs_nan || rhs_nan)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan)
-                    regs[instr.rd].u64 = 0;
-                
-                else
-                    regs[instr.rd].u64 = lhs.d == rhs.d ? 1 : 0;
-                
-                break;
+                ExecuteFused(fusion, block->instructions[i], block->instructions[i + 1]);
+                i++;
+
+                completed = i + 1 == block->instructions.size();
+                if (pc != next_pc) break;
+                continue;
             }
-            
-            case Type::FLT_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
 
-                auto lhs = fregs[instr.rs1];
-                auto rhs = fregs[instr.rs2];
+            retired = Execute(block->instructions[i]);
+            completed = retired && i + 1 == block->instructions.size();
 
-                bool lhs_nan, lhs_qnan;
-                bool rhs_nan, rhs_qnan;
-                ClassF64(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
-                ClassF64(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
-                
-                if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan) {
-                    SetFloatFlags(true, false, false, false, false);
-                    regs[instr.rd].u64 = 0;
-                }
-                else
-                    regs[instr.rd].u64 = lhs.d < rhs.d ? 1 : 0;
-                
+            if (!retired || pc != next_pc || watch_hit)
                 break;
-            }
-            
-            case Type::FLE_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+        }
 
-                auto lhs = fregs[instr.rs1];
-                auto rhs = fregs[instr.rs2];
+        if (completed && (block->exit == Exit::Call || block->exit == Exit::IndirectCall)) {
+            return_stack[return_top] = block;
+            return_top = (return_top + 1) % RETURN_STACK_SIZE;
+        }
 
-                bool lhs_nan, lhs_qnan;
-                bool rhs_nan, rhs_qnan;
-                ClassF64(lhs, nullptr, &lhs_nan, &lhs_qnan, nullptr, nullptr, nullptr);
-                ClassF64(rhs, nullptr, &rhs_nan, &rhs_qnan, nullptr, nullptr, nullptr);
-                
-                if (lhs_nan || rhs_nan || lhs_qnan || rhs_qnan) {
-                    SetFloatFlags(true, false, false, false, false);
-                    regs[instr.rd].u64 = 0;
-                }
-                else
-                    regs[instr.rd].u64 = lhs.d <= rhs.d ? 1 : 0;
-                
-                break;
-            }
-            
-            case Type::FCLASS_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+        previous = retired ? block : nullptr;
 
-                bool is_inf, is_nan, is_qnan, is_subnormal, is_zero, is_neg;
-                ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, &is_subnormal, &is_zero, &is_neg);
-                
-                Word result = 0;
-                if (is_inf && is_neg) result |= 1 << 0;
-                if (!is_subnormal && is_neg) result |= 1 << 1;
-                if (is_subnormal && is_neg) result |= 1 << 2;
-                if (is_zero && is_neg) result |= 1 << 3;
-                if (is_zero && !is_neg) result |= 1 << 4;
-                if (is_subnormal && !is_neg) result |= 1 << 5;
-                if (!is_subnormal && !is_nan) result |= 1 << 6;
-                if (is_inf && !is_neg) result |= 1 << 7;
-                if (is_nan) result |= 1 << 8;
-                if (is_qnan) result |= 1 << 9;
-
-                regs[instr.rd].u32 = result;
-                regs[instr.rd].is_u64 = 0;
-                break;
-            }
-            
-            case Type::FCVT_W_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+        if (watch_hit) [[unlikely]] {
+            FinishSteps();
+            return true;
+        }
+    }
 
-                bool is_inf, is_nan, is_qnan;
-                ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
-                
-                Word result;
+    FinishSteps();
+    return running && IsBreakPoint(pc);
+}
 
-                if (is_inf) {
-                    if (fregs[instr.rs1].d < 0) result = -1U;
-                    else result = 0x7fffffff;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else if (is_nan || is_qnan) {
-                    result = 0x7fffffff;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else {
-                    SWord val = fregs[instr.rs1].d;
-                    if (val != fregs[instr.rs1].d)
-                        SetFloatFlags(false, false, false, false, true);
+void VirtualMachine::WaitForWake() {
+    auto hart = csrs[CSR_MHARTID];
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration wait = MAX_IDLE_WAIT;
 
-                    result = AsUnsigned32(static_cast<SWord>(val));
-                }
+    if (!paused && !held) {
+        clint->SkipToDeadline(hart);
+        wait = std::min(wait, clint->TimeUntilDeadline(hart));
+    }
 
-                regs[instr.rd].u32 = result;
-                regs[instr.rd].is_u64 = 0;
-                break;
-            }
-            
-            case Type::FCVT_WU_D: {
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    {
+        std::unique_lock lock(idle_lock);
+        idle_signal.wait_until(lock, start + wait, [this] {
+            // A hold taken while asleep in WFI wakes the hart to park
+            return !running || start_requested.load(std::memory_order_relaxed) || (held && !parked) || !(paused || held || IsStillWaitingForInterrupt());
+        });
+    }
 
-                bool is_inf, is_nan, is_qnan;
-                ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
+    if (paused || held) return;
 
-                Word result;
+    UpdateTimer();
 
-                if (is_inf) {
-                    if (fregs[instr.rs1].d < 0) result = 0;
-                    else result = -1U;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else if (is_nan || is_qnan) {
-                    result = -1U;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else {
-                    Word val = fregs[instr.rs1].d;
-                    if (val != fregs[instr.rs1].d)
-                        SetFloatFlags(false, false, false, false, true);
-                    
-                    result = val;
-                }
+    // Nothing retired while asleep, so catch the cycle counter up at the
+    // rate the hart was running before. Counted time skips idle periods
+    // itself and must not see these cycles
+    if (busy_time.count() != 0) {
+        auto idle_time = std::chrono::steady_clock::now() - start;
+        auto idle_cycles = static_cast<Long>(static_cast<double>(busy_cycles) * idle_time.count() / busy_time.count());
+        cycles += idle_cycles;
+        stalled_cycles += idle_cycles;
+        retired_cycles = cycles;
+    }
+}
 
-                regs[instr.rd].u32 = result;
-                regs[instr.rd].is_u64 = 0;
-                break;
-            }
-            
-            case Type::FCVT_D_W: {
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+void VirtualMachine::RunSlice(Long steps) {
+    // The slice ends on a budget, so nothing past it runs
+    if (instructions_left) steps = std::min(steps, *instructions_left);
+    if (cycles_left) steps = std::min(steps, *cycles_left);
 
-                auto val = AsSigned32(regs[instr.rs1].u32);
+    auto start = std::chrono::steady_clock::now();
+    auto start_cycles = cycles;
+    auto start_instructions = cycles - stalled_cycles;
 
-                fregs[instr.rd].d = val;
-                if (fregs[instr.rd].d != val)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                break;
-            }
-            
-            case Type::FCVT_D_WU:
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
-                
-                fregs[instr.rd].d = regs[instr.rs1].u32;
-                if (fregs[instr.rd].d != regs[instr.rs1].u32)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                break;
-            
-            case Type::FCVT_L_D: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    bool hit_break_point = use_basic_blocks && !instruction_trace ? StepBlocks(steps) : Step(steps);
+    if (hit_break_point && pause_on_break)
+        paused = true;
 
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    busy_cycles += cycles - start_cycles;
+    busy_time += std::chrono::steady_clock::now() - start;
 
-                bool is_inf, is_nan, is_qnan;
-                ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
+    if (instructions_left || cycles_left)
+        ChargeBudgets(steps, cycles - start_cycles, cycles - stalled_cycles - start_instructions);
+}
 
-                Long result;
+void VirtualMachine::ChargeBudgets(Long steps, Long slice_cycles, Long slice_instructions) {
+    auto Charge = [&](std::optional<Long>& left, Long used, Budget budget) {
+        if (!left) return;
 
-                if (is_inf) {
-                    if (fregs[instr.rs1].d < 0) result = -1ULL;
-                    else result = 0x7fffffffffffffff;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else if (is_nan || is_qnan) {
-                    result = 0x7fffffffffffffff;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else {
-                    SLong val = fregs[instr.rs1].d;
-                    if (val != fregs[instr.rs1].d)
-                        SetFloatFlags(false, false, false, false, true);
-                    
-                    result = AsUnsigned64(val);
-                }
+        // A slice never counts more than its steps. More, or a count that
+        // went backwards, means the guest rewrote its counters or restarted,
+        // and the whole slice is charged
+        *left -= std::min({used, steps, *left});
+        if (*left != 0) return;
 
-                regs[instr.rd].u64 = result;
-                break;
-            }
+        if (budget_handler) budget_handler(*this, budget);
+        if (left && *left == 0) Stop();
+    };
 
-            case Type::FCVT_LU_D: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
-                
-                if (!ChangeRoundingMode(instr.rm)) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    Charge(instructions_left, slice_instructions, Budget::Instructions);
+    Charge(cycles_left, slice_cycles, Budget::Cycles);
+}
 
-                bool is_inf, is_nan, is_qnan;
-                ClassF64(fregs[instr.rs1], &is_inf, &is_nan, &is_qnan, nullptr, nullptr, nullptr);
+void VirtualMachine::SetInstructionBudget(Long instructions) {
+    instructions_left = instructions ? std::optional<Long>(instructions) : std::nullopt;
+}
 
-                Long result;
+void VirtualMachine::SetCycleBudget(Long cycles) {
+    cycles_left = cycles ? std::optional<Long>(cycles) : std::nullopt;
+}
 
-                if (is_inf) {
-                    if (fregs[instr.rs1].d < 0) result = 0;
-                    else result = -1ULL;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else if (is_nan || is_qnan) {
-                    result = -1ULL;
-                    SetFloatFlags(false, false, false, false, true);
-                }
-                else {
-                    Long val = fregs[instr.rs1].d;
-                    if (val != fregs[instr.rs1].d)
-                        SetFloatFlags(false, false, false, false, true);
-                    
-                    result = val;
-                }
+// WaitForWake without the wait. Idle time isn't caught up into the cycle
+// counter here since the scheduler doesn't know how long the hart slept
+bool VirtualMachine::PollWake(bool skip_idle) {
+    if (!IsStillWaitingForInterrupt()) return true;
 
-                regs[instr.rd].u64 = result;
-                break;
-            }
+    if (skip_idle) clint->SkipToDeadline(csrs[CSR_MHARTID]);
+    UpdateTimer();
 
-            case Type::FMV_X_D:
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+    return !IsStillWaitingForInterrupt();
+}
 
-                regs[instr.rd].u64 = ToUInt64(fregs[instr.rs1]);
-                break;
-            
-            case Type::FCVT_D_L: {
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+void VirtualMachine::Run() {
+    while (running) {
+        if (start_requested.load(std::memory_order_relaxed))
+            TakeStartRequest();
 
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        if (paused || held || IsStillWaitingForInterrupt()) {
+            if (tracing) tracer.Begin(paused || held ? Tracer::Kind::Pause : Tracer::Kind::WaitForInterrupt);
+            parked.store(paused || held, std::memory_order_release);
 
-                auto val = AsSigned64(regs[instr.rs1].u64);
+            // Sleeping harts still answer readers, and see state set while paused
+            if (state_requested.load(std::memory_order_relaxed))
+                PublishState();
 
-                fregs[instr.rd].d = val;
-                if (fregs[instr.rd].d != val)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                break;
-            }
-            
-            case Type::FCVT_D_LU:
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+            WaitForWake();
+            continue;
+        }
 
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
-                
-                fregs[instr.rd].d = regs[instr.rs1].u64;
-                if (fregs[instr.rd].d != regs[instr.rs1].u64)
-                    SetFloatFlags(true, false, false, false, false);
-                
-                break;
-            
-            case Type::FMV_D_X:
-                if (Is32BitMode()) {
-                    RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                    inc_pc = false;
-                    break;
-                }
+        if (tracing) {
+            tracer.End(Tracer::Kind::Pause);
+            tracer.End(Tracer::Kind::WaitForInterrupt);
+        }
 
-                mstatus.FS = FS_DIRTY;
-                sstatus.FS = FS_DIRTY;
+        parked.store(false, std::memory_order_relaxed);
+        RunSlice(1000);
+    }
 
-                fregs[instr.rd].u64 = regs[instr.rs1].u64;
-                break;
+    // Stopping while asleep still closes the span
+    if (tracing) {
+        tracer.End(Tracer::Kind::Pause);
+        tracer.End(Tracer::Kind::WaitForInterrupt);
+    }
+}
 
-            case Type::SRET:
-                if (privilege_level == PrivilegeLevel::User) {
-                    throw std::runtime_error("Cannot use SRET in user mode");
-                }
+bool VirtualMachine::IsRunnable(bool skip_idle) {
+    if (start_requested.load(std::memory_order_relaxed))
+        TakeStartRequest();
 
-                pc = csrs[CSR_SEPC];
-                sstatus.SIE = sstatus.SPIE;
+    return running && !paused && !held && PollWake(skip_idle);
+}
 
-                if (sstatus.SPP)
-                    privilege_level = PrivilegeLevel::Supervisor;
-                
-                else
-                    privilege_level = PrivilegeLevel::User;
-                
-                continue;
-            
-            case Type::MRET:
-                if (privilege_level == PrivilegeLevel::Supervisor) {
-                    RaiseInterrupt(INTERRUPT_SUPERVISOR_SOFTWARE);
-                    break;
-                }
+bool VirtualMachine::RunQuantum(Long steps, bool skip_idle) {
+    if (!IsRunnable(skip_idle)) {
+        if (tracing && running) tracer.Begin(paused || held ? Tracer::Kind::Pause : Tracer::Kind::WaitForInterrupt);
+        if (running && state_requested.load(std::memory_order_relaxed)) PublishState();
 
-                if (privilege_level == PrivilegeLevel::User) {
-                    throw std::runtime_error(std::format("Cannot use MRET in user mode"));
-                }
+        parked.store(paused || held, std::memory_order_release);
+        return false;
+    }
 
-                pc = csrs[CSR_MEPC];
-                mstatus.MIE = mstatus.MPIE;
-                sstatus.SIE = mstatus.SPIE;
+    parked.store(false, std::memory_order_relaxed);
 
-                switch (mstatus.MPP) {
-                    case MACHINE_MODE:
-                        privilege_level = PrivilegeLevel::Machine;
-                        break;
-                    
-                    case SUPERVISOR_MODE:
-                        privilege_level = PrivilegeLevel::Supervisor;
-                        break;
-                    
-                    case USER_MODE:
-                        privilege_level = PrivilegeLevel::User;
-                        break;
-                    
-                    default:
-                        throw std::runtime_error("Cannot MRET to hypervisor");
-                }
-                continue;
-            
-            case Type::WFI:
-                waiting_for_interrupt = true;
-                break;
-            
-            case Type::SFENCE_VMA:
-                throw std::runtime_error(std::format("Instruction not implemented {}", std::string(instr)));
-                break;
-            
-            case Type::SINVAL_VMA:
-                throw std::runtime_error(std::format("Instruction not implemented {}", std::string(instr)));
-                break;
-            
-            case Type::SINVAL_GVMA:
-                throw std::runtime_error(std::format("Instruction not implemented {}", std::string(instr)));
-                break;
-            
-            case Type::SFENCE_W_INVAL:
-                throw std::runtime_error(std::format("Instruction not implemented {}", std::string(instr)));
-                break;
-            
-            case Type::SFENCE_INVAL_IR:
-                throw std::runtime_error(std::format("Instruction not implemented {}", std::string(instr)));
-                break;
-            
-            case Type::CUST_TVA: {
-                auto addr = RS1();
-                if (Is32BitMode()) addr &= 0xffffffff;
+    if (tracing) {
+        tracer.End(Tracer::Kind::Pause);
+        tracer.End(Tracer::Kind::WaitForInterrupt);
+    }
 
-                auto [translated_address, translation_valid] = TranslateMemoryAddress(addr, false, false);
-                regs[instr.rd].u64 = translated_address;
-                break;
-            }
-            
-            case Type::CUST_MTRAP:
-                pc += 4;
+    RunSlice(steps);
+    return true;
+}
 
-                switch (regs[instr.rs2].u64 & 0b11) {
-                    case MACHINE_MODE:
-                        privilege_level = PrivilegeLevel::Machine;
-                        break;
-                    
-                    case SUPERVISOR_MODE:
-                        privilege_level = PrivilegeLevel::Supervisor;
-                        break;
-                    
-                    default:
-                        privilege_level = PrivilegeLevel::User;
-                        break;
-                }
+void VirtualMachine::SaveState(SnapshotWriter& writer) const {
+    writer.Write(pc);
+    writer.Write(cycles);
+    writer.Write(stalled_cycles);
+    writer.Write(retired_cycles);
+    writer.Write(regs);
+    writer.Write(fregs);
+    writer.Write(vregs);
+    writer.Write(csrs);
+    writer.Write(privilege_level);
+    writer.Write(mip.load());
+    writer.Write(mie);
+    writer.Write(mideleg);
+    writer.Write(sip);
+    writer.Write(sie);
+    writer.Write(mstatus);
+    writer.Write(sstatus);
+    writer.Write(satp);
+    writer.Write(waiting_for_interrupt);
+    writer.Write(events);
+    writer.Write(performance_counters);
+    writer.Write(count_inhibit);
+    writer.Write(instruction_tlb);
+    writer.Write(data_tlb);
+    writer.Write(tlb_generation);
+    writer.Write(running);
+    writer.Write(paused);
+}
 
-                if (Is32BitMode())
-                    RaiseMachineTrap(regs[instr.rs1].u32);
+void VirtualMachine::RestoreState(SnapshotReader& reader) {
+    reader.Read(pc);
+    reader.Read(cycles);
+    reader.Read(stalled_cycles);
+    reader.Read(retired_cycles);
+    reader.Read(regs);
+    reader.Read(fregs);
+    reader.Read(vregs);
+    reader.Read(csrs);
+    reader.Read(privilege_level);
+    Long pending_interrupts;
+    reader.Read(pending_interrupts);
+    mip = pending_interrupts;
+    reader.Read(mie);
+    reader.Read(mideleg);
+    reader.Read(sip);
+    reader.Read(sie);
+    reader.Read(mstatus);
+    reader.Read(sstatus);
+    reader.Read(satp);
+    reader.Read(waiting_for_interrupt);
+    reader.Read(events);
+    reader.Read(performance_counters);
+    reader.Read(count_inhibit);
+    reader.Read(instruction_tlb);
+    reader.Read(data_tlb);
+    reader.Read(tlb_generation);
+    reader.Read(running);
+    reader.Read(paused);
+
+    UpdateTranslation();
+
+    // Host pointers and decoded code belong to the memory being replaced
+    host_pages = {};
+    instruction_cache.Clear();
+    basic_blocks_dirty = true;
+}
 
-                else
-                    RaiseMachineTrap(regs[instr.rs1].u64);
-                
-                continue;
-            
-            case Type::CUST_STRAP:
-                pc += 4;
+void VirtualMachine::CopyState(const VirtualMachine& vm) {
+    pc = vm.pc;
+    cycles = vm.cycles;
+    stalled_cycles = vm.stalled_cycles;
+    retired_cycles = vm.retired_cycles;
+    regs = vm.regs;
+    fregs = vm.fregs;
+    vregs = vm.vregs;
+    csrs = vm.csrs;
+    privilege_level = vm.privilege_level;
+    mip = vm.mip.load();
+    mie = vm.mie;
+    mideleg = vm.mideleg;
+    sip = vm.sip;
+    sie = vm.sie;
+    mstatus = vm.mstatus;
+    sstatus = vm.sstatus;
+    satp = vm.satp;
+    waiting_for_interrupt = vm.waiting_for_interrupt;
+    events = vm.events;
+    performance_counters = vm.performance_counters;
+    count_inhibit = vm.count_inhibit;
+    instruction_tlb = vm.instruction_tlb;
+    data_tlb = vm.data_tlb;
+    tlb_generation = vm.tlb_generation;
+    running = vm.running;
+    paused = vm.paused;
+
+    UpdateTranslation();
+
+    host_pages = {};
+    instruction_cache.Clear();
+    basic_blocks_dirty = true;
+}
 
-                switch (regs[instr.rs2].u64 & 0b11) {
-                    case MACHINE_MODE:
-                        privilege_level = PrivilegeLevel::Machine;
-                        break;
-                    
-                    case SUPERVISOR_MODE:
-                        privilege_level = PrivilegeLevel::Supervisor;
-                        break;
-                    
-                    default:
-                        privilege_level = PrivilegeLevel::User;
-                        break;
-                }
-                
-                if (Is32BitMode())
-                    RaiseSupervisorTrap(regs[instr.rs1].u32);
-                
-                else
-                    RaiseSupervisorTrap(regs[instr.rs1].u64);
-                
-                continue;
+bool VirtualMachine::CopyMisaligned(Address virtual_address, Address address, Byte* bytes, Address size, bool is_write) {
+    if (trap_misaligned) return RaiseAccessFault(Memory::AccessFault::Misaligned, is_write);
 
-            case Type::INVALID:
-            default:
-                RaiseException(EXCEPTION_ILLEGAL_INSTRUCTION);
-                inc_pc = false;
-                break;
-        }
+    Address low_size = std::min(size, Memory::PAGE_SIZE - address % Memory::PAGE_SIZE);
+    Address upper = address + low_size;
 
-        switch (instr.type) {
-            case Type::JAL:
-            case Type::JALR:
-            case Type::BEQ:
-            case Type::BGE:
-            case Type::BGEU:
-            case Type::BLT:
-            case Type::BLTU:
-            case Type::BNE:
-                break;
-            
-            default:
-                if (inc_pc)
-                    pc += 4;
+    // Both pages are checked before either is touched
+    if (low_size < size) {
+        auto [translated_address, translation_valid] = TranslateMemoryAddress(virtual_address + low_size, is_write, false);
+        if (!translation_valid) return false;
+
+        upper = translated_address;
+    }
+
+    // Both pages may want the same slot, so take the pointers one at a time
+    std::array<std::pair<Address, Address>, 2> parts = {{{address, low_size}, {upper, size - low_size}}};
+    std::array<Byte*, 2> hosts = {};
+
+    for (size_t i = 0; i < parts.size() && parts[i].second != 0; i++) {
+        hosts[i] = GetHostPointer(parts[i].first, is_write);
+        if (!hosts[i]) return RaiseAccessFault(Memory::AccessFault::Misaligned, is_write);
+    }
+
+    for (size_t i = 0; i < parts.size() && parts[i].second != 0; i++) {
+        auto [part_address, part_size] = parts[i];
+
+        if (is_write) {
+            memory.NotifyWrite(part_address, part_size);
+            std::memcpy(hosts[i], bytes, part_size);
+            memory.MarkDirty(part_address);
         }
 
-        if (IsBreakPoint(pc)) return true;
+        else
+            std::memcpy(bytes, hosts[i], part_size);
+
+        bytes += part_size;
     }
 
+    return true;
+}
+
+bool VirtualMachine::RaiseAccessFault(Memory::AccessFault fault, bool is_write) {
+    if (fault == Memory::AccessFault::Misaligned)
+        RaiseException(is_write ? EXCEPTION_STORE_AMO_ADDRESS_MISALIGNED : EXCEPTION_LOAD_ADDRESS_MISALIGNED);
+    else
+        RaiseException(is_write ? EXCEPTION_STORE_AMO_ACCESS_FAULT : EXCEPTION_LOAD_ACCESS_FAULT);
+
     return false;
 }
 
-void VirtualMachine::Run() {
-    while (running) {
-        if (paused) {
-#if defined(_WIN32) || defined(_WIN64)
-            SwitchToThread();
-#else
-            sched_yield();
-#endif
-        
-        }
-        else {
-            if (Step() && pause_on_break)
-                paused = true;
+void VirtualMachine::LoadHostPage(HostPage& entry, Address address, bool is_write) {
+    Address page = address / Memory::PAGE_SIZE;
+
+    // Watched pages go through Load and Store, which check every access,
+    // and while sampling every page does so Memory counts it
+    if (memory.IsSampling() || memory.IsWatchedPage(address)) {
+        entry = {page, nullptr, false, false, 0, nullptr, 0};
+        return;
+    }
+
+    if (!is_write) {
+        // Taken before the lookup, so a copy made after it is noticed
+        auto generation = memory.GetHostPageGeneration();
+
+        if (auto shared = memory.GetSharedHostPage(address)) {
+            entry = {page, const_cast<Byte*>(shared), false, true, generation, nullptr, 0};
+            return;
         }
     }
+
+    auto [host, writable] = memory.GetHostPage(address);
+    auto [dirty, dirty_bit] = host && writable ? memory.GetDirtyBit(address) : std::pair<std::atomic<Long>*, Long>{nullptr, 0};
+
+    entry = {page, host, writable, false, 0, dirty, dirty_bit};
 }
 
 void VirtualMachine::GetSnapshot(std::array<Reg, REGISTER_COUNT>& registers, std::array<Float, REGISTER_COUNT>& fregisters, Long& pc) {
@@ -3481,46 +5099,135 @@ void VirtualMachine::GetSnapshot(std::array<Reg, REGISTER_COUNT>& registers, std
     pc = this->pc;
 }
 
+void VirtualMachine::CollectCSRs(std::array<Long, CSR_COUNT>& values) const {
+    for (size_t csr = 0; csr < CSR_COUNT; csr++)
+        values[csr] = csr_kinds[csr] != CSRKind::Unimplemented ? csrs[csr] : 0;
+
+    values[CSR_FFLAGS] = csrs[CSR_FCSR] & CSR_FCSR_FLAGS;
+    values[CSR_FRM] = (csrs[CSR_FCSR] >> 5) & 0b111;
+    values[CSR_MCYCLE] = cycles;
+    values[CSR_CYCLE] = cycles;
+    values[CSR_INSTRET] = cycles - stalled_cycles;
+    values[CSR_MINSTRET] = values[CSR_INSTRET];
+
+    values[CSR_TIME] = clint->GetTime();
+
+    values[CSR_CYCLEH] = values[CSR_CYCLE] >> 32;
+    values[CSR_TIMEH] = values[CSR_TIME] >> 32;
+    values[CSR_INSTRETH] = values[CSR_INSTRET] >> 32;
+    values[CSR_MINSTRETH] = values[CSR_INSTRETH];
+
+    values[CSR_MIP] = mip;
+    values[CSR_MIE] = mie;
+    values[CSR_MIDELEG] = mideleg;
+    values[CSR_SIP] = sip;
+    values[CSR_SIE] = sie;
+
+    values[CSR_MSTATUS] = mstatus.raw;
+    values[CSR_SSTATUS] = sstatus.raw;
+
+    values[CSR_SATP] = satp.raw;
+    values[CSR_MCOUNTINHIBIT] = count_inhibit;
+
+    for (Half counter = 3; counter < CSR_PERF_COUNTER_MAX; counter++) {
+        values[CSR_MHPMCOUNTER3 + counter - 3] = ReadPerformanceCounter(counter);
+        values[CSR_HPMCOUNTER + counter - 3] = ReadPerformanceCounter(counter);
+        values[CSR_MHPMEVENT3 + counter - 3] = performance_counters[counter].event;
+    }
+}
+
 void VirtualMachine::GetCSRSnapshot(std::unordered_map<Long, Long>& csrs) const {
-    csrs = this->csrs;
-    csrs[CSR_MCYCLE] = cycles;
-    csrs[CSR_CYCLE] = cycles;
+    csrs.clear();
+
+    std::array<Long, CSR_COUNT> values;
+    CollectCSRs(values);
+
+    for (size_t csr = 0; csr < CSR_COUNT; csr++) {
+        if (csr_kinds[csr] != CSRKind::Unimplemented)
+            csrs[csr] = values[csr];
+    }
+
+    csrs[CSR_FFLAGS] = values[CSR_FFLAGS];
+    csrs[CSR_FRM] = values[CSR_FRM];
+    csrs[CSR_MCYCLE] = values[CSR_MCYCLE];
+    csrs[CSR_CYCLE] = values[CSR_CYCLE];
+    csrs[CSR_TIME] = values[CSR_TIME];
+
+    csrs[CSR_MIP] = values[CSR_MIP];
+    csrs[CSR_MIE] = values[CSR_MIE];
+    csrs[CSR_MIDELEG] = values[CSR_MIDELEG];
+    csrs[CSR_SIP] = values[CSR_SIP];
+    csrs[CSR_SIE] = values[CSR_SIE];
 
-    csrs[CSR_TIME] = csr_mapped_memory->time;
+    csrs[CSR_MSTATUS] = values[CSR_MSTATUS];
+    csrs[CSR_SSTATUS] = values[CSR_SSTATUS];
 
-    csrs[CSR_MIP] = mip;
-    csrs[CSR_MIE] = mie;
-    csrs[CSR_MIDELEG] = mideleg;
-    csrs[CSR_SIP] = sip;
-    csrs[CSR_SIE] = sie;
+    csrs[CSR_SATP] = values[CSR_SATP];
+    csrs[CSR_MCOUNTINHIBIT] = values[CSR_MCOUNTINHIBIT];
 
-    csrs[CSR_MSTATUS] = mstatus.raw;
-    csrs[CSR_SSTATUS] = sstatus.raw;
+    for (Half counter = 3; counter < CSR_PERF_COUNTER_MAX; counter++) {
+        csrs[CSR_MHPMCOUNTER3 + counter - 3] = values[CSR_MHPMCOUNTER3 + counter - 3];
+        csrs[CSR_HPMCOUNTER + counter - 3] = values[CSR_HPMCOUNTER + counter - 3];
+        csrs[CSR_MHPMEVENT3 + counter - 3] = values[CSR_MHPMEVENT3 + counter - 3];
+    }
+}
+
+void VirtualMachine::PublishState() {
+    state_requested.store(false, std::memory_order_relaxed);
+
+    // Too large for the stack of every thread that steps a hart
+    static thread_local auto state = std::make_unique<HartState>();
+
+    CaptureState(*state);
+    published_state.Write(*state);
+}
+
+void VirtualMachine::CaptureState(HartState& state) const {
+    state.regs = regs;
+    state.fregs = fregs;
+    CollectCSRs(state.csrs);
+    state.pc = pc;
+    state.cycles = cycles;
+    state.privilege_level = static_cast<Byte>(privilege_level);
+    state.is_32_bit_mode = Is32BitMode();
+}
 
-    csrs[CSR_SATP] = satp.raw;
+bool VirtualMachine::ReadState(HartState& state) const {
+    state_requested.store(true, std::memory_order_relaxed);
+    return published_state.Read(state);
 }
 
 size_t VirtualMachine::GetInstructionsPerSecond() {
     double total_time = 0.0;
     Word total_ticks = 0;
 
-    for (size_t i = 0; i < history_delta.size(); i++) {
+    for (size_t i = 0; i < history_count; i++) {
         total_time += history_delta[i];
         total_ticks += history_tick[i];
     }
 
+    if (total_time <= 0) return 0;
+
     return total_ticks / total_time;
 }
 
 bool VirtualMachine::IsBreakPoint(Address addr) {
-    if (break_points.contains(addr)) return true;
+    if (instruction_cache.IsBreakPoint(addr)) return true;
 
-    auto word = memory.PeekWord(addr);
+    auto low = memory.PeekHalf(addr);
 
-    if (!word.second)
+    if (!low.second)
         return false;
 
-    RVInstruction instr = RVInstruction::FromUInt32(word.first);
+    Word word = low.first;
+    if (!RVInstruction::IsCompressed(word)) {
+        auto high = memory.PeekHalf(addr + sizeof(Half));
+        if (!high.second) return false;
+
+        word |= static_cast<Word>(high.first) << 16;
+    }
+
+    RVInstruction instr = RVInstruction::Decode(word);
 
     if (privilege_level == PrivilegeLevel::User)
         return false;
@@ -3528,19 +5235,17 @@ bool VirtualMachine::IsBreakPoint(Address addr) {
     return instr.type == RVInstruction::Type::EBREAK;
 }
 
-void VirtualMachine::UpdateTime(double delta_time) {
-    history_delta.push_back(delta_time);
-    history_tick.push_back(ticks);
+void VirtualMachine::UpdateHistory(double delta_time) {
+    history_delta[history_next] = delta_time;
+    history_tick[history_next] = ticks;
     ticks = 0;
-    
-    csr_mapped_memory->time += static_cast<Long>(delta_time * CSRMappedMemory::TICKS_PER_SECOND);
-    if (csr_mapped_memory->time >= csr_mapped_memory->time_cmp)
-        RaiseInterrupt(INTERRUPT_MACHINE_TIMER);
 
-    while (history_delta.size() > MAX_HISTORY) {
-        history_delta.erase(history_delta.begin());
-        history_tick.erase(history_tick.begin());
-    }
+    history_next = (history_next + 1) % MAX_HISTORY;
+    history_count = std::min(history_count + 1, MAX_HISTORY);
+}
+
+Unexpected<std::range_error> VirtualMachine::RegisterRangeError(const char* kind, size_t reg) {
+    return Unexpected<std::range_error>(std::range_error(std::format("Could not get {} {}. Max is {}", kind, reg, REGISTER_COUNT)));
 }
 
 void VirtualMachine::EmptyECallHandler(Hart hart, bool is_32_bit_mode, Memory&, std::array<Reg, REGISTER_COUNT>& regs, std::array<Float, REGISTER_COUNT>&) {
@@ -3550,4 +5255,5 @@ void VirtualMachine::EmptyECallHandler(Hart hart, bool is_32_bit_mode, Memory&,
         throw std::runtime_error(std::format("Hart {} called unknown ECall handler: {}", hart, regs[REG_A0].s64));
 }
 
+std::array<VirtualMachine::ECallHandler, VirtualMachine::ECALL_TABLE_SIZE> VirtualMachine::ecall_table;
 std::unordered_map<Long, VirtualMachine::ECallHandler> VirtualMachine::ecall_handlers;
\ No newline at end of file
@@ -0,0 +1,29 @@
+#include "Watchdog.hpp"
+
+Watchdog::Watchdog(std::vector<VirtualMachine*> harts, Clock::duration timeout, Handler handler) : harts{std::move(harts)}, handler{std::move(handler)}, deadline{Clock::now() + timeout} {
+    thread = std::jthread([this](std::stop_token stop) { Watch(stop); });
+}
+
+void Watchdog::Kick(Clock::duration timeout) {
+    std::lock_guard guard(lock);
+    deadline = Clock::now() + timeout;
+    signal.notify_one();
+}
+
+void Watchdog::Watch(std::stop_token stop) {
+    std::unique_lock guard(lock);
+
+    // A kick moves the deadline, which starts the wait over
+    auto until = deadline;
+    while (signal.wait_until(guard, stop, until, [&]() { return deadline != until; }))
+        until = deadline;
+
+    if (stop.stop_requested()) return;
+    guard.unlock();
+
+    for (auto hart : harts)
+        hart->Stop();
+
+    fired.store(true, std::memory_order_release);
+    if (handler) handler();
+}
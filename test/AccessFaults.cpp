@@ -0,0 +1,54 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(ACCESS_FAULTS) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    // Misaligned accesses are emulated otherwise
+    vm.SetTrapMisaligned(true);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Address HANDLER = 0x1100;
+    constexpr Address CAUSES = 0x1a00;
+    constexpr Address UNMAPPED = 0x80000;
+
+    vm.GetRegister(2).Value().u64 = UNMAPPED + Random<Word>(0, 0x1000) * 8;
+    vm.GetRegister(3).Value().u64 = 0x1800;
+    vm.GetRegister(7).Value().u64 = CAUSES;
+    vm.GetRegister(10).Value().u64 = HANDLER;
+
+    memory.WriteWords(0x1000, {
+        RVInstruction::Encode(Type::CSRRW, 0, 10, 0, VirtualMachine::CSR_MTVEC),
+        RVInstruction::Encode(Type::LD, 1, 2, 0, 0),
+        RVInstruction::Encode(Type::SD, 0, 2, 1, 0),
+        RVInstruction::Encode(Type::LW, 1, 3, 0, 2)
+    });
+
+    // Logs mcause and skips the faulting instruction
+    memory.WriteWords(HANDLER, {
+        RVInstruction::Encode(Type::CSRRS, 5, 0, 0, VirtualMachine::CSR_MCAUSE),
+        RVInstruction::Encode(Type::SD, 0, 7, 5, 0),
+        RVInstruction::Encode(Type::ADDI, 7, 7, 0, 8),
+        RVInstruction::Encode(Type::CSRRS, 6, 0, 0, VirtualMachine::CSR_MEPC),
+        RVInstruction::Encode(Type::ADDI, 6, 6, 0, 4),
+        RVInstruction::Encode(Type::CSRRW, 0, 6, 0, VirtualMachine::CSR_MEPC),
+        RVInstruction::Encode(Type::MRET, 0, 0, 0, 0)
+    });
+
+    STEP_VMS(1 + 3 * 8);
+
+    // Load access fault, store access fault, misaligned load
+    constexpr Long EXPECTED[] = {5, 7, 4};
+
+    for (size_t i = 0; i < std::size(EXPECTED); i++) {
+        auto cause = memory.ReadLong(CAUSES + i * 8);
+        ASSERT(cause == EXPECTED[i], "Fault {} trapped with cause {}, expected {}", i, cause, EXPECTED[i]);
+    }
+
+    ASSERT(vm.GetPC() == 0x1010, "Execution ended at {:x}, expected 1010", vm.GetPC());
+
+    SUCCESS;
+}
@@ -0,0 +1,97 @@
+#include "Test.hpp"
+
+#include <thread>
+
+DEFINE_TESTCASE(ACCESS_STATS) {
+    using Type = RVInstruction::Type;
+
+    constexpr Address LOADS = 0x2000;
+    constexpr Address STORES = 0x3000;
+    constexpr Address ATOMICS = 0x4000;
+    constexpr Address SHARED = 0x5000;
+
+    auto warmup = Random<Long>(1, 20);
+    auto loops = Random<Long>(1, 200);
+
+    std::vector<Word> program = {
+        RVInstruction::Encode(Type::LUI, 5, 0, 0, LOADS),
+        RVInstruction::Encode(Type::LUI, 6, 0, 0, STORES),
+        RVInstruction::Encode(Type::LUI, 7, 0, 0, ATOMICS),
+        RVInstruction::Encode(Type::LD, 8, 5, 0, 0),
+        RVInstruction::Encode(Type::SD, 0, 6, 8, 8),
+        RVInstruction::Encode(Type::AMOADD_D, 10, 7, 11, 0),
+        RVInstruction::Encode(Type::ADDI, 12, 12, 0, 1),
+        RVInstruction::Encode(Type::BNE, 0, 12, 13, -16),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0)
+    };
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x5000);
+    memory.WriteWords(0x1000, program);
+
+    vm.GetRegister(13).Value().u64 = warmup + loops;
+
+    // Pages the hart already holds host pointers to are counted once
+    // sampling starts
+    vm.Step(3 + warmup * 5);
+    ASSERT(memory.GetAccessStats().pages.empty(), "Counted accesses before sampling");
+
+    memory.SetAccessSampling(true);
+    vm.Step(loops * 5);
+
+    // Host threads count into shards of their own
+    constexpr Hart THREADS = 4;
+    auto increments = Random<Long>(1, 1000);
+
+    {
+        std::vector<std::jthread> threads;
+        for (Hart thread = 0; thread < THREADS; thread++) {
+            threads.emplace_back([&]() {
+                for (Long i = 0; i < increments; i++)
+                    memory.AtomicAddL(SHARED, 1);
+            });
+        }
+    }
+
+    auto stats = memory.TakeAccessStats();
+
+    auto Find = [&](Address page) {
+        for (auto& [address, counts] : stats.pages) {
+            if (address == page) return counts;
+        }
+
+        return AccessCounts{};
+    };
+
+    auto loads = Find(LOADS), stores = Find(STORES), atomics = Find(ATOMICS), shared = Find(SHARED);
+    ASSERT(loads.reads == loops && loads.Total() == loops, "Load page counted {} reads of {} accesses, expected {}", loads.reads, loads.Total(), loops);
+    ASSERT(stores.writes == loops && stores.Total() == loops, "Store page counted {} writes of {} accesses, expected {}", stores.writes, stores.Total(), loops);
+    ASSERT(atomics.atomics == loops && atomics.Total() == loops, "Atomic page counted {} atomics of {} accesses, expected {}", atomics.atomics, atomics.Total(), loops);
+    ASSERT(shared.atomics == THREADS * increments, "Threads counted {} atomics, expected {}", shared.atomics, THREADS * increments);
+
+    ASSERT(std::is_sorted(stats.pages.begin(), stats.pages.end(), [](auto& a, auto& b) { return a.first < b.first; }), "Pages aren't in address order");
+
+    // Every counted page is in the RAM region
+    auto& regions = memory.GetMemoryRegions();
+    ASSERT(stats.regions.size() == regions.size(), "{} region counts for {} regions", stats.regions.size(), regions.size());
+
+    Long total = 0;
+    for (auto& [address, counts] : stats.pages)
+        total += counts.Total();
+
+    for (size_t i = 0; i < regions.size(); i++) {
+        if (regions[i]->type != MemoryRegion::TYPE_GENERAL_RAM) continue;
+        ASSERT(stats.regions[i].Total() == total, "RAM region counted {} accesses, its pages {}", stats.regions[i].Total(), total);
+    }
+
+    // Taking starts a new window, and stopping stops counting
+    ASSERT(memory.GetAccessStats().pages.empty(), "Taking the counts left some behind");
+
+    memory.SetAccessSampling(false);
+    memory.AtomicAddL(SHARED, 1);
+    ASSERT(memory.GetAccessStats().pages.empty(), "Counted an access after sampling stopped");
+
+    SUCCESS;
+}
@@ -0,0 +1,47 @@
+#include "Test.hpp"
+
+#include <thread>
+
+DEFINE_TESTCASE(ATOMICS) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Address COUNTER = 0x1000;
+    constexpr Address VALUE = 0x1008;
+
+    // Signed compares use all 64 bits
+    constexpr SLong NEGATIVE = -0x100000000LL;
+    memory.WriteLong(VALUE, 1);
+
+    auto old_value = memory.AtomicMinL(VALUE, NEGATIVE);
+    ASSERT(old_value == 1, "AMOMIN.D returned {}, expected 1", old_value);
+    ASSERT(static_cast<SLong>(memory.ReadLong(VALUE)) == NEGATIVE, "AMOMIN.D stored {}", memory.ReadLong(VALUE));
+
+    memory.AtomicMaxUL(VALUE, 1);
+    ASSERT(static_cast<SLong>(memory.ReadLong(VALUE)) == NEGATIVE, "AMOMAXU.D treated the old value as signed");
+
+    memory.AtomicMaxL(VALUE, 1);
+    ASSERT(memory.ReadLong(VALUE) == 1, "AMOMAX.D stored {}, expected 1", memory.ReadLong(VALUE));
+
+    memory.WriteWord(VALUE, 5);
+    memory.AtomicMinW(VALUE, -1);
+    ASSERT(memory.ReadWord(VALUE) == 0xffffffff, "AMOMIN.W stored {:x}", memory.ReadWord(VALUE));
+
+    constexpr Hart HARTS = 4;
+    auto increments = Random<Long>(1000, 10000);
+
+    {
+        std::vector<std::jthread> harts;
+        for (Hart hart = 0; hart < HARTS; hart++) {
+            harts.emplace_back([&]() {
+                for (Long i = 0; i < increments; i++)
+                    memory.AtomicAddL(COUNTER, 1);
+            });
+        }
+    }
+
+    auto counted = memory.ReadLong(COUNTER);
+    ASSERT(counted == HARTS * increments, "Counter reached {}, expected {}", counted, HARTS * increments);
+
+    SUCCESS;
+}
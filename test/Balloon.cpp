@@ -0,0 +1,150 @@
+#include "Test.hpp"
+
+#include <BalloonDevice.hpp>
+#include <PLIC.hpp>
+
+#include <chrono>
+#include <thread>
+
+DEFINE_TESTCASE(BALLOON) {
+    using Type = RVInstruction::Type;
+
+    constexpr Address PAGE = Memory::PAGE_SIZE;
+    constexpr Address REGS = MemoryBalloon::DEFAULT_BASE;
+
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x40000);
+
+    auto plic = MemoryPLIC::Create();
+    auto balloon = MemoryBalloon::Create();
+
+    memory.AddMemoryRegion(plic);
+    memory.AddMemoryRegion(balloon);
+
+    auto ram = memory.FindMemoryRegionOfType<MemoryRAM>(MemoryRegion::TYPE_GENERAL_RAM);
+
+    auto pages = Random<Address>(2, 16);
+    for (Address page = 0; page < pages; page++)
+        memory.WriteLong(0x10000 + page * PAGE, page + 1);
+
+    balloon->SetTarget(pages * PAGE);
+    ASSERT(plic->IsPending(MemoryPLIC::SOURCE_BALLOON), "New target didn't raise the interrupt");
+
+    // A range that starts mid page only gives up the whole pages inside it
+    auto used = ram->SizeInMemory();
+    memory.WriteLong(REGS + MemoryBalloon::ADDRESS_OFFSET, 0x10000 - 8);
+    memory.WriteLong(REGS + MemoryBalloon::INFLATE_OFFSET, pages * PAGE + 8);
+
+    ASSERT(ram->SizeInMemory() == used - pages * PAGE, "Inflating freed {:x} bytes, expected {:x}", used - ram->SizeInMemory(), pages * PAGE);
+    ASSERT(balloon->GetFreed() == pages * PAGE, "Balloon counted {:x} freed bytes", balloon->GetFreed());
+    // Read without faulting the released pages back in
+    Long first = 1, last = 1;
+    memory.ReadBytes(0x10000, {reinterpret_cast<Byte*>(&first), sizeof(Long)});
+    memory.ReadBytes(0x10000 + (pages - 1) * PAGE, {reinterpret_cast<Byte*>(&last), sizeof(Long)});
+
+    ASSERT(first == 0 && last == 0, "Released pages kept their data");
+    ASSERT(ram->SizeInMemory() == used - pages * PAGE, "Reading released pages faulted them back in");
+    ASSERT(memory.ReadLong(REGS + MemoryBalloon::RELEASED_OFFSET) == pages * PAGE + 8, "Released reads {:x}", memory.ReadLong(REGS + MemoryBalloon::RELEASED_OFFSET));
+
+    memory.WriteLong(REGS + MemoryBalloon::DEFLATE_OFFSET, 8);
+    ASSERT(!plic->IsPending(MemoryPLIC::SOURCE_BALLOON), "Interrupt still raised at the target");
+
+    // Zeroed pages go back once nothing runs, written ones stay
+    memory.WriteLong(0x20000, 5);
+    memory.WriteLong(0x21000, 6);
+    memory.WriteLong(0x20000, 0);
+
+    SETUP_VM(0x1000);
+    memory.WriteWords(0x1000, {
+        RVInstruction::Encode(Type::ADDI, 5, 5, 0, 1),
+        RVInstruction::Encode(Type::SD, 0, 6, 5, 0),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, -8)
+    });
+
+    // The hart counts into RAM, where this thread can watch it
+    constexpr Address COUNTER = 0x30000;
+    vm.GetRegister(6).Value().u64 = COUNTER;
+
+    std::jthread runner([&]() { vm.Run(); });
+
+    // Locals go in reverse, so this stops the hart before runner joins it on
+    // any early return
+    struct StopOnExit {
+        VirtualMachine& vm;
+        ~StopOnExit() { vm.Stop(); }
+    } stop_on_exit{vm};
+
+    // The counter's page only holds data once the hart first stored to it
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (memory.ReadLong(COUNTER) == 0 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+
+    ASSERT(memory.ReadLong(COUNTER) != 0, "Hart never counted");
+
+    vm.Hold();
+    while (!vm.IsParked() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+
+    ASSERT(vm.IsParked(), "Held hart never parked");
+    ASSERT(!vm.IsPaused(), "Hold showed up as a pause");
+
+    auto counted = memory.ReadLong(COUNTER);
+    used = ram->SizeInMemory();
+
+    ASSERT(memory.ReclaimZeroPages() == PAGE, "Reclaim freed the wrong pages");
+    ASSERT(ram->SizeInMemory() == used - PAGE && memory.ReadLong(0x21000) == 6, "Reclaim took a page holding data");
+    ASSERT(memory.ReadLong(COUNTER) == counted, "Held hart kept running");
+
+    vm.Release();
+    while (memory.ReadLong(COUNTER) == counted && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+
+    vm.Stop();
+    runner.join();
+
+    ASSERT(memory.ReadLong(COUNTER) != counted, "Released hart didn't run again");
+
+    SUCCESS;
+}
+
+DEFINE_SERIAL_TESTCASE(RECLAIM_COPIES) {
+    constexpr Address BASE = 0x100000;
+    constexpr Address PAGE = Memory::PAGE_SIZE;
+    constexpr int COPIERS = 4;
+
+    SETUP_MEMORY;
+    ADD_RAM(BASE, COPIERS * PAGE);
+
+    // Device threads keep zeroing a page and filling it again, like the
+    // console does with its ring, while passes free it whenever it's zero
+    std::atomic<bool> done = false;
+    std::atomic<Long> lost = 0;
+
+    std::vector<std::jthread> copiers;
+    for (int copier = 0; copier < COPIERS; copier++) {
+        copiers.emplace_back([&, copier]() {
+            Address address = BASE + copier * PAGE;
+            std::vector<Byte> zeros(PAGE), filled(PAGE), read(PAGE);
+
+            for (Long round = 0; !done; round++) {
+                std::fill(filled.begin(), filled.end(), static_cast<Byte>(round % 255 + 1));
+
+                memory.WriteBytes(address, zeros);
+                memory.WriteBytes(address, filled);
+                memory.ReadBytes(address, read);
+
+                if (read != filled) lost++;
+            }
+        });
+    }
+
+    for (auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(Random<Long>(200, 400)); std::chrono::steady_clock::now() < end;)
+        memory.ReclaimZeroPages();
+
+    done = true;
+    copiers.clear();
+
+    ASSERT(lost == 0, "{} fills went into pages the pass freed", lost.load());
+
+    SUCCESS;
+}
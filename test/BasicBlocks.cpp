@@ -0,0 +1,38 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(BASIC_BLOCKS) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+    ADD_VM(1, 0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto count = Random<Word>(1, 0x100);
+    auto increment = Random<Word>(0, 0x7ff);
+    auto value = Random<Word>(0, 0x7ff);
+
+    memory.WriteWords(0x1000, {
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 1, RVInstruction::FUNCT3_ADDI, 0, count),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 2, RVInstruction::FUNCT3_ADDI, 2, increment),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 1, RVInstruction::FUNCT3_ADDI, 1, 0xfff),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BNE, 1, 0, 0x1ff8),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 3, RVInstruction::FUNCT3_ADDI, 0, value)
+    });
+
+    Long steps = 2 + count * 3;
+
+    vms[0].Step(steps);
+    vms[1].StepBlocks(steps);
+
+    for (size_t i = 0; i < VirtualMachine::REGISTER_COUNT; i++) {
+        auto expected = vms[0].GetRegister(i).Value().u64;
+        auto got = vms[1].GetRegister(i).Value().u64;
+
+        ASSERT(expected == got, "Register {} differs between engines. Expected {:x}, got {:x}", i, expected, got);
+    }
+
+    ASSERT(vms[0].GetPC() == vms[1].GetPC(), "PC differs between engines. Expected {:x}, got {:x}", vms[0].GetPC(), vms[1].GetPC());
+    ASSERT(vms[1].GetRegister(3).Value().u64 == value, "Block engine did not reach the end of the loop");
+
+    SUCCESS;
+}
@@ -0,0 +1,71 @@
+#include "Test.hpp"
+
+#include <bit>
+
+DEFINE_TESTCASE(BIT_MANIPULATION) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto a = Random<Long>(0, LONG_MAX) | (1ULL << 63);
+    auto b = Random<Long>(0, SLONG_MAX);
+    auto shift = Random<Word>(1, 63);
+
+    struct Case {
+        Type type;
+        Long expected;
+    };
+
+    std::vector<Case> cases = {
+        {Type::ADD_UW, (a & 0xffffffff) + b},
+        {Type::SH2ADD, (a << 2) + b},
+        {Type::SH3ADD_UW, ((a & 0xffffffff) << 3) + b},
+        {Type::SLLI_UW, (a & 0xffffffff) << shift},
+        {Type::ANDN, a & ~b},
+        {Type::XNOR, ~(a ^ b)},
+        {Type::CLZW, static_cast<Long>(std::countl_zero(static_cast<Word>(a)))},
+        {Type::CTZW, static_cast<Long>(std::countr_zero(static_cast<Word>(a)))},
+        {Type::CPOP, static_cast<Long>(std::popcount(a))},
+        {Type::MAX, b},
+        {Type::MINU, b},
+        {Type::SEXT_B, static_cast<Long>(static_cast<SByte>(a))},
+        {Type::ZEXT_H, a & 0xffff},
+        {Type::ROL, std::rotl(a, static_cast<int>(b & 63))},
+        {Type::RORI, std::rotr(a, static_cast<int>(shift))},
+        {Type::RORW, static_cast<Long>(static_cast<SWord>(std::rotr(static_cast<Word>(a), static_cast<int>(b & 31))))},
+        {Type::REV8, __builtin_bswap64(a)},
+        {Type::BEXT, (a >> (b & 63)) & 1},
+        {Type::BSETI, a | (1ULL << shift)},
+        {Type::BINV, a ^ (1ULL << (b & 63))}
+    };
+
+    // x1 and x2 hold the operands (unary ops read x1), each case writes its own register
+    std::vector<Word> program;
+    for (size_t i = 0; i < cases.size(); i++)
+        program.push_back(RVInstruction::Encode(cases[i].type, static_cast<Byte>(3 + i), 1, 2, shift));
+
+    memory.WriteWords(0x1000, program);
+
+    vm.GetRegister(1).Value().u64 = a;
+    vm.GetRegister(2).Value().u64 = b;
+
+    STEP_VMS(cases.size());
+
+    for (size_t i = 0; i < cases.size(); i++) {
+        auto got = vm.GetRegister(3 + i).Value().u64;
+        ASSERT(got == cases[i].expected, "{} of {:x}, {:x} gave {:x}, expected {:x}", RVInstruction::GetMnemonic(cases[i].type), a, b, got, cases[i].expected);
+    }
+
+    // ORC.B fills every nonzero byte
+    memory.WriteWord(0x1000 + program.size() * 4, RVInstruction::Encode(Type::ORC_B, 30, 31, 0, 0));
+    vm.GetRegister(31).Value().u64 = 0x0001'0000'8000'0300;
+
+    STEP_VMS(1);
+
+    ASSERT(vm.GetRegister(30).Value().u64 == 0x00ff'0000'ff00'ff00, "ORC.B gave {:x}", vm.GetRegister(30).Value().u64);
+
+    SUCCESS;
+}
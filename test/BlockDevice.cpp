@@ -0,0 +1,107 @@
+#include "Test.hpp"
+
+#include <BlockDevice.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+DEFINE_TESTCASE(BLOCK_DEVICE) {
+    constexpr Address SECTOR = MemoryBlockDevice::SECTOR_SIZE;
+    constexpr Address SECTORS = 64;
+
+    auto path = (std::filesystem::temp_directory_path() / "rv64_block_device_test.img").string();
+
+    std::vector<Byte> image(SECTORS * SECTOR);
+    for (auto& byte : image)
+        byte = Random<Byte>(0, 0xff);
+
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(image.data()), image.size());
+    }
+
+    constexpr Address RING = 0x2000;
+    constexpr Address READ_BUFFER = 0x3100;
+    constexpr Address WRITE_BUFFER = 0x8000;
+    constexpr Address REGS = MemoryBlockDevice::DEFAULT_BASE;
+
+    auto read_sector = Random<Long>(0, SECTORS - 16);
+    auto read_length = Random<Word>(1, 16) * SECTOR;
+    auto write_sector = Random<Long>(0, SECTORS - 1);
+
+    {
+        SETUP_MEMORY;
+        ADD_RAM(0x1000, 0x10000);
+        SETUP_VM(0x1000);
+
+        auto disk = MemoryBlockDevice::Create(path);
+        memory.AddMemoryRegion(disk);
+
+        ASSERT(memory.ReadLong(REGS + MemoryBlockDevice::CAPACITY_OFFSET) == SECTORS, "Disk holds {} sectors, expected {}", disk->GetCapacity(), SECTORS);
+
+        std::vector<Long> written(SECTOR / sizeof(Long));
+        for (auto& vlong : written)
+            vlong = Random<Long>(0, UINT64_MAX);
+
+        memory.WriteLongs(WRITE_BUFFER, written);
+
+        // A read crossing guest pages, a write and one past the end, in one batch
+        auto Describe = [&](Long index, Word op, Long sector, Address buffer, Word length) {
+            Address descriptor = RING + index * MemoryBlockDevice::DESCRIPTOR_SIZE;
+
+            memory.WriteWord(descriptor + MemoryBlockDevice::DESCRIPTOR_OP, op);
+            memory.WriteWord(descriptor + MemoryBlockDevice::DESCRIPTOR_STATUS, MemoryBlockDevice::STATUS_PENDING);
+            memory.WriteLong(descriptor + MemoryBlockDevice::DESCRIPTOR_SECTOR, sector);
+            memory.WriteLong(descriptor + MemoryBlockDevice::DESCRIPTOR_BUFFER, buffer);
+            memory.WriteWord(descriptor + MemoryBlockDevice::DESCRIPTOR_LENGTH, length);
+        };
+
+        Describe(0, MemoryBlockDevice::OP_READ, read_sector, READ_BUFFER, read_length);
+        Describe(1, MemoryBlockDevice::OP_WRITE, write_sector, WRITE_BUFFER, SECTOR);
+        Describe(2, MemoryBlockDevice::OP_READ, SECTORS, READ_BUFFER, SECTOR);
+
+        memory.WriteLong(REGS + MemoryBlockDevice::RING_ADDRESS_OFFSET, RING);
+        memory.WriteLong(REGS + MemoryBlockDevice::RING_SIZE_OFFSET, 4);
+        memory.WriteWord(REGS + MemoryBlockDevice::SUBMIT_OFFSET, 3);
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (memory.ReadLong(REGS + MemoryBlockDevice::COMPLETED_OFFSET) < 3 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::yield();
+
+        ASSERT(memory.ReadLong(REGS + MemoryBlockDevice::COMPLETED_OFFSET) == 3, "Only {} requests completed", memory.ReadLong(REGS + MemoryBlockDevice::COMPLETED_OFFSET));
+
+        auto Status = [&](Long index) { return memory.ReadWord(RING + index * MemoryBlockDevice::DESCRIPTOR_SIZE + MemoryBlockDevice::DESCRIPTOR_STATUS); };
+
+        ASSERT(Status(0) == MemoryBlockDevice::STATUS_OK && Status(1) == MemoryBlockDevice::STATUS_OK, "Requests finished with {} and {}", Status(0), Status(1));
+        ASSERT(Status(2) == MemoryBlockDevice::STATUS_ERROR, "Read past the end finished with {}", Status(2));
+
+        for (Address i = 0; i < read_length; i++)
+            ASSERT(memory.ReadByte(READ_BUFFER + i) == image[read_sector * SECTOR + i], "Read byte {:x} differs", i);
+
+        // The interrupt comes once the batch drains
+        while (memory.ReadLong(REGS + MemoryBlockDevice::INTERRUPT_OFFSET) == 0 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::yield();
+
+        std::unordered_map<Long, Long> csrs;
+        vm.GetCSRSnapshot(csrs);
+        ASSERT(csrs[VirtualMachine::CSR_MIP] & (1ULL << VirtualMachine::INTERRUPT_MACHINE_EXTERNAL), "Batch didn't raise the interrupt");
+
+        auto data = memory.ReadLongs(WRITE_BUFFER, written.size());
+        std::memcpy(image.data() + write_sector * SECTOR, data.data(), SECTOR);
+    }
+
+    std::vector<Byte> contents(image.size());
+    {
+        std::ifstream file(path, std::ios::binary);
+        file.read(reinterpret_cast<char*>(contents.data()), contents.size());
+    }
+
+    std::filesystem::remove(path);
+
+    ASSERT(contents == image, "Disk image differs after the write");
+
+    SUCCESS;
+}
@@ -0,0 +1,57 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(BREAKPOINTS) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+    ADD_VM(1, 0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Address BREAK = 0x1008;
+    constexpr Address WATCHED = 0x1800;
+
+    auto value = Random<Word>(1, 0x7ff);
+
+    memory.WriteWords(0x1000, {
+        RVInstruction::Encode(Type::ADDI, 1, 0, 0, value),
+        RVInstruction::Encode(Type::ADDI, 2, 0, 0, 2),
+        RVInstruction::Encode(Type::ADDI, 3, 0, 0, 3),
+        RVInstruction::Encode(Type::SD, 0, 4, 1, 0),
+        RVInstruction::Encode(Type::ADDI, 5, 0, 0, 5),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0)
+    });
+
+    for (auto& cur_vm : vms) {
+        cur_vm.GetRegister(4).Value().u64 = WATCHED;
+        cur_vm.SetBreakPoint(BREAK);
+    }
+
+    // The instruction engine and the block engine stop the same way
+    for (Hart hart = 0; hart < vms.size(); hart++) {
+        auto& cur_vm = vms[hart];
+        auto step = [&]() { return hart == 0 ? cur_vm.Step(100) : cur_vm.StepBlocks(100); };
+
+        ASSERT(step(), "Hart {} ran past the breakpoint", hart);
+        ASSERT(cur_vm.GetPC() == BREAK, "Hart {} stopped at {:x}, expected {:x}", hart, cur_vm.GetPC(), BREAK);
+        ASSERT(cur_vm.GetRegister(3).Value().u64 == 0, "Hart {} ran the instruction under the breakpoint", hart);
+
+        memory.AddWatchpoint({WATCHED, sizeof(Long), Memory::WatchKind::Write});
+
+        ASSERT(step(), "Hart {} ran past the watched store", hart);
+        ASSERT(cur_vm.GetPC() == BREAK + 8, "Hart {} stopped at {:x} after the store, expected {:x}", hart, cur_vm.GetPC(), BREAK + 8);
+
+        auto hit = cur_vm.TakeWatchHit();
+        ASSERT(hit && hit->address == WATCHED, "Hart {} gave no watchpoint hit", hart);
+        ASSERT(memory.ReadLong(WATCHED) == value, "Watched store wrote {:x}, expected {:x}", memory.ReadLong(WATCHED), value);
+
+        memory.RemoveWatchpoint({WATCHED, sizeof(Long), Memory::WatchKind::Write});
+        memory.WriteLong(WATCHED, 0);
+
+        ASSERT(!step(), "Hart {} stopped with nothing to stop on", hart);
+        ASSERT(cur_vm.GetRegister(5).Value().u64 == 5, "Hart {} did not run on after the watchpoint", hart);
+    }
+
+    SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include "Test.hpp"
+
+#include <Watchdog.hpp>
+
+#include <thread>
+
+namespace {
+    // Counts in t0 forever
+    const std::vector<Word> SPIN = {
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 5, 1),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BEQ, 0, 0, -4)
+    };
+}
+
+DEFINE_TESTCASE(BUDGETS) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x1000);
+
+    memory.WriteWords(0x1000, SPIN);
+
+    SETUP_VM(0x1000);
+
+    auto budget = Random<Long>(1, 5000);
+    auto extension = Random<Long>(1, 5000);
+    auto cycle_budget = Random<Long>(1, 5000);
+
+    std::vector<VirtualMachine::Budget> ran_out;
+
+    // The first time the hart gets more, the second time it stops
+    vm.SetBudgetHandler([&](VirtualMachine& hart, VirtualMachine::Budget kind) {
+        ran_out.push_back(kind);
+        if (ran_out.size() == 1) hart.SetInstructionBudget(extension);
+    });
+
+    vm.SetInstructionBudget(budget);
+    vm.Run();
+
+    auto ran = budget + extension;
+    ASSERT(ran_out.size() == 2, "The handler ran {} times", ran_out.size());
+    ASSERT(vm.GetCycles() == ran, "The hart ran {} cycles, expected {}", vm.GetCycles(), ran);
+    ASSERT(vm.GetRegister(5).Value().u64 == (ran + 1) / 2, "t0 counted {}, expected {}", vm.GetRegister(5).Value().u64, (ran + 1) / 2);
+    ASSERT(vm.GetInstructionsLeft() == Long(0), "The spent budget reads {}", vm.GetInstructionsLeft().value_or(-1));
+
+    // Still out of budget, so another start stops right away
+    vm.Start();
+    vm.Run();
+    ASSERT(vm.GetCycles() == ran && ran_out.size() == 3, "A hart out of budget ran {} more cycles", vm.GetCycles() - ran);
+
+    vm.SetInstructionBudget(0);
+    vm.SetCycleBudget(cycle_budget);
+    vm.Start();
+    vm.Run();
+
+    ASSERT(ran_out.back() == VirtualMachine::Budget::Cycles, "The cycle budget didn't run out");
+    ASSERT(vm.GetCycles() == ran + cycle_budget, "The hart ran {} cycles, expected {}", vm.GetCycles(), ran + cycle_budget);
+
+    SUCCESS;
+}
+
+DEFINE_SERIAL_TESTCASE(WATCHDOG) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x1000);
+
+    memory.WriteWords(0x1000, SPIN);
+
+    SETUP_VM(0x1000);
+
+    std::atomic<bool> handled = false;
+
+    {
+        Watchdog watchdog({&vm}, std::chrono::milliseconds(10), [&]() { handled = true; });
+
+        std::jthread hart([&]() { vm.Run(); });
+
+        // Kicked in time, the watchdog keeps waiting
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        watchdog.Kick(std::chrono::milliseconds(20));
+        ASSERT(!watchdog.HasFired(), "The watchdog fired before its deadline");
+
+        hart.join();
+        ASSERT(watchdog.HasFired() && handled, "The hart stopped without the watchdog");
+        ASSERT(!vm.IsRunning(), "The hart is still running");
+    }
+
+    // Destroyed before the deadline, it lets the harts be
+    vm.Start();
+    {
+        Watchdog watchdog({&vm}, std::chrono::hours(1));
+    }
+
+    ASSERT(vm.IsRunning(), "A disarmed watchdog stopped the hart");
+
+    SUCCESS;
+}
@@ -0,0 +1,55 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(CLINT) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto clint = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+    ASSERT(clint, "Hart did not create a CLINT");
+
+    clint->SetClockSource(MemoryCLINT::ClockSource::Instructions);
+    clint->SetTime(0);
+
+    auto deadline = Random<Long>(2, 100);
+
+    vm.GetRegister(1).Value().u64 = deadline;
+    vm.GetRegister(2).Value().u64 = MemoryCLINT::DEFAULT_BASE + MemoryCLINT::MTIMECMP_OFFSET;
+
+    memory.WriteWords(0x1000, {
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 2, 1, 0),
+        RV64_I(RVInstruction::OP_CSR, 3, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_MIP),
+        RV64_I(RVInstruction::OP_CSR, 4, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_TIME),
+        RV64_J(RVInstruction::OP_JAL, 0, 0)
+    });
+
+    constexpr Long MTIP = 1ULL << VirtualMachine::INTERRUPT_MACHINE_TIMER;
+
+    // Time is counted in retired instructions, so the deadline lands on an
+    // exact instruction
+    vm.Step(deadline * MemoryCLINT::INSTRUCTIONS_PER_TICK - 1);
+
+    ASSERT((vm.GetRegister(3).Value().u64 & MTIP) == 0, "Timer was pending before mtimecmp was reached");
+    ASSERT(vm.GetRegister(4).Value().u64 == 0, "time read as {} after 3 instructions", vm.GetRegister(4).Value().u64);
+
+    auto time = clint->GetTime();
+    ASSERT(time == deadline - 1, "Expected time {}, got {}", deadline - 1, time);
+
+    std::unordered_map<Long, Long> csrs;
+    vm.GetCSRSnapshot(csrs);
+    ASSERT((csrs[VirtualMachine::CSR_MIP] & MTIP) == 0, "Timer fired one instruction early");
+
+    vm.Step(1);
+
+    vm.GetCSRSnapshot(csrs);
+    ASSERT(csrs[VirtualMachine::CSR_MIP] & MTIP, "Timer did not fire at time {}", clint->GetTime());
+
+    // Moving the deadline forward clears the pending timer
+    memory.WriteLong(MemoryCLINT::DEFAULT_BASE + MemoryCLINT::MTIMECMP_OFFSET, deadline * 2);
+
+    vm.GetCSRSnapshot(csrs);
+    ASSERT((csrs[VirtualMachine::CSR_MIP] & MTIP) == 0, "Writing mtimecmp did not clear the timer");
+
+    SUCCESS;
+}
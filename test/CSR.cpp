@@ -0,0 +1,38 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(CSR) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto fcsr = Random<Long>(0, 0x100);
+    auto frm = Random<Long>(0, 0b1000);
+
+    vm.GetRegister(1).Value().u64 = fcsr;
+    vm.GetRegister(4).Value().u64 = frm;
+
+    memory.WriteWords(0x1000, {
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 1, VirtualMachine::CSR_FCSR),
+        RV64_I(RVInstruction::OP_CSR, 2, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_FFLAGS),
+        RV64_I(RVInstruction::OP_CSR, 3, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_FRM),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 4, VirtualMachine::CSR_FRM),
+        RV64_I(RVInstruction::OP_CSR, 5, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_FCSR),
+        RV64_I(RVInstruction::OP_CSR, 6, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_MHARTID)
+    });
+
+    STEP_VMS(6);
+
+    auto fflags = vm.GetRegister(2).Value().u64;
+    ASSERT(fflags == (fcsr & 0x1f), "fflags expected {:x}, got {:x}", fcsr & 0x1f, fflags);
+
+    auto old_frm = vm.GetRegister(3).Value().u64;
+    ASSERT(old_frm == (fcsr >> 5), "frm expected {:x}, got {:x}", fcsr >> 5, old_frm);
+
+    auto new_fcsr = vm.GetRegister(5).Value().u64;
+    ASSERT(new_fcsr == ((frm << 5) | (fcsr & 0x1f)), "Writing frm left fcsr at {:x}", new_fcsr);
+
+    ASSERT(vm.GetRegister(6).Value().u64 == 0, "mhartid of hart 0 read as {:x}", vm.GetRegister(6).Value().u64);
+
+    SUCCESS;
+}
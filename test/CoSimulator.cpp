@@ -0,0 +1,111 @@
+#include "Test.hpp"
+
+#include <CoSimulator.hpp>
+
+DEFINE_SERIAL_TESTCASE(CO_SIMULATOR) {
+    using Type = RVInstruction::Type;
+    using Regs = std::array<VirtualMachine::Reg, VirtualMachine::REGISTER_COUNT>;
+    using FRegs = std::array<Float, VirtualMachine::REGISTER_COUNT>;
+
+    constexpr Long ECALL_STOP = 0x2af;
+    constexpr Long ECALL_ENGINE = 0x2b0;
+    constexpr Address DATA = 0x3000;
+
+    auto loops = Random<Word>(50, 300);
+
+    // Stops the copy the call came from, every memory has its own CLINT
+    VirtualMachine::RegisterECall(ECALL_STOP, [](Hart hart, bool, Memory& memory, Regs&, FRegs&) {
+        memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT)->GetHart(hart)->Stop();
+    });
+
+    // Behaves like a bug in the fast engine when asked to. Handlers outlive
+    // the test, so the flag is shared rather than borrowed
+    auto tell_engines = std::make_shared<bool>(false);
+    VirtualMachine::RegisterECall(ECALL_ENGINE, [tell_engines](Hart hart, bool, Memory& memory, Regs& regs, FRegs&) {
+        auto vm = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT)->GetHart(hart);
+        regs[11].u64 = *tell_engines && vm->UsesBasicBlocks() ? 1 : 0;
+    });
+
+    constexpr Address ENGINE_CALL = 0x1000 + 8 * 4;
+
+    std::vector<Word> program = {
+        RVInstruction::Encode(Type::ADDI, 6, 0, 0, loops),
+        RVInstruction::Encode(Type::LUI, 8, 0, 0, DATA),
+        RVInstruction::Encode(Type::ADD, 5, 5, 6, 0),
+        RVInstruction::Encode(Type::SD, 0, 8, 5, 0),
+        RVInstruction::Encode(Type::ADDI, 8, 8, 0, 8),
+        RVInstruction::Encode(Type::ADDI, 6, 6, 0, -1),
+        RVInstruction::Encode(Type::BNE, 0, 6, 0, -16),
+        RVInstruction::Encode(Type::ADDI, 10, 0, 0, ECALL_ENGINE),
+        RVInstruction::Encode(Type::ECALL, 0, 0, 0, 0),
+        RVInstruction::Encode(Type::ADD, 5, 5, 11, 0),
+        RVInstruction::Encode(Type::ADDI, 10, 0, 0, ECALL_STOP),
+        RVInstruction::Encode(Type::ECALL, 0, 0, 0, 0)
+    };
+
+    CoSimulator::Options options;
+    options.interval = Random<Long>(1, 100);
+
+    // Returns the divergence if any, with how many intervals agreed and
+    // whether the stores all landed
+    struct Result {
+        std::optional<CoSimulator::Divergence> divergence;
+        Long checkpoints = 0;
+        bool stored = true;
+    };
+
+    auto RunOnce = [&](auto&& between) {
+        SETUP_MEMORY;
+        SETUP_VM(0x1000);
+
+        ADD_RAM(0x1000, 0x4000);
+        memory.WriteWords(0x1000, program);
+
+        vm.SetUseBasicBlocks(true);
+
+        CoSimulator cosim(vm, memory, options);
+
+        Long runs = 0;
+        while (cosim.Run(options.interval)) {
+            between(vm, runs++);
+        }
+
+        Result result{cosim.GetDivergence(), cosim.GetCheckpoints()};
+
+        Long sum = 0;
+        for (Word i = loops; i > 0; i--) {
+            sum += i;
+            result.stored &= memory.ReadLong(DATA + (loops - i) * sizeof(Long)) == sum;
+        }
+
+        return result;
+    };
+
+    // Both engines agree on the whole run
+    auto result = RunOnce([](VirtualMachine&, Long) {});
+    auto& divergence = result.divergence;
+
+    ASSERT(!divergence, "Engines diverged at {:x}: {}", divergence ? divergence->pc : 0, divergence ? divergence->difference : "");
+    ASSERT(result.checkpoints > 0 && result.stored, "Agreed on {} intervals, stores landed: {}", result.checkpoints, result.stored);
+
+    // An instruction that only goes wrong on the fast engine is found
+    *tell_engines = true;
+    result = RunOnce([](VirtualMachine&, Long) {});
+
+    ASSERT(divergence && divergence->pinpointed, "Engine dependent call wasn't pinpointed");
+    ASSERT(divergence->pc == ENGINE_CALL, "Diverged at {:x}, expected {:x}", divergence->pc, ENGINE_CALL);
+    ASSERT(divergence->encoding == program[8], "Diverged on {:x}, expected an ECALL", divergence->encoding);
+    ASSERT(divergence->difference.starts_with("x11"), "Difference was {}", divergence->difference);
+
+    // State changed behind the harness can't be replayed, so the interval it
+    // showed up in is reported
+    *tell_engines = false;
+    result = RunOnce([](VirtualMachine& vm, Long runs) {
+        if (runs == 0) vm.GetRegister(7).Value().u64 = 1;
+    });
+
+    ASSERT(divergence && !divergence->pinpointed, "Changed register wasn't reported unpinpointed");
+    ASSERT(divergence->difference.starts_with("x7"), "Difference was {}", divergence->difference);
+
+    SUCCESS;
+}
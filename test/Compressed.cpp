@@ -0,0 +1,84 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(COMPRESSED) {
+    std::vector<std::pair<Half, Word>> expansions = {
+        {0x0505, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 10, 1)},
+        {0x1141, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 2, RVInstruction::FUNCT3_ADDI, 2, -16)},
+        {0x8082, RV64_I(RVInstruction::OP_JALR, 0, RVInstruction::FUNCT3_JALR, 1, 0)},
+        {0x9002, 0x00100073},
+        {0xe406, RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 2, 1, 8)},
+        {0x0000, 0},
+        {0x6001, 0}
+    };
+
+    for (auto [half, word] : expansions)
+        ASSERT(RVInstruction::Expand(half) == word, "{:04x} expanded to {:08x}, expected {:08x}", half, RVInstruction::Expand(half), word);
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+    ADD_VM(1, 0x1000);
+
+    ADD_RAM(0x1000, 0x10000);
+
+    constexpr Address root = 0x8000;
+    constexpr Address l1 = 0x9000;
+    constexpr Address l0 = 0xa000;
+    constexpr Address next_page = 0x5000;
+
+    constexpr Long V = 1 << 0, R = 1 << 1, X = 1 << 3, A = 1 << 6;
+
+    auto Pointer = [](Address table) { return (table >> 12) << 10 | V; };
+    auto Leaf = [](Address page) { return (page >> 12) << 10 | R | X | V | A; };
+
+    // Virtual 0x2000 is identity mapped but 0x3000 is backed by 0x5000, so
+    // an instruction crossing between them has its halves apart
+    memory.WriteLong(root, Pointer(l1));
+    memory.WriteLong(l1, Pointer(l0));
+    memory.WriteLong(l0 + 2 * 8, Leaf(0x2000));
+    memory.WriteLong(l0 + 3 * 8, Leaf(next_page));
+
+    for (auto& hart : vms) {
+        hart.GetRegister(5).Value().u64 = (8ULL << 60) | (root >> 12);
+        hart.GetRegister(6).Value().u64 = 0x2ff8;
+        hart.GetRegister(7).Value().u64 = 1 << 11;
+    }
+
+    memory.WriteWords(0x1000, {
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 5, VirtualMachine::CSR_SATP),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 6, VirtualMachine::CSR_MEPC),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 7, VirtualMachine::CSR_MSTATUS),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_MRET)
+    });
+
+    auto straddling = RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 11, RVInstruction::FUNCT3_ADDI, 10, 100);
+
+    memory.WriteHalf(0x2ff8, 0x4515); // C.LI a0, 5
+    memory.WriteHalf(0x2ffa, 0x050d); // C.ADDI a0, 3
+    memory.WriteHalf(0x2ffc, 0x0001); // C.NOP
+    memory.WriteHalf(0x2ffe, static_cast<Half>(straddling));
+    memory.WriteHalf(next_page, static_cast<Half>(straddling >> 16));
+    memory.WriteHalf(next_page + 0x2, 0x95aa); // C.ADD a1, a0
+    memory.WriteHalf(next_page + 0x4, 0xe199); // C.BNEZ a1, +6
+    memory.WriteHalf(next_page + 0x6, 0x4605); // C.LI a2, 1
+    memory.WriteHalf(next_page + 0x8, 0x4609); // C.LI a2, 2
+    memory.WriteHalf(next_page + 0xa, 0x0001); // C.NOP
+    memory.WriteWord(next_page + 0xc, RV64_J(RVInstruction::OP_JAL, 1, 6));
+    memory.WriteHalf(next_page + 0x10, 0x469d); // C.LI a3, 7
+    memory.WriteHalf(next_page + 0x12, 0x4725); // C.LI a4, 9
+
+    constexpr Long steps = 4 + 9;
+
+    vms[0].Step(steps);
+    vms[1].StepBlocks(steps);
+
+    for (auto& hart : vms) {
+        ASSERT(hart.GetRegister(10).Value().u64 == 8, "a0 is {}", hart.GetRegister(10).Value().u64);
+        ASSERT(hart.GetRegister(11).Value().u64 == 116, "Straddling ADDI left a1 at {}", hart.GetRegister(11).Value().u64);
+        ASSERT(hart.GetRegister(12).Value().u64 == 0, "C.BNEZ fell through");
+        ASSERT(hart.GetRegister(1).Value().u64 == 0x3010, "JAL linked {:x}", hart.GetRegister(1).Value().u64);
+        ASSERT(hart.GetRegister(13).Value().u64 == 0 && hart.GetRegister(14).Value().u64 == 9, "JAL landed wrong");
+        ASSERT(hart.GetPC() == 0x3014, "pc ended at {:x}", hart.GetPC());
+    }
+
+    SUCCESS;
+}
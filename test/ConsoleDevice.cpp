@@ -0,0 +1,70 @@
+#include "Test.hpp"
+
+#include <ConsoleDevice.hpp>
+
+DEFINE_TESTCASE(CONSOLE_DEVICE) {
+    constexpr Address OUTPUT_RING = 0x2000;
+    constexpr Address OUTPUT_SIZE = 16;
+    constexpr Address INPUT_RING = 0x2100;
+    constexpr Address INPUT_SIZE = 8;
+    constexpr Address REGS = MemoryConsole::DEFAULT_BASE;
+
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x2000);
+
+    // Flush orders the sink's writes before the checks
+    std::string drained;
+    auto console = MemoryConsole::Create([&](std::string_view text) { drained.append(text); });
+    memory.AddMemoryRegion(console);
+
+    memory.WriteLong(REGS + MemoryConsole::OUTPUT_RING_OFFSET, OUTPUT_RING);
+    memory.WriteLong(REGS + MemoryConsole::OUTPUT_SIZE_OFFSET, OUTPUT_SIZE);
+
+    std::string text;
+    for (int i = 0; i < 40; i++)
+        text.push_back(Random<char>('a', 'z'));
+
+    // Published in uneven pieces through the low word, like a 32 bit guest,
+    // so the ring wraps part way through some of them
+    Word head = 0;
+    for (size_t at = 0; at < text.size();) {
+        auto piece = std::min<size_t>(Random<size_t>(1, OUTPUT_SIZE), text.size() - at);
+
+        for (size_t i = 0; i < piece; i++, head++)
+            memory.WriteByte(OUTPUT_RING + head % OUTPUT_SIZE, text[at + i]);
+
+        memory.WriteWord(REGS + MemoryConsole::OUTPUT_HEAD_OFFSET, head);
+        console->Flush();
+
+        at += piece;
+
+        auto tail = memory.ReadWord(REGS + MemoryConsole::OUTPUT_TAIL_OFFSET);
+        ASSERT(tail == head, "Output tail at {} after a flush, expected {}", tail, head);
+    }
+
+    ASSERT(drained == text, "Console drained \"{}\", expected \"{}\"", drained, text);
+
+    // Input queued before the ring exists waits for it, then fills it up
+    console->PushInput("hello world\n");
+    ASSERT(memory.ReadLong(REGS + MemoryConsole::INPUT_HEAD_OFFSET) == 0, "Input went in before the guest set up a ring");
+
+    memory.WriteLong(REGS + MemoryConsole::INPUT_RING_OFFSET, INPUT_RING);
+    memory.WriteLong(REGS + MemoryConsole::INPUT_SIZE_OFFSET, INPUT_SIZE);
+
+    auto input_head = memory.ReadLong(REGS + MemoryConsole::INPUT_HEAD_OFFSET);
+    ASSERT(input_head == INPUT_SIZE, "Input head at {}, expected a full ring of {}", input_head, INPUT_SIZE);
+
+    // Consuming five bytes lets the last four in over the start of the ring
+    memory.WriteLong(REGS + MemoryConsole::INPUT_TAIL_OFFSET, 5);
+
+    input_head = memory.ReadLong(REGS + MemoryConsole::INPUT_HEAD_OFFSET);
+    ASSERT(input_head == 12, "Input head at {} after the guest consumed, expected 12", input_head);
+
+    std::string ring(INPUT_SIZE, 0);
+    memory.ReadBytes(INPUT_RING, std::span(reinterpret_cast<Byte*>(ring.data()), ring.size()));
+    ASSERT(ring == std::string("rld\no wo", INPUT_SIZE), "Input ring holds \"{}\"", ring);
+
+    ASSERT(memory.ReadLong(REGS + MemoryConsole::INPUT_CLOSED_OFFSET) == 0, "Input closed without a source");
+
+    SUCCESS;
+}
@@ -0,0 +1,67 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(COUNTERS) {
+    auto loops = Random<Long>(2, 200);
+    auto instret = Random<Long>(1000, 1ULL << 40);
+    auto mcycle = Random<Long>(1000, 1ULL << 40);
+
+    std::vector<Word> program = {
+        RV64_I(RVInstruction::OP_CSR, 5, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_CYCLE),
+        RV64_I(RVInstruction::OP_CSR, 6, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_INSTRET),
+        RV64_I(RVInstruction::OP_CSR, 7, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_TIME),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 8, RVInstruction::FUNCT3_ADDI, 8, 1),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BNE, 8, 9, -16),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 10, VirtualMachine::CSR_MINSTRET),
+        RV64_I(RVInstruction::OP_CSR, 11, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_INSTRET),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 12, VirtualMachine::CSR_MCYCLE),
+        RV64_I(RVInstruction::OP_CSR, 13, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_INSTRET),
+        RV64_I(RVInstruction::OP_CSR, 14, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_CYCLE),
+        RV64_J(RVInstruction::OP_JAL, 0, 0)
+    };
+
+    // The interpreter and basic blocks, where counter reads don't end the
+    // block, must read the same values
+    for (bool blocks : {false, true}) {
+        SETUP_MEMORY;
+        SETUP_VM(0x1000);
+
+        ADD_RAM(0x1000, 0x1000);
+        memory.WriteWords(0x1000, program);
+
+        auto clint = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+        clint->SetClockSource(MemoryCLINT::ClockSource::Instructions);
+        clint->SetTime(0);
+
+        vm.GetRegister(9).Value().u64 = loops;
+        vm.GetRegister(10).Value().u64 = instret;
+        vm.GetRegister(12).Value().u64 = mcycle;
+
+        Long steps = loops * 5 + 5;
+        if (blocks) vm.StepBlocks(steps);
+        else vm.Step(steps);
+
+        auto Reg = [&](size_t reg) { return vm.GetRegister(reg).Value().u64; };
+
+        // A read counts the instruction doing it, and nothing stalled
+        Long last_cycle = (loops - 1) * 5 + 1;
+        ASSERT(Reg(5) == last_cycle, "Blocks {}: cycle read {}, expected {}", blocks, Reg(5), last_cycle);
+        ASSERT(Reg(6) == last_cycle + 1, "Blocks {}: instret read {}, expected {}", blocks, Reg(6), last_cycle + 1);
+
+        Long time = (last_cycle + 2) / MemoryCLINT::INSTRUCTIONS_PER_TICK;
+        ASSERT(Reg(7) == time, "Blocks {}: time read {}, expected {}", blocks, Reg(7), time);
+
+        // minstret counts on from what was written, and writing mcycle
+        // leaves it alone
+        ASSERT(Reg(11) == instret + 1, "Blocks {}: instret read {} after writing {}", blocks, Reg(11), instret);
+        ASSERT(Reg(13) == instret + 3, "Blocks {}: instret read {} after writing mcycle", blocks, Reg(13));
+        ASSERT(Reg(14) == mcycle + 2, "Blocks {}: cycle read {} after writing {}", blocks, Reg(14), mcycle);
+
+        // The upper halves RV32 reads
+        std::unordered_map<Long, Long> csrs;
+        vm.GetCSRSnapshot(csrs);
+        ASSERT(csrs[VirtualMachine::CSR_CYCLEH] == csrs[VirtualMachine::CSR_CYCLE] >> 32, "cycleh is {:x} with cycle {:x}", csrs[VirtualMachine::CSR_CYCLEH], csrs[VirtualMachine::CSR_CYCLE]);
+        ASSERT(csrs[VirtualMachine::CSR_INSTRETH] == csrs[VirtualMachine::CSR_INSTRET] >> 32, "instreth is {:x} with instret {:x}", csrs[VirtualMachine::CSR_INSTRETH], csrs[VirtualMachine::CSR_INSTRET]);
+    }
+
+    SUCCESS;
+}
@@ -0,0 +1,73 @@
+#include "Test.hpp"
+
+#include <DMA.hpp>
+
+DEFINE_TESTCASE(DMA) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x10000);
+
+    auto dma = MemoryDMA::Create();
+    memory.AddMemoryRegion(dma);
+
+    SETUP_VM(0x1000);
+
+    constexpr Address SOURCE = 0x2100;
+    constexpr Address DESTINATION = 0x6080;
+    constexpr Address REGS = MemoryDMA::DEFAULT_BASE;
+
+    // Crosses pages on both sides at different offsets
+    auto count = Random<Address>(0x400, 0x800);
+
+    std::vector<Long> data(count);
+    for (auto& vlong : data)
+        vlong = Random<Long>(0, UINT64_MAX);
+
+    memory.WriteLongs(SOURCE, data);
+
+    memory.WriteLong(REGS + MemoryDMA::SOURCE_OFFSET, SOURCE);
+    memory.WriteLong(REGS + MemoryDMA::DESTINATION_OFFSET, DESTINATION);
+    memory.WriteLong(REGS + MemoryDMA::LENGTH_OFFSET, count * sizeof(Long));
+    memory.WriteLong(REGS + MemoryDMA::INTERRUPT_HART_OFFSET, 0);
+    memory.WriteLong(REGS + MemoryDMA::CONTROL_OFFSET, MemoryDMA::COMMAND_COPY | MemoryDMA::CONTROL_INTERRUPT);
+
+    ASSERT(memory.ReadLong(REGS + MemoryDMA::STATUS_OFFSET) == MemoryDMA::STATUS_DONE, "Copy finished with status {}", memory.ReadLong(REGS + MemoryDMA::STATUS_OFFSET));
+    ASSERT(memory.ReadLongs(DESTINATION, count) == data, "Copied data differs");
+
+    constexpr Long MEIP = 1ULL << VirtualMachine::INTERRUPT_MACHINE_EXTERNAL;
+
+    std::unordered_map<Long, Long> csrs;
+    vm.GetCSRSnapshot(csrs);
+    ASSERT(csrs[VirtualMachine::CSR_MIP] & MEIP, "Copy didn't raise its interrupt");
+
+    memory.WriteLong(REGS + MemoryDMA::STATUS_OFFSET, MemoryDMA::STATUS_IDLE);
+    vm.GetCSRSnapshot(csrs);
+    ASSERT(!(csrs[VirtualMachine::CSR_MIP] & MEIP), "Clearing STATUS left the interrupt pending");
+
+    // Overlapping copies behave like memmove, filled a word at a time by a
+    // 32 bit guest
+    memory.WriteWord(REGS + MemoryDMA::SOURCE_OFFSET, DESTINATION);
+    memory.WriteWord(REGS + MemoryDMA::DESTINATION_OFFSET, DESTINATION + 0x18);
+    memory.WriteWord(REGS + MemoryDMA::CONTROL_OFFSET, MemoryDMA::COMMAND_COPY);
+
+    ASSERT(memory.ReadLongs(DESTINATION + 0x18, count) == data, "Overlapping copy corrupted the data");
+
+    auto fill = Random<Byte>(1, 0xff);
+    auto before = memory.ReadByte(DESTINATION + 2);
+
+    memory.WriteLong(REGS + MemoryDMA::FILL_OFFSET, fill);
+    memory.WriteLong(REGS + MemoryDMA::DESTINATION_OFFSET, DESTINATION + 3);
+    memory.WriteLong(REGS + MemoryDMA::LENGTH_OFFSET, 0x1001);
+    memory.WriteLong(REGS + MemoryDMA::CONTROL_OFFSET, MemoryDMA::COMMAND_FILL);
+
+    ASSERT(memory.ReadByte(DESTINATION + 2) == before, "Fill started early");
+    for (Address i = 0; i < 0x1001; i++)
+        ASSERT(memory.ReadByte(DESTINATION + 3 + i) == fill, "Fill missed byte {:x}", i);
+
+    // Unmapped destinations report an error instead of faulting the store
+    memory.WriteLong(REGS + MemoryDMA::DESTINATION_OFFSET, 0x80000);
+    memory.WriteLong(REGS + MemoryDMA::CONTROL_OFFSET, MemoryDMA::COMMAND_FILL);
+
+    ASSERT(memory.ReadLong(REGS + MemoryDMA::STATUS_OFFSET) == MemoryDMA::STATUS_ERROR, "Unmapped fill finished with status {}", memory.ReadLong(REGS + MemoryDMA::STATUS_OFFSET));
+
+    SUCCESS;
+}
@@ -0,0 +1,53 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(DECODER) {
+    // Every encoding decodes back to its own type and operands
+    for (size_t i = 0; i < RVInstruction::TYPE_COUNT; i++) {
+        auto type = static_cast<RVInstruction::Type>(i);
+        if (type == RVInstruction::Type::INVALID) continue;
+
+        auto rd = Random<Byte>(0, 31);
+        auto rs1 = Random<Byte>(0, 31);
+        auto rs2 = Random<Byte>(0, 31);
+        auto rs3 = Random<Byte>(0, 31);
+        auto rm = Random<Byte>(0, 7);
+        auto immediate = Random<SLong>(-2048, 2047);
+
+        auto word = RVInstruction::Encode(type, rd, rs1, rs2, immediate, rs3, rm);
+        auto instr = RVInstruction::FromUInt32(word);
+        ASSERT(instr.type == type, "{:08x} encoded as {} decoded as {}", word, RVInstruction::GetMnemonic(type), RVInstruction::GetMnemonic(instr.type));
+
+        auto again = RVInstruction::Encode(instr.type, instr.rd, instr.rs1, instr.rs2, instr.s_immediate, instr.rs3, instr.rm);
+        ASSERT(again == word, "{} re-encoded {:08x} as {:08x}", RVInstruction::GetMnemonic(type), word, again);
+    }
+
+    // Immediates are sign extended per format
+    auto branch = RVInstruction::FromUInt32(RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BNE, 1, 2, -4096));
+    ASSERT(branch.type == RVInstruction::Type::BNE && branch.s_immediate == -4096, "BNE offset {}", branch.s_immediate);
+
+    auto jump = RVInstruction::FromUInt32(RV64_J(RVInstruction::OP_JAL, 1, 0x1ffffe));
+    ASSERT(jump.s_immediate == -2, "JAL offset {}", jump.s_immediate);
+
+    auto store = RVInstruction::FromUInt32(RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 2, 3, -1));
+    ASSERT(store.s_immediate == -1, "SD offset {}", store.s_immediate);
+
+    auto lui = RVInstruction::FromUInt32(RV64_U(RVInstruction::OP_LUI, 5, 0x80000));
+    ASSERT(lui.s_immediate == -0x80000000LL, "LUI immediate {:x}", lui.immediate);
+
+    auto csr = RVInstruction::FromUInt32(RV64_I(RVInstruction::OP_CSR, 1, RVInstruction::FUNCT3_CSRRS, 0, 0xf14));
+    ASSERT(csr.immediate == 0xf14, "CSR number {:x}", csr.immediate);
+
+    // Words the spec reserves stay invalid
+    std::vector<Word> reserved = {
+        RV64_R(RVInstruction::OP_MATH_W, 1, RVInstruction::FUNCT3_SLTU_MULHU, 2, 3, 0),
+        RV64_R(RVInstruction::OP_MATH, 1, RVInstruction::FUNCT3_ADD_SUB_MUL, 2, 3, 0b0000010),
+        RV64_I(RVInstruction::OP_MATH_W_IMMEDIATE, 1, RVInstruction::FUNCT3_SHIFT_RIGHT_IMMEDIATE, 2, 0b010000 << 5),
+        RV64_I(RVInstruction::OP_JALR, 1, 0b001, 2, 0),
+        0
+    };
+
+    for (auto word : reserved)
+        ASSERT(RVInstruction::FromUInt32(word).type == RVInstruction::Type::INVALID, "{:08x} decoded as {}", word, RVInstruction::GetMnemonic(RVInstruction::FromUInt32(word).type));
+
+    SUCCESS;
+}
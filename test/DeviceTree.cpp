@@ -0,0 +1,113 @@
+#include "Test.hpp"
+
+#include <DeviceTree.hpp>
+#include <PLIC.hpp>
+
+DEFINE_TESTCASE(DeviceTree) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x100000);
+
+    memory.AddMemoryRegion(MemoryPLIC::Create());
+
+    SETUP_VM(0x1000);
+    ADD_VM(1, 0x1000);
+
+    DeviceTree::Options options;
+    options.harts = 2;
+    options.bootargs = "console=hvc0";
+
+    auto blob = DeviceTree::Generate(memory, options);
+
+    auto Cell = [&](size_t offset) {
+        return (Word(blob[offset]) << 24) | (Word(blob[offset + 1]) << 16) | (Word(blob[offset + 2]) << 8) | blob[offset + 3];
+    };
+
+    ASSERT(Cell(0) == DeviceTree::MAGIC, "Blob starts with {:x}", Cell(0));
+    ASSERT(Cell(4) == blob.size(), "Header gives {} bytes for a {} byte blob", Cell(4), blob.size());
+    ASSERT(Cell(20) == DeviceTree::VERSION, "Blob is version {}", Cell(20));
+
+    auto structure = Cell(8);
+    auto strings = Cell(12);
+
+    // Walks the structure block, noting every node path and the cells of
+    // the properties asked about
+    std::vector<std::string> path;
+    std::vector<std::string> nodes;
+    std::unordered_map<std::string, std::vector<Word>> cells;
+    std::unordered_map<std::string, std::string> texts;
+
+    size_t at = structure;
+    bool ended = false;
+    while (at + 4 <= blob.size() && !ended) {
+        Word token = Cell(at);
+        at += 4;
+
+        switch (token) {
+            case DeviceTree::TOKEN_BEGIN_NODE: {
+                std::string name(reinterpret_cast<const char*>(&blob[at]));
+                at += (name.size() + 4) & ~3ULL;
+
+                path.push_back(name);
+
+                std::string full;
+                for (auto& part : path) full += part + "/";
+                nodes.push_back(full);
+                break;
+            }
+
+            case DeviceTree::TOKEN_END_NODE:
+                path.pop_back();
+                break;
+
+            case DeviceTree::TOKEN_PROP: {
+                Word length = Cell(at);
+                std::string name(reinterpret_cast<const char*>(&blob[strings + Cell(at + 4)]));
+                at += 8;
+
+                auto key = nodes.back() + name;
+                for (Word i = 0; i + 4 <= length; i += 4)
+                    cells[key].push_back(Cell(at + i));
+
+                texts[key] = std::string(reinterpret_cast<const char*>(&blob[at]), length);
+                at += (length + 3) & ~3ULL;
+                break;
+            }
+
+            case DeviceTree::TOKEN_END:
+                ended = true;
+                break;
+
+            default:
+                FAILURE("Unknown token {} at {:x}", token, at - 4);
+        }
+    }
+
+    ASSERT(ended && path.empty(), "Structure block didn't end cleanly");
+
+    auto memory_reg = cells["/memory@1000/reg"];
+    ASSERT(memory_reg.size() == 4 && memory_reg[1] == 0x1000 && memory_reg[3] == 0x100000, "RAM node has the wrong reg");
+
+    ASSERT(std::count(nodes.begin(), nodes.end(), "/cpus/cpu@1/") == 1, "No node for hart 1");
+    ASSERT(cells["/cpus/timebase-frequency"] == std::vector<Word>{MemoryCLINT::TICKS_PER_SECOND}, "Timebase isn't the CLINT's tick rate");
+    ASSERT(texts["/chosen/bootargs"] == std::string("console=hvc0", 13), "Bootargs read {}", texts["/chosen/bootargs"]);
+
+    // Both harts' machine and supervisor external lines go to the PLIC
+    auto contexts = cells[std::format("/soc/interrupt-controller@{:x}/interrupts-extended", MemoryPLIC::DEFAULT_BASE)];
+    ASSERT(contexts.size() == 8 && contexts[1] == VirtualMachine::INTERRUPT_MACHINE_EXTERNAL && contexts[3] == VirtualMachine::INTERRUPT_SUPERVISOR_EXTERNAL, "PLIC wiring has {} cells", contexts.size());
+
+    auto clint_lines = cells[std::format("/soc/clint@{:x}/interrupts-extended", MemoryCLINT::DEFAULT_BASE)];
+    ASSERT(clint_lines.size() == 8 && clint_lines[4] == contexts[4], "CLINT wiring doesn't match hart 1's controller");
+
+    // Every start hands the guest its hart id and the tree
+    memory.AddMemoryRegion(DeviceTree::CreateROM(memory, options));
+    vms[1].SetDeviceTree(DeviceTree::DEFAULT_BASE);
+    memory.WriteWords(0x1000, {RVInstruction::Encode(RVInstruction::Type::ADDI, 0, 0, 0, 0)});
+    vms[1].RequestStart(0x1000);
+    vms[1].Step(1);
+
+    ASSERT(vms[1].GetRegister(10).Value().u64 == 1, "a0 isn't the hart id");
+    ASSERT(vms[1].GetRegister(11).Value().u64 == DeviceTree::DEFAULT_BASE, "a1 doesn't point at the tree");
+    ASSERT(memory.ReadWord(DeviceTree::DEFAULT_BASE) == 0xedfe0dd0, "ROM doesn't hold the blob");
+
+    SUCCESS;
+}
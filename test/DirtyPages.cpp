@@ -0,0 +1,61 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(DIRTY_PAGES) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x8000);
+
+    constexpr Address STORE = 0x5000;
+    constexpr Address ATOMIC = 0x7000;
+    constexpr Address WRITTEN = 0x2000;
+
+    // The CLINT doesn't track stores, so queries stay inside RAM
+    constexpr Address RAM = 0x1000;
+    constexpr Address RAM_SIZE = 0x8000;
+
+    // Two stores through the hart's host page, then an AMO
+    std::vector<Word> program = {
+        RV64_U(RVInstruction::OP_LUI, 8, STORE >> 12),
+        RV64_U(RVInstruction::OP_LUI, 9, ATOMIC >> 12),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 7, RVInstruction::FUNCT3_ADDI, 0, 1),
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 7, 16),
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 7, 24),
+        RV64_R(RVInstruction::OP_ATOMIC, 5, RVInstruction::FUNCT3_ATOMIC, 9, 7, RVInstruction::FUNCT7_AMOADD_W)
+    };
+
+    memory.WriteWords(0x1000, program);
+
+    // Loading the program dirtied its page
+    auto loaded = memory.TakeDirtyRanges(RAM, RAM_SIZE);
+    ASSERT(loaded.size() == 1 && loaded[0] == DirtyPages::Range(0x1000, 0x2000), "Program load dirtied {} ranges", loaded.size());
+    ASSERT(memory.PeekDirtyRanges(RAM, RAM_SIZE).empty(), "Take left pages dirty");
+
+    SETUP_VM(0x1000);
+    STEP_VMS(4);
+
+    auto stored = memory.TakeDirtyRanges(RAM, RAM_SIZE);
+    ASSERT(stored.size() == 1 && stored[0] == DirtyPages::Range(STORE, STORE + MemoryRAM::PAGE_SIZE), "Hart store dirtied {} ranges", stored.size());
+
+    // The hart has the page cached now, and still has to mark it again
+    STEP_VMS(2);
+
+    memory.WriteLong(WRITTEN, Random<Long>(1, UINT32_MAX));
+    memory.WriteLong(WRITTEN + MemoryRAM::PAGE_SIZE, Random<Long>(1, UINT32_MAX));
+
+    auto peeked = memory.PeekDirtyRanges(RAM, RAM_SIZE);
+    std::vector<DirtyPages::Range> expected = {
+        {WRITTEN, WRITTEN + MemoryRAM::PAGE_SIZE * 2},
+        {STORE, STORE + MemoryRAM::PAGE_SIZE},
+        {ATOMIC, ATOMIC + MemoryRAM::PAGE_SIZE}
+    };
+
+    ASSERT(peeked == expected, "Found {} dirty ranges, expected {}", peeked.size(), expected.size());
+
+    // Taking part of a range only clears the pages it covers
+    auto taken = memory.TakeDirtyRanges(WRITTEN + MemoryRAM::PAGE_SIZE, STORE - WRITTEN);
+    ASSERT(taken.size() == 2 && taken[0].first == WRITTEN + MemoryRAM::PAGE_SIZE, "Partial take found {} ranges", taken.size());
+
+    auto remaining = memory.TakeDirtyRanges(RAM, RAM_SIZE);
+    ASSERT(remaining.size() == 2 && remaining[0] == DirtyPages::Range(WRITTEN, WRITTEN + MemoryRAM::PAGE_SIZE), "Partial take cleared too much");
+
+    SUCCESS;
+}
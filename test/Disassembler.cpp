@@ -0,0 +1,52 @@
+#include "Test.hpp"
+
+#include <cstring>
+#include <span>
+
+DEFINE_TESTCASE(DISASSEMBLER) {
+    auto Text = [](Word word) {
+        return std::string(RVInstruction::FromUInt32(word));
+    };
+
+    std::vector<std::pair<Word, std::string>> cases = {
+        {RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 11, -4), "ADDI a0, a1, -4 (18446744073709551612)"},
+        {RV64_I(RVInstruction::OP_LOAD, 5, RVInstruction::FUNCT3_LD, 2, 16), "LD t0, 16(sp)"},
+        {RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SW, 2, 6, -8), "SW t1, -8(sp)"},
+        {RV64_R(RVInstruction::OP_MATH, 1, RVInstruction::FUNCT3_ADD_SUB_MUL, 2, 3, RVInstruction::FUNCT7_SUB), "SUB ra, sp, gp"},
+        {RV64_I(RVInstruction::OP_CSR, 7, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_MHARTID), "CSRRS t2, mhartid, zero"},
+        {RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRWI, 5, VirtualMachine::CSR_MSTATUS), "CSRRWI zero, mstatus, 5"},
+        {RV64_I(RVInstruction::OP_FL, 1, RVInstruction::FUNCT3_FLD, 10, 8), "FLD ft1, 8(a0)"},
+        {RV64_S(RVInstruction::OP_FS, RVInstruction::FUNCT3_FSW, 10, 2, 4), "FSW ft2, 4(a0)"},
+        {0x00000073, "ECALL"},
+        {0, "INVALID"}
+    };
+
+    for (const auto& [word, expected] : cases)
+        ASSERT(Text(word) == expected, "{:08x} disassembled as '{}', expected '{}'", word, Text(word), expected);
+
+    // Every type has a mnemonic of its own
+    for (size_t type = 0; type < RVInstruction::TYPE_COUNT; type++) {
+        auto name = RVInstruction::GetMnemonic(static_cast<RVInstruction::Type>(type));
+        ASSERT(!name.empty() && name != "UNKNOWN", "Type {} has no mnemonic", type);
+    }
+
+    // Short buffers truncate and stay terminated
+    auto instr = RVInstruction::FromUInt32(RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 11, -4));
+    char small[8];
+    std::memset(small, 'x', sizeof(small));
+    auto length = instr.Disassemble(small, sizeof(small));
+    ASSERT(length == 7 && std::string(small) == "ADDI a0", "Truncated to '{}' ({})", small, length);
+
+    // The batch form matches one at a time
+    std::vector<Word> words(Memory::PAGE_SIZE / sizeof(Word));
+    for (auto& word : words)
+        word = Random<Word>(0, UINT32_MAX);
+
+    std::vector<RVInstruction::Disassembly> lines(words.size());
+    RVInstruction::Disassemble(std::span<const Word>(words), std::span(lines));
+
+    for (size_t i = 0; i < words.size(); i++)
+        ASSERT(Text(words[i]) == lines[i].data(), "Batch line {} is '{}', expected '{}'", i, lines[i].data(), Text(words[i]));
+
+    SUCCESS;
+}
@@ -0,0 +1,34 @@
+#include "Test.hpp"
+
+DEFINE_SERIAL_TESTCASE(ECALL) {
+    using Type = RVInstruction::Type;
+    using Regs = std::array<VirtualMachine::Reg, VirtualMachine::REGISTER_COUNT>;
+    using FRegs = std::array<Float, VirtualMachine::REGISTER_COUNT>;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    // One number from the indexed table and one past it
+    constexpr Long TABLE_CALL = 12;
+    constexpr Long HASHED_CALL = 0x7ff;
+
+    VirtualMachine::RegisterECall(TABLE_CALL, [](Hart, bool, Memory&, Regs& regs, FRegs&) { regs[11].u64 += 1; });
+    VirtualMachine::RegisterECall(HASHED_CALL, [](Hart, bool, Memory&, Regs& regs, FRegs&) { regs[11].u64 += 0x100; });
+
+    memory.WriteWords(0x1000, {
+        RVInstruction::Encode(Type::ADDI, 10, 0, 0, TABLE_CALL),
+        RVInstruction::Encode(Type::ECALL, 0, 0, 0, 0),
+        RVInstruction::Encode(Type::ECALL, 0, 0, 0, 0),
+        RVInstruction::Encode(Type::ADDI, 10, 0, 0, HASHED_CALL),
+        RVInstruction::Encode(Type::ECALL, 0, 0, 0, 0)
+    });
+
+    STEP_VMS(5);
+
+    auto calls = vm.GetRegister(11).Value().u64;
+    ASSERT(calls == 0x102, "Handlers left a1 at {:x}, expected 102", calls);
+
+    SUCCESS;
+}
@@ -0,0 +1,138 @@
+#include "Test.hpp"
+
+#include <ELF.hpp>
+
+#include <cstring>
+#include <filesystem>
+
+DEFINE_TESTCASE(ELF) {
+    constexpr Address TEXT = 0x3000;
+    constexpr Address TEXT_OFFSET = 0x1000;
+    constexpr Address TEXT_BYTES = 0x1010;
+    constexpr Address DATA = 0x6000;
+    constexpr Address DATA_OFFSET = 0x3000;
+    constexpr Address DATA_BYTES = 0x10;
+    constexpr Address BSS_BYTES = 0x2000;
+    constexpr Address SYMTAB_OFFSET = 0x3100;
+    constexpr Address STRTAB_OFFSET = 0x3180;
+    constexpr Address SECTIONS_OFFSET = 0x3200;
+
+    std::vector<Byte> image(SECTIONS_OFFSET + 3 * 64);
+
+    auto Put = [&]<typename T>(Address offset, T value) {
+        std::memcpy(image.data() + offset, &value, sizeof(T));
+    };
+
+    // Header, then a read only text segment and a data segment with BSS
+    std::memcpy(image.data(), "\x7f" "ELF\x02\x01\x01", 7);
+    Put(16, Half{2});
+    Put(18, Half{243});
+    Put(20, Word{1});
+    Put(24, Long{TEXT});
+    Put(32, Long{64});
+    Put(40, Long{SECTIONS_OFFSET});
+    Put(52, Half{64});
+    Put(54, Half{56});
+    Put(56, Half{2});
+    Put(58, Half{64});
+    Put(60, Half{3});
+
+    auto Segment = [&](Address at, Word flags, Address offset, Address address, Address file_bytes, Address memory_bytes) {
+        Put(at, Word{1});
+        Put(at + 4, flags);
+        Put(at + 8, Long{offset});
+        Put(at + 16, Long{address});
+        Put(at + 24, Long{address});
+        Put(at + 32, Long{file_bytes});
+        Put(at + 40, Long{memory_bytes});
+        Put(at + 48, Long{0x1000});
+    };
+
+    Segment(64, 5, TEXT_OFFSET, TEXT, TEXT_BYTES, TEXT_BYTES);
+    Segment(64 + 56, 6, DATA_OFFSET, DATA, DATA_BYTES, BSS_BYTES);
+
+    std::vector<Word> program = {
+        RV64_U(RVInstruction::OP_LUI, 5, DATA >> 12),
+        RV64_I(RVInstruction::OP_LOAD, 6, RVInstruction::FUNCT3_LD, 5, 0),
+        RV64_I(RVInstruction::OP_LOAD, 7, RVInstruction::FUNCT3_LD, 5, 0x7f8),
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 5, 6, 0x10),
+        RV64_U(RVInstruction::OP_LUI, 9, (TEXT + 0x1000) >> 12),
+        RV64_I(RVInstruction::OP_LOAD, 8, RVInstruction::FUNCT3_LD, 9, 8),
+    };
+
+    for (size_t i = 0; i < program.size(); i++)
+        Put(TEXT_OFFSET + i * sizeof(Word), program[i]);
+
+    auto text_tail = Random<Long>(0, UINT64_MAX);
+    auto data = Random<Long>(1, UINT64_MAX);
+    Put(TEXT_OFFSET + 0x1008, text_tail);
+    Put(DATA_OFFSET, data);
+
+    // Symbols for both segments, after the null entry
+    std::memcpy(image.data() + STRTAB_OFFSET, "\0main\0table\0", 12);
+
+    auto Symbol = [&](Address at, Word name, Byte type, Address value, Address size) {
+        Put(at, name);
+        Put(at + 4, Byte(0x10 | type));
+        Put(at + 6, Half{1});
+        Put(at + 8, Long{value});
+        Put(at + 16, Long{size});
+    };
+
+    Symbol(SYMTAB_OFFSET + 24, 1, 2, TEXT, 0x20);
+    Symbol(SYMTAB_OFFSET + 48, 6, 1, DATA, DATA_BYTES);
+
+    auto Section = [&](Address at, Word type, Address offset, Address size, Word link, Address entry_size) {
+        Put(at + 4, type);
+        Put(at + 24, Long{offset});
+        Put(at + 32, Long{size});
+        Put(at + 40, link);
+        Put(at + 56, Long{entry_size});
+    };
+
+    Section(SECTIONS_OFFSET + 64, 2, SYMTAB_OFFSET, 72, 2, 24);
+    Section(SECTIONS_OFFSET + 128, 3, STRTAB_OFFSET, 12, 0, 0);
+
+    auto path = (std::filesystem::temp_directory_path() / "rv64_elf_test.elf").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(image.data()), image.size());
+    }
+
+    ASSERT(ELFImage::IsELF(path), "Image wasn't recognised as ELF");
+
+    auto elf = ELFImage::Open(path);
+    std::filesystem::remove(path);
+
+    ASSERT(elf->Is64Bit() && elf->GetEntry() == TEXT, "Entry is {:x}", elf->GetEntry());
+    ASSERT(elf->GetSegments().size() == 2, "Found {} segments", elf->GetSegments().size());
+
+    SETUP_MEMORY;
+    elf->MapReadOnlySegments(memory);
+    ADD_RAM(0x1000, 0x10000);
+    elf->LoadSegments(memory);
+
+    ASSERT(elf->GetSegments()[0].mapped && !elf->GetSegments()[1].mapped, "Only the text segment should be mapped");
+
+    auto [host, writable] = memory.GetHostPage(TEXT);
+    ASSERT(host && !writable, "Text should be a read only host page");
+
+    SETUP_VM(elf->GetEntry());
+    STEP_VMS(program.size());
+
+    ASSERT(vm.GetRegister(6).Value().u64 == data, "Data segment loaded {:x}, expected {:x}", vm.GetRegister(6).Value().u64, data);
+    ASSERT(vm.GetRegister(7).Value().u64 == 0, "BSS read {:x}", vm.GetRegister(7).Value().u64);
+    ASSERT(vm.GetRegister(8).Value().u64 == text_tail, "Text past the first page read {:x}", vm.GetRegister(8).Value().u64);
+    ASSERT(memory.ReadLong(DATA + 0x10) == data, "Store into BSS didn't land");
+
+    // Text was never copied, only the page the data and BSS live on
+    auto ram = memory.FindMemoryRegionOfType<MemoryRAM>(MemoryRegion::TYPE_GENERAL_RAM);
+    ASSERT(ram->SizeInMemory() == MemoryRAM::PAGE_SIZE, "RAM holds {:x} bytes", ram->SizeInMemory());
+
+    auto symbols = elf->GetSymbols();
+    ASSERT(symbols->Format(TEXT + 4) == "main+0x4", "Got {}", symbols->Format(TEXT + 4));
+    ASSERT(symbols->Format(DATA + 8) == "table+0x8", "Got {}", symbols->Format(DATA + 8));
+    ASSERT(symbols->Find(TEXT + 0x100) == nullptr, "Address past main found {}", symbols->Find(TEXT + 0x100)->name);
+
+    SUCCESS;
+}
@@ -0,0 +1,126 @@
+#include "Test.hpp"
+
+#include <Embed.h>
+
+#include <thread>
+
+namespace {
+    constexpr int64_t ECALL_ANSWER = 100;
+    constexpr int64_t ECALL_STOP = 101;
+
+    struct Context {
+        uint64_t answer = 0;
+        int calls = 0;
+    };
+
+    void Answer(rv64_machine* machine, uint32_t hart, void* user) {
+        auto& context = *static_cast<Context*>(user);
+        context.calls++;
+
+        uint64_t regs[32];
+        rv64_read_registers(machine, hart, regs);
+        regs[11] = context.answer;
+        rv64_write_registers(machine, hart, regs);
+    }
+
+    void Stop(rv64_machine* machine, uint32_t hart, void*) {
+        rv64_stop(machine, hart);
+    }
+
+    // Asks for the answer, then counts in t0 forever
+    const std::vector<Word> PROGRAM = {
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 0, ECALL_ANSWER),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_ECALL),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 5, 1),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BEQ, 0, 0, -4)
+    };
+
+    const std::vector<Word> STOPPING = {
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 0, ECALL_STOP),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_ECALL),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 0, ECALL_STOP + 1),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_ECALL)
+    };
+
+    uint64_t ReadRegister(rv64_machine* machine, uint32_t hart, size_t reg) {
+        uint64_t regs[32];
+        rv64_read_registers(machine, hart, regs);
+        return regs[reg];
+    }
+}
+
+DEFINE_TESTCASE(EMBED) {
+    rv64_config config;
+    rv64_config_init(&config);
+    config.harts = 2;
+
+    auto machine = rv64_create(&config);
+    ASSERT(machine && rv64_hart_count(machine) == 2, "The machine wasn't made with two harts");
+
+    Context context{Random<uint64_t>(1, UINT32_MAX)};
+    rv64_register_ecall(machine, ECALL_ANSWER, Answer, &context);
+    rv64_register_ecall(machine, ECALL_STOP, Stop, nullptr);
+
+    rv64_write_memory(machine, 0x1000, PROGRAM.data(), PROGRAM.size() * sizeof(Word));
+    rv64_write_memory(machine, 0x2000, STOPPING.data(), STOPPING.size() * sizeof(Word));
+
+    std::vector<Word> read_back(PROGRAM.size());
+    rv64_read_memory(machine, 0x1000, read_back.data(), read_back.size() * sizeof(Word));
+    ASSERT(read_back == PROGRAM, "Memory read back differs");
+
+    // Exact steps, with the ecall answered through the user's context
+    ASSERT(rv64_step(machine, 0, 2) == RV64_EVENT_DONE, "Two steps didn't finish");
+    ASSERT(context.calls == 1 && ReadRegister(machine, 0, 11) == context.answer, "The ecall handler answered {:x}", ReadRegister(machine, 0, 11));
+
+    auto steps = Random<uint64_t>(1, 5000);
+    ASSERT(rv64_step(machine, 0, steps) == RV64_EVENT_DONE, "{} steps didn't finish", steps);
+    ASSERT(ReadRegister(machine, 0, 5) == (steps + 1) / 2, "t0 counted {}, expected {}", ReadRegister(machine, 0, 5), (steps + 1) / 2);
+
+    // Breakpoints end a run on their address, and the next run goes on
+    rv64_set_breakpoint(machine, 0x100c);
+    ASSERT(rv64_run(machine, 0) == RV64_EVENT_BREAK && rv64_get_pc(machine, 0) == 0x100c, "The run didn't break at {:x}", rv64_get_pc(machine, 0));
+    rv64_clear_breakpoint(machine, 0x100c);
+
+    // The second hart stops itself, then calls a number nobody handles
+    rv64_set_pc(machine, 1, 0x2000);
+    ASSERT(rv64_run(machine, 1) == RV64_EVENT_STOPPED, "The hart didn't stop from its ecall");
+    ASSERT(rv64_run(machine, 1) == RV64_EVENT_ERROR, "An unknown ecall wasn't an error");
+
+    uint64_t regs[32];
+    ASSERT(rv64_read_registers(machine, 2, regs) == -1, "Hart 2 could be read");
+    ASSERT(rv64_read_memory(machine, 0x80000000, regs, sizeof(regs)) == -1, "Unmapped memory could be read");
+
+    // Both harts together, each ending on its own event
+    rv64_set_pc(machine, 1, 0x2000);
+    rv64_event events[2];
+    rv64_step_all(machine, 100, events);
+    ASSERT(events[0] == RV64_EVENT_DONE && events[1] == RV64_EVENT_STOPPED, "Stepping both harts ended with {} and {}", int(events[0]), int(events[1]));
+
+    rv64_destroy(machine);
+
+    // Machines share nothing, so they run side by side
+    std::vector<uint64_t> counted(4);
+    {
+        std::vector<std::jthread> threads;
+        for (size_t i = 0; i < counted.size(); i++) {
+            threads.emplace_back([&, i]() {
+                rv64_config single;
+                rv64_config_init(&single);
+
+                auto own = rv64_create(&single);
+                Context own_context;
+                rv64_register_ecall(own, ECALL_ANSWER, Answer, &own_context);
+                rv64_write_memory(own, 0x1000, PROGRAM.data(), PROGRAM.size() * sizeof(Word));
+
+                rv64_step(own, 0, 2 + 2 * (i + 1) * 1000);
+                counted[i] = ReadRegister(own, 0, 5);
+                rv64_destroy(own);
+            });
+        }
+    }
+
+    for (size_t i = 0; i < counted.size(); i++)
+        ASSERT(counted[i] == (i + 1) * 1000, "Machine {} counted {}", i, counted[i]);
+
+    SUCCESS;
+}
@@ -0,0 +1,54 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(FENCE_I) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto sel_rd = Random<size_t>(3, VirtualMachine::REGISTER_COUNT);
+
+    auto old_value = Random<Word>(0, 0x7ff);
+    auto new_value = Random<Word>(0, 0x7ff);
+
+    auto old_instr = RV64_I(RVInstruction::OP_MATH_IMMEDIATE, sel_rd, RVInstruction::FUNCT3_ADDI, 0, old_value);
+    auto new_instr = RV64_I(RVInstruction::OP_MATH_IMMEDIATE, sel_rd, RVInstruction::FUNCT3_ADDI, 0, new_value);
+
+    auto& addr = vm.GetRegister(1).Value();
+    auto& data = vm.GetRegister(2).Value();
+    auto& rd = vm.GetRegister(sel_rd).Value();
+
+    memory.WriteWord(0x1000, RV64_S(
+        RVInstruction::OP_STORE,
+        RVInstruction::FUNCT3_SW,
+        1,
+        2,
+        0
+    ));
+
+    memory.WriteWord(0x1004, RV64_I(
+        RVInstruction::OP_FENCE,
+        0,
+        RVInstruction::FUNCT3_FENCE_I,
+        0,
+        0
+    ));
+
+    memory.WriteWord(0x1008, old_instr);
+
+    addr.u64 = 0x1008;
+    data.u64 = old_instr;
+
+    STEP_VMS(3);
+
+    ASSERT(rd.u64 == old_value, "Wrong value before rewrite. Expected {:x}, got {:x}", old_value, rd.u64);
+
+    vm.SetPC(0x1000);
+    data.u64 = new_instr;
+
+    STEP_VMS(3);
+
+    ASSERT(rd.u64 == new_value, "Stale instruction executed after FENCE.I. Expected {:x}, got {:x}", new_value, rd.u64);
+
+    SUCCESS;
+}
@@ -0,0 +1,57 @@
+#include "Test.hpp"
+
+#include <cstring>
+
+DEFINE_TESTCASE(FFLAGS) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto dividend = Random<float>(-1000.0f, 1000.0f);
+    if (dividend == 0.0f) dividend = 1.0f;
+
+    Word bits;
+    std::memcpy(&bits, &dividend, sizeof(bits));
+
+    vm.GetRegister(1).Value().u64 = bits;
+    vm.GetRegister(2).Value().u64 = 0;
+
+    constexpr Word FUNCT7_FDIV_S = (RVInstruction::FUNCT5_FDIV << 2) | RVInstruction::FUNCT2_S;
+    constexpr Word FUNCT7_FADD_S = (RVInstruction::FUNCT5_FADD << 2) | RVInstruction::FUNCT2_S;
+    constexpr Word FUNCT7_FMV_W_X = (RVInstruction::FUNCT5_FMV_W_X << 2) | RVInstruction::FUNCT2_S;
+    constexpr Word FUNCT7_FMV_X_W = (RVInstruction::FUNCT5_FCLASS_FMV_X_W << 2) | RVInstruction::FUNCT2_S;
+
+    memory.WriteWords(0x1000, {
+        RV64_R(RVInstruction::OP_FLOAT, 1, RVInstruction::FUNCT3_FMV_W_X, 1, 0, FUNCT7_FMV_W_X),
+        RV64_R(RVInstruction::OP_FLOAT, 2, RVInstruction::FUNCT3_FMV_W_X, 2, 0, FUNCT7_FMV_W_X),
+        RV64_R(RVInstruction::OP_FLOAT, 3, RVInstruction::RM_DYNAMIC, 1, 2, FUNCT7_FDIV_S),
+        RV64_R(RVInstruction::OP_FLOAT, 3, RVInstruction::FUNCT3_FMV_X_W, 3, 0, FUNCT7_FMV_X_W),
+        RV64_I(RVInstruction::OP_CSR, 4, RVInstruction::FUNCT3_CSRRW, 0, VirtualMachine::CSR_FFLAGS),
+        RV64_R(RVInstruction::OP_FLOAT, 4, RVInstruction::RM_DYNAMIC, 2, 2, FUNCT7_FADD_S),
+        RV64_I(RVInstruction::OP_CSR, 5, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_FFLAGS),
+        RV64_R(RVInstruction::OP_FLOAT, 5, RVInstruction::RM_DYNAMIC, 2, 2, FUNCT7_FDIV_S),
+        RV64_R(RVInstruction::OP_FLOAT, 6, RVInstruction::FUNCT3_FMV_X_W, 5, 0, FUNCT7_FMV_X_W),
+        RV64_I(RVInstruction::OP_CSR, 7, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_FFLAGS)
+    });
+
+    STEP_VMS(10);
+
+    Word inf = 0x7f800000 | (bits & 0x80000000);
+    Word quotient = vm.GetRegister(3).Value().u64;
+    ASSERT(quotient == inf, "Dividing {:x} by zero gave {:x}, expected {:x}", bits, quotient, inf);
+
+    auto flags = vm.GetRegister(4).Value().u64;
+    ASSERT(flags == VirtualMachine::CSR_FCSR_DZ, "Dividing by zero raised flags {:x}", flags);
+
+    flags = vm.GetRegister(5).Value().u64;
+    ASSERT(flags == 0, "Exact add after clearing fflags raised flags {:x}", flags);
+
+    Word nan = vm.GetRegister(6).Value().u64;
+    ASSERT(nan == 0x7fc00000, "Zero divided by zero gave {:x}, expected the canonical NaN", nan);
+
+    flags = vm.GetRegister(7).Value().u64;
+    ASSERT(flags == VirtualMachine::CSR_FCSR_NV, "Zero divided by zero raised flags {:x}", flags);
+
+    SUCCESS;
+}
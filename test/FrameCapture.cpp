@@ -0,0 +1,88 @@
+#include "Test.hpp"
+
+#include <FrameCapture.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+DEFINE_TESTCASE(FRAME_CAPTURE) {
+    constexpr Address SCREEN = 0x2000;
+
+    // Odd, so RGB565 rows are only half aligned
+    auto width = Random<Word>(1, 40) * 2 + 1;
+    auto height = Random<Word>(1, 40);
+
+    SETUP_MEMORY;
+    ADD_RAM(SCREEN, 0x2000);
+
+    auto pixel = Random<Half>(0, 0xffff);
+    memory.WriteHalf(SCREEN, pixel);
+
+    auto directory = (std::filesystem::temp_directory_path() / "rv64_frame_capture_test").string();
+    std::filesystem::remove_all(directory);
+
+    std::vector<FrameCapture::Frame> frames;
+    Long second_hash = 0;
+
+    {
+        FrameCapture::Options options;
+        options.address = SCREEN;
+        options.width = width;
+        options.height = height;
+        options.format = FrameCapture::PixelFormat::RGB565;
+        options.destination = directory;
+        options.fps = 0;
+
+        FrameCapture capture(memory, options);
+
+        ASSERT(capture.CaptureFrame(), "The first frame wasn't kept");
+        ASSERT(!capture.CaptureFrame(), "An unchanged frame was kept");
+
+        // Changes anywhere on screen are a new frame
+        Address last = SCREEN + (static_cast<Address>(width) * height - 1) * sizeof(Half);
+        memory.WriteHalf(last, memory.ReadHalf(last) ^ 1);
+        ASSERT(capture.CaptureFrame(), "A changed frame wasn't kept");
+
+        std::vector<Byte> screen(static_cast<Address>(width) * height * sizeof(Half));
+        memory.ReadBytes(SCREEN, screen);
+        second_hash = FrameCapture::HashFrame(screen);
+
+        capture.Flush();
+        frames = capture.GetFrames();
+    }
+
+    ASSERT(frames.size() == 2 && frames[0].number == 0 && frames[1].number == 1, "Kept {} frames", frames.size());
+    ASSERT(frames[1].hash == second_hash && frames[0].hash != second_hash, "Frame hashes {:x} and {:x}, screen hashes {:x}", frames[0].hash, frames[1].hash, second_hash);
+
+    // The first PNG holds the pixel, widened to 8 bits per channel
+    auto path = (std::filesystem::path(directory) / "frame_000000.png").string();
+    std::ifstream file(path, std::ios::binary);
+    std::vector<Byte> png((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    ASSERT(png.size() > 33 && png[1] == 'P' && png[2] == 'N' && png[3] == 'G', "{} isn't a PNG", path);
+
+    auto BigEndian = [&](size_t offset) {
+        return (Word(png[offset]) << 24) | (Word(png[offset + 1]) << 16) | (Word(png[offset + 2]) << 8) | png[offset + 3];
+    };
+
+    ASSERT(BigEndian(16) == width && BigEndian(20) == height, "PNG is {}x{}, expected {}x{}", BigEndian(16), BigEndian(20), width, height);
+
+    // IDAT follows IHDR, a zlib header, then the first stored block's
+    // header and the first row's filter byte
+    size_t first_pixel = 33 + 8 + 2 + 5 + 1;
+    ASSERT(png.size() > first_pixel + 3 && png[37] == 'I' && png[38] == 'D', "No IDAT after IHDR");
+
+    Byte r = pixel >> 11, g = (pixel >> 5) & 0x3f, b = pixel & 0x1f;
+    std::array<Byte, 3> expected = {Byte((r << 3) | (r >> 2)), Byte((g << 2) | (g >> 4)), Byte((b << 3) | (b >> 2))};
+
+    for (size_t i = 0; i < 3; i++)
+        ASSERT(png[first_pixel + i] == expected[i], "Channel {} is {:x}, expected {:x} from {:x}", i, png[first_pixel + i], expected[i], pixel);
+
+    ASSERT(std::filesystem::exists(std::filesystem::path(directory) / "frame_000001.png"), "The second frame wasn't written");
+
+    file.close();
+    std::filesystem::remove_all(directory);
+
+    SUCCESS;
+}
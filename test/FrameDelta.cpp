@@ -0,0 +1,68 @@
+#include "Test.hpp"
+
+#include <FrameDelta.hpp>
+
+DEFINE_TESTCASE(FRAME_DELTA) {
+    constexpr Address SCREEN = 0x10000;
+    constexpr Word PIXEL = sizeof(Word);
+
+    // Not a multiple of the tile size either way
+    auto width = Random<Word>(FrameDelta::TILE + 1, 200);
+    auto height = Random<Word>(FrameDelta::TILE + 1, 200);
+    Address bytes = static_cast<Address>(width) * height * PIXEL;
+
+    SETUP_MEMORY;
+    ADD_RAM(SCREEN, 0x40000);
+
+    // Mostly one color so runs pack, with noise between
+    for (Address i = 0; i < bytes; i += PIXEL)
+        memory.WriteWord(SCREEN + i, Random<Word>(0, 3) == 0 ? Random<Word>(0, -1U) : 0xff203040);
+
+    FrameDelta delta(memory, SCREEN, width, height, PIXEL);
+
+    std::vector<Byte> viewer(bytes), screen(bytes), batch;
+    auto Matches = [&]() {
+        memory.ReadBytes(SCREEN, screen);
+        return screen == viewer;
+    };
+
+    // The first batch holds every tile
+    Word columns = (width + FrameDelta::TILE - 1) / FrameDelta::TILE;
+    Word rows = (height + FrameDelta::TILE - 1) / FrameDelta::TILE;
+
+    auto tiles = delta.Encode(batch, false);
+    ASSERT(tiles == columns * rows, "First batch had {} tiles, expected {}", tiles, columns * rows);
+    ASSERT(FrameDelta::Apply(batch, viewer, width, height, PIXEL) && Matches(), "Viewer doesn't match after the first batch");
+    ASSERT(batch.size() < bytes, "First batch took {} bytes for {} of pixels", batch.size(), bytes);
+
+    // Nothing drawn sends nothing
+    batch.clear();
+    ASSERT(delta.Encode(batch, false) == 0 && batch.size() == sizeof(Long), "An unchanged frame sent {} bytes", batch.size());
+
+    // A store of the same value dirties the page but changes no tile
+    memory.WriteWord(SCREEN, memory.ReadWord(SCREEN));
+    batch.clear();
+    ASSERT(delta.Encode(batch, false) == 0, "Rewriting a pixel sent a tile");
+
+    // One pixel changes exactly its tile
+    Word x = Random<Word>(0, width - 1), y = Random<Word>(0, height - 1);
+    Address pixel = SCREEN + (static_cast<Address>(y) * width + x) * PIXEL;
+    memory.WriteWord(pixel, ~memory.ReadWord(pixel));
+
+    batch.clear();
+    tiles = delta.Encode(batch, false);
+    ASSERT(tiles == 1, "Changing one pixel sent {} tiles", tiles);
+    ASSERT(FrameDelta::Apply(batch, viewer, width, height, PIXEL) && Matches(), "Viewer doesn't match after one pixel changed");
+
+    // A viewer joining late gets everything
+    std::vector<Byte> late(bytes);
+    batch.clear();
+    ASSERT(delta.Encode(batch, true) == columns * rows, "A full batch missed tiles");
+    ASSERT(FrameDelta::Apply(batch, late, width, height, PIXEL) && late == screen, "Late viewer doesn't match");
+
+    // Truncated batches are refused
+    batch.resize(batch.size() - 1);
+    ASSERT(!FrameDelta::Apply(batch, late, width, height, PIXEL), "Applied a truncated batch");
+
+    SUCCESS;
+}
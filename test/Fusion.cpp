@@ -0,0 +1,64 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(FUSION) {
+    using Type = RVInstruction::Type;
+
+    auto loops = Random<Long>(1, 50);
+
+    // Every fused pair, looping through a call so blocks link up
+    std::vector<Word> program = {
+        RVInstruction::Encode(Type::LUI, 5, 0, 0, 0x12345000),
+        RVInstruction::Encode(Type::ADDI, 5, 5, 0, -0x123),
+        RVInstruction::Encode(Type::LUI, 6, 0, 0, 0x7ffff000),
+        RVInstruction::Encode(Type::ADDIW, 6, 6, 0, 0x7ff),
+        RVInstruction::Encode(Type::AUIPC, 7, 0, 0, 0x1000),
+        RVInstruction::Encode(Type::ADDI, 7, 7, 0, 0x10),
+        RVInstruction::Encode(Type::SLLI, 8, 5, 0, 32),
+        RVInstruction::Encode(Type::SRLI, 8, 8, 0, 32),
+        RVInstruction::Encode(Type::ADD, 9, 9, 8, 0),
+        RVInstruction::Encode(Type::ADDI, 10, 10, 0, 1),
+        RVInstruction::Encode(Type::SLTU, 11, 10, 12, 0),
+        RVInstruction::Encode(Type::BNE, 0, 11, 0, 8),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0x10),
+        RVInstruction::Encode(Type::AUIPC, 13, 0, 0, 0),
+        RVInstruction::Encode(Type::JALR, 14, 13, 0, -0x34),
+        RVInstruction::Encode(Type::ADDI, 0, 0, 0, 0),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0)
+    };
+
+    auto total = Random<Long>(1, loops * 15 + 20);
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+    memory.WriteWords(0x1000, program);
+
+    // The interpreter never fuses
+    vms.emplace_back(memory, 0x1000, 1);
+    auto& reference = vms[1];
+    reference.Start();
+
+    vm.GetRegister(12).Value().u64 = loops;
+    reference.GetRegister(12).Value().u64 = loops;
+
+    reference.Step(total);
+
+    // Slices of a few instructions split some pairs between them
+    for (Long executed = 0; executed < total;) {
+        auto slice = std::min(Random<Long>(1, 8), total - executed);
+        vm.StepBlocks(slice);
+        executed += slice;
+    }
+
+    ASSERT(vm.GetPC() == reference.GetPC(), "Blocks stopped at {:x}, the interpreter at {:x}", vm.GetPC(), reference.GetPC());
+    ASSERT(vm.GetCycles() == reference.GetCycles(), "Blocks took {} cycles, the interpreter {}", vm.GetCycles(), reference.GetCycles());
+
+    for (size_t reg = 0; reg < VirtualMachine::REGISTER_COUNT; reg++) {
+        auto value = vm.GetRegister(reg).Value().u64;
+        auto expected = reference.GetRegister(reg).Value().u64;
+        ASSERT(value == expected, "x{} is {:x} after {} instructions, expected {:x}", reg, value, total, expected);
+    }
+
+    SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(HPM) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x2000);
+
+    constexpr Half CSR_MHPMCOUNTER4 = VirtualMachine::CSR_MHPMCOUNTER3 + 1;
+    constexpr Half CSR_MHPMEVENT4 = VirtualMachine::CSR_MHPMEVENT3 + 1;
+    constexpr Half CSR_HPMCOUNTER4 = VirtualMachine::CSR_HPMCOUNTER + 1;
+
+    auto loads = Random<Word>(1, 32);
+
+    std::vector<Word> program = {
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 7, RVInstruction::FUNCT3_ADDI, 0, VirtualMachine::HPM_EVENT_LOADS),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 7, VirtualMachine::CSR_MHPMEVENT3),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 7, RVInstruction::FUNCT3_ADDI, 0, VirtualMachine::HPM_EVENT_BRANCHES_TAKEN),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 7, CSR_MHPMEVENT4),
+        RV64_U(RVInstruction::OP_LUI, 6, 0x2)
+    };
+
+    for (Word i = 0; i < loads; i++)
+        program.push_back(RV64_I(RVInstruction::OP_LOAD, 5, RVInstruction::FUNCT3_LD, 6, 0));
+
+    program.insert(program.end(), {
+        // Taken over the nop, then not taken
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BEQ, 0, 0, 8),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 0, RVInstruction::FUNCT3_ADDI, 0, 0),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BNE, 0, 0, 8),
+        RV64_I(RVInstruction::OP_CSR, 10, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_MHPMCOUNTER3),
+        RV64_I(RVInstruction::OP_CSR, 11, RVInstruction::FUNCT3_CSRRS, 0, CSR_HPMCOUNTER4),
+
+        // Inhibit counter 3, then load once more
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 7, RVInstruction::FUNCT3_ADDI, 0, 1 << 3),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 7, VirtualMachine::CSR_MCOUNTINHIBIT),
+        RV64_I(RVInstruction::OP_LOAD, 5, RVInstruction::FUNCT3_LD, 6, 0),
+        RV64_I(RVInstruction::OP_CSR, 12, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_MHPMCOUNTER3),
+
+        // Overwrite counter 4 and take one more branch, to the next instruction
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 7, RVInstruction::FUNCT3_ADDI, 0, 100),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 7, CSR_MHPMCOUNTER4),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BEQ, 0, 0, 4),
+        RV64_I(RVInstruction::OP_CSR, 13, RVInstruction::FUNCT3_CSRRS, 0, CSR_MHPMCOUNTER4)
+    });
+
+    memory.WriteWords(0x1000, program);
+
+    // The skipped nop never runs
+    STEP_VMS(program.size() - 1);
+
+    auto counted = vm.GetRegister(10).Value().u64;
+    ASSERT(counted == loads, "mhpmcounter3 counted {} loads, expected {}", counted, loads);
+
+    counted = vm.GetRegister(11).Value().u64;
+    ASSERT(counted == 1, "hpmcounter4 counted {} taken branches, expected 1", counted);
+
+    counted = vm.GetRegister(12).Value().u64;
+    ASSERT(counted == loads, "Inhibited mhpmcounter3 moved to {}, expected {}", counted, loads);
+
+    counted = vm.GetRegister(13).Value().u64;
+    ASSERT(counted == 101, "mhpmcounter4 read {} after writing 100 and one branch", counted);
+
+    SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include "Test.hpp"
+
+#include <HartScheduler.hpp>
+
+#include <memory>
+#include <thread>
+
+DEFINE_SERIAL_TESTCASE(HART_SCHEDULER) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Long ECALL_STOP = 0x2ad;
+    constexpr Address COUNTER = 0x1700;
+
+    auto harts = Random<Hart>(2, 9);
+    auto loops = Random<Word>(100, 2000);
+
+    std::vector<std::unique_ptr<VirtualMachine>> machines;
+    std::vector<VirtualMachine*> schedule;
+
+    VirtualMachine::RegisterECall(ECALL_STOP, [&](Hart hart, bool, Memory&, auto&, auto&) {
+        machines[hart]->Stop();
+    });
+
+    // Every hart adds one to the counter per loop, then stops itself
+    std::vector<Word> program = {
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 6, RVInstruction::FUNCT3_ADDI, 0, loops),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 7, RVInstruction::FUNCT3_ADDI, 0, 1),
+        RV64_U(RVInstruction::OP_LUI, 8, COUNTER >> 12),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 8, RVInstruction::FUNCT3_ADDI, 8, COUNTER & 0xfff),
+        RV64_R(RVInstruction::OP_ATOMIC, 0, RVInstruction::FUNCT3_ATOMIC, 8, 7, RVInstruction::FUNCT7_AMOADD_W),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 6, RVInstruction::FUNCT3_ADDI, 6, -1),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BNE, 6, 0, -8),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 0, ECALL_STOP),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_ECALL)
+    };
+
+    memory.WriteWords(0x1000, program);
+
+    for (Hart hart = 0; hart < harts; hart++) {
+        machines.push_back(std::make_unique<VirtualMachine>(memory, 0x1000, hart));
+        schedule.push_back(machines.back().get());
+        machines.back()->Start();
+    }
+
+    // A paused hart is parked until the test wakes it
+    machines[0]->Pause();
+
+    HartScheduler::Options options;
+    options.threads = 2;
+    options.quantum = Random<Long>(1, 100);
+
+    HartScheduler scheduler(schedule, options);
+    scheduler.Start();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    machines[0]->Unpause();
+
+    scheduler.Wait();
+
+    auto counted = memory.ReadWord(COUNTER);
+    ASSERT(counted == harts * loops, "Counter reached {}, expected {}", counted, harts * loops);
+
+    SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include "Test.hpp"
+
+DEFINE_SERIAL_TESTCASE(HartStart) {
+    using Type = RVInstruction::Type;
+    using Regs = std::array<VirtualMachine::Reg, VirtualMachine::REGISTER_COUNT>;
+    using FRegs = std::array<Float, VirtualMachine::REGISTER_COUNT>;
+
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x1000);
+
+    SETUP_VM(0x1000);
+    ADD_VM(1, 0x1000);
+
+    constexpr Address START = MemoryCLINT::DEFAULT_BASE + MemoryCLINT::START_OFFSET;
+    constexpr Long ECALL_RESTART = 14;
+
+    VirtualMachine::RegisterECall(ECALL_RESTART, [&](Hart hart, bool, Memory&, Regs&, FRegs&) {
+        vms[hart].RequestStart(0x1200);
+    });
+
+    memory.WriteWords(0x1000, {
+        RVInstruction::Encode(Type::ADDI, 5, 0, 0, 1),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0)
+    });
+
+    memory.WriteWords(0x1100, {
+        RVInstruction::Encode(Type::ADDI, 6, 0, 0, 2),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0)
+    });
+
+    memory.WriteWords(0x1200, {
+        RVInstruction::Encode(Type::ADDI, 7, 0, 0, 3),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0)
+    });
+
+    // Restarts itself from an ecall, the ADDI after it never runs
+    memory.WriteWords(0x1300, {
+        RVInstruction::Encode(Type::ADDI, 10, 0, 0, ECALL_RESTART),
+        RVInstruction::Encode(Type::ECALL, 0, 0, 0, 0),
+        RVInstruction::Encode(Type::ADDI, 7, 0, 0, 9)
+    });
+
+    STEP_VMS(4);
+    ASSERT(vms[1].GetRegister(5).Value().u64 == 1, "Hart 1 didn't run its first program");
+
+    // Another hart's store to the mailbox starts hart 1 with clean registers
+    memory.WriteLong(START + 8, 0x1100);
+    vms[1].Step(4);
+
+    ASSERT(vms[1].GetPC() == 0x1104, "Started hart 1 is at {:x}, expected 1104", vms[1].GetPC());
+    ASSERT(vms[1].GetRegister(5).Value().u64 == 0, "Start kept hart 1's registers");
+    ASSERT(vms[1].GetRegister(6).Value().u64 == 2, "Hart 1 didn't run from its start address");
+    ASSERT(vms[0].GetRegister(5).Value().u64 == 1, "Starting hart 1 touched hart 0");
+
+    // A 32 bit store of the low word is enough
+    memory.WriteWord(START, 0x1300);
+    vms[0].Step(4);
+
+    ASSERT(vms[0].GetRegister(7).Value().u64 == 3, "Self restart left x7 at {}, expected 3", vms[0].GetRegister(7).Value().u64);
+    ASSERT(vms[0].GetPC() == 0x1204, "Self restarted hart is at {:x}, expected 1204", vms[0].GetPC());
+
+    ASSERT(memory.ReadLong(START) == 0, "Start mailbox reads back non zero");
+
+    SUCCESS;
+}
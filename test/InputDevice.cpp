@@ -0,0 +1,70 @@
+#include "Test.hpp"
+
+#include <InputDevice.hpp>
+
+DEFINE_TESTCASE(INPUT_DEVICE) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x1000);
+
+    auto input = MemoryInputDevice::Create();
+    memory.AddMemoryRegion(input);
+
+    SETUP_VM(0x1000);
+
+    constexpr Address REGS = MemoryInputDevice::DEFAULT_BASE;
+    constexpr Long MEIP = 1ULL << VirtualMachine::INTERRUPT_MACHINE_EXTERNAL;
+
+    std::unordered_map<Long, Long> csrs;
+
+    ASSERT(memory.ReadWord(REGS + MemoryInputDevice::EVENT_OFFSET) == MemoryInputDevice::EVENT_NONE, "Empty queue showed an event");
+
+    auto key = Random<Word>(0, 100);
+    auto x = Random<Word>(0, 0xffff);
+    auto y = Random<Word>(0, 0xffff);
+
+    input->PushKey(key, true);
+    input->PushMotion(x, y);
+    input->PushButton(1, false);
+
+    vm.GetCSRSnapshot(csrs);
+    ASSERT(csrs[VirtualMachine::CSR_MIP] & MEIP, "Pushing an event didn't raise the interrupt");
+    ASSERT(memory.ReadWord(REGS + MemoryInputDevice::COUNT_OFFSET) == 3, "Queue holds {} events, expected 3", memory.ReadWord(REGS + MemoryInputDevice::COUNT_OFFSET));
+
+    Word expected[] = {
+        MemoryInputDevice::EVENT_KEY | MemoryInputDevice::EVENT_PRESSED | key << MemoryInputDevice::EVENT_CODE_SHIFT,
+        MemoryInputDevice::EVENT_MOTION,
+        MemoryInputDevice::EVENT_BUTTON | 1 << MemoryInputDevice::EVENT_CODE_SHIFT
+    };
+
+    for (int i = 0; i < 3; i++) {
+        auto event = memory.ReadWord(REGS + MemoryInputDevice::EVENT_OFFSET);
+        ASSERT(event == expected[i], "Event {} read {:x}, expected {:x}", i, event, expected[i]);
+
+        // Reading again shows the same event until NEXT drops it
+        ASSERT(memory.ReadWord(REGS + MemoryInputDevice::EVENT_OFFSET) == event, "Reading event {} popped it", i);
+
+        if (i == 1) {
+            auto data = memory.ReadWord(REGS + MemoryInputDevice::DATA_OFFSET);
+            ASSERT(data == (x | y << 16), "Motion data read {:x}, expected {:x}", data, x | y << 16);
+        }
+
+        memory.WriteWord(REGS + MemoryInputDevice::NEXT_OFFSET, 0);
+
+        // Still queued events keep the interrupt raised through a clear
+        memory.WriteWord(REGS + MemoryInputDevice::INTERRUPT_OFFSET, 0);
+        vm.GetCSRSnapshot(csrs);
+        bool pending = csrs[VirtualMachine::CSR_MIP] & MEIP;
+        ASSERT(pending == (i < 2), "Interrupt pending {} with {} events left", pending, 2 - i);
+    }
+
+    ASSERT(memory.ReadWord(REGS + MemoryInputDevice::EVENT_OFFSET) == MemoryInputDevice::EVENT_NONE, "Drained queue showed an event");
+
+    // A full queue drops and counts the rest
+    for (size_t i = 0; i < MemoryInputDevice::QUEUE_SIZE; i++)
+        input->PushKey(0, true);
+
+    ASSERT(!input->PushKey(0, false), "Push into a full queue succeeded");
+    ASSERT(memory.ReadWord(REGS + MemoryInputDevice::DROPPED_OFFSET) == 1, "Dropped count reads {}", memory.ReadWord(REGS + MemoryInputDevice::DROPPED_OFFSET));
+
+    SUCCESS;
+}
@@ -0,0 +1,56 @@
+#include "Test.hpp"
+
+#include <filesystem>
+
+DEFINE_TESTCASE(INSTRUCTION_TRACE) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x2000);
+
+    auto value = Random<Word>(1, 0x7ff);
+
+    std::vector<Word> program = {
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 0, value),
+        RV64_U(RVInstruction::OP_LUI, 6, 0x2),
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 6, 5, 8),
+        RV64_I(RVInstruction::OP_LOAD, 7, RVInstruction::FUNCT3_LD, 6, 8),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BEQ, 5, 7, 8),
+        0,
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 0, RVInstruction::FUNCT3_ADDI, 0, 0)
+    };
+
+    memory.WriteWords(0x1000, program);
+
+    auto path = (std::filesystem::temp_directory_path() / "rv64_instruction_trace_test.bin").string();
+
+    vm.StartInstructionTrace(path);
+    STEP_VMS(program.size() - 1);
+    vm.StopInstructionTrace();
+
+    std::vector<InstructionTraceRecord> records;
+    {
+        InstructionTraceReader reader(path);
+        InstructionTraceRecord record;
+
+        while (reader.Next(record))
+            records.push_back(record);
+    }
+
+    std::filesystem::remove(path);
+
+    // The branch skips the illegal word
+    ASSERT(records.size() == 6, "Read {} records, expected 6", records.size());
+
+    ASSERT(records[0].pc == 0x1000 && records[0].raw == program[0], "First record is {:x} at {:x}", records[0].raw, records[0].pc);
+    ASSERT(records[0].writes_rd && records[0].rd == 5 && records[0].rd_value == value, "ADDI wrote x{} = {}", records[0].rd, records[0].rd_value);
+
+    ASSERT(!records[2].writes_rd && records[2].has_address && records[2].address == 0x2008, "SD accessed {:x}", records[2].address);
+    ASSERT(records[3].rd == 7 && records[3].rd_value == value && records[3].address == 0x2008, "LD read {} from {:x}", records[3].rd_value, records[3].address);
+
+    ASSERT(!records[4].writes_rd && !records[4].has_address, "BEQ recorded a writeback or access");
+    ASSERT(records[5].pc == 0x1018, "Branch target recorded at {:x}", records[5].pc);
+    ASSERT(!records[5].writes_rd, "Write to x0 was recorded");
+
+    SUCCESS;
+}
@@ -0,0 +1,139 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(JIT) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+    ADD_VM(1, 0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    vms[1].SetUseJIT(true);
+
+    // The loop body runs count - 1 times as its own block, so it must get hot
+    auto count = Random<Word>(JIT::HOT_THRESHOLD + 1, 0x100);
+    auto increment = Random<Word>(0, 0x7ff);
+    auto shift = Random<Word>(0, 31);
+
+    memory.WriteWords(0x1000, {
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 1, RVInstruction::FUNCT3_ADDI, 0, count),
+        RV64_U(RVInstruction::OP_LUI, 5, Random<Word>(0, 0xfffff)),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 2, RVInstruction::FUNCT3_ADDI, 2, increment),
+        RV64_R(RVInstruction::OP_MATH, 3, RVInstruction::FUNCT3_ADD_SUB_MUL, 3, 2, RVInstruction::FUNCT7_MUL),
+        RV64_R(RVInstruction::OP_MATH, 4, RVInstruction::FUNCT3_XOR_DIV, 4, 3, RVInstruction::FUNCT7_XOR),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 6, RVInstruction::FUNCT3_SLLI, 4, shift),
+        RV64_R(RVInstruction::OP_MATH, 7, RVInstruction::FUNCT3_SLTU_MULHU, 6, 5, RVInstruction::FUNCT7_SLTU),
+        RV64_R(RVInstruction::OP_MATH_W, 8, RVInstruction::FUNCT3_ADD_SUB_MUL, 8, 6, RVInstruction::FUNCT7_SUB),
+        RV64_U(RVInstruction::OP_AUIPC, 9, Random<Word>(0, 0xfffff)),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 1, RVInstruction::FUNCT3_ADDI, 1, 0xfff),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BNE, 1, 0, 0x2000 - 8 * 4)
+    });
+
+    vms[0].GetRegister(3).Value().u64 = 1;
+    vms[1].GetRegister(3).Value().u64 = 1;
+
+    Long steps = 2 + count * 9;
+
+    vms[0].Step(steps);
+    vms[1].StepBlocks(steps);
+
+    for (size_t i = 0; i < VirtualMachine::REGISTER_COUNT; i++) {
+        auto expected = vms[0].GetRegister(i).Value().u64;
+        auto got = vms[1].GetRegister(i).Value().u64;
+
+        ASSERT(expected == got, "Register {} differs between the interpreter and the JIT. Expected {:x}, got {:x}", i, expected, got);
+    }
+
+    ASSERT(vms[0].GetPC() == vms[1].GetPC(), "PC differs between the interpreter and the JIT. Expected {:x}, got {:x}", vms[0].GetPC(), vms[1].GetPC());
+
+    if (JIT::IsHostSupported())
+        ASSERT(vms[1].GetJITCoverage() > 0.0, "JIT did not compile the hot loop");
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(JIT_DIVIDE) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+    ADD_VM(1, 0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    vms[1].SetUseJIT(true);
+
+    // Every quotient and remainder is folded into x15 and x16. The divisor
+    // in x2 steps through zero partway into the loop, x3 holds -1, and x4 and
+    // x5 the most negative long and word, which overflow divided by it
+    auto count = Random<Word>(JIT::HOT_THRESHOLD + 3, 0x100);
+    auto increment = Random<Word>(1, 0x7ff);
+    auto step = Random<Word>(1, 0x7ff);
+
+    std::vector<Word> loop = {
+        RVInstruction::Encode(Type::ADDI, 2, 2, 0, increment),
+        RVInstruction::Encode(Type::DIV, 10, 11, 2, 0),
+        RVInstruction::Encode(Type::DIVU, 12, 11, 2, 0),
+        RVInstruction::Encode(Type::DIVW, 13, 11, 2, 0),
+        RVInstruction::Encode(Type::DIVUW, 14, 11, 2, 0),
+        RVInstruction::Encode(Type::ADD, 15, 15, 10, 0),
+        RVInstruction::Encode(Type::XOR, 15, 15, 12, 0),
+        RVInstruction::Encode(Type::ADD, 16, 16, 13, 0),
+        RVInstruction::Encode(Type::XOR, 16, 16, 14, 0),
+        RVInstruction::Encode(Type::REM, 10, 11, 2, 0),
+        RVInstruction::Encode(Type::REMU, 12, 11, 2, 0),
+        RVInstruction::Encode(Type::REMW, 13, 11, 2, 0),
+        RVInstruction::Encode(Type::REMUW, 14, 11, 2, 0),
+        RVInstruction::Encode(Type::ADD, 15, 15, 10, 0),
+        RVInstruction::Encode(Type::XOR, 15, 15, 12, 0),
+        RVInstruction::Encode(Type::ADD, 16, 16, 13, 0),
+        RVInstruction::Encode(Type::XOR, 16, 16, 14, 0),
+        RVInstruction::Encode(Type::DIV, 10, 11, 3, 0),
+        RVInstruction::Encode(Type::REM, 12, 11, 3, 0),
+        RVInstruction::Encode(Type::ADD, 15, 15, 10, 0),
+        RVInstruction::Encode(Type::XOR, 16, 16, 12, 0),
+        RVInstruction::Encode(Type::DIV, 10, 4, 3, 0),
+        RVInstruction::Encode(Type::REM, 12, 4, 3, 0),
+        RVInstruction::Encode(Type::DIVW, 13, 5, 3, 0),
+        RVInstruction::Encode(Type::REMW, 14, 5, 3, 0),
+        RVInstruction::Encode(Type::ADD, 15, 15, 10, 0),
+        RVInstruction::Encode(Type::XOR, 15, 15, 12, 0),
+        RVInstruction::Encode(Type::ADD, 16, 16, 13, 0),
+        RVInstruction::Encode(Type::XOR, 16, 16, 14, 0),
+        RVInstruction::Encode(Type::ADDI, 11, 11, 0, step),
+        RVInstruction::Encode(Type::ADDI, 1, 1, 0, -1)
+    };
+
+    auto length = static_cast<SWord>(loop.size());
+    loop.push_back(RVInstruction::Encode(Type::BNE, 0, 1, 0, -length * 4));
+    loop.insert(loop.begin(), RVInstruction::Encode(Type::ADDI, 1, 0, 0, count));
+
+    memory.WriteWords(0x1000, loop);
+
+    Long divisor = -static_cast<Long>(increment) * Random<Long>(JIT::HOT_THRESHOLD + 1, count - 1);
+    Long dividend = RandomInt();
+
+    for (auto& vm : vms) {
+        vm.GetRegister(2).Value().u64 = divisor;
+        vm.GetRegister(11).Value().u64 = dividend;
+        vm.GetRegister(3).Value().u64 = -1ULL;
+        vm.GetRegister(4).Value().u64 = 1ULL << 63;
+        vm.GetRegister(5).Value().u64 = -1ULL << 31;
+    }
+
+    Long steps = 1 + count * (length + 1);
+
+    vms[0].Step(steps);
+    vms[1].StepBlocks(steps);
+
+    for (size_t i = 0; i < VirtualMachine::REGISTER_COUNT; i++) {
+        auto expected = vms[0].GetRegister(i).Value().u64;
+        auto got = vms[1].GetRegister(i).Value().u64;
+
+        ASSERT(expected == got, "Register {} differs between the interpreter and the JIT. Expected {:x}, got {:x}", i, expected, got);
+    }
+
+    if (JIT::IsHostSupported())
+        ASSERT(vms[1].GetJITCoverage() > 0.0, "JIT did not compile the divide loop");
+
+    SUCCESS;
+}
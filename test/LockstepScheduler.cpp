@@ -0,0 +1,90 @@
+#include "Test.hpp"
+
+#include <LockstepScheduler.hpp>
+
+#include <memory>
+
+DEFINE_SERIAL_TESTCASE(LOCKSTEP_SCHEDULER) {
+    constexpr Long ECALL_STOP = 0x2ae;
+    constexpr Address INDEX = 0x1700;
+    constexpr Address LOG = INDEX + 8;
+
+    auto harts = Random<Hart>(2, 4);
+    auto loops = Random<Word>(50, 300);
+
+    LockstepScheduler::Options options;
+    options.quantum = Random<Long>(1, 50);
+    options.seed = Random<Long>(0, 1000);
+
+    // Every hart claims a log slot with an AMO and writes its id into it,
+    // so the log records the order the harts ran in
+    std::vector<Word> program = {
+        RV64_I(RVInstruction::OP_CSR, 9, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_MHARTID),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 6, RVInstruction::FUNCT3_ADDI, 0, loops),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 7, RVInstruction::FUNCT3_ADDI, 0, 1),
+        RV64_U(RVInstruction::OP_LUI, 8, INDEX >> 12),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 8, RVInstruction::FUNCT3_ADDI, 8, INDEX & 0xfff),
+        RV64_R(RVInstruction::OP_ATOMIC, 5, RVInstruction::FUNCT3_ATOMIC, 8, 7, RVInstruction::FUNCT7_AMOADD_W),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_SLLI, 5, 2),
+        RV64_R(RVInstruction::OP_MATH, 5, RVInstruction::FUNCT3_ADD_SUB_MUL, 5, 8, RVInstruction::FUNCT7_ADD),
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SW, 5, 9, LOG - INDEX),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 6, RVInstruction::FUNCT3_ADDI, 6, -1),
+        RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BNE, 6, 0, -20),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 0, ECALL_STOP),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_ECALL)
+    };
+
+    auto RunOnce = [&](LockstepScheduler::Mode mode, Long& rounds) {
+        SETUP_MEMORY;
+        ADD_RAM(0x1000, 0x4000);
+
+        memory.WriteWords(0x1000, program);
+
+        std::vector<std::unique_ptr<VirtualMachine>> machines;
+        std::vector<VirtualMachine*> schedule;
+
+        VirtualMachine::RegisterECall(ECALL_STOP, [&](Hart hart, bool, Memory&, auto&, auto&) {
+            machines[hart]->Stop();
+        });
+
+        for (Hart hart = 0; hart < harts; hart++) {
+            machines.push_back(std::make_unique<VirtualMachine>(memory, 0x1000, hart));
+            schedule.push_back(machines.back().get());
+            machines.back()->Start();
+        }
+
+        options.mode = mode;
+        options.threads = 2;
+
+        LockstepScheduler scheduler(memory, schedule, options);
+        scheduler.Start();
+        scheduler.Wait();
+
+        rounds = scheduler.GetRounds();
+
+        std::vector<Word> log;
+        for (Word i = 0; i < memory.ReadWord(INDEX); i++)
+            log.push_back(memory.ReadWord(LOG + i * sizeof(Word)));
+
+        return log;
+    };
+
+    Long first_rounds = 0;
+    Long second_rounds = 0;
+
+    auto first = RunOnce(LockstepScheduler::Mode::RoundRobin, first_rounds);
+    auto second = RunOnce(LockstepScheduler::Mode::RoundRobin, second_rounds);
+
+    ASSERT(first.size() == harts * loops, "Logged {} slots, expected {}", first.size(), harts * loops);
+    ASSERT(first == second, "Two runs with seed {} interleaved differently", options.seed);
+    ASSERT(first_rounds == second_rounds, "Two runs took {} and {} rounds", first_rounds, second_rounds);
+
+    // Parallel epochs still agree on how long the run took
+    RunOnce(LockstepScheduler::Mode::Epochs, first_rounds);
+    auto epochs = RunOnce(LockstepScheduler::Mode::Epochs, second_rounds);
+
+    ASSERT(epochs.size() == harts * loops, "Epochs logged {} slots, expected {}", epochs.size(), harts * loops);
+    ASSERT(first_rounds == second_rounds, "Two epoch runs took {} and {} epochs", first_rounds, second_rounds);
+
+    SUCCESS;
+}
@@ -0,0 +1,55 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(MEMORY_CLONE) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x8000);
+
+    constexpr Address DATA = 0x5000;
+
+    auto value = Random<Long>(1, UINT32_MAX);
+    auto other = value + Random<Long>(1, UINT32_MAX);
+
+    std::vector<Word> program = {
+        RV64_U(RVInstruction::OP_LUI, 8, DATA >> 12),
+        RV64_I(RVInstruction::OP_LOAD, 5, RVInstruction::FUNCT3_LD, 8, 0),
+        RV64_I(RVInstruction::OP_LOAD, 6, RVInstruction::FUNCT3_LD, 8, 0),
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 6, 8)
+    };
+
+    memory.WriteWords(0x1000, program);
+    memory.WriteLong(DATA, value);
+
+    auto clone = memory.Clone();
+    auto ram = clone->FindMemoryRegionOfType<MemoryRAM>(MemoryRegion::TYPE_GENERAL_RAM);
+
+    ASSERT(clone->ReadLong(DATA) == value, "Clone read {:x}, expected {:x}", clone->ReadLong(DATA), value);
+    ASSERT(ram->SizeInMemory() == 0, "Clone copied {:x} bytes before writing", ram->SizeInMemory());
+
+    // Writes on either side stay on that side
+    memory.WriteLong(DATA + 16, other);
+    ASSERT(clone->ReadLong(DATA + 16) == 0, "Parent write showed up in the clone");
+
+    {
+        VirtualMachine vm(*clone, 0x1000, 0);
+        vm.Start();
+
+        // The hart caches the shared page, then a write makes it private
+        vm.Step(2);
+        clone->WriteLong(DATA, other);
+        vm.Step(2);
+
+        auto& loaded = vm.GetRegister(6).Value();
+        ASSERT(loaded.u64 == other, "Hart read {:x} from the shared page after it was copied", loaded.u64);
+    }
+
+    ASSERT(clone->ReadLong(DATA + 8) == other, "Hart store missing from the clone");
+    ASSERT(memory.ReadLong(DATA) == value && memory.ReadLong(DATA + 8) == 0, "Clone writes reached the parent");
+    ASSERT(ram->SizeInMemory() == MemoryRAM::PAGE_SIZE, "Clone holds {:x} bytes, expected one page", ram->SizeInMemory());
+
+    // A clone of a clone starts from its parent's writes
+    auto grandchild = clone->Clone();
+    ASSERT(grandchild->ReadLong(DATA + 8) == other, "Grandchild missed its parent's store");
+    ASSERT(grandchild->ReadWord(0x1000) == program[0], "Grandchild lost the original image");
+
+    SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include "Test.hpp"
+
+#include <filesystem>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/stat.h>
+#endif
+
+DEFINE_SERIAL_TESTCASE(MEMORY_FILE) {
+    constexpr Address BASE = 0x10000;
+    constexpr Address SIZE = 64 * 1024 * 1024;
+
+    SETUP_MEMORY;
+    ADD_RAM(BASE, SIZE);
+
+    // Runs across pages and across chunks, at unaligned addresses
+    std::vector<std::pair<Address, std::vector<Byte>>> runs;
+    for (Address start : {BASE + 0x3, BASE + Memory::FILE_CHUNK_SIZE - 0x801, BASE + 0x2000005, BASE + SIZE - 0x1100}) {
+        auto& [address, bytes] = runs.emplace_back(start, std::vector<Byte>(Random<Address>(1, 0x1000)));
+
+        for (auto& byte : bytes)
+            byte = Random<Byte>(1, 0xff);
+
+        memory.WriteBytes(address, bytes);
+    }
+
+    // Touched but zero, so it's left out of the file like untouched pages
+    memory.WriteLong(BASE + 0x1000000, 1);
+    memory.WriteLong(BASE + 0x1000000, 0);
+
+    auto path = (std::filesystem::temp_directory_path() / "rv64_memory_file_test.bin").string();
+
+    for (bool direct_io : {false, true}) {
+        FileTransferOptions options;
+        options.threads = Random<unsigned>(1, 8);
+        options.direct_io = direct_io;
+
+        memory.WriteToFile(path, BASE, SIZE, options);
+        ASSERT(std::filesystem::file_size(path) == SIZE, "The dump is {:x} bytes, expected {:x}", std::filesystem::file_size(path), SIZE);
+
+#if !defined(_WIN32) && !defined(_WIN64)
+        struct stat info;
+        stat(path.c_str(), &info);
+        ASSERT(static_cast<Address>(info.st_blocks) * 512 < SIZE / 4, "The dump takes {:x} bytes on disk", info.st_blocks * 512);
+#endif
+
+        // Loading over pages that already hold something zeroes them where
+        // the file has holes, and leaves the rest of the RAM untouched
+        Memory loaded;
+        loaded.AddMemoryRegion(MemoryRAM::Create(BASE, SIZE));
+        loaded.WriteLong(BASE + 0x3000000, Random<Long>(1, UINT32_MAX));
+
+        auto used = loaded.GetUsedMemory();
+
+        auto size = loaded.ReadFileInto(path, BASE, options);
+        ASSERT(size == SIZE, "Loaded {:x} bytes, expected {:x}", size, SIZE);
+
+        for (auto& [address, bytes] : runs) {
+            std::vector<Byte> read(bytes.size());
+            loaded.ReadBytes(address, read);
+
+            ASSERT(read == bytes, "The run at {:x} came back changed", address);
+        }
+
+        ASSERT(loaded.ReadLong(BASE + 0x3000000) == 0, "A hole in the file didn't zero the page under it");
+        ASSERT(loaded.GetUsedMemory() <= used + 8 * Memory::PAGE_SIZE, "Loading took {:x} bytes, up from {:x}", loaded.GetUsedMemory(), used);
+    }
+
+    // A range starting inside a page, loaded somewhere else
+    memory.WriteToFile(path, BASE + 0x3, 0x3000);
+
+    Memory moved;
+    moved.AddMemoryRegion(MemoryRAM::Create(BASE, SIZE));
+    moved.ReadFileInto(path, BASE + 0x1003);
+
+    std::vector<Byte> read(runs[0].second.size());
+    moved.ReadBytes(BASE + 0x1003, read);
+    ASSERT(read == runs[0].second, "The unaligned range came back changed");
+
+    // Ranges past the RAM throw like single accesses
+    bool threw = false;
+    try {
+        memory.WriteToFile(path, BASE + SIZE - 0x1000, 0x2000);
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+
+    ASSERT(threw, "Dumping past the end of memory didn't throw");
+
+    std::filesystem::remove(path);
+
+    SUCCESS;
+}
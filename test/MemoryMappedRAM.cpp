@@ -0,0 +1,28 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(MEMORY_MAPPED_RAM) {
+    SETUP_MEMORY;
+
+    auto base = Random<Address>(1, 0x1000) * MemoryMappedRAM::PAGE_SIZE;
+    auto size = Random<Address>(0x10, 0x100) * MemoryMappedRAM::PAGE_SIZE;
+
+    memory.AddMemoryRegion(MemoryMappedRAM::Create(base, size));
+
+    ASSERT(memory.ReadLong(base + size - 8) == 0, "Untouched guest RAM is not zero");
+
+    auto offset = Random<Address>(0, size / 8) * 8;
+    auto value = Random<Long>(0, LONG_MAX);
+
+    memory.WriteLong(offset + base, value);
+    memory.WriteByte(offset + base + 1, 0xa5);
+    memory.WriteHalf(offset + base + 6, 0x1234);
+
+    Long expected = (value & 0x0000ffffffff00ffULL) | 0x000000000000a500ULL | 0x1234000000000000ULL;
+    ASSERT(memory.ReadLong(offset + base) == expected, "Expected {:x}, got {:x}", expected, memory.ReadLong(offset + base));
+    ASSERT(memory.ReadWord(offset + base + 4) == static_cast<Word>(expected >> 32), "Word read disagrees with long read");
+
+    memory.Prefault(base, size);
+    ASSERT(memory.GetUsedMemory() >= size, "Prefaulted {:x} bytes but only {:x} are resident", size, memory.GetUsedMemory());
+
+    SUCCESS;
+}
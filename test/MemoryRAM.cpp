@@ -0,0 +1,38 @@
+#include "Test.hpp"
+
+#include <thread>
+
+DEFINE_TESTCASE(MEMORY_RAM_PAGES) {
+    constexpr Address pages = 64;
+    constexpr size_t threads = 4;
+
+    auto ram = MemoryRAM::Create(0, pages * MemoryRAM::PAGE_SIZE);
+
+    auto prefaulted = Random<Address>(1, pages);
+    ram->Prefault(0, prefaulted * MemoryRAM::PAGE_SIZE);
+
+    ASSERT(ram->SizeInMemory() == prefaulted * MemoryRAM::PAGE_SIZE, "Prefaulting {} pages left {:x} bytes resident", prefaulted, ram->SizeInMemory());
+
+    // Every thread touches every page so first touches race
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back([&ram, i]() {
+            for (Address page = 0; page < pages; page++)
+                ram->WriteLong(page * MemoryRAM::PAGE_SIZE + i * sizeof(Long), page * threads + i);
+        });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    ASSERT(ram->SizeInMemory() == pages * MemoryRAM::PAGE_SIZE, "Expected {:x} bytes resident, got {:x}", pages * MemoryRAM::PAGE_SIZE, ram->SizeInMemory());
+
+    for (Address page = 0; page < pages; page++) {
+        for (size_t i = 0; i < threads; i++) {
+            auto value = ram->ReadLong(page * MemoryRAM::PAGE_SIZE + i * sizeof(Long));
+            ASSERT(value == page * threads + i, "Write to page {} from thread {} was lost", page, i);
+        }
+    }
+
+    SUCCESS;
+}
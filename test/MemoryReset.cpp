@@ -0,0 +1,30 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(MEMORY_RESET) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x8000);
+
+    auto base = Random<Address>(0x10000, 0x1000000000) & ~(Memory::PAGE_SIZE - 1);
+    ADD_RAM(base, 0x3000);
+
+    SETUP_VM(0x1000);
+
+    memory.WriteLong(base + 8, 0x55);
+    memory.SetHartNode(0, 1);
+    memory.ReadLongReserved(0x1000, 0);
+
+    vms.clear();
+    memory.Reset();
+
+    ASSERT(memory.GetMemoryRegions().size() == 1, "{} regions survived the reset", memory.GetMemoryRegions().size());
+    ASSERT(memory.TryReadLong(base + 8).second == Memory::AccessFault::Unmapped, "RAM at {:x} is still mapped", base);
+    ASSERT(memory.ReadLong(1 * 32) == 0 && memory.ReadLong(0x200) == 0, "PMA ROM still lists the old regions");
+
+    // Mapped again, the same addresses start out clean
+    ADD_RAM(0x1000, 0x8000);
+    ASSERT(memory.ReadLong(0x1000) == 0, "Reset RAM kept its contents");
+    ASSERT(!memory.WriteLongConditional(0x1000, 1, 0), "Reservation survived the reset");
+    ASSERT(memory.GetMaxAddress() == 0x9000, "Max address is {:x}", memory.GetMaxAddress());
+
+    SUCCESS;
+}
@@ -0,0 +1,34 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(MEMORY_ROUTING) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    constexpr Address chunk = 0x200000;
+
+    // Keep clear of the CLINT at 0x2000000
+    auto ram_base = Random<Address>(0x20, 0x100) * chunk + Random<Address>(0, 0x200) * MemoryRAM::PAGE_SIZE;
+    auto ram_size = Random<Address>(1, 0x400) * MemoryRAM::PAGE_SIZE;
+
+    ADD_RAM(0x1000, 0x1000);
+    ADD_RAM(ram_base, ram_size);
+    ADD_ROM_BYTES(ram_base + ram_size, std::vector<Long>({0x0123456789abcdef}));
+
+    auto offset = Random<Address>(0, ram_size / 8) * 8;
+    auto value = Random<Long>(0, LONG_MAX);
+
+    memory.WriteLong(ram_base + offset, value);
+    ASSERT(memory.ReadLong(ram_base + offset) == value, "RAM at {:x} read back {:x}, expected {:x}", ram_base + offset, memory.ReadLong(ram_base + offset), value);
+
+    ASSERT(memory.ReadLong(ram_base + ram_size) == 0x0123456789abcdef, "ROM after RAM was not routed");
+
+    auto [_, mapped] = memory.PeekWord(ram_base + ram_size + 8);
+    ASSERT(!mapped, "Unmapped address {:x} was routed to a region", ram_base + ram_size + 8);
+
+    ASSERT(memory.ReadLong(0) == MemoryRegion::TYPE_PMA_ROM, "PMA ROM is not at address 0");
+
+    auto time_cmp = memory.ReadLong(MemoryCLINT::DEFAULT_BASE + MemoryCLINT::MTIMECMP_OFFSET);
+    ASSERT(time_cmp == MemoryCLINT::NO_DEADLINE, "CLINT is not at {:x}", MemoryCLINT::DEFAULT_BASE);
+
+    SUCCESS;
+}
@@ -0,0 +1,70 @@
+#include "Test.hpp"
+
+#include <span>
+
+DEFINE_TESTCASE(MEMORY_SPANS) {
+    SETUP_MEMORY;
+
+    constexpr Address LOW = 0x10000;
+    constexpr Address LOW_SIZE = 0x4000;
+    constexpr Address HIGH = 0x16000;
+    constexpr Address HIGH_SIZE = 0x4000;
+
+    ADD_RAM(LOW, LOW_SIZE);
+    ADD_RAM(HIGH, HIGH_SIZE);
+    ADD_ROM_BYTES(HIGH + HIGH_SIZE, std::vector<Long>({0x0123456789abcdef}));
+
+    // Unaligned on both ends and crossing a page
+    auto start = LOW + Random<Address>(1, 0xfff);
+    auto count = Random<Address>(0x1001, 0x2000);
+
+    std::vector<Byte> written(count);
+    for (auto& byte : written)
+        byte = Random<Byte>(0, 0xff);
+
+    memory.WriteBytes(start, written);
+
+    std::vector<Byte> read(count);
+    memory.ReadBytes(start, read);
+    ASSERT(read == written, "Bytes read back differ");
+
+    ASSERT(memory.ReadByte(start - 1) == 0 && memory.ReadByte(start + count) == 0, "Write spilled past its range");
+
+    auto high_ram = std::static_pointer_cast<MemoryRAM>(memory.GetMemoryRegions()[2]);
+    auto used = high_ram->SizeInMemory();
+
+    // Peeking across the gap between the RAMs and into the ROM zeroes the
+    // gap, reports both sides and doesn't fault untouched pages in
+    std::vector<Long> longs((HIGH + HIGH_SIZE + 8 - LOW) / sizeof(Long), ~0ULL);
+    auto ranges = memory.Peek(LOW, std::span<Long>(longs));
+
+    ASSERT(ranges.size() == 2, "Peek found {} runs", ranges.size());
+    ASSERT(ranges[0] == Memory::Range(LOW, LOW + LOW_SIZE), "First run is {:x}-{:x}", ranges[0].first, ranges[0].second);
+    ASSERT(ranges[1] == Memory::Range(HIGH, HIGH + HIGH_SIZE + 8), "Second run is {:x}-{:x}", ranges[1].first, ranges[1].second);
+
+    ASSERT(longs[(LOW + LOW_SIZE - LOW) / 8] == 0, "Unmapped bytes weren't zeroed");
+    ASSERT(longs.back() == 0x0123456789abcdef, "ROM read {:x}", longs.back());
+    ASSERT(!Memory::IsInRanges(ranges, LOW + LOW_SIZE, 4) && Memory::IsInRanges(ranges, HIGH, 4), "Range lookups disagree with the runs");
+
+    ASSERT(high_ram->SizeInMemory() == used, "Peek loaded {} bytes of pages", high_ram->SizeInMemory() - used);
+
+    auto words = memory.PeekWords(start & ~3, 4);
+    for (Address i = 0; i < words.size(); i++) {
+        Word expected;
+        memory.ReadBytes((start & ~3) + i * 4, std::span<Byte>(reinterpret_cast<Byte*>(&expected), 4));
+        ASSERT(words[i].second && words[i].first == expected, "PeekWords disagrees with ReadBytes at word {}", i);
+    }
+
+    // Reads and writes that touch the gap throw like single accesses
+    bool threw = false;
+    try {
+        memory.ReadBytes(LOW + LOW_SIZE - 4, read);
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+
+    ASSERT(threw, "Reading across the gap didn't throw");
+
+    SUCCESS;
+}
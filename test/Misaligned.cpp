@@ -0,0 +1,50 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(MISALIGNED) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x2000);
+
+    // One access inside a page, one crossing into the next
+    constexpr Address INSIDE = 0x1803;
+    constexpr Address CROSSING = 0x1ffd;
+
+    auto value = Random<Long>(0, SLONG_MAX);
+
+    vm.GetRegister(1).Value().u64 = value;
+    vm.GetRegister(2).Value().u64 = INSIDE;
+    vm.GetRegister(3).Value().u64 = CROSSING;
+
+    memory.WriteWords(0x1000, {
+        RVInstruction::Encode(Type::SD, 0, 2, 1, 0),
+        RVInstruction::Encode(Type::LD, 4, 2, 0, 0),
+        RVInstruction::Encode(Type::SD, 0, 3, 1, 0),
+        RVInstruction::Encode(Type::LD, 5, 3, 0, 0),
+        RVInstruction::Encode(Type::LW, 6, 3, 0, 1)
+    });
+
+    STEP_VMS(5);
+
+    for (Address i = 0; i < sizeof(Long); i++) {
+        Byte expected = value >> (i * 8);
+
+        auto got = memory.ReadByte(INSIDE + i);
+        ASSERT(got == expected, "Byte {} of the store inside a page is {:x}, expected {:x}", i, got, expected);
+
+        got = memory.ReadByte(CROSSING + i);
+        ASSERT(got == expected, "Byte {} of the store across pages is {:x}, expected {:x}", i, got, expected);
+    }
+
+    ASSERT(vm.GetRegister(4).Value().u64 == value, "Load inside a page gave {:x}, expected {:x}", vm.GetRegister(4).Value().u64, value);
+    ASSERT(vm.GetRegister(5).Value().u64 == value, "Load across pages gave {:x}, expected {:x}", vm.GetRegister(5).Value().u64, value);
+
+    Long word = static_cast<SLong>(static_cast<SWord>(value >> 8));
+    ASSERT(vm.GetRegister(6).Value().u64 == word, "Word load across pages gave {:x}, expected {:x}", vm.GetRegister(6).Value().u64, word);
+
+    ASSERT(vm.GetPC() == 0x1014, "Execution ended at {:x}, expected 1014", vm.GetPC());
+
+    SUCCESS;
+}
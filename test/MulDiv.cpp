@@ -0,0 +1,92 @@
+#include "Test.hpp"
+
+namespace {
+    struct Case {
+        RVInstruction::Type type;
+        Long lhs;
+        Long rhs;
+        Long expected;
+    };
+
+    // Each case runs as rd = x3, rs1 = x1, rs2 = x2
+    bool RunsAsExpected(Memory& memory, VirtualMachine& vm, const Case& test) {
+        memory.WriteWord(0x1000, RVInstruction::Encode(test.type, 3, 1, 2, 0));
+
+        vm.SetPC(0x1000);
+        vm.GetRegister(1).Value().u64 = test.lhs;
+        vm.GetRegister(2).Value().u64 = test.rhs;
+        vm.Step(1);
+
+        return vm.GetRegister(3).Value().u64 == test.expected;
+    }
+}
+
+DEFINE_TESTCASE(MULTIPLY_HIGH) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Long MIN = 1ULL << 63;
+    constexpr Long ONES = -1ULL;
+
+    const Case cases[] = {
+        {Type::MULH, 0xfedcba9876543210, 0x8123456789abcdef, 0x0090574ce8a1f04b},
+        {Type::MULHSU, 0xfedcba9876543210, 0x8123456789abcdef, 0xff6d11e55ef6225b},
+        {Type::MULHU, 0xfedcba9876543210, 0x8123456789abcdef, 0x8090574ce8a1f04a},
+        {Type::MULH, MIN, MIN, 0x4000000000000000},
+        {Type::MULH, MIN, ONES, 0},
+        {Type::MULH, ONES, 1, ONES},
+        {Type::MULHSU, ONES, ONES, ONES},
+        {Type::MULHU, ONES, ONES, ONES - 1},
+        {Type::MULHU, 1ULL << 32, 1ULL << 32, 1},
+    };
+
+    for (auto& test : cases) {
+        ASSERT(RunsAsExpected(memory, vm, test), "{:x} by {:x} gave {:x}, expected {:x}", test.lhs, test.rhs, vm.GetRegister(3).Value().u64, test.expected);
+    }
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(DIVIDE_EDGES) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Long MIN = 1ULL << 63;
+    constexpr Long MIN_WORD = -1ULL << 31;
+    constexpr Long ONES = -1ULL;
+
+    auto value = RandomInt() | 1;
+
+    // The spec's results for a zero divisor and for overflow, none of which
+    // trap
+    const Case cases[] = {
+        {Type::DIV, value, 0, ONES},
+        {Type::DIVU, value, 0, ONES},
+        {Type::REM, value, 0, value},
+        {Type::REMU, value, 0, value},
+        {Type::DIV, MIN, ONES, MIN},
+        {Type::REM, MIN, ONES, 0},
+        {Type::DIVW, value, 0, ONES},
+        {Type::DIVUW, value, 0, ONES},
+        {Type::REMW, 0x1234567880000000, 0, MIN_WORD},
+        {Type::REMUW, 0x1234567880000000, 0, MIN_WORD},
+        {Type::DIVW, MIN_WORD, ONES, MIN_WORD},
+        {Type::REMW, MIN_WORD, ONES, 0},
+        {Type::DIV, -7ULL, 2, -3ULL},
+        {Type::REM, -7ULL, 2, ONES},
+    };
+
+    for (auto& test : cases) {
+        ASSERT(RunsAsExpected(memory, vm, test), "{:x} by {:x} gave {:x}, expected {:x}", test.lhs, test.rhs, vm.GetRegister(3).Value().u64, test.expected);
+    }
+
+    SUCCESS;
+}
@@ -0,0 +1,54 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(MultiGuest) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x10000);
+
+    // Both guests boot the same image, stored once before the clone
+    memory.WriteWords(0x1000, {
+        RVInstruction::Encode(Type::ADDI, 5, 0, 0, 1),
+        RVInstruction::Encode(Type::SD, 0, 6, 5, 0),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0)
+    });
+
+    auto other = memory.Clone();
+    ASSERT(other->GetUsedMemory() < Memory::PAGE_SIZE, "Clone holds {} bytes of its own before running", other->GetUsedMemory());
+
+    SETUP_VM(0x1000);
+    ADD_VM(1, 0x1000);
+
+    std::vector<VirtualMachine> other_vms;
+    other_vms.emplace_back(VirtualMachine(*other, 0x1000, 0));
+    other_vms[0].Start();
+
+    // Each guest gets a CLINT of its own, and only sees its own harts
+    auto clint = memory.FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+    auto other_clint = other->FindMemoryRegionOfType<MemoryCLINT>(MemoryRegion::TYPE_CLINT);
+
+    ASSERT(clint && other_clint && clint != other_clint, "Guests share a CLINT");
+    ASSERT(clint->GetHartCount() == 2 && other_clint->GetHartCount() == 1, "CLINTs count {} and {} harts", clint->GetHartCount(), other_clint->GetHartCount());
+    ASSERT(other_clint->GetHart(0) == &other_vms[0], "Guest hart 0 isn't the one attached");
+
+    for (auto* hart : {&vms[0], &vms[1], &other_vms[0]})
+        hart->GetRegister(6).Value().u64 = 0x1800;
+
+    STEP_VMS(3);
+    other_vms[0].Step(3);
+
+    // Stores land in each guest's own copy of the page
+    other->WriteLong(0x1800, 7);
+    ASSERT(memory.ReadLong(0x1800) == 1, "Guest 0 read {} back", memory.ReadLong(0x1800));
+    ASSERT(other->ReadLong(0x1800) == 7, "Guest 1 read {} back", other->ReadLong(0x1800));
+
+    // Starting hart 0 through one guest's mailbox leaves the other alone
+    other->WriteLong(MemoryCLINT::DEFAULT_BASE + MemoryCLINT::START_OFFSET, 0x1008);
+    other_vms[0].Step(1);
+    vms[0].Step(1);
+
+    ASSERT(other_vms[0].GetRegister(5).Value().u64 == 0, "Started hart kept its registers");
+    ASSERT(vms[0].GetRegister(5).Value().u64 == 1 && vms[0].GetPC() == 0x1008, "Other guest's start reached guest 0");
+
+    SUCCESS;
+}
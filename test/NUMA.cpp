@@ -0,0 +1,37 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(NUMA) {
+    SETUP_MEMORY;
+
+    constexpr Address NODE_SIZE = 0x10000;
+
+    // Every host has a node 0, so binding to it works anywhere
+    auto near = MemoryMappedRAM::Create(0x10000, NODE_SIZE, false, 0);
+    auto far = MemoryRAM::Create(0x20000, NODE_SIZE);
+    far->node = 1;
+
+    memory.AddMemoryRegion(std::move(near));
+    memory.AddMemoryRegion(std::move(far));
+
+    memory.WriteLong(0x10000 + NODE_SIZE - 8, 0x1122334455667788);
+    ASSERT(memory.ReadLong(0x10000 + NODE_SIZE - 8) == 0x1122334455667788, "Bound RAM didn't hold a store");
+
+    memory.SetHartNode(0, 0);
+    memory.SetHartNode(1, 1);
+    memory.SetHartNode(2, 1);
+
+    // Regions are listed in the order they were added, after the ROM itself
+    auto near_flags = memory.ReadLong(1 * 32 + 24);
+    auto far_flags = memory.ReadLong(2 * 32 + 24);
+
+    ASSERT(memory.ReadLong(1 * 32 + 8) == 0x10000 && (near_flags >> 16) == 0, "Node 0 RAM reports node {}", near_flags >> 16);
+    ASSERT(memory.ReadLong(2 * 32 + 8) == 0x20000 && (far_flags >> 16) == 1, "Node 1 RAM reports node {}", far_flags >> 16);
+    ASSERT((far_flags & 3) == 3, "Node bits clobbered the access flags");
+
+    auto hart_nodes = memory.ReadLong(0x200);
+    ASSERT(hart_nodes == 0x010100, "Hart nodes read {:x}, expected 10100", hart_nodes);
+
+    ASSERT(NUMA::GetNodeCount() >= 1 && !NUMA::GetNodeCPUs(0).empty(), "Host reports no node with CPUs");
+
+    SUCCESS;
+}
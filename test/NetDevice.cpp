@@ -0,0 +1,138 @@
+#include "Test.hpp"
+
+#include <NetDevice.hpp>
+
+#include <chrono>
+#include <thread>
+
+namespace {
+    // Keeps every frame sent, joined back together
+    class RecordingBackend : public MemoryNetDevice::Backend {
+    public:
+        std::vector<std::vector<Byte>> sent;
+        bool attached = false;
+
+        void Attach(MemoryNetDevice&) override { attached = true; }
+        void Detach() override { attached = false; }
+
+        bool Transmit(std::span<const std::span<const Byte>> frame) override {
+            auto& joined = sent.emplace_back();
+            for (auto piece : frame)
+                joined.insert(joined.end(), piece.begin(), piece.end());
+
+            return true;
+        }
+    };
+}
+
+DEFINE_TESTCASE(NET_DEVICE) {
+    constexpr Address TX_RING = 0x2000;
+    constexpr Address RX_RING = 0x2800;
+    constexpr Address REGS = MemoryNetDevice::DEFAULT_BASE;
+
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x10000);
+
+    auto net = MemoryNetDevice::Create();
+    memory.AddMemoryRegion(net);
+
+    auto backend = std::make_shared<RecordingBackend>();
+    net->SetBackend(backend);
+    ASSERT(backend->attached, "The backend wasn't attached");
+
+    ASSERT(memory.ReadLong(REGS + MemoryNetDevice::MAC_OFFSET) == MemoryNetDevice::DEFAULT_MAC, "MAC reads {:x}", memory.ReadLong(REGS + MemoryNetDevice::MAC_OFFSET));
+
+    auto Describe = [&](Address ring, Long index, Address buffer, Word length) {
+        Address descriptor = ring + index * MemoryNetDevice::DESCRIPTOR_SIZE;
+
+        memory.WriteLong(descriptor + MemoryNetDevice::DESCRIPTOR_BUFFER, buffer);
+        memory.WriteWord(descriptor + MemoryNetDevice::DESCRIPTOR_LENGTH, length);
+        memory.WriteWord(descriptor + MemoryNetDevice::DESCRIPTOR_STATUS, MemoryNetDevice::STATUS_PENDING);
+    };
+
+    auto Field = [&](Address ring, Long index, Address field) { return memory.ReadWord(ring + index * MemoryNetDevice::DESCRIPTOR_SIZE + field); };
+
+    // Frames crossing guest pages, sent in one doorbell with one interrupt
+    std::vector<std::vector<Byte>> frames;
+    Address buffer = 0x3f00;
+    for (int i = 0; i < 3; i++) {
+        auto& frame = frames.emplace_back(Random<Word>(60, 1514));
+        for (auto& byte : frame)
+            byte = Random<Byte>(0, 0xff);
+
+        for (size_t j = 0; j < frame.size(); j++)
+            memory.WriteByte(buffer + j, frame[j]);
+
+        Describe(TX_RING, i, buffer, frame.size());
+        buffer += 0x1000;
+    }
+
+    memory.WriteLong(REGS + MemoryNetDevice::TX_RING_ADDRESS_OFFSET, TX_RING);
+    memory.WriteLong(REGS + MemoryNetDevice::TX_RING_SIZE_OFFSET, 8);
+    memory.WriteWord(REGS + MemoryNetDevice::TX_SUBMIT_OFFSET, 3);
+
+    ASSERT(memory.ReadLong(REGS + MemoryNetDevice::TX_COMPLETED_OFFSET) == 3, "{} frames were sent", memory.ReadLong(REGS + MemoryNetDevice::TX_COMPLETED_OFFSET));
+    ASSERT(backend->sent.size() == 3, "The backend got {} frames", backend->sent.size());
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        ASSERT(backend->sent[i] == frames[i], "Frame {} went out changed", i);
+        ASSERT(Field(TX_RING, i, MemoryNetDevice::DESCRIPTOR_STATUS) == MemoryNetDevice::STATUS_OK, "Frame {} finished with {}", i, Field(TX_RING, i, MemoryNetDevice::DESCRIPTOR_STATUS));
+    }
+
+    ASSERT(memory.ReadLong(REGS + MemoryNetDevice::INTERRUPT_OFFSET) == 1, "Sending didn't raise the interrupt");
+    memory.WriteLong(REGS + MemoryNetDevice::INTERRUPT_OFFSET, 0);
+
+    // Nothing posted yet, so the frame is dropped
+    ASSERT(!net->Receive(frames[0]), "A frame was taken with no buffer posted");
+    ASSERT(memory.ReadLong(REGS + MemoryNetDevice::RX_DROPPED_OFFSET) == 1, "{} frames were dropped", memory.ReadLong(REGS + MemoryNetDevice::RX_DROPPED_OFFSET));
+
+    // A buffer crossing pages, one too small and one more, with the
+    // interrupt held back until three came in
+    Describe(RX_RING, 0, 0x8f80, 1514);
+    Describe(RX_RING, 1, 0xa000, 16);
+    Describe(RX_RING, 2, 0xb000, 1514);
+
+    memory.WriteLong(REGS + MemoryNetDevice::RX_RING_ADDRESS_OFFSET, RX_RING);
+    memory.WriteLong(REGS + MemoryNetDevice::RX_RING_SIZE_OFFSET, 4);
+    memory.WriteLong(REGS + MemoryNetDevice::COALESCE_FRAMES_OFFSET, 3);
+    memory.WriteLong(REGS + MemoryNetDevice::COALESCE_MICROS_OFFSET, 10'000'000);
+    memory.WriteLong(REGS + MemoryNetDevice::RX_SUBMIT_OFFSET, 3);
+
+    ASSERT(net->Receive(frames[1]), "The first posted buffer wasn't used");
+    ASSERT(net->Receive(frames[2]), "The small buffer wasn't used");
+    ASSERT(memory.ReadLong(REGS + MemoryNetDevice::INTERRUPT_OFFSET) == 0, "The interrupt came before three frames");
+
+    ASSERT(net->Receive(frames[0]), "The last posted buffer wasn't used");
+    ASSERT(memory.ReadLong(REGS + MemoryNetDevice::INTERRUPT_OFFSET) == 1, "Three frames didn't raise the interrupt");
+    ASSERT(memory.ReadLong(REGS + MemoryNetDevice::RX_COMPLETED_OFFSET) == 3, "{} frames came in", memory.ReadLong(REGS + MemoryNetDevice::RX_COMPLETED_OFFSET));
+
+    for (size_t j = 0; j < frames[1].size(); j++)
+        ASSERT(memory.ReadByte(0x8f80 + j) == frames[1][j], "Byte {} of the received frame is {:x}, expected {:x}", j, memory.ReadByte(0x8f80 + j), frames[1][j]);
+
+    ASSERT(Field(RX_RING, 0, MemoryNetDevice::DESCRIPTOR_LENGTH) == frames[1].size(), "The received frame is {} bytes, expected {}", Field(RX_RING, 0, MemoryNetDevice::DESCRIPTOR_LENGTH), frames[1].size());
+    ASSERT(Field(RX_RING, 0, MemoryNetDevice::DESCRIPTOR_STATUS) == MemoryNetDevice::STATUS_OK, "The received frame finished with {}", Field(RX_RING, 0, MemoryNetDevice::DESCRIPTOR_STATUS));
+
+    ASSERT(Field(RX_RING, 1, MemoryNetDevice::DESCRIPTOR_STATUS) == MemoryNetDevice::STATUS_ERROR, "A frame too big for its buffer finished with {}", Field(RX_RING, 1, MemoryNetDevice::DESCRIPTOR_STATUS));
+    ASSERT(Field(RX_RING, 1, MemoryNetDevice::DESCRIPTOR_LENGTH) == frames[2].size(), "A truncated frame reads {} bytes, expected {}", Field(RX_RING, 1, MemoryNetDevice::DESCRIPTOR_LENGTH), frames[2].size());
+    ASSERT(memory.ReadByte(0xa010) == 0, "A truncated frame ran past its buffer");
+
+    memory.WriteLong(REGS + MemoryNetDevice::INTERRUPT_OFFSET, 0);
+
+    // One frame short of the bound still raises it once the time is up
+    memory.WriteLong(REGS + MemoryNetDevice::COALESCE_MICROS_OFFSET, 1000);
+    Describe(RX_RING, 3, 0xc000, 1514);
+    memory.WriteLong(REGS + MemoryNetDevice::RX_SUBMIT_OFFSET, 4);
+
+    ASSERT(net->Receive(frames[2]), "The fourth posted buffer wasn't used");
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (memory.ReadLong(REGS + MemoryNetDevice::INTERRUPT_OFFSET) == 0 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+
+    ASSERT(memory.ReadLong(REGS + MemoryNetDevice::INTERRUPT_OFFSET) == 1, "The coalescing timer never raised the interrupt");
+
+    net->SetBackend(nullptr);
+    ASSERT(!backend->attached, "The backend wasn't detached");
+
+    SUCCESS;
+}
@@ -0,0 +1,103 @@
+#include "Test.hpp"
+
+#include <PLIC.hpp>
+
+DEFINE_TESTCASE(PLIC) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x1000);
+
+    auto plic = MemoryPLIC::Create();
+    memory.AddMemoryRegion(plic);
+
+    SETUP_VM(0x1000);
+
+    constexpr Address REGS = MemoryPLIC::DEFAULT_BASE;
+    constexpr Address CONTEXT = REGS + MemoryPLIC::CONTEXT_OFFSET;
+    constexpr Address SUPERVISOR_CONTEXT = CONTEXT + MemoryPLIC::CONTEXT_STRIDE;
+    constexpr Long MEIP = 1ULL << VirtualMachine::INTERRUPT_MACHINE_EXTERNAL;
+    constexpr Long SEIP = 1ULL << VirtualMachine::INTERRUPT_SUPERVISOR_EXTERNAL;
+
+    std::unordered_map<Long, Long> csrs;
+    auto Pending = [&]() {
+        vm.GetCSRSnapshot(csrs);
+        return csrs[VirtualMachine::CSR_MIP];
+    };
+
+    // Source 5 outranks source 3, both go to hart 0's machine context
+    memory.WriteWord(REGS + MemoryPLIC::PRIORITY_OFFSET + 3 * 4, 1);
+    memory.WriteWord(REGS + MemoryPLIC::PRIORITY_OFFSET + 5 * 4, 2);
+    memory.WriteWord(REGS + MemoryPLIC::ENABLE_OFFSET, (1 << 3) | (1 << 5));
+
+    plic->SetLevel(3, true);
+    ASSERT(Pending() & MEIP, "Raising an enabled source left MEIP clear");
+
+    plic->SetLevel(5, true);
+    ASSERT(memory.ReadWord(REGS + MemoryPLIC::PENDING_OFFSET) == ((1 << 3) | (1 << 5)), "Pending bits read {:x}", memory.ReadWord(REGS + MemoryPLIC::PENDING_OFFSET));
+
+    auto claimed = memory.ReadWord(CONTEXT + MemoryPLIC::CLAIM_OFFSET);
+    ASSERT(claimed == 5, "Claimed source {}, expected the higher priority 5", claimed);
+
+    claimed = memory.ReadWord(CONTEXT + MemoryPLIC::CLAIM_OFFSET);
+    ASSERT(claimed == 3, "Second claim got source {}, expected 3", claimed);
+    ASSERT(!(Pending() & MEIP), "MEIP still set with every source claimed");
+
+    // Completing a source whose line is still up pends it again
+    memory.WriteWord(CONTEXT + MemoryPLIC::CLAIM_OFFSET, 5);
+    ASSERT(plic->IsPending(5) && (Pending() & MEIP), "Completed source with its line up didn't pend again");
+
+    // A threshold at its priority masks it
+    memory.WriteWord(CONTEXT + MemoryPLIC::THRESHOLD_OFFSET, 2);
+    ASSERT(!(Pending() & MEIP), "Threshold 2 let a priority 2 source through");
+
+    memory.WriteWord(CONTEXT + MemoryPLIC::THRESHOLD_OFFSET, 0);
+    plic->SetLevel(5, false);
+    memory.WriteWord(CONTEXT + MemoryPLIC::CLAIM_OFFSET, 3);
+    plic->SetLevel(3, false);
+    ASSERT(!(Pending() & MEIP), "MEIP still set with every line down");
+    ASSERT(memory.ReadWord(CONTEXT + MemoryPLIC::CLAIM_OFFSET) == 0, "Claim with nothing pending returned a source");
+
+    // The supervisor context drives SEIP
+    memory.WriteWord(REGS + MemoryPLIC::ENABLE_OFFSET + MemoryPLIC::ENABLE_STRIDE, 1 << 3);
+    plic->SetLevel(3, true);
+    ASSERT((Pending() & (MEIP | SEIP)) == (MEIP | SEIP), "Pending interrupts {:x}, expected MEIP and SEIP", Pending());
+
+    ASSERT(memory.ReadWord(SUPERVISOR_CONTEXT + MemoryPLIC::CLAIM_OFFSET) == 3, "Supervisor context didn't claim source 3");
+    ASSERT(!(Pending() & (MEIP | SEIP)), "Claimed source left an external interrupt pending");
+
+    memory.WriteWord(SUPERVISOR_CONTEXT + MemoryPLIC::CLAIM_OFFSET, 3);
+
+    // With MEIE and mstatus.MIE set the pending source traps to mtvec
+    constexpr Address HANDLER = 0x1800;
+    vm.GetRegister(1).Value().u64 = 0x8;
+    vm.GetRegister(2).Value().u64 = MEIP;
+    vm.GetRegister(3).Value().u64 = HANDLER;
+
+    memory.WriteWords(0x1000, {
+        RVInstruction::Encode(Type::CSRRW, 0, 3, 0, VirtualMachine::CSR_MTVEC),
+        RVInstruction::Encode(Type::CSRRS, 0, 2, 0, VirtualMachine::CSR_MIE),
+        RVInstruction::Encode(Type::CSRRS, 0, 1, 0, VirtualMachine::CSR_MSTATUS),
+        RVInstruction::Encode(Type::ADDI, 4, 4, 0, 1)
+    });
+
+    // The handler counts once and then spins
+    memory.WriteWords(HANDLER, {
+        RVInstruction::Encode(Type::ADDI, 5, 5, 0, 1),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0)
+    });
+
+    STEP_VMS(6);
+
+    ASSERT(vm.GetPC() == HANDLER + 4, "Hart at {:x}, expected in the handler", vm.GetPC());
+    ASSERT(vm.GetRegister(5).Value().u64 == 1, "Handler ran {} times", vm.GetRegister(5).Value().u64);
+    ASSERT(vm.GetRegister(4).Value().u64 == 0, "The interrupted instruction ran");
+
+    vm.GetCSRSnapshot(csrs);
+    ASSERT(csrs[VirtualMachine::CSR_MEPC] == 0x100c, "mepc {:x}, expected the interrupted instruction", csrs[VirtualMachine::CSR_MEPC]);
+
+    auto cause = csrs[VirtualMachine::CSR_MCAUSE];
+    ASSERT(cause == ((1ULL << 31) | VirtualMachine::INTERRUPT_MACHINE_EXTERNAL), "mcause {:x}, expected the machine external interrupt", cause);
+
+    SUCCESS;
+}
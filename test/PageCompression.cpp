@@ -0,0 +1,123 @@
+#include "Test.hpp"
+
+#include <chrono>
+#include <thread>
+
+DEFINE_TESTCASE(PAGE_COMPRESSION) {
+    constexpr Address PAGE = MemoryRAM::PAGE_SIZE;
+    constexpr Address pages = 16;
+
+    constexpr Address HALF = MemoryRAM::LONGS_PER_PAGE / 2;
+
+    // Clear of the PMA ROM at 0
+    constexpr Address BASE = 0x100000;
+
+    SETUP_MEMORY;
+    ADD_RAM(BASE, pages * 2 * PAGE);
+
+    auto ram = memory.FindMemoryRegionOfType<MemoryRAM>(MemoryRegion::TYPE_GENERAL_RAM);
+
+    // Runs of small counters and of pointers sharing an upper half pack
+    // well, random words don't pack at all
+    constexpr Long POINTER = 0x3f80000000ULL;
+
+    auto Expected = [&](Address page, Address i) -> Long {
+        return i < HALF ? page * 1000 + i : POINTER + i * 16;
+    };
+
+    for (Address page = 0; page < pages; page++) {
+        for (Address i = 0; i < MemoryRAM::LONGS_PER_PAGE; i++)
+            memory.WriteLong(BASE + page * PAGE + i * sizeof(Long), Expected(page, i));
+    }
+
+    constexpr Address NOISE = BASE + pages * PAGE;
+    for (Address i = 0; i < MemoryRAM::LONGS_PER_PAGE; i++)
+        memory.WriteLong(NOISE + i * sizeof(Long), RandomInt() | (1ULL << 63));
+
+    memory.SetCompressionThresholds(PAGE, 0);
+
+    // Every page was just written, so the first pass finds none cold
+    ASSERT(memory.CompressColdPages() == 0, "Pages used since the start were packed");
+
+    auto used = ram->SizeInMemory();
+    ASSERT(used == (pages + 1) * PAGE, "Expected {:x} bytes used, got {:x}", (pages + 1) * PAGE, used);
+
+    // The hot page keeps being used between passes
+    constexpr Address HOT = 3;
+    memory.WriteLong(BASE + HOT * PAGE, 7);
+
+    auto saved = memory.CompressColdPages();
+    auto stats = memory.GetCompressionStats();
+
+    ASSERT(stats.pages == pages - 1, "Packed {} pages, expected {}", stats.pages, pages - 1);
+    ASSERT(ram->SizeInMemory() == used - saved, "Used memory went from {:x} to {:x} saving {:x}", used, ram->SizeInMemory(), saved);
+    ASSERT(stats.packed_bytes <= stats.pages * MemoryRAM::PACKED_LIMIT, "Packed pages take {:x} bytes", stats.packed_bytes);
+
+    // Reading a packed page without faulting it in leaves it packed
+    Long peeked = 0;
+    memory.ReadBytes(BASE + PAGE + HALF * sizeof(Long), {reinterpret_cast<Byte*>(&peeked), sizeof(Long)});
+    ASSERT(peeked == Expected(1, HALF), "Peeked {:x} from a packed page", peeked);
+    ASSERT(memory.GetCompressionStats().pages == stats.pages, "Peeking unpacked the page");
+
+    for (Address page = 0; page < pages; page++) {
+        for (Address i = 0; i < MemoryRAM::LONGS_PER_PAGE; i++) {
+            auto value = memory.ReadLong(BASE + page * PAGE + i * sizeof(Long));
+            auto expected = page == HOT && i == 0 ? 7 : Expected(page, i);
+            ASSERT(value == expected, "Page {} word {} came back as {:x}, expected {:x}", page, i, value, expected);
+        }
+    }
+
+    stats = memory.GetCompressionStats();
+    ASSERT(stats.pages == 0 && stats.packed_bytes == 0 && stats.unpacked == pages - 1, "Reading every page left {} packed, {} unpacked", stats.pages, stats.unpacked);
+    ASSERT(ram->SizeInMemory() == used, "Unpacking left {:x} bytes used", ram->SizeInMemory());
+
+    // Under the high threshold nothing is packed
+    memory.SetCompressionThresholds(memory.GetUsedMemory() * 2, 0);
+    memory.CompressColdPages();
+    ASSERT(memory.CompressColdPages() == 0 && memory.GetCompressionStats().pages == 0, "Packed pages below the threshold");
+
+    SUCCESS;
+}
+
+DEFINE_SERIAL_TESTCASE(PAGE_COMPRESSION_COPIES) {
+    constexpr Address BASE = 0x100000;
+    constexpr Address PAGE = MemoryRAM::PAGE_SIZE;
+    constexpr int COPIERS = 4;
+
+    SETUP_MEMORY;
+    ADD_RAM(BASE, COPIERS * PAGE);
+
+    memory.SetCompressionThresholds(PAGE, 0);
+
+    // Device threads keep filling a page while passes pack it away whenever
+    // it went a period without a write
+    std::atomic<bool> done = false;
+    std::atomic<Long> lost = 0;
+
+    std::vector<std::jthread> copiers;
+    for (int copier = 0; copier < COPIERS; copier++) {
+        copiers.emplace_back([&, copier]() {
+            Address address = BASE + copier * PAGE;
+            std::vector<Byte> filled(PAGE), read(PAGE);
+
+            for (Long round = 0; !done; round++) {
+                std::fill(filled.begin(), filled.end(), static_cast<Byte>(round % 255 + 1));
+
+                memory.WriteBytes(address, filled);
+                memory.ReadBytes(address, read);
+
+                if (read != filled) lost++;
+            }
+        });
+    }
+
+    for (auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(Random<Long>(200, 400)); std::chrono::steady_clock::now() < end;)
+        memory.CompressColdPages();
+
+    done = true;
+    copiers.clear();
+
+    ASSERT(lost == 0, "{} fills went into pages the pass freed", lost.load());
+
+    SUCCESS;
+}
@@ -0,0 +1,118 @@
+#include "Test.hpp"
+
+#include <ELF.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+DEFINE_TESTCASE(PROFILER) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto adds = Random<Word>(1, 64);
+
+    std::vector<Word> program;
+    for (Word i = 0; i < adds; i++)
+        program.push_back(RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 1, RVInstruction::FUNCT3_ADDI, 1, 1));
+
+    // An all zero word is an illegal instruction, mcause 2
+    constexpr size_t ILLEGAL_INSTRUCTION = 0x2;
+    program.push_back(0);
+    memory.WriteWords(0x1000, program);
+
+    STEP_VMS(1);
+
+    auto profile = vm.GetProfile();
+    ASSERT(profile.instructions[static_cast<size_t>(RVInstruction::Type::ADDI)] == 0, "Counted an ADDI while profiling was off");
+
+    vm.SetProfiling(true);
+    STEP_VMS(adds);
+
+    profile = vm.GetProfile();
+
+    auto counted = profile.instructions[static_cast<size_t>(RVInstruction::Type::ADDI)];
+    ASSERT(counted == adds - 1, "Counted {} ADDIs, expected {}", counted, adds - 1);
+
+    auto illegal = profile.exceptions[ILLEGAL_INSTRUCTION];
+    ASSERT(illegal == 1, "Counted {} illegal instruction traps, expected 1", illegal);
+
+    auto name = Profiler::GetTypeName(RVInstruction::Type::ADDI);
+    ASSERT(name == "ADDI", "ADDI is named {}", name);
+
+    vm.ResetProfile();
+
+    profile = vm.GetProfile();
+    ASSERT(profile.exceptions[ILLEGAL_INSTRUCTION] == 0, "Reset kept the trap counts");
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(AUTOFDO) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto loops = Random<Word>(1000, 2000);
+
+    // x1 counts down to zero, branching back from 0x1008 to 0x1004
+    memory.WriteWord(0x1000, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 1, RVInstruction::FUNCT3_ADDI, 0, loops));
+    memory.WriteWord(0x1004, RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 1, RVInstruction::FUNCT3_ADDI, 1, 0xfff));
+    memory.WriteWord(0x1008, RV64_B(RVInstruction::OP_BRANCH, RVInstruction::FUNCT3_BNE, 1, 0, 0x1ffc));
+
+    vm.SetProfiling(true);
+    STEP_VMS(1 + 2 * loops);
+
+    ASSERT(vm.GetPC() == 0x100c, "The loop ended at {:x}", vm.GetPC());
+
+    auto profile = vm.GetProfile();
+
+    ASSERT(profile.branches.size() == 1, "Sampled {} different branches, expected 1", profile.branches.size());
+    ASSERT(profile.branches.begin()->first == Profiler::Edge(0x1008, 0x1004), "Sampled a branch from {:x} to {:x}", profile.branches.begin()->first.first, profile.branches.begin()->first.second);
+
+    // Every sample past the first sees a full stack
+    Long samples = (1 + 2 * loops) / Profiler::SAMPLE_PERIOD;
+    auto branches = profile.branches.begin()->second;
+    ASSERT(branches > (samples - 1) * Profiler::BRANCH_STACK && branches <= samples * Profiler::BRANCH_STACK, "Counted {} branches over {} samples", branches, samples);
+
+    ASSERT(profile.ranges.size() == 1, "Sampled {} different runs, expected 1", profile.ranges.size());
+    ASSERT(profile.ranges.begin()->first == Profiler::Edge(0x1004, 0x1008), "Sampled a run from {:x} to {:x}", profile.ranges.begin()->first.first, profile.ranges.begin()->first.second);
+    ASSERT(profile.ranges.begin()->second + samples == branches, "Counted {} runs for {} branches", profile.ranges.begin()->second, branches);
+
+    auto path = (std::filesystem::temp_directory_path() / "rv64_autofdo_test.txt").string();
+    std::vector<Profiler::Profile> profiles = {profile, profile};
+
+    auto ReadBack = [&]() {
+        std::ifstream file(path);
+        std::vector<std::string> lines;
+
+        for (std::string line; std::getline(file, line);)
+            lines.push_back(line);
+
+        return lines;
+    };
+
+    // Two harts' worth, summed, inside the function
+    SymbolTable loop({{"loop", 0x1000, 0x10, true}});
+    Profiler::WriteAutoFDO(path, profiles, &loop);
+
+    auto lines = ReadBack();
+    ASSERT(lines.size() == 5 + profile.pc_samples.size(), "The profile has {} lines", lines.size());
+    ASSERT(lines[0] == "1", "The profile lists {} runs", lines[0]);
+    ASSERT(lines[1] == std::format("1004-1008:{}", 2 * profile.ranges.begin()->second), "The run reads {}", lines[1]);
+    ASSERT(lines[2] == std::format("{}", profile.pc_samples.size()), "The profile lists {} addresses", lines[2]);
+    ASSERT(lines.back() == std::format("1008->1004:{}", 2 * branches), "The branch reads {}", lines.back());
+
+    // Code outside the image's functions is left out
+    SymbolTable elsewhere({{"elsewhere", 0x2000, 0x10, true}});
+    Profiler::WriteAutoFDO(path, profiles, &elsewhere);
+
+    lines = ReadBack();
+    ASSERT(lines == std::vector<std::string>({"0", "0", "0"}), "Kept {} lines outside the functions", lines.size());
+
+    std::filesystem::remove(path);
+
+    SUCCESS;
+}
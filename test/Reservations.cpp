@@ -0,0 +1,55 @@
+#include "Test.hpp"
+
+#include <thread>
+
+DEFINE_TESTCASE(RESERVATIONS) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Address COUNTER = 0x1040;
+
+    auto value = Random<Long>(1, 0xffffffff);
+
+    // A store anywhere in the reserved line breaks the reservation
+    memory.ReadLongReserved(COUNTER, 0);
+    memory.WriteLong(COUNTER + 8, value);
+    ASSERT(!memory.WriteLongConditional(COUNTER, value, 0), "SC succeeded after a store to its line");
+
+    // A store to the next line doesn't
+    memory.ReadLongReserved(COUNTER, 0);
+    memory.WriteLong(COUNTER + 0x40, value);
+    ASSERT(memory.WriteLongConditional(COUNTER, value, 0), "SC failed after a store to another line");
+    ASSERT(memory.ReadLong(COUNTER) == value, "SC stored {}, expected {}", memory.ReadLong(COUNTER), value);
+
+    ASSERT(!memory.WriteLongConditional(COUNTER, 0, 0), "SC succeeded without a reservation");
+
+    // The first SC to land invalidates the other hart
+    memory.ReadWordReserved(COUNTER, 0);
+    memory.ReadWordReserved(COUNTER, 1);
+    ASSERT(memory.WriteWordConditional(COUNTER, 1, 1), "Hart 1 SC failed");
+    ASSERT(!memory.WriteWordConditional(COUNTER, 2, 0), "Hart 0 SC succeeded after hart 1 stored");
+
+    memory.WriteLong(COUNTER, 0);
+
+    constexpr Hart HARTS = 4;
+    auto increments = Random<Long>(500, 2000);
+
+    {
+        std::vector<std::jthread> harts;
+        for (Hart hart = 0; hart < HARTS; hart++) {
+            harts.emplace_back([&, hart]() {
+                for (Long i = 0; i < increments; i++) {
+                    while (true) {
+                        auto current = memory.ReadLongReserved(COUNTER, hart);
+                        if (memory.WriteLongConditional(COUNTER, current + 1, hart)) break;
+                    }
+                }
+            });
+        }
+    }
+
+    auto counted = memory.ReadLong(COUNTER);
+    ASSERT(counted == HARTS * increments, "Counter reached {}, expected {}", counted, HARTS * increments);
+
+    SUCCESS;
+}
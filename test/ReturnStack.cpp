@@ -0,0 +1,131 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(RETURN_STACK) {
+    using Type = RVInstruction::Type;
+
+    auto loops = Random<Long>(20, 200);
+
+    // A loop calling a function and taking an indirect jump every time
+    std::vector<Word> program = {
+        RVInstruction::Encode(Type::ADDI, 10, 10, 0, 1),
+        RVInstruction::Encode(Type::JAL, 1, 0, 0, 0x1c),
+        RVInstruction::Encode(Type::AUIPC, 6, 0, 0, 0),
+        RVInstruction::Encode(Type::JALR, 0, 6, 0, 8),
+        RVInstruction::Encode(Type::BNE, 0, 10, 12, -0x10),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0),
+        RVInstruction::Encode(Type::ADDI, 0, 0, 0, 0),
+        RVInstruction::Encode(Type::ADDI, 0, 0, 0, 0),
+        RVInstruction::Encode(Type::ADDI, 9, 9, 0, 3),
+        RVInstruction::Encode(Type::JALR, 0, 1, 0, 0)
+    };
+
+    constexpr Address FUNCTION = 0x1000 + 8 * 4;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+    memory.WriteWords(0x1000, program);
+
+    vms.emplace_back(memory, 0x1000, 1);
+    auto& reference = vms[1];
+    reference.Start();
+
+    auto Compare = [&](Long total) -> std::optional<std::string> {
+        vm.StepBlocks(total);
+        reference.Step(total);
+
+        if (vm.GetPC() != reference.GetPC())
+            return std::format("Blocks stopped at {:x}, the interpreter at {:x}", vm.GetPC(), reference.GetPC());
+
+        for (size_t reg = 0; reg < VirtualMachine::REGISTER_COUNT; reg++) {
+            auto value = vm.GetRegister(reg).Value().u64;
+            auto expected = reference.GetRegister(reg).Value().u64;
+            if (value != expected) return std::format("x{} is {:x}, expected {:x}", reg, value, expected);
+        }
+
+        return std::nullopt;
+    };
+
+    vm.GetRegister(12).Value().u64 = loops;
+    reference.GetRegister(12).Value().u64 = loops;
+
+    auto difference = Compare(loops * 7);
+    ASSERT(!difference, "{}", difference.value_or(""));
+
+    // Only the first return and indirect jump have to look their block up
+    auto rate = vm.GetIndirectHitRate();
+    ASSERT(rate >= 0.9, "Only {:.2f} of returns and indirect jumps were predicted", rate);
+
+    // Predicted blocks of rewritten code are rebuilt, not reused
+    memory.WriteWord(FUNCTION, RVInstruction::Encode(Type::ADDI, 9, 9, 0, 5));
+
+    vm.SetPC(0x1000);
+    reference.SetPC(0x1000);
+    vm.GetRegister(10).Value().u64 = reference.GetRegister(10).Value().u64 = 0;
+
+    difference = Compare(loops * 7);
+    ASSERT(!difference, "After rewriting the function: {}", difference.value_or(""));
+
+    SUCCESS;
+}
+
+DEFINE_TESTCASE(RETURN_STACK_COROUTINES) {
+    using Type = RVInstruction::Type;
+
+    constexpr Long YIELDS = 128;
+    constexpr Address RESUME = 0x1000 + 4 * 4;
+
+    auto rounds = Random<Long>(4, 8);
+
+    // Two coroutines swapping through ra and t0. Each swap pops the side it
+    // resumes and pushes itself, so the stack predicts every resume. The
+    // second side yields from far more places than the indirect jump cache
+    // holds, so nothing else could
+    std::vector<Word> program = {
+        RVInstruction::Encode(Type::ADDI, 10, 10, 0, 1),
+        RVInstruction::Encode(Type::JALR, 1, 5, 0, 0),
+        RVInstruction::Encode(Type::BNE, 0, 10, 12, -8),
+        RVInstruction::Encode(Type::JAL, 0, 0, 0, 0)
+    };
+
+    for (Long i = 0; i < YIELDS; i++) {
+        program.push_back(RVInstruction::Encode(Type::ADDI, 9, 9, 0, i));
+        program.push_back(RVInstruction::Encode(Type::JALR, 5, 1, 0, 0));
+    }
+
+    program.push_back(RVInstruction::Encode(Type::JAL, 0, 0, 0, -YIELDS * 8));
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+    memory.WriteWords(0x1000, program);
+
+    vms.emplace_back(memory, 0x1000, 1);
+    auto& reference = vms[1];
+    reference.Start();
+
+    for (auto& cur_vm : vms) {
+        cur_vm.GetRegister(5).Value().u64 = RESUME;
+        cur_vm.GetRegister(12).Value().u64 = rounds * YIELDS;
+    }
+
+    Long total = rounds * YIELDS * 6;
+    vm.StepBlocks(total);
+    reference.Step(total);
+
+    ASSERT(vm.GetPC() == reference.GetPC(), "Blocks stopped at {:x}, the interpreter at {:x}", vm.GetPC(), reference.GetPC());
+
+    for (size_t reg = 0; reg < VirtualMachine::REGISTER_COUNT; reg++) {
+        auto value = vm.GetRegister(reg).Value().u64;
+        auto expected = reference.GetRegister(reg).Value().u64;
+        ASSERT(value == expected, "x{} is {:x}, expected {:x}", reg, value, expected);
+    }
+
+    // Only the first round's resumes of the second side miss
+    auto rate = vm.GetIndirectHitRate();
+    ASSERT(rate >= 0.7, "Only {:.2f} of the swaps were predicted", rate);
+
+    SUCCESS;
+}
@@ -0,0 +1,63 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(REWIND) {
+    SETUP_MEMORY;
+    ADD_RAM(0x1000, 0x8000);
+
+    constexpr Address DATA = 0x5000;
+    constexpr Address SCRATCH = 0x6000;
+
+    auto value = Random<Long>(1, UINT32_MAX);
+
+    std::vector<Word> program = {
+        RV64_U(RVInstruction::OP_LUI, 8, DATA >> 12),
+        RV64_U(RVInstruction::OP_LUI, 9, SCRATCH >> 12),
+        RV64_I(RVInstruction::OP_LOAD, 5, RVInstruction::FUNCT3_LD, 8, 0),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 5, 1),
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 5, 0),
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 9, 5, 8),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 5, VirtualMachine::CSR_MSCRATCH)
+    };
+
+    memory.WriteWords(0x1000, program);
+    memory.WriteLong(DATA, value);
+    memory.Freeze();
+
+    SETUP_VM(0x1000);
+
+    auto ram = memory.FindMemoryRegionOfType<MemoryRAM>(MemoryRegion::TYPE_GENERAL_RAM);
+    Long held = 0;
+
+    auto ReadScratch = [&]() {
+        std::unordered_map<Long, Long> csrs;
+        vm.GetCSRSnapshot(csrs);
+        return csrs[VirtualMachine::CSR_MSCRATCH];
+    };
+
+    for (int run = 0; run < 3; run++) {
+        vm.Step(program.size());
+
+        ASSERT(memory.ReadLong(DATA) == value + 1, "Run {} stored {:x}, expected {:x}", run, memory.ReadLong(DATA), value + 1);
+        ASSERT(memory.ReadLong(SCRATCH + 8) == value + 1, "Run {} left {:x} on the scratch page", run, memory.ReadLong(SCRATCH + 8));
+        ASSERT(ReadScratch() == value + 1, "Run {} left mscratch at {:x}", run, ReadScratch());
+
+        // The hart changes its own code, which the rewind takes back
+        memory.WriteWord(0x1000 + 3 * sizeof(Word), RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 5, 2));
+
+        // Later runs write the same pages, which were kept from the first
+        if (run == 0) held = ram->SizeInMemory();
+        ASSERT(ram->SizeInMemory() == held, "Run {} holds {:x} bytes, the first held {:x}", run, ram->SizeInMemory(), held);
+
+        memory.Rewind();
+        vm.Reset(0x1000);
+
+        ASSERT(memory.ReadLong(DATA) == value, "Rewound data reads {:x}, expected {:x}", memory.ReadLong(DATA), value);
+        ASSERT(memory.ReadLong(SCRATCH + 8) == 0, "The scratch page wasn't zeroed");
+        ASSERT(memory.ReadWord(0x1000 + 3 * sizeof(Word)) == program[3], "The program wasn't put back");
+        ASSERT(ReadScratch() == 0, "mscratch survived the reset");
+        ASSERT(vm.GetPC() == 0x1000 && vm.GetCycles() == 0, "The hart reset to pc {:x} after {} cycles", vm.GetPC(), vm.GetCycles());
+        ASSERT(vm.GetHartID() == 0, "Reset lost the hart id");
+    }
+
+    SUCCESS;
+}
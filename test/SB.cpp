@@ -0,0 +1,46 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(SB) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto base = Random<Address>(0x2, 0x10000) * MemoryRAM::PAGE_SIZE;
+
+    ADD_RAM(base, 0x1000);
+
+    auto offset = Random<Address>(0, 0x7ff);
+    auto target = base + offset;
+
+    auto neighbours = Random<Long>(0, LONG_MAX);
+    memory.WriteLong(target & ~7ULL, neighbours);
+
+    auto value = Random<Long>(0, LONG_MAX);
+
+    auto sel_rs1 = Random<size_t>(1, VirtualMachine::REGISTER_COUNT);
+    auto sel_rs2 = Random<size_t>(1, VirtualMachine::REGISTER_COUNT);
+    while (sel_rs2 == sel_rs1)
+        sel_rs2 = Random<size_t>(1, VirtualMachine::REGISTER_COUNT);
+
+    vm.GetRegister(sel_rs1).Value().u64 = base;
+    vm.GetRegister(sel_rs2).Value().u64 = value;
+
+    memory.WriteWord(0x1000, RV64_S(
+        RVInstruction::OP_STORE,
+        RVInstruction::FUNCT3_SB,
+        sel_rs1,
+        sel_rs2,
+        offset
+    ));
+
+    STEP_VMS(1);
+
+    auto shift = (target & 7) * 8;
+    Long expected = (neighbours & ~(0xffULL << shift)) | ((value & 0xff) << shift);
+    auto got = memory.ReadLong(target & ~7ULL);
+
+    ASSERT(got == expected, "Wrong bytes around {:x}. Expected {:x}, got {:x}", target, expected, got);
+
+    SUCCESS;
+}
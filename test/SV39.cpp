@@ -0,0 +1,81 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(SV39) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x20000);
+
+    constexpr Address root = 0x10000;
+    constexpr Address code_l1 = 0x11000;
+    constexpr Address code_l0 = 0x12000;
+    constexpr Address data_l1 = 0x13000;
+    constexpr Address data_l0 = 0x14000;
+    constexpr Address old_page = 0x15000;
+    constexpr Address new_page = 0x16000;
+
+    constexpr Long V = 1 << 0, R = 1 << 1, W = 1 << 2, X = 1 << 3, A = 1 << 6, D = 1 << 7;
+
+    auto Pointer = [](Address table) { return (table >> 12) << 10 | V; };
+    auto Leaf = [](Address page, Long flags) { return (page >> 12) << 10 | flags | V | A; };
+
+    auto vpn_2 = Random<Address>(1, 0x100);
+    auto vpn_1 = Random<Address>(0, 0x200);
+    auto vpn_0 = Random<Address>(0, 0x200);
+    auto offset = Random<Address>(0, 0x200) * 8;
+
+    Address virt = (vpn_2 << 30) | (vpn_1 << 21) | (vpn_0 << 12) | offset;
+
+    // The code page at 0x2000 is identity mapped
+    memory.WriteLong(root, Pointer(code_l1));
+    memory.WriteLong(code_l1, Pointer(code_l0));
+    memory.WriteLong(code_l0 + 2 * 8, Leaf(0x2000, R | X));
+
+    memory.WriteLong(root + vpn_2 * 8, Pointer(data_l1));
+    memory.WriteLong(data_l1 + vpn_1 * 8, Pointer(data_l0));
+    memory.WriteLong(data_l0 + vpn_0 * 8, Leaf(old_page, R | W | D));
+
+    auto old_value = Random<Long>(0, LONG_MAX);
+    auto new_value = Random<Long>(0, LONG_MAX);
+    memory.WriteLong(old_page + offset, old_value);
+    memory.WriteLong(new_page + offset, new_value);
+
+    vm.GetRegister(10).Value().u64 = (8ULL << 60) | (root >> 12);
+    vm.GetRegister(11).Value().u64 = 0x2000;
+    vm.GetRegister(12).Value().u64 = 1 << 11;
+    vm.GetRegister(13).Value().u64 = virt;
+
+    memory.WriteWords(0x1000, {
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 10, VirtualMachine::CSR_SATP),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 11, VirtualMachine::CSR_MEPC),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 12, VirtualMachine::CSR_MSTATUS),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_MRET)
+    });
+
+    memory.WriteWords(0x2000, {
+        RV64_I(RVInstruction::OP_LOAD, 5, RVInstruction::FUNCT3_LD, 13, 0),
+        RV64_I(RVInstruction::OP_LOAD, 6, RVInstruction::FUNCT3_LD, 13, 0),
+        RV64_R(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, 0, RVInstruction::FUNCT7_SFENCE_VMA),
+        RV64_I(RVInstruction::OP_LOAD, 7, RVInstruction::FUNCT3_LD, 13, 0)
+    });
+
+    STEP_VMS(5);
+
+    ASSERT(vm.IsUsingVirtualMemory(), "Hart did not enter Sv39");
+
+    auto got = vm.GetRegister(5).Value().u64;
+    ASSERT(got == old_value, "Load through {:x} expected {:x}, got {:x}", virt, old_value, got);
+
+    // Remap without a fence. The stale TLB entry must be used until SFENCE.VMA
+    memory.WriteLong(data_l0 + vpn_0 * 8, Leaf(new_page, R | W | D));
+
+    STEP_VMS(3);
+
+    got = vm.GetRegister(6).Value().u64;
+    ASSERT(got == old_value, "Remapped page seen before SFENCE.VMA. Expected {:x}, got {:x}", old_value, got);
+
+    got = vm.GetRegister(7).Value().u64;
+    ASSERT(got == new_value, "Stale mapping used after SFENCE.VMA. Expected {:x}, got {:x}", new_value, got);
+
+    SUCCESS;
+}
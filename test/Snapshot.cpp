@@ -0,0 +1,75 @@
+#include "Test.hpp"
+
+#include <Snapshot.hpp>
+
+#include <filesystem>
+
+DEFINE_TESTCASE(SNAPSHOT) {
+    constexpr Address CODE = 0x1000;
+    constexpr Address DATA = 0x10000;
+    constexpr Address DATA_SIZE = 0x10000;
+
+    // Stores a climbing counter into consecutive longs of mapped RAM
+    std::vector<Word> program = {
+        RV64_U(RVInstruction::OP_LUI, 8, DATA >> 12),
+        RV64_S(RVInstruction::OP_STORE, RVInstruction::FUNCT3_SD, 8, 5, 0),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 8, RVInstruction::FUNCT3_ADDI, 8, 8),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 5, 1),
+        RV64_J(RVInstruction::OP_JAL, 0, -12)
+    };
+
+    auto Build = [&](Memory& memory) {
+        memory.AddMemoryRegion(MemoryRAM::Create(CODE, 0x1000));
+        memory.AddMemoryRegion(MemoryMappedRAM::Create(DATA, DATA_SIZE));
+    };
+
+    SETUP_MEMORY;
+    Build(memory);
+    memory.WriteWords(CODE, program);
+
+    SETUP_VM(CODE);
+
+    auto before = Random<Long>(10, 2000);
+    auto after = Random<Long>(10, 2000);
+
+    STEP_VMS(before);
+
+    auto path = (std::filesystem::temp_directory_path() / "rv64_snapshot_test.bin").string();
+    Snapshot::Save(path, memory, {&vm});
+
+    STEP_VMS(after);
+
+    std::array<VirtualMachine::Reg, VirtualMachine::REGISTER_COUNT> expected_regs;
+    std::array<Float, VirtualMachine::REGISTER_COUNT> expected_fregs;
+    Long expected_pc;
+    vm.GetSnapshot(expected_regs, expected_fregs, expected_pc);
+
+    auto expected_data = memory.ReadLongs(DATA, DATA_SIZE / sizeof(Long));
+
+    // Every restore from the same file starts from the same warm state
+    for (int run = 0; run < 2; run++) {
+        Memory restored_memory;
+        Build(restored_memory);
+
+        VirtualMachine restored(restored_memory, 0, 0);
+        Snapshot::Restore(path, restored_memory, {&restored});
+
+        restored.Step(after);
+
+        std::array<VirtualMachine::Reg, VirtualMachine::REGISTER_COUNT> regs;
+        std::array<Float, VirtualMachine::REGISTER_COUNT> fregs;
+        Long pc;
+        restored.GetSnapshot(regs, fregs, pc);
+
+        ASSERT(pc == expected_pc, "Restored hart ended at {:x}, expected {:x}", pc, expected_pc);
+        ASSERT(regs[5].u64 == expected_regs[5].u64, "Restored counter is {}, expected {}", regs[5].u64, expected_regs[5].u64);
+        ASSERT(restored.GetCycles() == vm.GetCycles(), "Restored hart ran {} cycles, expected {}", restored.GetCycles(), vm.GetCycles());
+
+        auto data = restored_memory.ReadLongs(DATA, DATA_SIZE / sizeof(Long));
+        ASSERT(data == expected_data, "Restored RAM differs after {} steps", after);
+    }
+
+    std::filesystem::remove(path);
+
+    SUCCESS;
+}
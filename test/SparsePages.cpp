@@ -0,0 +1,41 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(SPARSE_PAGES) {
+    constexpr Address SIZE = 64ULL << 30;
+
+    SETUP_MEMORY;
+    memory.AddMemoryRegion(MemoryRAM::Create(0x1000, SIZE));
+
+    // Pages far apart land in different leaves of the table
+    std::vector<Address> touched;
+    for (int i = 0; i < 8; i++)
+        touched.push_back(0x1000 + (Random<Address>(0, SIZE) & ~(Memory::PAGE_SIZE - 1)));
+
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+    for (auto address : touched)
+        memory.WriteLong(address, address);
+
+    auto ram = memory.FindMemoryRegionOfType<MemoryRAM>(MemoryRegion::TYPE_GENERAL_RAM);
+    ASSERT(ram->SizeInMemory() == touched.size() * Memory::PAGE_SIZE, "{} pages touched, {:x} bytes resident", touched.size(), ram->SizeInMemory());
+
+    for (auto address : touched)
+        ASSERT(memory.ReadLong(address) == address, "Page at {:x} lost its store", address);
+
+    // Saved pages are exactly the touched ones, on both sides of a clone
+    auto saved = ram->GetSavedPages();
+    ASSERT(saved.size() == touched.size() && saved.front() == touched.front() - 0x1000, "{} pages saved for {} touched", saved.size(), touched.size());
+
+    auto clone = memory.Clone();
+    auto cloned_ram = clone->FindMemoryRegionOfType<MemoryRAM>(MemoryRegion::TYPE_GENERAL_RAM);
+
+    clone->WriteLong(touched.back(), 1);
+    ASSERT(memory.ReadLong(touched.back()) == touched.back(), "Clone's store reached the parent");
+    ASSERT(cloned_ram->GetSavedPages().size() == touched.size(), "Clone saves {} pages", cloned_ram->GetSavedPages().size());
+
+    ram->DiscardPages();
+    ASSERT(ram->GetSavedPages().empty() && memory.ReadLong(touched.front()) == 0, "Discarded pages still read back");
+
+    SUCCESS;
+}
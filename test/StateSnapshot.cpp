@@ -0,0 +1,66 @@
+#include "Test.hpp"
+
+#include <atomic>
+#include <thread>
+
+DEFINE_TESTCASE(STATE_SNAPSHOT) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    // x1 counts up and x2 follows it doubled one instruction later, so a
+    // torn read shows up as a pair that disagrees with the pc
+    memory.WriteWords(0x1000, {
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 1, RVInstruction::FUNCT3_ADDI, 1, 1),
+        RV64_R(RVInstruction::OP_MATH, 2, RVInstruction::FUNCT3_ADD_SUB_MUL, 1, 1, RVInstruction::FUNCT7_ADD),
+        RV64_J(RVInstruction::OP_JAL, 0, -8)
+    });
+
+    // Nothing is published until a reader asks
+    vm.Step(3);
+    ASSERT(vm.GetStateVersion() == 0, "Published without a reader");
+
+    auto state = std::make_unique<VirtualMachine::HartState>();
+    ASSERT(!vm.ReadState(*state), "State read before the hart published one");
+    auto steps = Random<Long>(1, 100);
+    vm.Step(steps);
+
+    ASSERT(vm.ReadState(*state), "No state after a step");
+    ASSERT(state->pc == vm.GetPC(), "Published pc {:x}, hart is at {:x}", state->pc, vm.GetPC());
+    ASSERT(state->regs[1].u64 == vm.GetRegister(1).Value().u64, "x1 is {}, hart has {}", state->regs[1].u64, vm.GetRegister(1).Value().u64);
+    ASSERT(state->cycles == vm.GetCycles(), "Published {} cycles of {}", state->cycles, vm.GetCycles());
+
+    std::unordered_map<Long, Long> csrs;
+    vm.GetCSRSnapshot(csrs);
+    for (const auto& [csr, value] : csrs) {
+        if (csr == VirtualMachine::CSR_TIME) continue;
+        ASSERT(state->csrs[csr] == value, "CSR {:x} published as {:x}, snapshot has {:x}", csr, state->csrs[csr], value);
+    }
+
+    // A reader on another thread never sees a torn state
+    std::atomic<bool> done = false;
+    std::atomic<Long> torn = 0;
+    std::atomic<Long> reads = 0;
+
+    std::thread reader([&] {
+        auto seen = std::make_unique<VirtualMachine::HartState>();
+        while (!done.load()) {
+            if (!vm.ReadState(*seen)) continue;
+
+            auto lag = seen->pc == 0x1004 ? 1 : 0;
+            if (seen->regs[2].u64 != (seen->regs[1].u64 - lag) * 2) torn++;
+            reads++;
+        }
+    });
+
+    for (int i = 0; i < 2000; i++)
+        vm.Step(Random<Long>(1, 50));
+
+    done = true;
+    reader.join();
+
+    ASSERT(torn == 0, "{} of {} reads were torn", torn.load(), reads.load());
+
+    SUCCESS;
+}
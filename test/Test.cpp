@@ -1,43 +1,151 @@
 #include "Test.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <ctime>
+#include <functional>
+#include <thread>
 
 std::vector<__TestCase*> __TestCase::test_cases;
 
-void __TestCase::RunTestCases(size_t iterations) {
-    std::cout << std::format("Running {} test cases", test_cases.size()) << std::endl;
+static thread_local std::unique_ptr<Memory> fixture_memory;
+static thread_local bool fixture_in_use = false;
+
+static Memory& GetFixtureMemory() {
+    if (!fixture_memory) fixture_memory = std::make_unique<Memory>();
+    return *fixture_memory;
+}
+
+// A scope that sets up memory while another one holds the fixture gets a
+// Memory of its own
+__TestCase::MemoryFixture::MemoryFixture() : owned{fixture_in_use ? std::make_unique<Memory>() : nullptr}, memory{owned ? *owned : GetFixtureMemory()} {
+    if (!owned) fixture_in_use = true;
+}
+
+__TestCase::MemoryFixture::~MemoryFixture() {
+    if (owned) return;
+
+    memory.Reset();
+    fixture_in_use = false;
+}
+
+namespace {
+    enum class Outcome {
+        Passed,
+        Failed,
+        Excepted
+    };
+
+    struct Result {
+        Outcome outcome = Outcome::Passed;
+        std::string message;
+        double milliseconds = 0;
+    };
+}
+
+static Result RunTestCase(__TestCase& test_case, size_t iterations) {
+    Result result;
+    auto start = std::chrono::steady_clock::now();
+
+    try {
+        for (size_t i = 0; i < iterations && result.outcome == Outcome::Passed; i++) {
+            auto run = test_case.Run();
+
+            if (!run.HasValue()) {
+                result.outcome = Outcome::Failed;
+                result.message = run.Error();
+            }
+        }
+    }
+    catch (std::exception& e) {
+        result.outcome = Outcome::Excepted;
+        result.message = e.what();
+    }
+
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+bool __TestCase::RunTestCases(const Options& options) {
+    std::vector<__TestCase*> selected;
+    for (auto test_case : test_cases) {
+        auto desc = test_case->GetDescription();
+        bool wanted = options.filters.empty() || std::any_of(options.filters.begin(), options.filters.end(), [&](auto& filter) { return desc.find(filter) != std::string::npos; });
+
+        if (wanted) selected.push_back(test_case);
+    }
+
+    size_t threads = options.threads != 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1U);
+
+    std::cout << std::format("Running {} test cases on {} threads", selected.size(), threads) << std::endl;
+
+    std::vector<Result> results(selected.size());
+    auto start = std::chrono::steady_clock::now();
+
+    // Shards take the next parallel case as they free up, so one slow case
+    // doesn't hold back the cases queued behind it
+    {
+        std::atomic<size_t> next = 0;
+        std::vector<std::jthread> shards;
+
+        for (size_t i = 0; i < threads; i++) {
+            shards.emplace_back([&]() {
+                for (size_t index = next++; index < selected.size(); index = next++) {
+                    if (!selected[index]->serial)
+                        results[index] = RunTestCase(*selected[index], options.iterations);
+                }
+            });
+        }
+    }
+
+    for (size_t index = 0; index < selected.size(); index++) {
+        if (selected[index]->serial)
+            results[index] = RunTestCase(*selected[index], options.iterations);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
     std::vector<std::string> failed;
     std::vector<std::string> excepted;
     size_t passed = 0;
 
-    for (auto& test_case : test_cases) {
-        auto desc = test_case->GetDescription();
-        try {
-            bool success = true;
-
-            for (size_t i = 0; i < iterations; i++) {
-                auto result = test_case->Run();
-                
-                if (!result.HasValue()) {
-                    std::cout << std::format("Test '{}' failed: {}", desc, result.Error()) << std::endl;
-                    failed.push_back(desc);
-                    success = false;
-                    break;
-                }
-            }
+    for (size_t index = 0; index < selected.size(); index++) {
+        auto desc = selected[index]->GetDescription();
+        auto& result = results[index];
 
-            if (success) {
-                std::cout << std::format("Test '{}' passed", desc) << std::endl;
+        switch (result.outcome) {
+            case Outcome::Passed:
+                std::cout << std::format("Test '{}' passed in {:.1f} ms", desc, result.milliseconds) << std::endl;
                 ++passed;
-            }
-        }
-        catch (std::exception& e) {
-            std::cout << std::format("Test '{}' threw an exception: {}", desc, e.what()) << std::endl;
-            excepted.push_back(desc);
+                break;
+
+            case Outcome::Failed:
+                std::cout << std::format("Test '{}' failed: {}", desc, result.message) << std::endl;
+                failed.push_back(desc);
+                break;
+
+            case Outcome::Excepted:
+                std::cout << std::format("Test '{}' threw an exception: {}", desc, result.message) << std::endl;
+                excepted.push_back(desc);
+                break;
         }
     }
-    
-    std::cout << std::format("Passed {}, failed {}, excepted {}", passed, failed.size(), excepted.size()) << std::endl;
+
+    // The slowest cases are the ones worth looking at
+    std::vector<size_t> by_time(selected.size());
+    for (size_t i = 0; i < by_time.size(); i++)
+        by_time[i] = i;
+
+    std::sort(by_time.begin(), by_time.end(), [&](size_t a, size_t b) { return results[a].milliseconds > results[b].milliseconds; });
+
+    std::cout << "Slowest:";
+    for (size_t i = 0; i < std::min<size_t>(5, by_time.size()); i++)
+        std::cout << std::format(" {} {:.1f} ms", selected[by_time[i]]->GetDescription(), results[by_time[i]].milliseconds);
+
+    std::cout << std::endl;
+
+    std::cout << std::format("Passed {}, failed {}, excepted {} in {:.2f} s", passed, failed.size(), excepted.size(), seconds) << std::endl;
 
     if (failed.size() != 0) {
         std::cout << "Test failed: ";
@@ -53,20 +161,23 @@ void __TestCase::RunTestCases(size_t iterations) {
 
         for (auto& desc : excepted)
             std::cout << desc << " ";
-        
+
         std::cout << std::endl;
     }
+
+    return failed.empty() && excepted.empty();
 }
 
+// Each runner thread draws its own sequence
 size_t RandomInt() {
-    static size_t state[4];
-    static bool init = false;
+    static thread_local size_t state[4];
+    static thread_local bool init = false;
 
     if (!init) {
         init = true;
-        auto time = std::time(nullptr);
+        auto seed = static_cast<size_t>(std::time(nullptr)) ^ std::hash<std::thread::id>()(std::this_thread::get_id());
 
-        state[0] = state[1] = state[2] = state[3] = static_cast<size_t>(time);
+        state[0] = state[1] = state[2] = state[3] = seed;
 
         RandomInt();
         RandomInt();
@@ -87,4 +198,4 @@ size_t RandomInt() {
     state[0] = t;
 
     return state[0] ^ state[1] ^ state[2] ^ state[3];
-}
\ No newline at end of file
+}
@@ -0,0 +1,52 @@
+#include "Test.hpp"
+
+DEFINE_SERIAL_TESTCASE(TRACER) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    constexpr Long ECALL_INDEX = 0x2ac;
+    VirtualMachine::RegisterECall(ECALL_INDEX, [](Hart, bool, Memory&, auto&, auto&) {});
+
+    // The handler skips the faulting word and returns
+    std::vector<Word> handler = {
+        RV64_I(RVInstruction::OP_CSR, 6, RVInstruction::FUNCT3_CSRRS, 0, VirtualMachine::CSR_MEPC),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 6, RVInstruction::FUNCT3_ADDI, 6, 4),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 6, VirtualMachine::CSR_MEPC),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_MRET)
+    };
+
+    // An all zero word is an illegal instruction, mcause 2
+    std::vector<Word> program = {
+        RV64_U(RVInstruction::OP_LUI, 5, 0x1),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 5, RVInstruction::FUNCT3_ADDI, 5, 0x100),
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 5, VirtualMachine::CSR_MTVEC),
+        0,
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 10, RVInstruction::FUNCT3_ADDI, 0, ECALL_INDEX),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_ECALL)
+    };
+
+    memory.WriteWords(0x1000, program);
+    memory.WriteWords(0x1100, handler);
+
+    vm.SetTracing(true);
+    STEP_VMS(program.size() + handler.size());
+
+    auto events = vm.GetTracer().GetEvents();
+
+    // Entry privilege change, trap span, return privilege change, ecall span
+    ASSERT(events.size() == 4, "Recorded {} events, expected 4", events.size());
+
+    using Kind = Tracer::Kind;
+
+    ASSERT(events[0].kind == Kind::Privilege && events[0].instant, "Trap entry did not record a privilege change");
+    ASSERT(events[1].kind == Kind::MachineTrap && !events[1].instant, "Trap span missing");
+    ASSERT(events[1].arg == 2 && events[1].detail == 0, "Trap span has cause {} interrupt {}", events[1].arg, events[1].detail);
+    ASSERT(events[2].kind == Kind::Privilege && events[2].instant, "MRET did not record a privilege change");
+    ASSERT(events[3].kind == Kind::ECall && events[3].arg == ECALL_INDEX, "ECall span missing");
+
+    ASSERT(events[1].start + events[1].duration <= events[3].start, "ECall started before the trap returned");
+
+    SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include "Test.hpp"
+
+DEFINE_TESTCASE(VECTOR) {
+    using Type = RVInstruction::Type;
+
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    // e32, m1, so VLEN / 32 elements
+    constexpr Long VTYPE_E32 = 0b010 << 3;
+    constexpr Long ELEMENTS = VirtualMachine::VLEN / 32;
+
+    constexpr Address A = 0x1800;
+    constexpr Address B = A + ELEMENTS * 4;
+    constexpr Address SUMS = 0x1900;
+    constexpr Address MASKED = 0x1a00;
+    constexpr Address STRIDED = 0x1b00;
+
+    std::vector<Word> a, b;
+    for (Long i = 0; i < ELEMENTS; i++) {
+        a.push_back(Random<Word>(0, 0xffffffff));
+        b.push_back(Random<Word>(0, 0xffffffff));
+    }
+
+    memory.WriteWords(A, a);
+    memory.WriteWords(B, b);
+
+    vm.GetRegister(1).Value().u64 = 0x600;
+    vm.GetRegister(3).Value().u64 = ELEMENTS;
+    vm.GetRegister(4).Value().u64 = A;
+    vm.GetRegister(5).Value().u64 = B;
+    vm.GetRegister(6).Value().u64 = SUMS;
+    vm.GetRegister(8).Value().u64 = 0xaa;
+    vm.GetRegister(9).Value().u64 = 8;
+    vm.GetRegister(10).Value().u64 = MASKED;
+    vm.GetRegister(11).Value().u64 = STRIDED;
+
+    auto scalar = Random<float>(-100.0f, 100.0f);
+    vm.GetFloatRegister(1).Value().f = scalar;
+
+    // Unmasked vector instructions take vm = 1 as rs3
+    memory.WriteWords(0x1000, {
+        RVInstruction::Encode(Type::CSRRS, 0, 1, 0, VirtualMachine::CSR_MSTATUS),
+        RVInstruction::Encode(Type::VSETVLI, 2, 3, 0, VTYPE_E32),
+        RVInstruction::Encode(Type::VLE32_V, 1, 4, 0, 0, 1),
+        RVInstruction::Encode(Type::VLE32_V, 2, 5, 0, 0, 1),
+        RVInstruction::Encode(Type::VADD_VV, 3, 2, 1, 0, 1),
+        RVInstruction::Encode(Type::VSE32_V, 3, 6, 0, 0, 1),
+        RVInstruction::Encode(Type::VREDSUM_VS, 4, 5, 1, 0, 1),
+        RVInstruction::Encode(Type::VMV_X_S, 7, 0, 4, 0, 1),
+        RVInstruction::Encode(Type::VMV_V_X, 0, 8, 0, 0, 1),
+        RVInstruction::Encode(Type::VADD_VI, 1, 0, 1, 5, 0),
+        RVInstruction::Encode(Type::VSE32_V, 1, 10, 0, 0, 1),
+        RVInstruction::Encode(Type::VLSE32_V, 6, 4, 9, 0, 1),
+        RVInstruction::Encode(Type::VSE32_V, 6, 11, 0, 0, 1),
+        RVInstruction::Encode(Type::VFMV_V_F, 8, 1, 0, 0, 1),
+        RVInstruction::Encode(Type::VFMUL_VV, 9, 8, 8, 0, 1),
+        RVInstruction::Encode(Type::VFMV_F_S, 2, 0, 9, 0, 1)
+    });
+
+    STEP_VMS(16);
+
+    auto vl = vm.GetRegister(2).Value().u64;
+    ASSERT(vl == ELEMENTS, "vsetvli gave vl {}, expected {}", vl, ELEMENTS);
+
+    Word sum = 0;
+    for (Long i = 0; i < ELEMENTS; i++) {
+        auto got = memory.ReadWord(SUMS + i * 4);
+        ASSERT(got == a[i] + b[i], "vadd.vv element {} gave {:x}, expected {:x}", i, got, a[i] + b[i]);
+
+        // 0xaa leaves the even elements inactive and undisturbed
+        Word masked = i % 2 ? a[i] + 5 : a[i];
+        got = memory.ReadWord(MASKED + i * 4);
+        ASSERT(got == masked, "Masked vadd.vi element {} gave {:x}, expected {:x}", i, got, masked);
+
+        // Every other word, running on from a into b
+        Word strided = i * 2 < ELEMENTS ? a[i * 2] : b[i * 2 - ELEMENTS];
+        got = memory.ReadWord(STRIDED + i * 4);
+        ASSERT(got == strided, "vlse32.v element {} gave {:x}, expected {:x}", i, got, strided);
+
+        sum += a[i];
+    }
+
+    // v5 starts zeroed, so the reduction is the sum of a alone
+    auto reduced = static_cast<Word>(vm.GetRegister(7).Value().u64);
+    ASSERT(reduced == sum, "vredsum.vs gave {:x}, expected {:x}", reduced, sum);
+
+    auto product = vm.GetFloatRegister(2).Value().f;
+    ASSERT(product == scalar * scalar, "vfmul.vv of {} gave {}, expected {}", scalar, product, scalar * scalar);
+
+    SUCCESS;
+}
@@ -0,0 +1,49 @@
+#include "Test.hpp"
+
+#include <thread>
+
+DEFINE_TESTCASE(WFI) {
+    SETUP_MEMORY;
+    SETUP_VM(0x1000);
+
+    ADD_RAM(0x1000, 0x1000);
+
+    auto value = Random<Long>(1, 0x800);
+
+    vm.GetRegister(2).Value().u64 = 1ULL << VirtualMachine::INTERRUPT_MACHINE_SOFTWARE;
+
+    memory.WriteWords(0x1000, {
+        RV64_I(RVInstruction::OP_CSR, 0, RVInstruction::FUNCT3_CSRRW, 2, VirtualMachine::CSR_MIE),
+        RV64_I(RVInstruction::OP_SYSTEM, 0, RVInstruction::FUNCT3_SYSTEM, 0, RVInstruction::IMM_WFI),
+        RV64_I(RVInstruction::OP_MATH_IMMEDIATE, 1, RVInstruction::FUNCT3_ADDI, 0, value),
+        RV64_J(RVInstruction::OP_JAL, 0, 0)
+    });
+
+    auto WaitFor = [](auto condition) {
+        auto start = std::chrono::steady_clock::now();
+        while (!condition() && std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+            std::this_thread::yield();
+    };
+
+    vm.Start();
+    std::thread hart([&]() { vm.Run(); });
+
+    WaitFor([&]() { return vm.IsWaitingForInterrupt(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    auto got = vm.GetRegister(1).Value().u64;
+    ASSERT(got == 0, "Hart ran past WFI without an interrupt, x1 is {:x}", got);
+
+    vm.RaiseInterrupt(VirtualMachine::INTERRUPT_MACHINE_SOFTWARE);
+
+    WaitFor([&]() { return vm.GetRegister(1).Value().u64 == value; });
+
+    vm.Stop();
+    hart.join();
+
+    got = vm.GetRegister(1).Value().u64;
+    ASSERT(got == value, "Interrupt did not wake the hart, x1 expected {:x}, got {:x}", value, got);
+
+    SUCCESS;
+}
@@ -1,9 +1,24 @@
 #include <RV64.hpp>
 
+#include <cstdlib>
+#include <string_view>
+
 #include "Test.hpp"
 
-int main() {
-    RVInstruction::SetupCSRNames();
-    
-    __TestCase::RunTestCases();
-}
\ No newline at end of file
+// --threads=N and --iterations=N, then the names of the cases to run
+int main(int argc, const char** argv) {
+    __TestCase::Options options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+
+        if (arg.starts_with("--threads="))
+            options.threads = std::strtoull(argv[i] + 10, nullptr, 0);
+        else if (arg.starts_with("--iterations="))
+            options.iterations = std::strtoull(argv[i] + 13, nullptr, 0);
+        else
+            options.filters.emplace_back(arg);
+    }
+
+    return __TestCase::RunTestCases(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
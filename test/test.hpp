@@ -7,6 +7,7 @@
 #include <format>
 #include <string>
 #include <type_traits>
+#include <memory>
 
 #include <VirtualMachine.hpp>
 #include <Expected.hpp>
@@ -17,26 +18,60 @@ private:
     static std::vector<__TestCase*> test_cases;
 
 public:
-    __TestCase(__TestCase* test_case) { test_cases.push_back(test_case); }
+    // Serial cases touch process wide state, like the ecall handlers, so
+    // they run one at a time once the parallel shards are done
+    const bool serial;
+
+    __TestCase(__TestCase* test_case, bool serial = false) : serial{serial} { test_cases.push_back(test_case); }
 
     virtual Expected<bool, std::string> Run() = 0;
 
     virtual std::string GetDescription() const = 0;
 
-    static void RunTestCases(size_t iterations = 50);
+    struct Options {
+        size_t iterations = 50;
+        // Shards the cases run across, 0 for one per host thread
+        size_t threads = 0;
+        // Only cases whose name contains one of these, all when empty
+        std::vector<std::string> filters;
+    };
+
+    // Returns whether every case passed
+    static bool RunTestCases(const Options& options);
+
+    // The Memory SETUP_MEMORY hands out, one per runner thread. It's reset
+    // when the scope that took it ends, so the next run reuses it
+    class MemoryFixture {
+    private:
+        std::unique_ptr<Memory> owned;
+
+    public:
+        Memory& memory;
+
+        MemoryFixture();
+        ~MemoryFixture();
+
+        MemoryFixture(const MemoryFixture&) = delete;
+        MemoryFixture& operator=(const MemoryFixture&) = delete;
+    };
 };
 
-#define DEFINE_TESTCASE(name)\
+#define DEFINE_TESTCASE_WITH(name, serial)\
 class __TestCase_##name : public __TestCase {\
 public:\
-    __TestCase_##name() : __TestCase(this) {}\
+    __TestCase_##name() : __TestCase(this, serial) {}\
     Expected<bool, std::string> Run() override;\
     std::string GetDescription() const override { return #name; }\
 };\
 __TestCase_##name __TestCase_##name##_Impl;\
 Expected<bool, std::string> __TestCase_##name::Run()
 
-#define SETUP_MEMORY Memory memory;
+#define DEFINE_TESTCASE(name) DEFINE_TESTCASE_WITH(name, false)
+#define DEFINE_SERIAL_TESTCASE(name) DEFINE_TESTCASE_WITH(name, true)
+
+#define SETUP_MEMORY\
+    __TestCase::MemoryFixture __memory_fixture;\
+    Memory& memory = __memory_fixture.memory;
 #define ADD_RAM(base, size) {\
     auto ram = MemoryRAM::Create(base, size);\
     memory.AddMemoryRegion(std::move(ram));\
@@ -64,16 +99,18 @@ Expected<bool, std::string> __TestCase_##name::Run()
     memory.AddMemoryRegion(std::move(rom));\
 }
 
+// Harts are built in place. Room for a few is reserved up front so vm
+// stays valid across the first ADD_VMs
 #define SETUP_VM(start)\
     std::vector<VirtualMachine> vms;\
-    vms.emplace_back(VirtualMachine(memory, start, 0));\
+    vms.reserve(8);\
+    vms.emplace_back(memory, start, 0);\
     auto& vm = vms[0];\
     vm.Start();
 
 #define ADD_VM(hart_id, start) {\
-    auto new_vm = VirtualMachine(memory, start, hart_id);\
-    new_vm.Start();\
-    vms.emplace_back(std::move(new_vm));\
+    vms.emplace_back(memory, start, hart_id);\
+    vms.back().Start();\
 }
 
 #define STEP_VMS(steps)\
@@ -91,46 +128,34 @@ Expected<bool, std::string> __TestCase_##name::Run()
     if (!(cond))\
         FAILURE(__VA_ARGS__);
 
+// Field order follows the instruction formats. The packing itself is the
+// decoder's, see RVInstruction::Fields and PackImmediate
 inline Word RV64_R(Word opcode, Word rd, Word funct3, Word rs1, Word rs2, Word funct7) {
-    RVInstructionWord iw;
-    iw.R = {opcode, rd, funct3, rs1, rs2, funct7};
-    return iw.raw;
+    return RVInstruction::Fields(opcode, funct3, funct7, rs2, rs1, rd);
 }
 
 inline Word RV64_R4(Word opcode, Word rd, Word funct3, Word rs1, Word rs2, Word funct2, Word rs3) {
-    RVInstructionWord iw;
-    iw.R4 = {opcode, rd, funct3, rs1, rs2, funct2, rs3};
-    return iw.raw;
+    return RVInstruction::Fields(opcode, funct3, rs3 << 2 | funct2, rs2, rs1, rd);
 }
 
 inline Word RV64_I(Word opcode, Word rd, Word funct3, Word rs1, Word imm) {
-    RVInstructionWord iw;
-    iw.I = {opcode, rd, funct3, rs1, imm};
-    return iw.raw;
+    return RVInstruction::Fields(opcode, funct3, 0, 0, rs1, rd) | RVInstruction::PackImmediate(RVInstruction::Format::I, imm);
 }
 
 inline Word RV64_S(Word opcode, Word funct3, Word rs1, Word rs2, Word imm) {
-    RVInstructionWord iw;
-    iw.S = {opcode, imm, funct3, rs1, rs2, imm >> 5};
-    return iw.raw;
+    return RVInstruction::Fields(opcode, funct3, 0, rs2, rs1) | RVInstruction::PackImmediate(RVInstruction::Format::S, imm);
 }
 
 inline Word RV64_B(Word opcode, Word funct3, Word rs1, Word rs2, Word imm) {
-    RVInstructionWord iw;
-    iw.B = {opcode, imm >> 11, imm >> 1, funct3, rs1, rs2, imm >> 5, imm >> 12};
-    return iw.raw;
+    return RVInstruction::Fields(opcode, funct3, 0, rs2, rs1) | RVInstruction::PackImmediate(RVInstruction::Format::B, imm);
 }
 
 inline Word RV64_U(Word opcode, Word rd, Word imm) {
-    RVInstructionWord iw;
-    iw.U = {opcode, rd, imm};
-    return iw.raw;
+    return RVInstruction::Fields(opcode, 0, 0, 0, 0, rd) | RVInstruction::PackImmediate(RVInstruction::Format::U, imm << 12);
 }
 
 inline Word RV64_J(Word opcode, Word rd, Word imm) {
-    RVInstructionWord iw;
-    iw.J = {opcode, rd, imm >> 12, imm >> 11, imm >> 1, imm >> 20};
-    return iw.raw;
+    return RVInstruction::Fields(opcode, 0, 0, 0, 0, rd) | RVInstruction::PackImmediate(RVInstruction::Format::J, imm);
 }
 
 size_t RandomInt();